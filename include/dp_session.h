@@ -255,4 +255,48 @@ int dp_session_pack(struct session *session, void *buf, uint32_t size,
  */
 int dp_session_restore(void *buf, uint32_t size, enum session_pack_type *spt);
 
+/**
+ * Serialize many sessions into the buffer.
+ *
+ * Used for a bulk resync.  Sessions are packed in session table order,
+ * starting after the session identified by cursor, until the table is
+ * finished or the buffer is full.  Start a walk with cursor set to 0, and
+ * keep calling with the returned cursor until it is 0 again.  The walk
+ * carries on from where the cursor session was in the table even if that
+ * session has since expired.
+ *
+ * SESSION_PACK_FULL packs every session that can be restored.
+ * SESSION_PACK_UPDATE packs only the sessions that have seen packets, or
+ * have expired, since they were last bulk packed, and only their states
+ * and stats.  The forward sentry is packed in place of both sentries.
+ *
+ * Must be called from an RCU read-side.
+ *
+ * @param [in, out] buf - session buffer pointer.
+ * @param [in] size - size of buffer
+ * @param [in] spt - SESSION_PACK_FULL, SESSION_PACK_UPDATE
+ * @param [in, out] cursor - where to start, and where to start next time
+ *
+ * @return - packed length on success
+ *   -errno on error.
+ */
+int dp_session_pack_bulk(void *buf, uint32_t size, enum session_pack_type spt,
+			 uint64_t *cursor);
+
+/**
+ * Restore or update all the sessions in a buffer from dp_session_pack_bulk().
+ *
+ * Separate buffers may be restored at the same time by different threads,
+ * so a resync may be spread over several cores.
+ *
+ * @param [in] buf - buffer to be restored
+ * @param [in] size - length of buffer
+ * @param [out] spt - pack type.
+ *
+ * @return - number of sessions restored or updated
+ *   -errno if the buffer is invalid.
+ */
+int dp_session_restore_bulk(void *buf, uint32_t size,
+			    enum session_pack_type *spt);
+
 #endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef VYATTA_DATAPLANE_DP_STATS_SHM_H
+#define VYATTA_DATAPLANE_DP_STATS_SHM_H
+
+/**
+ * Layout of the shared memory statistics segment.
+ *
+ * When enabled ("stats-shm enable <interval-ms>"), the dataplane master
+ * thread copies interface, NPF rule, QoS and CGNAT pool counters into a
+ * POSIX shared memory object at a fixed interval.  Collectors map the
+ * object read-only and read counters from it directly, without sending
+ * any commands to the dataplane.
+ *
+ * The segment starts with a struct dp_stats_shm_hdr.  Each section of
+ * records is described by an entry in the header's section table, giving
+ * its offset from the start of the segment, its record count and the size
+ * of each record.  Records may grow at the end in later minor changes, so
+ * readers must step through a section using rec_len rather than the size
+ * of the structures below.  A change that is not compatible bumps
+ * DP_STATS_SHM_VERSION.
+ *
+ * Per-lcore counters hold one copy for each of the header's nr_lcores
+ * lcores, to be summed by the reader.  Interface counters are those kept
+ * in software by the forwarding threads, and do not include the counters
+ * read from the hardware for physical ports.  Rule and QoS counters go
+ * back to zero when cleared by the op-mode clear commands, so a reader
+ * should treat a decrease as a reset.
+ *
+ * Snapshots are protected by a sequence lock.  seq is odd while the
+ * dataplane is writing a snapshot, and is incremented again once it is
+ * complete.  A reader should:
+ *
+ *	do {
+ *		seq = hdr->seq;			(atomic load, acquire)
+ *		if (seq & 1)
+ *			continue;
+ *		if (hdr->size > mapped size)
+ *			remap the object at hdr->size;
+ *		copy what is needed;
+ *		fence (acquire)
+ *	} while (hdr->seq != seq);
+ *
+ * The segment only ever grows.  The dataplane removes the object when the
+ * export is disabled, or when it exits.
+ */
+
+#include <stdint.h>
+
+/* Name of the POSIX shared memory object, for shm_open */
+#define DP_STATS_SHM_NAME	"/vyatta-dataplane-stats"
+
+#define DP_STATS_SHM_MAGIC	0x53545044	/* "DPTS" */
+#define DP_STATS_SHM_VERSION	1
+
+#define DP_STATS_SHM_IFNAMSIZ	16
+#define DP_STATS_SHM_NAMSIZ	64
+
+enum dp_stats_shm_section_type {
+	DP_STATS_SHM_SECT_IF,		/**< struct dp_stats_shm_if */
+	DP_STATS_SHM_SECT_RULE,		/**< struct dp_stats_shm_rule */
+	DP_STATS_SHM_SECT_QOS,		/**< struct dp_stats_shm_qos */
+	DP_STATS_SHM_SECT_NAT_POOL,	/**< struct dp_stats_shm_nat_pool */
+	DP_STATS_SHM_SECT_COUNT
+};
+
+struct dp_stats_shm_section {
+	uint32_t	type;		/**< enum dp_stats_shm_section_type */
+	uint32_t	rec_len;	/**< bytes per record */
+	uint64_t	offset;		/**< of the first record */
+	uint32_t	count;		/**< records in the section */
+	uint32_t	_pad;
+};
+
+struct dp_stats_shm_hdr {
+	uint32_t	magic;		/**< DP_STATS_SHM_MAGIC */
+	uint16_t	version;	/**< DP_STATS_SHM_VERSION */
+	uint16_t	hdr_len;	/**< bytes in this header */
+	uint64_t	seq;		/**< odd while being written */
+	uint64_t	size;		/**< bytes in the segment */
+	uint64_t	generation;	/**< snapshots written */
+	uint64_t	timestamp_ns;	/**< CLOCK_REALTIME of snapshot */
+	uint32_t	interval_ms;	/**< between snapshots */
+	uint32_t	nr_lcores;	/**< copies of per-lcore counters */
+	uint32_t	nr_sections;
+	uint32_t	_pad;
+	struct dp_stats_shm_section sections[DP_STATS_SHM_SECT_COUNT];
+};
+
+/*
+ * Interfaces
+ */
+
+/* Per-lcore interface counters, as struct if_data */
+struct dp_stats_shm_if_counters {
+	uint64_t	ipackets;
+	uint64_t	ierrors;
+	uint64_t	opackets;
+	uint64_t	oerrors;
+	uint64_t	ibytes;
+	uint64_t	obytes;
+	uint64_t	idropped;
+	uint64_t	odropped_txring;
+	uint64_t	odropped_hwq;
+	uint64_t	odropped_proto;
+	uint64_t	ibridged;
+	uint64_t	imulticast;
+	uint64_t	ivlan;
+	uint64_t	no_address;
+	uint64_t	no_vlan;
+	uint64_t	unknown;
+};
+
+struct dp_stats_shm_if {
+	uint32_t	ifindex;
+	char		ifname[DP_STATS_SHM_IFNAMSIZ];
+	uint32_t	_pad;
+	struct dp_stats_shm_if_counters lcore[];	/**< nr_lcores */
+};
+
+/*
+ * NPF rules, for each rule of each ruleset on each attach point
+ */
+
+struct dp_stats_shm_rule_counters {
+	uint64_t	packets;
+	uint64_t	bytes;
+};
+
+struct dp_stats_shm_rule {
+	uint32_t	hash;		/**< as in rule log messages */
+	uint32_t	rule_no;
+	char		ruleset[DP_STATS_SHM_IFNAMSIZ];	/**< e.g. "fw-in" */
+	char		attach_point[DP_STATS_SHM_NAMSIZ];
+	char		group[DP_STATS_SHM_NAMSIZ];
+	struct dp_stats_shm_rule_counters lcore[];	/**< nr_lcores */
+};
+
+/*
+ * QoS, for each subport of each interface with QoS
+ */
+
+struct dp_stats_shm_qos_tc {
+	uint64_t	packets;
+	uint64_t	bytes;
+	uint64_t	dropped;
+	uint64_t	random_dropped;
+};
+
+struct dp_stats_shm_qos {
+	uint32_t	ifindex;
+	uint32_t	subport;
+	uint32_t	vlan_id;
+	uint32_t	nr_tcs;
+	struct dp_stats_shm_qos_tc tc[];		/**< nr_tcs */
+};
+
+/*
+ * CGNAT pools
+ */
+
+struct dp_stats_shm_nat_pool {
+	char		name[DP_STATS_SHM_NAMSIZ];
+	uint32_t	naddrs;		/**< addresses in the pool */
+	uint32_t	addrs_used;	/**< with no free port blocks */
+	uint32_t	map_active;
+	uint32_t	pb_active;
+	uint64_t	map_reqs;
+	uint64_t	map_fails;
+	uint64_t	pb_allocs;
+	uint64_t	pb_fails;
+	uint64_t	pb_freed;
+	uint64_t	pb_limit;	/**< max blocks per user reached */
+};
+
+#endif /* VYATTA_DATAPLANE_DP_STATS_SHM_H */
@@ -143,6 +143,18 @@ Suite * dp_test_get_suite(const char *filename);
 	_DP_START_TEST(TESTCASE, TEST, DONT_RUN)
 #endif
 
+/*
+ * Only run the BENCH tests if DP_TEST_BENCH is defined.  These measure
+ * performance rather than checking behaviour.
+ */
+#ifdef DP_TEST_BENCH
+#define DP_START_TEST_BENCH(TESTCASE, TEST)			 \
+	_DP_START_TEST(TESTCASE, TEST, __attribute__((constructor)))
+#else
+#define DP_START_TEST_BENCH(TESTCASE, TEST)			 \
+	_DP_START_TEST(TESTCASE, TEST, DONT_RUN)
+#endif
+
 
 
 
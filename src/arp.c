@@ -55,6 +55,7 @@
 #include "if_llatbl.h"
 #include "if_var.h"
 #include "ip_addr.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "nh_common.h"
 #include "pktmbuf_internal.h"
@@ -238,7 +239,7 @@ lookup:
 	/* resolved now */
 	if (likely(la && (la->la_flags & LLE_VALID))) {
 resolved:
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_set_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
@@ -260,45 +261,25 @@ resolved:
 			  inet_ntop(AF_INET, &addr, b1, sizeof(b1)));
 	}
 
-	/* Lock entry to hold off update and timer */
-	rte_spinlock_lock(&la->ll_lock);
-
-	/*
-	 * Whilst waiting for the spin lock, has the master thread
-	 * snuck in and deleted the entry?
-	 */
-	if (unlikely(la->la_flags & LLE_DELETED)) {
-		rte_spinlock_unlock(&la->ll_lock);
+	/* Has the master thread deleted the entry? */
+	if (unlikely(la->la_flags & LLE_DELETED))
 		goto lookup;
-	}
 
 	/* create lost race with lladdr_update */
-	if (unlikely(la->la_flags & LLE_VALID)) {
-		rte_spinlock_unlock(&la->ll_lock);
+	if (unlikely(la->la_flags & LLE_VALID))
 		goto resolved;
-	}
 
 	/*
 	 * There is an arptab entry, but no ethernet address
-	 * response yet.  Add the mbuf to the list, dropping
-	 * the oldest packet if we have exceeded the system
-	 * setting.
+	 * response yet.  Hold the packet on this lcore's queue
+	 * until there is.
 	 */
-	if (la->la_numheld >= ARP_MAXHOLD) {
-		ARPSTAT_INC(if_vrfid(ifp), dropped);
-		rte_pktmbuf_free(la->la_held[0]);
-		memmove(&la->la_held[0], &la->la_held[1],
-			(ARP_MAXHOLD-1) * sizeof(la->la_held[0]));
-		la->la_held[ARP_MAXHOLD-1] = m;
-	} else
-		la->la_held[la->la_numheld++] = m;
+	ll_hold_pkt(ifp, la, m, ARP_MAXHOLD);
 
 	/*
 	 * Only send first request here, others handled by timer.
 	 */
-	bool send_request = (++la->la_asked == 1);
-	rte_spinlock_unlock(&la->ll_lock);
-	if (send_request) {
+	if (ll_hold_solicit(la)) {
 		struct sockaddr_in taddr = {
 			.sin_family = AF_INET,
 			.sin_addr.s_addr = addr,
@@ -439,8 +420,5 @@ arp_walk(const struct ifnet *ifp, ll_walkhash_f_t *f, void *arg)
 void
 arp_entry_destroy(struct lltable *llt, struct llentry *lle)
 {
-	unsigned int pkts_dropped;
-
-	pkts_dropped = llentry_destroy(llt, lle);
-	ARPSTAT_ADD(if_vrfid(llt->llt_ifp), dropped, pkts_dropped);
+	llentry_destroy(llt, lle);
 }
@@ -62,6 +62,7 @@
 #include "l2_rx_fltr.h"
 #include "l2tp/l2tpeth.h"
 #include "lag.h"
+#include "lcore_sched.h"
 #include "main.h"
 #include "master.h"
 #include "mstp.h"
@@ -487,6 +488,32 @@ static int cmd_ipsec_engine(FILE *f, int argc, char **argv)
 		return rc;
 	}
 
+	if (strcmp(argv[0], "parallel") == 0)
+		return crypto_engine_set_parallel(f, argc > 1 ? argv[1] : NULL);
+
+	if (strcmp(argv[0], "cryptodev") == 0) {
+		/*
+		 * The devices are created and started on the master thread,
+		 * so that this cannot race with the master's own device
+		 * handling.  Output on the master is lost, so the argument
+		 * is checked and the result shown here.
+		 */
+		if (!is_master_thread()) {
+			if (argc < 2 || (strcmp(argv[1], "on") &&
+					 strcmp(argv[1], "off")))
+				return crypto_rte_set(f, NULL);
+
+			rc = console_cmd_on_master(cmd_ipsec_engine,
+						   argc + 2, argv - 2);
+			if (rc < 0) {
+				fprintf(f, "error failed to set cryptodev\n");
+				return rc;
+			}
+			return crypto_engine_probe(f);
+		}
+		return crypto_rte_set(f, argc > 1 ? argv[1] : NULL);
+	}
+
 	fprintf(f, "Invalid IPsec command\n");
 	return -1;
 }
@@ -726,13 +753,71 @@ static int cmd_affinity(FILE *f, int argc, char **argv)
 	if (strcmp(argv[0], "show") == 0)
 		return show_affinity(f, argc, argv);
 
-	fprintf(f, "usage: affinity show ...\n");
+	if (strcmp(argv[0], "rebalance") == 0) {
+		show_rxq_rebalance(f);
+		return 0;
+	}
+
+	fprintf(f, "usage: affinity show|rebalance ...\n");
 	return -1;
 }
 
+/* Set RX queue rebalancing
+ *  affinity rebalance disable
+ *  affinity rebalance enable [threshold <pct>] [min-rate <pps>]
+ *                            [holddown <secs>]
+ */
+static int cmd_affinity_rebalance_cfg(FILE *f, int argc, char **argv)
+{
+	struct rxq_rebalance_params params;
+	unsigned int value;
+	bool enabled;
+
+	--argc, ++argv;		/* skip "rebalance" */
+	if (argc < 1) {
+		fprintf(f, "usage: affinity rebalance enable|disable ...\n");
+		return -1;
+	}
+
+	get_rxq_rebalance(&enabled, &params);
+
+	if (strcmp(argv[0], "disable") == 0) {
+		set_rxq_rebalance(false, NULL);
+		return 0;
+	}
+
+	if (strcmp(argv[0], "enable") != 0) {
+		fprintf(f, "usage: affinity rebalance enable|disable ...\n");
+		return -1;
+	}
+
+	for (--argc, ++argv; argc > 0; argc -= 2, argv += 2) {
+		if (argc < 2 || get_unsigned(argv[1], &value) < 0) {
+			fprintf(f, "rebalance %s: missing or bad value\n",
+				argv[0]);
+			return -1;
+		}
+
+		if (strcmp(argv[0], "threshold") == 0)
+			params.threshold = value;
+		else if (strcmp(argv[0], "min-rate") == 0)
+			params.min_rate = value;
+		else if (strcmp(argv[0], "holddown") == 0)
+			params.holddown = value;
+		else {
+			fprintf(f, "rebalance: unknown option %s\n", argv[0]);
+			return -1;
+		}
+	}
+
+	set_rxq_rebalance(true, &params);
+	return 0;
+}
+
 /* Set port affinity
  *  affinity <ifindex> delete     - restore default
  *  affinity <ifindex> set <mask> - set new mask for port
+ *  affinity rebalance ...        - load based RX queue placement
  */
 int cmd_affinity_cfg(FILE *f, int argc, char **argv)
 {
@@ -747,6 +832,9 @@ int cmd_affinity_cfg(FILE *f, int argc, char **argv)
 		return -1;
 	}
 
+	if (strcmp(argv[0], "rebalance") == 0)
+		return cmd_affinity_rebalance_cfg(f, argc, argv);
+
 	if (get_unsigned(argv[0], &ifindex) < 0) {
 		fprintf(f, "usage: affinity IFINDEX ...\n");
 		return -1;
@@ -1764,6 +1852,7 @@ static const cmd_t cmd_table[] = {
 	{ 0,	"session-ut",	cmd_session_ut,	"session table UT cmds" },
 	{ 0,	"slowpath",	cmd_shadow,	"Slow path statistics" },
 	{ 0,	"snmp",		cmd_snmp,	"SNMP network statistics" },
+	{ 0,	"stats-shm",	cmd_stats_shm,	"Shared memory stats export" },
 	{ 2,    "storm-ctl",    cmd_storm_ctl_op, "Storm control commands" },
 	{ 0,    "switch",       cmd_switch_op,  "Switch op-mode commands" },
 	{ 0,	"vhost-client",	cmd_vhost_client,
@@ -1956,6 +2045,16 @@ out:
 	return rv;
 }
 
+/*
+ * Run a command on the master thread and wait for its return code.  Called
+ * from the console thread by commands that change state only the master
+ * may touch.  Output written by the command on the master is discarded.
+ */
+int console_cmd_on_master(cmd_func_t fn, int argc, char **argv)
+{
+	return send_console_cmd(fn, argc, argv, false);
+}
+
 int console_cmd(char *line, char **outbuf, size_t *outsize, cmd_func_t fn,
 		bool on_master)
 {
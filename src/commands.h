@@ -46,11 +46,13 @@ int cmd_xconnect_cfg(FILE *f, int argc, char **argv);
 int cmd_poe(FILE *f, int argc, char **argv);
 int cmd_ip(FILE *f, int argc, char **argv);
 int cmd_cpp_rl_op(FILE *f, int argc, char **argv);
+int cmd_stats_shm(FILE *f, int argc, char **argv);
 
 void list_all_cmd_versions(FILE *f);
 
 int console_cmd(char *line, char **outbuf, size_t *outsize, cmd_func_t fn,
 		bool on_master);
+int console_cmd_on_master(cmd_func_t fn, int argc, char **argv);
 int console_bind(enum cont_src_en cont_src);
 void console_unbind(enum cont_src_en cont_src);
 const char *console_endpoint_get(void);
@@ -194,6 +194,14 @@ static int parse_entry(void *user, const char *section,
 			cfg->backplane = strdup(value);
 		else if (strcmp(name, "update") == 0)
 			cfg->port_update = atoi(value);
+		else if (strcmp(name, "shadow-threads") == 0)
+			cfg->shadow_threads = atoi(value);
+		else if (strcmp(name, "shadow-backend") == 0) {
+			if (strcmp(value, "vhost") == 0)
+				cfg->shadow_vhost = true;
+			else if (strcmp(value, "tap") != 0)
+				return 0;
+		}
 		else if (strcmp(name, "uuid") == 0)
 			return copy_str(&cfg->uuid, value);
 		else  if (strcmp(name, "dataplane-id") == 0)
@@ -279,6 +287,7 @@ void parse_config(void)
 
 	/* non-zero default values */
 	config.port_update = PORTCHECK_INTERVAL;
+	config.shadow_threads = 1;
 
 	int rc = ini_parse_file(f, parse_entry, &config);
 
@@ -585,6 +594,14 @@ static int parse_driver_entry(void *user, const char *section,
 			param->drv_flags |= DRV_PARAM_USE_ALL_TXQ;
 		}
 	}
+	if (strcmp(name, "rx_intr") == 0) {
+		if (strcmp(value, "yes") == 0) {
+			DP_DEBUG(INIT, INFO, DATAPLANE,
+				 "Setting rx_intr for %s\n",
+				 section);
+			param->drv_flags |= DRV_PARAM_RX_INTR;
+		}
+	}
 	if (strcmp(name, "rx_offloads") == 0) {
 		parse_option_strs(strdupa(value), rx_offload_strs,
 				  MAX_RX_OFFLOAD_STRS,
@@ -55,6 +55,8 @@ struct config_param {
 	char *publish_url_uplink; /* publish socket url, uplink only */
 	char *request_url_uplink; /* snapshot request socket, uplink only */
 	unsigned int port_update; /* port status update interval (secs) */
+	unsigned int shadow_threads; /* threads for the kernel exception path */
+	bool shadow_vhost;	 /* vhost-net rather than tap exception path */
 	const char *backplane;	 /* interface for vxlan */
 	char *uuid;		 /* UUID of the dataplane */
 	char *vplane_name;	 /* Name used to ID the connected vplane */
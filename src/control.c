@@ -36,6 +36,7 @@
 #include "if/dpdk-eth/vhost.h"
 #include "if_var.h"
 #include "ip_addr.h"
+#include "ll_hold.h"
 #include "master.h"
 #include "mstp.h"
 #include "netinet6/nd6_nbr.h"
@@ -478,6 +479,7 @@ static const struct msg_handler message_handlers_main[] = {
 	{ 0,	"l2tpeth",	process_config_cmd,	 NULL },
 	{ 0,	"l2tp_",	process_l2tp_cmd,	 NULL },
 	{ 0,	"link",		process_netlink_data,	 NULL },
+	{ 0,	"lladdr",	process_config_cmd,	 cmd_lladdr_cfg },
 	{ 0,	"mode",		process_config_cmd,	 cmd_power_cfg },
 	{ 0,	"mpls",		process_config_cmd,	 NULL },
 	{ 0,	"mstp",		process_config_cmd,	 cmd_mstp },
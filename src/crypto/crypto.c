@@ -38,7 +38,9 @@
 #include "crypto_internal.h"
 #include "crypto_main.h"
 #include "crypto_policy.h"
+#include "crypto_rte_pmd.h"
 #include "crypto_sadb.h"
+#include "crypto_spd.h"
 #include "dp_event.h"
 #include "esp.h"
 #include "ether.h"
@@ -182,12 +184,18 @@ struct crypto_pkt_ctx {
 	 */
 	uint8_t action;
 	uint8_t in_ifp_port;
-	uint16_t SPARE1;
+	uint8_t offload; /* enum esp_offload, set by the crypto thread */
+	uint8_t SPARE1;
 	uint16_t direction;
 	uint8_t orig_family;
 	uint8_t family;
 	xfrm_address_t dst; /* Only used for outbound traffic */
 	vrfid_t vrfid;
+	/*
+	 * Outbound sequence number, reserved by the crypto
+	 * thread for each burst before the packets are encrypted.
+	 */
+	uint64_t seq;
 };
 
 static int crypto_vrf_insert(struct crypto_vrf_ctx *vrf_ctx)
@@ -266,6 +274,14 @@ struct crypto_vrf_ctx *crypto_vrf_get(vrfid_t vrfid)
 	if (!vrf_ctx->output_policy_rule_sel_ht)
 		goto vrf_ctx_get_fail;
 
+	vrf_ctx->input_spd = crypto_spd_create();
+	if (!vrf_ctx->input_spd)
+		goto vrf_ctx_get_fail;
+
+	vrf_ctx->output_spd = crypto_spd_create();
+	if (!vrf_ctx->output_spd)
+		goto vrf_ctx_get_fail;
+
 	vrf_ctx->s2s_bind_hash_table =
 		cds_lfht_new(POLICY_RULE_HT_MIN_BUCKETS,
 			     POLICY_RULE_HT_MIN_BUCKETS,
@@ -295,6 +311,8 @@ vrf_ctx_get_fail:
 		cds_lfht_destroy(vrf_ctx->output_policy_rule_sel_ht, NULL);
 	if (vrf_ctx->s2s_bind_hash_table)
 		cds_lfht_destroy(vrf_ctx->s2s_bind_hash_table, NULL);
+	crypto_spd_destroy(vrf_ctx->input_spd);
+	crypto_spd_destroy(vrf_ctx->output_spd);
 	free(vrf_ctx);
 	return NULL;
 }
@@ -310,6 +328,8 @@ static inline void crypto_vrf_free(struct rcu_head *head)
 	dp_ht_destroy_deferred(vrf_ctx->sadb_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->spi_out_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->s2s_bind_hash_table);
+	crypto_spd_destroy(vrf_ctx->input_spd);
+	crypto_spd_destroy(vrf_ctx->output_spd);
 
 	free(vrf_ctx);
 }
@@ -460,9 +480,9 @@ static void crypto_process_decrypt_packet(struct crypto_pkt_ctx *cctx,
 	}
 
 	if (cctx->family == AF_INET)
-		rc = esp_input(m, sa, bytes, &cctx->family);
+		rc = esp_input(m, sa, bytes, &cctx->family, cctx->offload);
 	else
-		rc = esp_input6(m, sa, bytes, &cctx->family);
+		rc = esp_input6(m, sa, bytes, &cctx->family, cctx->offload);
 
 	if (rc < 0) {
 		if (vti_ifp)
@@ -548,9 +568,11 @@ static void crypto_process_encrypt_packet(struct crypto_pkt_ctx *cctx,
 	int rc;
 
 	if (cctx->family == AF_INET)
-		rc = esp_output(m, cctx->orig_family, cctx->l3hdr, sa, bytes);
+		rc = esp_output(m, cctx->orig_family, cctx->l3hdr, sa,
+				cctx->seq, bytes);
 	else
-		rc = esp_output6(m, cctx->orig_family, cctx->l3hdr, sa, bytes);
+		rc = esp_output6(m, cctx->orig_family, cctx->l3hdr, sa,
+				 cctx->seq, bytes);
 
 	if (rc < 0) {
 		if (cctx->nxt_ifp)
@@ -712,6 +734,14 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 	struct crypto_pkt_ctx *ctx;
 	struct crypto_pkt_buffer *cpb;
 
+	/*
+	 * An SA processed in parallel may be on any PMD, so each
+	 * forwarding thread uses its own, keeping the packets of a
+	 * flow in order.
+	 */
+	if (pmd_dev_id == CRYPTO_PMD_ANY_ID)
+		pmd_dev_id = crypto_pmd_lcore_select(dp_lcore_id());
+
 	if (unlikely(pmd_dev_id == CRYPTO_PMD_INVALID_ID)) {
 		IPSEC_CNT_INC(DROPPED_INVALID_PMD_DEV_ID);
 		if (nxt_ifp && is_vti(nxt_ifp))
@@ -762,6 +792,7 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 	ctx->family    = family;
 	ctx->reqid     = reqid;
 	ctx->action    = CRYPTO_ACT_NONE;
+	ctx->offload   = ESP_OFFLOAD_NONE;
 	if (xfrm == CRYPTO_ENCRYPT) {
 		/*
 		 * For a VTI tunnel, do output crypto processing
@@ -1014,31 +1045,146 @@ sadb_lookup_sa(struct rte_mbuf *m __unused, enum crypto_xfrm xfrm,
 	return sa;
 }
 
-static inline unsigned int
-crypto_pmd_process_packet(struct crypto_pkt_ctx *contexts,
-			  enum crypto_xfrm xfrm)
+static inline struct sadb_sa *
+crypto_pmd_lookup_sa(struct crypto_pkt_ctx *contexts, enum crypto_xfrm xfrm)
 {
 	struct rte_mbuf *m;
-	unsigned int packet_size = 0;
-	struct sadb_sa *sa;
 
 	m = contexts->mbuf;
 	if (unlikely(!m)) {
 		CRYPTO_DATA_ERR("Null mbuf\n");
 		contexts->action = CRYPTO_ACT_DROP;
 		IPSEC_CNT_INC(DROPPED_NO_MBUF);
-		return 0;
+		return NULL;
 	}
 	assert(contexts->direction == xfrm);
 
-	sa = sadb_lookup_sa(m, xfrm, contexts);
+	return sadb_lookup_sa(m, xfrm, contexts);
+}
+
+static inline unsigned int
+crypto_pmd_process_packet(struct crypto_pkt_ctx *contexts,
+			  struct sadb_sa *sa, enum crypto_xfrm xfrm)
+{
+	unsigned int packet_size = 0;
+
 	if (unlikely(!sa))
 		return 0;
 
-	crypto_cb[xfrm].process(contexts, m, sa, &packet_size);
+	crypto_cb[xfrm].process(contexts, contexts->mbuf, sa, &packet_size);
 	return packet_size;
 }
 
+/*
+ * Reserve the outbound sequence numbers for a burst, taking a block
+ * for each run of packets using the same SA. This keeps the atomic
+ * update needed for an SA processed on several crypto threads down
+ * to one per run rather than one per packet.
+ */
+static void crypto_reserve_seq(struct crypto_pkt_ctx **contexts,
+			       struct sadb_sa **sas, unsigned int count)
+{
+	unsigned int i, j, run;
+	uint64_t seq;
+
+	for (i = 0; i < count; i += run) {
+		run = 1;
+		if (unlikely(!sas[i]))
+			continue;
+
+		while (i + run < count && sas[i + run] == sas[i])
+			run++;
+
+		seq = esp_seq_reserve(sas[i], run);
+		for (j = 0; j < run; j++)
+			contexts[i + j]->seq = seq + j + 1;
+	}
+}
+
+/*
+ * The cryptodev backend still has the mbuf of a packet whose op it
+ * gave up waiting for, and frees it once the op is done. Drop the
+ * packet without touching the mbuf.
+ */
+static void crypto_rte_abandon(struct crypto_pkt_ctx *ctx)
+{
+	CRYPTO_DATA_ERR("Cryptodev op timed out\n");
+	ctx->mbuf = NULL;
+	ctx->action = CRYPTO_ACT_DROP;
+	IPSEC_CNT_INC(DROPPED_NO_MBUF);
+}
+
+/*
+ * Queue the packets of an inbound burst that can be decrypted by the
+ * cryptodev backend, and decrypt them ahead of the ESP processing.
+ */
+static void crypto_rte_decrypt(struct crypto_pkt_ctx **contexts,
+			       struct sadb_sa **sas, unsigned int count)
+{
+	struct rte_mbuf *failed[MAX_CRYPTO_PKT_BURST];
+	struct rte_mbuf *inflight[MAX_CRYPTO_PKT_BURST];
+	unsigned int i, j, nb_failed, nb_inflight, queued = 0;
+
+	for (i = 0; i < count; i++) {
+		if (sas[i] && esp_input_queue(contexts[i]->mbuf,
+					      contexts[i]->family,
+					      sas[i]) == 0) {
+			contexts[i]->offload = ESP_OFFLOAD_DONE;
+			queued++;
+		}
+	}
+
+	if (!queued)
+		return;
+
+	nb_failed = crypto_rte_flush(failed, inflight, &nb_inflight);
+	for (j = 0; j < nb_failed; j++)
+		for (i = 0; i < count; i++)
+			if (contexts[i]->mbuf == failed[j]) {
+				contexts[i]->offload = ESP_OFFLOAD_FAILED;
+				break;
+			}
+
+	for (j = 0; j < nb_inflight; j++)
+		for (i = 0; i < count; i++)
+			if (contexts[i]->mbuf == inflight[j]) {
+				crypto_rte_abandon(contexts[i]);
+				sas[i] = NULL;
+				break;
+			}
+}
+
+/*
+ * Encrypt the packets of an outbound burst queued on the cryptodev
+ * backend while they were built, dropping any that fail.
+ */
+static void crypto_rte_encrypt(struct crypto_pkt_ctx **contexts,
+			       unsigned int count)
+{
+	struct rte_mbuf *failed[MAX_CRYPTO_PKT_BURST];
+	struct rte_mbuf *inflight[MAX_CRYPTO_PKT_BURST];
+	unsigned int i, j, nb_failed, nb_inflight;
+
+	nb_failed = crypto_rte_flush(failed, inflight, &nb_inflight);
+	for (j = 0; j < nb_failed; j++)
+		for (i = 0; i < count; i++)
+			if (contexts[i]->mbuf == failed[j]) {
+				if (contexts[i]->nxt_ifp)
+					if_incr_oerror(contexts[i]->nxt_ifp);
+				CRYPTO_DATA_ERR("Cryptodev encrypt failed\n");
+				contexts[i]->action = CRYPTO_ACT_DROP;
+				IPSEC_CNT_INC(DROPPED_ESP_OUTPUT_FAIL);
+				break;
+			}
+
+	for (j = 0; j < nb_inflight; j++)
+		for (i = 0; i < count; i++)
+			if (contexts[i]->mbuf == inflight[j]) {
+				crypto_rte_abandon(contexts[i]);
+				break;
+			}
+}
+
 /*
  * PMD walker callback passed together with a PMD listhead, and called
  * back for each xfrm queue within each PMD.
@@ -1051,6 +1197,7 @@ static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
 			       uint32_t *packets)
 {
 	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
+	struct sadb_sa *sas[MAX_CRYPTO_PKT_BURST];
 	unsigned int i, count, total_bytes = 0;
 
 	if (!rte_ring_empty(pmd_queue)) {
@@ -1062,23 +1209,38 @@ static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
 		for (i = 0; i < CRYPTO_PREFETCH_OFFSET && i < count; i++)
 			rte_prefetch0(contexts[i]);
 
+		/* Find the SAs for the packets in the burst. */
+		for (i = 0; i < count; i++) {
+			if (i + CRYPTO_PREFETCH_OFFSET < count)
+				rte_prefetch0(
+					contexts[i + CRYPTO_PREFETCH_OFFSET]);
+			sas[i] = crypto_pmd_lookup_sa(contexts[i], xfrm);
+		}
+
+		if (xfrm == CRYPTO_ENCRYPT)
+			crypto_reserve_seq(contexts, sas, count);
+		else
+			crypto_rte_decrypt(contexts, sas, count);
+
 		/* Process the packets in the burst. */
 		for (i = 0; i + CRYPTO_PREFETCH_OFFSET < count; i++) {
-			rte_prefetch0(contexts[i + CRYPTO_PREFETCH_OFFSET]);
 			rte_prefetch0(
 				contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->mbuf);
 			rte_prefetch0(
 			       contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->l3hdr);
 			total_bytes += crypto_pmd_process_packet(contexts[i],
-								 xfrm);
+								 sas[i], xfrm);
 		}
 
 		/* Process the remaining contexts */
 		for (; i < count; i++) {
 			total_bytes += crypto_pmd_process_packet(contexts[i],
-								 xfrm);
+								 sas[i], xfrm);
 		}
 
+		if (xfrm == CRYPTO_ENCRYPT)
+			crypto_rte_encrypt(contexts, count);
+
 		crypto_cb[xfrm].post_process(contexts, count);
 		*packets = count;
 		*bytes = total_bytes;
@@ -1291,6 +1453,7 @@ void dp_crypto_shutdown(void)
 	udp_handler_unregister(AF_INET, htons(ESP_PORT));
 	udp_handler_unregister(AF_INET6, htons(ESP_PORT));
 	crypto_engine_shutdown();
+	crypto_rte_shutdown();
 }
 
 void crypto_show_summary(FILE *f)
@@ -32,6 +32,7 @@
 #include "../in_cksum.h"
 #include "compiler.h"
 #include "crypto_internal.h"
+#include "crypto_rte_pmd.h"
 #include "in6.h"
 #include "json_writer.h"
 #include "util.h"
@@ -958,6 +959,47 @@ err:
 	return NULL;
 }
 
+/*
+ * Create a copy of a session with its own cipher and HMAC contexts and
+ * IV, for use by a single lcore.
+ */
+static struct crypto_session *
+crypto_session_clone(const struct crypto_session *s)
+{
+	struct crypto_session *ctx;
+
+	ctx = malloc(sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	memcpy(ctx, s, sizeof(*ctx));
+	if (ctx->rte)
+		crypto_rte_session_ref(ctx->rte);
+	ctx->ctx = NULL;
+	ctx->cipher_init = 0;
+	ctx->hmac_ctx = NULL;
+	RAND_bytes((unsigned char *)ctx->iv, ctx->iv_len);
+
+	if (s->hmac_ctx) {
+		ctx->hmac_ctx = HMAC_CTX_new();
+		if (!ctx->hmac_ctx) {
+			ENGINE_ERR_print_errors();
+			goto err;
+		}
+		if (!HMAC_Init_ex(ctx->hmac_ctx, ctx->auth_alg_key,
+				  ctx->auth_alg_key_len, ctx->md, NULL)) {
+			ENGINE_ERR_print_errors();
+			goto err;
+		}
+	}
+
+	return ctx;
+
+err:
+	crypto_session_destroy(ctx);
+	return NULL;
+}
+
 void crypto_session_destroy(struct crypto_session *ctx)
 {
 	if (!ctx)
@@ -967,6 +1009,7 @@ void crypto_session_destroy(struct crypto_session *ctx)
 		HMAC_CTX_free(ctx->hmac_ctx);
 	if (ctx->ctx)
 		EVP_CIPHER_CTX_free(ctx->ctx);
+	crypto_rte_session_destroy(ctx->rte);
 
 	free(ctx);
 }
@@ -1002,8 +1045,10 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 		     const struct xfrm_algo_auth *algo_auth,
 		     const struct xfrm_usersa_info *sa_info,
 		     const struct xfrm_encap_tmpl *tmpl,
+		     const struct xfrm_replay_state_esn *replay_esn,
 		     struct sadb_sa *sa, uint32_t extra_flags)
 {
+	uint32_t replay_window;
 	int ret;
 
 	if (check_algorithmic_requirements(algo_crypt, algo_auth))
@@ -1056,10 +1101,36 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 	}
 
 	sa->seq = 0;
-	sa->replay_bitmap = 0;
-	sa->replay_window = sa_info->replay_window;
+	memset(sa->replay_bitmap, 0, sizeof(sa->replay_bitmap));
+	rte_rwlock_init(&sa->replay_lock);
+	replay_window = sa_info->replay_window;
+
+	/*
+	 * The ESN replay state carries the wider window, and the
+	 * sequence numbers to carry on from if the SA is being
+	 * updated.
+	 */
+	if (replay_esn) {
+		replay_window = replay_esn->replay_window;
+		if (sa->dir == CRYPTO_DIR_OUT)
+			sa->seq = (uint64_t)replay_esn->oseq_hi << 32 |
+				replay_esn->oseq;
+		else
+			sa->seq = (uint64_t)replay_esn->seq_hi << 32 |
+				replay_esn->seq;
+	}
+	if (replay_window > ESP_REPLAY_WINDOW_MAX) {
+		ENGINE_ERR("Replay window %u reduced to %u\n",
+			   replay_window, ESP_REPLAY_WINDOW_MAX);
+		replay_window = ESP_REPLAY_WINDOW_MAX;
+	}
+	sa->replay_window = replay_window;
 
 	sa->flags = sa_info->flags;
+	if ((sa->flags & XFRM_STATE_ESN) && !replay_esn) {
+		ENGINE_ERR("ESN SA without replay state\n");
+		return -1;
+	}
 	sa->extra_flags = extra_flags;
 
 	if (sa_info->family == AF_INET) {
@@ -1083,11 +1154,56 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 		ip6_hdr->ip6_hlim = 64;
 		ip6_hdr->ip6_nxt = sa->udp_encap ? IPPROTO_UDP : IPPROTO_ESP;
 	}
+
+	if (crypto_rte_enabled() &&
+	    crypto_rte_session_create(sa->session, sa->dir == CRYPTO_DIR_OUT,
+				      crypto_sa_is_esn(sa)) < 0)
+		ENGINE_INFO("SA %x not supported by cryptodev, using OpenSSL\n",
+			    ntohl(sa->spi));
+
+	return 0;
+}
+
+/*
+ * Give each lcore its own copy of the session so that packets for the
+ * SA can be processed on any of the crypto lcores.
+ */
+int cipher_setup_parallel(struct sadb_sa *sa)
+{
+	struct sadb_sa_pcpu *pcpu;
+	unsigned int lcore;
+
+	pcpu = zmalloc_aligned((get_lcore_max() + 1) * sizeof(*pcpu));
+	if (!pcpu)
+		return -1;
+
+	FOREACH_DP_LCORE(lcore) {
+		pcpu[lcore].session = crypto_session_clone(sa->session);
+		if (!pcpu[lcore].session)
+			goto err;
+	}
+
+	sa->pcpu = pcpu;
 	return 0;
+
+err:
+	FOREACH_DP_LCORE(lcore)
+		crypto_session_destroy(pcpu[lcore].session);
+	free(pcpu);
+	return -1;
 }
 
 void cipher_teardown_ctx(struct sadb_sa *sa)
 {
+	unsigned int lcore;
+
+	if (sa->pcpu) {
+		FOREACH_DP_LCORE(lcore)
+			crypto_session_destroy(sa->pcpu[lcore].session);
+		free(sa->pcpu);
+		sa->pcpu = NULL;
+	}
+
 	crypto_session_destroy(sa->session);
 	sa->session = NULL;
 }
@@ -1153,6 +1269,7 @@ void crypto_engine_summary(json_writer_t *wr, const struct sadb_sa *sa)
 
 	jsonw_string_field(wr, "digest", sa->session->md_name ?
 			   sa->session->md_name : "null");
+	jsonw_bool_field(wr, "cryptodev", sa->session->rte != NULL);
 }
 
 static int crypto_chain_dump_set_iv(struct crypto_visitor_ctx *ctx,
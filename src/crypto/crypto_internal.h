@@ -20,10 +20,12 @@
 #include <rte_log.h>
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
+#include <rte_rwlock.h>
 #include <sys/queue.h>
 
 #include "crypto_main.h"
 #include "json_writer.h"
+#include "util.h"
 #include "vplane_log.h"
 #include "vrf_internal.h"
 
@@ -101,6 +103,21 @@ OPENSSL_init_crypto(uint32_t opts __attribute__ ((__unused__)),
 #endif
 
 #define CRYPTO_PMD_INVALID_ID -1
+/*
+ * Published in place of a real PMD id for SAs in parallel mode. The
+ * enqueueing forwarding thread resolves it to a PMD of its own, see
+ * crypto_pmd_lcore_select().
+ */
+#define CRYPTO_PMD_ANY_ID -2
+
+/*
+ * The anti-replay bitmap is a ring of 64-bit words indexed by sequence
+ * number. One word more than the largest window is kept so that the
+ * words cleared as the right hand edge advances never hold bits that
+ * are still inside the window.
+ */
+#define ESP_REPLAY_BITMAP_WORDS 32
+#define ESP_REPLAY_WINDOW_MAX ((ESP_REPLAY_BITMAP_WORDS - 1) * 64)
 
 struct crypto_session_operations;
 struct crypto_visitor_operations;
@@ -143,6 +160,7 @@ struct crypto_session {
 	const EVP_MD *md;
 	const char *md_name;
 	const char *cipher_name;
+	struct crypto_rte_session *rte; /* cryptodev backend, if used */
 };
 
 /*
@@ -156,6 +174,14 @@ struct crypto_session {
  * thread and are considered read only in all threads
  * thereafter.
  */
+/*
+ * Per lcore state of an SA in parallel mode, where packets for the SA
+ * may be processed by any crypto lcore.
+ */
+struct sadb_sa_pcpu {
+	struct crypto_session *session;
+} __rte_cache_aligned;
+
 struct sadb_sa {
 	struct cds_lfht_node spi_ht_node;
 	uint32_t spi; /* Network byte order */
@@ -175,14 +201,20 @@ struct sadb_sa {
 	/* --- cacheline 1 boundary (64 bytes) --- */
 	uint16_t udp_sport;
 	uint16_t udp_dport;
-	uint32_t seq;
 	uint32_t flags;
+	/*
+	 * Outbound: last sequence number used. Inbound: highest
+	 * sequence number received. The upper 32 bits are only
+	 * used with extended sequence numbers.
+	 */
+	uint64_t seq;
 	uint32_t extra_flags;
+	uint32_t parallel_pmds; /* bitmask of PMDs a parallel SA is on */
 	uint64_t packet_count;
 	uint64_t packet_limit;
 	uint64_t byte_count;
 	uint64_t byte_limit;
-	xfrm_address_t dst;
+	struct sadb_sa_pcpu *pcpu; /* NULL unless in parallel mode */
 	/* --- cacheline 2 boundary (128 bytes) --- */
 	struct cds_list_head peer_links;
 	uint32_t reqid;
@@ -192,13 +224,16 @@ struct sadb_sa {
 	uint32_t seq_drop;
 	int del_pmd_dev_id;
 	/* --- cacheline 3 boundary (192 bytes) --- */
-	uint8_t replay_window;
+	uint16_t replay_window;
 	uint8_t pending_del;
-	uint64_t replay_bitmap;
+	char SPARE2;
+	rte_rwlock_t replay_lock; /* right hand edge moves exclusive */
+	uint64_t replay_bitmap[ESP_REPLAY_BITMAP_WORDS];
 	struct ip6_hdr ip6_hdr;
 	struct ifnet *feat_attach_ifp;
 	vrfid_t overlay_vrf_id;
 	uint64_t epoch;
+	xfrm_address_t dst;
 };
 
 static_assert(offsetof(struct sadb_sa, udp_sport) == 64,
@@ -208,6 +243,37 @@ static_assert(offsetof(struct sadb_sa, peer_links) == 128,
 static_assert(offsetof(struct sadb_sa, replay_window) == 192,
 	      "third cache line exceeded");
 
+static inline bool crypto_sa_is_esn(const struct sadb_sa *sa)
+{
+	return sa->flags & XFRM_STATE_ESN;
+}
+
+/*
+ * The session to use for processing a packet on this lcore. An SA in
+ * parallel mode has a clone per lcore, as the cipher and HMAC contexts
+ * and the chained IV can't be shared between threads.
+ */
+static inline struct crypto_session *
+crypto_sa_session(const struct sadb_sa *sa)
+{
+	if (likely(!sa->pcpu))
+		return sa->session;
+
+	return sa->pcpu[dp_lcore_id()].session;
+}
+
+/*
+ * The PMD id the forwarding threads should use to send packets for the
+ * SA to the crypto threads.
+ */
+static inline int crypto_sa_pmd_dev_id(const struct sadb_sa *sa)
+{
+	if (sa->pcpu && sa->pmd_dev_id != CRYPTO_PMD_INVALID_ID)
+		return CRYPTO_PMD_ANY_ID;
+
+	return sa->pmd_dev_id;
+}
+
 struct crypto_chain_elem;
 
 struct crypto_session_operations {
@@ -281,6 +347,12 @@ crypto_session_digest_len(const struct crypto_session *ctx)
 	return ctx->digest_len;
 }
 
+static inline bool
+crypto_session_is_aead(const struct crypto_session *ctx)
+{
+	return ctx->cipher && EVP_CIPHER_mode(ctx->cipher) == EVP_CIPH_GCM_MODE;
+}
+
 int crypto_session_set_enc_key(struct crypto_session *session,
 			       unsigned int length, const char key[]);
 int crypto_session_set_auth_key(struct crypto_session *session,
@@ -400,9 +472,11 @@ int cipher_setup_ctx(const struct xfrm_algo *,
 		     const struct xfrm_algo_auth *,
 		     const struct xfrm_usersa_info *,
 		     const struct xfrm_encap_tmpl *t,
+		     const struct xfrm_replay_state_esn *replay_esn,
 		     struct sadb_sa *,
 		     uint32_t extra_flags);
 void cipher_teardown_ctx(struct sadb_sa *sa);
+int cipher_setup_parallel(struct sadb_sa *sa);
 
 void crypto_engine_summary(json_writer_t *wr, const struct sadb_sa *sa);
 
@@ -473,12 +547,17 @@ enum ipsec_cnt_types {
 	IPSEC_CNT_MAX /* this must be last */
 };
 
+struct crypto_spd;
+
 /*
  * per-VRF context block
  */
 struct crypto_vrf_ctx {
 	struct cds_lfht *input_policy_rule_sel_ht;
 	struct cds_lfht *output_policy_rule_sel_ht;
+	/* selector classifiers used to match packets against policies */
+	struct crypto_spd *input_spd;
+	struct crypto_spd *output_spd;
 	struct cds_lfht *spi_out_hash_table;
 	struct cds_lfht *sadb_hash_table;
 	struct cds_lfht *s2s_bind_hash_table;
@@ -563,6 +642,11 @@ void crypto_delete_queue(struct rte_ring *pmd_queue);
 void crypto_remove_sa_from_pmd(int crypto_dev_id, enum crypto_xfrm xfrm,
 			       bool pending);
 int crypto_allocate_pmd(enum crypto_xfrm xfrm);
+int crypto_allocate_parallel_pmds(enum crypto_xfrm xfrm, uint32_t *pmd_mask);
+void crypto_remove_sa_from_parallel_pmds(uint32_t pmd_mask, int crypto_dev_id,
+					 enum crypto_xfrm xfrm, bool pending);
+int crypto_pmd_lcore_select(unsigned int lcore_id);
+bool crypto_engine_parallel(void);
 struct rte_ring *crypto_pmd_get_q(int dev_id, enum crypto_xfrm xfrm);
 typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, enum crypto_xfrm,
 				     struct rte_ring *,
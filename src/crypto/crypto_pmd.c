@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
@@ -21,6 +22,7 @@
 #include "crypto.h"
 #include "crypto_internal.h"
 #include "crypto_main.h"
+#include "crypto_rte_pmd.h"
 #include "json_writer.h"
 #include "main.h"
 #include "urcu.h"
@@ -76,6 +78,16 @@ static_assert(offsetof(struct crypto_pmd, cnt) == 64,
 
 static struct crypto_pmd *crypto_pmd_devs[MAX_CRYPTO_PMD];
 
+/*
+ * Dense list of the ids of the allocated PMDs, used by the forwarding
+ * threads to spread the packets of parallel SAs.
+ */
+static int crypto_pmd_active_ids[MAX_CRYPTO_PMD];
+static unsigned int crypto_pmd_active_cnt;
+
+/* Are new SAs set up to be processed on all crypto engines? */
+static bool crypto_parallel_sa;
+
 /*
  * Counters to be exported for debug and status
  */
@@ -86,8 +98,7 @@ static unsigned int pmd_alloc, pmd_alloc_fail, pmd_sa_active,
 static struct crypto_pmd *crypto_dev_id_to_pmd(int dev_id,
 					       bool *err)
 {
-	if ((dev_id >= MAX_CRYPTO_PMD) ||
-	    dev_id == CRYPTO_PMD_INVALID_ID) {
+	if ((dev_id >= MAX_CRYPTO_PMD) || dev_id < 0) {
 		CRYPTO_ERR("Invalid crypto pmd ID %d\n", dev_id);
 		pmd_invalid_id++;
 		*err = true;
@@ -178,6 +189,40 @@ crypto_pmd_alloc_loadshare(enum crypto_xfrm xfrm)
 	return best_pmd;
 }
 
+static void crypto_pmd_active_refresh(void)
+{
+	unsigned int dev_id, cnt = 0;
+
+	for (dev_id = 0; dev_id < MAX_CRYPTO_PMD; dev_id++)
+		if (crypto_pmd_devs[dev_id])
+			CMM_STORE_SHARED(crypto_pmd_active_ids[cnt++], dev_id);
+
+	CMM_STORE_SHARED(crypto_pmd_active_cnt, cnt);
+}
+
+/*
+ * Used by the forwarding threads to pick the PMD for a parallel
+ * SA. Each forwarding thread sticks to one PMD, so the packets of a
+ * flow, which RSS keeps on one thread, stay in order.
+ *
+ * An SA is only spread across the PMDs when its packets arrive on
+ * several forwarding threads. That is the case for outbound SAs,
+ * whose inner flows are hashed across the threads, but not for
+ * inbound SAs: all the ESP packets of a tunnel have the same outer
+ * addresses and SPI, so RSS puts them on one thread and they are
+ * decrypted on one PMD. Spreading those by packet would need a
+ * reorder stage after decryption, which there isn't.
+ */
+int crypto_pmd_lcore_select(unsigned int lcore_id)
+{
+	unsigned int cnt = CMM_LOAD_SHARED(crypto_pmd_active_cnt);
+
+	if (unlikely(!cnt))
+		return CRYPTO_PMD_INVALID_ID;
+
+	return CMM_LOAD_SHARED(crypto_pmd_active_ids[lcore_id % cnt]);
+}
+
 static struct crypto_pmd *
 crypto_pmd_find_or_create(enum crypto_xfrm xfrm)
 {
@@ -239,6 +284,7 @@ crypto_pmd_find_or_create(enum crypto_xfrm xfrm)
 
 	pmd_alloc++;
 	pmd_total_created++;
+	crypto_pmd_active_refresh();
 
 	return pmd;
 }
@@ -276,6 +322,8 @@ static int crypto_cpu_describe(FILE *f, unsigned int count,
 	jsonw_name(wr, "crypto_cores");
 	jsonw_uint_field(wr, "count", count);
 	jsonw_uint_field(wr, "crypto_sticky", sticky);
+	jsonw_bool_field(wr, "parallel_sa", crypto_parallel_sa);
+	jsonw_bool_field(wr, "cryptodev", crypto_rte_enabled());
 	jsonw_end_object(wr);
 	jsonw_destroy(&wr);
 
@@ -317,6 +365,35 @@ int crypto_engine_set(FILE *f, const char *str)
 
 	return crypto_cpu_describe(f, num, tmp_sticky);
 }
+
+bool crypto_engine_parallel(void)
+{
+	return crypto_parallel_sa;
+}
+
+/*
+ * Only SAs created after the mode is changed are affected.
+ */
+int crypto_engine_set_parallel(FILE *f, const char *str)
+{
+	if (!str || (strcmp(str, "on") && strcmp(str, "off"))) {
+		if (f)
+			fprintf(f, "error expected on or off\n");
+		return -1;
+	}
+
+	crypto_parallel_sa = strcmp(str, "on") == 0;
+
+	return f ? crypto_engine_probe(f) : 0;
+}
+
+static void crypto_pmd_add_sa(struct crypto_pmd *pmd, enum crypto_xfrm xfrm)
+{
+	pmd->sa_cnt++;
+	pmd->sa_cnt_per_type[xfrm]++;
+	pmd_sa_active++;
+}
+
 /*
  * Return a PMD to be used by the caller, either reusing an
  * existing PMD or create a new one. If a new one is created
@@ -339,13 +416,48 @@ int crypto_allocate_pmd(enum crypto_xfrm xfrm)
 		return CRYPTO_PMD_INVALID_ID;
 	}
 
-	pmd->sa_cnt++;
-	pmd->sa_cnt_per_type[xfrm]++;
-	pmd_sa_active++;
+	crypto_pmd_add_sa(pmd, xfrm);
 
 	return pmd->dev_id;
 }
 
+/*
+ * Allocate the PMDs for an SA in parallel mode. The SA holds a
+ * reference on a PMD for each crypto engine, creating them if need
+ * be, so that the engines keep polling for as long as the SA may be
+ * spread over them. The returned PMD is the one that the pending
+ * delete accounting is done against.
+ */
+int crypto_allocate_parallel_pmds(enum crypto_xfrm xfrm, uint32_t *pmd_mask)
+{
+	struct crypto_pmd *pmd;
+	unsigned int dev_id;
+	int first, id;
+
+	*pmd_mask = 0;
+	first = crypto_allocate_pmd(xfrm);
+	if (first == CRYPTO_PMD_INVALID_ID)
+		return first;
+	*pmd_mask |= 1u << first;
+
+	while (pmd_alloc < max_pmds) {
+		id = crypto_allocate_pmd(xfrm);
+		if (id == CRYPTO_PMD_INVALID_ID)
+			break;
+		*pmd_mask |= 1u << id;
+	}
+
+	for (dev_id = 0; dev_id < MAX_CRYPTO_PMD; dev_id++) {
+		pmd = crypto_pmd_devs[dev_id];
+		if (!pmd || (*pmd_mask & (1u << dev_id)))
+			continue;
+		crypto_pmd_add_sa(pmd, xfrm);
+		*pmd_mask |= 1u << dev_id;
+	}
+
+	return first;
+}
+
 static void pmd_purge_and_release_queues(struct crypto_pmd *pmd)
 {
 	unsigned int q;
@@ -376,6 +488,7 @@ static void crypto_pmd_remove(int dev_id)
 
 	rcu_assign_pointer(crypto_pmd_devs[dev_id], NULL);
 	pmd_alloc--;
+	crypto_pmd_active_refresh();
 
 	cds_list_del_rcu(&pmd->next);
 
@@ -416,6 +529,17 @@ void crypto_remove_sa_from_pmd(int dev_id, enum crypto_xfrm xfrm,
 		crypto_pmd_remove(dev_id);
 }
 
+void crypto_remove_sa_from_parallel_pmds(uint32_t pmd_mask, int dev_id,
+					 enum crypto_xfrm xfrm, bool pending)
+{
+	int id;
+
+	for (id = 0; id < MAX_CRYPTO_PMD; id++)
+		if (pmd_mask & (1u << id))
+			crypto_remove_sa_from_pmd(id, xfrm,
+						  pending && id == dev_id);
+}
+
 /*
  * Insert a PMD into the list of PMDs being procssed by an engine,
  * i.e. an lcore or a pthread
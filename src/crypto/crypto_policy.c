@@ -45,6 +45,7 @@
 #include "crypto/crypto_main.h"
 #include "crypto/crypto_policy.h"
 #include "crypto/crypto_sadb.h"
+#include "crypto/crypto_spd.h"
 #include "crypto/esp.h"
 #include "if_var.h"
 #include "ip_funcs.h"
@@ -654,34 +655,6 @@ static void policy_rule_remove_from_tag_ht(struct policy_rule *pr)
 	cds_lfht_del(hash_table, &pr->tag_ht_node);
 }
 
-static struct policy_rule *policy_rule_find_by_tag(uint32_t tag,
-						   int policy_direction)
-{
-	struct cds_lfht *hash_table;
-	struct cds_lfht_node *node;
-	struct cds_lfht_iter iter;
-
-	switch (policy_direction) {
-	case XFRM_POLICY_IN:
-		hash_table = input_policy_rule_tag_ht;
-		break;
-	case XFRM_POLICY_OUT:
-		hash_table = output_policy_rule_tag_ht;
-		break;
-	default:
-		POLICY_ERR(
-			"Failed to find policy rule to hash table: Bad direction\n");
-		return false;
-	}
-
-	cds_lfht_lookup(hash_table, tag, policy_rule_tag_match, &tag, &iter);
-
-	node = cds_lfht_iter_get_node(&iter);
-
-	return node ? caa_container_of(node, struct policy_rule, tag_ht_node)
-		    : NULL;
-}
-
 static void
 policy_rule_set_peer_info(struct policy_rule *pr,
 			  const struct xfrm_user_tmpl *tmpl,
@@ -976,6 +949,12 @@ static bool policy_rule_build_npf_str(const struct policy_rule *pr,
 	return true;
 }
 
+static struct crypto_spd *
+policy_rule_spd(const struct crypto_vrf_ctx *vrf_ctx, int dir)
+{
+	return dir == XFRM_POLICY_IN ? vrf_ctx->input_spd : vrf_ctx->output_spd;
+}
+
 static void group_name_by_vrf(char *buf, int buflen, int dir, vrfid_t vrf)
 {
 	if (dir == XFRM_POLICY_IN)
@@ -1092,14 +1071,34 @@ static bool policy_rule_add_to_npf(struct policy_rule *pr)
 	group_name_by_vrf(group_name, sizeof(group_name), pr->dir,
 			  dp_vrf_get_external_id(pr->vrfid));
 
-	int rule_ret = npf_cfg_rule_add(NPF_RULE_CLASS_IPSEC, group_name,
-					pr->rule_index, buffer);
+	/*
+	 * Packets are matched against the policy by the SPD classifier,
+	 * which takes effect straight away. The NPF rule provides the
+	 * ruleset view of the policies, and is committed in batches.
+	 */
+	int rule_ret = crypto_spd_insert(policy_rule_spd(vrf_ctx, pr->dir),
+					 &pr->sel, pr->rule_index, pr);
+
+	if (rule_ret != 0) {
+		POLICY_ERR("Failed to add %s crypto policy tag %d to "
+			   "classifier - errno %d\n",
+			   pr->dir == XFRM_POLICY_IN ? "input" : "output",
+			   pr->tag, -rule_ret);
+		if (attach_group)
+			goto failed_add_rule;
+		return false;
+	}
+
+	rule_ret = npf_cfg_rule_add(NPF_RULE_CLASS_IPSEC, group_name,
+				    pr->rule_index, buffer);
 
 	if (rule_ret != 0) {
 		POLICY_ERR("Failed to add rule for %s crypto NPF rule tag %d: "
 			   "%s - errno %d\n",
 			   pr->dir == XFRM_POLICY_IN ? "input" : "output",
 			   pr->tag, buffer, -rule_ret);
+		crypto_spd_remove(policy_rule_spd(vrf_ctx, pr->dir), &pr->sel,
+				  pr->rule_index, pr);
 		if (attach_group)
 			goto failed_add_rule;
 		return false;
@@ -1184,6 +1183,13 @@ static void policy_rule_remove_from_npf(struct policy_rule *pr,
 		(vrf_ctx->crypto_total_ipv4_policies +
 		 vrf_ctx->crypto_total_ipv6_policies == 1);
 
+	if (crypto_spd_remove(policy_rule_spd(vrf_ctx, pr->dir), &pr->sel,
+			      rule_index, pr) != 0)
+		POLICY_ERR("Failed to remove %s crypto policy tag %d from "
+			   "classifier\n",
+			   pr->dir == XFRM_POLICY_IN ? "input" : "output",
+			   pr->tag);
+
 	int rule_ret = npf_cfg_rule_delete(NPF_RULE_CLASS_IPSEC, group_name,
 					   rule_index, NULL);
 
@@ -2343,7 +2349,8 @@ static npf_match_cb_tbl crypto_npf_match_cb_tbl = {
 	.npf_match_add_rule_cb = npf_rte_acl_add_rule,
 	.npf_match_build_cb    = npf_rte_acl_build,
 	.npf_match_classify_cb = crypto_npf_rte_acl_match,
-	.npf_match_destroy_cb  = npf_rte_acl_destroy
+	.npf_match_destroy_cb  = npf_rte_acl_destroy,
+	.npf_match_dup_cb      = npf_rte_acl_dup
 };
 
 /*
@@ -2398,52 +2405,75 @@ int crypto_policy_init(void)
 	return 0;
 }
 
+/*
+ * Find the policy matching a packet. If requested the input policies
+ * are checked ahead of the output policies, as the input group is ahead
+ * of the output group in the NPF ipsec ruleset.
+ */
+static struct policy_rule *
+crypto_policy_lookup(const struct crypto_vrf_ctx *vrf_ctx,
+		     struct rte_mbuf *m, bool v4, bool check_input,
+		     int *dir)
+{
+	struct crypto_spd_key key;
+	struct policy_rule *pr = NULL;
+
+	if (!crypto_spd_key_from_pkt(m, v4, &key))
+		return NULL;
+
+	if (check_input) {
+		pr = crypto_spd_lookup(vrf_ctx->input_spd, &key);
+		if (pr) {
+			*dir = XFRM_POLICY_IN;
+			return pr;
+		}
+	}
+
+	*dir = XFRM_POLICY_OUT;
+	return crypto_spd_lookup(vrf_ctx->output_spd, &key);
+}
+
+static inline bool crypto_policy_active(const struct crypto_vrf_ctx *vrf_ctx)
+{
+	return vrf_ctx && (crypto_spd_count(vrf_ctx->input_spd) ||
+			   crypto_spd_count(vrf_ctx->output_spd));
+}
+
 bool crypto_policy_outbound_match(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				  uint16_t ether)
 {
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(in_ifp->if_vrfid);
+	struct crypto_vrf_ctx *vrf_ctx = crypto_vrf_find(in_ifp->if_vrfid);
+	int dir;
 
-	if (!npf_active(npf_conf, NPF_IPSEC))
+	if (!crypto_policy_active(vrf_ctx))
 		return false;
 
-	const npf_ruleset_t *ruleset
-		= npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-	npf_result_t result
-		= npf_hook_notrack(ruleset, mbuf, in_ifp, PFIL_OUT, 0, ether);
-
-	return (result.decision != NPF_DECISION_UNMATCHED);
+	return crypto_policy_lookup(vrf_ctx, *mbuf,
+				    ether == htons(RTE_ETHER_TYPE_IPV4),
+				    false, &dir) != NULL;
 }
 
 bool crypto_policy_outbound_active(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				   uint32_t *af, void **addr, uint16_t eth_type)
 {
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(in_ifp->if_vrfid);
+	struct crypto_vrf_ctx *vrf_ctx = crypto_vrf_find(in_ifp->if_vrfid);
 	struct policy_rule *pr;
-	npf_result_t result;
-
-	if (npf_active(npf_conf, NPF_IPSEC)) {
-		result = npf_hook_notrack(npf_get_ruleset(npf_conf,
-					  NPF_RS_IPSEC), mbuf, in_ifp,
-					  PFIL_OUT, 0, eth_type);
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
-			return false;
+	int dir;
 
-		/* Only in the case of an ALLOW policy do we set a tag */
-		if (unlikely(!result.tag_set)) {
-			*af = 0;
-			return true;
-		}
+	if (!crypto_policy_active(vrf_ctx))
+		return false;
 
-		pr = policy_rule_find_by_tag(result.tag, XFRM_POLICY_OUT);
-		if (unlikely(!pr))
-			return false;
+	pr = crypto_policy_lookup(vrf_ctx, *mbuf,
+				  eth_type == htons(RTE_ETHER_TYPE_IPV4),
+				  false, &dir);
+	if (likely(!pr))
+		return false;
 
-		*af = pr->output_peer_af;
-		*addr = &pr->output_peer;
+	/* Only an ALLOW policy has a peer */
+	*af = pr->output_peer_af;
+	*addr = &pr->output_peer;
 
-		return true;
-	}
-	return false;
+	return true;
 }
 
 /*
@@ -2509,11 +2539,11 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	vrfid_t vrfid = pktmbuf_get_vrf(*mbuf);
 	bool v4 = (eth_type == htons(RTE_ETHER_TYPE_IPV4));
 	bool freed = false;
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(vrfid);
+	struct crypto_vrf_ctx *vrf_ctx = crypto_vrf_find(vrfid);
 	bool seen_by_crypto;
 	union crypto_ctx ctx;
 
-	if (likely(!npf_active(npf_conf, NPF_IPSEC)))
+	if (likely(!crypto_policy_active(vrf_ctx)))
 		return false;
 
 	seen_by_crypto = ((*mbuf)->ol_flags & PKT_RX_SEEN_BY_CRYPTO);
@@ -2542,53 +2572,34 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				return false;
 		}
 	} else {
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
+		int dir;
 
 		/*
 		 * If this packet was received encrypted,  then we don't need to
 		 * check the input policy.  Otherwise check the policy to see if
 		 * it should have been received encrypted,  and so now needs to
 		 * be dropped.
-		 */
-		int dir = PFIL_OUT | (seen_by_crypto ? 0 : PFIL_IN);
-
-		/*
+		 *
 		 * Packets matching an input policy must be dropped if
 		 * they were not encrypted when originally received,
 		 * and this routine is only called for such unencrypted
 		 * packets.
 		 *
-		 * If no policy matches we find NPF_DECISION_UNMATCHED.
-		 * Otherwise one of NPF_DECISION_PASS (for an ALLOW policy)
-		 * or NPF_DECISION_BLOCK (for a BLOCK policy).
-		 *
 		 * Only block rules are currently used in the input policy.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type);
+		pr = crypto_policy_lookup(vrf_ctx, *mbuf, v4, !seen_by_crypto,
+					  &dir);
 
 		/*
 		 * No input and no output policy matched,  allow normal
 		 * processing
 		 */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED)) {
+		if (likely(!pr)) {
 			crypto_flow_cache_add(flow_cache, NULL, *mbuf, v4,
 					      seen_by_crypto, XFRM_POLICY_OUT);
 			return false;
 		}
 
-		if (likely(result.tag_set)) {
-			dir = XFRM_POLICY_OUT;
-			pr = policy_rule_find_by_tag(result.tag, dir);
-			if (!pr) {
-				pr = policy_rule_find_by_tag(result.tag,
-							     XFRM_POLICY_IN);
-				if (pr)
-					dir = XFRM_POLICY_IN;
-			}
-		}
-
 		/*
 		 * We found a policy. If it has a selector
 		 * with an ifindex set, then check we match.
@@ -2703,10 +2714,10 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	bool v4 = (eth_type == htons(RTE_ETHER_TYPE_IPV4));
 	bool freed = false;
 	vrfid_t vrfid = pktmbuf_get_vrf(*mbuf);
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(vrfid);
+	struct crypto_vrf_ctx *vrf_ctx = crypto_vrf_find(vrfid);
 	union crypto_ctx ctx;
 
-	if (likely(!npf_active(npf_conf, NPF_IPSEC)))
+	if (likely(!crypto_policy_active(vrf_ctx)))
 		return false;
 
 	if ((*mbuf)->ol_flags & PKT_RX_SEEN_BY_CRYPTO)
@@ -2726,10 +2737,7 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 			goto drop;
 
 	} else {
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-
-		int dir = PFIL_IN;
+		struct crypto_spd_key key;
 
 		/*
 		 * Packets matching an input policy must be dropped if
@@ -2737,48 +2745,38 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 		 * and this routine is only called for such unencrypted
 		 * packets.
 		 *
-		 * If no policy matches we find NPF_DECISION_UNMATCHED.
-		 * Otherwise one of NPF_DECISION_PASS (for an ALLOW policy)
-		 * or NPF_DECISION_BLOCK (for a BLOCK policy).
-		 *
 		 * Only block rules are currently used in the input policy.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type);
-
-		/* No input policy matched */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
+		if (!crypto_spd_key_from_pkt(*mbuf, v4, &key))
 			return false;
 
-		if (likely(result.tag_set)) {
-			pr = policy_rule_find_by_tag(result.tag,
-						     XFRM_POLICY_IN);
-			if (pr) {
-				/*
-				 * We found an input policy. If it has a
-				 * selector with an ifindex set, then
-				 * check we match.
-				 */
-				if (pr->sel.ifindex) {
-					if (pr->sel.ifindex !=
-					    (int)in_ifp->if_index) {
-						/* We don't have a match */
-						return false;
-					}
-				}
+		pr = crypto_spd_lookup(vrf_ctx->input_spd, &key);
 
-				/*
-				 * We found an input policy, add it to the
-				 * flow cache and drop the packet.
-				 */
-				crypto_flow_cache_add(flow_cache, pr, *mbuf, v4,
-						      false, XFRM_POLICY_IN);
+		/* No input policy matched */
+		if (likely(!pr))
+			return false;
 
-				if (pr->action == XFRM_POLICY_BLOCK)
-					goto drop;
+		/*
+		 * We found an input policy. If it has a
+		 * selector with an ifindex set, then
+		 * check we match.
+		 */
+		if (pr->sel.ifindex) {
+			if (pr->sel.ifindex != (int)in_ifp->if_index) {
+				/* We don't have a match */
+				return false;
 			}
-
 		}
+
+		/*
+		 * We found an input policy, add it to the
+		 * flow cache and drop the packet.
+		 */
+		crypto_flow_cache_add(flow_cache, pr, *mbuf, v4,
+				      false, XFRM_POLICY_IN);
+
+		if (pr->action == XFRM_POLICY_BLOCK)
+			goto drop;
 	}
 	return false;
 
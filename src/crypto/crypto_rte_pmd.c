@@ -0,0 +1,592 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <openssl/evp.h>
+#include <rte_branch_prediction.h>
+#include <rte_bus_vdev.h>
+#include <rte_byteorder.h>
+#include <rte_crypto.h>
+#include <rte_cryptodev.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_pause.h>
+#include <rte_per_lcore.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/uatomic.h>
+
+#include "compiler.h"
+#include "crypto.h"
+#include "crypto_internal.h"
+#include "crypto_main.h"
+#include "crypto_rte_pmd.h"
+#include "util.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+#define CRYPTO_RTE_ERR(args...)				\
+	RTE_LOG(ERR, DATAPLANE, "CRYPTODEV: " args)
+
+#define CRYPTO_RTE_INFO(args...)			\
+	DP_DEBUG(CRYPTO, INFO, CRYPTO, args)
+
+enum crypto_rte_dev_type {
+	CRYPTO_RTE_DEV_MB,
+	CRYPTO_RTE_DEV_GCM,
+	CRYPTO_RTE_DEV_MAX
+};
+
+/*
+ * The vdev bus matches these to the aesni_mb and aesni_gcm drivers by
+ * their prefix.
+ */
+static const char * const crypto_rte_vdev_names[CRYPTO_RTE_DEV_MAX] = {
+	[CRYPTO_RTE_DEV_MB] = "crypto_aesni_mb_dp",
+	[CRYPTO_RTE_DEV_GCM] = "crypto_aesni_gcm_dp",
+};
+
+#define CRYPTO_RTE_NB_SESSIONS 2048
+#define CRYPTO_RTE_NB_OPS 8191
+#define CRYPTO_RTE_QP_DESC 1024
+
+struct crypto_rte_dev {
+	int dev_id;
+	uint16_t nb_qps;
+};
+
+static struct crypto_rte_dev crypto_rte_devs[CRYPTO_RTE_DEV_MAX];
+static struct rte_mempool *crypto_rte_sess_pool;
+static struct rte_mempool *crypto_rte_sess_priv_pool;
+static struct rte_mempool *crypto_rte_op_pool;
+static bool crypto_rte_initialised;
+static bool crypto_rte_on;
+
+/*
+ * A cryptodev session is shared by the per-lcore clones of an SA's
+ * crypto_session, as the PMDs keep no per packet state in it.  The
+ * clones may be freed on different lcores, so refcnt is atomic.
+ */
+struct crypto_rte_session {
+	struct rte_cryptodev_sym_session *sess;
+	enum crypto_rte_dev_type dev;
+	unsigned int refcnt;
+};
+
+/*
+ * Private data following each crypto op, holding the IV and the AAD
+ * as the PMDs expect to find them.
+ */
+struct crypto_rte_op_priv {
+	uint8_t iv[16];
+	uint8_t aad[16];
+};
+
+#define CRYPTO_RTE_IV_OFFSET (sizeof(struct rte_crypto_op) +	\
+			      sizeof(struct rte_crypto_sym_op))
+#define CRYPTO_RTE_AAD_OFFSET (CRYPTO_RTE_IV_OFFSET +			\
+			       offsetof(struct crypto_rte_op_priv, aad))
+
+/*
+ * Empty dequeue polls before crypto_rte_flush() gives up waiting for
+ * a burst, leaving the rest of its ops in flight.
+ */
+#define CRYPTO_RTE_DEQ_POLLS 256
+
+/*
+ * The ops queued by a crypto thread while processing a burst, for
+ * each device, and the number of ops of earlier bursts still in
+ * flight on the queue pair.
+ */
+struct crypto_rte_burst {
+	struct rte_crypto_op *ops[CRYPTO_RTE_DEV_MAX][MAX_CRYPTO_PKT_BURST];
+	uint16_t count[CRYPTO_RTE_DEV_MAX];
+	uint32_t inflight[CRYPTO_RTE_DEV_MAX];
+};
+
+static RTE_DEFINE_PER_LCORE(struct crypto_rte_burst, crypto_rte_burst);
+
+/*
+ * Each lcore uses the queue pair matching its lcore id, so that the
+ * crypto threads need no locking between them.
+ */
+static int crypto_rte_dev_init(enum crypto_rte_dev_type type,
+			       uint16_t nb_qps)
+{
+	const char *name = crypto_rte_vdev_names[type];
+	struct rte_cryptodev_config conf = {
+		.socket_id = rte_socket_id(),
+		.nb_queue_pairs = nb_qps,
+	};
+	struct rte_cryptodev_qp_conf qp_conf = {
+		.nb_descriptors = CRYPTO_RTE_QP_DESC,
+	};
+	char args[64];
+	uint16_t qp;
+	int dev_id;
+
+	snprintf(args, sizeof(args), "max_nb_queue_pairs=%u,socket_id=%d",
+		 nb_qps, conf.socket_id);
+	if (rte_vdev_init(name, args) < 0) {
+		CRYPTO_RTE_ERR("Failed to create %s\n", name);
+		return -1;
+	}
+
+	dev_id = rte_cryptodev_get_dev_id(name);
+	if (dev_id < 0) {
+		CRYPTO_RTE_ERR("No device for %s\n", name);
+		goto err;
+	}
+
+	if (rte_cryptodev_configure(dev_id, &conf) < 0) {
+		CRYPTO_RTE_ERR("Failed to configure %s\n", name);
+		goto err;
+	}
+
+	for (qp = 0; qp < nb_qps; qp++)
+		if (rte_cryptodev_queue_pair_setup(dev_id, qp, &qp_conf,
+						   conf.socket_id) < 0) {
+			CRYPTO_RTE_ERR("Failed to set up %s queue pair %u\n",
+				       name, qp);
+			goto err;
+		}
+
+	if (rte_cryptodev_start(dev_id) < 0) {
+		CRYPTO_RTE_ERR("Failed to start %s\n", name);
+		goto err;
+	}
+
+	crypto_rte_devs[type].dev_id = dev_id;
+	crypto_rte_devs[type].nb_qps = nb_qps;
+	return 0;
+
+err:
+	rte_vdev_uninit(name);
+	return -1;
+}
+
+static void crypto_rte_dev_uninit(enum crypto_rte_dev_type type)
+{
+	if (crypto_rte_devs[type].dev_id < 0)
+		return;
+
+	rte_cryptodev_stop(crypto_rte_devs[type].dev_id);
+	rte_vdev_uninit(crypto_rte_vdev_names[type]);
+	crypto_rte_devs[type].dev_id = -1;
+	crypto_rte_devs[type].nb_qps = 0;
+}
+
+static void crypto_rte_free_pools(void)
+{
+	rte_mempool_free(crypto_rte_op_pool);
+	rte_mempool_free(crypto_rte_sess_priv_pool);
+	rte_mempool_free(crypto_rte_sess_pool);
+	crypto_rte_op_pool = NULL;
+	crypto_rte_sess_priv_pool = NULL;
+	crypto_rte_sess_pool = NULL;
+}
+
+static int crypto_rte_init(void)
+{
+	uint16_t nb_qps = RTE_MIN(get_lcore_max() + 1, RTE_MAX_LCORE);
+	unsigned int priv_size = 0, size;
+	int socket = rte_socket_id();
+	unsigned int type;
+
+	for (type = 0; type < CRYPTO_RTE_DEV_MAX; type++)
+		crypto_rte_devs[type].dev_id = -1;
+
+	for (type = 0; type < CRYPTO_RTE_DEV_MAX; type++) {
+		if (crypto_rte_dev_init(type, nb_qps) < 0)
+			goto err;
+
+		size = rte_cryptodev_sym_get_private_session_size(
+			crypto_rte_devs[type].dev_id);
+		priv_size = RTE_MAX(priv_size, size);
+	}
+
+	crypto_rte_sess_pool =
+		rte_cryptodev_sym_session_pool_create("crypto_rte_sess",
+						      CRYPTO_RTE_NB_SESSIONS,
+						      0, 0, 0, socket);
+	crypto_rte_sess_priv_pool =
+		rte_mempool_create("crypto_rte_sess_priv",
+				   CRYPTO_RTE_NB_SESSIONS, priv_size, 0, 0,
+				   NULL, NULL, NULL, NULL, socket, 0);
+	crypto_rte_op_pool =
+		rte_crypto_op_pool_create("crypto_rte_op",
+					  RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+					  CRYPTO_RTE_NB_OPS,
+					  MAX_CRYPTO_PKT_BURST,
+					  sizeof(struct crypto_rte_op_priv),
+					  socket);
+	if (!crypto_rte_sess_pool || !crypto_rte_sess_priv_pool ||
+	    !crypto_rte_op_pool) {
+		CRYPTO_RTE_ERR("Failed to allocate mempools\n");
+		goto err;
+	}
+
+	crypto_rte_initialised = true;
+	return 0;
+
+err:
+	crypto_rte_free_pools();
+	for (type = 0; type < CRYPTO_RTE_DEV_MAX; type++)
+		crypto_rte_dev_uninit(type);
+	return -1;
+}
+
+void crypto_rte_shutdown(void)
+{
+	unsigned int type;
+
+	if (!crypto_rte_initialised)
+		return;
+
+	crypto_rte_on = false;
+	for (type = 0; type < CRYPTO_RTE_DEV_MAX; type++)
+		crypto_rte_dev_uninit(type);
+	crypto_rte_free_pools();
+	crypto_rte_initialised = false;
+}
+
+bool crypto_rte_enabled(void)
+{
+	return crypto_rte_on;
+}
+
+/*
+ * The devices are created the first time the backend is turned on, on
+ * the master thread.  Only SAs created after the backend is changed are
+ * affected.
+ */
+int crypto_rte_set(FILE *f, const char *str)
+{
+	bool on;
+
+	if (!str || (strcmp(str, "on") && strcmp(str, "off"))) {
+		if (f)
+			fprintf(f, "error expected on or off\n");
+		return -1;
+	}
+
+	on = strcmp(str, "on") == 0;
+	if (on && !crypto_rte_initialised && crypto_rte_init() < 0) {
+		if (f)
+			fprintf(f, "error failed to create cryptodev devices\n");
+		return -1;
+	}
+
+	crypto_rte_on = on;
+
+	return f ? crypto_engine_probe(f) : 0;
+}
+
+static int crypto_rte_auth_algo(const char *md_name,
+				enum rte_crypto_auth_algorithm *algo)
+{
+	if (!md_name)
+		return -1;
+
+	if (!strcmp(md_name, "hmac(sha1)"))
+		*algo = RTE_CRYPTO_AUTH_SHA1_HMAC;
+	else if (!strcmp(md_name, "hmac(sha256)"))
+		*algo = RTE_CRYPTO_AUTH_SHA256_HMAC;
+	else if (!strcmp(md_name, "hmac(sha384)"))
+		*algo = RTE_CRYPTO_AUTH_SHA384_HMAC;
+	else if (!strcmp(md_name, "hmac(sha512)"))
+		*algo = RTE_CRYPTO_AUTH_SHA512_HMAC;
+	else if (!strcmp(md_name, "hmac(md5)"))
+		*algo = RTE_CRYPTO_AUTH_MD5_HMAC;
+	else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Create a cryptodev session for an SA. AES-GCM goes to the AESNI-GCM
+ * device, and AES-CBC with an HMAC to the AESNI-MB device. Anything
+ * else, and AES-CBC with ESN, which would need the high order bits
+ * of the sequence number inserted ahead of the ICV, is left to
+ * OpenSSL.
+ */
+int crypto_rte_session_create(struct crypto_session *s, bool encrypt,
+			      bool esn)
+{
+	struct rte_crypto_sym_xform cipher = { 0 }, auth = { 0 };
+	struct rte_crypto_sym_xform *xform;
+	enum crypto_rte_dev_type type;
+	struct crypto_rte_session *rs;
+
+	if (!crypto_rte_initialised || !s->cipher)
+		return -1;
+
+	if (crypto_session_is_aead(s)) {
+		type = CRYPTO_RTE_DEV_GCM;
+		cipher.type = RTE_CRYPTO_SYM_XFORM_AEAD;
+		cipher.aead.op = encrypt ? RTE_CRYPTO_AEAD_OP_ENCRYPT :
+			RTE_CRYPTO_AEAD_OP_DECRYPT;
+		cipher.aead.algo = RTE_CRYPTO_AEAD_AES_GCM;
+		cipher.aead.key.data = s->key;
+		cipher.aead.key.length = s->key_len;
+		cipher.aead.iv.offset = CRYPTO_RTE_IV_OFFSET;
+		cipher.aead.iv.length = s->nonce_len + s->iv_len;
+		cipher.aead.digest_length = s->digest_len;
+		cipher.aead.aad_length = esn ? 12 : 8;
+		xform = &cipher;
+	} else {
+		if (esn || EVP_CIPHER_mode(s->cipher) != EVP_CIPH_CBC_MODE ||
+		    s->block_size != 16 ||
+		    crypto_rte_auth_algo(s->md_name, &auth.auth.algo) < 0)
+			return -1;
+
+		type = CRYPTO_RTE_DEV_MB;
+		cipher.type = RTE_CRYPTO_SYM_XFORM_CIPHER;
+		cipher.cipher.op = encrypt ? RTE_CRYPTO_CIPHER_OP_ENCRYPT :
+			RTE_CRYPTO_CIPHER_OP_DECRYPT;
+		cipher.cipher.algo = RTE_CRYPTO_CIPHER_AES_CBC;
+		cipher.cipher.key.data = s->key;
+		cipher.cipher.key.length = s->key_len;
+		cipher.cipher.iv.offset = CRYPTO_RTE_IV_OFFSET;
+		cipher.cipher.iv.length = s->iv_len;
+
+		auth.type = RTE_CRYPTO_SYM_XFORM_AUTH;
+		auth.auth.op = encrypt ? RTE_CRYPTO_AUTH_OP_GENERATE :
+			RTE_CRYPTO_AUTH_OP_VERIFY;
+		auth.auth.key.data = (uint8_t *)s->auth_alg_key;
+		auth.auth.key.length = s->auth_alg_key_len;
+		auth.auth.digest_length = s->digest_len;
+
+		/* Encrypt then MAC */
+		if (encrypt) {
+			cipher.next = &auth;
+			xform = &cipher;
+		} else {
+			auth.next = &cipher;
+			xform = &auth;
+		}
+	}
+
+	rs = calloc(1, sizeof(*rs));
+	if (!rs)
+		return -1;
+
+	rs->sess = rte_cryptodev_sym_session_create(crypto_rte_sess_pool);
+	if (!rs->sess)
+		goto err;
+
+	if (rte_cryptodev_sym_session_init(crypto_rte_devs[type].dev_id,
+					   rs->sess, xform,
+					   crypto_rte_sess_priv_pool) < 0) {
+		rte_cryptodev_sym_session_free(rs->sess);
+		goto err;
+	}
+
+	rs->dev = type;
+	rs->refcnt = 1;
+	s->rte = rs;
+	CRYPTO_RTE_INFO("Created %s session\n", crypto_rte_vdev_names[type]);
+	return 0;
+
+err:
+	free(rs);
+	return -1;
+}
+
+void crypto_rte_session_ref(struct crypto_rte_session *rs)
+{
+	uatomic_inc(&rs->refcnt);
+}
+
+void crypto_rte_session_destroy(struct crypto_rte_session *rs)
+{
+	if (!rs || uatomic_sub_return(&rs->refcnt, 1))
+		return;
+
+	rte_cryptodev_sym_session_clear(crypto_rte_devs[rs->dev].dev_id,
+					rs->sess);
+	rte_cryptodev_sym_session_free(rs->sess);
+	free(rs);
+}
+
+/*
+ * The IV for an outbound packet. For AES-GCM the sequence number is
+ * unique for the key and so serves as the IV (RFC 4106, section 3.1).
+ * AES-CBC needs an IV that cannot be guessed ahead, and the previous
+ * ciphertext block isn't yet available as the burst is encrypted after
+ * it is built.  Instead the random IV each session clone starts with,
+ * as on the OpenSSL path, is used as a salt and the sequence number
+ * mixed into it, so there is no call to the RNG per packet.
+ */
+void crypto_rte_generate_iv(struct crypto_session *s, char iv[],
+			    uint64_t seq)
+{
+	uint64_t be_seq, word;
+	unsigned int off;
+
+	be_seq = rte_cpu_to_be_64(seq);
+	if (crypto_session_is_aead(s)) {
+		memcpy(iv, &be_seq, RTE_MIN(s->iv_len, sizeof(be_seq)));
+		return;
+	}
+
+	memcpy(iv, s->iv, s->iv_len);
+	off = s->iv_len - sizeof(word);
+	memcpy(&word, iv + off, sizeof(word));
+	word ^= be_seq;
+	memcpy(iv + off, &word, sizeof(word));
+}
+
+/*
+ * Queue the crypto op for an ESP packet, the offsets being from the
+ * start of the mbuf data. The op is carried out by the next call to
+ * crypto_rte_flush() on this lcore.
+ */
+int crypto_rte_op_queue(const struct crypto_session *s,
+			struct rte_mbuf *m,
+			uint32_t esp_off, uint32_t esp_len,
+			uint32_t text_len, uint32_t icv_off,
+			const unsigned char *iv,
+			const unsigned char *aad)
+{
+	struct crypto_rte_burst *burst = &RTE_PER_LCORE(crypto_rte_burst);
+	const struct crypto_rte_session *rs = s->rte;
+	struct rte_crypto_sym_op *sym;
+	struct rte_crypto_op *op;
+	uint8_t *op_iv;
+
+	if (unlikely(dp_lcore_id() >= crypto_rte_devs[rs->dev].nb_qps ||
+		     burst->count[rs->dev] >= MAX_CRYPTO_PKT_BURST))
+		return -1;
+
+	op = rte_crypto_op_alloc(crypto_rte_op_pool,
+				 RTE_CRYPTO_OP_TYPE_SYMMETRIC);
+	if (unlikely(!op))
+		return -1;
+
+	rte_crypto_op_attach_sym_session(op, rs->sess);
+	sym = op->sym;
+	sym->m_src = m;
+	op_iv = rte_crypto_op_ctod_offset(op, uint8_t *, CRYPTO_RTE_IV_OFFSET);
+
+	if (rs->dev == CRYPTO_RTE_DEV_GCM) {
+		memcpy(op_iv, s->nonce, s->nonce_len);
+		memcpy(op_iv + s->nonce_len, iv, s->iv_len);
+		memcpy(rte_crypto_op_ctod_offset(op, uint8_t *,
+						 CRYPTO_RTE_AAD_OFFSET),
+		       aad, 12);
+		sym->aead.data.offset = esp_off + esp_len;
+		sym->aead.data.length = text_len;
+		sym->aead.aad.data = rte_crypto_op_ctod_offset(
+			op, uint8_t *, CRYPTO_RTE_AAD_OFFSET);
+		sym->aead.aad.phys_addr = rte_crypto_op_ctophys_offset(
+			op, CRYPTO_RTE_AAD_OFFSET);
+		sym->aead.digest.data = rte_pktmbuf_mtod_offset(m, uint8_t *,
+								icv_off);
+		sym->aead.digest.phys_addr = rte_pktmbuf_iova_offset(m,
+								     icv_off);
+	} else {
+		memcpy(op_iv, iv, s->iv_len);
+		sym->cipher.data.offset = esp_off + esp_len;
+		sym->cipher.data.length = text_len;
+		sym->auth.data.offset = esp_off;
+		sym->auth.data.length = esp_len + text_len;
+		sym->auth.digest.data = rte_pktmbuf_mtod_offset(m, uint8_t *,
+								icv_off);
+		sym->auth.digest.phys_addr = rte_pktmbuf_iova_offset(m,
+								     icv_off);
+	}
+
+	burst->ops[rs->dev][burst->count[rs->dev]++] = op;
+	return 0;
+}
+
+/*
+ * Carry out the ops queued on this lcore. The mbufs of any that
+ * failed, including failing to authenticate, are returned in failed,
+ * which must have room for MAX_CRYPTO_PKT_BURST entries as no more
+ * than a burst is queued between flushes.
+ *
+ * The software PMDs complete each op as it is dequeued, but a device
+ * may take longer. Rather than spin on it, the ops not back after
+ * CRYPTO_RTE_DEQ_POLLS empty polls are left in flight, and their mbufs
+ * returned in inflight, which also needs room for a burst. These now
+ * belong to the backend, and the caller must no longer touch them.
+ * The queue pair returns ops in order, so the ops left in flight are
+ * the first to be dequeued by a later flush, which frees them.
+ */
+unsigned int crypto_rte_flush(struct rte_mbuf **failed,
+			      struct rte_mbuf **inflight,
+			      unsigned int *nb_inflight)
+{
+	struct crypto_rte_burst *burst = &RTE_PER_LCORE(crypto_rte_burst);
+	struct rte_crypto_op *done[MAX_CRYPTO_PKT_BURST];
+	uint16_t qp = dp_lcore_id();
+	unsigned int type, polls, nb_failed = 0;
+	uint16_t count, enq, n, i;
+	struct rte_crypto_op **ops;
+	uint32_t pending, left;
+	struct rte_mbuf *m;
+	int dev_id;
+
+	*nb_inflight = 0;
+	for (type = 0; type < CRYPTO_RTE_DEV_MAX; type++) {
+		count = burst->count[type];
+		if (!count && !burst->inflight[type])
+			continue;
+
+		burst->count[type] = 0;
+		ops = burst->ops[type];
+		dev_id = crypto_rte_devs[type].dev_id;
+
+		enq = 0;
+		if (count)
+			enq = rte_cryptodev_enqueue_burst(dev_id, qp, ops,
+							  count);
+		for (i = enq; i < count; i++) {
+			failed[nb_failed++] = ops[i]->sym->m_src;
+			rte_crypto_op_free(ops[i]);
+		}
+
+		pending = burst->inflight[type] + enq;
+		for (polls = 0; pending && polls < CRYPTO_RTE_DEQ_POLLS;) {
+			n = rte_cryptodev_dequeue_burst(
+				dev_id, qp, done,
+				RTE_MIN(pending, MAX_CRYPTO_PKT_BURST));
+			if (!n) {
+				polls++;
+				rte_pause();
+				continue;
+			}
+
+			pending -= n;
+			for (i = 0; i < n; i++) {
+				m = done[i]->sym->m_src;
+				if (unlikely(burst->inflight[type])) {
+					/* From a burst already given up on */
+					burst->inflight[type]--;
+					rte_pktmbuf_free(m);
+				} else if (unlikely(done[i]->status !=
+						    RTE_CRYPTO_OP_STATUS_SUCCESS))
+					failed[nb_failed++] = m;
+				rte_crypto_op_free(done[i]);
+			}
+		}
+
+		/* Those of this burst still to come are at its end */
+		left = pending - burst->inflight[type];
+		for (i = enq - left; i < enq; i++)
+			inflight[(*nb_inflight)++] = ops[i]->sym->m_src;
+		burst->inflight[type] += left;
+	}
+
+	return nb_failed;
+}
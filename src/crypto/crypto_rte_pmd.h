@@ -0,0 +1,43 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef CRYPTO_RTE_PMD_H
+#define CRYPTO_RTE_PMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Crypto backend using the DPDK cryptodev software PMDs, AESNI-MB for
+ * AES-CBC with HMAC and AESNI-GCM for AES-GCM. Packets are queued as
+ * crypto ops while a burst is processed, and the burst is enqueued to
+ * and dequeued from the device in one go by crypto_rte_flush().
+ */
+
+struct crypto_rte_session;
+struct crypto_session;
+struct rte_mbuf;
+
+bool crypto_rte_enabled(void);
+void crypto_rte_shutdown(void);
+
+int crypto_rte_session_create(struct crypto_session *s, bool encrypt,
+			      bool esn);
+void crypto_rte_session_ref(struct crypto_rte_session *rs);
+void crypto_rte_session_destroy(struct crypto_rte_session *rs);
+
+void crypto_rte_generate_iv(struct crypto_session *s, char iv[],
+			    uint64_t seq);
+int crypto_rte_op_queue(const struct crypto_session *s,
+			struct rte_mbuf *m,
+			uint32_t esp_off, uint32_t esp_len,
+			uint32_t text_len, uint32_t icv_off,
+			const unsigned char *iv,
+			const unsigned char *aad);
+unsigned int crypto_rte_flush(struct rte_mbuf **failed,
+			      struct rte_mbuf **inflight,
+			      unsigned int *nb_inflight);
+
+#endif /* CRYPTO_RTE_PMD_H */
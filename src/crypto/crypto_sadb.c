@@ -161,7 +161,7 @@ int crypto_spi_to_pmd_dev_id(uint32_t spi)
 		return CRYPTO_PMD_INVALID_ID;
 	}
 
-	return sa->pmd_dev_id;
+	return crypto_sa_pmd_dev_id(sa);
 }
 
 static bool sadb_add_sa_to_spi_in_hash(struct sadb_sa *sa)
@@ -517,7 +517,8 @@ static void sadb_refresh_osbervers_of_sa(struct sadb_sa *sa,
 				observer->bytes =
 				 cipher_get_encryption_overhead(sa,
 								sa->family);
-				observer->pmd_dev_id = sa->pmd_dev_id;
+				observer->pmd_dev_id =
+					crypto_sa_pmd_dev_id(sa);
 				observer->spi = sa->spi;
 			}
 		}
@@ -736,6 +737,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 			const struct xfrm_algo *crypto_algo,
 			const struct xfrm_algo_auth *auth_algo,
 			const struct xfrm_encap_tmpl *tmpl,
+			const struct xfrm_replay_state_esn *replay_esn,
 			uint32_t mark_val, uint32_t extra_flags,
 			vrfid_t vrf_id)
 {
@@ -791,8 +793,11 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 	CDS_INIT_LIST_HEAD(&sa->peer_links);
 
 	if (cipher_setup_ctx(crypto_algo, auth_algo, sa_info, tmpl,
-			     sa, extra_flags))
+			     replay_esn, sa, extra_flags))
 		sa->blocked = true;
+	else if (crypto_engine_parallel() && cipher_setup_parallel(sa))
+		SADB_ERR("Failed to set up SA %x for parallel mode\n",
+			 ntohl(sa->spi));
 	/*
 	 * Need to allocate the crypto_pmd before inserting the sa as
 	 * the insertion triggers an update for any registered
@@ -806,8 +811,13 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 					   true);
 	}
 
-	sa->del_pmd_dev_id = sa->pmd_dev_id =
-		crypto_allocate_pmd(crypto_sa_to_xfrm(sa));
+	if (sa->pcpu)
+		sa->del_pmd_dev_id = sa->pmd_dev_id =
+			crypto_allocate_parallel_pmds(crypto_sa_to_xfrm(sa),
+						      &sa->parallel_pmds);
+	else
+		sa->del_pmd_dev_id = sa->pmd_dev_id =
+			crypto_allocate_pmd(crypto_sa_to_xfrm(sa));
 	if (sadb_insert_sa(sa, vrf_ctx) < 0) {
 		/*
 		 * Even though the SA insert failed, we know
@@ -905,9 +915,15 @@ static void crypto_sadb_del_sa_internal(const xfrm_address_t *dst,
 	if (resurrect_old_sa && !sa->pending_del)
 		crypto_sadb_resurrect_sa(sa, vrf_ctx->vrfid);
 
-	crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
-				  crypto_sa_to_xfrm(sa),
-				  sa->pending_del);
+	if (sa->parallel_pmds)
+		crypto_remove_sa_from_parallel_pmds(sa->parallel_pmds,
+						    sa->del_pmd_dev_id,
+						    crypto_sa_to_xfrm(sa),
+						    sa->pending_del);
+	else
+		crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
+					  crypto_sa_to_xfrm(sa),
+					  sa->pending_del);
 	call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
 	vrf_ctx->count_of_sas--;
 
@@ -1113,8 +1129,10 @@ void crypto_sadb_show_summary(FILE *f, vrfid_t vrfid)
 			jsonw_uint_field(wr, "replay_window",
 					 sa->replay_window);
 			jsonw_uint_field(wr, "replay_bitmap",
-					 sa->replay_bitmap);
+					 esp_replay_recent(sa));
 			jsonw_uint_field(wr, "seq", sa->seq);
+			jsonw_bool_field(wr, "esn", crypto_sa_is_esn(sa));
+			jsonw_bool_field(wr, "parallel", sa->pcpu != NULL);
 			jsonw_uint_field(wr, "af", sa->family);
 			jsonw_string_field(wr, "dst",
 					   xfrm_addr_to_str(sa->family,
@@ -1212,11 +1230,18 @@ void crypto_sadb_show_spi_mapping(FILE *f, vrfid_t vrfid)
 void crypto_sadb_increment_counters(struct sadb_sa *sa, uint32_t bytes,
 				    uint32_t packets)
 {
-	sa->packet_count += packets;
-	sa->byte_count   += bytes;
+	uint64_t packet_count, byte_count;
+
+	if (sa->pcpu) {
+		packet_count = uatomic_add_return(&sa->packet_count, packets);
+		byte_count = uatomic_add_return(&sa->byte_count, bytes);
+	} else {
+		packet_count = sa->packet_count += packets;
+		byte_count = sa->byte_count += bytes;
+	}
 
-	if ((sa->packet_count > sa->packet_limit) ||
-	    (sa->byte_count > sa->byte_limit)) {
+	if ((packet_count > sa->packet_limit) ||
+	    (byte_count > sa->byte_limit)) {
 		crypto_sadb_mark_as_blocked(sa);
 		crypto_expire_request(sa->spi, sa->reqid,
 				      IPPROTO_ESP, 0 /* hard */);
@@ -1242,7 +1267,7 @@ static void cypto_sadb_overhead_refresh(struct sadb_peer *peer,
 								 sa->family);
 		overhead->block_size = RTE_ALIGN(block_size,
 						 ESP_PAYLOAD_MIN_ALIGN);
-		overhead->pmd_dev_id = sa->pmd_dev_id;
+		overhead->pmd_dev_id = crypto_sa_pmd_dev_id(sa);
 		overhead->spi = sa->spi;
 		break;
 	}
@@ -1328,7 +1353,7 @@ void crypto_sadb_mark_as_blocked(struct sadb_sa *sa)
 
 void crypto_sadb_seq_drop_inc(struct sadb_sa *sa)
 {
-	sa->seq_drop++;
+	uatomic_inc(&sa->seq_drop);
 	IPSEC_CNT_INC(OUTSIDE_SEQ_WINDOW);
 }
 
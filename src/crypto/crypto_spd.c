@@ -0,0 +1,497 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_branch_prediction.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "compiler.h"
+#include "crypto/crypto_spd.h"
+#include "ip_funcs.h"
+#include "netinet6/in6.h"
+#include "netinet6/ip6_funcs.h"
+#include "pktmbuf_internal.h"
+#include "urcu.h"
+#include "util.h"
+
+/*
+ * Each level of the trie consumes SPD_STRIDE bits of the destination
+ * address. A policy is held at the node at depth prefixlen_d / SPD_STRIDE
+ * along the path of its destination prefix, so every node on the path of
+ * a packet's destination address holds candidate policies.
+ */
+#define SPD_STRIDE		4
+#define SPD_FANOUT		(1 << SPD_STRIDE)
+#define SPD_MAX_DEPTH		(128 / SPD_STRIDE)
+
+struct spd_entry {
+	xfrm_address_t saddr;	/* masked to prefixlen_s */
+	xfrm_address_t daddr;	/* masked to prefixlen_d */
+	void *data;
+	uint32_t rule_index;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t proto;
+	uint8_t prefixlen_s;
+	uint8_t prefixlen_d;
+};
+
+/* Immutable array of policies, sorted by rule index */
+struct spd_rules {
+	struct rcu_head rcu;
+	uint32_t count;
+	struct spd_entry entry[];
+};
+
+struct spd_node {
+	struct spd_node *child[SPD_FANOUT];
+	struct spd_rules *rules;
+	uint32_t nchildren;
+	struct rcu_head rcu;
+};
+
+struct crypto_spd {
+	struct spd_node *root[2];	/* IPv4, IPv6 */
+	uint32_t count;
+};
+
+static inline unsigned int spd_af_idx(uint8_t family)
+{
+	return family == AF_INET6;
+}
+
+static inline unsigned int spd_addr_bits(uint8_t family)
+{
+	return family == AF_INET6 ? 128 : 32;
+}
+
+static inline unsigned int
+spd_nibble(const xfrm_address_t *addr, unsigned int depth)
+{
+	uint8_t byte = ((const uint8_t *)addr)[depth / 2];
+
+	return (depth & 1) ? (byte & 0xf) : (byte >> 4);
+}
+
+static void spd_addr_mask(xfrm_address_t *addr, unsigned int plen)
+{
+	uint8_t *bytes = (uint8_t *)addr;
+	unsigned int i;
+
+	for (i = plen / 8; i < sizeof(*addr); i++) {
+		if (i == plen / 8 && plen % 8)
+			bytes[i] &= 0xff << (8 - plen % 8);
+		else
+			bytes[i] = 0;
+	}
+}
+
+static inline bool
+spd_prefix_match(const xfrm_address_t *prefix, const xfrm_address_t *addr,
+		 unsigned int plen)
+{
+	const uint8_t *p = (const uint8_t *)prefix;
+	const uint8_t *a = (const uint8_t *)addr;
+	unsigned int bytes = plen / 8;
+
+	if (bytes && memcmp(p, a, bytes) != 0)
+		return false;
+
+	if (plen % 8) {
+		uint8_t mask = 0xff << (8 - plen % 8);
+
+		return (a[bytes] & mask) == p[bytes];
+	}
+	return true;
+}
+
+static inline bool
+spd_entry_match(const struct spd_entry *e, const struct crypto_spd_key *key)
+{
+	if (e->proto && e->proto != key->proto)
+		return false;
+	if (e->sport && e->sport != key->sport)
+		return false;
+	if (e->dport && e->dport != key->dport)
+		return false;
+
+	return spd_prefix_match(&e->daddr, &key->daddr, e->prefixlen_d) &&
+		spd_prefix_match(&e->saddr, &key->saddr, e->prefixlen_s);
+}
+
+void *crypto_spd_lookup(const struct crypto_spd *spd,
+			const struct crypto_spd_key *key)
+{
+	unsigned int max_depth = spd_addr_bits(key->family) / SPD_STRIDE;
+	const struct spd_node *node;
+	const struct spd_rules *rules;
+	const struct spd_entry *e;
+	uint32_t best_index = UINT32_MAX;
+	void *best = NULL;
+	unsigned int depth;
+	uint32_t i;
+
+	node = rcu_dereference(spd->root[spd_af_idx(key->family)]);
+
+	for (depth = 0; node; depth++) {
+		rules = rcu_dereference(node->rules);
+		if (rules) {
+			/*
+			 * Sorted by rule index, so stop at the first match
+			 * or once no better match than found so far.
+			 */
+			for (i = 0; i < rules->count; i++) {
+				e = &rules->entry[i];
+				if (e->rule_index >= best_index)
+					break;
+				if (spd_entry_match(e, key)) {
+					void *data = CMM_LOAD_SHARED(e->data);
+
+					/* Skip a policy failed to be removed */
+					if (!data)
+						continue;
+
+					best_index = e->rule_index;
+					best = data;
+					break;
+				}
+			}
+		}
+
+		if (depth == max_depth)
+			break;
+
+		node = rcu_dereference(node->child[spd_nibble(&key->daddr,
+							       depth)]);
+	}
+
+	return best;
+}
+
+/*
+ * Extract the fields to match on from an IP packet. As for xfrm
+ * selectors, the ICMP type and code are matched as the source and
+ * destination ports.
+ *
+ * Ports are only available for the first fragment. A later fragment is
+ * still matched on its upper-layer protocol, taken for IPv6 from the
+ * fragment header as npf does, with the ports left as zero. So it only
+ * matches policies that do not select on ports.
+ */
+bool crypto_spd_key_from_pkt(struct rte_mbuf *m, bool v4,
+			     struct crypto_spd_key *key)
+{
+	uint16_t off = dp_pktmbuf_l2_len(m);
+	const uint16_t *ports = NULL;
+
+	key->sport = 0;
+	key->dport = 0;
+
+	if (v4) {
+		const struct iphdr *ip = iphdr(m);
+
+		key->family = AF_INET;
+		memset(&key->saddr, 0, sizeof(key->saddr));
+		memset(&key->daddr, 0, sizeof(key->daddr));
+		key->saddr.a4 = ip->saddr;
+		key->daddr.a4 = ip->daddr;
+		key->proto = ip->protocol;
+
+		if (ip->frag_off & htons(IP_OFFMASK))
+			return true;
+
+		off += ip->ihl << 2;
+	} else {
+		const struct ip6_hdr *ip6 = ip6hdr(m);
+		uint16_t proto;
+
+		key->family = AF_INET6;
+		memcpy(&key->saddr, &ip6->ip6_src, sizeof(key->saddr));
+		memcpy(&key->daddr, &ip6->ip6_dst, sizeof(key->daddr));
+
+		proto = ip6_findpayload(m, &off);
+		if (proto == IPPROTO_MAX)
+			return false;
+
+		if (proto == IPPROTO_FRAGMENT) {
+			const struct ip6_frag *fh;
+
+			fh = ip6_exthdr(m, off, sizeof(*fh));
+			if (!fh)
+				return false;
+			key->proto = fh->ip6f_nxt;
+			return true;
+		}
+		key->proto = proto;
+	}
+
+	switch (key->proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		if (rte_pktmbuf_data_len(m) < off + 2 * sizeof(uint16_t))
+			return true;
+		ports = rte_pktmbuf_mtod_offset(m, const uint16_t *, off);
+		key->sport = ports[0];
+		key->dport = ports[1];
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		if (rte_pktmbuf_data_len(m) < off + 2)
+			return true;
+		ports = rte_pktmbuf_mtod_offset(m, const uint16_t *, off);
+		key->sport = htons(((const uint8_t *)ports)[0]);
+		key->dport = htons(((const uint8_t *)ports)[1]);
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+uint32_t crypto_spd_count(const struct crypto_spd *spd)
+{
+	return spd ? CMM_LOAD_SHARED(spd->count) : 0;
+}
+
+static void spd_rules_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct spd_rules, rcu));
+}
+
+static void spd_node_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct spd_node, rcu));
+}
+
+static struct spd_rules *spd_rules_alloc(uint32_t count)
+{
+	struct spd_rules *rules;
+
+	rules = malloc(sizeof(*rules) + count * sizeof(rules->entry[0]));
+	if (rules)
+		rules->count = count;
+	return rules;
+}
+
+/*
+ * Publish a new rule array on a node, freeing the old one once no
+ * reader can still be using it.
+ */
+static void spd_node_set_rules(struct spd_node *node, struct spd_rules *rules)
+{
+	struct spd_rules *old = node->rules;
+
+	rcu_assign_pointer(node->rules, rules);
+	if (old)
+		call_rcu(&old->rcu, spd_rules_free);
+}
+
+static bool spd_sel_valid(const struct xfrm_selector *sel)
+{
+	if (sel->family != AF_INET && sel->family != AF_INET6)
+		return false;
+
+	return sel->prefixlen_d <= spd_addr_bits(sel->family) &&
+		sel->prefixlen_s <= spd_addr_bits(sel->family);
+}
+
+int crypto_spd_insert(struct crypto_spd *spd, const struct xfrm_selector *sel,
+		      uint32_t rule_index, void *data)
+{
+	struct spd_node *new[SPD_MAX_DEPTH + 1];
+	struct spd_node **slot, *node, *parent = NULL;
+	unsigned int depth, target, nnew = 0, nalloc;
+	struct spd_rules *old, *rules;
+	struct spd_entry *e;
+	uint32_t count, i;
+
+	if (!spd_sel_valid(sel))
+		return -EINVAL;
+
+	/* Follow the path of the destination prefix as far as it exists */
+	target = sel->prefixlen_d / SPD_STRIDE;
+	slot = &spd->root[spd_af_idx(sel->family)];
+	node = *slot;
+	for (depth = 0; node && depth < target; depth++) {
+		parent = node;
+		slot = &node->child[spd_nibble(&sel->daddr, depth)];
+		node = *slot;
+	}
+
+	/*
+	 * Build the missing part of the path to one side, and publish it
+	 * in one go once complete. So a failed allocation leaves the trie
+	 * as it was, and readers never see a partial node.
+	 */
+	if (!node) {
+		nnew = target - depth + 1;
+		for (nalloc = 0; nalloc < nnew; nalloc++) {
+			new[nalloc] = zmalloc_aligned(sizeof(*node));
+			if (!new[nalloc])
+				goto nomem;
+		}
+		for (i = 0; i + 1 < nnew; i++) {
+			new[i]->child[spd_nibble(&sel->daddr, depth + i)] =
+				new[i + 1];
+			new[i]->nchildren = 1;
+		}
+		node = new[nnew - 1];
+	}
+
+	old = node->rules;
+	count = old ? old->count : 0;
+	rules = spd_rules_alloc(count + 1);
+	if (!rules) {
+		nalloc = nnew;
+		goto nomem;
+	}
+
+	for (i = 0; i < count && old->entry[i].rule_index <= rule_index; i++)
+		rules->entry[i] = old->entry[i];
+
+	e = &rules->entry[i];
+	memset(e, 0, sizeof(*e));
+	e->saddr = sel->saddr;
+	e->daddr = sel->daddr;
+	spd_addr_mask(&e->saddr, sel->prefixlen_s);
+	spd_addr_mask(&e->daddr, sel->prefixlen_d);
+	e->prefixlen_s = sel->prefixlen_s;
+	e->prefixlen_d = sel->prefixlen_d;
+	e->proto = sel->proto;
+	e->sport = sel->sport;
+	e->dport = sel->dport;
+	e->rule_index = rule_index;
+	e->data = data;
+
+	for (; i < count; i++)
+		rules->entry[i + 1] = old->entry[i];
+
+	if (nnew) {
+		node->rules = rules;
+		if (parent)
+			parent->nchildren++;
+		rcu_assign_pointer(*slot, new[0]);
+	} else
+		spd_node_set_rules(node, rules);
+	CMM_STORE_SHARED(spd->count, spd->count + 1);
+
+	return 0;
+
+nomem:
+	while (nalloc > 0)
+		free(new[--nalloc]);
+	return -ENOMEM;
+}
+
+int crypto_spd_remove(struct crypto_spd *spd, const struct xfrm_selector *sel,
+		      uint32_t rule_index, const void *data)
+{
+	struct spd_node *path[SPD_MAX_DEPTH + 1];
+	struct spd_rules *old, *rules = NULL;
+	struct spd_node *node;
+	unsigned int depth, target;
+	uint32_t i, j;
+
+	if (!spd_sel_valid(sel))
+		return -EINVAL;
+
+	target = sel->prefixlen_d / SPD_STRIDE;
+	node = spd->root[spd_af_idx(sel->family)];
+	for (depth = 0; node; depth++) {
+		path[depth] = node;
+		if (depth == target)
+			break;
+		node = node->child[spd_nibble(&sel->daddr, depth)];
+	}
+	if (!node || !node->rules)
+		return -ENOENT;
+
+	old = node->rules;
+	for (i = 0; i < old->count; i++)
+		if (old->entry[i].rule_index == rule_index &&
+		    old->entry[i].data == data)
+			break;
+	if (i == old->count)
+		return -ENOENT;
+
+	if (old->count > 1) {
+		rules = spd_rules_alloc(old->count - 1);
+		if (!rules) {
+			/*
+			 * The caller is about to free the data, so make
+			 * sure lookups stop returning it.
+			 */
+			CMM_STORE_SHARED(old->entry[i].data, NULL);
+			return -ENOMEM;
+		}
+		for (j = 0; j < old->count; j++)
+			if (j != i)
+				rules->entry[j < i ? j : j - 1] =
+					old->entry[j];
+	}
+
+	spd_node_set_rules(node, rules);
+	CMM_STORE_SHARED(spd->count, spd->count - 1);
+
+	/* Prune the nodes of the path that no longer lead to any policy */
+	while (depth > 0 && !node->rules && !node->nchildren) {
+		struct spd_node *parent = path[depth - 1];
+
+		rcu_assign_pointer(
+			parent->child[spd_nibble(&sel->daddr, depth - 1)],
+			NULL);
+		parent->nchildren--;
+		call_rcu(&node->rcu, spd_node_free);
+		node = parent;
+		depth--;
+	}
+
+	return 0;
+}
+
+struct crypto_spd *crypto_spd_create(void)
+{
+	return zmalloc_aligned(sizeof(struct crypto_spd));
+}
+
+static void spd_node_destroy(struct spd_node *node)
+{
+	unsigned int i;
+
+	if (!node)
+		return;
+
+	for (i = 0; i < SPD_FANOUT; i++)
+		spd_node_destroy(node->child[i]);
+
+	free(node->rules);
+	free(node);
+}
+
+/*
+ * Must only be called once no reader can be using the classifier, e.g.
+ * from an RCU callback.
+ */
+void crypto_spd_destroy(struct crypto_spd *spd)
+{
+	if (!spd)
+		return;
+
+	spd_node_destroy(spd->root[0]);
+	spd_node_destroy(spd->root[1]);
+	free(spd);
+}
@@ -0,0 +1,57 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef CRYPTO_SPD_H
+#define CRYPTO_SPD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/xfrm.h>
+
+/*
+ * Selector classifier for the security policy database.
+ *
+ * Policies are held in a multi-bit trie on the destination prefix, with
+ * the source prefix, protocol and ports of each policy checked at the
+ * trie node its destination prefix ends at. A lookup returns the data of
+ * the matching policy with the lowest rule index, i.e. the same policy
+ * the NPF ipsec ruleset would match.
+ *
+ * As in that ruleset, a zero protocol or port in a selector matches any,
+ * and any other port matches only itself. The xfrm port masks are not
+ * used, as policies are never configured with them.
+ *
+ * Inserts and deletes are done by the main thread only and touch a single
+ * path in the trie, with changes published by RCU. Lookups are lock free.
+ */
+
+struct crypto_spd;
+struct rte_mbuf;
+
+/* Packet fields a policy selector is matched against */
+struct crypto_spd_key {
+	xfrm_address_t saddr;
+	xfrm_address_t daddr;
+	uint16_t sport;		/* network order */
+	uint16_t dport;		/* network order */
+	uint8_t proto;
+	uint8_t family;
+};
+
+struct crypto_spd *crypto_spd_create(void);
+void crypto_spd_destroy(struct crypto_spd *spd);
+
+int crypto_spd_insert(struct crypto_spd *spd, const struct xfrm_selector *sel,
+		      uint32_t rule_index, void *data);
+int crypto_spd_remove(struct crypto_spd *spd, const struct xfrm_selector *sel,
+		      uint32_t rule_index, const void *data);
+
+void *crypto_spd_lookup(const struct crypto_spd *spd,
+			const struct crypto_spd_key *key);
+bool crypto_spd_key_from_pkt(struct rte_mbuf *m, bool v4,
+			     struct crypto_spd_key *key);
+uint32_t crypto_spd_count(const struct crypto_spd *spd);
+
+#endif /* CRYPTO_SPD_H */
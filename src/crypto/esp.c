@@ -21,6 +21,8 @@
 #include <rte_log.h>
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
+#include <rte_rwlock.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "crypto/crypto_sadb.h"
@@ -38,6 +40,7 @@
 #include "../pktmbuf_internal.h"
 #include "crypto.h"
 #include "crypto_internal.h"
+#include "crypto_rte_pmd.h"
 #include "esp.h"
 
 struct ifnet;
@@ -204,38 +207,76 @@ uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
  *   not have been previously checked and accepted [by
  *   esp_replay_advance]
  *
- * we detect previously received sequence numbers using a bitmask. The
- * MSB of the bitmask corresponds to the stored highest sequence
- * number so far received. Less significant bits correspond to
- * sequence numbers S in the range:
+ * we detect previously received sequence numbers using a bitmap. This
+ * is a ring indexed by the sequence number, so a sequence number S in
+ * the range:
  *
  * highest_received >= S > (highest_received - replay_window_size)
  *
+ * is recorded by the bit S modulo the size of the ring. Checking and
+ * setting bits needs no lock, so packets for an SA may be decrypted on
+ * several lcores at once.
  */
-int esp_replay_check(const uint8_t *esp,
-		     const struct sadb_sa *sa)
+#define ESP_REPLAY_WORD(seq) \
+	(((seq) / 64) & (ESP_REPLAY_BITMAP_WORDS - 1))
+#define ESP_REPLAY_BIT(seq) (1ul << ((seq) & 63))
+
+/*
+ * Work out the full sequence number of an inbound packet. With ESN
+ * only the low order 32 bits are sent, and the high order bits are
+ * inferred from the window as per RFC 4303, Appendix A2.
+ */
+uint64_t esp_replay_seq(const uint8_t *esp, const struct sadb_sa *sa)
+{
+	const uint32_t seql = ntohl(*(const uint32_t *)(esp+4));
+	const uint32_t window = sa->replay_window ? sa->replay_window : 1;
+	uint64_t top;
+	uint32_t tl, th;
+
+	if (!crypto_sa_is_esn(sa))
+		return seql;
+
+	top = CMM_LOAD_SHARED(sa->seq);
+	tl = top;
+	th = top >> 32;
+
+	if (tl >= window - 1) {
+		/* Window within one subspace */
+		if (seql < tl - window + 1)
+			th++;
+	} else {
+		/* Window spans two subspaces */
+		if (seql >= tl - window + 1 && th)
+			th--;
+	}
+
+	return (uint64_t)th << 32 | seql;
+}
+
+int esp_replay_check(uint64_t seq, const struct sadb_sa *sa)
 {
 	const uint32_t replay_window = sa->replay_window;
-	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
-	uint32_t delta;
+	const uint64_t top = CMM_LOAD_SHARED(sa->seq);
+	uint64_t delta;
 	int ret = 0;
 
-	if (unlikely(!pkt_seq)) {
+	if (unlikely(!seq)) {
 		ret = -1; /* Invalid seq in packet. Auditable event? */
 		goto err;
 	}
 
-	if (likely(pkt_seq > sa->seq))
+	if (likely(seq > top))
 		return 0;
 
-	delta = sa->seq - pkt_seq;
+	delta = top - seq;
 
 	if (delta >= replay_window) {
 		ret = -2; /* Wrap or replay. Auditable event? */
 		goto err;
 	}
 
-	if (sa->replay_bitmap & (1U << delta)) {
+	if (CMM_LOAD_SHARED(sa->replay_bitmap[ESP_REPLAY_WORD(seq)]) &
+	    ESP_REPLAY_BIT(seq)) {
 		ret = -3; /* Replay. Auditable event? */
 		goto err;
 	}
@@ -245,42 +286,129 @@ int esp_replay_check(const uint8_t *esp,
 err:
 	if (net_ratelimit())
 		ESP_INFO("Replay check failed for SPI %#x."
-			" (Packet seq: %#x / SA seq: %#x / Replay Bitmap: %#lx)\n",
-			sa->spi, pkt_seq, sa->seq, sa->replay_bitmap);
+			" (Packet seq: %#lx / SA seq: %#lx)\n",
+			sa->spi, seq, top);
 	return ret;
 }
 
 /*
- * The most significant bit in the mask represents the right hand edge
- * of the sliding window. As the window moves, the bitmask is shifted
- * left. If a packet is received with a sequence number more than
- * replay_window ahead of the current right hand edge, then the
- * bitmask is cleared, and a single bit set to indicate that we've
- * started afresh.
+ * Clear the words of the ring for sequence numbers now ahead of the
+ * old right hand edge, up to and including the new one. If the window
+ * has moved by more than the size of the ring, all of it is cleared.
  */
-void esp_replay_advance(const uint8_t *esp,
-			struct sadb_sa *sa)
+static void esp_replay_clear(struct sadb_sa *sa, uint64_t top, uint64_t seq)
+{
+	uint64_t word = top / 64 + 1;
+	const uint64_t last = seq / 64;
+
+	if (last >= word + ESP_REPLAY_BITMAP_WORDS)
+		word = last - ESP_REPLAY_BITMAP_WORDS + 1;
+
+	for (; word <= last; word++)
+		CMM_STORE_SHARED(sa->replay_bitmap[word &
+						   (ESP_REPLAY_BITMAP_WORDS - 1)],
+				 0);
+}
+
+/*
+ * Record a sequence number, moving the right hand edge of the window if
+ * it is ahead of it. The bit is set atomically, as it may share a word
+ * with bits being set by other lcores.
+ */
+static int esp_replay_update(uint64_t seq, struct sadb_sa *sa)
 {
 	const uint32_t replay_window = sa->replay_window;
-	uint32_t delta;
+	uint64_t top, old, *word;
+
+	top = CMM_LOAD_SHARED(sa->seq);
+	if (seq > top) {
+		if (replay_window)
+			esp_replay_clear(sa, top, seq);
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(sa->seq, seq);
+		top = seq;
+	}
 
 	if (unlikely(!replay_window))
-		return;
-
-	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
-
-	if (pkt_seq > sa->seq) {
-		delta = pkt_seq - sa->seq;
-		if (delta < replay_window)
-			sa->replay_bitmap =
-				((sa->replay_bitmap) << delta) | 1;
-		else
-			sa->replay_bitmap = 1;
-		sa->seq = pkt_seq;
+		return 0;
+
+	if (top - seq >= replay_window)
+		return -2;
+
+	word = &sa->replay_bitmap[ESP_REPLAY_WORD(seq)];
+	do {
+		old = CMM_LOAD_SHARED(*word);
+		if (old & ESP_REPLAY_BIT(seq))
+			return -3;
+	} while (uatomic_cmpxchg(word, old, old | ESP_REPLAY_BIT(seq)) != old);
+
+	return 0;
+}
+
+/*
+ * Record a sequence number once the packet has been authenticated.
+ *
+ * When packets for an SA are decrypted on several lcores, a packet
+ * replayed while the original was being decrypted is caught here. Moving
+ * the right hand edge clears words of the ring, so it excludes the other
+ * lcores. Otherwise a bit checked against the old edge could be set in a
+ * word just cleared for newer sequence numbers, and a later packet would
+ * be dropped as a replay. Lcores that only set bits share the lock.
+ */
+int esp_replay_advance(uint64_t seq, struct sadb_sa *sa)
+{
+	int rc;
+
+	if (!sa->pcpu)
+		return esp_replay_update(seq, sa);
+
+	if (seq > CMM_LOAD_SHARED(sa->seq)) {
+		rte_rwlock_write_lock(&sa->replay_lock);
+		rc = esp_replay_update(seq, sa);
+		rte_rwlock_write_unlock(&sa->replay_lock);
 	} else {
-		delta = sa->seq - pkt_seq;
-		sa->replay_bitmap |= (1U << delta);
+		/* The edge only moves forward, so this cannot move it */
+		rte_rwlock_read_lock(&sa->replay_lock);
+		rc = esp_replay_update(seq, sa);
+		rte_rwlock_read_unlock(&sa->replay_lock);
 	}
+	return rc;
+}
+
+/*
+ * The most recent part of the window, with the least significant bit
+ * representing the right hand edge, as shown to the user.
+ */
+uint64_t esp_replay_recent(const struct sadb_sa *sa)
+{
+	const uint64_t top = CMM_LOAD_SHARED(sa->seq);
+	uint64_t recent = 0;
+	unsigned int i;
+
+	for (i = 0; i < 64 && i < top; i++)
+		if (sa->replay_bitmap[ESP_REPLAY_WORD(top - i)] &
+		    ESP_REPLAY_BIT(top - i))
+			recent |= 1ul << i;
+
+	return recent;
+}
+
+/*
+ * Reserve count outbound sequence numbers, returning the one before
+ * the first reserved. For an SA in parallel mode this is done with a
+ * single atomic update per burst, as any crypto lcore may be using
+ * the SA.
+ */
+uint64_t esp_seq_reserve(struct sadb_sa *sa, unsigned int count)
+{
+	uint64_t seq;
+
+	if (sa->pcpu)
+		return uatomic_add_return(&sa->seq, count) - count;
+
+	seq = sa->seq;
+	sa->seq += count;
+	return seq;
 }
 
 static struct rte_mbuf *esp_get_next_seg(struct rte_mbuf *current,
@@ -308,12 +436,24 @@ static struct rte_mbuf *esp_get_next_seg(struct rte_mbuf *current,
 }
 
 static int esp_process_authdata(struct crypto_chain *chain,
-				unsigned char *esp)
+				unsigned char *esp, const uint32_t *seq_hi)
 {
-	unsigned int esp_len = 8;
+	unsigned char aad[12];
 
-	/* FIXME: the length of the authdata depends on ESN */
-	crypto_chain_add_element(chain, esp, NULL, esp_len, ENG_DIGEST_BLOCK);
+	/*
+	 * With ESN the AAD for AES-GCM is the SPI followed by the full
+	 * 64 bit sequence number (RFC 4106, section 5).
+	 */
+	if (seq_hi && crypto_session_is_aead(chain->ctx)) {
+		memcpy(aad, esp, 4);
+		memcpy(aad + 4, seq_hi, 4);
+		memcpy(aad + 8, esp + 4, 4);
+		crypto_chain_add_element(chain, aad, NULL, sizeof(aad),
+					 ENG_DIGEST_BLOCK);
+	} else {
+		crypto_chain_add_element(chain, esp, NULL, 8,
+					 ENG_DIGEST_BLOCK);
+	}
 
 	return crypto_chain_walk(chain);
 }
@@ -495,16 +635,25 @@ static int esp_process_text(struct crypto_chain *chain,
 *               or will be compated with (verify).
 * seg_data_left - Amount of data remaining in segment passed
 */
-static int esp_process_digest(struct crypto_chain *chain)
+static int esp_process_digest(struct crypto_chain *chain,
+			      uint32_t *seq_hi)
 {
 	uint32_t icv_len = crypto_session_digest_len(chain->ctx);
 
 	if (!icv_len)
 		return 0;
 
-	/* FIXME: support for ESN missing */
-
 	chain->index = 0;
+
+	/*
+	 * With ESN the high order bits of the sequence number are
+	 * included in the ICV after the payload (RFC 4303, section
+	 * 2.2.1).
+	 */
+	if (seq_hi && !crypto_session_is_aead(chain->ctx))
+		crypto_chain_add_element(chain, (unsigned char *)seq_hi, NULL,
+					 sizeof(*seq_hi), ENG_DIGEST_BLOCK);
+
 	crypto_chain_add_element(chain, chain->slop_buffer, chain->slop_buffer,
 				 icv_len, ENG_DIGEST_FINALISE);
 
@@ -545,29 +694,70 @@ static int null_icv_cb(struct crypto_chain *chain __rte_unused,
 	return 0;
 }
 
+/*
+ * Queue the crypto operation for a packet on the cryptodev backend.
+ * It is carried out when the crypto thread flushes the burst.
+ */
+static int esp_queue_op(struct sadb_sa *sa,
+			struct crypto_session *session,
+			struct rte_mbuf *mbuf,
+			unsigned char *esp,
+			unsigned char *iv,
+			uint32_t text_total_len,
+			uint64_t seq)
+{
+	unsigned int esp_off = esp - rte_pktmbuf_mtod(mbuf, unsigned char *);
+	unsigned int esp_len = esp_hdr_len(sa);
+	uint32_t seq_hi = htonl(seq >> 32);
+	unsigned char aad[12];
+
+	/* AAD for AES-GCM, as in esp_process_authdata() */
+	memcpy(aad, esp, 4);
+	if (crypto_sa_is_esn(sa)) {
+		memcpy(aad + 4, &seq_hi, 4);
+		memcpy(aad + 8, esp + 4, 4);
+	} else {
+		memcpy(aad + 4, esp + 4, 4);
+	}
+
+	return crypto_rte_op_queue(session, mbuf, esp_off, esp_len,
+				   text_total_len - esp_len,
+				   esp_off + text_total_len, iv, aad);
+}
+
 /*
  * esp_generate_chain
  *
  * Generate and process a chain of actions for the crypto engine.
+ * Outbound packets on an SA with a cryptodev session are queued to
+ * be encrypted with the rest of the burst instead.
  */
 static int esp_generate_chain(struct sadb_sa *sa,
+			      struct crypto_session *session,
 			      struct rte_mbuf *mbuf,
 			      unsigned int l3_hdr_len,
 			      unsigned char *esp,
 			      unsigned char *iv,
-			      uint32_t text_total_len, int8_t encrypt)
+			      uint32_t text_total_len, int8_t encrypt,
+			      uint64_t seq)
 {
 	struct crypto_chain chain;
 	unsigned int esp_len = esp_hdr_len(sa);
-	unsigned int iv_len = crypto_session_iv_len(sa->session);
+	unsigned int iv_len = crypto_session_iv_len(session);
 	unsigned int icv_len = esp_icv_len(sa);
 	struct crypto_visitor_ctx ctx = {
-		.session = sa->session,
+		.session = session,
 	};
+	uint32_t seq_hi = htonl(seq >> 32);
+	uint32_t *esn = crypto_sa_is_esn(sa) ? &seq_hi : NULL;
+
+	if (encrypt && session->rte && rte_pktmbuf_is_contiguous(mbuf) &&
+	    esp_queue_op(sa, session, mbuf, esp, iv, text_total_len, seq) == 0)
+		return 0;
 
-	crypto_session_set_direction(sa->session, encrypt);
+	crypto_session_set_direction(session, encrypt);
 
-	if (crypto_chain_init(&chain, sa->session))
+	if (crypto_chain_init(&chain, session))
 		return -1;
 
 	chain.v_ctx = &ctx;
@@ -595,7 +785,7 @@ static int esp_generate_chain(struct sadb_sa *sa,
 	}
 
 	/* process plaintext ESP header (w/o IV) */
-	if (esp_process_authdata(&chain, esp) < 0)
+	if (esp_process_authdata(&chain, esp, esn) < 0)
 		return -1;
 
 	/* process plaintext ESP payload IV ptr & len*/
@@ -608,7 +798,7 @@ static int esp_generate_chain(struct sadb_sa *sa,
 	if (esp_process_text(&chain, mbuf, text_total_len, esp + esp_len) < 0)
 		return -1;
 
-	if (esp_process_digest(&chain) < 0)
+	if (esp_process_digest(&chain, esn) < 0)
 		return -1;
 
 	return chain.icv_callback(&chain, mbuf);
@@ -717,28 +907,23 @@ static void esp_input_nat_l4cksum_fixup(int family, struct rte_mbuf *m)
 	}
 }
 
-static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
-			   struct sadb_sa *sa, uint32_t *bytes,
-			   uint8_t *new_family)
-{
-	int rc = 0, head_trim  = 0, tail_trim = 0;
-	unsigned int esp_len, ciphertext_len, udp_len = 0;
-	unsigned int iphlen, icv_len, counter_modify = 0;
+struct esp_in_hdr {
+	unsigned char *esp;
 	unsigned int base_len;
-	char next_hdr = 0, padding_size = 0;
-	unsigned char *iv = NULL, *esp = NULL;
-	unsigned int seg_data_remaining;
-	unsigned int new_total;
-	uint16_t ethertype, prev_off = 0;
-	char *new_l3_hdr;
-	uint8_t post_decrypt_family;
-	void (*tran_fixup)(void *, unsigned int, char, unsigned int);
-	unsigned int (*tunl_fixup)(struct sadb_sa *, void *, void *);
+	unsigned int iphlen;
+	unsigned int udp_len;
+	unsigned int esp_len;
+	unsigned int ciphertext_len;
+};
 
-	if (!sa) {
-		ESP_ERR("No SA for the inbound packet\n");
-		return -1;
-	}
+/*
+ * Locate the ESP header of an inbound packet, and work out the length
+ * of the encrypted payload.
+ */
+static int esp_input_parse(int family, struct rte_mbuf *m, void *l3_hdr,
+			   struct sadb_sa *sa, struct esp_in_hdr *h)
+{
+	unsigned int seg_data_remaining;
 
 	if (family == AF_INET) {
 		struct iphdr *ip = l3_hdr;
@@ -748,30 +933,23 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 			return -1;
 		}
 
-		base_len = ntohs(ip->tot_len);
-		iphlen = ip->ihl << 2;
+		h->base_len = ntohs(ip->tot_len);
+		h->iphlen = ip->ihl << 2;
 	} else {
 		struct ip6_hdr *ip6 = l3_hdr;
 
-		base_len = ntohs(ip6->ip6_plen) + sizeof(struct ip6_hdr);
-		iphlen = dp_pktmbuf_l3_len(m);
-		if (sa->mode == XFRM_MODE_TRANSPORT)
-			prev_off = ip6_findprevoff(m);
+		h->base_len = ntohs(ip6->ip6_plen) + sizeof(struct ip6_hdr);
+		h->iphlen = dp_pktmbuf_l3_len(m);
 	}
 
-	esp =  dp_pktmbuf_mtol4(m, unsigned char *);
+	h->udp_len = 0;
+	h->esp =  dp_pktmbuf_mtol4(m, unsigned char *);
 	if (sa->udp_encap) {
-		esp += sizeof(struct udphdr);
-		udp_len = sizeof(struct udphdr);
-	}
-
-	if (unlikely(sa->replay_window &&
-		     esp_replay_check(esp, sa) < 0)) {
-		crypto_sadb_seq_drop_inc(sa);
-		return -1;
+		h->esp += sizeof(struct udphdr);
+		h->udp_len = sizeof(struct udphdr);
 	}
 
-	esp_len = esp_hdr_len(sa);
+	h->esp_len = esp_hdr_len(sa);
 
 	/*
 	 * Now much data is there left in the segment after the ip/udp
@@ -779,34 +957,94 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 	 * segment.
 	 */
 	seg_data_remaining = rte_pktmbuf_data_len(m) -
-		(esp - rte_pktmbuf_mtod(m, unsigned char *));
+		(h->esp - rte_pktmbuf_mtod(m, unsigned char *));
 
-	if (seg_data_remaining < esp_len) {
+	if (seg_data_remaining < h->esp_len) {
 		ESP_ERR("ESP not in first buffer\n");
 		return -1;
 	}
 
+	h->ciphertext_len = h->base_len - h->iphlen - h->esp_len -
+		h->udp_len - esp_icv_len(sa);
+
+	if (h->ciphertext_len  % crypto_session_block_size(sa->session)) {
+		ESP_ERR("Invalid ctext len %d block_size %d",
+			h->ciphertext_len,
+			crypto_session_block_size(sa->session));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
+			   struct sadb_sa *sa, uint32_t *bytes,
+			   uint8_t *new_family, uint8_t offload)
+{
+	int rc = 0, head_trim  = 0, tail_trim = 0;
+	unsigned int esp_len, ciphertext_len, udp_len;
+	unsigned int iphlen, icv_len, counter_modify = 0;
+	unsigned int base_len;
+	char next_hdr = 0, padding_size = 0;
+	unsigned char *iv = NULL, *esp = NULL;
+	unsigned int new_total;
+	uint16_t ethertype, prev_off = 0;
+	char *new_l3_hdr;
+	uint8_t post_decrypt_family;
+	void (*tran_fixup)(void *, unsigned int, char, unsigned int);
+	unsigned int (*tunl_fixup)(struct sadb_sa *, void *, void *);
+	struct esp_in_hdr h;
+	uint64_t seq;
+
+	if (!sa) {
+		ESP_ERR("No SA for the inbound packet\n");
+		return -1;
+	}
+
+	if (esp_input_parse(family, m, l3_hdr, sa, &h) < 0)
+		return -1;
+
+	esp = h.esp;
+	base_len = h.base_len;
+	iphlen = h.iphlen;
+	udp_len = h.udp_len;
+	esp_len = h.esp_len;
+	ciphertext_len = h.ciphertext_len;
+
+	if (family == AF_INET6 && sa->mode == XFRM_MODE_TRANSPORT)
+		prev_off = ip6_findprevoff(m);
+
+	seq = esp_replay_seq(esp, sa);
+	if (unlikely(sa->replay_window &&
+		     esp_replay_check(seq, sa) < 0)) {
+		crypto_sadb_seq_drop_inc(sa);
+		return -1;
+	}
+
 	/* iv is after the SPI(4) and the SEQ(4) */
 	iv = esp + 8;
 
 	/* ESP length = SPI(4) + SEQ(4) + IV_LEN */
 	head_trim = esp_len + udp_len;
 	icv_len = esp_icv_len(sa);
-	ciphertext_len = base_len - iphlen - esp_len - udp_len - icv_len;
 
-	if (ciphertext_len  % crypto_session_block_size(sa->session)) {
-		ESP_ERR("Invalid ctext len %d block_size %d",
-			ciphertext_len,
-			crypto_session_block_size(sa->session));
+	/*
+	 * A packet already decrypted and authenticated by the cryptodev
+	 * backend only needs the rest of the ESP processing.
+	 */
+	if (unlikely(offload == ESP_OFFLOAD_FAILED))
 		return -1;
-	}
 
-	if (unlikely(esp_generate_chain(sa, m, iphlen, esp, iv,
-					ciphertext_len + esp_len,
-					0) != 0))
+	if (offload != ESP_OFFLOAD_DONE &&
+	    unlikely(esp_generate_chain(sa, crypto_sa_session(sa), m, iphlen,
+					esp, iv, ciphertext_len + esp_len,
+					0, seq) != 0))
 		return -1;
 
-	esp_replay_advance(esp, sa);
+	if (unlikely(esp_replay_advance(seq, sa) < 0)) {
+		crypto_sadb_seq_drop_inc(sa);
+		return -1;
+	}
 
 	rc = buf_tail_trim(m, icv_len, rc);
 	rc = buf_tail_read_char(m, &next_hdr, rc);
@@ -1123,7 +1361,7 @@ static void esp_out_hdr_parse4(void *l3hdr, struct esp_hdr_ctx *h,
 
 static int esp_output_inner(int new_family, struct sadb_sa *sa,
 			    struct rte_mbuf *m, uint8_t orig_family,
-			    void *l3hdr, uint32_t *bytes)
+			    void *l3hdr, uint64_t seq, uint32_t *bytes)
 {
 	int block_size;
 	unsigned int icv_size, tail_len, padding, enc_inc, udp_size = 0;
@@ -1136,6 +1374,7 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 	struct udphdr *udp = NULL;
 	struct rte_ether_hdr *eth_hdr;
 	unsigned char *new_l3hdr;
+	struct crypto_session *session;
 	struct esp_hdr_ctx h;
 
 	if (!sa) {
@@ -1143,6 +1382,17 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 		return -1;
 	}
 
+	/*
+	 * Without ESN the sequence number must not cycle (RFC 4303,
+	 * section 3.3.3), so drop anything reserved beyond the limit.
+	 */
+	if (unlikely(!crypto_sa_is_esn(sa) && seq > ESP_SEQ_SA_BLOCK_LIMIT)) {
+		crypto_sadb_mark_as_blocked(sa);
+		return -1;
+	}
+
+	session = crypto_sa_session(sa);
+
 	transport = (sa->mode == XFRM_MODE_TRANSPORT) ? 1 : 0;
 
 	if (orig_family == AF_INET) {
@@ -1231,27 +1481,35 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 	/* Add Spi, sequence and IV */
 	*(uint32_t *)esp_ptr = (sa->spi);
 	esp_ptr += 4;
-	*(uint32_t *)esp_ptr = htonl(++(sa->seq));
+	*(uint32_t *)esp_ptr = htonl((uint32_t)seq);
 	esp_ptr += 4;
 
-	crypto_session_generate_iv(sa->session, (char *)esp_ptr);
-
-	if (unlikely(sa->seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
-		crypto_rekey_requests++;
-		crypto_expire_request(sa->spi,
-				      crypto_sadb_get_reqid(sa),
-				      IPPROTO_ESP, 0 /* hard */);
+	if (session->rte)
+		crypto_rte_generate_iv(session, (char *)esp_ptr, seq);
+	else
+		crypto_session_generate_iv(session, (char *)esp_ptr);
+
+	if (!crypto_sa_is_esn(sa)) {
+		if (unlikely(seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
+			crypto_rekey_requests++;
+			crypto_expire_request(sa->spi,
+					      crypto_sadb_get_reqid(sa),
+					      IPPROTO_ESP, 0 /* hard */);
+		}
+		if (unlikely(seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
+			crypto_sadb_mark_as_blocked(sa);
 	}
-	if (unlikely(sa->seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
-		crypto_sadb_mark_as_blocked(sa);
 
-	if (unlikely(esp_generate_chain(sa, m, h.out_hdr_len, esp_base, esp_ptr,
-					plaintext_size + esp_size, 1) != 0))
+	if (unlikely(esp_generate_chain(sa, session, m, h.out_hdr_len,
+					esp_base, esp_ptr,
+					plaintext_size + esp_size, 1,
+					seq) != 0))
 		return -1;
 
-	crypto_session_set_iv(sa->session,
-			      crypto_session_iv_len(sa->session),
-			      tail - crypto_session_iv_len(sa->session));
+	if (!session->rte)
+		crypto_session_set_iv(session,
+				      crypto_session_iv_len(session),
+				      tail - crypto_session_iv_len(session));
 
 	eth_hdr = (struct rte_ether_hdr *)hdr;
 	eth_hdr->ether_type = htons(h.out_ethertype);
@@ -1263,33 +1521,62 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 }
 
 int esp_output(struct rte_mbuf *m, uint8_t orig_family, void *ip,
-	       struct sadb_sa *sa, uint32_t *bytes)
+	       struct sadb_sa *sa, uint64_t seq, uint32_t *bytes)
 {
-	return esp_output_inner(AF_INET, sa, m, orig_family, ip, bytes);
+	return esp_output_inner(AF_INET, sa, m, orig_family, ip, seq, bytes);
 }
 
 int esp_output6(struct rte_mbuf *m, uint8_t orig_family, void *ip6,
-		struct sadb_sa *sa, uint32_t *bytes)
+		struct sadb_sa *sa, uint64_t seq, uint32_t *bytes)
 {
-	return esp_output_inner(AF_INET6, sa, m, orig_family, ip6, bytes);
+	return esp_output_inner(AF_INET6, sa, m, orig_family, ip6, seq,
+				bytes);
 }
 
 int esp_input(struct rte_mbuf *m, struct sadb_sa *sa,
-	      uint32_t *bytes, uint8_t *new_family)
+	      uint32_t *bytes, uint8_t *new_family, uint8_t offload)
 {
 	struct iphdr *ip = iphdr(m);
 
 	return esp_input_inner(AF_INET, m, ip, sa,
-			       bytes, new_family);
+			       bytes, new_family, offload);
 }
 
 int esp_input6(struct rte_mbuf *m, struct sadb_sa *sa,
-	       uint32_t *bytes, uint8_t *new_family)
+	       uint32_t *bytes, uint8_t *new_family, uint8_t offload)
 {
 	struct ip6_hdr *ip6 = ip6hdr(m);
 
 	return esp_input_inner(AF_INET6, m, ip6, sa,
-			       bytes, new_family);
+			       bytes, new_family, offload);
+}
+
+/*
+ * Queue an inbound packet to be decrypted by the cryptodev backend.
+ * Returns 0 if it was queued, in which case the result is passed to
+ * esp_input() once the burst has been flushed. Otherwise the packet
+ * is left for esp_input() to decrypt.
+ */
+int esp_input_queue(struct rte_mbuf *m, uint8_t family, struct sadb_sa *sa)
+{
+	struct crypto_session *session = crypto_sa_session(sa);
+	struct esp_in_hdr h;
+	uint64_t seq;
+
+	if (!session->rte || !rte_pktmbuf_is_contiguous(m))
+		return -1;
+
+	if (esp_input_parse(family, m, dp_pktmbuf_mtol3(m, void *), sa,
+			    &h) < 0)
+		return -1;
+
+	/* Leave replays for esp_input() to drop and count */
+	seq = esp_replay_seq(h.esp, sa);
+	if (sa->replay_window && esp_replay_check(seq, sa) < 0)
+		return -1;
+
+	return esp_queue_op(sa, session, m, h.esp, h.esp + 8,
+			    h.ciphertext_len + h.esp_len, seq);
 }
 
 bool udp_esp_dp_interesting(const struct udphdr *udp,
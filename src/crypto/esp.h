@@ -22,16 +22,27 @@ struct rte_mbuf;
 struct sadb_sa;
 struct udphdr;
 
+/*
+ * Whether an inbound packet has been through the cryptodev backend
+ * before esp_input() is called for it.
+ */
+enum esp_offload {
+	ESP_OFFLOAD_NONE,
+	ESP_OFFLOAD_DONE,
+	ESP_OFFLOAD_FAILED,
+};
+
 int esp_input(struct rte_mbuf *m, struct sadb_sa *sa, uint32_t *bytes,
-	      uint8_t *new_family);
+	      uint8_t *new_family, uint8_t offload);
 int esp_input6(struct rte_mbuf *m, struct sadb_sa *sa, uint32_t *bytes,
-	       uint8_t *new_family);
+	       uint8_t *new_family, uint8_t offload);
+int esp_input_queue(struct rte_mbuf *m, uint8_t family, struct sadb_sa *sa);
 
 
 int esp_output(struct rte_mbuf *m,  uint8_t family, void *l3hdr,
-	       struct sadb_sa *sa, uint32_t *bytes);
+	       struct sadb_sa *sa, uint64_t seq, uint32_t *bytes);
 int esp_output6(struct rte_mbuf *m, uint8_t family, void *l3hdr,
-		struct sadb_sa *sa, uint32_t *bytes);
+		struct sadb_sa *sa, uint64_t seq, uint32_t *bytes);
 
 /*
  * RFC 4303 requires the pad length and next header fields to be right aligned
@@ -46,8 +57,11 @@ int esp_output6(struct rte_mbuf *m, uint8_t family, void *l3hdr,
 uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
 				uint16_t tot_len);
 
-int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa);
-void esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa);
+uint64_t esp_replay_seq(const uint8_t *esp, const struct sadb_sa *sa);
+int esp_replay_check(uint64_t seq, const struct sadb_sa *sa);
+int esp_replay_advance(uint64_t seq, struct sadb_sa *sa);
+uint64_t esp_replay_recent(const struct sadb_sa *sa);
+uint64_t esp_seq_reserve(struct sadb_sa *sa, unsigned int count);
 
 /*
  * Returns true if packet requires crypto processing, false otherwise
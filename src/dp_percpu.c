@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <rte_common.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <urcu/system.h>
+
+#include "dp_percpu.h"
+#include "util.h"
+
+/*
+ * Allocate a set of nvals per-lcore counters, all zero.  The per-lcore copies
+ * and the clear base are in the same allocation as the header.
+ */
+struct dp_percpu_counter *dp_percpu_counter_alloc(unsigned int nvals)
+{
+	struct dp_percpu_counter *pc;
+	unsigned int stride, nr_copies;
+
+	if (nvals == 0 || nvals > UINT16_MAX / sizeof(uint64_t))
+		return NULL;
+
+	stride = RTE_ALIGN_CEIL(nvals * sizeof(uint64_t),
+				RTE_CACHE_LINE_SIZE) / sizeof(uint64_t);
+	nr_copies = get_lcore_max() + 1;
+
+	pc = zmalloc_aligned(sizeof(*pc) +
+			     (nr_copies * stride + nvals) * sizeof(uint64_t));
+	if (!pc)
+		return NULL;
+
+	pc->pc_nvals = nvals;
+	pc->pc_stride = stride;
+	pc->pc_nr_copies = nr_copies;
+	pc->pc_base = &pc->pc_vals[nr_copies * stride];
+
+	return pc;
+}
+
+void dp_percpu_counter_free(struct dp_percpu_counter *pc)
+{
+	free(pc);
+}
+
+static uint64_t
+dp_percpu_counter_sum(const struct dp_percpu_counter *pc, unsigned int idx)
+{
+	uint64_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < pc->pc_nr_copies; i++)
+		sum += CMM_LOAD_SHARED(pc->pc_vals[i * pc->pc_stride + idx]);
+
+	return sum;
+}
+
+uint64_t dp_percpu_counter_read(const struct dp_percpu_counter *pc,
+				unsigned int idx)
+{
+	if (idx >= pc->pc_nvals)
+		return 0;
+
+	return dp_percpu_counter_sum(pc, idx) - pc->pc_base[idx];
+}
+
+void dp_percpu_counter_clear(struct dp_percpu_counter *pc)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < pc->pc_nvals; idx++)
+		pc->pc_base[idx] = dp_percpu_counter_sum(pc, idx);
+}
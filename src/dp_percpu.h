@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef DP_PERCPU_H
+#define DP_PERCPU_H
+
+#include <rte_memory.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "util.h"
+
+/*
+ * Per-lcore counters
+ *
+ * A dp_percpu_counter is a small set of 64-bit counters with a private copy
+ * per lcore, each copy starting on its own cache line.  The forwarding
+ * threads update their own copy with plain writes, so a counter hit by many
+ * lcores at once does not have its cache line bounced between them.
+ *
+ * Copies are only summed when the counter is read.  Clearing a counter
+ * records the current sums as a base that later reads subtract, so the
+ * master thread never writes to a copy that an lcore may be updating.
+ *
+ * Threads that are not EAL lcores (console, control and other helper
+ * threads) get lcore id 0 from dp_lcore_id(), so they share the copy of
+ * lcore 0 and update it without any synchronisation.  Counts can be lost if
+ * two of them, or one of them and lcore 0, update a counter at the same
+ * time, so such threads should only update counters where that is
+ * acceptable.
+ */
+struct dp_percpu_counter {
+	uint16_t	pc_nvals;	/* counters per copy */
+	uint16_t	pc_stride;	/* uint64_t per copy */
+	uint32_t	pc_nr_copies;	/* get_lcore_max() + 1 */
+	uint64_t	*pc_base;	/* sums at last clear */
+	uint64_t	pc_vals[] __rte_cache_aligned;
+};
+
+struct dp_percpu_counter *dp_percpu_counter_alloc(unsigned int nvals);
+void dp_percpu_counter_free(struct dp_percpu_counter *pc);
+
+static ALWAYS_INLINE void
+dp_percpu_counter_add(struct dp_percpu_counter *pc, unsigned int idx,
+		      uint64_t val)
+{
+	pc->pc_vals[dp_lcore_id() * pc->pc_stride + idx] += val;
+}
+
+static ALWAYS_INLINE void
+dp_percpu_counter_inc(struct dp_percpu_counter *pc, unsigned int idx)
+{
+	dp_percpu_counter_add(pc, idx, 1);
+}
+
+uint64_t dp_percpu_counter_read(const struct dp_percpu_counter *pc,
+				unsigned int idx);
+void dp_percpu_counter_clear(struct dp_percpu_counter *pc);
+
+#endif /* DP_PERCPU_H */
@@ -1104,6 +1104,8 @@ static void if_free_rcu(struct rcu_head *head)
 
 	if_free_feature_space(ifp);
 	rte_free(ifp->if_vlantbl);
+	rte_free(ifp->if_data);
+	rte_free(ifp->if_mpls_data);
 	rte_free(ifp);
 }
 
@@ -1128,6 +1130,7 @@ struct ifnet *if_alloc(const char *ifname, enum if_type type,
 		       int socket)
 {
 	const struct ift_ops *ops;
+	unsigned int nr_lcores;
 	struct ifnet *ifp;
 	int ret = 0;
 
@@ -1144,6 +1147,25 @@ struct ifnet *if_alloc(const char *ifname, enum if_type type,
 	if (!ifp)
 		return NULL;
 
+	/*
+	 * Per-lcore statistics are sized for the lcores that exist rather
+	 * than RTE_MAX_LCORE.
+	 */
+	nr_lcores = get_lcore_max() + 1;
+	ifp->if_data = rte_zmalloc_socket("ifnet stats",
+					  nr_lcores * sizeof(struct if_data),
+					  RTE_CACHE_LINE_SIZE, socket);
+	ifp->if_mpls_data = rte_zmalloc_socket("ifnet mpls stats",
+					       nr_lcores *
+					       sizeof(struct if_mpls_data),
+					       RTE_CACHE_LINE_SIZE, socket);
+	if (!ifp->if_data || !ifp->if_mpls_data) {
+		rte_free(ifp->if_data);
+		rte_free(ifp->if_mpls_data);
+		rte_free(ifp);
+		return NULL;
+	}
+
 	if (eth_addr)
 		rte_ether_addr_copy(eth_addr, &ifp->eth_addr);
 
@@ -1668,24 +1690,16 @@ void if_cleanup(enum cont_src_en cont_src)
 /* Sum the per-pcore statistics to get one set of data */
 bool if_stats(struct ifnet *ifp, struct if_data *stats)
 {
-	unsigned int lcore, i, n = sizeof(struct if_data) / sizeof(uint64_t);
-	uint64_t *sum = (uint64_t *) stats;
 	const struct ift_ops *ops;
 	int ret;
 
-	memset(sum, 0, sizeof(struct if_data));
-
-	if (ifp->unplugged)
+	if (ifp->unplugged) {
+		memset(stats, 0, sizeof(struct if_data));
 		return false;
-
-	FOREACH_DP_LCORE(lcore) {
-		const uint64_t *pcpu
-			= (const uint64_t *) &ifp->if_data[lcore];
-
-		for (i = 0; i < n; i++)
-			sum[i] += pcpu[i];
 	}
 
+	dp_lcore_sum_u64(stats, ifp->if_data, sizeof(struct if_data));
+
 	ops = if_get_ops(ifp);
 	if (!ops)
 		return false;
@@ -1733,19 +1747,7 @@ bool if_stats(struct ifnet *ifp, struct if_data *stats)
 /* Sum the per-pcore mpls statistics to get one set of data */
 void if_mpls_stats(const struct ifnet *ifp, struct if_mpls_data *stats)
 {
-	unsigned int lcore, i, n = sizeof(struct if_mpls_data) / sizeof(uint64_t);
-	uint64_t *sum = (uint64_t *) stats;
-
-	memset(sum, 0, sizeof(struct if_mpls_data));
-
-	FOREACH_DP_LCORE(lcore) {
-		const uint64_t *pcpu
-			= (const uint64_t *) &ifp->if_mpls_data[lcore];
-
-		for (i = 0; i < n; i++)
-			sum[i] += pcpu[i];
-	}
-
+	dp_lcore_sum_u64(stats, ifp->if_mpls_data, sizeof(struct if_mpls_data));
 }
 
 
@@ -29,6 +29,7 @@
 #include <rte_log.h>
 #include <rte_mbuf.h>
 #include <rte_memory.h>
+#include <rte_spinlock.h>
 #include <rte_timer.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -451,7 +452,69 @@ bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
 }
 
 /*
- * Update existing forwarding table entry
+ * Forwarding table entries are taken from a pool that is grown in chunks
+ * and never shrunk, so a learning storm does not go to the allocator for
+ * every new address.  Entries are returned to the pool from RCU callbacks,
+ * hence the lock.
+ */
+static struct bridge_rtnode *bridge_rtnode_pool;
+static rte_spinlock_t bridge_rtnode_pool_lock = RTE_SPINLOCK_INITIALIZER;
+static uint32_t bridge_rtnode_pool_size;
+static uint32_t bridge_rtnode_pool_used;
+
+/* Learning counters, only written by the master thread */
+static uint64_t bridge_learn_batches;
+static uint64_t bridge_learn_new;
+static uint64_t bridge_learn_moved;
+static uint64_t bridge_learn_nomem;
+
+/* Called with the pool lock held */
+static int bridge_rtnode_pool_grow(void)
+{
+	struct bridge_rtnode *chunk;
+	unsigned int i;
+
+	chunk = zmalloc_aligned(BRIDGE_RTNODE_POOL_CHUNK * sizeof(*chunk));
+	if (!chunk)
+		return -ENOMEM;
+
+	for (i = 0; i < BRIDGE_RTNODE_POOL_CHUNK; i++) {
+		chunk[i].brt_pool_next = bridge_rtnode_pool;
+		bridge_rtnode_pool = &chunk[i];
+	}
+	bridge_rtnode_pool_size += BRIDGE_RTNODE_POOL_CHUNK;
+	return 0;
+}
+
+static struct bridge_rtnode *bridge_rtnode_alloc(void)
+{
+	struct bridge_rtnode *brt = NULL;
+
+	rte_spinlock_lock(&bridge_rtnode_pool_lock);
+	if (bridge_rtnode_pool || bridge_rtnode_pool_grow() == 0) {
+		brt = bridge_rtnode_pool;
+		bridge_rtnode_pool = brt->brt_pool_next;
+		bridge_rtnode_pool_used++;
+	}
+	rte_spinlock_unlock(&bridge_rtnode_pool_lock);
+
+	if (brt)
+		memset(brt, 0, sizeof(*brt));
+	return brt;
+}
+
+static void bridge_rtnode_release(struct bridge_rtnode *brt)
+{
+	rte_spinlock_lock(&bridge_rtnode_pool_lock);
+	brt->brt_pool_next = bridge_rtnode_pool;
+	bridge_rtnode_pool = brt;
+	bridge_rtnode_pool_used--;
+	rte_spinlock_unlock(&bridge_rtnode_pool_lock);
+}
+
+/*
+ * Update existing forwarding table entry, or add a new one.
+ * Only called from the master thread.
  */
 static void
 bridge_rtupdate(struct ifnet *ifp,
@@ -484,10 +547,12 @@ bridge_rtupdate(struct ifnet *ifp,
 	 * update it.
 	 */
 	brt = bridge_rtnode_lookup(sc, dst, vlan);
-	if (unlikely(brt == NULL)) {
-		brt = zmalloc_aligned(sizeof(*brt));
-		if (unlikely(brt == NULL))
+	if (brt == NULL) {
+		brt = bridge_rtnode_alloc();
+		if (unlikely(brt == NULL)) {
+			bridge_learn_nomem++;
 			return;
+		}
 
 		brt->brt_difp = ifp;
 		brt->brt_flags = IFBAF_DYNAMIC;
@@ -496,14 +561,16 @@ bridge_rtupdate(struct ifnet *ifp,
 		brt->brt_expire = 0;
 
 		if (unlikely(bridge_rtnode_insert(sc, brt) != 0)) {
-			free(brt);
+			bridge_rtnode_release(brt);
 			return;
 		}
 		fal_br_new_neigh(ifp->if_index, vlan, dst, 1, &attr);
+		bridge_learn_new++;
 	} else if ((brt->brt_flags & IFBAF_TYPEMASK) == IFBAF_DYNAMIC) {
-		if (unlikely(brt->brt_difp != ifp)) {
+		if (brt->brt_difp != ifp) {
 			fal_br_upd_neigh(ifp->if_index, vlan, dst, &attr);
 			brt->brt_difp = ifp;
+			bridge_learn_moved++;
 		}
 	}
 
@@ -511,10 +578,213 @@ bridge_rtupdate(struct ifnet *ifp,
 	rte_atomic32_clear(&brt->brt_unused);
 }
 
+/*
+ * Source addresses to learn are queued by the forwarding lcores and
+ * applied in batches by the master thread, so a miss costs the lcore a
+ * queue entry rather than an allocation, a hash table insert and a FAL
+ * call.  Each lcore has its own single producer, single consumer queue.
+ * Threads that are not forwarding lcores share the last queue, under a
+ * lock.
+ *
+ * Until an address has been learnt every frame from it misses, so each
+ * queue remembers recently queued addresses and does not queue them
+ * again until the master has drained the queues.  A MAC move is just a
+ * learn event for a different port; the last one queued wins.
+ */
+struct bridge_learn {
+	uint32_t		bl_ifindex;
+	struct bridge_key	bl_key;
+};
+
+struct bridge_learn_ring {
+	uint32_t		prod;
+	uint32_t		gen;		/* of the recent[] entries */
+	uint64_t		enqueued;
+	uint64_t		dedup;
+	uint64_t		dropped;
+	rte_spinlock_t		lock;		/* shared queue only */
+	struct bridge_learn	recent[BRIDGE_LEARN_RECENT];
+	uint32_t		cons __rte_cache_aligned;
+	struct bridge_learn	q[BRIDGE_LEARN_RING_SZ] __rte_cache_aligned;
+};
+
+static_assert((BRIDGE_LEARN_RING_SZ & (BRIDGE_LEARN_RING_SZ - 1)) == 0,
+	      "ring size must be a power of 2");
+static_assert((BRIDGE_LEARN_RECENT & (BRIDGE_LEARN_RECENT - 1)) == 0,
+	      "recent size must be a power of 2");
+
+/* One queue per lcore, with the shared queue last */
+static struct bridge_learn_ring *bridge_learn_rings;
+static unsigned int bridge_learn_nrings;
+
+/* Bumped by the master each time it drains the queues */
+static uint32_t bridge_learn_gen;
+
+/* Set when an event is queued, so the master only drains when needed */
+static bool bridge_learn_posted;
+
+static void
+bridge_learn_enqueue(struct ifnet *ifp, const struct rte_ether_addr *src,
+		     uint16_t vlan)
+{
+	struct bridge_key key = { .addr = *src, .vlan = vlan };
+	unsigned int lcore_id = rte_lcore_id();
+	struct bridge_learn_ring *ring;
+	struct bridge_learn *recent;
+	uint32_t gen, prod;
+	bool shared;
+
+	if (unlikely(!bridge_learn_rings))
+		return;
+
+	shared = lcore_id >= bridge_learn_nrings - 1;
+	ring = &bridge_learn_rings[shared ? bridge_learn_nrings - 1 :
+				   lcore_id];
+
+	if (shared)
+		rte_spinlock_lock(&ring->lock);
+
+	gen = CMM_LOAD_SHARED(bridge_learn_gen);
+	if (ring->gen != gen) {
+		memset(ring->recent, 0, sizeof(ring->recent));
+		ring->gen = gen;
+	}
+
+	recent = &ring->recent[bridge_key_hash(&key) &
+			       (BRIDGE_LEARN_RECENT - 1)];
+	if (recent->bl_ifindex == ifp->if_index &&
+	    bridge_key_equal(&recent->bl_key, &key)) {
+		ring->dedup++;
+		goto out;
+	}
+
+	prod = ring->prod;
+	if (unlikely(prod - CMM_LOAD_SHARED(ring->cons) >=
+		     BRIDGE_LEARN_RING_SZ)) {
+		ring->dropped++;
+		goto out;
+	}
+
+	recent->bl_ifindex = ifp->if_index;
+	recent->bl_key = key;
+	ring->q[prod & (BRIDGE_LEARN_RING_SZ - 1)] = *recent;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(ring->prod, prod + 1);
+	ring->enqueued++;
+
+	/* Order the event before reading the flag the master clears */
+	cmm_smp_mb();
+	if (!CMM_LOAD_SHARED(bridge_learn_posted))
+		CMM_STORE_SHARED(bridge_learn_posted, true);
+out:
+	if (shared)
+		rte_spinlock_unlock(&ring->lock);
+}
+
+/*
+ * Learn the source address of a frame.  An address that is already known
+ * on this port only needs its entry marked as used, and that is only
+ * written when the ageing timer has marked it unused.
+ */
+static inline void
+bridge_learn(struct bridge_softc *sc, struct ifnet *ifp,
+	     const struct rte_ether_addr *src, uint16_t vlan)
+{
+	struct bridge_rtnode *brt;
+
+	brt = bridge_rtnode_lookup(sc, src, vlan);
+	if (likely(brt != NULL) &&
+	    (likely(brt->brt_difp == ifp) || !bridge_mac_is_dynamic(brt))) {
+		if (unlikely(rte_atomic32_read(&brt->brt_unused)))
+			rte_atomic32_clear(&brt->brt_unused);
+		return;
+	}
+
+	bridge_learn_enqueue(ifp, src, vlan);
+}
+
+static void bridge_learn_apply(const struct bridge_learn *bl)
+{
+	struct ifnet *ifp = dp_ifnet_byifindex(bl->bl_ifindex);
+	struct bridge_port *port;
+	uint8_t state;
+
+	/* The port may have gone, or left the bridge, since it was queued */
+	if (!ifp)
+		return;
+	port = rcu_dereference(ifp->if_brport);
+	if (!port)
+		return;
+
+	state = bridge_port_get_state_vlan(port, bl->bl_key.vlan);
+	if (state != STP_IFSTATE_LEARNING && state != STP_IFSTATE_FORWARDING)
+		return;
+
+	bridge_rtupdate(ifp, &bl->bl_key.addr, bl->bl_key.vlan);
+}
+
+/* Drain one queue, returning the number of events taken */
+static unsigned int bridge_learn_drain(struct bridge_learn_ring *ring)
+{
+	uint32_t cons = ring->cons;
+	uint32_t prod = CMM_LOAD_SHARED(ring->prod);
+	unsigned int n = prod - cons;
+
+	if (!n)
+		return 0;
+
+	cmm_smp_rmb();
+	for (; cons != prod; cons++)
+		bridge_learn_apply(&ring->q[cons & (BRIDGE_LEARN_RING_SZ - 1)]);
+
+	/* Finish with the events before the producer may reuse them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(ring->cons, cons);
+	return n;
+}
+
+/* Called from the master thread main loop */
+void bridge_learn_service(void)
+{
+	unsigned int i, n = 0;
+
+	if (likely(!CMM_LOAD_SHARED(bridge_learn_posted)))
+		return;
+
+	/* Clear the flag before looking, so no event is missed */
+	CMM_STORE_SHARED(bridge_learn_posted, false);
+	cmm_smp_mb();
+
+	for (i = 0; i < bridge_learn_nrings; i++)
+		n += bridge_learn_drain(&bridge_learn_rings[i]);
+
+	if (n) {
+		bridge_learn_batches++;
+		CMM_STORE_SHARED(bridge_learn_gen, bridge_learn_gen + 1);
+	}
+}
+
+/* Are there learn events that the master has not yet applied? */
+bool bridge_learn_pending(void)
+{
+	unsigned int i;
+
+	if (!bridge_learn_rings)
+		return false;
+
+	for (i = 0; i < bridge_learn_nrings; i++) {
+		if (CMM_LOAD_SHARED(bridge_learn_rings[i].prod) !=
+		    CMM_LOAD_SHARED(bridge_learn_rings[i].cons))
+			return true;
+	}
+	return false;
+}
+
 static void
 bridge_rtnode_free(struct rcu_head *head)
 {
-	free(caa_container_of(head, struct bridge_rtnode, brt_rcu));
+	bridge_rtnode_release(caa_container_of(head, struct bridge_rtnode,
+					       brt_rcu));
 }
 
 /*
@@ -567,7 +837,7 @@ bridge_newneigh_tunnel(struct bridge_port *brport,
 		return 0;
 	}
 
-	brt = zmalloc_aligned(sizeof(*brt));
+	brt = bridge_rtnode_alloc();
 	if (!brt) {
 		DP_DEBUG(BRIDGE, ERR, BRIDGE,
 			 "out of memory for forwarding entry\n");
@@ -584,7 +854,7 @@ bridge_newneigh_tunnel(struct bridge_port *brport,
 	err = bridge_rtnode_insert(sc, brt);
 	if (err) {
 		/* already created (race) */
-		free(brt);
+		bridge_rtnode_release(brt);
 		return err;
 	}
 	rte_atomic32_clear(&brt->brt_unused);
@@ -1488,7 +1758,7 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 	/* Learn the source address */
 	if (state == STP_IFSTATE_LEARNING ||
 	    state == STP_IFSTATE_FORWARDING)
-		bridge_rtupdate(ifp, &eh->s_addr, bridge_frame_get_vlan(m));
+		bridge_learn(sc, ifp, &eh->s_addr, vlan);
 
 	if (state != STP_IFSTATE_FORWARDING)
 		goto drop;
@@ -1760,7 +2030,7 @@ static void bridge_newneigh(int ifindex, const struct rte_ether_addr *dst,
 		return;
 	}
 
-	brt = zmalloc_aligned(sizeof(*brt));
+	brt = bridge_rtnode_alloc();
 	if (!brt) {
 		DP_DEBUG(BRIDGE, ERR, BRIDGE,
 			"out of memory for forwarding entry\n");
@@ -1777,7 +2047,7 @@ static void bridge_newneigh(int ifindex, const struct rte_ether_addr *dst,
 	err = bridge_rtnode_insert(sc, brt);
 	if (err) {
 		/* already created (race) */
-		free(brt);
+		bridge_rtnode_release(brt);
 	}
 	fal_br_new_neigh(ifindex, vlan, dst, 1, attr_list);
 }
@@ -2550,10 +2820,64 @@ bridge_frag(FILE *f, int argc, char **argv)
 	return -1;
 }
 
+/*
+ * bridge learn show
+ */
+static int
+bridge_learn_show(FILE *f, int argc, char **argv)
+{
+	json_writer_t *wr;
+	unsigned int i;
+
+	if (argc < 2 || strcmp(argv[1], "show") != 0) {
+		fprintf(f, "Unknown bridge learn command\n");
+		return -1;
+	}
+
+	wr = jsonw_new(f);
+	if (!wr)
+		return -1;
+
+	jsonw_name(wr, "learn");
+	jsonw_start_object(wr);
+	jsonw_uint_field(wr, "batches", bridge_learn_batches);
+	jsonw_uint_field(wr, "new", bridge_learn_new);
+	jsonw_uint_field(wr, "moved", bridge_learn_moved);
+	jsonw_uint_field(wr, "nomem", bridge_learn_nomem);
+	jsonw_uint_field(wr, "pool_size",
+			 CMM_LOAD_SHARED(bridge_rtnode_pool_size));
+	jsonw_uint_field(wr, "pool_used",
+			 CMM_LOAD_SHARED(bridge_rtnode_pool_used));
+
+	jsonw_name(wr, "queues");
+	jsonw_start_array(wr);
+	for (i = 0; bridge_learn_rings && i < bridge_learn_nrings; i++) {
+		const struct bridge_learn_ring *ring = &bridge_learn_rings[i];
+
+		if (!ring->enqueued && !ring->dedup && !ring->dropped)
+			continue;
+
+		jsonw_start_object(wr);
+		if (i == bridge_learn_nrings - 1)
+			jsonw_string_field(wr, "lcore", "shared");
+		else
+			jsonw_uint_field(wr, "lcore", i);
+		jsonw_uint_field(wr, "enqueued", ring->enqueued);
+		jsonw_uint_field(wr, "dedup", ring->dedup);
+		jsonw_uint_field(wr, "dropped", ring->dropped);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+	jsonw_end_object(wr);
+	jsonw_destroy(&wr);
+	return 0;
+}
+
 /*
  * bridge <bridge> macs show [port <port>] [mac <mac>] [vlan <vlan>] [hardware]
  * bridge <bridge> macs clear [port <port>] [mac <mac>]
  * bridge frag {enable | disable | show}
+ * bridge learn show
  */
 int
 cmd_bridge(FILE *f, int argc, char **argv)
@@ -2569,6 +2893,9 @@ cmd_bridge(FILE *f, int argc, char **argv)
 	if (strcmp(argv[0], "frag") == 0)
 		return bridge_frag(f, argc, argv);
 
+	if (strcmp(argv[0], "learn") == 0)
+		return bridge_learn_show(f, argc, argv);
+
 	bridge = dp_ifnet_byifname(argv[0]);
 
 	if (!bridge || !bridge->if_softc ||
@@ -2688,6 +3015,20 @@ static void bridge_init(void)
 		bridge_pvst_flood_local = punt_pvst.value.booldata;
 	else
 		bridge_pvst_flood_local = true;
+
+	bridge_learn_nrings = get_lcore_max() + 2;
+	bridge_learn_rings = zmalloc_aligned(bridge_learn_nrings *
+					     sizeof(*bridge_learn_rings));
+	if (!bridge_learn_rings)
+		rte_panic("Failed to allocate bridge learn queues\n");
+	for (unsigned int i = 0; i < bridge_learn_nrings; i++)
+		rte_spinlock_init(&bridge_learn_rings[i].lock);
+
+	rte_spinlock_lock(&bridge_rtnode_pool_lock);
+	ret = bridge_rtnode_pool_grow();
+	rte_spinlock_unlock(&bridge_rtnode_pool_lock);
+	if (ret < 0)
+		rte_panic("Failed to allocate bridge forwarding entries\n");
 }
 
 static const struct dp_event_ops bridge_events = {
@@ -82,8 +82,18 @@ struct bridge_rtnode {
 	uint8_t			brt_expire;
 	rte_atomic32_t          brt_unused;     /* 0 = used */
 	uint32_t		brt_dip;
+	struct bridge_rtnode	*brt_pool_next;	/* free list when unused */
 };
 
+/* Forwarding table entries are allocated from the pool in chunks */
+#define BRIDGE_RTNODE_POOL_CHUNK	1024
+
+/* Learn events queued per lcore before further events are dropped */
+#define BRIDGE_LEARN_RING_SZ	1024
+
+/* Recently queued addresses remembered per lcore to suppress duplicates */
+#define BRIDGE_LEARN_RECENT	256
+
 struct mstp_bridge;
 
 struct bridge_softc {
@@ -145,6 +155,10 @@ bridge_newneigh_tunnel(struct bridge_port *brport,
 
 void bridge_output(struct ifnet *ifp, struct rte_mbuf *m, struct ifnet *in_ifp);
 
+/* Apply source addresses queued for learning by the forwarding lcores */
+void bridge_learn_service(void);
+bool bridge_learn_pending(void);
+
 fal_object_t bridge_fal_stp_object(const struct ifnet *ifp);
 
 struct ifnet *bridge_create(int ifindex, const char *ifname,
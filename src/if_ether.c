@@ -57,9 +57,9 @@
 #include "if_ether.h"
 #include "if_llatbl.h"
 #include "if_var.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "netinet6/nd6_nbr.h"
-#include "pktmbuf_internal.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -112,10 +112,8 @@ void ll_addr_set(struct llentry *lle, const struct rte_ether_addr *eth)
 void lladdr_update(struct ifnet *ifp, struct llentry *la,
 		   const struct rte_ether_addr *enaddr, uint16_t flags)
 {
-	struct rte_mbuf *la_held[ARP_MAXHOLD];
 	struct rte_ether_addr old_enaddr;
 	char b1[20], b2[20];
-	int la_numheld = 0;
 	bool was_valid;
 
 	if (!enaddr) {
@@ -166,14 +164,8 @@ void lladdr_update(struct ifnet *ifp, struct llentry *la,
 	}
 	la->la_flags |= flags;
 
-	if (!was_valid) {
-		la_numheld = la->la_numheld;
-		for (int i = 0; i < la_numheld; ++i) {
-			la_held[i] = la->la_held[i];
-			la->la_held[i] = NULL;
-		}
+	if (!was_valid)
 		la->la_numheld = 0;
-	}
 
 	rte_spinlock_unlock(&la->ll_lock);
 
@@ -188,27 +180,9 @@ void lladdr_update(struct ifnet *ifp, struct llentry *la,
 			     lladdr_ntop(la),
 			     ether_ntoa_r(enaddr, b1));
 
-	if (!was_valid) {
-		/* now valid: release any pending packets */
-		for (int i = 0; i < la_numheld; i++) {
-			struct rte_mbuf *m = la_held[i];
-			struct rte_ether_hdr *eh;
-
-			/* fill in destination in held packet and send it */
-			eh = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-
-			rte_ether_addr_copy(enaddr, &eh->d_addr);
-			/*
-			 * Note: even though this may be a forwarded
-			 * packet, NULL is passed in for the input
-			 * interface since this is only used for
-			 * tunnel interfaces in certain corner cases
-			 * and it's not worth the effort of keeping
-			 * track of the input interface context.
-			 */
-			if_output(ifp, m, NULL, htons(eh->ether_type));
-		}
-	}
+	/* now valid: release any pending packets */
+	if (!was_valid)
+		ll_hold_changed(la);
 
 	/* entry updated */
 	rte_atomic16_clear(&la->ll_idle);
@@ -262,9 +236,6 @@ lladdr_add(struct ifnet *ifp, struct sockaddr *sock,
 	} else {
 		rte_spinlock_lock(&lle->ll_lock);
 		lle->la_flags &= ~(LLE_VALID | LLE_STATIC);
-
-		pktmbuf_free_bulk(lle->la_held, lle->la_numheld);
-		lle->la_numheld = 0;
 		rte_spinlock_unlock(&lle->ll_lock);
 	}
 
@@ -50,9 +50,9 @@
 #include "if_llatbl.h"
 #include "if_var.h"
 #include "lcore_sched.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "nd6_nbr.h"
-#include "pktmbuf_internal.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_log.h"
@@ -165,18 +165,15 @@ __llentry_destroy(struct lltable *llt, struct llentry *lle)
 }
 
 /* Marks entry as DELETED, so that the master thread can then pick it
- * up from the timer and complete the deletion.
+ * up from the timer and complete the deletion.  Packets held for the
+ * entry are dropped when their hold queues are next serviced.
  * Must be protected by spinlock.
  */
-unsigned
+void
 llentry_destroy(struct lltable *llt, struct llentry *lle)
 {
-	unsigned int dropped = lle->la_numheld;
-
 	lle->la_flags |= LLE_DELETED;
-
-	pktmbuf_free_bulk(lle->la_held, dropped);
-	lle->la_numheld = 0;
+	ll_hold_changed(lle);
 
 	if (is_master_thread())
 		__llentry_destroy(llt, lle);
@@ -185,14 +182,13 @@ llentry_destroy(struct lltable *llt, struct llentry *lle)
 		rte_timer_reset(&llt->lle_timer, 0,
 				SINGLE, rte_get_master_lcore(),
 				lladdr_timer, llt);
-
-	return dropped;
 }
 
 static unsigned
 llentry_flush_cb(struct lltable *llt, struct llentry *lle, void *arg __unused)
 {
-	return llentry_destroy(llt, lle);
+	llentry_destroy(llt, lle);
+	return 0;
 }
 
 /*
@@ -313,11 +309,6 @@ lltable_fal_l3_change(struct lltable *llt, bool enable)
 
 void llentry_free(struct llentry *lle)
 {
-	if (lle->la_numheld != 0)
-		RTE_LOG(ERR, DATAPLANE,
-			"%s(%p) possible mbuf leak (%#x %d)\n",
-			__func__, lle, lle->la_flags, lle->la_numheld);
-
 	rte_free(lle);
 }
 
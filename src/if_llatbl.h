@@ -78,7 +78,7 @@ struct llentry {
 #define ll_addr ll_u.lu_addr
 #define la_flags ll_u.lu_flags
 	rte_atomic16_t		ll_idle;	/* 0 if used */
-	uint8_t			la_numheld;
+	uint8_t			la_numheld;	/* on hold queues */
 	uint8_t			la_asked;
 	uint8_t			la_state;
 	uint8_t			pad1[3];
@@ -88,8 +88,6 @@ struct llentry {
 	/* --- cacheline 2 boundary (128 bytes) was 48 bytes ago --- */
 	uint64_t		ll_expire;
 	struct rcu_head		ll_rcu;
-	/* --- cacheline 3 boundary (192 bytes) was 8 bytes ago --- */
-	struct rte_mbuf		*la_held[ARP_MAXHOLD];
 };
 
 static_assert(offsetof(struct llentry, ll_sock) < 64,
@@ -157,7 +155,7 @@ bool lltable_fal_l3_change(struct lltable *llt, bool enable);
 /* Final destroy on master thread */
 void __llentry_destroy(struct lltable *llt, struct llentry *lle);
 /* Destroy on any thread */
-unsigned int llentry_destroy(struct lltable *, struct llentry *);
+void llentry_destroy(struct lltable *, struct llentry *);
 void llentry_free(struct llentry *);
 
 struct llentry *in_lltable_lookup(struct ifnet *ifp, u_int flags,
@@ -203,12 +201,23 @@ struct in_addr *ll_ipv4_addr(struct llentry *lle);
 /* If the entry is v6 return a ptr to the  v4 addr, otherwise null */
 struct in6_addr *ll_ipv6_addr(struct llentry *lle);
 
+/*
+ * Mark an entry as used by the forwarding path.  The idle flag is only
+ * written if the aging timer has set it since the last use, so that in the
+ * steady state the forwarding threads only ever read the entry's first
+ * cache line and it can stay shared between them.
+ */
+static ALWAYS_INLINE void llentry_set_used(struct llentry *la)
+{
+	if (unlikely(rte_atomic16_read(&la->ll_idle)))
+		rte_atomic16_clear(&la->ll_idle);
+}
+
 static ALWAYS_INLINE bool
 llentry_copy_mac(struct llentry *la,  struct rte_ether_addr *desten)
 {
 	if (likely(la && (la->la_flags & LLE_VALID))) {
-		if (rte_atomic16_read(&la->ll_idle))
-			rte_atomic16_clear(&la->ll_idle);
+		llentry_set_used(la);
 		rte_ether_addr_copy((struct rte_ether_addr *)&la->ll_addr,
 				    desten);
 		return true;
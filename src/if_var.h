@@ -303,6 +303,9 @@ struct ifnet {
 	struct cds_lfht   *if_mcfltr_hash;   /* Table of filtered mcast pkts*/
 	struct lltable	   *if_lltable;	/* IPv4 address mapping */
 	struct lltable	   *if_lltable6; /* IPv6 address mapping */
+
+	/* Per-lcore statistics, indexed by dp_lcore_id() */
+	struct if_data	   *if_data;
 	/* --- cacheline 3 boundary (192 bytes)  --- */
 	uint8_t            if_mac_filtr_supported:1,
 			   if_mac_filtr_active:1,
@@ -351,11 +354,9 @@ struct ifnet {
 	struct if_perf	   if_rxpps;	/* packets rate */
 	struct if_perf	   if_rxbps;	/* bandwidth */
 	struct rte_timer   if_stats_timer; /* update performance */
-	uint8_t padding4[40];
-
-	struct if_data	   if_data[RTE_MAX_LCORE];
 
-	struct if_mpls_data if_mpls_data[RTE_MAX_LCORE];
+	/* Per-lcore MPLS statistics, indexed by dp_lcore_id() */
+	struct if_mpls_data *if_mpls_data;
 
 	/* TCP MSS clamping feature type and value */
 	uint16_t            tcp_mss_type[TCP_MSS_AF_SIZE];
@@ -386,6 +387,8 @@ static_assert(offsetof(struct ifnet, if_vlantbl) == 64,
 	      "first cache line exceeded");
 static_assert(offsetof(struct ifnet, pminfo) == 128,
 	      "second cache line exceeded");
+static_assert(offsetof(struct ifnet, if_data) < 192,
+	      "third cache line exceeded");
 
 static inline uint16_t if_tpid(const struct ifnet *ifp)
 {
@@ -6,6 +6,8 @@
  * Route update protobuf handling for IP & MPLS
  */
 
+#include <rte_jhash.h>
+
 #include "if_var.h"
 #include "ip_rt_protobuf.h"
 #include "mpls/mpls_label_table.h"
@@ -429,32 +431,25 @@ static int mpls_route_pb_handler(RibUpdate *rtupdate, bool *add_incomplete)
 	return 0;
 }
 
-int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
+static int ip_route_pb_apply(RibUpdate *rtupdate, void *data, size_t len,
+			     enum cont_src_en cont_src)
 {
 	bool add_incomplete = false;
-	RibUpdate *rtupdate;
 	Route *route;
 	int rc = -1;
 	void *dest;
 	int af;
 
-	rtupdate = rib_update__unpack(NULL, len, data);
-	if (!rtupdate) {
-		RTE_LOG(ERR, DATAPLANE,
-			"failed to read RibUpdate protobuf message\n");
-		return -1;
-	}
-
 	if (!rtupdate->route) {
 		RTE_LOG(NOTICE, DATAPLANE,
 			"missing route in RibUpdate protobuf message\n");
-		goto free_msg;
+		return rc;
 	}
 
 	if (!rtupdate->route->prefix) {
 		RTE_LOG(NOTICE, DATAPLANE,
 			"missing prefix in RibUpdate protobuf message\n");
-		goto free_msg;
+		return rc;
 	}
 
 	route = rtupdate->route;
@@ -469,8 +464,7 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 			RTE_LOG(NOTICE, DATAPLANE,
 				"bad prefix address length %lu in RibUpdate protobuf message\n",
 				route->prefix->ipv6_addr.len);
-			rc = -1;
-			goto free_msg;
+			return -1;
 		}
 
 		af = AF_INET6;
@@ -481,8 +475,7 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 		dest = &rtupdate->route->prefix->mpls_label;
 		break;
 	default:
-		rc = -2;
-		goto free_msg;
+		return -2;
 	}
 
 	incomplete_route_del(dest, af, route->prefix_length,
@@ -510,7 +503,171 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 					route->routing_protocol, data,
 					len);
 
-free_msg:
+	return rc;
+}
+
+int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
+{
+	RibUpdate *rtupdate;
+	int rc;
+
+	rtupdate = rib_update__unpack(NULL, len, data);
+	if (!rtupdate) {
+		RTE_LOG(ERR, DATAPLANE,
+			"failed to read RibUpdate protobuf message\n");
+		return -1;
+	}
+
+	rc = ip_route_pb_apply(rtupdate, data, len, cont_src);
+
 	rib_update__free_unpacked(rtupdate, NULL);
 	return rc;
 }
+
+/* The route that a RibUpdate adds, replaces or deletes */
+struct ip_route_pb_key {
+	uint8_t		addr[sizeof(struct in6_addr)];
+	uint32_t	table_id;
+	uint32_t	scope;
+	uint32_t	proto;
+	uint8_t		af;
+	uint8_t		prefix_length;
+	uint8_t		local;
+	uint8_t		pad;
+};
+
+#define IP_ROUTE_PB_BATCH_HASH_SZ	(2 * IP_ROUTE_PB_BATCH_MAX)
+
+/*
+ * Get the key for an IPv4 or IPv6 RibUpdate.  Returns false for anything
+ * else, including MPLS label updates, which are never coalesced.
+ */
+static bool
+ip_route_pb_key_get(const RibUpdate *rtupdate, struct ip_route_pb_key *key)
+{
+	const Route *route = rtupdate->route;
+
+	if (!route || !route->prefix)
+		return false;
+
+	if (rtupdate->action != RIB_UPDATE__ACTION__UPDATE &&
+	    rtupdate->action != RIB_UPDATE__ACTION__DELETE)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+
+	switch (route->prefix->address_oneof_case) {
+	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV4_ADDR:
+		key->af = AF_INET;
+		memcpy(key->addr, &route->prefix->ipv4_addr,
+		       sizeof(route->prefix->ipv4_addr));
+		break;
+	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV6_ADDR:
+		if (route->prefix->ipv6_addr.len != sizeof(struct in6_addr))
+			return false;
+		key->af = AF_INET6;
+		memcpy(key->addr, route->prefix->ipv6_addr.data,
+		       sizeof(struct in6_addr));
+		break;
+	default:
+		return false;
+	}
+
+	key->table_id = route->table_id;
+	key->scope = route->scope;
+	key->proto = route->routing_protocol;
+	key->prefix_length = route->prefix_length;
+	key->local = route->n_paths == 1 &&
+		route->paths[0]->type == PATH__PATH_TYPE__LOCAL;
+
+	return true;
+}
+
+/*
+ * Add a key to the set of routes with a later update in the batch.  Returns
+ * true if it was already present.
+ */
+static bool
+ip_route_pb_key_test_and_set(const struct ip_route_pb_key *keys,
+			     int16_t *slots, int16_t idx)
+{
+	const struct ip_route_pb_key *key = &keys[idx];
+	uint32_t i;
+
+	i = rte_jhash(key, sizeof(*key), 0) % IP_ROUTE_PB_BATCH_HASH_SZ;
+
+	while (slots[i] >= 0) {
+		if (!memcmp(&keys[slots[i]], key, sizeof(*key)))
+			return true;
+		i = (i + 1) % IP_ROUTE_PB_BATCH_HASH_SZ;
+	}
+	slots[i] = idx;
+	return false;
+}
+
+/*
+ * Process a batch of RibUpdate messages, e.g. all those that were queued on
+ * the route broker socket.
+ *
+ * Both an IP route update and a delete remove any previous state for the
+ * route, so only the last message for each route in the batch needs to be
+ * applied.  Earlier ones are dropped rather than programming the LPM and FAL
+ * with a route that is replaced straight away, as happens when the RIB is
+ * converging after a restart.  The messages that are applied keep the order
+ * in which they were received.
+ *
+ * Returns the number of messages that were not handled.
+ */
+unsigned int ip_route_pb_batch_handler(void *data[], size_t len[],
+				       unsigned int count,
+				       enum cont_src_en cont_src)
+{
+	RibUpdate *rtupdate[IP_ROUTE_PB_BATCH_MAX];
+	struct ip_route_pb_key keys[IP_ROUTE_PB_BATCH_MAX];
+	int16_t slots[IP_ROUTE_PB_BATCH_HASH_SZ];
+	bool skip[IP_ROUTE_PB_BATCH_MAX];
+	unsigned int failed = 0;
+	unsigned int dropped = 0;
+	int i;
+
+	count = RTE_MIN(count, (unsigned int)IP_ROUTE_PB_BATCH_MAX);
+
+	for (i = 0; i < (int)count; i++) {
+		rtupdate[i] = rib_update__unpack(NULL, len[i], data[i]);
+		if (!rtupdate[i])
+			RTE_LOG(ERR, DATAPLANE,
+				"failed to read RibUpdate protobuf message\n");
+	}
+
+	/*
+	 * Walk backwards, so that a message is skipped if there is a later
+	 * one for the same route.
+	 */
+	memset(slots, -1, sizeof(slots));
+	for (i = count - 1; i >= 0; i--) {
+		skip[i] = false;
+		if (rtupdate[i] && ip_route_pb_key_get(rtupdate[i], &keys[i]) &&
+		    ip_route_pb_key_test_and_set(keys, slots, i)) {
+			skip[i] = true;
+			dropped++;
+		}
+	}
+
+	for (i = 0; i < (int)count; i++) {
+		if (!rtupdate[i]) {
+			failed++;
+			continue;
+		}
+		if (!skip[i] &&
+		    ip_route_pb_apply(rtupdate[i], data[i], len[i], cont_src))
+			failed++;
+		rib_update__free_unpacked(rtupdate[i], NULL);
+	}
+
+	if (dropped)
+		DP_DEBUG(NETLINK_ROUTE, DEBUG, ROUTE,
+			 "%u of %u route updates overridden in batch\n",
+			 dropped, count);
+
+	return failed;
+}
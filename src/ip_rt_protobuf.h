@@ -6,10 +6,17 @@
 #ifndef IP_RT_PROTOBUF_H
 #define IP_RT_PROTOBUF_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "control.h"
 
+/* Maximum number of messages in an ip_route_pb_batch_handler call */
+#define IP_ROUTE_PB_BATCH_MAX 256
+
 int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src);
+unsigned int ip_route_pb_batch_handler(void *data[], size_t len[],
+				       unsigned int count,
+				       enum cont_src_en cont_src);
 
 #endif /* IP_RT_PROTOBUF_H */
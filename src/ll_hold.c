@@ -0,0 +1,677 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Neighbour resolution hold queues.  See ll_hold.h.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_jhash.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_spinlock.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <urcu/system.h>
+
+#include "arp.h"
+#include "compiler.h"
+#include "ether.h"
+#include "if_llatbl.h"
+#include "if_var.h"
+#include "json_writer.h"
+#include "ll_hold.h"
+#include "netinet6/nd6_nbr.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_log.h"
+
+struct ll_hold_ent {
+	struct rte_mbuf		*m;
+	uint64_t		expire;		/* timer cycles */
+	uint32_t		ifindex;
+	uint8_t			family;
+	uint8_t			bucket;		/* of its generation */
+	union {
+		struct in_addr	in;
+		struct in6_addr	in6;
+	} addr;
+};
+
+/* A packet released by a scan, waiting to be sent */
+struct ll_hold_out {
+	struct ifnet		*ifp;
+	struct rte_mbuf		*m;
+	uint32_t		seq;		/* position in the queue */
+};
+
+struct ll_hold_stats {
+	uint64_t		held;
+	uint64_t		sent;
+	uint64_t		dropped_full;
+	uint64_t		dropped_unresolved;
+	uint64_t		expired;
+	uint64_t		solicit_limited;
+};
+
+struct ll_hold_queue {
+	rte_spinlock_t		lock;		/* shared queue only */
+	uint32_t		count;
+	bool			rescan;		/* whatever the gens */
+	uint64_t		held_buckets;	/* with packets held */
+	uint64_t		scanned;	/* time of last full scan */
+	uint32_t		gens[LL_HOLD_GEN_BUCKETS]; /* at last scan */
+	uint32_t		sol_tokens;
+	uint64_t		sol_refill;
+	struct ll_hold_ent	*ents;
+	struct ll_hold_ent	*spare;		/* swapped with ents to scan */
+	struct ll_hold_out	*out;
+	struct ll_hold_stats	stats;
+} __rte_cache_aligned;
+
+/*
+ * One queue per lcore that dp_lcore_id() can return, with the shared queue
+ * last.
+ */
+static struct ll_hold_queue *ll_hold_queues;
+static unsigned int ll_hold_shared;
+
+/*
+ * Generations of the neighbours, hashed into buckets, so a change only
+ * causes the packets held for neighbours in the same bucket to be
+ * looked at again.
+ */
+static uint32_t ll_hold_gens[LL_HOLD_GEN_BUCKETS];
+static unsigned int ll_hold_depth = LL_HOLD_DEPTH_DEF;
+static unsigned int ll_hold_sol_rate = LL_HOLD_SOL_RATE_DEF;
+
+void ll_hold_init(void)
+{
+	unsigned int i;
+
+	ll_hold_shared = get_lcore_max() + 1;
+	ll_hold_queues = zmalloc_aligned((ll_hold_shared + 1) *
+					 sizeof(*ll_hold_queues));
+	if (!ll_hold_queues)
+		rte_panic("Can't allocate neighbour hold queues\n");
+
+	for (i = 0; i <= ll_hold_shared; i++) {
+		struct ll_hold_queue *q = &ll_hold_queues[i];
+
+		rte_spinlock_init(&q->lock);
+		q->ents = calloc(LL_HOLD_DEPTH_MAX, sizeof(*q->ents));
+		q->spare = calloc(LL_HOLD_DEPTH_MAX, sizeof(*q->spare));
+		q->out = calloc(LL_HOLD_DEPTH_MAX, sizeof(*q->out));
+		if (!q->ents || !q->spare || !q->out)
+			rte_panic("Can't allocate neighbour hold queues\n");
+	}
+}
+
+static unsigned int ll_hold_bucket(uint32_t ifindex, uint8_t family,
+				   const void *addr)
+{
+	uint32_t a;
+
+	if (family == AF_INET)
+		a = ((const struct in_addr *)addr)->s_addr;
+	else
+		a = ((const struct in6_addr *)addr)->s6_addr32[3];
+
+	return rte_jhash_2words(ifindex, a, 0) & (LL_HOLD_GEN_BUCKETS - 1);
+}
+
+/*
+ * Forwarding lcores have their own queue.  The master thread and
+ * non-dataplane threads use the shared queue.
+ */
+static struct ll_hold_queue *ll_hold_queue_get(bool *shared)
+{
+	unsigned int lcore_id = rte_lcore_id();
+
+	*shared = lcore_id == LCORE_ID_ANY ||
+		lcore_id == rte_get_master_lcore() ||
+		lcore_id >= ll_hold_shared;
+
+	return &ll_hold_queues[*shared ? ll_hold_shared : lcore_id];
+}
+
+/*
+ * Drop a held packet, or one that could not be held.  IPv6 packets whose
+ * neighbour could not be resolved may get a Destination Unreachable.
+ */
+static void ll_hold_drop(struct ifnet *ifp, uint8_t family,
+			 struct rte_mbuf *m, bool unreach)
+{
+	if (ifp && family == AF_INET6) {
+		nd6_held_drop(ifp, m, unreach);
+		return;
+	}
+
+	if (ifp)
+		ARPSTAT_INC(if_vrfid(ifp), dropped);
+	rte_pktmbuf_free(m);
+}
+
+/*
+ * An entry's packet has been dropped while it was still held.  The count
+ * of held packets is only reset when the entry resolves, so take this one
+ * off, without going below zero if the entry has just been reset.
+ */
+static void ll_hold_unheld(struct llentry *la)
+{
+	uint8_t numheld = __atomic_load_n(&la->la_numheld, __ATOMIC_RELAXED);
+
+	while (numheld &&
+	       !__atomic_compare_exchange_n(&la->la_numheld, &numheld,
+					    numheld - 1, false,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * Drop a held packet that cannot be sent, looking up its entry if it
+ * still has one.
+ */
+static void ll_hold_ent_drop(const struct ll_hold_ent *ent, bool unreach)
+{
+	struct llentry *la = NULL;
+	struct ifnet *ifp;
+
+	ifp = dp_ifnet_byifindex(ent->ifindex);
+	if (ifp) {
+		if (ent->family == AF_INET)
+			la = in_lltable_find(ifp, ent->addr.in.s_addr);
+		else
+			la = in6_lltable_find(ifp, &ent->addr.in6);
+	}
+	if (la)
+		ll_hold_unheld(la);
+
+	ll_hold_drop(ifp, ent->family, ent->m, unreach);
+}
+
+/*
+ * Append to a queue, with the lock held for the shared queue.  A full
+ * queue drops the new packet rather than the oldest, as the oldest may be
+ * being scanned by its lcore.
+ */
+static bool ll_hold_append(struct ll_hold_queue *q,
+			   const struct ll_hold_ent *ent)
+{
+	if (unlikely(q->count >= CMM_LOAD_SHARED(ll_hold_depth))) {
+		q->stats.dropped_full++;
+		return false;
+	}
+
+	q->ents[q->count++] = *ent;
+	CMM_STORE_SHARED(q->held_buckets,
+			 q->held_buckets | (1ull << ent->bucket));
+	return true;
+}
+
+void ll_hold_pkt(struct ifnet *ifp, struct llentry *la, struct rte_mbuf *m,
+		 unsigned int maxhold)
+{
+	struct sockaddr *sa = ll_sockaddr(la);
+	struct ll_hold_queue *q;
+	struct ll_hold_ent ent;
+	bool shared, held = false;
+
+	ent.m = m;
+	ent.expire = rte_get_timer_cycles() +
+		rte_get_timer_hz() * LL_HOLD_TIMEOUT;
+	ent.ifindex = ifp->if_index;
+	ent.family = sa->sa_family;
+	if (ent.family == AF_INET)
+		ent.addr.in = satosin(sa)->sin_addr;
+	else
+		ent.addr.in6 = satosin6(sa)->sin6_addr;
+	ent.bucket = ll_hold_bucket(ent.ifindex, ent.family, &ent.addr);
+
+	q = ll_hold_queue_get(&shared);
+	if (shared)
+		rte_spinlock_lock(&q->lock);
+
+	/*
+	 * The per-entry limit is only approximate, as packets for an entry
+	 * are held by several lcores at once, but it stops one neighbour
+	 * from using all of a queue.
+	 */
+	if (unlikely(la->la_numheld >= maxhold)) {
+		q->stats.dropped_full++;
+	} else {
+		held = ll_hold_append(q, &ent);
+		if (held) {
+			__atomic_add_fetch(&la->la_numheld, 1,
+					   __ATOMIC_RELAXED);
+			q->stats.held++;
+
+			/*
+			 * The entry may have resolved, and the queue been
+			 * scanned, since the caller found it unresolved.
+			 * Make sure the next scan looks at this packet.
+			 */
+			if (CMM_LOAD_SHARED(la->la_flags) & LLE_VALID)
+				q->rescan = true;
+		}
+	}
+
+	if (shared)
+		rte_spinlock_unlock(&q->lock);
+
+	if (!held)
+		ll_hold_drop(ifp, ent.family, m, false);
+}
+
+bool ll_hold_solicit(struct llentry *la)
+{
+	struct ll_hold_queue *q;
+	uint8_t asked = 0;
+	uint64_t now;
+	bool shared;
+
+	/* Coalesce the first solicitation for the entry across lcores */
+	if (!__atomic_compare_exchange_n(&la->la_asked, &asked, 1, false,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return false;
+
+	q = ll_hold_queue_get(&shared);
+	if (shared)
+		return true;
+
+	now = rte_get_timer_cycles();
+	if (now - q->sol_refill >= rte_get_timer_hz()) {
+		q->sol_refill = now;
+		q->sol_tokens = CMM_LOAD_SHARED(ll_hold_sol_rate);
+	}
+
+	if (q->sol_tokens) {
+		q->sol_tokens--;
+		return true;
+	}
+
+	q->stats.solicit_limited++;
+	return false;
+}
+
+void ll_hold_changed(struct llentry *la)
+{
+	struct sockaddr *sa = ll_sockaddr(la);
+	unsigned int b;
+
+	if (sa->sa_family == AF_INET)
+		b = ll_hold_bucket(la->ifp->if_index, AF_INET,
+				   &satosin(sa)->sin_addr);
+	else
+		b = ll_hold_bucket(la->ifp->if_index, AF_INET6,
+				   &satosin6(sa)->sin6_addr);
+
+	__atomic_add_fetch(&ll_hold_gens[b], 1, __ATOMIC_RELEASE);
+}
+
+enum ll_hold_result {
+	LL_HOLD_KEEP,
+	LL_HOLD_SEND,
+	LL_HOLD_DONE,	/* dropped */
+};
+
+/*
+ * Release a held packet to be sent if its entry is now resolved, drop it
+ * if the entry has gone, otherwise keep holding it.
+ */
+static enum ll_hold_result
+ll_hold_resolve(struct ll_hold_queue *q, const struct ll_hold_ent *ent,
+		uint64_t now, struct ifnet **out_ifp)
+{
+	struct rte_ether_hdr *eh;
+	struct llentry *la;
+	struct ifnet *ifp;
+
+	ifp = dp_ifnet_byifindex(ent->ifindex);
+	if (!ifp) {
+		q->stats.dropped_unresolved++;
+		rte_pktmbuf_free(ent->m);
+		return LL_HOLD_DONE;
+	}
+
+	if (ent->family == AF_INET)
+		la = in_lltable_find(ifp, ent->addr.in.s_addr);
+	else
+		la = in6_lltable_find(ifp, &ent->addr.in6);
+
+	if (!la || (la->la_flags & LLE_DELETED)) {
+		q->stats.dropped_unresolved++;
+		ll_hold_drop(ifp, ent->family, ent->m, true);
+		return LL_HOLD_DONE;
+	}
+
+	eh = rte_pktmbuf_mtod(ent->m, struct rte_ether_hdr *);
+	if (!llentry_copy_mac(la, &eh->d_addr)) {
+		if ((int64_t)(now - ent->expire) < 0)
+			return LL_HOLD_KEEP;
+
+		q->stats.expired++;
+		ll_hold_unheld(la);
+		ll_hold_drop(ifp, ent->family, ent->m, true);
+		return LL_HOLD_DONE;
+	}
+
+	q->stats.sent++;
+	*out_ifp = ifp;
+	return LL_HOLD_SEND;
+}
+
+static int ll_hold_out_cmp(const void *a, const void *b)
+{
+	const struct ll_hold_out *x = a, *y = b;
+
+	if (x->ifp->if_index != y->ifp->if_index)
+		return x->ifp->if_index < y->ifp->if_index ? -1 : 1;
+
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/*
+ * Send the packets released by a scan grouped by output interface, in
+ * the order they were held, so an lcore queues each port's packets for
+ * transmit as full bursts rather than flushing its burst buffer
+ * whenever the port changes.
+ */
+static void ll_hold_send(struct ll_hold_out *out, unsigned int n)
+{
+	struct rte_ether_hdr *eh;
+	unsigned int i;
+
+	if (n > 1)
+		qsort(out, n, sizeof(*out), ll_hold_out_cmp);
+
+	for (i = 0; i < n; i++) {
+		eh = rte_pktmbuf_mtod(out[i].m, struct rte_ether_hdr *);
+		/*
+		 * Note: even though this may be a forwarded packet, NULL is
+		 * passed in for the input interface since this is only used
+		 * for tunnel interfaces in certain corner cases and it's not
+		 * worth the effort of keeping track of the input interface
+		 * context.
+		 */
+		if_output(out[i].ifp, out[i].m, NULL, ntohs(eh->ether_type));
+	}
+}
+
+/*
+ * Which buckets of held packets need looking at?  All of them once a
+ * second, to age out packets held for too long, or when asked to
+ * rescan, otherwise those whose generation has changed since the last
+ * scan.  Only the thread that scans the queue writes gens and scanned,
+ * so no lock is needed, and a bucket missed as it is being added is
+ * seen on the next call.
+ */
+static uint64_t ll_hold_changed_buckets(struct ll_hold_queue *q,
+					uint64_t now)
+{
+	uint64_t held, changed = 0;
+	unsigned int b;
+
+	if (CMM_LOAD_SHARED(q->rescan) ||
+	    now - q->scanned >= rte_get_timer_hz())
+		return UINT64_MAX;
+
+	held = CMM_LOAD_SHARED(q->held_buckets);
+	while (held) {
+		b = __builtin_ctzll(held);
+		held &= held - 1;
+		if (__atomic_load_n(&ll_hold_gens[b], __ATOMIC_ACQUIRE) !=
+		    q->gens[b])
+			changed |= 1ull << b;
+	}
+
+	return changed;
+}
+
+/*
+ * Rescan the packets held for neighbours that have changed since the
+ * queue was last scanned.  The queue is swapped for an empty one first,
+ * so that sending a packet may hold another on the same queue, and
+ * packets still unresolved are then put back.  Packets released are
+ * only sent once the scan is done, in bursts.
+ *
+ * Generations are only recorded when there is something to scan, so a
+ * packet held just after an empty queue is checked still sees the change.
+ */
+static void ll_hold_scan(struct ll_hold_queue *q, bool shared)
+{
+	struct ll_hold_ent *scan;
+	unsigned int count, i, b, nout = 0;
+	struct ifnet *ifp;
+	uint64_t now, changed;
+
+	now = rte_get_timer_cycles();
+	changed = ll_hold_changed_buckets(q, now);
+	if (!changed)
+		return;
+
+	if (shared)
+		rte_spinlock_lock(&q->lock);
+	count = q->count;
+	if (!count) {
+		if (shared)
+			rte_spinlock_unlock(&q->lock);
+		return;
+	}
+	for (b = 0; b < LL_HOLD_GEN_BUCKETS; b++)
+		if (changed & (1ull << b))
+			q->gens[b] = __atomic_load_n(&ll_hold_gens[b],
+						     __ATOMIC_ACQUIRE);
+	if (changed == UINT64_MAX)
+		q->scanned = now;
+	q->rescan = false;
+	scan = q->ents;
+	q->ents = q->spare;
+	q->spare = NULL;
+	q->count = 0;
+	CMM_STORE_SHARED(q->held_buckets, 0);
+	if (shared)
+		rte_spinlock_unlock(&q->lock);
+
+	for (i = 0; i < count; i++) {
+		bool held;
+
+		if (changed & (1ull << scan[i].bucket)) {
+			switch (ll_hold_resolve(q, &scan[i], now, &ifp)) {
+			case LL_HOLD_SEND:
+				q->out[nout].ifp = ifp;
+				q->out[nout].m = scan[i].m;
+				q->out[nout].seq = i;
+				nout++;
+				continue;
+			case LL_HOLD_DONE:
+				continue;
+			case LL_HOLD_KEEP:
+				break;
+			}
+		}
+
+		if (shared)
+			rte_spinlock_lock(&q->lock);
+		held = ll_hold_append(q, &scan[i]);
+		if (shared)
+			rte_spinlock_unlock(&q->lock);
+
+		if (!held)
+			ll_hold_ent_drop(&scan[i], false);
+	}
+
+	ll_hold_send(q->out, nout);
+
+	if (shared)
+		rte_spinlock_lock(&q->lock);
+	q->spare = scan;
+	if (shared)
+		rte_spinlock_unlock(&q->lock);
+}
+
+void ll_hold_service(unsigned int lcore_id)
+{
+	struct ll_hold_queue *q = &ll_hold_queues[lcore_id];
+
+	if (likely(!q->count))
+		return;
+
+	ll_hold_scan(q, false);
+}
+
+/*
+ * An lcore is about to stop polling, to sleep or exit, or has no queues
+ * left to poll.  Its held packets are moved to the shared queue so that
+ * the master thread sends or ages them out meanwhile.
+ */
+void ll_hold_release(unsigned int lcore_id)
+{
+	struct ll_hold_queue *sq = &ll_hold_queues[ll_hold_shared];
+	struct ll_hold_queue *q;
+	unsigned int i, moved;
+
+	if (lcore_id >= ll_hold_shared)
+		return;
+
+	q = &ll_hold_queues[lcore_id];
+	if (likely(!q->count))
+		return;
+
+	rte_spinlock_lock(&sq->lock);
+	for (moved = 0; moved < q->count; moved++)
+		if (!ll_hold_append(sq, &q->ents[moved]))
+			break;
+	sq->rescan = true;
+	rte_spinlock_unlock(&sq->lock);
+
+	for (i = moved; i < q->count; i++)
+		ll_hold_ent_drop(&q->ents[i], false);
+	q->count = 0;
+	q->held_buckets = 0;
+}
+
+/*
+ * Master thread only, as scans of a queue must not overlap.  Called on
+ * every pass of the master loop, so it only takes the lock when there
+ * are packets held for a neighbour that has changed.
+ */
+void ll_hold_service_shared(void)
+{
+	struct ll_hold_queue *q = &ll_hold_queues[ll_hold_shared];
+
+	if (likely(!CMM_LOAD_SHARED(q->count)))
+		return;
+
+	ll_hold_scan(q, true);
+}
+
+static void ll_hold_show_queue(json_writer_t *wr,
+			       const struct ll_hold_queue *q)
+{
+	jsonw_uint_field(wr, "queued", CMM_LOAD_SHARED(q->count));
+	jsonw_uint_field(wr, "held", q->stats.held);
+	jsonw_uint_field(wr, "sent", q->stats.sent);
+	jsonw_uint_field(wr, "dropped_full", q->stats.dropped_full);
+	jsonw_uint_field(wr, "dropped_unresolved",
+			 q->stats.dropped_unresolved);
+	jsonw_uint_field(wr, "expired", q->stats.expired);
+	jsonw_uint_field(wr, "solicit_limited", q->stats.solicit_limited);
+}
+
+/* Show hold queue configuration and per-lcore statistics */
+int cmd_ll_hold_show(FILE *f)
+{
+	json_writer_t *wr = jsonw_new(f);
+	unsigned int i;
+
+	if (!wr)
+		return -1;
+
+	jsonw_name(wr, "hold");
+	jsonw_start_object(wr);
+	jsonw_uint_field(wr, "depth", ll_hold_depth);
+	jsonw_uint_field(wr, "solicit_rate", ll_hold_sol_rate);
+
+	jsonw_name(wr, "lcores");
+	jsonw_start_array(wr);
+	for (i = 0; i < ll_hold_shared; i++) {
+		const struct ll_hold_queue *q = &ll_hold_queues[i];
+
+		if (!q->stats.held && !q->stats.dropped_full &&
+		    !q->stats.solicit_limited)
+			continue;
+
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "lcore", i);
+		ll_hold_show_queue(wr, q);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+
+	jsonw_name(wr, "shared");
+	jsonw_start_object(wr);
+	ll_hold_show_queue(wr, &ll_hold_queues[ll_hold_shared]);
+	jsonw_end_object(wr);
+
+	jsonw_end_object(wr);
+	jsonw_destroy(&wr);
+	return 0;
+}
+
+/*
+ * lladdr {set|delete} {hold-queue|solicit-rate} [<value>]
+ *
+ * Changes only affect packets held from then on.
+ */
+int cmd_lladdr_cfg(FILE *f, int argc, char **argv)
+{
+	bool set;
+	int val = 0;
+
+	if (argc < 3 || strcmp(argv[0], "lladdr"))
+		goto error;
+
+	if (!strcmp(argv[1], "set")) {
+		if (argc < 4 || get_signed(argv[3], &val) < 0 || val <= 0)
+			goto error;
+		set = true;
+	} else if (!strcmp(argv[1], "delete")) {
+		set = false;
+	} else {
+		goto error;
+	}
+
+	if (!strcmp(argv[2], "hold-queue")) {
+		if (val > LL_HOLD_DEPTH_MAX)
+			goto error;
+		CMM_STORE_SHARED(ll_hold_depth,
+				 set ? (unsigned int)val : LL_HOLD_DEPTH_DEF);
+	} else if (!strcmp(argv[2], "solicit-rate")) {
+		CMM_STORE_SHARED(ll_hold_sol_rate,
+				 set ? (unsigned int)val :
+				 LL_HOLD_SOL_RATE_DEF);
+	} else {
+		goto error;
+	}
+
+	return 0;
+
+error:
+	fprintf(f, "Usage: lladdr {set|delete} {hold-queue|solicit-rate} "
+		"<value>\n");
+	return -1;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef LL_HOLD_H
+#define LL_HOLD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Packets held waiting for neighbour resolution
+ *
+ * Each forwarding lcore holds packets for unresolved neighbours on its own
+ * queue, so no lock is taken when a packet is held, however many lcores are
+ * sending to unresolved neighbours at once.  Packets held by any other
+ * thread go on a shared queue, under a lock, that is serviced by the
+ * master thread.
+ *
+ * A held packet records its output interface and neighbour address rather
+ * than the llentry, as the entry may be freed while the packet is held.
+ * Whenever an entry is resolved or destroyed the generation of its bucket,
+ * hashed from the interface and address, is bumped, and the packets each
+ * queue holds for that bucket are looked at again the next time it is
+ * serviced.  Packets for neighbours that are now resolved are sent
+ * together, grouped by interface, and packets for neighbours that have
+ * gone are dropped.  Packets still unresolved after LL_HOLD_TIMEOUT
+ * seconds are dropped too.
+ *
+ * An lcore that stops polling, to sleep or exit, hands its held packets
+ * to the shared queue first, so none are left behind on an idle lcore.
+ */
+
+#define LL_HOLD_DEPTH_DEF	256	/* packets per lcore queue */
+#define LL_HOLD_DEPTH_MAX	1024
+#define LL_HOLD_SOL_RATE_DEF	1000	/* solicitations/sec per lcore */
+#define LL_HOLD_TIMEOUT		5	/* seconds, as ARP_MAXPROBES */
+#define LL_HOLD_GEN_BUCKETS	64	/* bits in a uint64_t */
+
+struct ifnet;
+struct llentry;
+struct rte_mbuf;
+
+void ll_hold_init(void);
+
+/*
+ * Hold a packet until its neighbour is resolved.  The packet is always
+ * consumed.  maxhold limits the number of packets held for the entry.
+ */
+void ll_hold_pkt(struct ifnet *ifp, struct llentry *la, struct rte_mbuf *m,
+		 unsigned int maxhold);
+
+/*
+ * Should a solicitation be sent for an entry that a packet has just been
+ * held for?  Only the first caller for an entry is told to send one, and
+ * each lcore's solicitations are rate limited.  An entry that is not
+ * solicited here is left to the retry timer.
+ */
+bool ll_hold_solicit(struct llentry *la);
+
+/* An entry has been resolved or destroyed */
+void ll_hold_changed(struct llentry *la);
+
+/* Send or drop held packets as their entries have changed */
+void ll_hold_service(unsigned int lcore_id);
+void ll_hold_service_shared(void);
+
+/* Hand an lcore's held packets to the master thread */
+void ll_hold_release(unsigned int lcore_id);
+
+int cmd_ll_hold_show(FILE *f);
+int cmd_lladdr_cfg(FILE *f, int argc, char **argv);
+
+#endif /* LL_HOLD_H */
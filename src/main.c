@@ -73,6 +73,7 @@
 #include <rte_errno.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_interrupts.h>
 #include <rte_launch.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
@@ -81,6 +82,7 @@
 #include <rte_memory.h>
 #include <rte_mempool.h>
 #include <rte_per_lcore.h>
+#include <rte_power.h>
 #include <rte_prefetch.h>
 #include <rte_ring.h>
 #include <rte_timer.h>
@@ -114,6 +116,7 @@
 #include "l2_rx_fltr.h"
 #include "l2tp/l2tpeth.h"
 #include "lag.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "master.h"
 #include "mpls/mpls_label_table.h"
@@ -121,6 +124,7 @@
 #include "npf/fragment/ipv4_rsmbl.h"
 #include "npf_shim.h"
 #include "pipeline/pl_internal.h"
+#include "perf_profile.h"
 #include "pktmbuf_internal.h"
 #include "portmonitor/portmonitor.h"
 #include "power.h"
@@ -128,6 +132,7 @@
 #include "route.h"
 #include "session/session.h"
 #include "shadow.h"
+#include "stats_shm.h"
 #include "lcore_sched.h"
 #include "lcore_sched_internal.h"
 #include "udp_handler.h"
@@ -196,10 +201,26 @@ static RTE_DEFINE_PER_LCORE(struct pkt_burst *, pkt_burst);
 enum lcore_state {
 	LCORE_STATE_POLL,
 	LCORE_STATE_POWERSAVE,
+	LCORE_STATE_INTR,
 	LCORE_STATE_IDLE,
 	LCORE_STATE_EXIT,
 };
 
+/* Whether an rx queue can wake its lcore with an interrupt */
+enum rxq_intr_state {
+	RXQ_INTR_UNKNOWN,	/* not tried yet */
+	RXQ_INTR_ON,		/* added to the lcore's epoll set */
+	RXQ_INTR_NONE,		/* not supported, always poll */
+};
+
+/* rte_power frequency scaling state of an lcore */
+enum lcore_power_state {
+	LCORE_POWER_UNINIT,
+	LCORE_POWER_MAX,	/* running at full frequency */
+	LCORE_POWER_MIN,	/* lowered while waiting for interrupts */
+	LCORE_POWER_NONE,	/* not supported, don't try again */
+};
+
 /*
  * Per CPU configuration
  */
@@ -214,11 +235,17 @@ struct lcore_conf {
 	uint16_t high_txq;    /* highest index assigned to tx_poll */
 	uint8_t tx_qid;	      /* my tx queue for multi-queue devices */
 	uint8_t do_crypto;    /* thread is tasked with doing crypto */
+	uint8_t power;	      /* enum lcore_power_state */
+	uint8_t tx_wait;      /* waiting, tx ring producers must wake it */
+	int wake_fd;	      /* eventfd that wakes it from tx_wait */
+	uint32_t idle_polls;  /* consecutive polls that found no work */
 
 	/* receive queues this cpu should check for input */
 	struct lcore_rx_queue {
 		portid_t portid;
 		uint8_t queueid;
+		uint8_t intr;	/* enum rxq_intr_state */
+		portid_t intr_portid;	/* port intr was added for */
 		struct pm_governor gov;
 		uint64_t packets;
 	} rx_poll[MAX_RX_QUEUE_PER_CORE];
@@ -246,12 +273,22 @@ struct lcore_conf {
 		struct cds_list_head pmd_list;
 	} crypt;
 
+	/* cycle accounting, only updated if perf profiling is built in */
+	struct lcore_perf {
+		uint64_t busy_cycles;	/* polls that found work */
+		uint64_t idle_cycles;	/* polls that found nothing */
+		uint64_t sleep_cycles;	/* napping or sleeping */
+		struct perf_count rx_burst[PERF_RX_BURST_BUCKETS];
+	} perf;
+
 	/* Not touched in forwarding path so at end to avoid false sharing */
 	void *padding[0]   __rte_cache_aligned;
 	struct rate_stats rx_poll_stats[MAX_RX_QUEUE_PER_CORE];
 	struct rate_stats tx_poll_stats[MAX_TX_QUEUE_PER_CORE];
 	struct rate_stats crypt_stats;
 	bool ded_to_feature;
+	bool wake_added;	/* wake_fd is in the lcore's epoll set */
+	struct rte_epoll_event wake_ev;
 
 	/* State for when a feature has registered to use this core */
 	uint8_t do_feature;
@@ -270,6 +307,7 @@ static const uint8_t NO_OWNER = 255;
 /* Port configuration */
 static struct port_conf {
 	struct rte_ring *pkt_ring[MAX_TX_QUEUE_PER_PORT];
+	uint8_t		tx_lcore[MAX_TX_QUEUE_PER_PORT]; /* ring consumer */
 	int8_t		socketid;	/* NUMA socket */
 	uint8_t		rx_queues;
 	uint8_t		tx_queues;
@@ -285,6 +323,7 @@ static struct port_conf {
 	bitmask_t	tx_enabled_queues;
 	bitmask_t	rx_enabled_queues;
 	bool            uses_queue_state;
+	bool		rx_intr;	/* use rx queue interrupts */
 
 	struct rte_mempool *rx_pool;	/* Receive buffer pool */
 	struct rte_eth_txconf tx_conf;
@@ -529,6 +568,29 @@ void dp_pkt_burst_setup(void)
 	pkt_burst_init(lcore_id, lcore_conf[lcore_id]->tx_qid);
 }
 
+/*
+ * Wake the lcore that drains a transmit ring if it is waiting for an
+ * interrupt.  Only the first producer to see it waiting writes to its
+ * eventfd.
+ */
+static ALWAYS_INLINE void
+pkt_ring_wake(portid_t port, uint8_t rid)
+{
+	struct lcore_conf *conf;
+	uint64_t one = 1;
+
+	/* Order the enqueue before reading tx_wait */
+	cmm_smp_mb();
+	conf = lcore_conf[CMM_ACCESS_ONCE(port_config[port].tx_lcore[rid])];
+	if (likely(!conf || !CMM_LOAD_SHARED(conf->tx_wait)) ||
+	    !uatomic_xchg(&conf->tx_wait, 0))
+		return;
+
+	if (write(conf->wake_fd, &one, sizeof(one)) < 0)
+		RTE_LOG(NOTICE, DATAPLANE, "tx ring wake failed: %s\n",
+			strerror(errno));
+}
+
 static ALWAYS_INLINE uint16_t
 pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 		  uint16_t queue, struct rte_mbuf **mbufs, uint16_t nb_pkts)
@@ -550,6 +612,8 @@ pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 					port_config[port].pkt_ring[rid],
 					(void **) mbufs, nb_pkts,
 					NULL);
+		if (n)
+			pkt_ring_wake(port, rid);
 	}
 	return n;
 }
@@ -666,6 +730,7 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 
 			if (rte_ring_mp_enqueue(ring, m) != 0)
 				goto full_txring;
+			pkt_ring_wake(portid, 0);
 		}
 	}
 
@@ -732,6 +797,226 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 	}
 }
 
+/*
+ * Add the lcore's receive queues to its epoll set, if not done
+ * already, and enable their interrupts so that the lcore can wait
+ * for packets instead of polling. Returns false, with no interrupts
+ * enabled, if any queue can't wake the lcore or already has packets.
+ */
+static bool
+lcore_rx_intr_arm(struct lcore_conf *conf)
+{
+	uint16_t high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
+	unsigned int i, armed;
+
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid == NO_OWNER)
+			continue;
+
+		if (rxq->intr == RXQ_INTR_UNKNOWN) {
+			if (rte_eth_dev_rx_intr_ctl_q(portid, rxq->queueid,
+						      RTE_EPOLL_PER_THREAD,
+						      RTE_INTR_EVENT_ADD,
+						      NULL) < 0) {
+				rxq->intr = RXQ_INTR_NONE;
+			} else {
+				rxq->intr_portid = portid;
+				rxq->intr = RXQ_INTR_ON;
+			}
+		}
+
+		if (rxq->intr != RXQ_INTR_ON)
+			return false;
+	}
+
+	for (armed = 0; armed < high_rxq; armed++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[armed];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid == NO_OWNER)
+			continue;
+
+		rte_eth_dev_rx_intr_enable(portid, rxq->queueid);
+
+		/* packets that arrived before the interrupt was enabled */
+		if (rte_eth_rx_queue_count(portid, rxq->queueid) > 0) {
+			armed++;
+			goto disarm;
+		}
+	}
+
+	return true;
+
+disarm:
+	for (i = 0; i < armed; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid != NO_OWNER)
+			rte_eth_dev_rx_intr_disable(portid, rxq->queueid);
+	}
+	return false;
+}
+
+/*
+ * Add the lcore's wake eventfd to its epoll set, the first time the lcore
+ * runs.  The set belongs to the lcore's thread, which persists.
+ */
+static void
+lcore_tx_wake_init(struct lcore_conf *conf)
+{
+	if (conf->wake_added || conf->wake_fd < 0)
+		return;
+
+	if (rte_epoll_ctl(RTE_EPOLL_PER_THREAD, EPOLL_CTL_ADD,
+			  conf->wake_fd, &conf->wake_ev) < 0) {
+		RTE_LOG(NOTICE, DATAPLANE, "cannot add tx wake eventfd\n");
+		return;
+	}
+	conf->wake_added = true;
+}
+
+/*
+ * Transmit rings are fed by other lcores.  Before waiting, mark the lcore
+ * as waiting so that those lcores wake it, then check that its transmit
+ * queues are flushed, so that no packet is left behind.  Queues that must be called regularly, for 802.3ad or QoS,
+ * keep the lcore polling.
+ */
+static bool
+lcore_tx_arm(struct lcore_conf *conf)
+{
+	uint16_t high_txq = CMM_LOAD_SHARED(conf->high_txq);
+	unsigned int i;
+
+	if (!CMM_LOAD_SHARED(conf->num_txq))
+		return true;
+
+	if (!conf->wake_added)
+		return false;
+
+	CMM_STORE_SHARED(conf->tx_wait, 1);
+	/* Order setting tx_wait before reading the rings */
+	cmm_smp_mb();
+
+	for (i = 0; i < high_txq; i++) {
+		struct lcore_tx_queue *txq = &conf->tx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(txq->portid);
+		struct ifnet *ifp;
+
+		if (portid == NO_OWNER)
+			continue;
+
+		ifp = ifnet_byport(portid);
+		if (txq->pending || txq->tx_no_pkts ||
+		    (ifp && qos_handle(ifp)) ||
+		    !rte_ring_empty(port_config[portid].pkt_ring[txq->ringid]))
+			goto busy;
+	}
+	return true;
+
+busy:
+	CMM_STORE_SHARED(conf->tx_wait, 0);
+	return false;
+}
+
+/* Back to polling, no more wake-ups from transmit ring producers */
+static void
+lcore_tx_disarm(struct lcore_conf *conf)
+{
+	uint64_t count;
+
+	CMM_STORE_SHARED(conf->tx_wait, 0);
+	if (conf->wake_added &&
+	    read(conf->wake_fd, &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN)
+		RTE_LOG(NOTICE, DATAPLANE, "tx wake read failed: %s\n",
+			strerror(errno));
+}
+
+/* Back to polling, stop any more interrupts from the receive queues */
+static void
+lcore_rx_intr_disarm(struct lcore_conf *conf)
+{
+	uint16_t high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
+	unsigned int i;
+
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid != NO_OWNER && rxq->intr == RXQ_INTR_ON)
+			rte_eth_dev_rx_intr_disable(portid, rxq->queueid);
+	}
+}
+
+/*
+ * Take a released receive queue out of the epoll set of the lcore
+ * that polled it, so that its next owner can add it. Must only be
+ * called after a grace period, once that lcore can no longer be
+ * using the slot.
+ */
+static void
+lcore_rx_intr_detach(struct lcore_conf *conf, unsigned int slot)
+{
+	struct lcore_rx_queue *rxq = &conf->rx_poll[slot];
+
+	/* Stopping the port has already emptied the epoll sets */
+	if (rxq->intr == RXQ_INTR_ON &&
+	    dpdk_eth_if_port_started(rxq->intr_portid))
+		rte_eth_dev_rx_intr_ctl_q(rxq->intr_portid, rxq->queueid,
+					  RTE_EPOLL_PER_THREAD,
+					  RTE_INTR_EVENT_DEL, NULL);
+	rxq->intr = RXQ_INTR_UNKNOWN;
+}
+
+/*
+ * Hint the lcore's cpu frequency, lowered while it waits for
+ * interrupts and raised again as soon as it finds work.
+ */
+static void
+lcore_power_hint(unsigned int lcore_id, struct lcore_conf *conf, bool busy)
+{
+	switch (conf->power) {
+	case LCORE_POWER_NONE:
+		return;
+	case LCORE_POWER_UNINIT:
+		if (busy)
+			return;
+		if (rte_power_init(lcore_id) < 0) {
+			RTE_LOG(NOTICE, DATAPLANE,
+				"core %u: cpu frequency scaling unavailable\n",
+				lcore_id);
+			conf->power = LCORE_POWER_NONE;
+			return;
+		}
+		/* fall through */
+	case LCORE_POWER_MAX:
+		if (!busy) {
+			rte_power_freq_min(lcore_id);
+			conf->power = LCORE_POWER_MIN;
+		}
+		break;
+	case LCORE_POWER_MIN:
+		if (busy) {
+			rte_power_freq_max(lcore_id);
+			conf->power = LCORE_POWER_MAX;
+		}
+		break;
+	}
+}
+
+static void
+lcore_power_exit(unsigned int lcore_id, struct lcore_conf *conf)
+{
+	if (conf->power == LCORE_POWER_MAX || conf->power == LCORE_POWER_MIN) {
+		rte_power_exit(lcore_id);
+		conf->power = LCORE_POWER_UNINIT;
+	}
+}
+
 /*
  * Determine the next state for the lcore
  *
@@ -741,10 +1026,15 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
  * 2. This is no work to do and all the assigned ports are down ->
  *    idle state (lcore may sleep for long periods, but must wake up
  *    periodically)
- * 3. Work out the minimum sleep time based on heuristics of how much
+ * 3. The lcore is not doing crypto, its queues have all been empty
+ *    for the power policy's interrupt threshold, its receive queues
+ *    can all interrupt and its transmit queues are flushed -> wait
+ *    for an interrupt or a transmit ring wake-up, for up to the
+ *    policy's interrupt timeout
+ * 4. Work out the minimum sleep time based on heuristics of how much
  *    work was done for each work item recently. If less than power
  *    policy minimum sleep time -> poll
- * 4. Otherwise -> powernap for the specified time.
+ * 5. Otherwise -> powernap for the specified time.
  */
 static __hot_func enum lcore_state
 lcore_next_state(struct lcore_conf *conf,
@@ -814,19 +1104,69 @@ lcore_next_state(struct lcore_conf *conf,
 		if (!inactive_port_linkup)
 			return LCORE_STATE_IDLE;
 	}
+
+	/*
+	 * Crypto is fed by other lcores, which can't wake this one, so it
+	 * must keep being polled.  Transmit ring producers wake it.
+	 */
+	if (pm->intr_thresh && conf->idle_polls >= pm->intr_thresh &&
+	    !CMM_LOAD_SHARED(conf->do_crypto) &&
+	    lcore_rx_intr_arm(conf)) {
+		if (lcore_tx_arm(conf)) {
+			*nap_us = pm->intr_timeout * (USEC_PER_SEC / 1000);
+			return LCORE_STATE_INTR;
+		}
+		lcore_rx_intr_disarm(conf);
+	}
+
 	if (min_us < pm->min_sleep)
 		return LCORE_STATE_POLL;
 	*nap_us = min_us;
 	return LCORE_STATE_POWERSAVE;
 }
 
-/* Check for packets from network ports */
-static void __hot_func
+/*
+ * Whether an idle lcore whose only work is the first transmit queue of a
+ * port would wait for an interrupt, with a packet still pending on the
+ * queue or not.
+ */
+/* For power UT */
+bool lcore_txq_can_intr(portid_t portid, bool pending)
+{
+	struct lcore_conf *conf;
+	unsigned int us;
+	bool intr;
+
+	conf = rte_zmalloc("lcore_conf", sizeof(*conf), RTE_CACHE_LINE_SIZE);
+	if (!conf)
+		return false;
+
+	/* Not in an epoll set, as nothing waits on it */
+	conf->wake_fd = eventfd(0, EFD_NONBLOCK);
+	conf->wake_added = conf->wake_fd >= 0;
+
+	conf->num_txq = conf->high_txq = 1;
+	conf->tx_poll[0].portid = portid;
+	conf->tx_poll[0].pending = pending;
+	conf->idle_polls = UINT32_MAX;
+
+	intr = lcore_next_state(conf, get_current_pm(), &us) ==
+		LCORE_STATE_INTR;
+
+	lcore_tx_disarm(conf);
+	if (conf->wake_fd >= 0)
+		close(conf->wake_fd);
+	rte_free(conf);
+	return intr;
+}
+
+/* Check for packets from network ports, returns number received */
+static unsigned int __hot_func
 poll_receive_queues(struct lcore_conf *conf)
 {
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
+	unsigned int i, received = 0;
 	uint16_t high_rxq;
-	unsigned int i;
 
 	high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
 	for (i = 0; i < high_rxq; i++) {
@@ -852,11 +1192,20 @@ poll_receive_queues(struct lcore_conf *conf)
 		pm_update(&rxq->gov, nb);
 
 		if (nb > 0) {
+			uint64_t start = perf_cycles();
+
 			rxq->packets += nb;
 			process_burst(portid, rx_pkts, nb);
 			crypto_send(cpb);
+
+			perf_count_add(
+				&conf->perf.rx_burst[perf_burst_bucket(nb)],
+				1, start);
+			received += nb;
 		}
 	}
+
+	return received;
 }
 
 /* Move packets from txq->burst array to hardware.
@@ -934,11 +1283,12 @@ static unsigned int pkt_transmit_direct(struct lcore_tx_queue *txq,
 
 /* Get some packets from inter-thread packet ring
  * and put them in the per-queue burst buffer.
+ * Returns the number of packets taken off the rings.
  */
-static void __hot_func
+static unsigned int __hot_func
 poll_transmit_queues(struct lcore_conf *conf)
 {
-	unsigned int i, added;
+	unsigned int i, added, total = 0;
 	uint16_t high_txq;
 
 	high_txq = CMM_LOAD_SHARED(conf->high_txq);
@@ -981,19 +1331,59 @@ poll_transmit_queues(struct lcore_conf *conf)
 
 		pm_update(&txq->gov, added);
 		txq->pending += added;
+		total += added;
 
 		if (txq->pending > 0 || txq->tx_no_pkts)
 			put_transmit(ifp, txq->queueid, txq);
 	}
+
+	return total;
 }
 
-static void process_crypto(struct lcore_conf *conf)
+static unsigned int process_crypto(struct lcore_conf *conf)
 {
 	struct lcore_crypt *cpq = &conf->crypt;
 	unsigned int pkts = dp_crypto_poll(&conf->crypt.pmd_list);
 
 	cpq->packets += pkts;
 	pm_update(&cpq->gov, pkts);
+
+	return pkts;
+}
+
+/* Account cycles of one pass over the lcore's work as busy or idle */
+static ALWAYS_INLINE void
+lcore_perf_poll(struct lcore_conf *conf, uint64_t start, unsigned int work)
+{
+	uint64_t cycles;
+
+	if (!PERF_PROFILE_ENABLED)
+		return;
+
+	cycles = perf_cycles() - start;
+	if (work)
+		conf->perf.busy_cycles += cycles;
+	else
+		conf->perf.idle_cycles += cycles;
+}
+
+static ALWAYS_INLINE void
+lcore_perf_sleep(struct lcore_conf *conf, uint64_t start)
+{
+	if (PERF_PROFILE_ENABLED)
+		conf->perf.sleep_cycles += perf_cycles() - start;
+}
+
+#define RX_INTR_EVENTS	8
+
+/* Wait for an interrupt from any armed receive queue, or a tx wake-up */
+static void
+lcore_rx_intr_wait(unsigned int timeout_us)
+{
+	struct rte_epoll_event event[RX_INTR_EVENTS];
+
+	rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, RX_INTR_EVENTS,
+		       timeout_us / (USEC_PER_SEC / 1000));
 }
 
 /* main processing loop */
@@ -1004,11 +1394,15 @@ forwarding_loop(unsigned int lcore_id)
 	const struct power_profile *pm;
 	struct lcore_conf *conf = lcore_conf[lcore_id];
 	enum lcore_state state;
+	bool freq_scale;
+	uint64_t start;
 
 	RTE_PER_LCORE(_dp_lcore_id) = lcore_id;
 	dp_lcore_events_init(lcore_id);
 
 	pkt_burst_init(lcore_id, conf->tx_qid);
+	fragment_tables_lcore_init(lcore_id);
+	lcore_tx_wake_init(conf);
 
 	char name[16];
 	snprintf(name, sizeof(name), "dataplane/%u", lcore_id);
@@ -1027,21 +1421,44 @@ forwarding_loop(unsigned int lcore_id)
 
 		pm = get_current_pm();
 		for (i = 0; i < pm->idle_thresh ; i++) {
+			unsigned int work = 0;
+
+			start = perf_cycles();
 			if (CMM_LOAD_SHARED(conf->num_rxq) > 0)
-				poll_receive_queues(conf);
+				work += poll_receive_queues(conf);
 			if (CMM_LOAD_SHARED(conf->do_crypto))
-				process_crypto(conf);
+				work += process_crypto(conf);
 			if (CMM_LOAD_SHARED(conf->num_txq) > 0)
-				poll_transmit_queues(conf);
+				work += poll_transmit_queues(conf);
+			lcore_perf_poll(conf, start, work);
+
+			if (work)
+				conf->idle_polls = 0;
+			else if (conf->idle_polls < UINT32_MAX)
+				conf->idle_polls++;
 		}
 
 		/* Move leftover packets */
 		pkt_ring_drain();
+		ll_hold_service(lcore_id);
+		fragment_tables_service(lcore_id);
 
 		state = lcore_next_state(conf, pm, &us);
+		freq_scale = pm->freq_scale;
+
+		/* Not polling for a while, so let the master send them */
+		if (state != LCORE_STATE_POLL &&
+		    state != LCORE_STATE_POWERSAVE) {
+			ll_hold_release(lcore_id);
+			fragment_tables_release(lcore_id);
+		}
 
 		rcu_read_unlock();
 
+		if (unlikely(conf->power == LCORE_POWER_MIN) &&
+		    (conf->idle_polls == 0 || !freq_scale))
+			lcore_power_hint(lcore_id, conf, true);
+
 		switch (state) {
 		case LCORE_STATE_EXIT:
 			RTE_LOG(DEBUG, DATAPLANE, "terminating core %d\n",
@@ -1052,17 +1469,37 @@ forwarding_loop(unsigned int lcore_id)
 			break;
 		case LCORE_STATE_POWERSAVE:
 			rcu_quiescent_state();
+			start = perf_cycles();
 			usleep(us);
+			lcore_perf_sleep(conf, start);
+			break;
+		case LCORE_STATE_INTR:
+			if (freq_scale)
+				lcore_power_hint(lcore_id, conf, false);
+			rcu_thread_offline();
+			start = perf_cycles();
+			lcore_rx_intr_wait(us);
+			lcore_perf_sleep(conf, start);
+			rcu_thread_online();
+
+			rcu_read_lock();
+			lcore_rx_intr_disarm(conf);
+			lcore_tx_disarm(conf);
+			rcu_read_unlock();
 			break;
 		case LCORE_STATE_IDLE:
 			rcu_thread_offline();
+			start = perf_cycles();
 			sleep(LCORE_IDLE_SLEEP_SECS);
+			lcore_perf_sleep(conf, start);
 			rcu_thread_online();
 			break;
 		}
 	} while (likely(state != LCORE_STATE_EXIT));
 	dp_rcu_unregister_thread();
 
+	lcore_power_exit(lcore_id, conf);
+
 	dp_lcore_events_teardown(lcore_id);
 	dp_pkt_burst_free();
 
@@ -1519,6 +1956,31 @@ static void unassign_port_transmit_queues(portid_t portid,
 		bitmask_clear(&conf->portmask, portid);
 }
 
+/* Does the lcore still poll any rx or tx queue of the port? */
+static bool lcore_uses_port(const struct lcore_conf *conf, portid_t portid)
+{
+	unsigned int i;
+
+	for (i = 0; i < conf->high_rxq; i++)
+		if (conf->rx_poll[i].portid == portid)
+			return true;
+
+	for (i = 0; i < conf->high_txq; i++)
+		if (conf->tx_poll[i].portid == portid)
+			return true;
+
+	return false;
+}
+
+/* Stop polling the receive queue in the given slot */
+static void lcore_release_rxq(struct lcore_conf *conf, unsigned int slot)
+{
+	struct lcore_rx_queue *rxq = &conf->rx_poll[slot];
+
+	_CMM_STORE_SHARED(rxq->portid, NO_OWNER);
+	CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq - 1);
+}
+
 static void unassign_port_receive_queues(portid_t portid,
 					 struct lcore_conf *conf)
 {
@@ -1531,8 +1993,7 @@ static void unassign_port_receive_queues(portid_t portid,
 		if (portid != rxq->portid)
 			continue;
 
-		_CMM_STORE_SHARED(rxq->portid, NO_OWNER);
-		CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq - 1);
+		lcore_release_rxq(conf, i);
 	}
 
 	for (i = 0; i < MAX_TX_QUEUE_PER_CORE; i++) {
@@ -1560,6 +2021,17 @@ void unassign_queues(portid_t portid)
 	}
 
 	synchronize_rcu();
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		struct lcore_conf *conf = lcore_conf[lcore];
+		unsigned int i;
+
+		for (i = 0; i < conf->high_rxq; i++)
+			if (conf->rx_poll[i].portid == NO_OWNER &&
+			    conf->rx_poll[i].intr_portid == portid)
+				lcore_rx_intr_detach(conf, i);
+	}
+
 	pkt_ring_empty(portid);
 	stop_cpus();
 }
@@ -1655,6 +2127,47 @@ static bitmask_t cpu_affinity_online(const bitmask_t *cpu_affinity_mask)
 	return mask;
 }
 
+/*
+ * Take a free rx_poll slot on the lcore and start polling the
+ * receive queue with it. Returns the slot used or negative errno.
+ */
+static int lcore_assign_rxq(unsigned int lcore, portid_t portid, uint8_t q)
+{
+	struct lcore_conf *conf = lcore_conf[lcore];
+	int i;
+
+	/* find empty slot to use */
+	for (i = 0; i < conf->high_rxq; i++) {
+		if (conf->rx_poll[i].portid == NO_OWNER)
+			goto found;
+	}
+
+	if (conf->high_rxq < MAX_RX_QUEUE_PER_CORE)
+		_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
+	else
+		return -ENOMEM;
+found:
+	_CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq + 1);
+
+	struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+	struct rate_stats *rxq_stats = &conf->rx_poll_stats[i];
+
+	init_rate_stats(rxq_stats);
+
+	memset(&rxq->gov, 0, sizeof(rxq->gov));
+	rxq->packets = 0;
+	rxq->intr = port_config[portid].rx_intr ?
+		RXQ_INTR_UNKNOWN : RXQ_INTR_NONE;
+	CMM_STORE_SHARED(rxq->queueid, q);
+	/* write queueid before writing portid */
+	cmm_smp_wmb();
+	_CMM_STORE_SHARED(rxq->portid, portid);
+
+	bitmask_set(&conf->portmask, portid);
+
+	return i;
+}
+
 /* Assign all receive queues for a port */
 static int assign_port_receive_queues(portid_t portid)
 {
@@ -1663,8 +2176,7 @@ static int assign_port_receive_queues(portid_t portid)
 	bitmask_t allowed = cpu_affinity_online(&port_conf->rx_cpu_affinity);
 
 	for (q = 0; q < port_conf->rx_queues; q++) {
-		struct lcore_conf *conf;
-		int i, lcore;
+		int lcore;
 
 		if (!bitmask_isset(&port_conf->rx_enabled_queues, q))
 			continue;
@@ -1677,46 +2189,22 @@ static int assign_port_receive_queues(portid_t portid)
 				"no available lcore for rx port %u\n", portid);
 			return -ENOENT;
 		}
-		conf = lcore_conf[lcore];
 
-		/* find empty slot to use */
-		for (i = 0; i < conf->high_rxq; i++) {
-			if (conf->rx_poll[i].portid == NO_OWNER)
-				goto found;
-		}
-
-		if (conf->high_rxq < MAX_RX_QUEUE_PER_CORE)
-			_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
-		else {
+		if (lcore_assign_rxq(lcore, portid, q) < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				"Socket %d has no unused rx queues\n",
 				port_conf->socketid);
 			return -ENOMEM;
 		}
-found:
+
 		bitmask_clear(&allowed, lcore);
 		if (bitmask_isempty(&allowed))
 			allowed = cpu_affinity_online(		/* start over */
 				&port_conf->rx_cpu_affinity);
-		_CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq + 1);
 
 		DP_DEBUG(INIT, DEBUG, DATAPLANE,
 			 "Assign RX port %u queue %u to core %u (node %u)\n",
 			 portid, q, lcore, port_conf->socketid);
-
-		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
-		struct rate_stats *rxq_stats = &conf->rx_poll_stats[i];
-
-		init_rate_stats(rxq_stats);
-
-		memset(&rxq->gov, 0, sizeof(rxq->gov));
-		rxq->packets = 0;
-		CMM_STORE_SHARED(rxq->queueid, q);
-		/* write queueid before writing portid */
-		cmm_smp_wmb();
-		_CMM_STORE_SHARED(rxq->portid, portid);
-
-		bitmask_set(&conf->portmask, portid);
 	}
 
 	return 0;
@@ -1790,6 +2278,7 @@ found:
 		txq->tx_no_pkts = ifp->if_team;
 		txq->packets = 0;
 		txq->ringid = r;
+		CMM_STORE_SHARED(port_conf->tx_lcore[r], lcore);
 		r++;
 		CMM_STORE_SHARED(txq->queueid, q);
 		/* write queueid and other fields before writing portid */
@@ -2536,6 +3025,7 @@ static int port_conf_final(portid_t portid, struct rte_eth_conf *dev_conf)
 
 	dev_conf->intr_conf.lsc = (dev->data->dev_flags &
 				   RTE_ETH_DEV_INTR_LSC) ? 1 : 0;
+	dev_conf->intr_conf.rxq = port_conf->rx_intr;
 
 	dev_conf->rxmode.offloads = port_conf->rx_conf.offloads;
 	dev_conf->rxmode.mq_mode = port_conf->rx_mq_mode;
@@ -2714,6 +3204,8 @@ static int port_conf_init(portid_t portid)
 		port_conf->percoreq = true;
 		port_conf->max_rings = 1;		/* needed for QoS */
 	}
+
+	port_conf->rx_intr = parm->drv_flags & DRV_PARAM_RX_INTR;
 	port_conf->nrings = port_conf->max_rings;
 
 	for (q = 0; q < port_conf->tx_queues; q++)
@@ -3126,6 +3618,13 @@ static void lcore_init(void)
 
 		conf->tx_qid = q++;
 
+		/* Without it an lcore with tx queues never waits for intr */
+		conf->wake_fd = eventfd(0, EFD_NONBLOCK);
+		if (conf->wake_fd < 0)
+			RTE_LOG(NOTICE, DATAPLANE,
+				"no tx wake eventfd for core %u: %s\n", i,
+				strerror(errno));
+
 		/* Initialise the pmd list head */
 		CDS_INIT_LIST_HEAD(&conf->crypt.pmd_list);
 	}
@@ -3573,10 +4072,11 @@ main(int argc, char **argv)
 	shadow_init();
 	npf_init();
 	session_init();
+	ll_hold_init();
 	nexthop_tbl_init();
 	ip6_init();
 	init_eth_ports(0, nb_ports);
-	fragment_tables_timer_init();
+	fragment_tables_init();
 	mcast_init_ipv4();
 	mcast_init_ipv6();
 	mpls_init();
@@ -3624,6 +4124,7 @@ main(int argc, char **argv)
 	capture_destroy();
 	device_server_destroy();
 	shadow_destroy();
+	stats_shm_destroy();
 	console_destroy();
 	zactor_destroy(&vplane_auth);
 	interface_cleanup();
@@ -3657,6 +4158,378 @@ main(int argc, char **argv)
 	return 0;
 }
 
+/*
+ * RX queue rebalancing
+ *
+ * Queues are initially spread over lcores by queue count alone, so
+ * skewed traffic can leave some lcores saturated while others idle.
+ * When enabled, once a second the packet rates from load_estimator()
+ * are used to find the busiest lcore and, if it has been above the
+ * mean load by more than the threshold for a few intervals, move the
+ * receive queues that best even out the load, a few at a time.
+ */
+#define REBALANCE_PERSIST	3	/* intervals imbalance must persist */
+#define REBALANCE_MAX_MOVES	4	/* queues moved per interval */
+
+struct rxq_move {
+	unsigned int from;
+	unsigned int slot;
+	unsigned int to;
+};
+
+static struct rxq_rebalance {
+	bool enabled;
+	struct rxq_rebalance_params params;
+	unsigned int imbalanced;	/* consecutive intervals over thresh */
+	unsigned int holddown;		/* intervals left before next move */
+	uint64_t moves;
+	uint64_t failed;
+} rxq_rebalance = {
+	.params = {
+		.threshold = 25,
+		.min_rate = 100000,
+		.holddown = 10,
+	},
+};
+
+static bool rebalance_lcore(unsigned int lcore)
+{
+	const struct lcore_conf *conf = lcore_conf[lcore];
+
+	return !conf->ded_to_feature && !conf->do_feature;
+}
+
+/* Packet rate an lcore is handling, as an estimate of its load */
+static uint64_t rebalance_lcore_load(unsigned int lcore)
+{
+	const struct lcore_conf *conf = lcore_conf[lcore];
+	uint64_t load = 0;
+	unsigned int i;
+
+	for (i = 0; i < conf->high_rxq; i++) {
+		if (conf->rx_poll[i].portid == NO_OWNER)
+			continue;
+
+		load += conf->rx_poll_stats[i].packet_rate;
+	}
+
+	if (conf->do_crypto)
+		load += conf->crypt_stats.packet_rate;
+
+	return load;
+}
+
+/*
+ * Move receive queues between lcores.
+ *
+ * The old owners stop polling the queues before the new ones start,
+ * and synchronize_rcu() guarantees any burst they already took off
+ * the queues has been fully processed and queued for transmit, so
+ * packets within a flow are not reordered by the handover. Packets
+ * arriving in the meantime just wait in the NIC ring.
+ *
+ * The whole batch shares one grace period, so master blocks once
+ * however many queues move. No lcore a queue moves from is given
+ * another queue in the same batch, so the slot it gave up is still
+ * free if a move fails. Returns the number of queues moved.
+ */
+static unsigned int rxq_migrate(const struct rxq_move *moves, unsigned int n)
+{
+	portid_t portid[REBALANCE_MAX_MOVES];
+	uint8_t q[REBALANCE_MAX_MOVES];
+	unsigned int i, moved = 0;
+	struct lcore_conf *conf;
+
+	for (i = 0; i < n; i++) {
+		conf = lcore_conf[moves[i].from];
+		portid[i] = conf->rx_poll[moves[i].slot].portid;
+		q[i] = conf->rx_poll[moves[i].slot].queueid;
+
+		lcore_release_rxq(conf, moves[i].slot);
+		if (!lcore_uses_port(conf, portid[i]))
+			bitmask_clear(&conf->portmask, portid[i]);
+	}
+
+	synchronize_rcu();
+
+	for (i = 0; i < n; i++)
+		lcore_rx_intr_detach(lcore_conf[moves[i].from], moves[i].slot);
+
+	for (i = 0; i < n; i++) {
+		if (lcore_assign_rxq(moves[i].to, portid[i], q[i]) < 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"rebalance of RX port %u queue %u to core %u "
+				"failed\n",
+				portid[i], q[i], moves[i].to);
+			lcore_assign_rxq(moves[i].from, portid[i], q[i]);
+			continue;
+		}
+
+		DP_DEBUG(INIT, INFO, DATAPLANE,
+			 "Rebalance RX port %u queue %u from core %u "
+			 "to core %u\n",
+			 portid[i], q[i], moves[i].from, moves[i].to);
+		++moved;
+	}
+
+	start_cpus();
+	stop_cpus();
+
+	return moved;
+}
+
+/*
+ * Move one receive queue to the given lcore, which may be the lcore
+ * already polling it. Returns 0 or negative errno.
+ */
+/* For affinity UT */
+int rxq_move(portid_t portid, uint8_t queueid, unsigned int to)
+{
+	struct rxq_move move = { .to = to };
+	const struct lcore_conf *conf;
+	unsigned int lcore, i;
+
+	if (to >= RTE_MAX_LCORE || !lcore_conf[to])
+		return -EINVAL;
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		conf = lcore_conf[lcore];
+		for (i = 0; i < conf->high_rxq; i++) {
+			if (conf->rx_poll[i].portid != portid ||
+			    conf->rx_poll[i].queueid != queueid)
+				continue;
+
+			move.from = lcore;
+			move.slot = i;
+			return rxq_migrate(&move, 1) == 1 ? 0 : -ENOMEM;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Find the busiest of the candidate lcores, if it is busy enough and far
+ * enough above the mean load to move a queue from.  Returns RTE_MAX_LCORE
+ * if the load is balanced.
+ */
+/* For affinity UT */
+unsigned int rxq_rebalance_hot(const uint64_t *load, const bitmask_t *lcores,
+			       const struct rxq_rebalance_params *params)
+{
+	unsigned int lcore, hot = RTE_MAX_LCORE, n = 0;
+	uint64_t total = 0, mean;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (!bitmask_isset(lcores, lcore))
+			continue;
+
+		total += load[lcore];
+		++n;
+		if (hot == RTE_MAX_LCORE || load[lcore] > load[hot])
+			hot = lcore;
+	}
+
+	if (n < 2)
+		return RTE_MAX_LCORE;
+
+	mean = total / n;
+	if (load[hot] < params->min_rate ||
+	    load[hot] * 100 <= mean * (100 + params->threshold))
+		return RTE_MAX_LCORE;
+
+	return hot;
+}
+
+/*
+ * Find the lcore a queue of the busiest lcore could move to that minimises
+ * the larger of the two lcore loads after the move, if that is lower than
+ * *best_score.  A move that would not lower the load of the busiest lcore
+ * just shifts the hot spot.  Returns RTE_MAX_LCORE if there is none.
+ */
+/* For affinity UT */
+unsigned int rxq_rebalance_dst(const uint64_t *load, unsigned int hot,
+			       uint64_t rate, const bitmask_t *allowed,
+			       uint64_t *best_score)
+{
+	unsigned int lcore, dst = RTE_MAX_LCORE;
+	uint64_t score;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (lcore == hot || !bitmask_isset(allowed, lcore))
+			continue;
+
+		score = RTE_MAX(load[hot] - rate, load[lcore] + rate);
+		if (score < *best_score) {
+			*best_score = score;
+			dst = lcore;
+		}
+	}
+
+	return dst;
+}
+
+/* Is the queue in the lcore's slot already being moved? */
+static bool rxq_move_pending(const struct rxq_move *moves, unsigned int n,
+			     unsigned int lcore, unsigned int slot)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (moves[i].from == lcore && moves[i].slot == slot)
+			return true;
+
+	return false;
+}
+
+static void rxq_rebalance_run(void)
+{
+	const struct rxq_rebalance_params *params = &rxq_rebalance.params;
+	struct rxq_move moves[REBALANCE_MAX_MOVES];
+	uint64_t load[RTE_MAX_LCORE];
+	uint64_t best_score, best_rate = 0;
+	unsigned int lcore, i, hot, dst, n = 0, moved;
+	unsigned int best_slot = 0, best_dst;
+	bitmask_t lcores, dsts, to_ok;
+
+	if (!rxq_rebalance.enabled || single_cpu)
+		return;
+
+	if (rxq_rebalance.holddown > 0) {
+		--rxq_rebalance.holddown;
+		return;
+	}
+
+	bitmask_zero(&lcores);
+	FOREACH_FORWARD_LCORE(lcore) {
+		if (!rebalance_lcore(lcore))
+			continue;
+
+		load[lcore] = rebalance_lcore_load(lcore);
+		bitmask_set(&lcores, lcore);
+	}
+
+	hot = rxq_rebalance_hot(load, &lcores, params);
+	if (hot == RTE_MAX_LCORE) {
+		rxq_rebalance.imbalanced = 0;
+		return;
+	}
+
+	/* hysteresis, ignore short bursts */
+	if (++rxq_rebalance.imbalanced < REBALANCE_PERSIST)
+		return;
+	rxq_rebalance.imbalanced = 0;
+
+	/*
+	 * Pick the queues and destinations that best even out the load,
+	 * one at a time against the loads the moves so far would leave.
+	 * An lcore queues move from is never a destination, and the
+	 * other way around.
+	 */
+	bitmask_zero(&dsts);
+	bitmask_copy(&to_ok, &lcores);
+	while (n < REBALANCE_MAX_MOVES) {
+		const struct lcore_conf *conf = lcore_conf[hot];
+
+		bitmask_clear(&to_ok, hot);
+		best_score = load[hot];
+		best_dst = RTE_MAX_LCORE;
+		for (i = 0; i < conf->high_rxq; i++) {
+			portid_t portid = conf->rx_poll[i].portid;
+			uint64_t rate = conf->rx_poll_stats[i].packet_rate;
+			const struct port_conf *port_conf;
+			bitmask_t allowed;
+
+			if (portid == NO_OWNER || rate == 0 ||
+			    rxq_move_pending(moves, n, hot, i))
+				continue;
+
+			port_conf = &port_config[portid];
+			allowed = cpu_affinity_online(
+				&port_conf->rx_cpu_affinity);
+			bitmask_and(&allowed, &allowed, &to_ok);
+
+			/* never move a queue away from its NUMA node */
+			if (port_conf->socketid != SOCKET_ID_ANY) {
+				FOREACH_FORWARD_LCORE(lcore) {
+					if ((unsigned int)port_conf->socketid !=
+					    rte_lcore_to_socket_id(lcore))
+						bitmask_clear(&allowed, lcore);
+				}
+			}
+
+			dst = rxq_rebalance_dst(load, hot, rate, &allowed,
+						&best_score);
+			if (dst != RTE_MAX_LCORE) {
+				best_slot = i;
+				best_dst = dst;
+				best_rate = rate;
+			}
+		}
+
+		if (best_dst == RTE_MAX_LCORE)
+			break;
+
+		moves[n].from = hot;
+		moves[n].slot = best_slot;
+		moves[n].to = best_dst;
+		++n;
+
+		bitmask_set(&dsts, best_dst);
+		load[hot] -= best_rate;
+		load[best_dst] += best_rate;
+
+		hot = rxq_rebalance_hot(load, &lcores, params);
+		if (hot == RTE_MAX_LCORE || bitmask_isset(&dsts, hot))
+			break;
+	}
+
+	if (n == 0)
+		return;
+
+	moved = rxq_migrate(moves, n);
+	rxq_rebalance.moves += moved;
+	rxq_rebalance.failed += n - moved;
+
+	/* let the rate estimates settle before looking again */
+	rxq_rebalance.holddown = params->holddown;
+}
+
+void get_rxq_rebalance(bool *enabled, struct rxq_rebalance_params *params)
+{
+	*enabled = rxq_rebalance.enabled;
+	*params = rxq_rebalance.params;
+}
+
+void set_rxq_rebalance(bool enable, const struct rxq_rebalance_params *params)
+{
+	rxq_rebalance.enabled = enable;
+	if (params)
+		rxq_rebalance.params = *params;
+	rxq_rebalance.imbalanced = 0;
+	rxq_rebalance.holddown = 0;
+}
+
+void show_rxq_rebalance(FILE *f)
+{
+	const struct rxq_rebalance_params *params = &rxq_rebalance.params;
+	json_writer_t *wr = jsonw_new(f);
+
+	if (!wr)
+		return;
+
+	jsonw_name(wr, "rebalance");
+	jsonw_start_object(wr);
+	jsonw_bool_field(wr, "enabled", rxq_rebalance.enabled);
+	jsonw_uint_field(wr, "threshold", params->threshold);
+	jsonw_uint_field(wr, "min_rate", params->min_rate);
+	jsonw_uint_field(wr, "holddown", params->holddown);
+	jsonw_uint_field(wr, "moves", rxq_rebalance.moves);
+	jsonw_uint_field(wr, "failed", rxq_rebalance.failed);
+	jsonw_end_object(wr);
+	jsonw_destroy(&wr);
+}
+
 /* Update packets per second value */
 void load_estimator(void)
 {
@@ -3710,6 +4583,8 @@ void load_estimator(void)
 
 		}
 	}
+
+	rxq_rebalance_run();
 }
 
 /* Display per-core info in JSON
@@ -3846,6 +4721,51 @@ void show_per_core(FILE *f)
 	jsonw_destroy(&wr);
 }
 
+/*
+ * Cycle accounting per forwarding lcore. The counters are only
+ * written by the owning lcore, so a clear may race with an update
+ * and lose it, which is fine for statistics.
+ */
+void show_lcore_perf(json_writer_t *wr)
+{
+	unsigned int id, b;
+
+	jsonw_name(wr, "lcore");
+	jsonw_start_array(wr);
+	FOREACH_FORWARD_LCORE(id) {
+		const struct lcore_perf *perf = &lcore_conf[id]->perf;
+
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "core", id);
+		jsonw_uint_field(wr, "busy_cycles", perf->busy_cycles);
+		jsonw_uint_field(wr, "idle_cycles", perf->idle_cycles);
+		jsonw_uint_field(wr, "sleep_cycles", perf->sleep_cycles);
+
+		jsonw_name(wr, "rx_burst");
+		jsonw_start_array(wr);
+		for (b = 0; b < PERF_RX_BURST_BUCKETS; b++) {
+			const struct perf_count *pc = &perf->rx_burst[b];
+
+			jsonw_start_object(wr);
+			jsonw_uint_field(wr, "min_size", 1u << b);
+			jsonw_uint_field(wr, "bursts", pc->count);
+			jsonw_uint_field(wr, "cycles", pc->cycles);
+			jsonw_end_object(wr);
+		}
+		jsonw_end_array(wr);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+}
+
+void clear_lcore_perf(void)
+{
+	unsigned int id;
+
+	FOREACH_FORWARD_LCORE(id)
+		memset(&lcore_conf[id]->perf, 0, sizeof(struct lcore_perf));
+}
+
 static void show_ifp_affinity(struct ifnet *ifp, void *arg)
 {
 	const struct port_conf *port_conf = &port_config[ifp->if_port];
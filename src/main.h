@@ -22,6 +22,7 @@
 #include "compat.h"
 #include "compiler.h"
 #include "control.h"
+#include "json_writer.h"
 
 struct rte_mbuf;
 struct rte_mempool;
@@ -49,6 +50,8 @@ struct rte_mempool *mbuf_pool_create(const char *name,
 /* Console interface */
 void load_estimator(void);
 void show_per_core(FILE *f);
+void show_lcore_perf(json_writer_t *wr);
+void clear_lcore_perf(void);
 
 extern const char *console_endpoint;
 void console_setup(void);
@@ -86,6 +89,26 @@ void set_port_affinity(portid_t portid, const bitmask_t *rx_mask,
 		       const bitmask_t *tx_mask);
 uint64_t get_link_modes(struct ifnet *ifp);
 
+/* Parameters for moving RX queues between lcores based on load */
+struct rxq_rebalance_params {
+	unsigned int threshold;	/* % above mean lcore load to act on */
+	unsigned int min_rate;	/* pps below which an lcore is not busy */
+	unsigned int holddown;	/* seconds to wait after moving a queue */
+};
+
+void get_rxq_rebalance(bool *enabled, struct rxq_rebalance_params *params);
+void set_rxq_rebalance(bool enable,
+		       const struct rxq_rebalance_params *params);
+void show_rxq_rebalance(FILE *f);
+unsigned int rxq_rebalance_hot(const uint64_t *load, const bitmask_t *lcores,
+			       const struct rxq_rebalance_params *params);
+unsigned int rxq_rebalance_dst(const uint64_t *load, unsigned int hot,
+			       uint64_t rate, const bitmask_t *allowed,
+			       uint64_t *best_score);
+int rxq_move(portid_t portid, uint8_t queueid, unsigned int to);
+
+bool lcore_txq_can_intr(portid_t portid, bool pending);
+
 int assign_queues(portid_t portid);
 void unassign_queues(portid_t portid);
 int enable_transmit_thread(portid_t portid);
@@ -127,6 +150,7 @@ void scale_rate_stats(struct rate_stats *stats, uint64_t *packets,
 #define DRV_PARAM_NO_DIRECT	(1<<2)	/* do not use direct TX */
 #define DRV_PARAM_USE_ALL_RXQ	(1<<3)	/* use all available RX queues */
 #define DRV_PARAM_USE_ALL_TXQ	(1<<4)	/* use all available TX queues */
+#define DRV_PARAM_RX_INTR	(1<<5)	/* supports RX queue interrupts */
 
 struct rxtx_param {
 	const char *match;
@@ -46,11 +46,13 @@
 #include "dp_event.h"
 #include "dpmsg.h"
 #include "event_internal.h"
+#include "if/bridge/bridge.h"
 #include "if/dpdk-eth/hotplug.h"
 #include "if_ether.h"
 #include "if_var.h"
 #include "ip_addr.h"
 #include "json_writer.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "master.h"
 #include "npf/npf_event.h"
@@ -1223,6 +1225,8 @@ void master_loop(void)
 				cont_src = CONT_SRC_MAIN;
 		}
 		rte_timer_manage();
+		ll_hold_service_shared();
+		bridge_learn_service();
 
 		rcu_quiescent_state();
 		switch (master_state_get(cont_src)) {
@@ -78,6 +78,7 @@
 #include "in_cksum.h"
 #include "ip6_funcs.h"
 #include "lcore_sched.h"
+#include "ll_hold.h"
 #include "main.h"
 #include "nd6.h"
 #include "nd6_nbr.h"
@@ -371,6 +372,7 @@ nd6_entry_amend(struct ifnet *ifp, struct llentry *la, uint8_t state,
 		const struct rte_ether_addr *enaddr, uint16_t secs, u_int flags)
 {
 	struct lltable *llt = ifp->if_lltable6;
+	bool resolved = false;
 
 	rte_spinlock_lock(&la->ll_lock);
 
@@ -408,30 +410,16 @@ nd6_entry_amend(struct ifnet *ifp, struct llentry *la, uint8_t state,
 		la->ll_expire = secs ?
 			rte_get_timer_cycles() + rte_get_timer_hz() * secs : 0;
 
-		/*
-		 * Send any queued data if now valid
-		 */
-		if (la->la_numheld > 0) {
-			unsigned int i;
-
-			for (i = 0; i < la->la_numheld; ++i) {
-				struct rte_mbuf *m = la->la_held[i];
-				struct rte_ether_hdr *eh;
-
-				if (!m)
-					break;
-
-				eh = rte_pktmbuf_mtod(m,
-						      struct rte_ether_hdr *);
-
-				la->la_held[i] = NULL;
-				rte_ether_addr_copy(enaddr, &eh->d_addr);
-				if_output(ifp, m, NULL, ntohs(eh->ether_type));
-			}
-			la->la_numheld = 0;
-		}
+		la->la_numheld = 0;
+		resolved = true;
 	}
 	rte_spinlock_unlock(&la->ll_lock);
+
+	/*
+	 * Send any queued data if now valid
+	 */
+	if (resolved)
+		ll_hold_changed(la);
 }
 
 /*
@@ -1137,13 +1125,13 @@ int nd6_resolve(struct ifnet *in_ifp, struct ifnet *ifp,
 	struct lltable *llt = ifp->if_lltable6;
 	struct llentry *la;
 	char b[INET6_ADDRSTRLEN];
-	bool send_ns = false;
+	struct in6_addr src6;
 
 lookup:
 	la = in6_lltable_lookup(ifp, 0, addr);
 	if (likely(la && (la->la_flags & LLE_VALID))) {
 resolved:
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_set_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
@@ -1178,49 +1166,26 @@ resolved:
 			  PRINT6(addr, b));
 	}
 
-	/* Lock entry to hold off update and timer */
-	rte_spinlock_lock(&la->ll_lock);
-
-	if (unlikely(la->la_flags & LLE_VALID)) {
-		rte_spinlock_unlock(&la->ll_lock);
+	if (unlikely(la->la_flags & LLE_VALID))
 		goto resolved;
-	}
 
-	if (unlikely(la->la_flags & LLE_DELETED)) {
-		rte_spinlock_unlock(&la->ll_lock);
+	if (unlikely(la->la_flags & LLE_DELETED))
 		goto lookup;
-	}
 
 	/*
-	 * Incomplete ND cache entry. Queue packet on entry
-	 * Discard oldest if queue limit is exceeded
+	 * Incomplete ND cache entry. Hold packet until it is resolved,
+	 * noting the source for the NS first as holding consumes it.
 	 */
+	src6 = ip6hdr(m)->ip6_src;
 	if (in_ifp)
 		pktmbuf_save_ifp(m, in_ifp);
-	if (la->la_numheld >= nd6_cfg.nd6_maxhold) {
-		ND6NBR_INC(dropped);
-		rte_pktmbuf_free(la->la_held[0]);
-		memmove(&la->la_held[0], &la->la_held[1],
-			(nd6_cfg.nd6_maxhold - 1) * sizeof(la->la_held[0]));
-		la->la_held[nd6_cfg.nd6_maxhold - 1] = m;
-	} else {
-		la->la_held[la->la_numheld++] = m;
-	}
+	ll_hold_pkt(ifp, la, m, nd6_cfg.nd6_maxhold);
 
 	/*
 	 * Build and send an NS if newly-created
 	 */
-	if (!la->la_asked) {
-		la->la_asked = 1;
-		send_ns = true;
-	}
-	rte_spinlock_unlock(&la->ll_lock);
-
-	if (send_ns) {
-		struct ip6_hdr *ip6 = ip6hdr(m);
-
-		nd6_ns_output(ifp, &ip6->ip6_src, addr, NULL);
-	}
+	if (ll_hold_solicit(la))
+		nd6_ns_output(ifp, &src6, addr, NULL);
 
 	return -EWOULDBLOCK;
 }
@@ -1350,8 +1315,6 @@ nd6_nbr_walk(const struct ifnet *ifp, ll_walkhash_f_t *f, void *arg)
 void
 nd6_entry_destroy(struct lltable *llt, struct llentry *lle)
 {
-	unsigned int pkts_dropped;
-
 	if (lle->la_flags & LLE_DELETED)
 		return;
 
@@ -1362,9 +1325,7 @@ nd6_entry_destroy(struct lltable *llt, struct llentry *lle)
 	    rte_atomic16_read(&llt->lle_restoken) < nd6_cfg.nd6_res_token)
 		rte_atomic16_inc(&llt->lle_restoken);
 
-	pkts_dropped = llentry_destroy(llt, lle);
-
-	ND6NBR_ADD(dropped, pkts_dropped);
+	llentry_destroy(llt, lle);
 	rte_atomic32_dec(&llt->lle_size);
 }
 
@@ -1573,51 +1534,36 @@ nd6_lookup(const struct in6_addr *addr6, const struct ifnet *ifp)
 }
 
 /*
- * Handle unreachable neighbour
- * Caller must have a spinlock on the entry if required
+ * Drop a packet held for a neighbour.  If the neighbour could not be
+ * resolved, do a rate-limited Destination Unreachable.  Do not attempt
+ * for locally-generated packet.
  */
-static void
-nd6_unreachable(struct ifnet *ifp, struct llentry *lle,
-		struct rte_mbuf **m_for_icmp_unreach,
-		struct ifnet **ifp_for_icmp_unreach)
+void nd6_held_drop(struct ifnet *ifp, struct rte_mbuf *m, bool unreach)
 {
 	struct lltable *llt = ifp->if_lltable6;
-
-	/*
-	 * Do a rate-limited Destination Unreachable
-	 * Do not attempt for locally-generated packet
-	 */
-	if (lle->la_numheld > 0) {
-		struct rte_mbuf *m = lle->la_held[0];
-		struct ifnet *in_ifp = pktmbuf_restore_ifp(m);
-
-		if (llt->lle_unrtoken && in_ifp) {
-			llt->lle_unrtoken--;
-			/*
-			 * We have the spinlock held for the ND entry,
-			 * so defer the sending of the ICMP unreachable
-			 * until later to minimise the time that the lock
-			 * is held and to avoid a deadlock when the
-			 * response needs to use the same entry that is
-			 * being resolved.
-			 */
-			*m_for_icmp_unreach = m;
-			*ifp_for_icmp_unreach = in_ifp;
-			/*
-			 * First pkt will be consumed, flush rest of
-			 * queued data.
-			 */
-			if (lle->la_numheld > 1)
-				pktmbuf_free_bulk(&lle->la_held[1],
-						  lle->la_numheld - 1);
-		} else {
-			/* Flush queued data */
-			pktmbuf_free_bulk(lle->la_held, lle->la_numheld);
+	struct ifnet *in_ifp;
+	uint16_t tokens;
+
+	ND6NBR_INC(dropped);
+
+	in_ifp = unreach ? pktmbuf_restore_ifp(m) : NULL;
+	if (in_ifp && llt) {
+		/* Held packets are dropped by any lcore */
+		tokens = CMM_LOAD_SHARED(llt->lle_unrtoken);
+		while (tokens) {
+			if (__atomic_compare_exchange_n(&llt->lle_unrtoken,
+							&tokens, tokens - 1,
+							false,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)) {
+				icmp6_error(in_ifp, m, ICMP6_DST_UNREACH,
+					    ICMP6_DST_UNREACH_ADDR, htonl(0));
+				return;
+			}
 		}
-		ND6NBR_ADD(dropped, lle->la_numheld);
-		lle->la_numheld = 0;
 	}
-	nd6_entry_destroy(llt, lle);
+
+	rte_pktmbuf_free(m);
 }
 
 /*
@@ -1625,9 +1571,7 @@ nd6_unreachable(struct ifnet *ifp, struct llentry *lle,
  */
 static struct rte_mbuf *
 nd6_resolve_timeout(struct lltable *llt, struct llentry *lle,
-		    uint64_t cur_time, bool nud,
-		    struct rte_mbuf **m_for_icmp_unreach,
-		    struct ifnet **ifp_for_icmp_unreach)
+		    uint64_t cur_time, bool nud)
 {
 	struct ifnet *ifp = llt->llt_ifp;
 
@@ -1653,8 +1597,8 @@ nd6_resolve_timeout(struct lltable *llt, struct llentry *lle,
 		else
 			ND6NBR_INC(timeouts);
 
-		nd6_unreachable(ifp, lle, m_for_icmp_unreach,
-				ifp_for_icmp_unreach);
+		/* Held packets are dropped as the hold queues are serviced */
+		nd6_entry_destroy(llt, lle);
 	}
 	return NULL;
 }
@@ -1720,15 +1664,11 @@ in6_ll_age(struct lltable *llt, struct llentry *lle, uint64_t cur_time)
 
 	if ((int64_t)(cur_time - lle->ll_expire) >= 0) {
 		struct rte_mbuf *m = NULL;
-		struct rte_mbuf *m_for_icmp_unreach = NULL;
-		struct ifnet *ifp_for_icmp_unreach = NULL;
 
 		rte_spinlock_lock(&lle->ll_lock);
 		switch (lle->la_state) {
 		case ND6_LLINFO_INCOMPLETE:
-			m = nd6_resolve_timeout(llt, lle, cur_time, false,
-						&m_for_icmp_unreach,
-						&ifp_for_icmp_unreach);
+			m = nd6_resolve_timeout(llt, lle, cur_time, false);
 			break;
 
 		case ND6_LLINFO_REACHABLE:
@@ -1744,9 +1684,7 @@ in6_ll_age(struct lltable *llt, struct llentry *lle, uint64_t cur_time)
 			break;
 
 		case ND6_LLINFO_PROBE:
-			m = nd6_resolve_timeout(llt, lle, cur_time, true,
-						&m_for_icmp_unreach,
-						&ifp_for_icmp_unreach);
+			m = nd6_resolve_timeout(llt, lle, cur_time, true);
 			break;
 
 		default:
@@ -1759,12 +1697,6 @@ in6_ll_age(struct lltable *llt, struct llentry *lle, uint64_t cur_time)
 			if (!ipv6_originate_filter(ifp, m))
 				if_output(ifp, m, NULL, ETH_P_IPV6);
 		}
-
-		if (m_for_icmp_unreach)
-			icmp6_error(ifp_for_icmp_unreach,
-				    m_for_icmp_unreach,
-				    ICMP6_DST_UNREACH,
-				    ICMP6_DST_UNREACH_ADDR, htonl(0));
 	}
 }
 
@@ -72,6 +72,7 @@ int nd6_input(struct ifnet *ifp, struct rte_mbuf *m);
 
 void nd6_nbr_walk(const struct ifnet *, ll_walkhash_f_t *, void *);
 void nd6_entry_destroy(struct lltable *llt, struct llentry *lle);
+void nd6_held_drop(struct ifnet *ifp, struct rte_mbuf *m, bool unreach);
 struct llentry *nd6_lookup(const struct in6_addr *, const struct ifnet *);
 struct llentry *in6_lltable_lookup(struct ifnet *ifp, u_int flags,
 				   const struct in6_addr *);
@@ -104,7 +105,7 @@ nd6_resolve_fast(struct ifnet *in_ifp, struct ifnet *ifp, struct rte_mbuf *m,
 
 	la = in6_lltable_find(ifp, addr);
 	if (likely(la && (la->la_flags & LLE_VALID))) {
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_set_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
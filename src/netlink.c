@@ -1597,6 +1597,7 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 	struct xfrm_algo_auth *auth_algo;
 	struct xfrm_algo *crypto_algo = NULL;
 	struct xfrm_encap_tmpl *tmpl = NULL;
+	struct xfrm_replay_state_esn *replay_esn = NULL;
 	struct xfrm_mark *mark;
 	uint32_t mark_val;
 	uint32_t extra_flags = 0;
@@ -1657,6 +1658,16 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 		}
 	}
 
+	if (attrs[XFRMA_REPLAY_ESN_VAL]) {
+		replay_esn = get_nl_attr_payload(attrs[XFRMA_REPLAY_ESN_VAL]);
+		if (mnl_attr_get_payload_len(attrs[XFRMA_REPLAY_ESN_VAL]) <
+		    sizeof(*replay_esn)) {
+			RTE_LOG(ERR, DATAPLANE,
+				"Could not decode REPLAY_ESN_VAL attr\n");
+			goto scrub;
+		}
+	}
+
 	/* create on-stack xfrm_algo to create the SA */
 	if (aead_algo) {
 		crypto_algo = alloca(sizeof(struct xfrm_algo) +
@@ -1668,7 +1679,7 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 		auth_algo = (struct xfrm_algo_auth *)aead_algo;
 	}
 
-	crypto_sadb_new_sa(sa_info, crypto_algo, auth_algo, tmpl,
+	crypto_sadb_new_sa(sa_info, crypto_algo, auth_algo, tmpl, replay_esn,
 			   mark_val, extra_flags, vrf_id);
 
  scrub:
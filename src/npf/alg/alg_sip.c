@@ -467,9 +467,35 @@ static void sip_alg_inspect_packet(npf_session_t *se, npf_cache_t *npc,
 {
 	struct sip_alg_request *sr;
 	struct npf_alg *sip = npf_alg_session_get_alg(se);
+	struct sip_nat sn = { 0 };
+	struct sip_scan sc;
+	char payload[SIP_MESSAGE_MAX_LENGTH + 1];
+	uint16_t plen;
 	bool consumed = false;
 
-	sr = sip_alg_parse(sip, npc, npf_session_get_if_index(se), nbuf);
+	plen = npf_payload_fetch(npc, nbuf, payload,
+			SIP_MSG_MIN_LENGTH, SIP_MESSAGE_MAX_LENGTH);
+	if (!plen)
+		return;
+
+	/* Make the payload a string */
+	payload[plen] = '\0';
+
+	/*
+	 * Nothing to translate, so messages that do not change call state
+	 * only need to be scanned.
+	 */
+	sip_nat_init(&sn, false, NULL, NULL, 0, 0, di);
+	if (plen == npf_payload_len(npc) && !sip_scan(payload, plen, &sc) &&
+	    sip_scan_is_passive(&sc) &&
+	    (!sc.sc_request || sip_request_is_passive(se, &sn))) {
+		npc->npc_alg_flags = sc.sc_request ? SIP_NPC_REQUEST :
+			SIP_NPC_RESPONSE;
+		return;
+	}
+
+	sr = sip_alg_parse_buf(sip, payload, plen,
+			       npf_session_get_if_index(se));
 	if (!sr)
 		return;
 
@@ -478,7 +504,7 @@ static void sip_alg_inspect_packet(npf_session_t *se, npf_cache_t *npc,
 		return;
 	}
 
-	sip_init_nat(sr, false, NULL, NULL, 0, 0, di);
+	sr->sr_nat = sn;
 
 	sip_alg_manage_sip(se, npc, sr, sr, NULL, &consumed);
 
@@ -22,6 +22,7 @@
 #include "npf/alg/sip/sip_response.h"
 #include "npf/alg/sip/sip_parse.h"
 #include "npf/alg/sip/sip_translate.h"
+#include "npf/alg/sip/sip_scan.h"
 
 /*
  * SIP private data.
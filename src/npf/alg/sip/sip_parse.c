@@ -634,10 +634,8 @@ struct sip_alg_request *sip_alg_parse(const struct npf_alg *sip,
 				      npf_cache_t *npc, uint32_t if_idx,
 				      struct rte_mbuf *nbuf)
 {
-	struct sip_alg_request *sr = NULL;
 	uint16_t plen;
 	char payload[SIP_MESSAGE_MAX_LENGTH + 1];
-	int rc;
 
 	plen = npf_payload_fetch(npc, nbuf, payload,
 			SIP_MSG_MIN_LENGTH, SIP_MESSAGE_MAX_LENGTH);
@@ -647,6 +645,20 @@ struct sip_alg_request *sip_alg_parse(const struct npf_alg *sip,
 	/* Make the payload a string */
 	payload[plen] = '\0';
 
+	return sip_alg_parse_buf(sip, payload, plen, if_idx);
+}
+
+/*
+ * As sip_alg_parse, for a payload that has already been fetched.  payload
+ * must be NUL terminated.
+ */
+struct sip_alg_request *sip_alg_parse_buf(const struct npf_alg *sip,
+					  const char *payload, uint16_t plen,
+					  uint32_t if_idx)
+{
+	struct sip_alg_request *sr = NULL;
+	int rc;
+
 	sr = sip_alg_request_alloc(true, if_idx);
 	if (!sr)
 		return NULL;
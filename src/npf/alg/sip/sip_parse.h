@@ -35,5 +35,8 @@ int sip_alg_manage_media(npf_session_t *se, npf_nat_t *nat,
 struct sip_alg_request *sip_alg_parse(const struct npf_alg *sip,
 				      npf_cache_t *npc, uint32_t if_idx,
 				      struct rte_mbuf *nbuf);
+struct sip_alg_request *sip_alg_parse_buf(const struct npf_alg *sip,
+					  const char *payload, uint16_t plen,
+					  uint32_t if_idx);
 
 #endif
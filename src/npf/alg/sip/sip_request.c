@@ -359,6 +359,28 @@ static int sip_alg_manage_cntl(npf_session_t *se, npf_cache_t *npc,
 	return sip_alg_add_cntl_tuple(se, npc);
 }
 
+/*
+ * Would sip_manage_request do anything for this request other than set the
+ * per-packet flags?  Used by the scanner fast path, which never calls it.
+ */
+bool sip_request_is_passive(npf_session_t *se, const struct sip_nat *sn)
+{
+	struct sip_alg_session *ss = npf_alg_session_get_private(se);
+	uint32_t flags = npf_alg_session_get_flags(se);
+
+	/* Reply path not yet learnt from the first VIA */
+	if (!ss || !ss->ss_via_port)
+		return false;
+
+	if (flags & SIP_ALG_ALT_TUPLE_SET)
+		return true;
+
+	/* Would add the alt cntl tuple */
+	return !(npf_session_get_proto(se) == IPPROTO_UDP &&
+		 (flags & SIP_ALG_CNTL_FLOW) && sn->sn_forw &&
+		 sn->sn_type == sip_nat_snat);
+}
+
 /*
  * Add the call id on the session handle private data.
  * We will expire these then the session handle is expired.
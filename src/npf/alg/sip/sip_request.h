@@ -15,6 +15,7 @@
 
 struct sip_alg_request;
 struct sip_alg_media;
+struct sip_nat;
 struct sip_private;
 struct rte_mbuf;
 struct npf_alg;
@@ -45,6 +46,7 @@ int sip_manage_request(npf_session_t *se, npf_cache_t *npc,
 		       struct sip_alg_request *sr,
 		       struct sip_alg_request *tsr,
 		       npf_nat_t *nat, bool *consumed);
+bool sip_request_is_passive(npf_session_t *se, const struct sip_nat *sn);
 
 /*
  * SIP request hash table
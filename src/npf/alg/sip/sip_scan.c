@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * SIP scan.
+ *
+ * sip_scan finds the headers of a SIP message in place.  For messages that
+ * carry no SDP and do not change the state of a call, which is most of the
+ * SIP traffic, e.g. REGISTERs and their responses, sip_scan_translate
+ * rewrites the headers directly into a buffer that replaces the payload.
+ * This avoids osip parsing, cloning and re-serialising each message, and
+ * all the allocations that go with it.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "npf/alg/sip/sip.h"
+#include "npf/alg/sip/sip_scan.h"
+
+static const struct {
+	const char	*name;
+	uint8_t		type;
+} sip_scan_names[] = {
+	{ "Via",			SIP_HDR_VIA },
+	{ "v",				SIP_HDR_VIA },
+	{ "From",			SIP_HDR_FROM },
+	{ "f",				SIP_HDR_FROM },
+	{ "To",				SIP_HDR_TO },
+	{ "t",				SIP_HDR_TO },
+	{ "Call-ID",			SIP_HDR_CALL_ID },
+	{ "i",				SIP_HDR_CALL_ID },
+	{ "CSeq",			SIP_HDR_CSEQ },
+	{ "Contact",			SIP_HDR_CONTACT },
+	{ "m",				SIP_HDR_CONTACT },
+	{ "Route",			SIP_HDR_ROUTE },
+	{ "Record-Route",		SIP_HDR_RECORD_ROUTE },
+	{ "User-Agent",			SIP_HDR_USER_AGENT },
+	{ "P-Asserted-Identity",	SIP_HDR_P_ASSERTED_ID },
+	{ "P-Preferred-Identity",	SIP_HDR_P_PREFERRED_ID },
+	{ "Content-Length",		SIP_HDR_CONTENT_LENGTH },
+	{ "l",				SIP_HDR_CONTENT_LENGTH },
+};
+
+#define H(t)	SIP_HDR_BIT(SIP_HDR_##t)
+
+/*
+ * Headers translated, indexed by [request][forw].  These are the same
+ * headers as translated by sip_alg_translate_snat and
+ * sip_alg_translate_dnat.
+ */
+static const uint32_t sip_scan_snat_hdrs[2][2] = {
+	[0][0] = H(FROM) | H(CALL_ID) | H(VIA) | H(RECORD_ROUTE) | H(ROUTE),
+	[0][1] = H(TO) | H(CONTACT) | H(RECORD_ROUTE) | H(FROM) |
+		 H(CALL_ID) | H(VIA),
+	[1][0] = H(REQ_URI) | H(TO) | H(CALL_ID),
+	[1][1] = H(FROM) | H(USER_AGENT) | H(CALL_ID) | H(VIA) |
+		 H(CONTACT) | H(RECORD_ROUTE) | H(ROUTE) |
+		 H(P_ASSERTED_ID) | H(P_PREFERRED_ID),
+};
+
+static const uint32_t sip_scan_dnat_hdrs[2][2] = {
+	[0][0] = H(REQ_URI) | H(TO) | H(CONTACT) | H(RECORD_ROUTE) |
+		 H(ROUTE),
+	[0][1] = H(TO) | H(RECORD_ROUTE) | H(ROUTE),
+	[1][0] = H(REQ_URI) | H(CONTACT) | H(TO) | H(P_ASSERTED_ID) |
+		 H(P_PREFERRED_ID),
+	[1][1] = H(REQ_URI) | H(TO),
+};
+
+/* Find the CRLF that ends the line starting at p */
+static const char *sip_scan_eol(const char *p, const char *end)
+{
+	for (; p + 1 < end; p++) {
+		if (p[0] == '\r' && p[1] == '\n')
+			return p;
+	}
+	return NULL;
+}
+
+static const char *sip_scan_find(const char *p, const char *end,
+				 const char *s, size_t slen)
+{
+	for (; p + slen <= end; p++) {
+		if (!memcmp(p, s, slen))
+			return p;
+	}
+	return NULL;
+}
+
+static bool sip_scan_eq(const char *p, const char *end, const char *s)
+{
+	size_t len = end - p;
+
+	return strlen(s) == len && !memcmp(p, s, len);
+}
+
+static uint8_t sip_scan_method(const char *p, const char *end)
+{
+	if (sip_scan_eq(p, end, "INVITE"))
+		return SIP_METHOD_INVITE;
+	if (sip_scan_eq(p, end, "ACK"))
+		return SIP_METHOD_ACK;
+	if (sip_scan_eq(p, end, "BYE"))
+		return SIP_METHOD_BYE;
+	if (sip_scan_eq(p, end, "CANCEL"))
+		return SIP_METHOD_CANCEL;
+	return SIP_METHOD_OTHER;
+}
+
+static uint8_t sip_scan_hdr_type(const char *p, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sip_scan_names); i++) {
+		if (strlen(sip_scan_names[i].name) == len &&
+		    !strncasecmp(sip_scan_names[i].name, p, len))
+			return sip_scan_names[i].type;
+	}
+	return SIP_HDR_OTHER;
+}
+
+static int sip_scan_add(struct sip_scan *sc, uint8_t type,
+			const char *v, const char *ve)
+{
+	struct sip_scan_hdr *sh;
+
+	if (sc->sc_nhdrs >= SIP_SCAN_MAX_HDRS)
+		return -ENOSPC;
+
+	sh = &sc->sc_hdrs[sc->sc_nhdrs++];
+	sh->sh_off = v - sc->sc_msg;
+	sh->sh_len = ve - v;
+	sh->sh_type = type;
+	sc->sc_seen |= SIP_HDR_BIT(type);
+	return 0;
+}
+
+/* "SIP/2.0 200 OK" or "INVITE sip:bob@example.com SIP/2.0" */
+static int sip_scan_start_line(struct sip_scan *sc, const char *p,
+			       const char *eol)
+{
+	const char *sp, *v;
+
+	if (eol - p >= 11 && !memcmp(p, "SIP/2.0 ", 8)) {
+		if (!isdigit((unsigned char)p[8]) ||
+		    !isdigit((unsigned char)p[9]) ||
+		    !isdigit((unsigned char)p[10]) ||
+		    (eol - p > 11 && p[11] != ' '))
+			return -EINVAL;
+		sc->sc_request = false;
+		sc->sc_status = (p[8] - '0') * 100 + (p[9] - '0') * 10 +
+			(p[10] - '0');
+		return 0;
+	}
+
+	sp = memchr(p, ' ', eol - p);
+	if (!sp || sp == p)
+		return -EINVAL;
+	sc->sc_request = true;
+	sc->sc_method = sip_scan_method(p, sp);
+
+	v = sp + 1;
+	sp = memchr(v, ' ', eol - v);
+	if (!sp || sp == v || !sip_scan_eq(sp + 1, eol, "SIP/2.0"))
+		return -EINVAL;
+
+	return sip_scan_add(sc, SIP_HDR_REQ_URI, v, sp);
+}
+
+int sip_scan(const char *msg, uint16_t len, struct sip_scan *sc)
+{
+	const char *end = msg + len;
+	const char *p, *eol, *colon, *ne, *v, *ve;
+	long clen = -1;
+	uint8_t type;
+
+	sc->sc_msg = msg;
+	sc->sc_len = len;
+	sc->sc_body = 0;
+	sc->sc_status = 0;
+	sc->sc_method = SIP_METHOD_OTHER;
+	sc->sc_nhdrs = 0;
+	sc->sc_seen = 0;
+
+	eol = sip_scan_eol(msg, end);
+	if (!eol || sip_scan_start_line(sc, msg, eol))
+		return -EINVAL;
+
+	for (p = eol + 2; ; p = eol + 2) {
+		eol = sip_scan_eol(p, end);
+		if (!eol)
+			return -EINVAL;
+
+		/* Empty line ends the headers */
+		if (eol == p)
+			break;
+
+		/* Folded header lines are left to osip */
+		if (*p == ' ' || *p == '\t')
+			return -EINVAL;
+
+		colon = memchr(p, ':', eol - p);
+		if (!colon)
+			return -EINVAL;
+
+		for (ne = colon; ne > p && (ne[-1] == ' ' || ne[-1] == '\t');)
+			ne--;
+		type = sip_scan_hdr_type(p, ne - p);
+		if (type == SIP_HDR_OTHER)
+			continue;
+
+		for (v = colon + 1; v < eol && (*v == ' ' || *v == '\t');)
+			v++;
+		for (ve = eol; ve > v && (ve[-1] == ' ' || ve[-1] == '\t');)
+			ve--;
+
+		if (type == SIP_HDR_CSEQ) {
+			/* "1 INVITE" */
+			const char *m = memchr(v, ' ', ve - v);
+
+			if (!m)
+				return -EINVAL;
+			while (m < ve && *m == ' ')
+				m++;
+			if (!sc->sc_request)
+				sc->sc_method = sip_scan_method(m, ve);
+		} else if (type == SIP_HDR_CONTENT_LENGTH) {
+			const char *d;
+
+			if (v == ve || ve - v > 5)
+				return -EINVAL;
+			clen = 0;
+			for (d = v; d < ve; d++) {
+				if (!isdigit((unsigned char)*d))
+					return -EINVAL;
+				clen = clen * 10 + (*d - '0');
+			}
+		}
+
+		if (sip_scan_add(sc, type, v, ve))
+			return -EINVAL;
+	}
+
+	sc->sc_body = eol + 2 - msg;
+
+	if (clen >= 0 && clen != sc->sc_len - sc->sc_body)
+		return -EINVAL;
+
+	if ((sc->sc_seen & SIP_HDR_REQUIRED) != SIP_HDR_REQUIRED)
+		return -EINVAL;
+
+	return 0;
+}
+
+bool sip_scan_is_passive(const struct sip_scan *sc)
+{
+	if (sc->sc_body != sc->sc_len)
+		return false;
+
+	if (sc->sc_request)
+		return sc->sc_method != SIP_METHOD_INVITE &&
+			sc->sc_method != SIP_METHOD_BYE &&
+			sc->sc_method != SIP_METHOD_CANCEL;
+
+	/* Error responses expire the request */
+	if (sc->sc_status < 100 || sc->sc_status >= 300)
+		return false;
+
+	return !(sc->sc_method == SIP_METHOD_INVITE &&
+		 (sc->sc_status == 200 || sc->sc_status == 183));
+}
+
+/*
+ * The translated message.  Input up to so_in has been copied, or replaced.
+ */
+struct sip_scan_out {
+	const struct sip_scan	*so_sc;
+	const struct sip_nat	*so_sn;
+	char			*so_buf;
+	uint16_t		so_size;
+	uint16_t		so_len;
+	uint16_t		so_in;
+	uint16_t		so_edits;
+};
+
+static int sip_scan_out_copy(struct sip_scan_out *so, const char *p,
+			     size_t len)
+{
+	if (len > (size_t)(so->so_size - so->so_len))
+		return -ENOSPC;
+	memcpy(so->so_buf + so->so_len, p, len);
+	so->so_len += len;
+	return 0;
+}
+
+/* Replace the input from p to end with s */
+static int sip_scan_out_replace(struct sip_scan_out *so, const char *p,
+				const char *end, const char *s)
+{
+	const char *msg = so->so_sc->sc_msg;
+	int rc;
+
+	if (p < msg + so->so_in)
+		return -EINVAL;
+
+	rc = sip_scan_out_copy(so, msg + so->so_in, p - (msg + so->so_in));
+	if (!rc)
+		rc = sip_scan_out_copy(so, s, strlen(s));
+	if (rc)
+		return rc;
+
+	so->so_in = end - msg;
+	so->so_edits++;
+	return 0;
+}
+
+static bool sip_scan_is_host_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '.' || c == '-';
+}
+
+/*
+ * Translate a host, and its port if present, if the host is the original
+ * address.  A port is only replaced if it differs from the translation port.
+ */
+static int sip_scan_host(struct sip_scan_out *so, const char *h,
+			 const char *end)
+{
+	const struct sip_nat *sn = so->so_sn;
+	const char *he, *pe;
+	int rc;
+
+	for (he = h; he < end && sip_scan_is_host_char(*he);)
+		he++;
+	if (!sip_scan_eq(h, he, sn->sn_oaddr))
+		return 0;
+
+	rc = sip_scan_out_replace(so, h, he, sn->sn_taddr);
+	if (rc || he == end || *he != ':')
+		return rc;
+
+	for (pe = he + 1; pe < end && isdigit((unsigned char)*pe);)
+		pe++;
+	if (pe == he + 1 || sip_scan_eq(he + 1, pe, sn->sn_tport))
+		return 0;
+
+	return sip_scan_out_replace(so, he + 1, pe, sn->sn_tport);
+}
+
+static bool sip_scan_is_uri(const char *p, const char *start, const char *end)
+{
+	if (p > start && isalnum((unsigned char)p[-1]))
+		return false;
+	if (end - p >= 4 && !strncasecmp(p, "sip:", 4))
+		return true;
+	return end - p >= 5 && !strncasecmp(p, "sips:", 5);
+}
+
+/* Translate the host of every SIP URI in a header value */
+static int sip_scan_uris(struct sip_scan_out *so, const char *v,
+			 const char *end)
+{
+	const char *p = v;
+	const char *h, *stop;
+	bool quoted = false;
+	int rc;
+
+	while (p < end) {
+		if (quoted) {
+			if (*p == '\\')
+				p++;
+			else if (*p == '"')
+				quoted = false;
+			p++;
+			continue;
+		}
+		if (*p == '"') {
+			quoted = true;
+			p++;
+			continue;
+		}
+		if (!sip_scan_is_uri(p, v, end)) {
+			p++;
+			continue;
+		}
+
+		h = (const char *)memchr(p, ':', end - p) + 1;
+
+		/* Skip the user part, if present */
+		for (stop = h; stop < end && *stop != '@' && *stop != '>' &&
+			     *stop != ',' && *stop != ' ';)
+			stop++;
+		if (stop < end && *stop == '@')
+			h = stop + 1;
+
+		rc = sip_scan_host(so, h, end);
+		if (rc)
+			return rc;
+		p = h;
+	}
+	return 0;
+}
+
+/* "SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK776asdhds, SIP/2.0/UDP ..." */
+static int sip_scan_vias(struct sip_scan_out *so, const char *v,
+			 const char *end)
+{
+	const char *p = v;
+	int rc;
+
+	while (p < end) {
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+
+		rc = sip_scan_host(so, p, end);
+		if (rc)
+			return rc;
+
+		p = memchr(p, ',', end - p);
+		if (!p)
+			break;
+		p++;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+	}
+	return 0;
+}
+
+/* "f81d4fae-7dec-11d0-a765-00a0c91e6bf6@10.0.0.1" */
+static int sip_scan_call_id(struct sip_scan_out *so, const char *v,
+			    const char *end)
+{
+	const char *h = memchr(v, '@', end - v);
+
+	if (!h || !sip_scan_eq(h + 1, end, so->so_sn->sn_oaddr))
+		return 0;
+
+	return sip_scan_out_replace(so, h + 1, end, so->so_sn->sn_taddr);
+}
+
+/*
+ * Translate the first instance of the original address anywhere in the
+ * value, as for the headers that osip does not parse.
+ */
+static int sip_scan_generic(struct sip_scan_out *so, const char *v,
+			    const char *end, bool port)
+{
+	const struct sip_nat *sn = so->so_sn;
+	size_t olen = strlen(sn->sn_oaddr);
+	const char *p, *pp, *pe;
+	int rc;
+
+	p = sip_scan_find(v, end, sn->sn_oaddr, olen);
+	if (!p)
+		return 0;
+
+	rc = sip_scan_out_replace(so, p, p + olen, sn->sn_taddr);
+	p += olen;
+	if (rc || !port || p == end || *p != ':')
+		return rc;
+
+	pp = p + 1;
+	for (pe = pp; pe < end && pe - pp < 5 && isdigit((unsigned char)*pe);)
+		pe++;
+
+	/* A port with leading zeros is not replaced */
+	if (pe == pp || (*pp == '0' && pe - pp > 1) ||
+	    sip_scan_eq(pp, pe, sn->sn_tport))
+		return 0;
+
+	return sip_scan_out_replace(so, pp, pe, sn->sn_tport);
+}
+
+int sip_scan_translate(const struct sip_scan *sc, const struct sip_nat *sn,
+		       char *out, uint16_t size)
+{
+	struct sip_scan_out so = {
+		.so_sc = sc,
+		.so_sn = sn,
+		.so_buf = out,
+		.so_size = size,
+	};
+	const struct sip_scan_hdr *sh;
+	const char *v, *ve;
+	bool user_agent = false;
+	uint32_t hdrs;
+	unsigned int i;
+	int rc = 0;
+
+	if (sn->sn_type == sip_nat_snat)
+		hdrs = sip_scan_snat_hdrs[sc->sc_request][sn->sn_forw];
+	else if (sn->sn_type == sip_nat_dnat)
+		hdrs = sip_scan_dnat_hdrs[sc->sc_request][sn->sn_forw];
+	else
+		return 0;
+
+	if (!sn->sn_oaddr[0] || !sn->sn_taddr[0])
+		return 0;
+
+	for (i = 0; i < sc->sc_nhdrs && !rc; i++) {
+		sh = &sc->sc_hdrs[i];
+		if (!(hdrs & SIP_HDR_BIT(sh->sh_type)))
+			continue;
+
+		v = sc->sc_msg + sh->sh_off;
+		ve = v + sh->sh_len;
+
+		switch (sh->sh_type) {
+		case SIP_HDR_REQ_URI:
+		case SIP_HDR_FROM:
+		case SIP_HDR_TO:
+		case SIP_HDR_CONTACT:
+		case SIP_HDR_ROUTE:
+		case SIP_HDR_RECORD_ROUTE:
+			rc = sip_scan_uris(&so, v, ve);
+			break;
+		case SIP_HDR_VIA:
+			rc = sip_scan_vias(&so, v, ve);
+			break;
+		case SIP_HDR_CALL_ID:
+			rc = sip_scan_call_id(&so, v, ve);
+			break;
+		case SIP_HDR_USER_AGENT:
+			/* Only the first User-Agent */
+			if (!user_agent)
+				rc = sip_scan_generic(&so, v, ve, false);
+			user_agent = true;
+			break;
+		case SIP_HDR_P_ASSERTED_ID:
+		case SIP_HDR_P_PREFERRED_ID:
+			rc = sip_scan_generic(&so, v, ve, true);
+			break;
+		}
+	}
+	if (rc)
+		return rc;
+
+	if (!so.so_edits)
+		return 0;
+
+	rc = sip_scan_out_copy(&so, sc->sc_msg + so.so_in,
+			       sc->sc_len - so.so_in);
+	if (rc)
+		return rc;
+
+	return so.so_len;
+}
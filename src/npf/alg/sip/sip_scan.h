@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef _SIP_SCAN_H_
+#define _SIP_SCAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sip_nat;
+
+/*
+ * SIP message scanner.
+ *
+ * Finds the start line and the headers of a SIP message in the payload
+ * buffer, without copying or allocating anything.  Only the headers the
+ * ALG translates or checks are recorded.  Messages that the scanner does
+ * not understand, e.g. those with folded header lines, are left to the
+ * osip parser.
+ */
+
+/* Most headers of interest recorded for one message */
+#define SIP_SCAN_MAX_HDRS	48
+
+enum sip_scan_hdr_type {
+	SIP_HDR_REQ_URI,	/* Request-URI in the start line */
+	SIP_HDR_VIA,
+	SIP_HDR_FROM,
+	SIP_HDR_TO,
+	SIP_HDR_CALL_ID,
+	SIP_HDR_CSEQ,
+	SIP_HDR_CONTACT,
+	SIP_HDR_ROUTE,
+	SIP_HDR_RECORD_ROUTE,
+	SIP_HDR_USER_AGENT,
+	SIP_HDR_P_ASSERTED_ID,
+	SIP_HDR_P_PREFERRED_ID,
+	SIP_HDR_CONTENT_LENGTH,
+	SIP_HDR_OTHER,
+};
+
+#define SIP_HDR_BIT(t)		(1u << (t))
+
+/* Headers that must be present, as checked by sip_alg_verify */
+#define SIP_HDR_REQUIRED	(SIP_HDR_BIT(SIP_HDR_VIA) |		\
+				 SIP_HDR_BIT(SIP_HDR_FROM) |		\
+				 SIP_HDR_BIT(SIP_HDR_TO) |		\
+				 SIP_HDR_BIT(SIP_HDR_CALL_ID) |		\
+				 SIP_HDR_BIT(SIP_HDR_CSEQ))
+
+enum sip_scan_method {
+	SIP_METHOD_OTHER,
+	SIP_METHOD_INVITE,
+	SIP_METHOD_ACK,
+	SIP_METHOD_BYE,
+	SIP_METHOD_CANCEL,
+};
+
+/* Offset and length of a header value within the message */
+struct sip_scan_hdr {
+	uint16_t	sh_off;
+	uint16_t	sh_len;
+	uint8_t		sh_type;
+};
+
+struct sip_scan {
+	const char		*sc_msg;
+	uint16_t		sc_len;
+	uint16_t		sc_body;	/* offset of message body */
+	uint16_t		sc_status;	/* response status code */
+	bool			sc_request;
+	uint8_t			sc_method;	/* of request, or CSeq */
+	uint8_t			sc_nhdrs;
+	uint32_t		sc_seen;	/* SIP_HDR_BIT of each type */
+	struct sip_scan_hdr	sc_hdrs[SIP_SCAN_MAX_HDRS];
+};
+
+/*
+ * Scan a SIP message.  Returns 0 if the message was understood, and the
+ * whole message is present.
+ */
+int sip_scan(const char *msg, uint16_t len, struct sip_scan *sc);
+
+/*
+ * Does the ALG only need to translate the headers of this message?  True
+ * for messages without a body that do not start, answer or end a call.
+ */
+bool sip_scan_is_passive(const struct sip_scan *sc);
+
+/*
+ * Translate the headers of a scanned message into out, using the same
+ * rules as the osip path.  Returns the new length, 0 if nothing needs to
+ * be translated, or -errno if the message must be left to osip.
+ */
+int sip_scan_translate(const struct sip_scan *sc, const struct sip_nat *sn,
+		       char *out, uint16_t size);
+
+#endif /* _SIP_SCAN_H_ */
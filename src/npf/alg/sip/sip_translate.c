@@ -805,13 +805,45 @@ done:
 }
 
 /*
- * sip_init_nat() - Init the 'nat' params for this request
+ * sip_alg_translate_buf() - Translate a message with osip
+ *
+ * Parse, translate and serialise a NUL terminated message as the osip path
+ * does, returning a string to be freed with osip_free.  With an inspect
+ * sn, this only gives the message as osip serialises it.
  */
-void sip_init_nat(struct sip_alg_request *sr, bool forw,
+/* For SIP UT */
+int sip_alg_translate_buf(const struct npf_alg *sip, const char *payload,
+			  uint16_t plen, const struct sip_nat *sn,
+			  char **out, size_t *sz)
+{
+	struct sip_alg_request *sr, *tsr;
+	int rc;
+
+	sr = sip_alg_parse_buf(sip, payload, plen, 0);
+	if (!sr)
+		return -EINVAL;
+
+	sr->sr_nat = *sn;
+
+	rc = sip_alg_translate_message(sip, sr, &tsr);
+	if (!rc) {
+		osip_message_force_update(tsr->sr_sip);
+		if (osip_message_to_str(tsr->sr_sip, out, sz))
+			rc = -ENOMEM;
+		sip_alg_request_free(sip, tsr);
+	}
+	sip_alg_request_free(sip, sr);
+
+	return rc;
+}
+
+/*
+ * sip_nat_init() - Init the 'nat' params for a message
+ */
+void sip_nat_init(struct sip_nat *sn, bool forw,
 		  const npf_addr_t *taddr, const npf_addr_t *oaddr,
 		  uint8_t alen, in_port_t tport, const int di)
 {
-	struct sip_nat *sn = &sr->sr_nat;
 	int rc;
 
 	/* Port and addr from nat struct for CNTL session */
@@ -878,6 +910,46 @@ done:
 	return rc;
 }
 
+/*
+ * sip_alg_translate_fast() - Translate a message without using osip
+ *
+ * Registrations, keepalives and the like only need their headers
+ * translated, and do not change any call state.  Scan these in place, and
+ * write the translated message straight back to the packet.  Returns
+ * -EAGAIN if the message must be handled by the osip path.
+ */
+static int sip_alg_translate_fast(npf_session_t *se, npf_cache_t *npc,
+				  struct rte_mbuf *nbuf, const char *payload,
+				  uint16_t plen, const struct sip_nat *sn,
+				  const int di)
+{
+	struct sip_scan sc;
+	char out[SIP_MESSAGE_MAX_LENGTH];
+	int len;
+
+	/* Truncated payloads are left to osip */
+	if (plen != npf_payload_len(npc))
+		return -EAGAIN;
+
+	if (sip_scan(payload, plen, &sc) || !sip_scan_is_passive(&sc))
+		return -EAGAIN;
+
+	if (sc.sc_request && !sip_request_is_passive(se, sn))
+		return -EAGAIN;
+
+	len = sip_scan_translate(&sc, sn, out, sizeof(out));
+	if (len < 0)
+		return -EAGAIN;
+
+	npc->npc_alg_flags = sc.sc_request ? SIP_NPC_REQUEST :
+		SIP_NPC_RESPONSE;
+
+	if (!len)
+		return 0;
+
+	return npf_payload_update(se, npc, nbuf, out, di, len);
+}
+
 /*
  * sip_alg_translate_packet()
  */
@@ -891,23 +963,22 @@ int sip_alg_translate_packet(npf_session_t *se, npf_cache_t *npc,
 	in_port_t oport;
 	bool forw;
 	struct sip_alg_request *sr;
+	struct sip_nat sn = { 0 };
+	char payload[SIP_MESSAGE_MAX_LENGTH + 1];
+	uint16_t plen;
+	int rc;
 
 	/* Don't manipulate (TCP) packets w/o data */
 	if (!npf_payload_len(npc))
 		return 0;
 
-       /*
-	* Parsed msg may have been placed into session provate data by tuple
-	* inspect
-	*/
-	sr = sip_alg_parse(sip, npc, npf_session_get_if_index(se), nbuf);
-	if (!sr)
+	plen = npf_payload_fetch(npc, nbuf, payload,
+			SIP_MSG_MIN_LENGTH, SIP_MESSAGE_MAX_LENGTH);
+	if (!plen)
 		return -EINVAL;
 
-	if (sip_alg_verify(sr)) {
-		sip_alg_request_free(sip, sr);
-		return -EINVAL;
-	}
+	/* Make the payload a string */
+	payload[plen] = '\0';
 
 	(void) npf_session_retnat(se, di, &forw);
 
@@ -934,7 +1005,23 @@ int sip_alg_translate_packet(npf_session_t *se, npf_cache_t *npc,
 	    npf_alg_session_test_flag(se, SIP_ALG_REVERSE))
 		forw = !forw;
 
-	sip_init_nat(sr, forw, &taddr, &oaddr, npc->npc_alen, tport, di);
+	sip_nat_init(&sn, forw, &taddr, &oaddr, npc->npc_alen, tport, di);
+
+	rc = sip_alg_translate_fast(se, npc, nbuf, payload, plen, &sn, di);
+	if (rc != -EAGAIN)
+		return rc;
+
+	sr = sip_alg_parse_buf(sip, payload, plen,
+			       npf_session_get_if_index(se));
+	if (!sr)
+		return -EINVAL;
+
+	if (sip_alg_verify(sr)) {
+		sip_alg_request_free(sip, sr);
+		return -EINVAL;
+	}
+
+	sr->sr_nat = sn;
 
 	return sip_alg_manage_packet(se, sr, npc, nbuf, ns);
 }
@@ -15,6 +15,7 @@
 
 struct sip_alg_request;
 struct sip_alg_media;
+struct sip_nat;
 struct rte_mbuf;
 
 /*
@@ -28,7 +29,14 @@ int sip_alg_translate_media(struct sip_alg_request *sr,
  */
 void sip_alg_update_session_media(struct sip_alg_request *sr);
 
-void sip_init_nat(struct sip_alg_request *sr, bool forw,
+/*
+ * Translate a message with osip
+ */
+int sip_alg_translate_buf(const struct npf_alg *sip, const char *payload,
+			  uint16_t plen, const struct sip_nat *sn,
+			  char **out, size_t *sz);
+
+void sip_nat_init(struct sip_nat *sn, bool forw,
 		  const npf_addr_t *taddr, const npf_addr_t *oaddr,
 		  uint8_t alen, in_port_t tport, const int di);
 
@@ -468,6 +468,9 @@ apm_block_create(struct apm *apm, uint16_t block)
 	apm->apm_blocks[block] = pb;
 	apm->apm_blocks_used++;
 
+	nat_pool_addr_usage(apm->apm_np, apm->apm_addr, apm->apm_blocks_used,
+			    apm->apm_nblocks);
+
 	if (apm->apm_blocks_used >= apm->apm_nblocks)
 		apm_pb_full(apm);
 
@@ -504,6 +507,9 @@ void apm_block_destroy(struct apm_port_block *pb)
 	apm->apm_blocks[pb->pb_block] = NULL;
 	apm->apm_blocks_used--;
 
+	nat_pool_addr_usage(apm->apm_np, apm->apm_addr, apm->apm_blocks_used,
+			    apm->apm_nblocks);
+
 	apm_pb_available(apm);
 	cgn_alloc_pool_available(apm->apm_np, apm);
 
@@ -26,10 +26,16 @@
  * Event config
  * -----------------------------------------------
  *
- * cgn-cfg events rte_log|protobuf <type> enable|disable
+ * cgn-cfg events rte_log|protobuf|ipfix <type> enable|disable
  * cgn-cfg events protobuf <type> hwm <integer>
+ * cgn-cfg events ipfix collector <addr> [<port>]
+ * cgn-cfg events ipfix file <path>
+ * cgn-cfg events ipfix delete
  * cgn-cfg events core [<core-num>]
  *
+ * Only ipfix batches events off the forwarding threads.  rte_log and
+ * protobuf emit each event from the thread that logs it.
+ *
  * -----------------------------------------------
  * Other config
  * -----------------------------------------------
@@ -38,7 +44,9 @@
  * cgn-cfg snat-alg-bypass {on | off}
  */
 
+#include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <linux/if.h>
 
@@ -59,6 +67,7 @@
 #include "npf/cgnat/cgn_session.h"
 #include "npf/cgnat/cgn_cmd_cfg.h"
 #include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
 #include "npf/cgnat/cgn_log_protobuf_zmq.h"
 
 
@@ -597,6 +606,123 @@ static int cgn_events_cfg_protobuf(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+/*
+ * cgn-cfg events ipfix <type> enable|disable
+ * cgn-cfg events ipfix collector <addr> [<port>]
+ * cgn-cfg events ipfix file <path>
+ * cgn-cfg events ipfix delete
+ *
+ * <type> is one of session, port-block-allocation, subscriber,
+ * or resource-constraint
+ */
+static int cgn_events_cfg_ipfix(FILE *f, int argc, char **argv)
+{
+	const char *ltype_str;
+	enum cgn_log_type ltype;
+	int rc;
+
+	if (argc < 4) {
+		if (f)
+			fprintf(f, "%s: need at least 4 fields", __func__);
+		return -1;
+	}
+
+	if (strcmp(argv[3], "collector") == 0) {
+		struct in_addr addr;
+		int port = 0;
+
+		if (argc < 5 || inet_pton(AF_INET, argv[4], &addr) != 1) {
+			if (f)
+				fprintf(f, "%s: invalid collector address",
+					__func__);
+			return -1;
+		}
+		if (argc >= 6) {
+			port = cgn_arg_to_int(argv[5]);
+			if (port <= 0 || port > USHRT_MAX) {
+				if (f)
+					fprintf(f, "%s: invalid collector "
+						"port %s", __func__, argv[5]);
+				return -1;
+			}
+		}
+
+		rc = cgn_ipfix_set_collector(addr.s_addr, port);
+		if (rc < 0) {
+			if (f)
+				fprintf(f, "%s: cgn_ipfix_set_collector "
+					"failed (%s)", __func__,
+					strerror(-rc));
+			return -1;
+		}
+		return 0;
+	}
+
+	if (strcmp(argv[3], "file") == 0) {
+		if (argc < 5) {
+			if (f)
+				fprintf(f, "%s: missing file name", __func__);
+			return -1;
+		}
+
+		rc = cgn_ipfix_set_file(argv[4]);
+		if (rc < 0) {
+			if (f)
+				fprintf(f, "%s: cgn_ipfix_set_file failed "
+					"for %s (%s)", __func__, argv[4],
+					strerror(-rc));
+			return -1;
+		}
+		return 0;
+	}
+
+	if (strcmp(argv[3], "delete") == 0) {
+		cgn_ipfix_clear_dest();
+		return 0;
+	}
+
+	if (argc < 5) {
+		if (f)
+			fprintf(f, "%s: need at least 5 fields", __func__);
+		return -1;
+	}
+
+	ltype_str = argv[3];
+
+	rc = cgn_get_log_type(ltype_str, &ltype);
+	if (rc < 0) {
+		if (f)
+			fprintf(f, "%s: unknown event type %s", __func__,
+				ltype_str);
+		return -1;
+	}
+
+	if (strcmp(argv[4], "enable") == 0) {
+		rc = cgn_log_enable_handler(ltype, "ipfix");
+		if (rc < 0 && rc != -EEXIST) {
+			if (f)
+				fprintf(f, "%s: cgn_log_enable_handler failed "
+					"for type %s", __func__, ltype_str);
+			return -1;
+		}
+	} else if (strcmp(argv[4], "disable") == 0) {
+		rc = cgn_log_disable_handler(ltype, "ipfix");
+		if (rc < 0 && rc != -ENOENT) {
+			if (f)
+				fprintf(f, "%s: cgn_log_disable_handler failed "
+					"for type %s", __func__, ltype_str);
+			return -1;
+		}
+	} else {
+		if (f)
+			fprintf(f, "%s: unexpected value %s for type %s",
+				__func__, argv[4], ltype_str);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * cgn-cfg events core [<core-num>]
  *
@@ -639,7 +765,7 @@ static int cgn_events_cfg_core(FILE *f, int argc, char **argv)
 }
 
 /*
- * cgn-cfg events rte_log|protobuf
+ * cgn-cfg events rte_log|protobuf|ipfix|core
  */
 static int cgn_events_cfg(FILE *f, int argc, char **argv)
 {
@@ -654,6 +780,9 @@ static int cgn_events_cfg(FILE *f, int argc, char **argv)
 	else if (strcmp(argv[2], "protobuf") == 0)
 		rc = cgn_events_cfg_protobuf(f, argc, argv);
 
+	else if (strcmp(argv[2], "ipfix") == 0)
+		rc = cgn_events_cfg_ipfix(f, argc, argv);
+
 	else if (strcmp(argv[2], "core") == 0)
 		rc = cgn_events_cfg_core(f, argc, argv);
 
@@ -664,8 +793,8 @@ static int cgn_events_cfg(FILE *f, int argc, char **argv)
 
 usage:
 	if (f)
-		fprintf(f, "%s: cgn-cfg events {rte_log|protobuf|core} ... ",
-			__func__);
+		fprintf(f, "%s: cgn-cfg events "
+			"{rte_log|protobuf|ipfix|core} ... ", __func__);
 
 	return -1;
 }
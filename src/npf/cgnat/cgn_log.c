@@ -50,6 +50,7 @@ static const struct cgn_log_format_info {
 } cgn_log_format_info[CGN_LOG_FORMAT_COUNT] = {
 	[CGN_LOG_FORMAT_RTE_LOG]	= { .name = "rte_log", },
 	[CGN_LOG_FORMAT_PROTOBUF]	= { .name = "protobuf", },
+	[CGN_LOG_FORMAT_IPFIX]		= { .name = "ipfix", },
 };
 
 const char *cgn_get_log_format_name(enum cgn_log_format format)
@@ -73,11 +74,13 @@ int cgn_get_log_format(const char *name, enum cgn_log_format *format)
 	return -ENOENT;
 }
 
-extern const struct cgn_log_fns cgn_rte_log_fns, cgn_protobuf_fns;
+extern const struct cgn_log_fns cgn_rte_log_fns, cgn_protobuf_fns,
+	cgn_ipfix_fns;
 
 static const struct cgn_log_fns *cgn_log_fns[] = {
 	&cgn_rte_log_fns,
 	&cgn_protobuf_fns,
+	&cgn_ipfix_fns,
 };
 
 struct cgn_log_active_fns {
@@ -268,6 +271,9 @@ void cgn_log_disable_all_handlers(void)
 		while (*afnsp != NULL) {
 			struct cgn_log_active_fns *old = *afnsp;
 			rcu_assign_pointer(*afnsp, old->cla_next);
+			if (old->cla_fns->cl_fini)
+				old->cla_fns->cl_fini(old->cla_ltype,
+						      old->cla_fns);
 			call_rcu(&old->rcu, cgn_log_handler_reclaim);
 		}
 	}
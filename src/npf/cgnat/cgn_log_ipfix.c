@@ -0,0 +1,896 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/**
+ * @file cgn_log_ipfix.c - cgnat logging as IPFIX NAT events (RFC 8158)
+ *
+ * An event is encoded into a fixed size record by the thread that logs it,
+ * and queued on that lcore's ring.  Logging an event takes no lock and does
+ * no allocation or I/O.  Threads that are not EAL lcores share one ring
+ * under a lock.
+ *
+ * A dedicated exporter thread drains the rings and packs the records into
+ * IPFIX messages, which are sent to a UDP collector or appended to a file.
+ * Templates are sent with the first message to a new destination, and then
+ * periodically since a UDP collector may have restarted.  Events are
+ * dropped and counted if an lcore's ring is full.
+ *
+ * This is the only handler that batches events.  The rte_log and protobuf
+ * handlers still format and emit each event from the thread that logs it,
+ * one message per event, so their consumers see an unchanged format.  Use
+ * this handler where the event rate makes that cost matter on the
+ * forwarding lcores.
+ */
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_spinlock.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "json_writer.h"
+#include "soft_ticks.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_log.h"
+
+#include "npf/cgnat/cgn.h"
+#include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
+#include "npf/cgnat/cgn_session.h"
+#include "npf/cgnat/cgn_sess2.h"
+
+#define CGN_IPFIX_VERSION		10
+#define CGN_IPFIX_SET_TEMPLATE		2
+#define CGN_IPFIX_DOMAIN		1
+
+/* Resend templates this often, in milliseconds */
+#define CGN_IPFIX_TMPL_REFRESH_MS	(60 * 1000)
+
+/* Exporter sleep when there is nothing to send, in microseconds */
+#define CGN_IPFIX_IDLE_US		10000
+
+/* natEvent values, RFC 8158 */
+#define NAT_EVENT_SESS_CREATE		4
+#define NAT_EVENT_SESS_DELETE		5
+#define NAT_EVENT_PORTS_EXHAUSTED	12
+#define NAT_EVENT_BINDING_CREATE	14
+#define NAT_EVENT_BINDING_DELETE	15
+#define NAT_EVENT_PB_ALLOC		16
+#define NAT_EVENT_PB_DEALLOC		17
+
+/* IANA information elements */
+#define IPFIX_IE_PROTO			4
+#define IPFIX_IE_SRC_PORT		7
+#define IPFIX_IE_SRC_ADDR		8
+#define IPFIX_IE_DST_PORT		11
+#define IPFIX_IE_DST_ADDR		12
+#define IPFIX_IE_POST_NAT_SRC_ADDR	225
+#define IPFIX_IE_POST_NAPT_SRC_PORT	227
+#define IPFIX_IE_NAT_EVENT		230
+#define IPFIX_IE_OBS_TIME_MS		323
+#define IPFIX_IE_PORT_RANGE_START	361
+#define IPFIX_IE_PORT_RANGE_END		362
+
+enum cgn_ipfix_tmpl_id {
+	CGN_IPFIX_TMPL_SESSION,
+	CGN_IPFIX_TMPL_PORT_BLOCK,
+	CGN_IPFIX_TMPL_BINDING,
+	CGN_IPFIX_TMPL_EXHAUSTED,
+
+	CGN_IPFIX_TMPL_COUNT
+};
+
+struct cgn_ipfix_field {
+	uint16_t	ie;
+	uint16_t	len;
+};
+
+struct cgn_ipfix_tmpl {
+	uint16_t			id;
+	uint16_t			nfields;
+	const struct cgn_ipfix_field	*fields;
+	uint16_t			rec_len;
+};
+
+static const struct cgn_ipfix_field cgn_ipfix_sess_fields[] = {
+	{ IPFIX_IE_OBS_TIME_MS,		8 },
+	{ IPFIX_IE_NAT_EVENT,		1 },
+	{ IPFIX_IE_PROTO,		1 },
+	{ IPFIX_IE_SRC_ADDR,		4 },
+	{ IPFIX_IE_POST_NAT_SRC_ADDR,	4 },
+	{ IPFIX_IE_DST_ADDR,		4 },
+	{ IPFIX_IE_SRC_PORT,		2 },
+	{ IPFIX_IE_POST_NAPT_SRC_PORT,	2 },
+	{ IPFIX_IE_DST_PORT,		2 },
+};
+
+static const struct cgn_ipfix_field cgn_ipfix_pb_fields[] = {
+	{ IPFIX_IE_OBS_TIME_MS,		8 },
+	{ IPFIX_IE_NAT_EVENT,		1 },
+	{ IPFIX_IE_SRC_ADDR,		4 },
+	{ IPFIX_IE_POST_NAT_SRC_ADDR,	4 },
+	{ IPFIX_IE_PORT_RANGE_START,	2 },
+	{ IPFIX_IE_PORT_RANGE_END,	2 },
+};
+
+static const struct cgn_ipfix_field cgn_ipfix_binding_fields[] = {
+	{ IPFIX_IE_OBS_TIME_MS,		8 },
+	{ IPFIX_IE_NAT_EVENT,		1 },
+	{ IPFIX_IE_SRC_ADDR,		4 },
+};
+
+static const struct cgn_ipfix_field cgn_ipfix_exhausted_fields[] = {
+	{ IPFIX_IE_OBS_TIME_MS,		8 },
+	{ IPFIX_IE_NAT_EVENT,		1 },
+	{ IPFIX_IE_POST_NAT_SRC_ADDR,	4 },
+};
+
+#define CGN_IPFIX_TMPL(_id, _f, _len) \
+	{ .id = (_id), .nfields = ARRAY_SIZE(_f), .fields = (_f), \
+	  .rec_len = (_len) }
+
+static const struct cgn_ipfix_tmpl cgn_ipfix_tmpls[CGN_IPFIX_TMPL_COUNT] = {
+	[CGN_IPFIX_TMPL_SESSION] =
+		CGN_IPFIX_TMPL(256, cgn_ipfix_sess_fields, 28),
+	[CGN_IPFIX_TMPL_PORT_BLOCK] =
+		CGN_IPFIX_TMPL(257, cgn_ipfix_pb_fields, 21),
+	[CGN_IPFIX_TMPL_BINDING] =
+		CGN_IPFIX_TMPL(258, cgn_ipfix_binding_fields, 13),
+	[CGN_IPFIX_TMPL_EXHAUSTED] =
+		CGN_IPFIX_TMPL(259, cgn_ipfix_exhausted_fields, 13),
+};
+
+/* An event as queued by the logging thread.  Addresses in host order. */
+struct cgn_ipfix_rec {
+	uint64_t	ir_time_ms;
+	uint32_t	ir_src_addr;
+	uint32_t	ir_nat_addr;
+	uint32_t	ir_dst_addr;
+	uint16_t	ir_src_port;
+	uint16_t	ir_nat_port;
+	uint16_t	ir_dst_port;
+	uint16_t	ir_port_start;
+	uint16_t	ir_port_end;
+	uint8_t		ir_tmpl;
+	uint8_t		ir_event;
+	uint8_t		ir_proto;
+};
+
+/*
+ * Single producer, single consumer ring.  prod is only written by the
+ * lcore logging events, and cons only by the exporter.
+ */
+struct cgn_ipfix_ring {
+	uint32_t		prod;
+	uint64_t		enqueued;
+	uint64_t		dropped;
+	rte_spinlock_t		lock;		/* shared ring only */
+	uint32_t		cons __rte_cache_aligned;
+	struct cgn_ipfix_rec	recs[CGN_IPFIX_RING_SZ] __rte_cache_aligned;
+};
+
+static_assert((CGN_IPFIX_RING_SZ & (CGN_IPFIX_RING_SZ - 1)) == 0,
+	      "ring size must be a power of 2");
+
+enum cgn_ipfix_dest_type {
+	CGN_IPFIX_DEST_NONE,
+	CGN_IPFIX_DEST_UDP,
+	CGN_IPFIX_DEST_FILE,
+};
+
+/* Exporter state.  Only the exporter thread writes this. */
+struct cgn_ipfix_exp {
+	uint8_t		buf[CGN_IPFIX_MSG_MAX];
+	uint16_t	len;
+	uint16_t	set_off;	/* of open data set, or 0 */
+	uint16_t	set_id;
+	uint32_t	nrecs;		/* in message */
+	bool		has_tmpl;	/* message has the templates */
+	uint32_t	seq;
+	uint64_t	tmpl_sent_ms;
+	uint64_t	msgs;
+	uint64_t	records;
+	uint64_t	bytes;
+	uint64_t	templates;
+	uint64_t	send_fails;
+	uint64_t	no_dest;
+};
+
+/* One ring per lcore, with the shared ring last */
+static struct cgn_ipfix_ring *cgn_ipfix_rings;
+static unsigned int cgn_ipfix_nrings;
+
+static struct cgn_ipfix_exp cgn_ipfix_exp;
+
+/* Number of log types the ipfix handler is enabled for */
+static unsigned int cgn_ipfix_users;
+static bool cgn_ipfix_running;
+static pthread_t cgn_ipfix_pthread;
+
+/* Destination, protected by cgn_ipfix_dest_lock */
+static pthread_mutex_t cgn_ipfix_dest_lock = PTHREAD_MUTEX_INITIALIZER;
+static enum cgn_ipfix_dest_type cgn_ipfix_dest_type;
+static int cgn_ipfix_fd = -1;
+static struct sockaddr_in cgn_ipfix_collector;
+static char *cgn_ipfix_path;
+static bool cgn_ipfix_tmpl_due;
+
+static uint64_t cgn_ipfix_now_ms(void)
+{
+	return cgn_ticks2timestamp(soft_ticks) / 1000;
+}
+
+static void cgn_ipfix_enqueue(const struct cgn_ipfix_rec *rec)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct cgn_ipfix_ring *ring;
+	bool shared;
+	uint32_t prod;
+
+	shared = lcore_id >= cgn_ipfix_nrings - 1;
+	ring = &cgn_ipfix_rings[shared ? cgn_ipfix_nrings - 1 : lcore_id];
+
+	if (shared)
+		rte_spinlock_lock(&ring->lock);
+
+	prod = ring->prod;
+	if (unlikely(prod - CMM_LOAD_SHARED(ring->cons) >=
+		     CGN_IPFIX_RING_SZ)) {
+		ring->dropped++;
+	} else {
+		ring->recs[prod & (CGN_IPFIX_RING_SZ - 1)] = *rec;
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(ring->prod, prod + 1);
+		ring->enqueued++;
+	}
+
+	if (shared)
+		rte_spinlock_unlock(&ring->lock);
+}
+
+static void cl_ipfix_sess(struct cgn_sess2 *s2, uint8_t event,
+			  uint64_t time_us)
+{
+	struct cgn_session *cse = cgn_sess2_session(s2);
+	struct cgn_ipfix_rec rec = {
+		.ir_tmpl = CGN_IPFIX_TMPL_SESSION,
+		.ir_event = event,
+		.ir_time_ms = time_us / 1000,
+		.ir_proto = cgn_sess2_ipproto(s2),
+		.ir_src_addr = ntohl(cgn_session_forw_addr(cse)),
+		.ir_nat_addr = ntohl(cgn_session_back_addr(cse)),
+		.ir_dst_addr = ntohl(cgn_sess2_addr(s2)),
+		.ir_src_port = ntohs(cgn_session_forw_id(cse)),
+		.ir_nat_port = ntohs(cgn_session_back_id(cse)),
+		.ir_dst_port = ntohs(cgn_sess2_port(s2)),
+	};
+
+	cgn_ipfix_enqueue(&rec);
+}
+
+/*
+ * Log session creation.  The session start time is in microseconds.
+ */
+static void cl_ipfix_sess_start(struct cgn_sess2 *s2)
+{
+	cl_ipfix_sess(s2, NAT_EVENT_SESS_CREATE, cgn_sess2_start_time(s2));
+}
+
+static void cl_ipfix_sess_end(struct cgn_sess2 *s2, uint64_t end_time)
+{
+	cl_ipfix_sess(s2, NAT_EVENT_SESS_DELETE, end_time);
+}
+
+static void cl_ipfix_pb(uint8_t event, uint32_t pvt_addr, uint32_t pub_addr,
+			uint16_t port_start, uint16_t port_end,
+			uint64_t time_ticks)
+{
+	struct cgn_ipfix_rec rec = {
+		.ir_tmpl = CGN_IPFIX_TMPL_PORT_BLOCK,
+		.ir_event = event,
+		.ir_time_ms = cgn_ticks2timestamp(time_ticks) / 1000,
+		.ir_src_addr = pvt_addr,
+		.ir_nat_addr = pub_addr,
+		.ir_port_start = port_start,
+		.ir_port_end = port_end,
+	};
+
+	cgn_ipfix_enqueue(&rec);
+}
+
+static void cl_ipfix_pb_alloc(uint32_t pvt_addr, uint32_t pub_addr,
+			      uint16_t port_start, uint16_t port_end,
+			      uint64_t start_time,
+			      const char *policy_name __unused,
+			      const char *pool_name __unused)
+{
+	cl_ipfix_pb(NAT_EVENT_PB_ALLOC, pvt_addr, pub_addr,
+		    port_start, port_end, start_time);
+}
+
+static void cl_ipfix_pb_release(uint32_t pvt_addr, uint32_t pub_addr,
+				uint16_t port_start, uint16_t port_end,
+				uint64_t start_time __unused,
+				uint64_t end_time,
+				const char *policy_name __unused,
+				const char *pool_name __unused)
+{
+	cl_ipfix_pb(NAT_EVENT_PB_DEALLOC, pvt_addr, pub_addr,
+		    port_start, port_end, end_time);
+}
+
+static void cl_ipfix_subscriber_start(uint32_t addr)
+{
+	struct cgn_ipfix_rec rec = {
+		.ir_tmpl = CGN_IPFIX_TMPL_BINDING,
+		.ir_event = NAT_EVENT_BINDING_CREATE,
+		.ir_time_ms = cgn_ipfix_now_ms(),
+		.ir_src_addr = addr,
+	};
+
+	cgn_ipfix_enqueue(&rec);
+}
+
+static void cl_ipfix_subscriber_end(uint32_t addr,
+				    uint64_t start_time __unused,
+				    uint64_t end_time,
+				    uint64_t pkts_out __unused,
+				    uint64_t bytes_out __unused,
+				    uint64_t pkts_in __unused,
+				    uint64_t bytes_in __unused,
+				    uint64_t sessions __unused)
+{
+	struct cgn_ipfix_rec rec = {
+		.ir_tmpl = CGN_IPFIX_TMPL_BINDING,
+		.ir_event = NAT_EVENT_BINDING_DELETE,
+		.ir_time_ms = cgn_ticks2timestamp(end_time) / 1000,
+		.ir_src_addr = addr,
+	};
+
+	cgn_ipfix_enqueue(&rec);
+}
+
+/*
+ * Only running out of ports on a public address has a natEvent.  The other
+ * resource constraints are left to the rte_log and protobuf handlers.
+ */
+static void cl_ipfix_resource_public_pb(enum cgn_resource_type type,
+					uint32_t addr,
+					uint16_t blocks_used __unused,
+					uint16_t nblocks __unused)
+{
+	struct cgn_ipfix_rec rec = {
+		.ir_tmpl = CGN_IPFIX_TMPL_EXHAUSTED,
+		.ir_event = NAT_EVENT_PORTS_EXHAUSTED,
+		.ir_time_ms = cgn_ipfix_now_ms(),
+		.ir_nat_addr = addr,
+	};
+
+	if (type != CGN_RESOURCE_FULL)
+		return;
+
+	cgn_ipfix_enqueue(&rec);
+}
+
+static uint8_t *cgn_ipfix_put16(uint8_t *p, uint16_t v)
+{
+	v = htons(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t *cgn_ipfix_put32(uint8_t *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t *cgn_ipfix_put64(uint8_t *p, uint64_t v)
+{
+	v = rte_cpu_to_be_64(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t *cgn_ipfix_put_field(uint8_t *p, uint16_t ie,
+				    const struct cgn_ipfix_rec *rec)
+{
+	switch (ie) {
+	case IPFIX_IE_OBS_TIME_MS:
+		return cgn_ipfix_put64(p, rec->ir_time_ms);
+	case IPFIX_IE_NAT_EVENT:
+		*p = rec->ir_event;
+		return p + 1;
+	case IPFIX_IE_PROTO:
+		*p = rec->ir_proto;
+		return p + 1;
+	case IPFIX_IE_SRC_ADDR:
+		return cgn_ipfix_put32(p, rec->ir_src_addr);
+	case IPFIX_IE_POST_NAT_SRC_ADDR:
+		return cgn_ipfix_put32(p, rec->ir_nat_addr);
+	case IPFIX_IE_DST_ADDR:
+		return cgn_ipfix_put32(p, rec->ir_dst_addr);
+	case IPFIX_IE_SRC_PORT:
+		return cgn_ipfix_put16(p, rec->ir_src_port);
+	case IPFIX_IE_POST_NAPT_SRC_PORT:
+		return cgn_ipfix_put16(p, rec->ir_nat_port);
+	case IPFIX_IE_DST_PORT:
+		return cgn_ipfix_put16(p, rec->ir_dst_port);
+	case IPFIX_IE_PORT_RANGE_START:
+		return cgn_ipfix_put16(p, rec->ir_port_start);
+	case IPFIX_IE_PORT_RANGE_END:
+		return cgn_ipfix_put16(p, rec->ir_port_end);
+	}
+	return p;
+}
+
+static void cgn_ipfix_close_set(struct cgn_ipfix_exp *exp)
+{
+	if (exp->set_off) {
+		cgn_ipfix_put16(&exp->buf[exp->set_off + 2],
+				exp->len - exp->set_off);
+		exp->set_off = 0;
+	}
+}
+
+static void cgn_ipfix_add_templates(struct cgn_ipfix_exp *exp)
+{
+	uint8_t *start = &exp->buf[exp->len];
+	uint8_t *p = start;
+	unsigned int i, j;
+
+	p = cgn_ipfix_put16(p, CGN_IPFIX_SET_TEMPLATE);
+	p += 2;		/* length */
+
+	for (i = 0; i < CGN_IPFIX_TMPL_COUNT; i++) {
+		const struct cgn_ipfix_tmpl *t = &cgn_ipfix_tmpls[i];
+
+		p = cgn_ipfix_put16(p, t->id);
+		p = cgn_ipfix_put16(p, t->nfields);
+		for (j = 0; j < t->nfields; j++) {
+			p = cgn_ipfix_put16(p, t->fields[j].ie);
+			p = cgn_ipfix_put16(p, t->fields[j].len);
+		}
+	}
+	cgn_ipfix_put16(start + 2, p - start);
+
+	exp->len += p - start;
+	exp->has_tmpl = true;
+}
+
+/* Start a new message, with the templates if they are due */
+static void cgn_ipfix_msg_start(struct cgn_ipfix_exp *exp)
+{
+	uint64_t now = cgn_ipfix_now_ms();
+
+	exp->len = 16;
+	exp->set_off = 0;
+	exp->nrecs = 0;
+	exp->has_tmpl = false;
+
+	if (CMM_LOAD_SHARED(cgn_ipfix_tmpl_due) ||
+	    now - exp->tmpl_sent_ms >= CGN_IPFIX_TMPL_REFRESH_MS) {
+		CMM_STORE_SHARED(cgn_ipfix_tmpl_due, false);
+		exp->tmpl_sent_ms = now;
+		cgn_ipfix_add_templates(exp);
+	}
+}
+
+static int cgn_ipfix_write(const void *buf, size_t len)
+{
+	ssize_t rc = -1;
+
+	switch (cgn_ipfix_dest_type) {
+	case CGN_IPFIX_DEST_NONE:
+		return -ENOTCONN;
+	case CGN_IPFIX_DEST_UDP:
+		rc = send(cgn_ipfix_fd, buf, len, MSG_DONTWAIT);
+		break;
+	case CGN_IPFIX_DEST_FILE:
+		rc = write(cgn_ipfix_fd, buf, len);
+		break;
+	}
+
+	if (rc < 0)
+		return -errno;
+	return rc == (ssize_t)len ? 0 : -EIO;
+}
+
+/*
+ * Send the message.  A failed send is counted but not retried, as the
+ * exporter must keep up with the rings.
+ */
+static void cgn_ipfix_msg_send(struct cgn_ipfix_exp *exp)
+{
+	uint8_t *p = exp->buf;
+	int rc;
+
+	if (!exp->nrecs)
+		return;
+
+	cgn_ipfix_close_set(exp);
+
+	p = cgn_ipfix_put16(p, CGN_IPFIX_VERSION);
+	p = cgn_ipfix_put16(p, exp->len);
+	p = cgn_ipfix_put32(p, time(NULL));
+	p = cgn_ipfix_put32(p, exp->seq);
+	cgn_ipfix_put32(p, CGN_IPFIX_DOMAIN);
+
+	pthread_mutex_lock(&cgn_ipfix_dest_lock);
+	rc = cgn_ipfix_write(exp->buf, exp->len);
+	pthread_mutex_unlock(&cgn_ipfix_dest_lock);
+
+	if (rc == -ENOTCONN) {
+		exp->no_dest += exp->nrecs;
+		/* So the templates go with the first message to a new one */
+		CMM_STORE_SHARED(cgn_ipfix_tmpl_due, true);
+	} else if (rc < 0) {
+		exp->send_fails++;
+		if (net_ratelimit())
+			RTE_LOG(DEBUG, CGNAT, "%s: IPFIX export failure (%s)\n",
+				__func__, strerror(-rc));
+	} else {
+		exp->msgs++;
+		exp->records += exp->nrecs;
+		exp->bytes += exp->len;
+		if (exp->has_tmpl)
+			exp->templates++;
+	}
+
+	/* Sequence numbers count all data records exported */
+	exp->seq += exp->nrecs;
+
+	cgn_ipfix_msg_start(exp);
+}
+
+static void cgn_ipfix_add_rec(struct cgn_ipfix_exp *exp,
+			      const struct cgn_ipfix_rec *rec)
+{
+	const struct cgn_ipfix_tmpl *t = &cgn_ipfix_tmpls[rec->ir_tmpl];
+	uint16_t need = t->rec_len;
+	uint8_t *p;
+	unsigned int i;
+
+	if (exp->set_id != t->id || !exp->set_off)
+		need += 4;
+
+	if (exp->len + need > CGN_IPFIX_MSG_MAX)
+		cgn_ipfix_msg_send(exp);
+
+	if (exp->set_id != t->id || !exp->set_off) {
+		cgn_ipfix_close_set(exp);
+		exp->set_off = exp->len;
+		exp->set_id = t->id;
+		cgn_ipfix_put16(&exp->buf[exp->len], t->id);
+		exp->len += 4;
+	}
+
+	p = &exp->buf[exp->len];
+	for (i = 0; i < t->nfields; i++)
+		p = cgn_ipfix_put_field(p, t->fields[i].ie, rec);
+
+	exp->len += t->rec_len;
+	exp->nrecs++;
+}
+
+/* Drain one ring, returning the number of records taken */
+static unsigned int cgn_ipfix_drain_ring(struct cgn_ipfix_exp *exp,
+					 struct cgn_ipfix_ring *ring)
+{
+	uint32_t cons = ring->cons;
+	uint32_t prod = CMM_LOAD_SHARED(ring->prod);
+	unsigned int n = prod - cons;
+
+	if (!n)
+		return 0;
+
+	/* Read the records only after seeing prod */
+	cmm_smp_rmb();
+
+	for (; cons != prod; cons++)
+		cgn_ipfix_add_rec(exp,
+			  &ring->recs[cons & (CGN_IPFIX_RING_SZ - 1)]);
+
+	/* Finish with the records before the producer may reuse them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(ring->cons, cons);
+
+	return n;
+}
+
+static unsigned int cgn_ipfix_drain(struct cgn_ipfix_exp *exp)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < cgn_ipfix_nrings; i++)
+		n += cgn_ipfix_drain_ring(exp, &cgn_ipfix_rings[i]);
+
+	return n;
+}
+
+/*
+ * Messages are sent as soon as they are full.  A partly full message is
+ * sent once the rings are empty, so an event waits at most one idle period.
+ */
+static void *cgn_ipfix_thread(void *arg __unused)
+{
+	struct cgn_ipfix_exp *exp = &cgn_ipfix_exp;
+
+	pthread_setname_np(pthread_self(), "dp/cgn-ipfix");
+
+	cgn_ipfix_msg_start(exp);
+
+	while (CMM_LOAD_SHARED(cgn_ipfix_running)) {
+		if (cgn_ipfix_drain(exp))
+			continue;
+
+		cgn_ipfix_msg_send(exp);
+		usleep(CGN_IPFIX_IDLE_US);
+	}
+
+	cgn_ipfix_drain(exp);
+	cgn_ipfix_msg_send(exp);
+
+	return NULL;
+}
+
+static int cgn_ipfix_rings_init(void)
+{
+	unsigned int i;
+
+	if (cgn_ipfix_rings)
+		return 0;
+
+	cgn_ipfix_nrings = get_lcore_max() + 2;
+	cgn_ipfix_rings = zmalloc_aligned(cgn_ipfix_nrings *
+					  sizeof(*cgn_ipfix_rings));
+	if (!cgn_ipfix_rings)
+		return -ENOMEM;
+
+	for (i = 0; i < cgn_ipfix_nrings; i++)
+		rte_spinlock_init(&cgn_ipfix_rings[i].lock);
+
+	return 0;
+}
+
+/*
+ * Function called when ipfix logging is enabled for a log type.  The
+ * exporter runs while any log type uses it.  Rings are kept once allocated,
+ * as lcores may still be logging to them after the handler is removed.
+ */
+static int cl_ipfix_init(enum cgn_log_type ltype __unused,
+			 const struct cgn_log_fns *fns __unused)
+{
+	int rc;
+
+	if (cgn_ipfix_users++)
+		return 0;
+
+	rc = cgn_ipfix_rings_init();
+	if (rc < 0)
+		goto error;
+
+	CMM_STORE_SHARED(cgn_ipfix_running, true);
+	rc = -pthread_create(&cgn_ipfix_pthread, NULL, cgn_ipfix_thread,
+			     NULL);
+	if (rc < 0) {
+		CMM_STORE_SHARED(cgn_ipfix_running, false);
+		RTE_LOG(ERR, CGNAT, "%s: pthread_create failed (%s)\n",
+			__func__, strerror(-rc));
+		goto error;
+	}
+
+	return 0;
+
+error:
+	cgn_ipfix_users--;
+	return rc;
+}
+
+static void cl_ipfix_fini(enum cgn_log_type ltype __unused,
+			  const struct cgn_log_fns *fns __unused)
+{
+	if (!cgn_ipfix_users || --cgn_ipfix_users)
+		return;
+
+	CMM_STORE_SHARED(cgn_ipfix_running, false);
+	pthread_join(cgn_ipfix_pthread, NULL);
+}
+
+/* Must hold cgn_ipfix_dest_lock */
+static void cgn_ipfix_close_dest(void)
+{
+	if (cgn_ipfix_fd >= 0)
+		close(cgn_ipfix_fd);
+	cgn_ipfix_fd = -1;
+	cgn_ipfix_dest_type = CGN_IPFIX_DEST_NONE;
+	free(cgn_ipfix_path);
+	cgn_ipfix_path = NULL;
+}
+
+int cgn_ipfix_set_collector(uint32_t addr, uint16_t port)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = addr,
+		.sin_port = htons(port ? port : CGN_IPFIX_PORT),
+	};
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		int rc = -errno;
+
+		close(fd);
+		return rc;
+	}
+
+	pthread_mutex_lock(&cgn_ipfix_dest_lock);
+	cgn_ipfix_close_dest();
+	cgn_ipfix_fd = fd;
+	cgn_ipfix_collector = sin;
+	cgn_ipfix_dest_type = CGN_IPFIX_DEST_UDP;
+	CMM_STORE_SHARED(cgn_ipfix_tmpl_due, true);
+	pthread_mutex_unlock(&cgn_ipfix_dest_lock);
+
+	return 0;
+}
+
+int cgn_ipfix_set_file(const char *path)
+{
+	char *copy;
+	int fd;
+
+	copy = strdup(path);
+	if (!copy)
+		return -ENOMEM;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+	if (fd < 0) {
+		int rc = -errno;
+
+		free(copy);
+		return rc;
+	}
+
+	pthread_mutex_lock(&cgn_ipfix_dest_lock);
+	cgn_ipfix_close_dest();
+	cgn_ipfix_fd = fd;
+	cgn_ipfix_path = copy;
+	cgn_ipfix_dest_type = CGN_IPFIX_DEST_FILE;
+	CMM_STORE_SHARED(cgn_ipfix_tmpl_due, true);
+	pthread_mutex_unlock(&cgn_ipfix_dest_lock);
+
+	return 0;
+}
+
+void cgn_ipfix_clear_dest(void)
+{
+	pthread_mutex_lock(&cgn_ipfix_dest_lock);
+	cgn_ipfix_close_dest();
+	pthread_mutex_unlock(&cgn_ipfix_dest_lock);
+}
+
+void cgn_show_ipfix(FILE *f)
+{
+	const struct cgn_ipfix_exp *exp = &cgn_ipfix_exp;
+	char addr[INET_ADDRSTRLEN];
+	json_writer_t *json;
+	unsigned int i;
+
+	json = jsonw_new(f);
+	if (!json)
+		return;
+
+	jsonw_name(json, "ipfix");
+	jsonw_start_object(json);
+
+	pthread_mutex_lock(&cgn_ipfix_dest_lock);
+	switch (cgn_ipfix_dest_type) {
+	case CGN_IPFIX_DEST_NONE:
+		jsonw_string_field(json, "destination", "none");
+		break;
+	case CGN_IPFIX_DEST_UDP:
+		jsonw_string_field(json, "destination", "udp");
+		inet_ntop(AF_INET, &cgn_ipfix_collector.sin_addr,
+			  addr, sizeof(addr));
+		jsonw_string_field(json, "collector", addr);
+		jsonw_uint_field(json, "port",
+				 ntohs(cgn_ipfix_collector.sin_port));
+		break;
+	case CGN_IPFIX_DEST_FILE:
+		jsonw_string_field(json, "destination", "file");
+		jsonw_string_field(json, "file", cgn_ipfix_path);
+		break;
+	}
+	pthread_mutex_unlock(&cgn_ipfix_dest_lock);
+
+	jsonw_bool_field(json, "running", CMM_LOAD_SHARED(cgn_ipfix_running));
+	jsonw_uint_field(json, "msgs_sent", exp->msgs);
+	jsonw_uint_field(json, "records_sent", exp->records);
+	jsonw_uint_field(json, "bytes_sent", exp->bytes);
+	jsonw_uint_field(json, "templates_sent", exp->templates);
+	jsonw_uint_field(json, "send_fails", exp->send_fails);
+	jsonw_uint_field(json, "no_destination", exp->no_dest);
+
+	jsonw_name(json, "rings");
+	jsonw_start_array(json);
+	for (i = 0; i < cgn_ipfix_nrings; i++) {
+		const struct cgn_ipfix_ring *ring = &cgn_ipfix_rings[i];
+
+		if (!ring->enqueued && !ring->dropped)
+			continue;
+
+		jsonw_start_object(json);
+		if (i == cgn_ipfix_nrings - 1)
+			jsonw_string_field(json, "lcore", "shared");
+		else
+			jsonw_uint_field(json, "lcore", i);
+		jsonw_uint_field(json, "queued",
+				 CMM_LOAD_SHARED(ring->prod) -
+				 CMM_LOAD_SHARED(ring->cons));
+		jsonw_uint_field(json, "enqueued", ring->enqueued);
+		jsonw_uint_field(json, "dropped", ring->dropped);
+		jsonw_end_object(json);
+	}
+	jsonw_end_array(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+}
+
+const struct cgn_session_log_fns cgn_session_ipfix_fns = {
+	.cl_sess_start = cl_ipfix_sess_start,
+	.cl_sess_end = cl_ipfix_sess_end,
+};
+
+const struct cgn_port_block_alloc_log_fns cgn_port_block_alloc_ipfix_fns = {
+	.cl_pb_alloc = cl_ipfix_pb_alloc,
+	.cl_pb_release = cl_ipfix_pb_release,
+};
+
+const struct cgn_subscriber_log_fns cgn_subscriber_ipfix_fns = {
+	.cl_subscriber_start = cl_ipfix_subscriber_start,
+	.cl_subscriber_end = cl_ipfix_subscriber_end,
+};
+
+const struct cgn_res_constraint_log_fns cgn_res_constraint_ipfix_fns = {
+	.cl_resource_public_pb = cl_ipfix_resource_public_pb,
+};
+
+const struct cgn_log_fns cgn_ipfix_fns = {
+	.cl_name = "ipfix",
+	.cl_init = cl_ipfix_init,
+	.cl_fini = cl_ipfix_fini,
+	.logfn[CGN_LOG_TYPE_SESSION].session =
+		&cgn_session_ipfix_fns,
+	.logfn[CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION].port_block_alloc =
+		&cgn_port_block_alloc_ipfix_fns,
+	.logfn[CGN_LOG_TYPE_SUBSCRIBER].subscriber =
+		&cgn_subscriber_ipfix_fns,
+	.logfn[CGN_LOG_TYPE_RES_CONSTRAINT].res_constraint =
+		&cgn_res_constraint_ipfix_fns,
+};
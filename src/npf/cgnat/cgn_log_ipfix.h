@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef _CGN_LOG_IPFIX_H_
+#define _CGN_LOG_IPFIX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Records queued per lcore before events are dropped */
+#define CGN_IPFIX_RING_SZ	4096
+
+/* Largest IPFIX message, chosen to fit in one unfragmented UDP packet */
+#define CGN_IPFIX_MSG_MAX	1400
+
+#define CGN_IPFIX_PORT		4739
+
+/*
+ * Set the destination for IPFIX messages.  addr is in network byte order and
+ * port in host byte order.  Events are counted and discarded while there is
+ * no destination.
+ */
+int cgn_ipfix_set_collector(uint32_t addr, uint16_t port);
+int cgn_ipfix_set_file(const char *path);
+void cgn_ipfix_clear_dest(void);
+
+void cgn_show_ipfix(FILE *f);
+
+#endif /* _CGN_LOG_IPFIX_H_ */
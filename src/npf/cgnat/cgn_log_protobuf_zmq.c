@@ -6,6 +6,10 @@
 
 /**
  * @file cgn_log_protobuf_zmq.c - cgnat logging sending protobufs over zmq
+ *
+ * Each event is packed and sent as its own zmq message by the thread that
+ * logs it.  Events are not batched; see cgn_log_ipfix.c for the handler
+ * that is.
  */
 
 #include <errno.h>
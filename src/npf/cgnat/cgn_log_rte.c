@@ -6,6 +6,10 @@
 
 /**
  * @file cgn_log_rte.c - cgnat logging using rte_log()
+ *
+ * Each event is formatted and logged by the thread that logs it, one log
+ * message per event.  Events are not batched; see cgn_log_ipfix.c for the
+ * handler that is.
  */
 
 #include <errno.h>
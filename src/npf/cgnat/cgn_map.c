@@ -85,170 +85,99 @@ void cgn_alloc_pool_available(struct nat_pool *np, struct apm *apm)
  * invocation.  After each allocation, we store the address in the pools
  * np_addr_hint object.
  *
- * Before we consider an address to use, we check if it has unallocated port
- * blocks.  Addresses with no port blocks in-use are preferred over an address
- * with some port blocks already in-use.
+ * Addresses with no port blocks in-use are preferred over an address with
+ * some port blocks already in-use.  If there are no unused addresses then
+ * the "least used" shareable address is chosen.
  *
- * On first iteration of the pool addresses we try and identify the "least
- * used" address.  This may be used if an totally unused address is not found.
- *
- * We also make a "last gasp" second iteration of the pool addresses if the
- * above yields no result.  This simply grabs the first address with any free
- * port-blocks.
- *
- * If addr_hint is set then pr may also be set.  If so, then this a pointer to
- * the address range that addr_hint is in.
+ * Rather than look at every pool address, we only look at the addresses in
+ * each usage level of the pool, least used level first, starting at the
+ * address hint.  Full addresses are never looked at.  The usage levels are
+ * only a hint, so each candidate apm is checked once it is locked.  A
+ * candidate whose level was wrong has its level corrected.
  *
  * If successful, the returned apm will be LOCKED.
  */
 static struct apm *
 cgn_alloc_addr_rrobin(struct nat_pool *np, uint8_t proto, uint32_t addr_hint,
-		      struct nat_pool_range *pr, vrfid_t vrfid, int *error)
+		      vrfid_t vrfid, int *error)
 {
-	uint32_t addr, start_addr;
-	struct apm *apm, *lu_apm = NULL;
-	bool pass2 = false;
+	struct nat_pool_ranges *nr = rcu_dereference(np->np_ranges);
+	struct nat_pool_range *pr;
+	uint32_t start, idx, left, addr;
+	bool busy = false;
+	struct apm *apm;
+	int64_t hint;
+	uint8_t level;
 
-	/* Do not iterate over pool addresses if we know none are available */
-repeat:
+	/* Do not look for pool addresses if we know none are available */
 	if (np->np_full) {
 		*error = -CGN_POOL_ENOSPC;
 		return NULL;
 	}
 
-	addr = start_addr = addr_hint;
-
-	if (!pr) {
-		int range = nat_pool_addr_range(np, addr);
+	hint = nat_pool_addr_index(nr, addr_hint);
+	start = hint < 0 ? 0 : (uint32_t)hint;
 
-		if (range >= 0)
-			pr = &np->np_ranges->nr_range[range];
-	}
+	for (level = NP_LVL_UNUSED; level < NP_LVL_COUNT; level++) {
+		idx = start;
+		left = nr->nr_naddrs;
 
-	/* Iterate over all addresses in all address ranges */
-	do {
-		int lock_result;
+		while (nat_pool_level_next(nr, level, &idx, &left)) {
+			addr = nat_pool_index_addr(nr, idx, &pr);
 
-		/*
-		 * This should almost never happen.  It might only occur if an
-		 * address pool has been reconfigured before the stored
-		 * address hint has been updated or cleared.
-		 */
-		if (unlikely(!pr))
-			goto next_addr;
+			if (++idx >= nr->nr_naddrs)
+				idx = 0;
 
-		/* Ignore blacklisted addresses */
-		if (nat_pool_is_blacklist_addr(np, htonl(addr)))
-			goto next_addr;
+			/* Ignore blacklisted addresses */
+			if (nat_pool_is_blacklist_addr(np, htonl(addr)))
+				continue;
 
-		apm = apm_lookup(addr, vrfid);
+			/* Only shareable addresses may be partly used */
+			if (level != NP_LVL_UNUSED && !pr->pr_shared)
+				continue;
 
-		if (!apm) {
-			apm = apm_create_and_insert(addr, vrfid, np, error);
+			apm = apm_lookup(addr, vrfid);
 
-			/* Either out of memory, or apm table is full */
-			if (unlikely(!apm))
-				return NULL;
-		}
+			if (!apm) {
+				apm = apm_create_and_insert(addr, vrfid, np,
+							    error);
 
-		/* LOCK apm before checking if there are free blocks */
-		lock_result = rte_spinlock_trylock(&apm->apm_lock);
-
-		/* Lock was unsuccessful, try next address */
-		if (lock_result == 0)
-			goto next_addr;
+				/* Either out of memory, or apm table is full */
+				if (unlikely(!apm))
+					return NULL;
+			}
 
-		/* Was the apm destroyed between table lookup and lock? */
-		if (unlikely((apm->apm_flags & APM_DEAD) != 0)) {
-			rte_spinlock_unlock(&apm->apm_lock);
-			goto next_addr;
-		}
+			/* LOCK apm before checking if there are free blocks */
+			if (rte_spinlock_trylock(&apm->apm_lock) == 0) {
+				busy = true;
+				continue;
+			}
 
-		/* Always pick an unused public address first */
-		if (apm->apm_blocks_used == 0)
-			goto addr_found;
+			/* Was the apm destroyed between lookup and lock? */
+			if (unlikely((apm->apm_flags & APM_DEAD) != 0)) {
+				rte_spinlock_unlock(&apm->apm_lock);
+				continue;
+			}
 
-		/*
-		 * Is the address shareable, and does it have some free
-		 * port-blocks?
-		 */
-		if (pr->pr_shared &&
-		    (apm->apm_blocks_used < apm->apm_nblocks)) {
-			/*
-			 * On second iteration through the NAT pool addresses,
-			 * we simply use the first shareable address with any
-			 * free port-blocks.
-			 */
-			if (unlikely(pass2))
+			if (apm->apm_blocks_used == 0 ||
+			    (level != NP_LVL_UNUSED && pr->pr_shared &&
+			     apm->apm_blocks_used < apm->apm_nblocks))
 				goto addr_found;
 
-			/*
-			 * On first iteration through the NAT pool addresses,
-			 * we try and identify a "least used" address.
-			 */
-			if (!lu_apm ||
-			    (apm->apm_blocks_used < lu_apm->apm_blocks_used))
-				lu_apm = apm;
-		}
-
-		rte_spinlock_unlock(&apm->apm_lock);
-
-		/* Try the next address in the pool */
-next_addr:
-		addr = nat_pool_next_addr(np, addr, &pr);
-	} while (addr != start_addr);
-
-	/*
-	 * No unused addresses were found in first iteration of the pool.  Did
-	 * we find a "least used" address?
-	 */
-	if (lu_apm) {
-		int lock_result;
-
-		/*
-		 * If we cannot lock the candidate apm, or it is no longer
-		 * suitable, then simple fall through to do the second
-		 * iteration.
-		 */
-		apm = lu_apm;
-		lock_result = rte_spinlock_trylock(&apm->apm_lock);
-
-		if (lock_result != 0) {
-			/* Lock successful.  Can we still use this addr? */
-			if ((apm->apm_flags & APM_DEAD) == 0 &&
-			    apm->apm_blocks_used < apm->apm_nblocks) {
-				/* Use this address */
-				addr = apm->apm_addr;
-				goto addr_found;
-			}
-
-			/*
-			 * No longer suitable.  Unlock and do second
-			 * iteration.
-			 */
+			nat_pool_addr_usage(np, addr, apm->apm_blocks_used,
+					    apm->apm_nblocks);
 			rte_spinlock_unlock(&apm->apm_lock);
 		}
 	}
 
-	/*
-	 * No unused addresses found, and either we failed to find a "least
-	 * used" address or we lost the race to use the "least used" address.
-	 * Make a last gasp attempt to just grab the first address with any
-	 * free port-blocks.
-	 */
-	if (!pass2) {
-		pass2 = true;
-		pr = NULL;
-		lu_apm = NULL;
-		goto repeat;
-	}
+	*error = -CGN_POOL_ENOSPC;
 
 	/*
-	 * We only get here if both: 1. no unshareble addresses are unused,
-	 * and 2. no shareable addresses have any free port-blocks.
+	 * Only mark the pool as full if we did not skip over any addresses
+	 * that were locked by another thread.
 	 */
-	*error = -CGN_POOL_ENOSPC;
-	cgn_alloc_pool_full(np);
+	if (!busy)
+		cgn_alloc_pool_full(np);
 
 	return NULL;
 
@@ -319,6 +248,104 @@ error:
 	return NULL;
 }
 
+/*
+ * Get the public address (host order) and port-block of a subscriber of a
+ * deterministic policy.  Every pool address contributes the same number of
+ * blocks, so this is just a division and a walk of the pool ranges.
+ */
+static bool
+cgn_map_det_addr(struct cgn_policy *cp, struct nat_pool *np,
+		 uint32_t subs_addr, uint32_t *addr, uint16_t *block)
+{
+	struct nat_pool_ranges *nr;
+	uint16_t nblocks;
+	uint32_t index;
+	uint8_t i;
+
+	nblocks = np->np_nports / np->np_block_sz;
+	if (!nblocks || !cgn_policy_det_index(cp, subs_addr, &index))
+		return false;
+
+	*block = index % nblocks;
+	index /= nblocks;
+
+	nr = rcu_dereference(np->np_ranges);
+	for (i = 0; i < nr->nr_nranges; i++) {
+		if (index < nr->nr_range[i].pr_naddrs) {
+			*addr = nr->nr_range[i].pr_addr_start + index;
+			return true;
+		}
+		index -= nr->nr_range[i].pr_naddrs;
+	}
+	return false;
+}
+
+/*
+ * Allocate the port-block of a subscriber of a deterministic policy, and add
+ * it to the subscriber.  The public address is never searched for, and the
+ * apm is only locked while the block is added to it.
+ */
+static struct apm_port_block *
+cgn_alloc_det_block(struct cgn_policy *cp, struct nat_pool *np,
+		    struct cgn_source *src, uint8_t proto, vrfid_t vrfid,
+		    int *error)
+{
+	struct apm_port_block *pb;
+	struct apm *apm;
+	uint32_t addr;
+	uint16_t block;
+
+	if (!cgn_map_det_addr(cp, np, src->sr_addr, &addr, &block) ||
+	    nat_pool_is_blacklist_addr(np, htonl(addr))) {
+		*error = -CGN_POOL_ENOSPC;
+		return NULL;
+	}
+
+	apm = apm_lookup(addr, vrfid);
+	if (!apm) {
+		apm = apm_create_and_insert(addr, vrfid, np, error);
+
+		/* Either out of memory, or apm table is full */
+		if (unlikely(!apm))
+			return NULL;
+	}
+
+	rte_spinlock_lock(&apm->apm_lock);
+
+	if (unlikely((apm->apm_flags & APM_DEAD) != 0)) {
+		rte_spinlock_unlock(&apm->apm_lock);
+		*error = -CGN_POOL_ENOSPC;
+		return NULL;
+	}
+
+	/*
+	 * The block may only be in-use if the pool is shared with a dynamic
+	 * policy.
+	 */
+	if (unlikely(block >= apm->apm_nblocks || apm->apm_blocks[block])) {
+		rte_spinlock_unlock(&apm->apm_lock);
+		*error = -CGN_BLK_ENOSPC;
+		nat_pool_incr_block_fails(np);
+		return NULL;
+	}
+
+	pb = apm_block_create(apm, block);
+	if (!pb) {
+		rte_spinlock_unlock(&apm->apm_lock);
+		*error = -CGN_PB_ENOMEM;
+		nat_pool_incr_block_fails(np);
+		return NULL;
+	}
+
+	nat_pool_incr_block_allocs(np);
+	nat_pool_incr_block_active(np);
+
+	cgn_source_add_block(src, proto, pb, np);
+	rte_spinlock_unlock(&apm->apm_lock);
+
+	return pb;
+}
+
 /*
  * Find a free port in any of the port-blocks already in-use by a subscriber,
  * except the active block (since we will already have checked that).
@@ -394,6 +421,41 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 	/* Get active port-block for this source and protocol */
 	pb = src->sr_active_block[proto];
 
+	/*
+	 * A subscriber of a deterministic policy has exactly one port-block,
+	 * which is active for all protocols.
+	 */
+	if (cgn_policy_is_deterministic(cp)) {
+		if (unlikely(!pb)) {
+			pb = cgn_alloc_det_block(cp, np, src, proto, vrfid,
+						 &error);
+			if (!pb)
+				goto error;
+		}
+		apm = apm_block_get_apm(pb);
+
+		if (nat_pool_is_pa_sequential(np))
+			port = apm_block_alloc_first_free_port(pb, proto);
+		else
+			port = apm_block_alloc_random_port(pb, proto);
+
+		if (likely(port > 0))
+			goto port_found;
+
+		nat_pool_incr_block_limit(np);
+		error = -CGN_MBU_ENOSPC;
+
+		if (!src->sr_mbpu_full[proto]) {
+			cgn_log_resource_subscriber_mbpu(
+				CGN_RESOURCE_FULL,
+				src->sr_addr, nat_ipproto_from_proto(proto),
+				src->sr_block_count, src->sr_block_count);
+
+			src->sr_mbpu_full[proto] = true;
+		}
+		goto error;
+	}
+
 	/*
 	 * If there is no active port-block for this protocol:
 	 *  1. alloc a public address (apm),
@@ -407,7 +469,6 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 		 * paired address for this subscriber.  Else get the next
 		 * address in the nat pool after the last allocated address.
 		 */
-		struct nat_pool_range *pr = NULL;
 		uint32_t addr_hint;
 
 		/* Does subscriber already have a paired address? */
@@ -426,16 +487,16 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 			 * from pool.
 			 */
 			addr_hint = nat_pool_hint(np, proto);
-			addr_hint = nat_pool_next_addr(np, addr_hint, &pr);
+			addr_hint = nat_pool_next_addr(np, addr_hint, NULL);
 		}
 
 		/*
-		 * Starting at addr_hint, iterate through addresses in the nat
-		 * pool until we find one with a free port-block.
+		 * Starting at addr_hint, find an address in the nat pool with
+		 * a free port-block.
 		 *
 		 * If successful, the returned apm will be LOCKED.
 		 */
-		apm = cgn_alloc_addr_rrobin(np, proto, addr_hint, pr,
+		apm = cgn_alloc_addr_rrobin(np, proto, addr_hint,
 					    vrfid, &error);
 
 		/*
@@ -539,14 +600,13 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 			goto error;
 		} else {
 			/* alloc a new public address */
-			struct nat_pool_range *pr = NULL;
 			uint32_t addr_hint;
 
 			addr_hint = nat_pool_hint(np, proto);
-			addr_hint = nat_pool_next_addr(np, addr_hint, &pr);
+			addr_hint = nat_pool_next_addr(np, addr_hint, NULL);
 
 			/* If successful, apm will be LOCKED */
-			apm = cgn_alloc_addr_rrobin(np, proto, addr_hint, pr,
+			apm = cgn_alloc_addr_rrobin(np, proto, addr_hint,
 						    vrfid, &error);
 			if (!apm)
 				goto error;
@@ -668,6 +728,25 @@ cgn_map_get2(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 		goto error;
 	}
 
+	/*
+	 * A subscriber of a deterministic policy may only be given a port
+	 * from its own port-block.
+	 */
+	if (cgn_policy_is_deterministic(cp)) {
+		uint32_t det_addr;
+		uint16_t det_block;
+
+		port = ntohs(tport);
+		if (!cgn_map_det_addr(cp, np, src->sr_addr, &det_addr,
+				      &det_block) ||
+		    det_addr != ntohl(taddr) || port < np->np_port_start ||
+		    apm_block(port, np->np_port_start, np->np_block_sz) !=
+		    det_block) {
+			error = -CGN_BLK_ENOSPC;
+			goto error;
+		}
+	}
+
 	/* Lookup public address in apm table */
 	apm = apm_lookup(taddr, vrfid);
 	if (!apm) {
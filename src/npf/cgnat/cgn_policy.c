@@ -8,7 +8,9 @@
  * @file cgn_policy.c - cgnat policy
  */
 
+#include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <netinet/in.h>
 #include <linux/if.h>
 #include <dpdk/rte_jhash.h>
@@ -16,6 +18,7 @@
 #include "compiler.h"
 #include "if_var.h"
 #include "util.h"
+#include "vplane_log.h"
 
 #include "npf/npf_addrgrp.h"
 #include "npf/nat/nat_pool_public.h"
@@ -227,11 +230,143 @@ cgn_policy_detach_pool(struct cgn_policy *cp)
 	cp->cp_pool = NULL;
 }
 
+static int
+cgn_policy_det_count_cb(uint32_t start __unused, uint32_t stop __unused,
+			uint32_t range __unused, void *ctx)
+{
+	uint32_t *count = ctx;
+
+	(*count)++;
+	return 0;
+}
+
+/*
+ * Subscribers are numbered in address-group order as the ranges are added.
+ * The array is only sorted by address afterwards, for the lookup.
+ */
+static int
+cgn_policy_det_range_cb(uint32_t start, uint32_t stop,
+			uint32_t range __unused, void *ctx)
+{
+	struct cgn_det_ranges *dr = ctx;
+	struct cgn_det_range *r;
+
+	r = &dr->dr_range[dr->dr_nranges++];
+	r->dr_start = start;
+	r->dr_stop = stop;
+	r->dr_base = dr->dr_nsubs;
+	dr->dr_nsubs += stop - start + 1;
+
+	return 0;
+}
+
+static int cgn_policy_det_range_cmp(const void *a, const void *b)
+{
+	const struct cgn_det_range *ra = a, *rb = b;
+
+	if (ra->dr_start < rb->dr_start)
+		return -1;
+	return ra->dr_start > rb->dr_start;
+}
+
+static void cgn_policy_det_rcu_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cgn_det_ranges, dr_rcu_head));
+}
+
+/*
+ * Number the subscriber addresses of a deterministic policy.  This is redone
+ * whenever the policy is configured, so a change to the match address-group
+ * takes effect when the policy is next updated.  Nothing is changed here, so
+ * that a policy update can be checked before it is applied.  *drp is left
+ * NULL for a dynamic policy.
+ */
+static int
+cgn_policy_det_build(enum cgn_trans_type trans_type, const char *match_name,
+		     struct nat_pool *np, struct cgn_det_ranges **drp)
+{
+	struct cgn_det_ranges *dr;
+	uint32_t tid, count = 0;
+
+	*drp = NULL;
+	if (trans_type != CGN_TRANS_NAPT44_DETERMINISTIC || !match_name)
+		return 0;
+
+	if (npf_addrgrp_name2tid(match_name, &tid) < 0)
+		return -ENOENT;
+
+	npf_addrgrp_ipv4_range_walk(tid, cgn_policy_det_count_cb, &count);
+	if (count == 0)
+		return -EINVAL;
+
+	dr = zmalloc_aligned(sizeof(*dr) + count * sizeof(dr->dr_range[0]));
+	if (!dr)
+		return -ENOMEM;
+
+	/* Both walks are on the master thread, so count is exact */
+	npf_addrgrp_ipv4_range_walk(tid, cgn_policy_det_range_cb, dr);
+	assert(dr->dr_nranges == count);
+
+	/* Every subscriber needs a port-block of its own */
+	if (!np || dr->dr_nsubs > nat_pool_nblocks(np)) {
+		free(dr);
+		return -ERANGE;
+	}
+
+	qsort(dr->dr_range, dr->dr_nranges, sizeof(dr->dr_range[0]),
+	      cgn_policy_det_range_cmp);
+
+	*drp = dr;
+	return 0;
+}
+
+static void
+cgn_policy_det_set(struct cgn_policy *cp, struct cgn_det_ranges *dr)
+{
+	struct cgn_det_ranges *old;
+
+	old = rcu_xchg_pointer(&cp->cp_det, dr);
+	if (old)
+		call_rcu(&old->dr_rcu_head, cgn_policy_det_rcu_free);
+}
+
+bool cgn_policy_det_index(struct cgn_policy *cp, uint32_t addr,
+			  uint32_t *index)
+{
+	struct cgn_det_ranges *dr = rcu_dereference(cp->cp_det);
+	struct cgn_det_range *r;
+	uint32_t lo, hi, mid;
+
+	if (!dr)
+		return false;
+
+	/* Find the last range starting at or below addr */
+	lo = 0;
+	hi = dr->dr_nranges;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dr->dr_range[mid].dr_start <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return false;
+
+	r = &dr->dr_range[lo - 1];
+	if (addr > r->dr_stop)
+		return false;
+
+	*index = r->dr_base + (addr - r->dr_start);
+	return true;
+}
+
 /*
  * Create cgnat policy
  */
 static struct cgn_policy *cgn_policy_create(struct cgn_policy_cfg *cpc)
 {
+	struct cgn_det_ranges *dr;
 	size_t sz;
 	int rc;
 
@@ -308,6 +443,12 @@ static struct cgn_policy *cgn_policy_create(struct cgn_policy_cfg *cpc)
 	if (rc < 0)
 		goto error;
 
+	rc = cgn_policy_det_build(cp->cp_trans_type, cpc->cp_match_ag_name,
+				  cp->cp_pool, &dr);
+	if (rc < 0)
+		goto error;
+	cgn_policy_det_set(cp, dr);
+
 	return cp;
 
 error:
@@ -334,6 +475,7 @@ static void cgn_policy_rcu_free(struct rcu_head *head)
 static void cgn_policy_destroy(struct cgn_policy *cp, bool rcu_free)
 {
 	struct npf_addrgrp *ag;
+	struct cgn_det_ranges *dr;
 
 	/*
 	 * Only detach from pool when all references on the policy have been
@@ -341,6 +483,10 @@ static void cgn_policy_destroy(struct cgn_policy *cp, bool rcu_free)
 	 */
 	cgn_policy_detach_pool(cp);
 
+	dr = rcu_xchg_pointer(&cp->cp_det, NULL);
+	if (dr)
+		call_rcu(&dr->dr_rcu_head, cgn_policy_det_rcu_free);
+
 	/* Release reference on match address-group */
 	ag = rcu_xchg_pointer(&cp->cp_match_ag, NULL);
 	if (ag)
@@ -655,6 +801,8 @@ cgn_policy_jsonw_one(json_writer_t *json, struct cgn_policy *cp)
 	jsonw_uint_field(json, "priority", cp->cp_priority);
 
 	jsonw_uint_field(json, "naddrs", cgn_policy_naddrs(cp));
+	jsonw_bool_field(json, "deterministic",
+			 cgn_policy_is_deterministic(cp));
 	if (cp->cp_pool)
 		jsonw_string_field(json, "pool", nat_pool_name(cp->cp_pool));
 	else
@@ -1086,14 +1234,32 @@ int cgn_policy_cfg_add(FILE * f __unused, int argc, char **argv)
 		cgn_source_policy_added(cp);
 	} else {
 		/* Update existing policy */
+		struct cgn_det_ranges *dr;
+		struct nat_pool *np = cp->cp_pool;
 
 		/* Has pool changed? */
 		char *pool_name = nat_pool_name(cp->cp_pool);
 
 		if (cfg.cp_pool_name != pool_name) {
-			if (!nat_pool_lookup(cfg.cp_pool_name))
+			np = nat_pool_lookup(cfg.cp_pool_name);
+			if (!np)
 				return -ENOENT;
+		}
+
+		/*
+		 * Check the deterministic mapping before changing anything,
+		 * so that a failed update leaves the policy as it was.
+		 */
+		rc = cgn_policy_det_build(cfg.cp_trans_type,
+					  cfg.cp_match_ag_name, np, &dr);
+		if (rc < 0) {
+			RTE_LOG(ERR, CGNAT,
+				"Failed to map subscribers of policy %s: %d\n",
+				cp->cp_name, rc);
+			return rc;
+		}
 
+		if (np != cp->cp_pool) {
 			cgn_policy_detach_pool(cp);
 			cgn_policy_attach_pool(cp, cfg.cp_pool_name);
 		}
@@ -1129,6 +1295,8 @@ int cgn_policy_cfg_add(FILE * f __unused, int argc, char **argv)
 		    cp->cp_map_type == CGN_MAP_EDM ||
 		    cp->cp_fltr_type == CGN_FLTR_EDF)
 			cp->cp_sess2_enabled = true;
+
+		cgn_policy_det_set(cp, dr);
 	}
 
 	return 0;
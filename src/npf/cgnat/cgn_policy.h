@@ -46,6 +46,28 @@ enum cgn_trans_type {
 	CGN_TRANS_NAPT44_DETERMINISTIC,
 };
 
+/*
+ * Deterministic translation (RFC 7422).  The subscriber addresses in the
+ * match address-group are numbered from 0, in address-group order, when the
+ * policy is configured.  Subscriber n is always given port-block
+ * (n % blocks-per-address) of public address (n / blocks-per-address) of the
+ * pool, so mappings are computed rather than searched for, and port-block
+ * allocations are not logged.
+ */
+struct cgn_det_range {
+	uint32_t		dr_start;	/* host order */
+	uint32_t		dr_stop;
+	uint32_t		dr_base;	/* index of dr_start */
+};
+
+/* One per match address-group range, sorted by dr_start */
+struct cgn_det_ranges {
+	struct rcu_head		dr_rcu_head;
+	uint32_t		dr_nsubs;
+	uint32_t		dr_nranges;
+	struct cgn_det_range	dr_range[];
+};
+
 struct cgn_policy_cfg {
 	/* Identity */
 	char			cp_name[NAT_POLICY_NAME_MAX];
@@ -126,6 +148,8 @@ struct cgn_policy {
 	uint64_t		cp_unk_pkts_in;
 	uint64_t		cp_unk_pkts_in_tot;
 
+	/* Subscriber numbering for deterministic translation */
+	struct cgn_det_ranges	*cp_det;
 };
 
 static_assert(offsetof(struct cgn_policy, cp_sess_created) == 64,
@@ -135,6 +159,19 @@ static_assert(offsetof(struct cgn_policy, cp_sess_rate_list) == 128,
 static_assert(offsetof(struct cgn_policy, cp_name) == 192,
 	      "third cache line exceeded");
 
+static inline bool
+cgn_policy_is_deterministic(const struct cgn_policy *cp)
+{
+	return cp->cp_trans_type == CGN_TRANS_NAPT44_DETERMINISTIC;
+}
+
+/*
+ * Get the deterministic index of a subscriber address (host order).  Returns
+ * false if the address is not numbered by the policy.
+ */
+bool cgn_policy_det_index(struct cgn_policy *cp, uint32_t addr,
+			  uint32_t *index);
+
 bool cgn_policy_record_dest(struct cgn_policy *cp, uint32_t addr, int dir);
 
 void cgn_policy_update_stats(struct cgn_policy *cp,
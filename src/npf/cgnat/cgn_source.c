@@ -130,6 +130,19 @@ struct nat_pool *cgn_source_get_pool(struct cgn_source *src)
 	return NULL;
 }
 
+/*
+ * Log port-block alloc and release?  The port-blocks of a deterministic
+ * policy follow from its configuration, so are never logged.
+ */
+static bool
+cgn_source_log_pba(struct cgn_source *src, struct nat_pool *np)
+{
+	if (src->sr_policy && cgn_policy_is_deterministic(src->sr_policy))
+		return false;
+
+	return nat_pool_log_pba(np);
+}
+
 /*
  * Add port block to source list
  */
@@ -170,7 +183,7 @@ cgn_source_add_block(struct cgn_source *src, uint8_t proto,
 			src->sr_paired_addr = apm->apm_addr;
 	}
 
-	if (nat_pool_log_pba(np))
+	if (cgn_source_log_pba(src, np))
 		apm_log_block_alloc(pb, src->sr_addr,
 				    cgn_policy_get_name(src->sr_policy),
 				    nat_pool_name(np));
@@ -187,7 +200,7 @@ cgn_source_del_block(struct cgn_source *src, struct apm_port_block *pb,
 {
 	assert(rte_spinlock_is_locked(&src->sr_lock));
 
-	if (nat_pool_log_pba(np))
+	if (cgn_source_log_pba(src, np))
 		apm_log_block_release(pb, src->sr_addr,
 				      cgn_policy_get_name(src->sr_policy),
 				      nat_pool_name(np));
@@ -180,7 +180,8 @@ static void npf_cfg_commit(struct npf_attpt_item *ap, enum npf_commit_type type)
 			int ret = npf_cfg_build_ruleset(&new_ruleset,
 							nc_attach_type,
 							nc_attach_point,
-							ruleset_type);
+							ruleset_type,
+							*nc_rulesets);
 
 			if (ret != 0) {
 				RTE_LOG(ERR, DATAPLANE,
@@ -117,8 +117,11 @@ npf_cfg_create_ruleset_group_cb(const struct npf_attpt_group *rsg, void *ctx)
 	if (info->num_rules_in_group == 0)
 		/* no rules in the group or does no exist, so discard it */
 		npf_free_group(rg);
-	else
-		npf_match_optimize(rg);
+	else {
+		info->error = npf_match_optimize(rg);
+		if (info->error)
+			return false;
+	}
 
 	info->num_rules_in_group = 0;
 	info->dp_rule_group = NULL;
@@ -132,7 +135,8 @@ npf_cfg_create_ruleset(npf_ruleset_t **new_dp_ruleset,
 		       const char *attach_point,
 		       enum npf_ruleset_type ruleset_type,
 		       unsigned int ruleset_type_flags,
-		       struct npf_attpt_rlset *ars)
+		       struct npf_attpt_rlset *ars,
+		       npf_ruleset_t *old_dp_ruleset)
 {
 	struct create_ruleset_info info = {
 		.error = 0,
@@ -152,8 +156,10 @@ npf_cfg_create_ruleset(npf_ruleset_t **new_dp_ruleset,
 		RTE_LOG(ERR, DATAPLANE, "failed to create new ruleset\n");
 		info.error = -ENOMEM;
 	} else {
+		npf_ruleset_set_prev(*new_dp_ruleset, old_dp_ruleset);
 		npf_attpt_walk_rlset_grps(ars, npf_cfg_create_ruleset_group_cb,
 					  &info);
+		npf_ruleset_set_prev(*new_dp_ruleset, NULL);
 	}
 	if (info.error) {
 		npf_ruleset_free(*new_dp_ruleset);
@@ -165,7 +171,8 @@ npf_cfg_create_ruleset(npf_ruleset_t **new_dp_ruleset,
 int npf_cfg_build_ruleset(npf_ruleset_t **dp_ruleset,
 			  enum npf_attach_type attach_type,
 			  const char *attach_point,
-			  enum npf_ruleset_type ruleset_type)
+			  enum npf_ruleset_type ruleset_type,
+			  npf_ruleset_t *old_dp_ruleset)
 {
 	int ret = 0;
 	struct npf_attpt_item *ap = NULL;
@@ -192,7 +199,7 @@ int npf_cfg_build_ruleset(npf_ruleset_t **dp_ruleset,
 	ret = npf_cfg_create_ruleset(dp_ruleset, attach_type,
 				     attach_point, ruleset_type,
 				     ruleset_type_flags,
-				     ars);
+				     ars, old_dp_ruleset);
 	if (ret)
 		RTE_LOG(ERR, DATAPLANE, "failed to create ruleset\n");
 
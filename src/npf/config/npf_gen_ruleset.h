@@ -24,13 +24,17 @@
  * @param attach_point The name of the attach point (e.g. interface name).
  * @param ruleset_type Identifies the ruleset type to build the ruleset for
  *                     (e.g. firewall in, NAT out, etc.)
+ * @param old_dp_ruleset The ruleset that the new ruleset will replace, or
+ *                       NULL. Rules that are unchanged from it are reused
+ *                       rather than being parsed and compiled again.
  * @return Returns 0 on successfully building the rules, or negative errno
  *         on failure to create the ruleset.
  */
 int npf_cfg_build_ruleset(npf_ruleset_t **dp_ruleset,
 			  enum npf_attach_type attach_type,
 			  const char *attach_point,
-			  enum npf_ruleset_type ruleset_type);
+			  enum npf_ruleset_type ruleset_type,
+			  npf_ruleset_t *old_dp_ruleset);
 
 /**
  * Replaces a ruleset with a new ruleset
@@ -25,11 +25,19 @@ enum class_flags {
 	CF_HAS_RULE		= 0x0001,
 	CF_RPROC_ONLY		= 0x0002,
 	CF_RETAIN_PARSED	= 0x0004,
+	CF_NCODE_INLINE		= 0x0008,
 };
 
 static bool npf_group_class_has_rules(enum npf_rule_class group_class);
 static bool npf_group_class_rproc_only(enum npf_rule_class group_class);
 static bool npf_group_class_retain_parsed(enum npf_rule_class group_class);
+static bool npf_group_class_ncode_inline(enum npf_rule_class group_class);
+
+/*
+ * Bumped on any change to a group whose contents are copied into the
+ * ncode of the rules that reference it, e.g. a port-group.
+ */
+static uint32_t npf_cfg_ncode_gen;
 
 /* Rule definition */
 struct cfg_rule {
@@ -267,6 +275,9 @@ static void npf_cfg_rule_event(enum npf_cfg_rule_group_event_type event_type,
 	struct cfg_group_item *cg = zhashx_lookup(group_hash, &rg_match);
 	struct cfg_group_user *cu;
 
+	if (npf_group_class_ncode_inline(group_class))
+		npf_cfg_ncode_gen++;
+
 	if (cg == NULL)
 		return;
 
@@ -643,12 +654,15 @@ struct rule_class_attrs {
 static struct rule_class_attrs npf_rule_class_attrs[NPF_RULE_CLASS_COUNT] =  {
 	[NPF_RULE_CLASS_PORT_GROUP] = {
 		.cl_name = "port-group",
+		.cl_flags = CF_NCODE_INLINE,
 	},
 	[NPF_RULE_CLASS_ICMP_GROUP] = {
 		.cl_name = "icmp-group",
+		.cl_flags = CF_NCODE_INLINE,
 	},
 	[NPF_RULE_CLASS_ICMPV6_GROUP] = {
 		.cl_name = "icmpv6-group",
+		.cl_flags = CF_NCODE_INLINE,
 	},
 	[NPF_RULE_CLASS_ACL] = {
 		.cl_name = "acl",
@@ -696,9 +710,11 @@ static struct rule_class_attrs npf_rule_class_attrs[NPF_RULE_CLASS_COUNT] =  {
 	},
 	[NPF_RULE_CLASS_DSCP_GROUP] = {
 		.cl_name = "dscp-group",
+		.cl_flags = CF_NCODE_INLINE,
 	},
 	[NPF_RULE_CLASS_PROTOCOL_GROUP] = {
 		.cl_name = "protocol-group",
+		.cl_flags = CF_NCODE_INLINE,
 	},
 	[NPF_RULE_CLASS_ACTION_GROUP] = {
 		.cl_name = "action-group",
@@ -767,3 +783,18 @@ static bool npf_group_class_retain_parsed(enum npf_rule_class group_class)
 
 	return (class_flags & CF_RETAIN_PARSED);
 }
+
+static bool npf_group_class_ncode_inline(enum npf_rule_class group_class)
+{
+	if (group_class >= NPF_RULE_CLASS_COUNT)
+		return false;
+
+	uint16_t class_flags = npf_rule_class_attrs[group_class].cl_flags;
+
+	return (class_flags & CF_NCODE_INLINE);
+}
+
+uint32_t npf_cfg_ncode_generation(void)
+{
+	return npf_cfg_ncode_gen;
+}
@@ -269,6 +269,16 @@ void npf_cfg_rule_group_walk(enum npf_rule_class group_class, const char *group,
 void npf_cfg_rule_group_walk_all(void *param,
 				 npf_cfg_rule_group_walker_cb walker_cb);
 
+/**
+ * Get the generation of the groups that are inlined into ncode
+ *
+ * @return Returns a counter that changes whenever a group of a class
+ *         that is copied into the ncode of referencing rules (port-group,
+ *         icmp-group, dscp-group, etc.) changes. Compiled rules may only
+ *         be reused across rulesets built with the same generation.
+ */
+uint32_t npf_cfg_ncode_generation(void);
+
 /**
  * Get the name associated with a rule class
  *
@@ -24,6 +24,7 @@
 #include "util.h"
 #include "vplane_log.h"
 #include "npf/dpi/app_cmds.h"
+#include "npf/dpi/dpi_internal.h"
 #include "npf/dpi/npf_appdb.h"
 
 static zhash_t *cmd_op_hash;
@@ -271,9 +272,78 @@ cmd_op_show_app_db_byid(FILE *f, int argc __unused, char **argv __unused)
 	return 0;
 }
 
+/* Show the DPI classification budget and per-application counters. */
+static int
+cmd_op_show_dpi_stats(FILE *f, int argc __unused, char **argv __unused)
+{
+	uint32_t pkts, bytes;
+
+	json_writer_t *json = jsonw_new(f);
+	if (!json)
+		return 1;
+
+	dpi_get_budget(&pkts, &bytes);
+
+	jsonw_pretty(json, true);
+	jsonw_name(json, "dpi");
+	jsonw_start_object(json);
+
+	jsonw_name(json, "budget");
+	jsonw_start_object(json);
+	jsonw_uint_field(json, "packets", pkts);
+	jsonw_uint_field(json, "bytes", bytes);
+	jsonw_end_object(json);
+
+	dpi_app_stats_json(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+
+	return 0;
+}
+
+/* Clear the DPI per-application counters. */
+static int
+cmd_op_clear_dpi_stats(FILE *f __unused, int argc __unused,
+		       char **argv __unused)
+{
+	dpi_app_stats_clear();
+	return 0;
+}
+
+/*
+ * Set the DPI per-flow classification budget.
+ *
+ * dpi budget <packets> <bytes>
+ *
+ * Zero is no limit.
+ */
+static int
+cmd_op_dpi_budget(FILE *f, int argc, char **argv)
+{
+	unsigned int pkts, bytes;
+
+	if (argc < 2) {
+		cmd_err(f, "%s", err_str_missing);
+		return -1;
+	}
+
+	if (get_unsigned(argv[0], &pkts) < 0 ||
+	    get_unsigned(argv[1], &bytes) < 0) {
+		cmd_err(f, "invalid budget: %s %s", argv[0], argv[1]);
+		return -1;
+	}
+
+	dpi_set_budget(pkts, bytes);
+	return 0;
+}
+
 enum cmd_op {
 	OP_SHOW_APP_DB_NAME,
 	OP_SHOW_APP_DB_ID,
+	OP_SHOW_DPI_STATS,
+	OP_CLEAR_DPI_STATS,
+	OP_DPI_BUDGET,
 };
 
 static const struct app_command app_cmd_op[] = {
@@ -285,6 +355,18 @@ static const struct app_command app_cmd_op[] = {
 		.tokens = "show app db id",
 		.handler = cmd_op_show_app_db_byid,
 	},
+	[OP_SHOW_DPI_STATS] = {
+		.tokens = "show dpi stats",
+		.handler = cmd_op_show_dpi_stats,
+	},
+	[OP_CLEAR_DPI_STATS] = {
+		.tokens = "clear dpi stats",
+		.handler = cmd_op_clear_dpi_stats,
+	},
+	[OP_DPI_BUDGET] = {
+		.tokens = "dpi budget",
+		.handler = cmd_op_dpi_budget,
+	},
 };
 
 /* Initialisation */
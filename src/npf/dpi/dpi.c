@@ -10,7 +10,10 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <string.h>
+#include <rte_cycles.h>
+#include <urcu/uatomic.h>
 #include "npf/npf_session.h"
+#include "dp_percpu.h"
 #include "dpi.h"
 #include "npf/dpi/dpi_internal.h"
 #include "pktmbuf_internal.h"
@@ -23,10 +26,20 @@ struct flow_procs_tup {
 	struct dpi_engine_procs *procs;
 };
 
+/*
+ * The packets of the two directions of a flow may be inspected on
+ * different lcores at the same time.  The inspection counters are not
+ * updated atomically, so they are approximate, and only good enough for
+ * the budget and the per-application counters.
+ */
 struct dpi_flow {
 	struct dpi_engine_flow ef;	// Must be first.
-	struct flow_procs_tup *flows;
+	uint64_t cycles;		/* spent in the engines */
+	uint32_t pkts;			/* inspected */
+	uint32_t bytes;			/* of payload inspected */
+	bool done;			/* inspection has ended */
 	size_t flows_len;
+	struct flow_procs_tup flows[];
 };
 
 #define DPI_FLOW_ENGINE_ID	ef.engine_id
@@ -72,6 +85,30 @@ static uint8_t global_engine = IANA_USER;
 static unsigned int engine_procs_len = ARRAY_SIZE(engine_procs);
 static unsigned int engine_names_len = ARRAY_SIZE(engine_name_id_map);
 
+/* Per-flow classification budget, zero for no limit */
+static uint32_t dpi_budget_pkts;
+static uint32_t dpi_budget_bytes;
+
+/*
+ * Per-application inspection counters.  There is a slot for each of the
+ * first DPI_APP_STATS_MAX application IDs of each engine, and one more
+ * that is shared by all higher IDs.
+ */
+#define DPI_APP_STATS_MAX	512
+
+enum dpi_app_stat {
+	DPI_APP_STAT_FLOWS,
+	DPI_APP_STAT_PKTS,
+	DPI_APP_STAT_CYCLES,
+	DPI_APP_STAT_COUNT
+};
+
+#define DPI_APP_STAT_IDX(_eng, _slot, _stat)				\
+	((((_eng) * (DPI_APP_STATS_MAX + 1)) + (_slot)) *		\
+	 DPI_APP_STAT_COUNT + (_stat))
+
+static struct dp_percpu_counter *dpi_app_stats;
+
 /* Find the first dpi_engine_proc which is:
  * - not NULL
  * - has the same ID as the given id
@@ -164,6 +201,90 @@ dpi_update_stats(struct dpi_engine_flow *flow, uint32_t data_len, bool forw)
 		flow->update_stats = false;
 }
 
+/**
+ * Has the given flow spent its classification budget?
+ */
+static inline bool
+dpi_flow_over_budget(struct dpi_flow *flow)
+{
+	uint32_t pkts = CMM_LOAD_SHARED(dpi_budget_pkts);
+	uint32_t bytes = CMM_LOAD_SHARED(dpi_budget_bytes);
+
+	return (pkts && flow->pkts >= pkts) || (bytes && flow->bytes >= bytes);
+}
+
+/**
+ * Stop all engines that are still inspecting the given flow.
+ */
+static void
+dpi_flow_give_up(struct dpi_flow *flow)
+{
+	for (unsigned int i = 0; i < flow->flows_len; i++) {
+		struct flow_procs_tup *tup = &flow->flows[i];
+
+		if (!tup->flow ||
+		    CALL_IF_EXIST(is_offloaded, tup->procs, tup->flow))
+			continue;
+
+		if (tup->procs->give_up)
+			tup->procs->give_up(tup->flow);
+	}
+}
+
+/**
+ * Inspection of the given flow has ended.  Add the packets and cycles spent
+ * on it to the counters of the application it was found to be, or of the
+ * first engine's undetermined slot.
+ */
+static void
+dpi_flow_done(struct dpi_flow *flow)
+{
+	struct dpi_engine_procs *procs = NULL_ENGINE;
+	uint32_t app_id = DPI_APP_UNDETERMINED;
+	unsigned int eng, slot;
+
+	if (!dpi_app_stats || !flow->flows_len ||
+	    uatomic_xchg(&flow->done, true))
+		return;
+
+	for (unsigned int i = 0; i < flow->flows_len; i++) {
+		struct flow_procs_tup *tup = &flow->flows[i];
+		uint32_t id;
+
+		if (!tup->flow || !tup->procs->flow_get_id)
+			continue;
+
+		id = tup->procs->flow_get_id(tup->flow);
+		if (!no_app_id(id)) {
+			procs = tup->procs;
+			app_id = id;
+			break;
+		}
+	}
+
+	if (!procs)
+		procs = flow->flows[0].procs;
+
+	for (eng = 0; eng < engine_procs_len; eng++)
+		if (engine_procs[eng] == procs)
+			break;
+	if (eng == engine_procs_len)
+		return;
+
+	slot = app_id & DPI_APP_MASK;
+	if (slot >= DPI_APP_STATS_MAX)
+		slot = DPI_APP_STATS_MAX;
+
+	dp_percpu_counter_inc(dpi_app_stats,
+			      DPI_APP_STAT_IDX(eng, slot, DPI_APP_STAT_FLOWS));
+	dp_percpu_counter_add(dpi_app_stats,
+			      DPI_APP_STAT_IDX(eng, slot, DPI_APP_STAT_PKTS),
+			      flow->pkts);
+	dp_percpu_counter_add(dpi_app_stats,
+			      DPI_APP_STAT_IDX(eng, slot, DPI_APP_STAT_CYCLES),
+			      flow->cycles);
+}
+
 /**
  * Run DPI processing on the given packet.
  *
@@ -181,6 +302,7 @@ dpi_process_pkt(struct npf_session *se, struct npf_cache *npc,
 	bool forw = npf_session_forward_dir(se, dir);
 	bool ret = true;
 	bool offloaded = true;
+	uint64_t start = rte_rdtsc();
 
 	for (unsigned int i = 0; i < dpi_flow->flows_len; i++) {
 		struct dpi_engine_procs *procs = dpi_flow->flows[i].procs;
@@ -208,8 +330,19 @@ dpi_process_pkt(struct npf_session *se, struct npf_cache *npc,
 			&& offloaded;
 	}
 
-	if (offloaded)
+	dpi_flow->cycles += rte_rdtsc() - start;
+	dpi_flow->pkts++;
+	dpi_flow->bytes += data_len;
+
+	if (!offloaded && dpi_flow_over_budget(dpi_flow)) {
+		dpi_flow_give_up(dpi_flow);
+		offloaded = true;
+	}
+
+	if (offloaded) {
 		npf_session_set_pkt_hook(se, NULL);
+		dpi_flow_done(dpi_flow);
+	}
 
 	pktmbuf_mdata_set(mbuf, PKT_MDATA_DPI_SEEN);
 	return ret;
@@ -257,6 +390,11 @@ dpi_engine_id_to_name(uint8_t id)
 bool
 dpi_init(uint8_t engine_id)
 {
+	if (!dpi_app_stats)
+		dpi_app_stats = dp_percpu_counter_alloc(
+			engine_procs_len * (DPI_APP_STATS_MAX + 1) *
+			DPI_APP_STAT_COUNT);
+
 	if (engine_id == IANA_RESERVED) {
 		/* Start all engines. */
 		ENGINE_PROC_EXEC_ALL(init);
@@ -288,14 +426,10 @@ void
 dpi_session_flow_destroy(struct dpi_flow *flow)
 {
 	if (flow) {
-		if (flow->flows) {
-			for (unsigned int i = 0; i < flow->flows_len; i++) {
-				struct flow_procs_tup *tup = &flow->flows[i];
-				if (tup->flow && tup->procs->destructor)
-					tup->procs->destructor(tup->flow);
-			}
-
-			free(flow->flows);
+		for (unsigned int i = 0; i < flow->flows_len; i++) {
+			struct flow_procs_tup *tup = &flow->flows[i];
+			if (tup->flow && tup->procs->destructor)
+				tup->procs->destructor(tup->flow);
 		}
 
 		free(flow);
@@ -319,27 +453,22 @@ dpi_session_first_packet(struct npf_session *se, struct npf_cache *npc,
 	if (protocol != IPPROTO_TCP && protocol != IPPROTO_UDP)
 		return -EINVAL;
 
-	struct dpi_flow *flow = zmalloc_aligned(sizeof(struct dpi_flow));
+	/* The engine flows are in the same allocation */
+	struct dpi_flow *flow = zmalloc_aligned(sizeof(struct dpi_flow) +
+			engines_len * sizeof(struct flow_procs_tup));
 	if (!flow)
 		return -ENOMEM;
 
-	flow->flows = zmalloc_aligned(engines_len
-			* sizeof(struct flow_procs_tup));
-	if (!flow->flows) {
-		free(flow);
-		return -ENOMEM;
-	}
-
 	flow->flows_len = engines_len;
 
 	/* Add it or lose the race */
 	if (!npf_session_set_dpi(se, flow)) {
-		free(flow->flows);
 		free(flow);
 		return -EEXIST;
 	}
 
 	uint32_t data_len = dpi_get_data_len(npc, mbuf);
+	uint64_t start = rte_rdtsc();
 
 	for (i = 0; i < engines_len; i++) {
 		struct dpi_engine_procs *engine = NULL_ENGINE;
@@ -373,13 +502,23 @@ dpi_session_first_packet(struct npf_session *se, struct npf_cache *npc,
 		}
 	}
 
-	npf_session_set_pkt_hook(se, dpi_process_pkt);
+	flow->cycles = rte_rdtsc() - start;
+	flow->pkts = 1;
+	flow->bytes = data_len;
+
+	if (!dpi_flow_get_offloaded(flow) && dpi_flow_over_budget(flow))
+		dpi_flow_give_up(flow);
+
+	if (dpi_flow_get_offloaded(flow))
+		dpi_flow_done(flow);
+	else
+		npf_session_set_pkt_hook(se, dpi_process_pkt);
 
 	return ret;
 
 free_flows:
 	for (unsigned int j = 0; j < i; j++) {
-		struct flow_procs_tup *tup = &flow->flows[i];
+		struct flow_procs_tup *tup = &flow->flows[j];
 		if (!tup)
 			continue;
 		if (!tup->procs)
@@ -392,8 +531,6 @@ free_flows:
 			tup->procs->destructor(tup->flow);
 	}
 
-	free(flow->flows);
-	flow->flows = NULL;
 	flow->flows_len = 0;
 
 	return ret;
@@ -467,7 +604,7 @@ dpi_flow_get_offloaded(struct dpi_flow *flow)
 bool
 dpi_flow_get_error(struct dpi_flow *flow)
 {
-	if (!flow || !flow->flows)
+	if (!flow || !flow->flows_len)
 		return true;
 
 	for (unsigned int i = 0; i < flow->flows_len; i++) {
@@ -660,3 +797,76 @@ uint32_t dpi_refcount_dec(uint8_t engine_id)
 
 	return 0;
 }
+
+void dpi_set_budget(uint32_t pkts, uint32_t bytes)
+{
+	CMM_STORE_SHARED(dpi_budget_pkts, pkts);
+	CMM_STORE_SHARED(dpi_budget_bytes, bytes);
+}
+
+void dpi_get_budget(uint32_t *pkts, uint32_t *bytes)
+{
+	*pkts = CMM_LOAD_SHARED(dpi_budget_pkts);
+	*bytes = CMM_LOAD_SHARED(dpi_budget_bytes);
+}
+
+void dpi_app_stats_json(json_writer_t *json)
+{
+	char name[MAX_DPI_LOG_SIZE];
+
+	jsonw_name(json, "applications");
+	jsonw_start_array(json);
+
+	for (unsigned int eng = 0; dpi_app_stats && eng < engine_procs_len;
+	     eng++) {
+		struct dpi_engine_procs *procs = engine_procs[eng];
+
+		for (unsigned int slot = 0; slot <= DPI_APP_STATS_MAX; slot++) {
+			uint64_t flows = dp_percpu_counter_read(dpi_app_stats,
+				DPI_APP_STAT_IDX(eng, slot,
+						 DPI_APP_STAT_FLOWS));
+			uint32_t id;
+			size_t used = 0;
+
+			if (!flows)
+				continue;
+
+			id = (procs->id << DPI_ENGINE_SHIFT) | slot;
+
+			jsonw_start_object(json);
+			jsonw_string_field(json, "engine",
+					   dpi_engine_id_to_name(procs->id));
+			if (slot == DPI_APP_STATS_MAX) {
+				jsonw_string_field(json, "app-name",
+						   "(Other)");
+			} else {
+				jsonw_uint_field(json, "app-id", id);
+				if (procs->id_to_name) {
+					dpi_app_id_to_buf(name, &used,
+							  sizeof(name), id,
+							  procs->id_to_name);
+					jsonw_string_field(json, "app-name",
+							   name);
+				}
+			}
+			jsonw_uint_field(json, "flows", flows);
+			jsonw_uint_field(json, "packets",
+				dp_percpu_counter_read(dpi_app_stats,
+					DPI_APP_STAT_IDX(eng, slot,
+							 DPI_APP_STAT_PKTS)));
+			jsonw_uint_field(json, "cycles",
+				dp_percpu_counter_read(dpi_app_stats,
+					DPI_APP_STAT_IDX(eng, slot,
+							 DPI_APP_STAT_CYCLES)));
+			jsonw_end_object(json);
+		}
+	}
+
+	jsonw_end_array(json);
+}
+
+void dpi_app_stats_clear(void)
+{
+	if (dpi_app_stats)
+		dp_percpu_counter_clear(dpi_app_stats);
+}
@@ -262,6 +262,23 @@ void dpi_info_log(struct dpi_flow *dpi_flow, char *buf,
 struct dpi_engine_flow *dpi_get_engine_flow(struct dpi_flow *flow,
 					    uint8_t engine_id);
 
+/*
+ * Per-flow classification budget.  Once a flow has had this many packets,
+ * or this many bytes of payload, inspected without all engines reaching a
+ * result, the engines give up on it and release their state.  Zero is no
+ * limit.  A flow's packets are counted without locking across both
+ * directions, so a flow may be inspected for a packet or two more.
+ */
+void dpi_set_budget(uint32_t pkts, uint32_t bytes);
+void dpi_get_budget(uint32_t *pkts, uint32_t *bytes);
+
+/*
+ * Write the per-application inspection counters, i.e. the flows, packets
+ * and cycles spent on flows of each application, to the given writer.
+ */
+void dpi_app_stats_json(json_writer_t *json);
+void dpi_app_stats_clear(void);
+
 /*
  * Converts an application ID into a string, writing it to the buffer at
  * "used_buf_len", ensuring it does not go off the end of the buffer.
@@ -357,6 +374,14 @@ struct dpi_engine_procs {
 	 */
 	bool (*is_offloaded)(struct dpi_engine_flow *flow);
 
+	/**
+	 * Stop inspecting the given flow and release any inspection state
+	 * held for it, leaving the flow offloaded with whatever result has
+	 * been found so far.  Called when the flow's classification budget
+	 * has been spent.
+	 */
+	void (*give_up)(struct dpi_engine_flow *flow);
+
 	/**
 	 * Get the protocol ID of the given flow.
 	 */
@@ -382,6 +407,11 @@ struct dpi_engine_procs {
 	 */
 	uint32_t (*type_to_id)(const char *type);
 
+	/**
+	 * Get the name for the given application ID.
+	 */
+	const char *(*id_to_name)(uint32_t id);
+
 	/**
 	 * Write the JSON representation of the given flow to the given
 	 * writer. Return false if nothing was written, else true.
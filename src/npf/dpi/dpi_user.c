@@ -312,6 +312,7 @@ struct dpi_engine_procs user_engine_procs = {
 	.flow_get_type = dpi_user_get_type,
 	.name_to_id = dpi_user_name_to_id,
 	.type_to_id = dpi_user_type_to_id,
+	.id_to_name = dpi_user_id_to_name,
 	.info_json = dpi_user_flow_json,
 	.info_log = dpi_user_flow_log,
 };
@@ -13,10 +13,13 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <rte_config.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "npf/npf.h"
@@ -40,16 +43,36 @@ static uint32_t ndpi_refcount;
 
 static const char *dpi_ndpi_app_id_to_name(uint32_t app_id);
 
+/*
+ * Inspection state of a flow, only needed until the flow is offloaded.
+ *
+ * These come from a pool with a cache per lcore, so starting to inspect a
+ * flow does not need to go to the allocator for the IDs.  The flow key
+ * is allocated by nDPI, as only nDPI knows how to free what it hangs off
+ * it.
+ */
+struct ndpi_flow_state {
+	struct ndpi_flow_struct *key;
+	struct ndpi_id_struct src_id;
+	struct ndpi_id_struct dest_id;
+	bool pooled;
+	struct rcu_head ns_rcu_head;
+};
+
+/* Flow states per lcore in the pool, and in each lcore's cache */
+#define NDPI_STATE_POOL_SIZE	1024
+#define NDPI_STATE_POOL_CACHE	256
+
+static struct rte_mempool *ndpi_state_pool;
+
 struct ndpi_flow {
 	struct dpi_engine_flow ef;	// Must be first.
-	struct ndpi_flow_struct *key;
+	struct ndpi_flow_state *state;
 	bool error;
 	bool offloaded;
 	uint32_t application;
 	uint32_t protocol;
 	uint32_t type;
-	struct ndpi_id_struct *src_id;
-	struct ndpi_id_struct *dest_id;
 	struct rcu_head n_rcu_head;
 };
 
@@ -71,6 +94,58 @@ dpi_from_ndpi_proto(uint16_t id)
 	return DPI_ENGINE_NDPI | id;
 }
 
+/**
+ * Get a flow state, from the pool if it has any left.
+ */
+static struct ndpi_flow_state *
+dpi_ndpi_state_get(void)
+{
+	struct ndpi_flow_state *state = NULL;
+
+	if (ndpi_state_pool &&
+	    rte_mempool_get(ndpi_state_pool, (void **)&state) == 0) {
+		memset(state, 0, sizeof(*state));
+		state->pooled = true;
+		return state;
+	}
+
+	return zmalloc_aligned(sizeof(*state));
+}
+
+/**
+ * Free the flow state, and nDPI's flow key.
+ */
+static void
+dpi_ndpi_state_put(struct ndpi_flow_state *state)
+{
+	ndpi_free_flow(state->key);
+
+	if (state->pooled)
+		rte_mempool_put(ndpi_state_pool, state);
+	else
+		free(state);
+}
+
+static void
+dpi_ndpi_state_free(struct rcu_head *head)
+{
+	dpi_ndpi_state_put(caa_container_of(head, struct ndpi_flow_state,
+					    ns_rcu_head));
+}
+
+/**
+ * Release the flow's inspection state, once no other lcore can be
+ * processing a packet with it.
+ */
+static void
+dpi_ndpi_state_release(struct ndpi_flow *flow)
+{
+	struct ndpi_flow_state *state = uatomic_xchg(&flow->state, NULL);
+
+	if (state)
+		call_rcu(&state->ns_rcu_head, dpi_ndpi_state_free);
+}
+
 /**
  * Process the given packet with nDPI.
  *
@@ -81,7 +156,8 @@ dpi_from_ndpi_proto(uint16_t id)
  */
 static bool
 dpi_ndpi_process(struct ndpi_detection_module_struct *detect,
-		struct rte_mbuf *mbuf, struct ndpi_flow *flow)
+		struct rte_mbuf *mbuf, struct ndpi_flow *flow,
+		struct ndpi_flow_state *state)
 {
 	if (unlikely(!detect))
 		return false;
@@ -92,9 +168,9 @@ dpi_ndpi_process(struct ndpi_detection_module_struct *detect,
 	const unsigned char *data =
 		rte_pktmbuf_mtod(mbuf, const unsigned char *) + offset;
 
-	ndpi_protocol proto = ndpi_detection_process_packet(detect, flow->key,
+	ndpi_protocol proto = ndpi_detection_process_packet(detect, state->key,
 			data, data_len, (uint64_t) get_time_uptime(),
-			flow->src_id, flow->dest_id);
+			&state->src_id, &state->dest_id);
 
 	flow->protocol = dpi_from_ndpi_proto(proto.master_protocol);
 	flow->application = dpi_from_ndpi_proto(proto.app_protocol);
@@ -109,7 +185,8 @@ dpi_ndpi_process(struct ndpi_detection_module_struct *detect,
  * Process the given packet with nDPI
  *
  * The flow attached to the given session will be placed in an error state if
- * the DPI engine is invalid.
+ * the DPI engine is invalid.  The inspection state is released as soon as
+ * the flow is offloaded.
  *
  * @return false if the flow attached to the given session has an invalid key,
  * true otherwise.
@@ -119,20 +196,41 @@ dpi_ndpi_process_pkt(struct dpi_engine_flow *engine_flow,
 		struct rte_mbuf *mbuf, int dir __unused)
 {
 	struct ndpi_flow *flow = (struct ndpi_flow *) engine_flow;
+	struct ndpi_flow_state *state = rcu_dereference(flow->state);
 
-	if (unlikely(!flow->key))
+	/* Released by another lcore */
+	if (!state)
+		return true;
+
+	if (unlikely(!state->key))
 		return false;
 
 	if (!dpi_ndpi_process(detection_modules[dp_lcore_id()],
-				mbuf, flow)) {
+				mbuf, flow, state)) {
 		flow->protocol = DPI_APP_ERROR;
 		flow->offloaded = true;
 		flow->error = true;
 	}
 
+	if (flow->offloaded)
+		dpi_ndpi_state_release(flow);
+
 	return true;
 }
 
+/**
+ * The flow's classification budget is spent, so keep what has been found
+ * so far and release the inspection state.
+ */
+static void
+dpi_ndpi_give_up(struct dpi_engine_flow *engine_flow)
+{
+	struct ndpi_flow *flow = (struct ndpi_flow *) engine_flow;
+
+	flow->offloaded = true;
+	dpi_ndpi_state_release(flow);
+}
+
 static bool initialised;
 
 static bool dpi_ndpi_terminate(void);
@@ -154,6 +252,21 @@ dpi_ndpi_init(void)
 	set_ndpi_malloc(zmalloc_aligned);
 	NDPI_BITMASK_SET_ALL(all);
 
+	/*
+	 * The pool outlives the engine, as flows may still hold states when
+	 * the engine is terminated.
+	 */
+	if (!ndpi_state_pool) {
+		ndpi_state_pool = rte_mempool_create("ndpi_flow_state",
+				NDPI_STATE_POOL_SIZE * rte_lcore_count(),
+				sizeof(struct ndpi_flow_state),
+				NDPI_STATE_POOL_CACHE, 0,
+				NULL, NULL, NULL, NULL, SOCKET_ID_ANY, 0);
+		if (!ndpi_state_pool)
+			RTE_LOG(NOTICE, DATAPLANE,
+				"No nDPI flow state pool, using the heap\n");
+	}
+
 	RTE_LCORE_FOREACH(lcore) {
 		struct ndpi_detection_module_struct *detect
 			= ndpi_init_detection_module();
@@ -227,9 +340,8 @@ dpi_ndpi_free(struct rcu_head *head)
 	struct ndpi_flow *flow = caa_container_of(head, struct ndpi_flow,
 						  n_rcu_head);
 
-	ndpi_free_flow(flow->key);
-	ndpi_free(flow->src_id);
-	ndpi_free(flow->dest_id);
+	if (flow->state)
+		dpi_ndpi_state_put(flow->state);
 	free(flow);
 }
 
@@ -260,24 +372,19 @@ dpi_ndpi_session_first_packet(struct npf_session *se __unused,
 		return -ENOMEM;
 
 	flow->NDPI_FLOW_ENGINE_ID = IANA_NDPI;
-	flow->key = NULL;
 	flow->application = DPI_APP_UNDETERMINED;
 	flow->protocol = DPI_APP_UNDETERMINED;
 	flow->type = DPI_APP_TYPE_NONE;
 	flow->error = false;
 	flow->offloaded = false;
 
-	flow->key = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT);
-	if (!flow->key)
-		goto key_error;
+	flow->state = dpi_ndpi_state_get();
+	if (!flow->state)
+		goto state_error;
 
-	flow->src_id = ndpi_malloc(SIZEOF_ID_STRUCT);
-	if (!flow->src_id)
-		goto src_id_error;
-
-	flow->dest_id = ndpi_malloc(SIZEOF_ID_STRUCT);
-	if (!flow->dest_id)
-		goto dest_id_error;
+	flow->state->key = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT);
+	if (!flow->state->key)
+		goto key_error;
 
 	if (data_len != 0 && !dpi_ndpi_process_pkt(
 				(struct dpi_engine_flow *)flow, mbuf, dir))
@@ -286,18 +393,10 @@ dpi_ndpi_session_first_packet(struct npf_session *se __unused,
 	*dpi_flow = (struct dpi_engine_flow *)flow;
 	return 0;
 
-dest_id_error:
-	ndpi_free(flow->src_id);
-	flow->src_id = NULL;
-
-src_id_error:
-	ndpi_free(flow->key);
-	flow->key = NULL;
-	flow->error = true;
-	flow->offloaded = true;
-	flow->protocol = DPI_APP_ERROR;
-
 key_error:
+	dpi_ndpi_state_put(flow->state);
+
+state_error:
 	free(flow);
 	return -ENOMEM;
 }
@@ -491,12 +590,14 @@ struct dpi_engine_procs ndpi_engine_procs = {
 	.first_packet = dpi_ndpi_session_first_packet,
 	.process_pkt = dpi_ndpi_process_pkt,
 	.is_offloaded = dpi_ndpi_flow_get_offloaded,
+	.give_up = dpi_ndpi_give_up,
 	.is_error = dpi_ndpi_flow_get_error,
 	.flow_get_proto = dpi_ndpi_flow_get_app_proto,
 	.flow_get_id = dpi_ndpi_flow_get_app_id,
 	.flow_get_type = dpi_ndpi_flow_get_app_type,
 	.name_to_id = dpi_ndpi_app_name_to_id,
 	.type_to_id = dpi_ndpi_app_type_name_to_id,
+	.id_to_name = dpi_ndpi_app_id_to_name,
 	.info_json = dpi_ndpi_info_json,
 	.info_log = dpi_ndpi_info_log,
 };
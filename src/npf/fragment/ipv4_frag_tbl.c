@@ -40,6 +40,7 @@
  *
  */
 
+#include <errno.h>
 #include <linux/snmp.h>
 #include <rte_common.h>
 #include <rte_cycles.h>
@@ -47,9 +48,12 @@
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_spinlock.h>
 #include <rte_timer.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <urcu/system.h>
 
 #include "ipv4_frag_tbl.h"
 #include "ipv4_rsmbl.h"
@@ -58,274 +62,346 @@
 #include "vplane_log.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
+/*
+ * A reassembly table.  Fragment sets are on the age list, oldest first,
+ * while in use, and on the free list otherwise.  A per-lcore table is only
+ * used by its lcore, so is not locked.  ft_lock is only taken for the
+ * shared table.
+ */
+struct ipv4_frag_tbl {
+	rte_spinlock_t		ft_lock;
+	uint32_t		ft_used;
+	struct cds_list_head	ft_age;
+	struct ipv4_frag_pkt	*ft_free;
+	struct ipv4_frag_pkt	*ft_bucket[IPV4_FRAG_TBL_BUCKETS];
+	struct ipv4_frag_pkt	ft_pkts[IPV4_MAX_FRAG_SETS];
+};
 
 static struct rte_timer ipv4_timer;
 static uint32_t hash_seed;
 
-/* free a pkt */
-static void ipv4_frag_free_pkt(struct rcu_head *head)
+/* Per-lcore tables, followed by the shared table */
+static struct ipv4_frag_tbl **ipv4_frag_tbls;
+static unsigned int ipv4_frag_shared;
+
+static struct ipv4_frag_tbl *ipv4_frag_tbl_create(void)
 {
-	struct ipv4_frag_pkt *pkt = caa_container_of(head,
-					struct ipv4_frag_pkt, pkt_rcu_head);
+	struct ipv4_frag_tbl *tbl;
 	uint32_t i;
 
-	for (i = 0; i != pkt->last_idx; i++) {
-		if (pkt->frags[i].mb)
-			rte_pktmbuf_free(pkt->frags[i].mb);
+	tbl = zmalloc_aligned(sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+
+	rte_spinlock_init(&tbl->ft_lock);
+	CDS_INIT_LIST_HEAD(&tbl->ft_age);
+
+	for (i = 0; i < IPV4_MAX_FRAG_SETS; i++) {
+		tbl->ft_pkts[i].pkt_next = tbl->ft_free;
+		tbl->ft_free = &tbl->ft_pkts[i];
 	}
-	free(pkt);
+	return tbl;
 }
 
-/* update timeout stats */
-static void ipv4_frag_timeout_stats(struct ipv4_frag_pkt *pkt)
+/*
+ * Create the table of a forwarding lcore, when the lcore starts.  The
+ * lcore uses the shared table if this fails.
+ */
+int ipv4_frag_tbl_lcore_init(unsigned int lcore_id)
 {
-	uint32_t i;
+	struct ipv4_frag_tbl *tbl;
 
-	/* temp while frag vrf unaware */
-	IPSTAT_INC(VRF_DEFAULT_ID, IPSTATS_MIB_REASMFAILS);
-	for (i = 0; i != pkt->last_idx; i++) {
-		if (pkt->frags[i].mb)
-			/* temp while frag vrf unaware */
-			IPSTAT_INC(VRF_DEFAULT_ID, IPSTATS_MIB_REASMTIMEOUT);
+	if (lcore_id >= ipv4_frag_shared || ipv4_frag_tbls[lcore_id])
+		return 0;
+
+	tbl = ipv4_frag_tbl_create();
+	if (!tbl) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Can't allocate ipv4 reassembly table for core %u\n",
+			lcore_id);
+		return -ENOMEM;
 	}
+	rcu_assign_pointer(ipv4_frag_tbls[lcore_id], tbl);
+	return 0;
 }
 
-/* Delete a frag packet struct from the hash table */
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *pkt)
+/*
+ * Get the table of a forwarding lcore, which only that lcore may use
+ * unless it has stopped forwarding.  Returns NULL if it has no table.
+ */
+struct ipv4_frag_tbl *ipv4_frag_tbl_lcore_get(unsigned int lcore_id)
 {
-	if (!cds_lfht_del(frag_table, &pkt->pkt_node))
-		call_rcu(&pkt->pkt_rcu_head, ipv4_frag_free_pkt);
+	return rcu_dereference(ipv4_frag_tbls[lcore_id]);
 }
 
 /*
- * Clean out expired frag pkts
- *
- * NB ipv4_gc() is a callback function for rte_timer_reset(),
- *    so we use __rte_unused rather than __unused.
+ * Forwarding lcores have their own table.  The master thread and
+ * non-dataplane threads use the shared table, which is locked.
  */
-static void ipv4_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
+struct ipv4_frag_tbl *ipv4_frag_tbl_get(void)
 {
-	struct cds_lfht_iter iter;
-	struct ipv4_frag_pkt *pkt;
-	uint64_t current = rte_get_timer_cycles();
-	vrfid_t vrfid;
-	struct vrf *vrf;
-
-	VRF_FOREACH(vrf, vrfid) {
-		cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
-					pkt_node) {
-			if (pkt->pkt_expire < current) {
-				ipv4_frag_timeout_stats(pkt);
-				ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
-			}
-		}
+	unsigned int lcore_id = rte_lcore_id();
+	struct ipv4_frag_tbl *tbl;
+
+	if (likely(lcore_id < ipv4_frag_shared &&
+		   lcore_id != rte_get_master_lcore())) {
+		tbl = rcu_dereference(ipv4_frag_tbls[lcore_id]);
+		if (likely(tbl))
+			return tbl;
 	}
+
+	tbl = ipv4_frag_tbls[ipv4_frag_shared];
+	rte_spinlock_lock(&tbl->ft_lock);
+	return tbl;
 }
 
-/* Clear the rte_mbufs from a pkt */
-void ipv4_frag_clear(struct ipv4_frag_pkt *pkt)
+void ipv4_frag_tbl_put(struct ipv4_frag_tbl *tbl)
+{
+	if (tbl == ipv4_frag_tbls[ipv4_frag_shared])
+		rte_spinlock_unlock(&tbl->ft_lock);
+}
+
+/* For fragment table UT */
+uint32_t ipv4_frag_tbl_used(struct ipv4_frag_tbl *tbl)
+{
+	return tbl->ft_used;
+}
+
+/* update timeout stats */
+static void ipv4_frag_timeout_stats(struct ipv4_frag_pkt *pkt)
 {
 	uint32_t i;
 
-	for (i = 0; i != pkt->last_idx; i++)
-		pkt->frags[i].mb = NULL;
+	IPSTAT_INC(pkt->pkt_key.vrfid, IPSTATS_MIB_REASMFAILS);
+	for (i = 0; i != pkt->last_idx; i++) {
+		if (pkt->frags[i].mb)
+			IPSTAT_INC(pkt->pkt_key.vrfid,
+				   IPSTATS_MIB_REASMTIMEOUT);
+	}
 }
 
-/* Hash the key */
-static unsigned long ipv4_hash(const struct ipv4_frag_key *key)
+/*
+ * Delete a frag packet struct from its table, freeing any fragments it
+ * still holds.
+ */
+void ipv4_frag_free(struct ipv4_frag_tbl *tbl, struct ipv4_frag_pkt *pkt)
 {
-	uint32_t v;
-	const uint32_t *p;
+	struct ipv4_frag_pkt **pp;
+	uint32_t i;
 
-	p = (const uint32_t *)&key->src_dst;
-	v = rte_jhash_3words(p[0], p[1], key->id, hash_seed);
+	for (i = 0; i != pkt->last_idx; i++) {
+		if (pkt->frags[i].mb)
+			rte_pktmbuf_free(pkt->frags[i].mb);
+	}
+	memset(pkt->frags, 0, pkt->last_idx * sizeof(pkt->frags[0]));
+
+	pp = &tbl->ft_bucket[pkt->pkt_hash & (IPV4_FRAG_TBL_BUCKETS - 1)];
+	while (*pp != pkt)
+		pp = &(*pp)->pkt_next;
+	*pp = pkt->pkt_next;
 
-	return v;
+	cds_list_del(&pkt->pkt_age_node);
+	pkt->pkt_next = tbl->ft_free;
+	tbl->ft_free = pkt;
+	tbl->ft_used--;
 }
 
-/* hash table match function */
-static int ipv4_match(struct cds_lfht_node *node, const void *data)
+/* Clean out expired frag pkts, which are at the start of the age list */
+static void ipv4_frag_expire(struct ipv4_frag_tbl *tbl, uint64_t current)
 {
-	const struct ipv4_frag_key *key = data;
 	struct ipv4_frag_pkt *pkt;
-	int rc = 1;
 
-	pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
+	while (!cds_list_empty(&tbl->ft_age)) {
+		pkt = cds_list_first_entry(&tbl->ft_age, struct ipv4_frag_pkt,
+					   pkt_age_node);
+		if (pkt->pkt_expire >= current)
+			break;
 
-	if (key->src_dst != pkt->pkt_key.src_dst)
-		rc = 0;
-	if (key->id != pkt->pkt_key.id)
-		rc = 0;
-	return rc;
+		ipv4_frag_timeout_stats(pkt);
+		ipv4_frag_free(tbl, pkt);
+	}
 }
 
-/* Count nodes */
-static unsigned long ipv4_frag_count(struct cds_lfht *frag_table)
+/* Called from the main loop of each forwarding lcore, for its own table */
+void ipv4_frag_tbl_service(unsigned int lcore_id)
 {
-	unsigned long count;
-	long dummy;
+	struct ipv4_frag_tbl *tbl = ipv4_frag_tbls[lcore_id];
+
+	if (likely(!tbl || !tbl->ft_used))
+		return;
 
-	cds_lfht_count_nodes(frag_table, &dummy, &count, &dummy);
-	return count;
+	ipv4_frag_expire(tbl, rte_get_timer_cycles());
 }
 
-/* Add a new pkt if max not reached */
-static struct ipv4_frag_pkt *
-ipv4_frag_create(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv4_frag_key *key)
+/*
+ * An lcore is about to stop polling, to sleep or exit, or has no queues
+ * left to poll.  Nothing would expire its sets meanwhile, so they are
+ * freed now and counted as timeouts.  Called by the lcore itself.
+ */
+void ipv4_frag_tbl_release(unsigned int lcore_id)
 {
-	struct ipv4_frag_pkt *pkt;
-	struct cds_lfht_node *node;
-	unsigned long count;
+	struct ipv4_frag_tbl *tbl;
 
-	/* Max packets reached? */
-	count = ipv4_frag_count(frag_table);
-	if (count >= IPV4_MAX_FRAG_SETS)
-		return NULL;
+	if (lcore_id >= ipv4_frag_shared)
+		return;
 
-	pkt = calloc(1, sizeof(struct ipv4_frag_pkt));
-	if (!pkt)
-		return NULL;
+	tbl = ipv4_frag_tbls[lcore_id];
+	if (likely(!tbl || !tbl->ft_used))
+		return;
 
-	rte_spinlock_init(&pkt->pkt_lock);
-	pkt->pkt_key.src_dst = key->src_dst;
-	pkt->pkt_key.id = key->id;
-	pkt->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
-	cds_lfht_node_init(&pkt->pkt_node);
-	pkt->pkt_expire = rte_get_timer_cycles() +
-		(rte_get_timer_hz() * IPV4_FRAG_SET_TTL);
+	ipv4_frag_expire(tbl, UINT64_MAX);
+}
 
-	/*
-	 * Now try to add the new pkt, if somebody beat us to it,
-	 * use that one.
-	 */
-	node = cds_lfht_add_unique(frag_table, hash, ipv4_match,
-				key, &pkt->pkt_node);
-	if (node != &pkt->pkt_node) {
-		free(pkt);
-		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
-	}
+/*
+ * Clean out expired frag pkts from the shared table.  Each lcore ages its
+ * own table.
+ */
+void ipv4_frag_tbl_gc(void)
+{
+	struct ipv4_frag_tbl *tbl = ipv4_frag_tbls[ipv4_frag_shared];
 
-	return pkt;
+	if (!CMM_LOAD_SHARED(tbl->ft_used))
+		return;
+
+	rte_spinlock_lock(&tbl->ft_lock);
+	ipv4_frag_expire(tbl, rte_get_timer_cycles());
+	rte_spinlock_unlock(&tbl->ft_lock);
 }
 
-/* Lookup a 'pkt' in the hash table */
-static struct ipv4_frag_pkt *
-ipv4_frag_lookup(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv4_frag_key *key)
+/*
+ * NB ipv4_gc() is a callback function for rte_timer_reset(),
+ *    so we use __rte_unused rather than __unused.
+ */
+static void ipv4_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 {
-	struct ipv4_frag_pkt *pkt;
-	struct cds_lfht_iter iter;
-	struct cds_lfht_node *node;
+	ipv4_frag_tbl_gc();
+}
 
-	cds_lfht_lookup(frag_table, hash, ipv4_match, key, &iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (node)
-		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
-	else
-		pkt = NULL;
+/* Clear the rte_mbufs from a pkt */
+void ipv4_frag_clear(struct ipv4_frag_pkt *pkt)
+{
+	uint32_t i;
 
-	return pkt;
+	for (i = 0; i != pkt->last_idx; i++)
+		pkt->frags[i].mb = NULL;
+}
+
+/* Hash the key */
+static uint32_t ipv4_hash(const struct ipv4_frag_key *key)
+{
+	const uint32_t *p;
+
+	p = (const uint32_t *)&key->src_dst;
+	return rte_jhash_3words(p[0], p[1], key->id, hash_seed ^ key->vrfid);
+}
+
+static bool ipv4_match(const struct ipv4_frag_pkt *pkt,
+		       const struct ipv4_frag_key *key)
+{
+	return key->src_dst == pkt->pkt_key.src_dst &&
+		key->id == pkt->pkt_key.id &&
+		key->vrfid == pkt->pkt_key.vrfid;
 }
 
 /*
  * Find an entry in the table for the corresponding fragment.
- * If such entry is not present, then allocate a new one.
+ * If such entry is not present, then take a free one, evicting the oldest
+ * entry if the table is full.
  */
-struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
+struct ipv4_frag_pkt *ipv4_frag_find(struct ipv4_frag_tbl *tbl,
 				     const struct ipv4_frag_key *key)
 {
+	uint32_t hash = ipv4_hash(key);
+	struct ipv4_frag_pkt **bucket;
 	struct ipv4_frag_pkt *pkt;
-	unsigned long hash = ipv4_hash(key);
-	struct cds_lfht *frag_table = vrf->v_ipv4_frag_table;
-
-	pkt = ipv4_frag_lookup(frag_table, hash, key);
-	if (!pkt)
-		pkt = ipv4_frag_create(frag_table, hash, key);
-	return pkt;
-}
+	uint64_t current;
 
-static void
-ipv4_fragment_table_uninit(struct vrf *vrf)
-{
-	struct cds_lfht_iter iter;
-	struct ipv4_frag_pkt *pkt;
+	bucket = &tbl->ft_bucket[hash & (IPV4_FRAG_TBL_BUCKETS - 1)];
+	for (pkt = *bucket; pkt; pkt = pkt->pkt_next) {
+		if (pkt->pkt_hash == hash && ipv4_match(pkt, key))
+			return pkt;
+	}
 
-	if (!vrf->v_ipv4_frag_table)
-		return;
+	current = rte_get_timer_cycles();
+	ipv4_frag_expire(tbl, current);
 
-	cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
-				pkt_node) {
-		ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
+	if (unlikely(!tbl->ft_free)) {
+		pkt = cds_list_first_entry(&tbl->ft_age, struct ipv4_frag_pkt,
+					   pkt_age_node);
+		IPSTAT_INC(pkt->pkt_key.vrfid, IPSTATS_MIB_REASMFAILS);
+		ipv4_frag_free(tbl, pkt);
 	}
 
-	dp_ht_destroy_deferred(vrf->v_ipv4_frag_table);
-	vrf->v_ipv4_frag_table = NULL;
+	pkt = tbl->ft_free;
+	tbl->ft_free = pkt->pkt_next;
+
+	pkt->pkt_key = *key;
+	pkt->pkt_hash = hash;
+	pkt->pkt_expire = current + (rte_get_timer_hz() * IPV4_FRAG_SET_TTL);
+	pkt->total_size = 0;
+	pkt->frag_size = 0;
+	pkt->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
+
+	pkt->pkt_next = *bucket;
+	*bucket = pkt;
+	cds_list_add_tail(&pkt->pkt_age_node, &tbl->ft_age);
+	tbl->ft_used++;
+
+	return pkt;
 }
 
-/*
- * Create a new IPV4 Frag table.
- */
-static int
-ipv4_fragment_table_init(struct vrf *vrf)
+void ipv4_frag_tbl_init(void)
 {
-	/*
-	 * Create a RCU hash table.  Since we only support a
-	 * (relatively) small number of frag pkt's at any given time,
-	 * allow to grow but not shrink.  We can save cycles by not doing
-	 * accounting for splits.
-	 */
-	vrf->v_ipv4_frag_table = cds_lfht_new(IPV4_FRAG_HT_INIT,
-					      IPV4_FRAG_HT_MIN,
-					      IPV4_FRAG_HT_MAX,
-					      CDS_LFHT_AUTO_RESIZE, NULL);
-	if (!vrf->v_ipv4_frag_table) {
-		DP_LOG_W_VRF(ERR, DATAPLANE, vrf->v_id,
-			     "Unable to create ipv4 frag hash table\n");
-		return -1;
-	}
+	ipv4_frag_shared = get_lcore_max() + 1;
+	ipv4_frag_tbls = zmalloc_aligned((ipv4_frag_shared + 1) *
+					 sizeof(*ipv4_frag_tbls));
+	if (!ipv4_frag_tbls)
+		rte_panic("Can't allocate ipv4 reassembly tables\n");
+
+	ipv4_frag_tbls[ipv4_frag_shared] = ipv4_frag_tbl_create();
+	if (!ipv4_frag_tbls[ipv4_frag_shared])
+		rte_panic("Can't allocate ipv4 reassembly tables\n");
 
 	/*
 	 * Create a seed for hashing
 	 */
 	hash_seed = random();
-	return 0;
+
+	/*
+	 * Create a timer for cleanup of stale entries in the shared table.
+	 */
+	rte_timer_init(&ipv4_timer);
+	rte_timer_reset(&ipv4_timer, IPV4_FRAG_INTERVAL * rte_get_timer_hz(),
+			PERIODICAL, rte_get_master_lcore(), ipv4_gc, NULL);
 }
 
 /*
- * Create a new IPV4 and IPv6 fragment reassembly tables.
+ * Create the IPv4 and IPv6 fragment reassembly tables.
  */
-int fragment_tables_init(struct vrf *vrf)
+void fragment_tables_init(void)
 {
-	int ret = 0;
-
-	ret = ipv4_fragment_table_init(vrf);
-	if (ret < 0)
-		return ret;
-
-	return ipv6_fragment_table_init(vrf);
+	ipv4_frag_tbl_init();
+	ipv6_frag_tbl_init();
 }
 
-void fragment_tables_uninit(struct vrf *vrf)
+/*
+ * Create the tables of a forwarding lcore.  Called by the lcore when it
+ * starts, so that it does not allocate them when a fragment arrives.
+ */
+void fragment_tables_lcore_init(unsigned int lcore_id)
 {
-	ipv4_fragment_table_uninit(vrf);
-	ipv6_fragment_table_uninit(vrf);
+	ipv4_frag_tbl_lcore_init(lcore_id);
+	ipv6_frag_tbl_lcore_init(lcore_id);
 }
 
-static void
-ipv4_fragment_tables_timer_init(void)
-	{
-	/*
-	 * Creat a timer for cleanup of stale entries.
-	 */
-	rte_timer_init(&ipv4_timer);
-	rte_timer_reset(&ipv4_timer, IPV4_FRAG_INTERVAL * rte_get_timer_hz(),
-			PERIODICAL, rte_get_master_lcore(), ipv4_gc, NULL);
+void fragment_tables_service(unsigned int lcore_id)
+{
+	ipv4_frag_tbl_service(lcore_id);
+	ipv6_frag_tbl_service(lcore_id);
 }
 
-void fragment_tables_timer_init(void)
+void fragment_tables_release(unsigned int lcore_id)
 {
-	ipv4_fragment_tables_timer_init();
-	ipv6_fragment_tables_timer_init();
+	ipv4_frag_tbl_release(lcore_id);
+	ipv6_frag_tbl_release(lcore_id);
 }
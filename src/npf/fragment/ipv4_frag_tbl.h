@@ -45,35 +45,48 @@
 #define IPV4_FRAG_TBL_H
 
 #include <rte_memory.h>
-#include <rte_spinlock.h>
 #include <stdint.h>
-#include <urcu.h>
+#include <urcu/list.h>
 
-#include "urcu.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-struct vrf;
-
 /*
- * Default IPv4 RCU hash table values.
+ * Fragment reassembly tables.
+ *
+ * Each forwarding lcore has its own fixed-size table, allocated when the
+ * lcore starts.  Only that lcore uses it, so it is not locked.  The master
+ * thread and non-dataplane threads share a table, which is locked.
+ *
+ * Fragment sets are kept oldest first.  When a table is full the oldest set
+ * is evicted.  Each lcore expires its own sets from its main loop, and frees
+ * any that are left when it stops polling, so sets are not stranded on an
+ * lcore that has stopped forwarding.  The master timer only expires the
+ * sets in the shared table.
+ *
+ * A table is shared by all VRFs.  It holds as many sets as each VRF had
+ * before the tables were per-lcore, so the sets available to any one VRF
+ * grow with the number of forwarding lcores.  A forwarding lcore's tables
+ * take about 800KB for IPv4 and 400KB for IPv6.
  *
- * IPV4_FRAG_HT_INIT - Number of hash buckets to alloc initially. Must be
- *                     a power or two.
- * IPV4_FRAG_HT_MIN  - Min number of hash buckets.  Must be a power of two.
- * IPV4_FRAG_HT_MAX  - Max number of hash buckets.  Must be a power of two.
+ * Fragments of a datagram all have the same L3-only RSS hash, so normally
+ * arrive on the same lcore.  Fragments that arrive on different lcores,
+ * for example because a port hashes on L4 ports as well or because packets
+ * were moved between lcores by software, go into separate sets that are
+ * never completed.  Those sets expire, and are counted as reassembly
+ * timeouts and failures, and the datagram is lost.  Such ports need their
+ * RSS changed to hash fragments on addresses only.
  */
-#define IPV4_FRAG_HT_INIT	32
-#define IPV4_FRAG_HT_MIN	64
-#define IPV4_FRAG_HT_MAX	512
 
-/* Max number of fragment sets we support */
+/* Hash buckets per table.  Must be a power of two. */
+#define IPV4_FRAG_TBL_BUCKETS	512
+
+/* Max number of fragment sets per table */
 #define IPV4_MAX_FRAG_SETS	1024
 
 /* Max number of fragments per fragment set */
 #define IPV4_MAX_FRAGS_PER_SET	44
 
-/* GC periodic hash table cleanup interval (seconds) */
+/* GC periodic cleanup interval of the shared table (seconds) */
 #define IPV4_FRAG_INTERVAL	10
 
 /* Timeout period for incomplete fragment sets */
@@ -86,11 +99,12 @@ struct ipv4_frag {
 };
 
 /*
- * Use <src addr, dst_addr, id> to uniquely identify fragmented datagram.
+ * Use <src addr, dst_addr, id, vrf> to uniquely identify fragmented datagram.
  */
 struct ipv4_frag_key {
 	uint64_t  src_dst;
 	uint32_t  id;
+	vrfid_t   vrfid;
 };
 
 /*
@@ -98,10 +112,10 @@ struct ipv4_frag_key {
  * First two entries in the frags[] array are for the last and first fragments.
  */
 struct ipv4_frag_pkt {
-	struct rcu_head		pkt_rcu_head;	/* for call_rcu */
-	struct cds_lfht_node	pkt_node;	/* For hash table */
-	rte_spinlock_t		pkt_lock;	/* lock for this pkt */
+	struct ipv4_frag_pkt	*pkt_next;	/* hash chain or free list */
+	struct cds_list_head	pkt_age_node;	/* table age list */
 	struct ipv4_frag_key	pkt_key;	/* src_dst/id key */
+	uint32_t		pkt_hash;
 	uint64_t		pkt_expire;	/* expiration timestamp */
 	uint32_t		total_size;	/* expected reassembled size */
 	uint32_t		frag_size;	/* size of fragments received */
@@ -109,11 +123,26 @@ struct ipv4_frag_pkt {
 	struct ipv4_frag	frags[IPV4_MAX_FRAGS_PER_SET];
 } __rte_cache_aligned;
 
+struct ipv4_frag_tbl;
 
-void ipv4_frag_tbl_create(void);
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *);
-void ipv4_frag_clear(struct ipv4_frag_pkt *);
-struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
-				     const struct ipv4_frag_key *);
+/*
+ * Get the reassembly table for this thread, locking it if it is the
+ * shared table, or the table of the given lcore.
+ */
+struct ipv4_frag_tbl *ipv4_frag_tbl_get(void);
+struct ipv4_frag_tbl *ipv4_frag_tbl_lcore_get(unsigned int lcore_id);
+void ipv4_frag_tbl_put(struct ipv4_frag_tbl *tbl);
+uint32_t ipv4_frag_tbl_used(struct ipv4_frag_tbl *tbl);
+
+void ipv4_frag_free(struct ipv4_frag_tbl *tbl, struct ipv4_frag_pkt *pkt);
+void ipv4_frag_clear(struct ipv4_frag_pkt *pkt);
+struct ipv4_frag_pkt *ipv4_frag_find(struct ipv4_frag_tbl *tbl,
+				     const struct ipv4_frag_key *key);
+
+void ipv4_frag_tbl_init(void);
+int ipv4_frag_tbl_lcore_init(unsigned int lcore_id);
+void ipv4_frag_tbl_service(unsigned int lcore_id);
+void ipv4_frag_tbl_release(unsigned int lcore_id);
+void ipv4_frag_tbl_gc(void);
 
 #endif /* IPV4_FRAG_TBL_H */
@@ -46,7 +46,6 @@
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <rte_mbuf.h>
-#include <rte_spinlock.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -61,8 +60,6 @@
 #include "util.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-
 /*
  * Helper function.
  * Takes 2 mbufs that represents two fragments of the same packet and
@@ -171,7 +168,7 @@ static struct rte_mbuf *ipv4_frag_reassemble(struct ipv4_frag_pkt *fp)
  *	 - mbuf was added to the table, and held for later
  */
 static struct rte_mbuf *
-ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
+ipv4_frag_process(struct ipv4_frag_tbl *frag_tbl, struct ipv4_frag_pkt *fp,
 		  struct rte_mbuf *mb, uint16_t ofs, uint16_t len,
 		  uint16_t more_frags)
 {
@@ -183,9 +180,6 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 	};
 	unsigned int i;
 
-	/* Lock the frag pkt */
-	rte_spinlock_lock(&fp->pkt_lock);
-
 	if (ofs == 0) {
 		/* is this a repeat of the first fragment? */
 		if (fp->frags[FIRST_FRAG_IDX].mb == NULL) {
@@ -244,7 +238,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 
 	/* errorneous packet: exceeded max allowed number of fragments */
 	if (idx >= ARRAY_SIZE(fp->frags)) {
-		ipv4_frag_free(frag_tables, fp);
+		ipv4_frag_free(frag_tbl, fp);
 		IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
 		rte_pktmbuf_free(mb);	/* drop bad packet as well */
 		mb = NULL;
@@ -281,7 +275,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 		mb = ipv4_frag_reassemble(fp);
 		if (!mb) {
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(frag_tbl, fp);
 		} else {
 			/*
 			 * On successful reassembly, NULL out the
@@ -290,13 +284,12 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 			ipv4_frag_clear(fp);
 
 			/* Delete this pkt from the table */
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(frag_tbl, fp);
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMOKS);
 		}
 	}
 
 done:
-	rte_spinlock_unlock(&fp->pkt_lock);
 	return mb;
 }
 
@@ -305,17 +298,13 @@ done:
  */
 static struct rte_mbuf *ipv4_frag_mbuf(struct rte_mbuf *mb)
 {
+	struct ipv4_frag_tbl *frag_tbl;
 	struct ipv4_frag_pkt *fp;
 	struct ipv4_frag_key key;
 	const uint64_t *psd;
 	uint16_t ip_len;
 	uint16_t flag_offset, ip_flag, ip_ofs;
 	struct iphdr  *ipv4_hdr;
-	vrfid_t vrfid = pktmbuf_get_vrf(mb);
-	struct vrf *vrf = vrf_get_rcu(vrfid);
-
-	if (!vrf)
-		return NULL;
 
 	ipv4_hdr = iphdr(mb);
 
@@ -330,22 +319,19 @@ static struct rte_mbuf *ipv4_frag_mbuf(struct rte_mbuf *mb)
 	psd = (uint64_t *)&ipv4_hdr->saddr;
 	key.src_dst = psd[0];
 	key.id = ipv4_hdr->id | (ipv4_hdr->protocol << 16);
+	key.vrfid = pktmbuf_get_vrf(mb);
 
 	ip_len = (uint16_t)(ntohs(ipv4_hdr->tot_len) -
 	mb->l3_len);
 
 	/* try to find/add entry into the fragment's table. */
-	fp = ipv4_frag_find(vrf, &key);
-	if (fp == NULL) {
-		IPSTAT_INC(pktmbuf_get_vrf(mb), IPSTATS_MIB_REASMFAILS);
-		rte_pktmbuf_free(mb);
-		return NULL;
-	}
+	frag_tbl = ipv4_frag_tbl_get();
+	fp = ipv4_frag_find(frag_tbl, &key);
 
 	/* process the fragmented packet. */
-	mb = ipv4_frag_process(vrf->v_ipv4_frag_table,
-			       fp, mb, ip_ofs, ip_len, ip_flag);
+	mb = ipv4_frag_process(frag_tbl, fp, mb, ip_ofs, ip_len, ip_flag);
 
+	ipv4_frag_tbl_put(frag_tbl);
 	return mb;
 }
 
@@ -24,12 +24,12 @@ enum {
 	FIRST_INTERMEDIATE_FRAG_IDX,
 };
 
-extern int ipv6_fragment_table_init(struct vrf *vrf);
-extern void ipv6_fragment_table_uninit(struct vrf *vrf);
-extern void ipv6_fragment_tables_timer_init(void);
+extern void ipv6_frag_tbl_init(void);
+extern void ipv6_frag_tbl_service(unsigned int lcore_id);
 
-extern int fragment_tables_init(struct vrf *vrf);
-extern void fragment_tables_uninit(struct vrf *vrf);
-extern void fragment_tables_timer_init(void);
+extern void fragment_tables_init(void);
+extern void fragment_tables_lcore_init(unsigned int lcore_id);
+extern void fragment_tables_service(unsigned int lcore_id);
+extern void fragment_tables_release(unsigned int lcore_id);
 
 #endif
@@ -13,7 +13,6 @@
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <rte_mbuf.h>
-#include <rte_spinlock.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -30,8 +29,6 @@
 #include "util.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-
 /*
  * Helper function.  Takes 2 mbufs that represents two fragments of
  * the same packet and chains them into one mbuf.
@@ -222,8 +219,9 @@ ipv6_frag_reassemble(struct ipv6_frag_pkt *fp)
  *	 - mbuf was added to the table, and held for later
  */
 static struct rte_mbuf *
-ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
-		  struct rte_mbuf *m, npf_cache_t *npc, uint16_t *gleaned_mtu)
+ipv6_frag_process(struct ipv6_frag_tbl *frag_table,
+		  struct ipv6_frag_pkt *fp, struct rte_mbuf *m,
+		  npf_cache_t *npc, uint16_t *gleaned_mtu)
 {
 	struct ip6_hdr	*ip6;
 	uint32_t idx = 0;
@@ -263,9 +261,6 @@ ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
 	extra_hlen = npc->last_unfrg_hofs + npc->last_unfrg_hlen +
 		sizeof(struct ip6_frag) - sizeof(struct ip6_hdr);
 
-	/* Lock the frag pkt */
-	rte_spinlock_lock(&fp->pkt_lock);
-
 	if (npc->fh_offset == 0) {
 		/*
 		 * First fragment
@@ -439,7 +434,6 @@ ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
 	}
 
 done:
-	rte_spinlock_unlock(&fp->pkt_lock);
 	return m;
 }
 
@@ -450,14 +444,11 @@ static struct rte_mbuf *
 ipv6_frag_mbuf(struct rte_mbuf *m, npf_cache_t *npc,
 	       uint16_t *gleaned_mtu)
 {
+	struct ipv6_frag_tbl *frag_table;
 	struct ipv6_frag_pkt *fp;
 	struct ipv6_frag_key key;
 	struct ip6_hdr	*ip6;
 	vrfid_t vrfid = pktmbuf_get_vrf(m);
-	struct vrf *vrf = vrf_get_rcu(vrfid);
-
-	if (!vrf)
-		return NULL;
 
 	ip6 = ip6hdr(m);
 
@@ -470,21 +461,21 @@ ipv6_frag_mbuf(struct rte_mbuf *m, npf_cache_t *npc,
 	memcpy(&key.src_dst[IPV6_FRAG_KEY_WORDS/2],
 	       &ip6->ip6_dst, sizeof(ip6->ip6_dst));
 	key.id = npc->fh_id;
+	key.vrfid = vrfid;
+
+	frag_table = ipv6_frag_tbl_get();
 
 	/*
 	 * try to find an entry in the fragment's table.  If one
-	 * doesn't exist then create one.  This will fail if we have
-	 * reached the max fragment sets.
+	 * doesn't exist then take a free one, evicting the oldest
+	 * fragment set if the table is full.
 	 */
-	fp = ipv6_frag_find_or_create(vrf, &key);
-	if (fp == NULL) {
-		IP6STAT_INC_VRF(vrf, IPSTATS_MIB_REASMFAILS);
-		rte_pktmbuf_free(m);
-		return NULL;
-	}
+	fp = ipv6_frag_find_or_create(frag_table, &key);
 
 	/* process the fragmented packet. */
-	m = ipv6_frag_process(vrf->v_ipv6_frag_table, fp, m, npc, gleaned_mtu);
+	m = ipv6_frag_process(frag_table, fp, m, npc, gleaned_mtu);
+
+	ipv6_frag_tbl_put(frag_table);
 
 	return m;
 }
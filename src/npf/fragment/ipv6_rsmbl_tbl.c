@@ -6,24 +6,41 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <errno.h>
+#include <linux/snmp.h>
 #include <rte_common.h>
 #include <rte_cycles.h>
 #include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_spinlock.h>
 #include <rte_timer.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <urcu/system.h>
 
 #include "compiler.h"
 #include "npf/fragment/ipv4_rsmbl.h"
 #include "npf/npf.h"
 #include "npf/fragment/ipv6_rsmbl_tbl.h"
+#include "snmp_mib.h"
 #include "util.h"
 #include "vplane_log.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
+/*
+ * A reassembly table, arranged and locked as for IPv4.
+ */
+struct ipv6_frag_tbl {
+	rte_spinlock_t		ft_lock;
+	uint32_t		ft_used;
+	struct cds_list_head	ft_age;
+	struct ipv6_frag_pkt	*ft_free;
+	struct ipv6_frag_pkt	*ft_bucket[IPV6_FRAG_TBL_BUCKETS];
+	struct ipv6_frag_pkt	ft_pkts[IPV6_MAX_FRAG_SETS];
+};
 
 /*
  * Globals
@@ -31,17 +48,9 @@ struct cds_lfht;
 static struct rte_timer ipv6_timer;
 static uint32_t ipv6_hash_seed;
 
-static inline void
-ipv6_frag_key_copy(struct ipv6_frag_key *dst,
-		   const struct ipv6_frag_key *src)
-{
-	unsigned int word;
-
-	for (word = 0; word < IPV6_FRAG_KEY_WORDS; word++)
-		dst->src_dst[word] = src->src_dst[word];
-
-	dst->id = src->id;
-}
+/* Per-lcore tables, followed by the shared table */
+static struct ipv6_frag_tbl **ipv6_frag_tbls;
+static unsigned int ipv6_frag_shared;
 
 /*
  * Compare two keys, and return -1, 0, or 1 if k1 < k2, k1 == k2, or
@@ -63,251 +72,293 @@ ipv6_frag_key_cmp(const struct ipv6_frag_key *k1,
 		return -1;
 	if (k1->id > k2->id)
 		return 1;
+	if (k1->vrfid < k2->vrfid)
+		return -1;
+	if (k1->vrfid > k2->vrfid)
+		return 1;
 	return 0;
 }
 
-/*
- * update timeout stats
- */
-static void
-ipv6_frag_timeout_stats(struct ipv6_frag_pkt *fp __unused)
+static struct ipv6_frag_tbl *ipv6_frag_tbl_create(void)
 {
+	struct ipv6_frag_tbl *tbl;
+	uint32_t i;
+
+	tbl = zmalloc_aligned(sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+
+	rte_spinlock_init(&tbl->ft_lock);
+	CDS_INIT_LIST_HEAD(&tbl->ft_age);
+
+	for (i = 0; i < IPV6_MAX_FRAG_SETS; i++) {
+		tbl->ft_pkts[i].pkt_next = tbl->ft_free;
+		tbl->ft_free = &tbl->ft_pkts[i];
+	}
+	return tbl;
 }
 
 /*
- * free a fragmentation packet
+ * Create the table of a forwarding lcore, when the lcore starts.  The
+ * lcore uses the shared table if this fails.
  */
-static void ipv6_frag_free_pkt(struct rcu_head *head)
+int ipv6_frag_tbl_lcore_init(unsigned int lcore_id)
 {
-	struct ipv6_frag_pkt *fp = caa_container_of(head,
-				    struct ipv6_frag_pkt, pkt_rcu_head);
-	struct rte_mbuf *m;
-	uint32_t i;
+	struct ipv6_frag_tbl *tbl;
 
-	for (i = 0; i != fp->last_idx; i++) {
-		m = fp->frags[i].mb;
-		if (m != NULL) {
-			rte_pktmbuf_free(m);
-			fp->frags[i].mb = NULL;
-		}
+	if (lcore_id >= ipv6_frag_shared || ipv6_frag_tbls[lcore_id])
+		return 0;
+
+	tbl = ipv6_frag_tbl_create();
+	if (!tbl) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Can't allocate ipv6 reassembly table for core %u\n",
+			lcore_id);
+		return -ENOMEM;
 	}
-	free(fp);
+	rcu_assign_pointer(ipv6_frag_tbls[lcore_id], tbl);
+	return 0;
 }
 
 /*
- * Delete a frag packet struct from the hash table
+ * Get the table of a forwarding lcore, which only that lcore may use
+ * unless it has stopped forwarding.  Returns NULL if it has no table.
  */
-void
-ipv6_frag_free(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp)
+struct ipv6_frag_tbl *ipv6_frag_tbl_lcore_get(unsigned int lcore_id)
 {
-	if (!cds_lfht_del(frag_table, &fp->pkt_node))
-		call_rcu(&fp->pkt_rcu_head, ipv6_frag_free_pkt);
+	return rcu_dereference(ipv6_frag_tbls[lcore_id]);
 }
 
 /*
- * Clean out expired frag pkts
- *
- * NB ipv6_gc() is a callback function for rte_timer_reset(),
- *    so we use __rte_unused rather than __unused.
+ * Forwarding lcores have their own table.  The master thread and
+ * non-dataplane threads use the shared table, which is locked.
  */
-static void
-ipv6_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
+struct ipv6_frag_tbl *ipv6_frag_tbl_get(void)
 {
-	struct cds_lfht_iter iter;
-	struct ipv6_frag_pkt *fp;
-	uint64_t current = get_time_uptime(); /* uptime in secs */
-	vrfid_t vrfid;
-	struct vrf *vrf;
-
-	VRF_FOREACH(vrf, vrfid) {
-		if (!vrf)
-			continue;
-
-		cds_lfht_for_each_entry(vrf->v_ipv6_frag_table, &iter, fp,
-					pkt_node) {
-			if (fp->pkt_expire < current) {
-				ipv6_frag_timeout_stats(fp);
-				ipv6_frag_free(vrf->v_ipv6_frag_table, fp);
-			}
-		}
+	unsigned int lcore_id = rte_lcore_id();
+	struct ipv6_frag_tbl *tbl;
+
+	if (likely(lcore_id < ipv6_frag_shared &&
+		   lcore_id != rte_get_master_lcore())) {
+		tbl = rcu_dereference(ipv6_frag_tbls[lcore_id]);
+		if (likely(tbl))
+			return tbl;
 	}
+
+	tbl = ipv6_frag_tbls[ipv6_frag_shared];
+	rte_spinlock_lock(&tbl->ft_lock);
+	return tbl;
+}
+
+void ipv6_frag_tbl_put(struct ipv6_frag_tbl *tbl)
+{
+	if (tbl == ipv6_frag_tbls[ipv6_frag_shared])
+		rte_spinlock_unlock(&tbl->ft_lock);
+}
+
+/* For fragment table UT */
+uint32_t ipv6_frag_tbl_used(struct ipv6_frag_tbl *tbl)
+{
+	return tbl->ft_used;
 }
 
 /*
- * Clear the rte_mbufs from a pkt
+ * update timeout stats
+ */
+static void
+ipv6_frag_timeout_stats(struct ipv6_frag_pkt *fp __unused)
+{
+}
+
+/*
+ * Delete a frag packet struct from its table, freeing any fragments it
+ * still holds.
  */
 void
-ipv6_frag_clear(struct ipv6_frag_pkt *fp)
+ipv6_frag_free(struct ipv6_frag_tbl *tbl, struct ipv6_frag_pkt *fp)
 {
+	struct ipv6_frag_pkt **pp;
 	uint32_t i;
 
-	for (i = 0; i != fp->last_idx; i++)
-		fp->frags[i].mb = NULL;
-}
+	for (i = 0; i != fp->last_idx; i++) {
+		if (fp->frags[i].mb)
+			rte_pktmbuf_free(fp->frags[i].mb);
+	}
+	memset(fp->frags, 0, fp->last_idx * sizeof(fp->frags[0]));
 
-static unsigned long
-ipv6_hash(const struct ipv6_frag_key *key)
-{
-	/* Plus one to include the 'id' field */
-	return rte_jhash_32b(key->src_dst, IPV6_FRAG_KEY_WORDS + 1,
-			     ipv6_hash_seed);
+	pp = &tbl->ft_bucket[fp->pkt_hash & (IPV6_FRAG_TBL_BUCKETS - 1)];
+	while (*pp != fp)
+		pp = &(*pp)->pkt_next;
+	*pp = fp->pkt_next;
+
+	cds_list_del(&fp->pkt_age_node);
+	fp->pkt_next = tbl->ft_free;
+	tbl->ft_free = fp;
+	tbl->ft_used--;
 }
 
 /*
- * hash table match function.	Return 1 for a match, 0 for no match
+ * Clean out expired frag pkts, which are at the start of the age list
  */
-static int
-ipv6_match(struct cds_lfht_node *node, const void *data)
+static void
+ipv6_frag_expire(struct ipv6_frag_tbl *tbl, uint64_t current)
 {
-	const struct ipv6_frag_key *key = data;
 	struct ipv6_frag_pkt *fp;
 
-	fp = caa_container_of(node, struct ipv6_frag_pkt, pkt_node);
+	while (!cds_list_empty(&tbl->ft_age)) {
+		fp = cds_list_first_entry(&tbl->ft_age, struct ipv6_frag_pkt,
+					  pkt_age_node);
+		if (fp->pkt_expire >= current)
+			break;
 
-	return ipv6_frag_key_cmp(key, &fp->pkt_key) == 0 ? 1 : 0;
+		ipv6_frag_timeout_stats(fp);
+		ipv6_frag_free(tbl, fp);
+	}
 }
 
-/* Count nodes */
-static unsigned long
-ipv6_frag_count(struct cds_lfht *frag_table)
+/*
+ * Called from the main loop of each forwarding lcore, for its own table
+ */
+void ipv6_frag_tbl_service(unsigned int lcore_id)
 {
-	unsigned long count;
-	long dummy;
+	struct ipv6_frag_tbl *tbl = ipv6_frag_tbls[lcore_id];
 
-	cds_lfht_count_nodes(frag_table, &dummy, &count, &dummy);
-	return count;
+	if (likely(!tbl || !tbl->ft_used))
+		return;
+
+	ipv6_frag_expire(tbl, get_time_uptime());
 }
 
 /*
- * Add a new pkt if max not reached
+ * Free the sets of an lcore that is about to stop polling, as for IPv4
  */
-static struct ipv6_frag_pkt *
-ipv6_frag_create(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv6_frag_key *key)
+void ipv6_frag_tbl_release(unsigned int lcore_id)
 {
-	struct cds_lfht_node *node;
-	struct ipv6_frag_pkt *fp;
-	unsigned long count;
+	struct ipv6_frag_tbl *tbl;
 
-	/* Max packets reached? */
-	count = ipv6_frag_count(frag_table);
-	if (count >= IPV6_MAX_FRAG_SETS)
-		return NULL;
+	if (lcore_id >= ipv6_frag_shared)
+		return;
 
-	fp = calloc(1, sizeof(struct ipv6_frag_pkt));
-	if (!fp)
-		return NULL;
+	tbl = ipv6_frag_tbls[lcore_id];
+	if (likely(!tbl || !tbl->ft_used))
+		return;
 
-	rte_spinlock_init(&fp->pkt_lock);
-	ipv6_frag_key_copy(&fp->pkt_key, key);
-	fp->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
-	cds_lfht_node_init(&fp->pkt_node);
-	fp->pkt_expire = get_time_uptime() + IPV6_FRAG_SET_TTL;
+	ipv6_frag_expire(tbl, UINT64_MAX);
+}
 
-	/*
-	 * Now try to add the new pkt, if somebody beat us to it, use
-	 * that one.
-	 */
-	node = cds_lfht_add_unique(frag_table, hash, ipv6_match,
-				   key, &fp->pkt_node);
-	if (node != &fp->pkt_node) {
-		free(fp);
-		fp = caa_container_of(node, struct ipv6_frag_pkt, pkt_node);
-	}
+/*
+ * Clean out expired frag pkts from the shared table.  Each lcore ages its
+ * own table.
+ */
+void ipv6_frag_tbl_gc(void)
+{
+	struct ipv6_frag_tbl *tbl = ipv6_frag_tbls[ipv6_frag_shared];
 
-	return fp;
+	if (!CMM_LOAD_SHARED(tbl->ft_used))
+		return;
+
+	rte_spinlock_lock(&tbl->ft_lock);
+	ipv6_frag_expire(tbl, get_time_uptime());
+	rte_spinlock_unlock(&tbl->ft_lock);
 }
 
 /*
- * Lookup a 'pkt' in the hash table
+ * NB ipv6_gc() is a callback function for rte_timer_reset(),
+ *    so we use __rte_unused rather than __unused.
  */
-static struct ipv6_frag_pkt *
-ipv6_frag_lookup(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv6_frag_key *key)
+static void
+ipv6_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 {
-	struct ipv6_frag_pkt *fp;
-	struct cds_lfht_iter iter;
-	struct cds_lfht_node *node;
+	ipv6_frag_tbl_gc();
+}
 
-	cds_lfht_lookup(frag_table, hash, ipv6_match, key, &iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (node)
-		fp = caa_container_of(node, struct ipv6_frag_pkt, pkt_node);
-	else
-		fp = NULL;
+/*
+ * Clear the rte_mbufs from a pkt
+ */
+void
+ipv6_frag_clear(struct ipv6_frag_pkt *fp)
+{
+	uint32_t i;
 
-	return fp;
+	for (i = 0; i != fp->last_idx; i++)
+		fp->frags[i].mb = NULL;
+}
+
+static uint32_t
+ipv6_hash(const struct ipv6_frag_key *key)
+{
+	/* Plus one to include the 'id' field */
+	return rte_jhash_32b(key->src_dst, IPV6_FRAG_KEY_WORDS + 1,
+			     ipv6_hash_seed ^ key->vrfid);
 }
 
 /*
  * Find an entry in the table for the corresponding fragment.
- * If such entry is not present, then allocate a new one.
+ * If such entry is not present, then take a free one, evicting the oldest
+ * entry if the table is full.
  */
 struct ipv6_frag_pkt *
-ipv6_frag_find_or_create(struct vrf *vrf, const struct ipv6_frag_key *key)
+ipv6_frag_find_or_create(struct ipv6_frag_tbl *tbl,
+			 const struct ipv6_frag_key *key)
 {
+	uint32_t hash = ipv6_hash(key);
+	struct ipv6_frag_pkt **bucket;
 	struct ipv6_frag_pkt *fp;
-	unsigned long hash = ipv6_hash(key);
-	struct cds_lfht *frag_table = vrf->v_ipv6_frag_table;
+	uint64_t current;
 
-	fp = ipv6_frag_lookup(frag_table, hash, key);
-	if (!fp)
-		fp = ipv6_frag_create(frag_table, hash, key);
+	bucket = &tbl->ft_bucket[hash & (IPV6_FRAG_TBL_BUCKETS - 1)];
+	for (fp = *bucket; fp; fp = fp->pkt_next) {
+		if (fp->pkt_hash == hash &&
+		    ipv6_frag_key_cmp(key, &fp->pkt_key) == 0)
+			return fp;
+	}
 
-	return fp;
-}
+	current = get_time_uptime(); /* uptime in secs */
+	ipv6_frag_expire(tbl, current);
 
-void
-ipv6_fragment_table_uninit(struct vrf *vrf)
-{
-	struct cds_lfht_iter iter;
-	struct ipv6_frag_pkt *pkt;
+	if (unlikely(!tbl->ft_free)) {
+		fp = cds_list_first_entry(&tbl->ft_age, struct ipv6_frag_pkt,
+					  pkt_age_node);
+		IP6STAT_INC(fp->pkt_key.vrfid, IPSTATS_MIB_REASMFAILS);
+		ipv6_frag_free(tbl, fp);
+	}
 
-	if (!vrf->v_ipv6_frag_table)
-		return;
+	fp = tbl->ft_free;
+	tbl->ft_free = fp->pkt_next;
 
-	cds_lfht_for_each_entry(vrf->v_ipv6_frag_table, &iter, pkt,
-				pkt_node) {
-		ipv6_frag_free(vrf->v_ipv6_frag_table, pkt);
-	}
+	memset(fp, 0, offsetof(struct ipv6_frag_pkt, frags));
+	fp->pkt_key = *key;
+	fp->pkt_hash = hash;
+	fp->pkt_expire = current + IPV6_FRAG_SET_TTL;
+	fp->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
+
+	fp->pkt_next = *bucket;
+	*bucket = fp;
+	cds_list_add_tail(&fp->pkt_age_node, &tbl->ft_age);
+	tbl->ft_used++;
 
-	dp_ht_destroy_deferred(vrf->v_ipv6_frag_table);
-	vrf->v_ipv6_frag_table = NULL;
+	return fp;
 }
 
-/*
- * Create a new IPv6 Frag table.
- */
-int
-ipv6_fragment_table_init(struct vrf *vrf)
+void ipv6_frag_tbl_init(void)
 {
-	/*
-	 * Create a lock-free RCU hash table.  Since we only support a
-	 * (relatively) small number of frag pkt's at any given time,
-	 * allow to grow but not shrink.  We can save cycles by not
-	 * doing accounting for splits.
-	 */
-	vrf->v_ipv6_frag_table = cds_lfht_new(IPV6_FRAG_HT_INIT,
-					      IPV6_FRAG_HT_MIN,
-					      IPV6_FRAG_HT_MAX,
-					      CDS_LFHT_AUTO_RESIZE, NULL);
-	if (!vrf->v_ipv6_frag_table) {
-		DP_LOG_W_VRF(ERR, DATAPLANE, vrf->v_id,
-			     "Unable to create ipv6 frag hash table\n");
-		return -1;
-	}
+	ipv6_frag_shared = get_lcore_max() + 1;
+	ipv6_frag_tbls = zmalloc_aligned((ipv6_frag_shared + 1) *
+					 sizeof(*ipv6_frag_tbls));
+	if (!ipv6_frag_tbls)
+		rte_panic("Can't allocate ipv6 reassembly tables\n");
+
+	ipv6_frag_tbls[ipv6_frag_shared] = ipv6_frag_tbl_create();
+	if (!ipv6_frag_tbls[ipv6_frag_shared])
+		rte_panic("Can't allocate ipv6 reassembly tables\n");
 
 	/*
 	 * Create a seed for hashing
 	 */
 	ipv6_hash_seed = random();
-	return 0;
-}
 
-void ipv6_fragment_tables_timer_init(void)
-{
 	/*
-	 * Create a timer for cleanup of stale entries.
+	 * Create a timer for cleanup of stale entries in the shared table.
 	 */
 	rte_timer_init(&ipv6_timer);
 	rte_timer_reset(&ipv6_timer,
@@ -9,32 +9,23 @@
 #ifndef IPV6_FRAG_TBL_H
 #define IPV6_FRAG_TBL_H
 
-#include <rte_spinlock.h>
 #include <stdint.h>
+#include <urcu/list.h>
 
 #include "npf/fragment/ipv6_rsmbl.h"
-#include "urcu.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-struct vrf;
-
 /*
- * Default IPv6 RCU hash table values.
- *
- * IPV6_FRAG_HT_INIT - Number of hash buckets to alloc initially. Must be
- *                     a power or two.
- * IPV6_FRAG_HT_MIN  - Min number of hash buckets.  Must be a power of two.
- * IPV6_FRAG_HT_MAX  - Max number of hash buckets.  Must be a power of two.
+ * Reassembly tables are per-lcore, as for IPv4.  See ipv4_frag_tbl.h.
  */
-#define IPV6_FRAG_HT_INIT	32
-#define IPV6_FRAG_HT_MIN	64
-#define IPV6_FRAG_HT_MAX	512
 
-/* Max number of fragment sets we support */
+/* Hash buckets per table.  Must be a power of two. */
+#define IPV6_FRAG_TBL_BUCKETS	512
+
+/* Max number of fragment sets per table */
 #define IPV6_MAX_FRAG_SETS	1024
 
-/* GC periodic hash table cleanup interval (seconds) */
+/* GC periodic cleanup interval of the shared table (seconds) */
 #define IPV6_FRAG_INTERVAL	10
 
 /* Timeout period for incomplete fragment sets */
@@ -70,6 +61,7 @@ struct ipv6_frag {
 struct ipv6_frag_key {
 	uint32_t  src_dst[IPV6_FRAG_KEY_WORDS];
 	uint32_t  id;
+	vrfid_t   vrfid;
 };
 
 /*
@@ -77,10 +69,10 @@ struct ipv6_frag_key {
  * frags[] array are for the last and first fragments.
  */
 struct ipv6_frag_pkt {
-	struct rcu_head		pkt_rcu_head;	/* for call_rcu */
-	struct cds_lfht_node	pkt_node;	/* For hash table */
-	rte_spinlock_t		pkt_lock;	/* lock for this pkt */
+	struct ipv6_frag_pkt	*pkt_next;	/* hash chain or free list */
+	struct cds_list_head	pkt_age_node;	/* table age list */
 	struct ipv6_frag_key	pkt_key;	/* src_dst/id key */
+	uint32_t		pkt_hash;
 	uint64_t		pkt_expire;	/* expiration timestamp */
 	uint32_t		total_size;	/* expected reassd size */
 	uint32_t		frag_size;	/* size of fragments rcvd */
@@ -100,9 +92,24 @@ struct ipv6_frag_pkt {
 	struct ipv6_frag	frags[IPV6_MAX_FRAGS_PER_SET];
 };
 
+struct ipv6_frag_tbl;
+
+/*
+ * Get the reassembly table for this thread, locking it if it is the
+ * shared table, or the table of the given lcore.
+ */
+struct ipv6_frag_tbl *ipv6_frag_tbl_get(void);
+struct ipv6_frag_tbl *ipv6_frag_tbl_lcore_get(unsigned int lcore_id);
+void ipv6_frag_tbl_put(struct ipv6_frag_tbl *tbl);
+uint32_t ipv6_frag_tbl_used(struct ipv6_frag_tbl *tbl);
+int ipv6_frag_tbl_lcore_init(unsigned int lcore_id);
+void ipv6_frag_tbl_release(unsigned int lcore_id);
+void ipv6_frag_tbl_gc(void);
+
 struct ipv6_frag_pkt *
-ipv6_frag_find_or_create(struct vrf *vrf, const struct ipv6_frag_key *);
-void ipv6_frag_free(struct cds_lfht *frag_table, struct ipv6_frag_pkt *);
-void ipv6_frag_clear(struct ipv6_frag_pkt *);
+ipv6_frag_find_or_create(struct ipv6_frag_tbl *tbl,
+			 const struct ipv6_frag_key *key);
+void ipv6_frag_free(struct ipv6_frag_tbl *tbl, struct ipv6_frag_pkt *fp);
+void ipv6_frag_clear(struct ipv6_frag_pkt *fp);
 
 #endif
@@ -585,6 +585,109 @@ g2_optimize(g2_config_t **confp)
 	}
 }
 
+/*
+ * Copy a match table, pointing the pointer array of the copy at its own bit
+ * patterns.
+ */
+static uint64_t **
+g2_copy_match_table(const g2_config_t *conf, uint64_t **table)
+{
+	size_t array_bytes, bitp_bytes_tot;
+	uint bitp_bytes;
+	uint8_t *new_table;
+	uint j;
+
+	array_bytes = PATTERN_PER_TABLE * sizeof(uint64_t *);
+	bitp_bytes = g_size_alloc[conf->_rs_size_idx] / NBITS(uint8_t);
+	bitp_bytes_tot = bitp_bytes * PATTERN_PER_TABLE;
+
+	new_table = malloc_aligned(array_bytes + bitp_bytes_tot);
+	if (!new_table)
+		return NULL;
+
+	/* The bit patterns of a table are contiguous, starting at the first */
+	memcpy(new_table + array_bytes, table[0], bitp_bytes_tot);
+
+	for (j = 0; j < PATTERN_PER_TABLE; j++)
+		((uint64_t **)new_table)[j] =
+			(uint64_t *)(new_table + array_bytes +
+				     (j * bitp_bytes));
+
+	return (uint64_t **)new_table;
+}
+
+/*
+ * g2_dup()
+ * conf: ptr to an optimized conf structure.
+ * map:  returns the match data for the copy of a rule, given its match data
+ *       in conf.
+ *
+ * Copy a grouper, for a ruleset with the same rules, without evaluating the
+ * rules again.
+ */
+g2_config_t *
+g2_dup(const g2_config_t *conf, g2_md_map_t map, void *arg)
+{
+	g2_config_t *dup;
+	uint i;
+
+	if (!conf)
+		return NULL;
+
+	dup = zmalloc_aligned(sizeof(g2_config_t) +
+			      conf->_num_tables * sizeof(uint64_t *));
+	if (!dup)
+		goto error;
+
+	dup->_num_tables = conf->_num_tables;
+	dup->_num_rules = conf->_num_rules;
+	dup->_num_chunks = conf->_num_chunks;
+	dup->_rs_size_idx = conf->_rs_size_idx;
+
+	dup->_mask = malloc(conf->_num_tables);
+	if (!dup->_mask)
+		goto error;
+	memcpy(dup->_mask, conf->_mask, conf->_num_tables);
+
+	if (conf->_num_rules) {
+		dup->_rule_no = malloc(conf->_num_rules * sizeof(rule_no_t));
+		dup->_md = malloc(conf->_num_rules * sizeof(void *));
+		if (!dup->_rule_no || !dup->_md)
+			goto error;
+	}
+
+	for (i = 0; i < conf->_num_rules; i++) {
+		dup->_rule_no[i] = conf->_rule_no[i];
+		dup->_md[i] = map(conf->_md[i], arg);
+		if (!dup->_md[i])
+			goto error;
+	}
+
+	if (conf->_match_all) {
+		dup->_match_all = g2_copy_match_table(conf, conf->_match_all);
+		if (!dup->_match_all)
+			goto error;
+	}
+
+	for (i = 0; i < conf->_num_tables; i++) {
+		if (conf->_match_table[i] == conf->_match_all)
+			dup->_match_table[i] = dup->_match_all;
+		else
+			dup->_match_table[i] =
+				g2_copy_match_table(conf,
+						    conf->_match_table[i]);
+		if (!dup->_match_table[i])
+			goto error;
+	}
+
+	return dup;
+
+error:
+	RTE_LOG(ERR, FIREWALL, "Error in grouper duplication\n");
+	g2_destroy(&dup);
+	return NULL;
+}
+
 /*
  * g2_eval4()
  * conf:     ptr to configuration structure
@@ -19,12 +19,14 @@
 typedef struct g2_config g2_config_t;
 typedef void *g2_handle_t;
 typedef	bool (*process_callback)(void *, void *);
+typedef void *(*g2_md_map_t)(void *match_data, void *arg);
 
 g2_config_t *g2_init(uint num_tables);
 bool g2_create_rule(g2_config_t *conf, rule_no_t rule_no, void *match_data);
 bool g2_add(g2_config_t *conf, uint table, uint ntables,
 	    const uint8_t *match, const uint8_t *mask);
 void g2_optimize(g2_config_t **confp);
+g2_config_t *g2_dup(const g2_config_t *conf, g2_md_map_t map, void *arg);
 void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
 	       const void *data);
 void *g2_eval6(const g2_config_t *conf, const uint8_t *packet,
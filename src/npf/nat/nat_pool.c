@@ -137,6 +137,17 @@ bool nat_pool_log_pba(struct nat_pool *np)
 	return !np || np->np_log_pba;
 }
 
+/* Number of port-blocks over all of the pool addresses */
+uint64_t nat_pool_nblocks(struct nat_pool *np)
+{
+	struct nat_pool_ranges *nr = rcu_dereference(np->np_ranges);
+
+	if (!nr || !np->np_block_sz)
+		return 0;
+
+	return (uint64_t)nr->nr_naddrs * (np->np_nports / np->np_block_sz);
+}
+
 /* Is this a blacklisted address? */
 bool
 nat_pool_is_blacklist_addr(struct nat_pool *np, uint32_t addr)
@@ -376,6 +387,8 @@ static struct nat_pool_ranges *
 nat_pool_create_ranges(struct nat_pool_cfg *cfg, int *error)
 {
 	struct nat_pool_ranges *nr;
+	uint32_t nwords;
+	uint64_t *bm;
 	uint i;
 
 	/* Must contain at least one prefix or address range */
@@ -414,6 +427,27 @@ nat_pool_create_ranges(struct nat_pool_cfg *cfg, int *error)
 	for (i = NAT_PROTO_FIRST; i <= NAT_PROTO_LAST; i++)
 		rte_atomic32_set(&nr->nr_addr_hint[i], 0);
 
+	/*
+	 * All addresses start as unused.  If an existing pool is being
+	 * reconfigured then the levels of any in-use addresses are corrected
+	 * as they are found.
+	 */
+	nwords = (nr->nr_naddrs + 63) / 64;
+	bm = zmalloc_aligned(nwords * NP_LVL_COUNT * sizeof(*bm));
+	if (!bm) {
+		free(nr);
+		*error = -ENOMEM;
+		return NULL;
+	}
+
+	for (i = 0; i < NP_LVL_COUNT; i++)
+		nr->nr_level_bm[i] = &bm[i * nwords];
+
+	for (i = 0; i < nr->nr_naddrs / 64; i++)
+		bm[i] = UINT64_MAX;
+	if (nr->nr_naddrs % 64)
+		bm[i] = (UINT64_C(1) << (nr->nr_naddrs % 64)) - 1;
+
 	/*
 	 * Create a 'hidden' address-group from the set of address ranges.
 	 * This is used to quickly test if an address in in a NAT pool, for
@@ -431,6 +465,7 @@ static void nat_pool_rcu_free_ranges(struct rcu_head *head)
 	struct nat_pool_ranges *nr;
 
 	nr = caa_container_of(head, struct nat_pool_ranges, nr_rcu_head);
+	free(nr->nr_level_bm[0]);
 	free(nr);
 }
 
@@ -456,8 +491,10 @@ static void nat_pool_free_ranges(struct nat_pool_ranges *nr, bool rcu_free)
 
 	if (rcu_free)
 		call_rcu(&nr->nr_rcu_head, nat_pool_rcu_free_ranges);
-	else
+	else {
+		free(nr->nr_level_bm[0]);
 		free(nr);
+	}
 }
 
 /*
@@ -731,6 +768,122 @@ int nat_pool_addr_range(struct nat_pool *np, uint32_t addr)
 	return -1;
 }
 
+int64_t nat_pool_addr_index(struct nat_pool_ranges *nr, uint32_t addr)
+{
+	uint32_t base = 0;
+	uint range;
+
+	for (range = 0; range < nr->nr_nranges; range++) {
+		struct nat_pool_range *pr = &nr->nr_range[range];
+
+		if (addr >= pr->pr_addr_start && addr <= pr->pr_addr_stop)
+			return base + (addr - pr->pr_addr_start);
+		base += pr->pr_naddrs;
+	}
+	return -1;
+}
+
+uint32_t nat_pool_index_addr(struct nat_pool_ranges *nr, uint32_t idx,
+			     struct nat_pool_range **prp)
+{
+	uint range;
+
+	for (range = 0; range < nr->nr_nranges; range++) {
+		struct nat_pool_range *pr = &nr->nr_range[range];
+
+		if (idx < pr->pr_naddrs) {
+			*prp = pr;
+			return pr->pr_addr_start + idx;
+		}
+		idx -= pr->pr_naddrs;
+	}
+
+	/* Should never happen */
+	*prp = &nr->nr_range[0];
+	return nr->nr_range[0].pr_addr_start;
+}
+
+bool nat_pool_level_next(struct nat_pool_ranges *nr, uint8_t level,
+			 uint32_t *idx, uint32_t *left)
+{
+	const uint64_t *bm = nr->nr_level_bm[level];
+	uint32_t i = *idx, n = *left;
+
+	if (i >= nr->nr_naddrs)
+		i = 0;
+
+	while (n > 0) {
+		uint64_t word = CMM_LOAD_SHARED(bm[i / 64]) >> (i % 64);
+		uint32_t run = 64 - (i % 64);
+
+		if (run > nr->nr_naddrs - i)
+			run = nr->nr_naddrs - i;
+
+		if (word) {
+			uint32_t d = __builtin_ctzll(word);
+
+			if (d < run && d < n) {
+				*idx = i + d;
+				*left = n - d - 1;
+				return true;
+			}
+		}
+		if (run >= n)
+			break;
+
+		n -= run;
+		i += run;
+		if (i >= nr->nr_naddrs)
+			i = 0;
+	}
+
+	*left = 0;
+	return false;
+}
+
+static uint8_t nat_pool_usage_level(uint16_t used, uint16_t nblocks)
+{
+	if (used == 0)
+		return NP_LVL_UNUSED;
+	if (used >= nblocks)
+		return NP_LVL_COUNT;
+	return 1 + ((used - 1) * (NP_LVL_COUNT - 1)) / nblocks;
+}
+
+void nat_pool_addr_usage(struct nat_pool *np, uint32_t addr, uint16_t used,
+			 uint16_t nblocks)
+{
+	struct nat_pool_ranges *nr;
+	uint64_t bit, *word;
+	uint8_t level, l;
+	int64_t idx;
+
+	if (!np)
+		return;
+
+	nr = rcu_dereference(np->np_ranges);
+	if (!nr)
+		return;
+
+	idx = nat_pool_addr_index(nr, addr);
+	if (idx < 0)
+		return;
+
+	level = nat_pool_usage_level(used, nblocks);
+	bit = UINT64_C(1) << (idx % 64);
+
+	/* Words are shared with other addresses, whose apms are not locked */
+	for (l = 0; l < NP_LVL_COUNT; l++) {
+		word = &nr->nr_level_bm[l][idx / 64];
+
+		if (l == level) {
+			if (!(CMM_LOAD_SHARED(*word) & bit))
+				__atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+		} else if (CMM_LOAD_SHARED(*word) & bit)
+			__atomic_fetch_and(word, ~bit, __ATOMIC_RELAXED);
+	}
+}
+
 /*
  * Get next address in pool after the given address.  If the given addr is 0
  * then the first address in the first range is returned.
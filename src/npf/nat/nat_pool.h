@@ -108,6 +108,15 @@ struct nat_pool_range {
 	uint32_t		pr_naddrs;
 };
 
+/*
+ * Pool address usage levels.  Each pool address is in exactly one level,
+ * according to how many of its port-blocks are in-use: NP_LVL_UNUSED if none
+ * are, levels 1 to NP_LVL_COUNT - 1 as more are used, and no level at all
+ * once every block is used.
+ */
+#define NP_LVL_UNUSED	0
+#define NP_LVL_COUNT	7
+
 /*
  * Set of address ranges.
  *
@@ -130,6 +139,15 @@ struct nat_pool_ranges {
 	 */
 	rte_atomic32_t		nr_addr_hint[NAT_PROTO_COUNT];
 
+	/*
+	 * Per-level bitmaps of pool addresses, indexed by the position of
+	 * the address in the pool.  Used to find an address with free
+	 * port-blocks without looking at every address.  Levels are updated
+	 * as port-blocks are allocated and freed, and so are only a hint.
+	 * The apm must always be checked.
+	 */
+	uint64_t		*nr_level_bm[NP_LVL_COUNT];
+
 	struct rcu_head		nr_rcu_head;
 };
 
@@ -199,6 +217,29 @@ uint32_t nat_pool_next_addr(struct nat_pool *np, uint32_t addr,
 /* Which address range is an address in? */
 int nat_pool_addr_range(struct nat_pool *np, uint32_t addr);
 
+/* Position of an address in the pool, or -1 */
+int64_t nat_pool_addr_index(struct nat_pool_ranges *nr, uint32_t addr);
+
+/* Address at a position in the pool, and its range */
+uint32_t nat_pool_index_addr(struct nat_pool_ranges *nr, uint32_t idx,
+			     struct nat_pool_range **prp);
+
+/*
+ * Find the next address in a usage level, starting at position *idx and
+ * looking at no more than *left addresses, wrapping at the end of the pool.
+ * *idx is set to the position found, and *left reduced by the number of
+ * addresses passed over.
+ */
+bool nat_pool_level_next(struct nat_pool_ranges *nr, uint8_t level,
+			 uint32_t *idx, uint32_t *left);
+
+/*
+ * Record that 'used' of the 'nblocks' port-blocks of a pool address are in
+ * use.  Called with the apm for the address locked.
+ */
+void nat_pool_addr_usage(struct nat_pool *np, uint32_t addr, uint16_t used,
+			 uint16_t nblocks);
+
 /* Return true if address-pool paired is enabled */
 static inline bool
 nat_pool_is_ap_paired(const struct nat_pool *np)
@@ -35,6 +35,9 @@ void nat_pool_clear_active(struct nat_pool *np);
 /* Log port-block alloc and release? */
 bool nat_pool_log_pba(struct nat_pool *np);
 
+/* Number of port-blocks over all of the pool addresses */
+uint64_t nat_pool_nblocks(struct nat_pool *np);
+
 /* Is this a blacklisted address? */
 bool nat_pool_is_blacklist_addr(struct nat_pool *np, uint32_t addr);
 
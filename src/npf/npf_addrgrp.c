@@ -10,7 +10,11 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
 #include <rte_rwlock.h>
+#include <rte_timer.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +26,7 @@
 #include "json_writer.h"
 #include "npf/npf.h"
 #include "npf_addrgrp.h"
+#include "npf_addrgrp_lpm.h"
 #include "npf_cidr_util.h"
 #include "npf_ptree.h"
 #include "npf_tblset.h"
@@ -74,6 +79,14 @@ struct ptree_table;
  * There is one 'writer' (master thread) and multiple 'readers' (forwarding
  * threads).  The readers are only blocked when the writer holds the lock.
  *
+ * Large IPv4 address-groups (e.g. blocklists from threat-intelligence feeds)
+ * are also compiled into an immutable multibit trie (npf_addrgrp_lpm.c).
+ * This is rebuilt from the ptree on the next commit after the group changes,
+ * or after a short delay if no commit arrives.  Any change to the group
+ * discards the current trie first, so lookups fall back to the ptree until
+ * the new trie is published.  The ptree and lists remain the master copy
+ * for config and show.
+ *
  *
  * g_addrgrp_table[]
  *      |
@@ -214,8 +227,22 @@ struct npf_addrgrp {
 	bool                ag_any[AG_MAX];  /* 0.0.0.0/0 or ::/0 */
 	zlist_t            *ag_list[AG_MAX];
 	struct ptree_table *ag_tree[AG_MAX];
+	struct ag_lpm      *ag_lpm;  /* IPv4 only.  Lock free */
+	bool                ag_lpm_dirty;
 };
 
+/*
+ * Min number of IPv4 ptree prefixes before an address-group is compiled
+ * into a multibit trie.  The first level of the trie alone is 256KB, so
+ * smaller groups are left to the ptree.
+ */
+#define NPF_ADDRGRP_LPM_MIN 1024
+
+/* Rebuild tries this long after a change, if there is no commit first */
+#define NPF_ADDRGRP_LPM_DELAY 2 /* seconds */
+
+static struct rte_timer npf_addrgrp_lpm_timer;
+
 #define AG_KLEN_IPv4 4
 #define AG_KLEN_IPv6 16
 
@@ -283,6 +310,22 @@ static struct npf_addrgrp *npf_addrgrp_tid_lookup(int tid)
 	return npf_tbl_id_lookup(table, tid);
 }
 
+/*
+ * Lookup an IPv4 address in the address-groups trie.  Returns 0 if found,
+ * -ENOENT if not found, or -EAGAIN if the address-group does not currently
+ * have a trie.
+ */
+static ALWAYS_INLINE int
+ag_trie_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
+{
+	struct ag_lpm *al = rcu_dereference(ag->ag_lpm);
+
+	if (!al)
+		return -EAGAIN;
+
+	return ag_lpm_lookup(al, ntohl(addr)) ? 0 : -ENOENT;
+}
+
 /*
  * Lookup an address in an address-group.  Called from forwarding thread.
  */
@@ -305,6 +348,13 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 	if (ag->ag_any[af])
 		return 0;
 
+	if (af == AG_IPv4) {
+		int rc = ag_trie_lookup_v4(ag, addr->s6_addr32[0]);
+
+		if (rc != -EAGAIN)
+			return rc;
+	}
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[af], addr->s6_addr);
@@ -320,6 +370,7 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 {
 	struct ptree_node *pn;
+	int rc;
 
 	if (unlikely(!ag))
 		return -EINVAL;
@@ -328,6 +379,10 @@ static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 	if (ag->ag_any[AG_IPv4])
 		return 0;
 
+	rc = ag_trie_lookup_v4(ag, addr);
+	if (rc != -EAGAIN)
+		return rc;
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[AG_IPv4], (uint8_t *)&addr);
@@ -406,6 +461,121 @@ int npf_addrgrp_lookup_v6_by_handle(struct npf_addrgrp *ag, uint8_t *addr)
 	return ag_lookup_v6(ag, addr);
 }
 
+/********************************************************************
+ * IPv4 multibit trie
+ *******************************************************************/
+
+static void npf_addrgrp_lpm_free_rcu(struct rcu_head *head)
+{
+	ag_lpm_destroy(caa_container_of(head, struct ag_lpm, al_rcu));
+}
+
+static int npf_addrgrp_lpm_add_cb(struct ptree_node *n, void *ctx)
+{
+	struct ag_lpm *al = ctx;
+	uint32_t addr;
+
+	memcpy(&addr, ptree_get_key(n), sizeof(addr));
+
+	return ag_lpm_add(al, ntohl(addr), ptree_get_mask(n));
+}
+
+/*
+ * Compile an address-groups IPv4 ptree into a new trie, and publish it in
+ * place of the current trie (if any).
+ */
+static void npf_addrgrp_lpm_build(struct npf_addrgrp *ag)
+{
+	struct ag_lpm *al = NULL, *old;
+	int rc;
+
+	if (ptree_get_table_leaf_count(ag->ag_tree[AG_IPv4]) >=
+	    NPF_ADDRGRP_LPM_MIN) {
+		al = ag_lpm_create();
+		if (!al)
+			goto error;
+
+		rc = ptree_walk(ag->ag_tree[AG_IPv4], PT_UP,
+				npf_addrgrp_lpm_add_cb, al);
+		if (rc != 0) {
+			ag_lpm_destroy(al);
+			goto error;
+		}
+		ag_lpm_trim(al);
+	}
+
+	old = ag->ag_lpm;
+	rcu_assign_pointer(ag->ag_lpm, al);
+	if (old)
+		call_rcu(&old->al_rcu, npf_addrgrp_lpm_free_rcu);
+	return;
+
+error:
+	/* Lookups continue to use the ptree */
+	RTE_LOG(ERR, FIREWALL,
+		"Failed to build trie for address-group %s\n", ag->ag_name);
+}
+
+static int
+npf_addrgrp_lpm_update_cb(const char *name __unused, uint id __unused,
+			  void *data, void *ctx __unused)
+{
+	struct npf_addrgrp *ag = data;
+
+	if (ag->ag_lpm_dirty) {
+		ag->ag_lpm_dirty = false;
+		npf_addrgrp_lpm_build(ag);
+	}
+	return 0;
+}
+
+/*
+ * Rebuild the tries of all address-groups that have changed since the last
+ * update.  Called on commit, or from a timer.
+ */
+void npf_addrgrp_lpm_update(void)
+{
+	if (!g_addrgrp_table)
+		return;
+
+	rte_timer_stop(&npf_addrgrp_lpm_timer);
+	npf_tbl_walk(g_addrgrp_table, npf_addrgrp_lpm_update_cb, NULL);
+}
+
+static void
+npf_addrgrp_lpm_timer_handler(struct rte_timer *timer __rte_unused,
+			      void *arg __rte_unused)
+{
+	npf_addrgrp_lpm_update();
+}
+
+/*
+ * An address-groups IPv4 ptree is about to change.  Discard its trie, and
+ * schedule a rebuild.
+ */
+static void
+npf_addrgrp_lpm_invalidate(struct npf_addrgrp *ag, enum npf_addrgrp_af af)
+{
+	struct ag_lpm *al;
+
+	if (af != AG_IPv4)
+		return;
+
+	al = ag->ag_lpm;
+	if (al) {
+		rcu_assign_pointer(ag->ag_lpm, NULL);
+		call_rcu(&al->al_rcu, npf_addrgrp_lpm_free_rcu);
+	}
+
+	ag->ag_lpm_dirty = true;
+
+	if (!rte_timer_pending(&npf_addrgrp_lpm_timer))
+		rte_timer_reset(&npf_addrgrp_lpm_timer,
+				NPF_ADDRGRP_LPM_DELAY * rte_get_timer_hz(),
+				SINGLE, rte_get_master_lcore(),
+				npf_addrgrp_lpm_timer_handler, NULL);
+}
+
 /*
  * Create an address-group tableset
  */
@@ -423,6 +593,7 @@ npf_addrgrp_tbl_create(void)
 			return -1;
 
 		npf_tbl_set_entry_freefn(table, npf_tbl_entry_free_cb);
+		rte_timer_init(&npf_addrgrp_lpm_timer);
 
 		rcu_assign_pointer(g_addrgrp_table, table);
 	}
@@ -440,6 +611,8 @@ npf_addrgrp_tbl_destroy(void)
 	if (!g_addrgrp_table)
 		return -EINVAL;
 
+	rte_timer_stop(&npf_addrgrp_lpm_timer);
+
 	table = g_addrgrp_table;
 	g_addrgrp_table = NULL;
 
@@ -679,6 +852,10 @@ static void npf_addrgrp_destroy(struct npf_addrgrp *ag)
 
 	rte_rwlock_write_unlock(&ag->ag_lock);
 
+	/* An RCU grace period has already elapsed */
+	ag_lpm_destroy(ag->ag_lpm);
+	ag->ag_lpm = NULL;
+
 	if (ag->ag_name) {
 		free(ag->ag_name);
 		ag->ag_name = NULL;
@@ -1343,6 +1520,8 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	if (mask == 0 && ag->ag_any[af])
 		return -EEXIST;
 
+	npf_addrgrp_lpm_invalidate(ag, af);
+
 	/*
 	 * Does the new prefix match/overlap with an existing prefix list
 	 * entry or list range entry?  This examines the address-group *list*.
@@ -1683,6 +1862,8 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 		cur_ae = ae;
 	}
 
+	npf_addrgrp_lpm_invalidate(ag, AG_ALEN2AF(alen));
+
 	zlist_t *list = ag->ag_list[AG_ALEN2AF(alen)];
 
 	ae = npf_addrgrp_range_insert_list(list, start->s6_addr, end->s6_addr,
@@ -1769,6 +1950,8 @@ int npf_addrgrp_prefix_remove(const char *name, npf_addr_t *addr,
 	if (ae->ae_type != NPF_ADDRGRP_TYPE_PREFIX)
 		return -EINVAL;
 
+	npf_addrgrp_lpm_invalidate(ag, AG_ALEN2AF(alen));
+
 	rc = npf_addrgrp_prefix_mask_remove(ae, mask);
 	if (rc < 0)
 		return rc;
@@ -1812,6 +1995,8 @@ int npf_addrgrp_range_remove(const char *name, npf_addr_t *start,
 	if (!ae)
 		return -ENOENT;
 
+	npf_addrgrp_lpm_invalidate(ag, AG_ALEN2AF(alen));
+
 	/*
 	 * zlist_remove calls npf_addrgrp_entry_free to free the entry,
 	 * which will remove the range prefixes from the ptree
@@ -2145,6 +2330,15 @@ npf_addrgrp_jsonw(json_writer_t *json, struct npf_addrgrp *ag,
 		if (ctl->tree)
 			npf_addrgrp_jsonw_tree(json, ag, af);
 
+		/* Memory used by the trie, for large IPv4 groups */
+		if (af == AG_IPv4) {
+			struct ag_lpm *al = rcu_dereference(ag->ag_lpm);
+
+			if (al)
+				jsonw_uint_field(json, "trie-size",
+						 ag_lpm_size(al));
+		}
+
 		jsonw_end_object(json);
 	}
 	jsonw_end_object(json);
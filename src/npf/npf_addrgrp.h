@@ -167,6 +167,14 @@ struct npf_addrgrp *npf_addrgrp_lookup_name(const char *name);
 void npf_addrgrp_update_handle(const char *old_name, const char *new_name,
 			       struct npf_addrgrp **agp);
 
+/**
+ * @brief Rebuild the IPv4 tries of any address-groups that have changed
+ *
+ * Called on commit.  Tries are otherwise rebuilt a short time after the
+ * last change.
+ */
+void npf_addrgrp_lpm_update(void);
+
 /**
  * @brief Create an address-group and insert it into tableset
  */
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Compressed IPv4 membership trie for address-groups.  See
+ * npf_addrgrp_lpm.h.
+ *
+ * Tables are built by the master thread only.  Second and third level blocks
+ * are allocated from two arrays that are grown as required while the table
+ * is being built, and trimmed to size once it is complete.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "npf_addrgrp_lpm.h"
+
+/* Initial number of blocks in each of the tbl8 and bitmap arrays */
+#define AG_LPM_BLOCKS_MIN	64
+
+struct ag_lpm *ag_lpm_create(void)
+{
+	struct ag_lpm *al;
+
+	al = calloc(1, sizeof(*al));
+	if (!al)
+		return NULL;
+
+	/* Block 0 is reserved */
+	al->al_ntbl8 = 1;
+	al->al_nbmap = 1;
+
+	return al;
+}
+
+void ag_lpm_destroy(struct ag_lpm *al)
+{
+	if (!al)
+		return;
+
+	free(al->al_tbl8);
+	free(al->al_bmap);
+	free(al);
+}
+
+/*
+ * Grow a block array, zeroing the new space.  Returns the new array, or NULL
+ * if out of memory (in which case the old array is unchanged).
+ */
+static void *
+ag_lpm_grow(void *array, uint32_t *max, size_t block_sz)
+{
+	uint32_t new_max;
+	uint8_t *new;
+
+	new_max = *max ? *max * 2 : AG_LPM_BLOCKS_MIN;
+
+	new = realloc(array, new_max * block_sz);
+	if (!new)
+		return NULL;
+
+	memset(new + *max * block_sz, 0, (new_max - *max) * block_sz);
+	*max = new_max;
+
+	return new;
+}
+
+static int ag_lpm_tbl8_alloc(struct ag_lpm *al, uint32_t *idx)
+{
+	if (al->al_ntbl8 == al->al_tbl8_max) {
+		uint32_t *tbl8;
+
+		tbl8 = ag_lpm_grow(al->al_tbl8, &al->al_tbl8_max,
+				   AG_LPM_TBL8_SZ * sizeof(*tbl8));
+		if (!tbl8)
+			return -ENOMEM;
+		al->al_tbl8 = tbl8;
+	}
+	*idx = al->al_ntbl8++;
+	return 0;
+}
+
+static int ag_lpm_bmap_alloc(struct ag_lpm *al, uint32_t *idx)
+{
+	if (al->al_nbmap == al->al_bmap_max) {
+		uint64_t *bmap;
+
+		bmap = ag_lpm_grow(al->al_bmap, &al->al_bmap_max,
+				   AG_LPM_BMAP_WORDS * sizeof(*bmap));
+		if (!bmap)
+			return -ENOMEM;
+		al->al_bmap = bmap;
+	}
+	*idx = al->al_nbmap++;
+	return 0;
+}
+
+/*
+ * Add a prefix.  A prefix that covers an entry that already references a
+ * next level block simply overwrites the reference with AG_LPM_HIT.  The
+ * orphaned block is not reused, but is still freed with the table.
+ */
+int ag_lpm_add(struct ag_lpm *al, uint32_t addr, uint8_t mask)
+{
+	uint32_t *e16, *e8, *tbl8;
+	uint64_t *bm;
+	uint32_t i, first, n, idx;
+	int rc;
+
+	if (mask > 32)
+		return -EINVAL;
+
+	if (mask <= 16) {
+		first = mask ? (addr >> 16) : 0;
+		n = 1u << (16 - mask);
+
+		for (i = first; i < first + n; i++)
+			al->al_tbl16[i] = AG_LPM_HIT;
+		return 0;
+	}
+
+	e16 = &al->al_tbl16[addr >> 16];
+	if (*e16 == AG_LPM_HIT)
+		return 0;
+
+	if (*e16 == AG_LPM_MISS) {
+		rc = ag_lpm_tbl8_alloc(al, &idx);
+		if (rc < 0)
+			return rc;
+		*e16 = idx << 1;
+	}
+	tbl8 = &al->al_tbl8[(*e16 >> 1) * AG_LPM_TBL8_SZ];
+
+	if (mask <= 24) {
+		first = (addr >> 8) & 0xff;
+		n = 1u << (24 - mask);
+
+		for (i = first; i < first + n; i++)
+			tbl8[i] = AG_LPM_HIT;
+		return 0;
+	}
+
+	e8 = &tbl8[(addr >> 8) & 0xff];
+	if (*e8 == AG_LPM_HIT)
+		return 0;
+
+	if (*e8 == AG_LPM_MISS) {
+		rc = ag_lpm_bmap_alloc(al, &idx);
+		if (rc < 0)
+			return rc;
+		*e8 = idx << 1;
+	}
+	bm = &al->al_bmap[(*e8 >> 1) * AG_LPM_BMAP_WORDS];
+
+	first = addr & 0xff;
+	n = 1u << (32 - mask);
+
+	for (i = first; i < first + n; i++)
+		bm[i >> 6] |= UINT64_C(1) << (i & 63);
+
+	return 0;
+}
+
+void ag_lpm_trim(struct ag_lpm *al)
+{
+	void *p;
+
+	/* A failure to shrink leaves the larger array in place */
+	if (al->al_ntbl8 < al->al_tbl8_max) {
+		p = realloc(al->al_tbl8, (size_t)al->al_ntbl8 *
+			    AG_LPM_TBL8_SZ * sizeof(*al->al_tbl8));
+		if (p) {
+			al->al_tbl8 = p;
+			al->al_tbl8_max = al->al_ntbl8;
+		}
+	}
+
+	if (al->al_nbmap < al->al_bmap_max) {
+		p = realloc(al->al_bmap, (size_t)al->al_nbmap *
+			    AG_LPM_BMAP_WORDS * sizeof(*al->al_bmap));
+		if (p) {
+			al->al_bmap = p;
+			al->al_bmap_max = al->al_nbmap;
+		}
+	}
+}
+
+size_t ag_lpm_size(const struct ag_lpm *al)
+{
+	return sizeof(*al) +
+		(size_t)al->al_tbl8_max * AG_LPM_TBL8_SZ *
+		sizeof(*al->al_tbl8) +
+		(size_t)al->al_bmap_max * AG_LPM_BMAP_WORDS *
+		sizeof(*al->al_bmap);
+}
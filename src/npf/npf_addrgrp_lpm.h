@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_ADDRGRP_LPM_H
+#define NPF_ADDRGRP_LPM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "compiler.h"
+#include "urcu.h"
+
+/*
+ * Compressed IPv4 membership trie for large address-groups.
+ *
+ * A three level multibit trie with strides of 16, 8 and 8 bits.  Unlike an
+ * LPM table there is no next-hop to store, only whether or not an address
+ * is covered by any prefix in the group, so the last level is a 256 bit
+ * bitmap per /24 rather than a table of entries.
+ *
+ * An entry in the first two levels is either AG_LPM_MISS, AG_LPM_HIT, or the
+ * index of a next level block shifted left by one.  Block index 0 is never
+ * used, so a block reference is always greater than AG_LPM_HIT.
+ *
+ * A lookup is at most three dependent memory reads.  The table is built
+ * from the address-group ptree and is never changed once published, so
+ * readers need no lock.
+ */
+
+#define AG_LPM_TBL16_SZ		(1 << 16)
+#define AG_LPM_TBL8_SZ		256
+#define AG_LPM_BMAP_WORDS	(AG_LPM_TBL8_SZ / 64)
+
+#define AG_LPM_MISS		0
+#define AG_LPM_HIT		1
+
+struct ag_lpm {
+	uint32_t	*al_tbl8;	/* second level blocks */
+	uint64_t	*al_bmap;	/* third level bitmaps */
+	uint32_t	al_ntbl8;
+	uint32_t	al_tbl8_max;
+	uint32_t	al_nbmap;
+	uint32_t	al_bmap_max;
+	struct rcu_head	al_rcu;
+	uint32_t	al_tbl16[AG_LPM_TBL16_SZ];
+};
+
+struct ag_lpm *ag_lpm_create(void);
+void ag_lpm_destroy(struct ag_lpm *al);
+
+/*
+ * Add a prefix.  addr is in host byte order.
+ */
+int ag_lpm_add(struct ag_lpm *al, uint32_t addr, uint8_t mask);
+
+/*
+ * Release unused space once all prefixes have been added
+ */
+void ag_lpm_trim(struct ag_lpm *al);
+
+/*
+ * Memory used by the table, in bytes
+ */
+size_t ag_lpm_size(const struct ag_lpm *al);
+
+/*
+ * Is an address covered by the table?  addr is in host byte order.
+ */
+static ALWAYS_INLINE bool
+ag_lpm_lookup(const struct ag_lpm *al, uint32_t addr)
+{
+	const uint64_t *bm;
+	uint32_t e;
+
+	e = al->al_tbl16[addr >> 16];
+	if (e <= AG_LPM_HIT)
+		return e;
+
+	e = al->al_tbl8[(e >> 1) * AG_LPM_TBL8_SZ + ((addr >> 8) & 0xff)];
+	if (e <= AG_LPM_HIT)
+		return e;
+
+	bm = &al->al_bmap[(e >> 1) * AG_LPM_BMAP_WORDS];
+	return (bm[(addr & 0xff) >> 6] >> (addr & 63)) & 1;
+}
+
+#endif /* NPF_ADDRGRP_LPM_H */
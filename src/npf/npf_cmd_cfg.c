@@ -653,6 +653,7 @@ cmd_commit(FILE *f, int argc, char **argv __unused)
 	}
 
 	pmf_arlg_commit();
+	npf_addrgrp_lpm_update();
 	npf_cfg_commit_all();
 	return 0;
 }
@@ -47,6 +47,16 @@ int npf_grouper_build(g2_config_t **g_ctx)
 	return 0;
 }
 
+int npf_grouper_dup(g2_config_t *g_ctx, g2_config_t **new_ctx,
+		    g2_md_map_t map, void *arg)
+{
+	*new_ctx = g2_dup(g_ctx, map, arg);
+	if (!*new_ctx)
+		return -ENOMEM;
+
+	return 0;
+}
+
 int npf_grouper_match(int af, g2_config_t *g_ctx, npf_cache_t *npc,
 		      void *data, npf_rule_t **rl)
 {
@@ -21,6 +21,9 @@ int npf_grouper_add_rule(int af, g2_config_t *g_ctx, uint32_t rule_no,
 
 int npf_grouper_build(g2_config_t **g_ctx);
 
+int npf_grouper_dup(g2_config_t *g_ctx, g2_config_t **new_ctx,
+		    g2_md_map_t map, void *arg);
+
 int npf_grouper_match(int af, g2_config_t *g_ctx, npf_cache_t *npc,
 		      void *data, npf_rule_t **rl);
 
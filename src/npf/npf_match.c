@@ -94,3 +94,20 @@ int npf_match_destroy(enum npf_ruleset_type rs_type,
 
 	return npf_grouper_destroy((g2_config_t **)ctx);
 }
+
+int npf_match_dup(enum npf_ruleset_type rs_type,
+		  int af, npf_match_ctx_t *ctx, npf_match_ctx_t **new_ctx,
+		  npf_match_ctx_map_t map, void *arg)
+{
+	npf_match_cb_tbl *tbl;
+
+	tbl = npf_match_cbs[rs_type];
+	if (tbl) {
+		if (!tbl->npf_match_dup_cb)
+			return -EOPNOTSUPP;
+		return tbl->npf_match_dup_cb(af, ctx, new_ctx, map, arg);
+	}
+
+	return npf_grouper_dup((g2_config_t *)ctx, (g2_config_t **)new_ctx,
+			       map, arg);
+}
@@ -41,6 +41,15 @@ typedef	int (*npf_match_classify_cb_t)(int af, npf_match_ctx_t *ctx,
 				       npf_rule_t **rl);
 typedef int (*npf_match_destroy_cb_t)(int af, npf_match_ctx_t **ctx);
 
+/*
+ * Optional. Make a context from a built one, for a group with the same
+ * rules, without building it again. map returns the match_ctx of each rule
+ * in the new group, given the match_ctx it was added to ctx with.
+ */
+typedef void *(*npf_match_ctx_map_t)(void *match_ctx, void *arg);
+typedef int (*npf_match_dup_cb_t)(int af, npf_match_ctx_t *ctx,
+				  npf_match_ctx_t **new_ctx,
+				  npf_match_ctx_map_t map, void *arg);
 
 typedef struct npf_match_cb_tbl {
 	npf_match_init_cb_t      npf_match_init_cb;
@@ -48,6 +57,7 @@ typedef struct npf_match_cb_tbl {
 	npf_match_build_cb_t     npf_match_build_cb;
 	npf_match_classify_cb_t  npf_match_classify_cb;
 	npf_match_destroy_cb_t   npf_match_destroy_cb;
+	npf_match_dup_cb_t       npf_match_dup_cb;
 } npf_match_cb_tbl;
 
 int npf_match_register_cb_tbl(enum npf_ruleset_type rlset_type,
@@ -73,4 +83,8 @@ int npf_match_classify(enum npf_ruleset_type rlset_type,
 int npf_match_destroy(enum npf_ruleset_type rlset_type,
 		      int af, npf_match_ctx_t **ctx);
 
+int npf_match_dup(enum npf_ruleset_type rlset_type,
+		  int af, npf_match_ctx_t *ctx, npf_match_ctx_t **new_ctx,
+		  npf_match_ctx_map_t map, void *arg);
+
 #endif
@@ -5,6 +5,8 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
+#include <rte_common.h>
 #include <rte_log.h>
 
 #include "dp_session.h"
@@ -421,3 +423,179 @@ int dp_session_pack(struct session *session, void *buf, uint32_t size,
 
 	return ret;
 }
+
+/* Bulk packing state, carried through the session table walk */
+struct npf_pack_bulk {
+	char			*buf;
+	uint32_t		size;
+	uint32_t		len;
+	uint32_t		count;
+	enum session_pack_type	spt;
+	uint64_t		last_id;
+	bool			full;
+};
+
+static uint64_t npf_pack_session_pkts(struct session *s)
+{
+	return rte_atomic64_read(&s->se_pkts_in) +
+		rte_atomic64_read(&s->se_pkts_out);
+}
+
+static int npf_pack_bulk_full(struct session *s, struct npf_pack_bulk *pb)
+{
+	struct npf_pack_bulk_rec *rec;
+	struct session *peer = NULL;
+	uint32_t len = 0;
+	int rc;
+
+	if (dp_session_is_expired(s))
+		return 0;
+
+	/* A NAT64 pair is packed together, with the parent */
+	if ((session_is_nat64(s) || session_is_nat46(s)) &&
+	    session_base_parent(s) != s)
+		return 0;
+
+	if (pb->size - pb->len < NPF_PACK_BULK_SESSION_MAX_SIZE) {
+		pb->full = true;
+		return 1;
+	}
+
+	rec = (struct npf_pack_bulk_rec *)(pb->buf + pb->len);
+	rc = npf_pack_session_pack_new(s,
+			(struct npf_pack_session_new *)(rec + 1), &len, &peer);
+	if (rc)
+		return 0;
+
+	rec->len = sizeof(*rec) + len;
+	pb->len += rec->len;
+	pb->count++;
+
+	s->se_pack_pkts = npf_pack_session_pkts(s);
+	if (peer)
+		peer->se_pack_pkts = npf_pack_session_pkts(peer);
+	return 0;
+}
+
+static int npf_pack_bulk_update(struct session *s, struct npf_pack_bulk *pb)
+{
+	struct npf_pack_session_delta *psd;
+	struct npf_pack_bulk_rec *rec;
+	struct npf_session *se;
+	struct sentry *sen;
+	struct ifnet *ifp;
+	uint64_t pkts;
+	bool expired;
+	int i;
+
+	/* Expiry is sent once, marked by all ones */
+	expired = dp_session_is_expired(s);
+	pkts = expired ? UINT64_MAX : npf_pack_session_pkts(s);
+	if (pkts == s->se_pack_pkts)
+		return 0;
+
+	sen = s->se_sen;
+	if (!sen)
+		return 0;
+	ifp = dp_ifnet_byifindex(sen->sen_ifindex);
+	if (!ifp)
+		return 0;
+
+	se = session_feature_get(s, sen->sen_ifindex, SESSION_FEATURE_NPF);
+	if (!se && !expired)
+		return 0;
+
+	if (pb->size - pb->len < NPF_PACK_DELTA_SESSION_MAX_SIZE) {
+		pb->full = true;
+		return 1;
+	}
+
+	rec = (struct npf_pack_bulk_rec *)(pb->buf + pb->len);
+	psd = (struct npf_pack_session_delta *)(rec + 1);
+	memset(psd, 0, sizeof(*psd));
+
+	strncpy(psd->ifname, ifp->if_name, IFNAMSIZ);
+	psd->sp_sentry_flags = (sen->sen_flags & SENTRY_IPv4) ?
+		SENTRY_IPv4 : SENTRY_IPv6;
+	psd->sp_protocol = sen->sen_protocol;
+	psd->sp_len = sen->sen_len;
+	for (i = 0; i < sen->sen_len; i++)
+		psd->sp_addrids[i] = sen->sen_addrids[i];
+
+	session_npf_pack_stats_pack(s, &psd->stats);
+
+	if (!expired && !npf_session_npf_pack_state_pack(se, &psd->state))
+		psd->se_feature_count = rte_atomic16_read(&s->se_feature_count);
+
+	rec->len = sizeof(*rec) + sizeof(*psd) +
+		sen->sen_len * sizeof(uint32_t);
+	pb->len += rec->len;
+	pb->count++;
+
+	s->se_pack_pkts = pkts;
+	return 0;
+}
+
+static int npf_pack_bulk_session(struct session *s, void *data)
+{
+	struct npf_pack_bulk *pb = data;
+	uint32_t count = pb->count;
+	int rc;
+
+	if (pb->spt == SESSION_PACK_FULL)
+		rc = npf_pack_bulk_full(s, pb);
+	else
+		rc = npf_pack_bulk_update(s, pb);
+
+	/* The cursor is the last session packed, not the last one seen */
+	if (pb->count != count)
+		pb->last_id = s->se_id;
+	return rc;
+}
+
+int dp_session_pack_bulk(void *buf, uint32_t size, enum session_pack_type spt,
+			 uint64_t *cursor)
+{
+	struct npf_pack_message *msg = buf;
+	struct npf_pack_bulk_hdr *bh;
+	struct npf_pack_bulk pb = {
+		.buf = buf,
+		.size = RTE_MIN(size, (uint32_t)NPF_PACK_BULK_MAX_SIZE),
+		.len = NPF_PACK_BULK_MIN_SIZE,
+		.spt = spt,
+	};
+	int rc;
+
+	if (!buf || !cursor || size < NPF_PACK_BULK_MIN_SIZE ||
+	    (spt != SESSION_PACK_FULL && spt != SESSION_PACK_UPDATE))
+		return -EINVAL;
+
+	if (*cursor)
+		rc = session_table_walk_after(*cursor, npf_pack_bulk_session,
+					      &pb);
+	else
+		rc = session_table_walk(npf_pack_bulk_session, &pb);
+
+	if (rc < 0)
+		return rc;
+
+	/* The first session did not fit */
+	if (pb.full && !pb.count) {
+		RTE_LOG(ERR, DATAPLANE,
+			"SESSION_PACK: Bulk buffer too small: given %u\n",
+			size);
+		return -EINVAL;
+	}
+
+	*cursor = pb.full ? pb.last_id : 0;
+
+	bh = (struct npf_pack_bulk_hdr *)&msg->data;
+	bh->count = pb.count;
+
+	msg->hdr.len = pb.len;
+	msg->hdr.version = SESSION_PACK_BULK_VERSION;
+	msg->hdr.flags = 0;
+	msg->hdr.msg_type = spt;
+
+	return (int)msg->hdr.len;
+}
@@ -34,6 +34,12 @@
 #define NPF_PACK_MESSAGE_MIN_SIZE     (sizeof(struct npf_pack_message_hdr))
 
 #define SESSION_PACK_VERSION	      (0x0100)
+#define SESSION_PACK_BULK_VERSION     (0x0101)
+
+/* Smallest and largest bulk message */
+#define NPF_PACK_BULK_MIN_SIZE	      (sizeof(struct npf_pack_message_hdr) + \
+				       sizeof(struct npf_pack_bulk_hdr))
+#define NPF_PACK_BULK_MAX_SIZE	      (1 << 20)
 
 enum {
 	NPF_PACK_SESSION_NEW_FW = 1,
@@ -181,11 +187,50 @@ struct npf_pack_message {
 	} data;
 } __attribute__ ((__packed__));
 
+/*
+ * Bulk messages have the version SESSION_PACK_BULK_VERSION and carry many
+ * sessions.  The message header is followed by a record count and then by
+ * the records, each preceded by its length.
+ *
+ * A SESSION_PACK_FULL record is a npf_pack_session_new, followed by its
+ * peer for a NAT64 or NAT46 session.  A SESSION_PACK_UPDATE record is a
+ * npf_pack_session_delta, which only has the forward sentry, and only the
+ * words of that sentry that are used.
+ */
+struct npf_pack_bulk_hdr {
+	uint32_t	count;
+} __attribute__ ((__packed__));
+
+struct npf_pack_bulk_rec {
+	uint32_t	len;
+} __attribute__ ((__packed__));
+
+struct npf_pack_session_delta {
+	char				ifname[IFNAMSIZ];
+	uint16_t			sp_sentry_flags;
+	uint8_t				sp_protocol;
+	uint8_t				sp_len;
+	uint16_t			se_feature_count;
+	uint8_t				pad[2];
+	struct npf_pack_npf_state	state;
+	struct npf_pack_session_stats	stats;
+	uint32_t			sp_addrids[];
+} __attribute__ ((__packed__));
+
+#define NPF_PACK_DELTA_SESSION_MAX_SIZE				\
+	(sizeof(struct npf_pack_bulk_rec) +			\
+	 sizeof(struct npf_pack_session_delta) +		\
+	 SENTRY_LEN_IPV6 * sizeof(uint32_t))
+
+#define NPF_PACK_BULK_SESSION_MAX_SIZE				\
+	(sizeof(struct npf_pack_bulk_rec) + NPF_PACK_NEW_SESSION_MAX_SIZE)
+
 bool npf_pack_validate_msg(struct npf_pack_message *msg, uint32_t size);
 uint8_t npf_pack_get_msg_type(struct npf_pack_message *msg);
 uint64_t npf_pack_get_session_id(struct npf_pack_message *msg);
 
 struct npf_pack_session_stats *
 npf_pack_get_session_stats(struct npf_pack_message *msg);
+bool npf_pack_validate_bulk_msg(struct npf_pack_message *msg, uint32_t size);
 
 #endif	/* NPF_PACK_H */
@@ -5,6 +5,7 @@
  */
 
 #include <rte_acl.h>
+#include <rte_atomic.h>
 #include <rte_ip.h>
 #include "vplane_log.h"
 #include "npf_rte_acl.h"
@@ -16,6 +17,7 @@ struct npf_match_ctx {
 	struct rte_acl_ctx *acl_ctx;
 	char *name;
 	uint16_t num_rules;
+	rte_atomic32_t refcnt;	/* groups sharing the context */
 };
 
 /* rte acl stuff */
@@ -290,6 +292,7 @@ int npf_rte_acl_init(int af, const char *name, uint32_t max_rules,
 		return -ENOMEM;
 	}
 
+	rte_atomic32_set(&tmp_ctx->refcnt, 1);
 	*m_ctx = tmp_ctx;
 
 	return 0;
@@ -563,14 +566,32 @@ int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx,
 	return 1;
 }
 
+/*
+ * A match gives the rule number, which is looked up in the group being
+ * matched, so a group with the same rules can share the built context.
+ */
+int npf_rte_acl_dup(int af __rte_unused, npf_match_ctx_t *m_ctx,
+		    npf_match_ctx_t **new_ctx,
+		    npf_match_ctx_map_t map __rte_unused,
+		    void *arg __rte_unused)
+{
+	rte_atomic32_inc(&m_ctx->refcnt);
+	*new_ctx = m_ctx;
+
+	return 0;
+}
+
 int npf_rte_acl_destroy(int af __rte_unused, npf_match_ctx_t **m_ctx)
 {
 	npf_match_ctx_t *ctx = *m_ctx;
 
 	if (ctx) {
-		rte_acl_reset(ctx->acl_ctx);
-		rte_acl_free(ctx->acl_ctx);
-		free(ctx);
+		if (rte_atomic32_dec_and_test(&ctx->refcnt)) {
+			rte_acl_reset(ctx->acl_ctx);
+			rte_acl_free(ctx->acl_ctx);
+			free(ctx->name);
+			free(ctx);
+		}
 		*m_ctx = NULL;
 	}
 
@@ -24,6 +24,10 @@ int npf_rte_acl_build(int af, npf_match_ctx_t **m_ctx);
 int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx, npf_cache_t *npc,
 		      struct npf_match_cb_data *data, uint32_t *rule_no);
 
+int npf_rte_acl_dup(int af, npf_match_ctx_t *m_ctx,
+		    npf_match_ctx_t **new_ctx,
+		    npf_match_ctx_map_t map, void *arg);
+
 int npf_rte_acl_destroy(int af, npf_match_ctx_t **m_ctx);
 
 #endif
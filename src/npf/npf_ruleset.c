@@ -67,6 +67,7 @@
 #include "npf/npf.h"
 #include "npf/config/npf_attach_point.h"
 #include "npf/config/npf_config.h"
+#include "npf/config/npf_rule_group.h"
 #include "npf/grouper2.h"
 #include "npf/npf_disassemble.h"
 #include "npf/npf_nat.h"
@@ -106,6 +107,10 @@ struct npf_ruleset {
 	enum npf_ruleset_type	rs_type;
 	bool			rs_is_stateful;
 	bool			rs_is_dead;
+	uint32_t		rs_ncode_gen;	/* see npf_rule_group.h */
+
+	/* The ruleset this one replaces, only set while building */
+	npf_ruleset_t		*rs_prev;
 };
 
 /* Rproc definitions */
@@ -142,6 +147,20 @@ struct npf_rule_group {
 	char *rg_name;			/* name of this rule group */
 
 	npf_ruleset_t *rg_ruleset;	/* ruleset this group is in */
+
+	/*
+	 * The same group in the ruleset being replaced, and the last rule
+	 * found in it, while building. Used to reuse unchanged rules.
+	 */
+	npf_rule_group_t *rg_prev;
+	struct cds_list_head *rg_prev_pos;
+
+	/*
+	 * While all the rules so far are unchanged, adding them to the match
+	 * contexts is put off, as the built contexts of rg_prev may be reused.
+	 */
+	uint32_t rg_max_rules;
+	bool rg_unchanged;
 };
 
 /* Struct containing rule generation and state data.  */
@@ -186,6 +205,7 @@ npf_ruleset_create(enum npf_ruleset_type ruleset_type,
 		CDS_INIT_LIST_HEAD(&ruleset->rs_reap);
 		ruleset->rs_type = ruleset_type;
 		ruleset->rs_attach_type = attach_type;
+		ruleset->rs_ncode_gen = npf_cfg_ncode_generation();
 		ruleset->rs_attach_point = strdup(attach_point);
 
 		if (!ruleset->rs_attach_point) {
@@ -196,6 +216,21 @@ npf_ruleset_create(enum npf_ruleset_type ruleset_type,
 	return ruleset;
 }
 
+/*
+ * Set the ruleset that the ruleset being built will replace, or NULL
+ * once building is complete. Groups created while it is set pick up
+ * the matching group of the old ruleset so that unchanged rules can be
+ * reused rather than being parsed and compiled again.
+ */
+void
+npf_ruleset_set_prev(npf_ruleset_t *ruleset, npf_ruleset_t *prev)
+{
+	if (prev && prev->rs_type != ruleset->rs_type)
+		prev = NULL;
+
+	ruleset->rs_prev = prev;
+}
+
 static struct npf_rule_stats *
 npf_rule_stats_get(struct npf_rule_stats *rl_stats)
 {
@@ -567,6 +602,9 @@ static void rule_ref_stats(npf_rule_t *old, npf_rule_t *new)
 	 * rule, and instead reference the statistics associated with the
 	 * old rule.
 	 */
+	if (new->r_stats == old->r_stats)
+		return;
+
 	if (new->r_stats)
 		npf_rule_stats_put(new->r_stats);
 
@@ -618,27 +656,38 @@ static int npf_rg_rule_match(struct cds_lfht_node *node, const void *key)
 	return 0;
 }
 
+/*
+ * Find a rule by number. The rules of a group are kept in rule number
+ * order, so for a group without a hash table the list walk resumes from
+ * *pos, the last rule visited. Looking up rules in increasing order is
+ * then linear in the size of the group rather than quadratic.
+ */
 static npf_rule_t *
-npf_find_rule(npf_rule_group_t *rg, npf_rule_t *match)
+npf_find_rule(npf_rule_group_t *rg, uint32_t rule_no,
+	      struct cds_list_head **pos)
 {
+	struct cds_list_head *next;
 	npf_rule_t *rl;
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
 
 	if (rg->rg_rules_ht) {
-		cds_lfht_lookup(rg->rg_rules_ht, match->r_state->rs_rule_no,
-				npf_rg_rule_match, &match->r_state->rs_rule_no,
-				&iter);
+		cds_lfht_lookup(rg->rg_rules_ht, rule_no,
+				npf_rg_rule_match, &rule_no, &iter);
 		node = cds_lfht_iter_get_node(&iter);
 		return node ? caa_container_of(node, npf_rule_t, r_entry_ht) :
 			NULL;
 	}
 
-	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
-		if (match->r_state->rs_rule_no == rl->r_state->rs_rule_no)
-			return rl;
-		else if (match->r_state->rs_rule_no < rl->r_state->rs_rule_no)
+	for (next = (*pos)->next; next != &rg->rg_rules; next = next->next) {
+		rl = cds_list_entry(next, npf_rule_t, r_entry);
+
+		if (rule_no < rl->r_state->rs_rule_no)
 			return NULL;
+
+		*pos = next;
+		if (rule_no == rl->r_state->rs_rule_no)
+			return rl;
 	}
 	return NULL;
 }
@@ -646,10 +695,12 @@ npf_find_rule(npf_rule_group_t *rg, npf_rule_t *match)
 static void
 npf_ref_stats_group(npf_rule_group_t *rg_old, npf_rule_group_t *rg_new)
 {
+	struct cds_list_head *pos = &rg_old->rg_rules;
 	npf_rule_t *rl_old, *rl_new;
 
 	cds_list_for_each_entry(rl_new, &rg_new->rg_rules, r_entry) {
-		rl_old = npf_find_rule(rg_old, rl_new);
+		rl_old = npf_find_rule(rg_old, rl_new->r_state->rs_rule_no,
+				       &pos);
 
 		if (rl_old)
 			npf_ref_stats_if_rule_unchanged(rl_old, rl_new);
@@ -679,11 +730,8 @@ npf_find_rule_group(struct cds_list_head *from_groups, npf_rule_group_t *match)
  * When a rule has a non-filter change, i.e. log the statistics
  * are still cleared.
  *
- * Finally, this is a list walk from the beginning--expensive on
- * large sets. Marking last match would improve performance, but
- * this is tricky in getting right when there's a number of rule
- * changes. Or moderately tricky--should be done once this technique
- * has been validated.
+ * Rules reused from the old ruleset by npf_make_rule() already share
+ * their statistics, so this only has work to do for changed rules.
  */
 void
 npf_ref_stats(npf_ruleset_t *old, npf_ruleset_t *new)
@@ -748,6 +796,15 @@ npf_get_ncode(const npf_rule_t *rl)
 	return rl->r_ncode;
 }
 
+/*
+ * Per-lcore rule counters, indexed by lcore id.  May be NULL.
+ */
+const struct npf_rule_stats *
+npf_rule_get_stats(const npf_rule_t *rl)
+{
+	return rl->r_stats;
+}
+
 rule_no_t
 npf_rule_get_num(npf_rule_t *rl)
 {
@@ -1225,6 +1282,14 @@ npf_rule_group_create(npf_ruleset_t *ruleset, enum npf_rule_class group_class,
 			goto err;
 	}
 
+	/* Find the group being replaced, if any, to reuse its rules */
+	if (ruleset->rs_prev) {
+		rg->rg_prev = npf_find_rule_group(&ruleset->rs_prev->rs_groups,
+						  rg);
+		if (rg->rg_prev)
+			rg->rg_prev_pos = &rg->rg_prev->rg_rules;
+	}
+
 	/* Add group to ruleset, after the groups that are there. */
 	cds_list_add_tail_rcu(&rg->rg_entry, &ruleset->rs_groups);
 
@@ -1381,6 +1446,9 @@ npf_add_rule_to_grouper(npf_rule_t *rl)
 		rl->r_state->rs_rule_group->rg_ruleset->rs_type;
 	int err;
 
+	if (rl->r_state->rs_rule_group->rg_unchanged)
+		return 0;
+
 	/*
 	 * Insert the grouper entries for this rule into the grouper
 	 * associated with this group of rules.
@@ -1452,8 +1520,47 @@ grouper_rule_dump(struct npf_rule_grouper_info *info)
 }
 #endif /* NPF_RULE_DEBUG */
 
+/*
+ * Can the ncode of an unchanged rule in the ruleset being replaced be
+ * copied? Not if any group inlined into the ncode has changed since, or
+ * if the rule references an address-group, as the table id is resolved
+ * when generating the ncode.
+ */
+static bool
+npf_rule_ncode_reusable(const npf_rule_t *rl_old, const npf_ruleset_t *rs)
+{
+	zhashx_t *config_ht = rl_old->r_state->rs_config_ht;
+
+	if (rl_old->r_state->rs_rule_group->rg_ruleset->rs_ncode_gen !=
+	    rs->rs_ncode_gen)
+		return false;
+
+	return !zhashx_lookup(config_ht, "src-addr-group") &&
+		!zhashx_lookup(config_ht, "dst-addr-group");
+}
+
 static int
-npf_process_rule_config(npf_rule_t *rl)
+npf_copy_rule_ncode(npf_rule_t *rl, const npf_rule_t *rl_old)
+{
+	if (rl_old->r_ncode) {
+		rl->r_ncode = malloc(rl_old->r_nc_size);
+		if (!rl->r_ncode)
+			return -ENOMEM;
+		memcpy(rl->r_ncode, rl_old->r_ncode, rl_old->r_nc_size);
+	}
+	rl->r_nc_size = rl_old->r_nc_size;
+	rl->r_state->rs_grouper_info = rl_old->r_state->rs_grouper_info;
+
+	return 0;
+}
+
+/*
+ * Process the parsed config of a rule. If rl_old is set then it is the
+ * same rule with an identical config in the ruleset being replaced, and
+ * its ncode is copied when possible rather than generated again.
+ */
+static int
+npf_process_rule_config(npf_rule_t *rl, const npf_rule_t *rl_old)
 {
 	char *value;
 	int ret;
@@ -1496,9 +1603,13 @@ npf_process_rule_config(npf_rule_t *rl)
 			return ret;
 	}
 
-	ret = npf_gen_ncode(rl->r_state->rs_config_ht, &rl->r_ncode,
-			&rl->r_nc_size, rl->r_rproc_match,
-			&rl->r_state->rs_grouper_info);
+	if (rl_old && npf_rule_ncode_reusable(
+		    rl_old, rl->r_state->rs_rule_group->rg_ruleset))
+		ret = npf_copy_rule_ncode(rl, rl_old);
+	else
+		ret = npf_gen_ncode(rl->r_state->rs_config_ht, &rl->r_ncode,
+				    &rl->r_nc_size, rl->r_rproc_match,
+				    &rl->r_state->rs_grouper_info);
 	if (ret)
 		return ret;
 
@@ -1527,12 +1638,82 @@ npf_process_rule_config(npf_rule_t *rl)
 	return 0;
 }
 
+/*
+ * Find the rule in the group being replaced with the same number and an
+ * identical config line, if there is one.
+ */
+static npf_rule_t *
+npf_find_unchanged_rule(npf_rule_group_t *rg, uint32_t rule_no,
+			const char *rule_line)
+{
+	npf_rule_t *rl_old;
+
+	if (!rg->rg_prev)
+		return NULL;
+
+	rl_old = npf_find_rule(rg->rg_prev, rule_no, &rg->rg_prev_pos);
+	if (!rl_old || !rl_old->r_state->rs_config_ht ||
+	    strcmp(rl_old->r_state->rs_config_line, rule_line) != 0)
+		return NULL;
+
+	return rl_old;
+}
+
+static int
+npf_match_create(npf_rule_group_t *rg)
+{
+	int err;
+	enum npf_ruleset_type rs_type = rg->rg_ruleset->rs_type;
+
+	DP_DEBUG(NPF, DEBUG, DATAPLANE, "Creating ruleset of size %d\n",
+		 rg->rg_max_rules);
+
+	err = npf_match_init(rs_type, AF_INET, rg->rg_name,
+			     rg->rg_max_rules, &rg->match_ctx_v4);
+	if (err)
+		return err;
+
+	err = npf_match_init(rs_type, AF_INET6, rg->rg_name,
+			     rg->rg_max_rules, &rg->match_ctx_v6);
+	if (err) {
+		npf_match_destroy(rs_type, AF_INET, &rg->match_ctx_v4);
+		return err;
+	}
+
+	return 0;
+}
+
+/*
+ * The group cannot reuse the match contexts it replaces, so create its own
+ * and add the rules that were put off.
+ */
+static int
+npf_match_add_deferred(npf_rule_group_t *rg)
+{
+	npf_rule_t *rl;
+	int err;
+
+	rg->rg_unchanged = false;
+
+	err = npf_match_create(rg);
+	if (err)
+		return err;
+
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
+		err = npf_add_rule_to_grouper(rl);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
 int
 npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line,
 	      uint32_t ruleset_type_flags)
 {
 	struct cds_lfht_node *ret_node = NULL;
-	npf_rule_t *rl;
+	npf_rule_t *rl, *rl_old;
 	int ret;
 
 	rl = npf_alloc_rule(ruleset_type_flags);
@@ -1548,7 +1729,27 @@ npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line,
 		goto error;
 	}
 
-	rl->r_state->rs_config_ht = zhashx_new();
+	/*
+	 * An unchanged rule starts from a copy of the parsed config of the
+	 * rule it replaces, rather than parsing the rule line again.
+	 */
+	rl_old = npf_find_unchanged_rule(rg, rule_no, rule_line);
+
+	/*
+	 * The match contexts can only be reused if the rule's grouper data,
+	 * which is made along with its ncode, is reused too.
+	 */
+	if (rg->rg_unchanged &&
+	    (!rl_old || !npf_rule_ncode_reusable(rl_old, rg->rg_ruleset))) {
+		ret = npf_match_add_deferred(rg);
+		if (ret)
+			goto error;
+	}
+	if (rl_old)
+		rl->r_state->rs_config_ht =
+			zhashx_dup(rl_old->r_state->rs_config_ht);
+	else
+		rl->r_state->rs_config_ht = zhashx_new();
 	if (!rl->r_state->rs_config_ht) {
 		RTE_LOG(ERR, FIREWALL, "Error: rule hash table allocation "
 			"failed\n");
@@ -1591,14 +1792,18 @@ npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line,
 		}
 	}
 
-	ret = npf_parse_rule_line(rl->r_state->rs_config_ht, rule_line);
-	if (ret) {
-		RTE_LOG(ERR, FIREWALL, "Error: parsing rule line: %s - %s\n",
-			rule_line, strerror(-ret));
-		goto error;
+	if (!rl_old) {
+		ret = npf_parse_rule_line(rl->r_state->rs_config_ht,
+					  rule_line);
+		if (ret) {
+			RTE_LOG(ERR, FIREWALL,
+				"Error: parsing rule line: %s - %s\n",
+				rule_line, strerror(-ret));
+			goto error;
+		}
 	}
 
-	ret = npf_process_rule_config(rl);
+	ret = npf_process_rule_config(rl, rl_old);
 	if (ret) {
 		RTE_LOG(ERR, FIREWALL, "Error: processing config for rule "
 			"line: %s - %s\n", rule_line, strerror(-ret));
@@ -1607,6 +1812,10 @@ npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line,
 
 	rl->r_state->rs_hash = npf_rule_hash(rl);
 
+	/* An unchanged rule carries on counting in the old statistics */
+	if (rl_old)
+		rule_ref_stats(rl_old, rl);
+
 	return 0;
 error:
 	cds_list_del(&rl->r_entry);
@@ -1705,19 +1914,78 @@ npf_rproc_match(npf_cache_t *npc, struct rte_mbuf *m, const npf_rule_t *rl,
 int
 npf_match_setup(npf_rule_group_t *rg, uint32_t max_rules)
 {
-	int err;
+	rg->rg_max_rules = max_rules;
+
+	/* Wait to see if the group can reuse the contexts it replaces */
+	if (rg->rg_prev) {
+		rg->rg_unchanged = true;
+		return 0;
+	}
+
+	return npf_match_create(rg);
+}
+
+/* Does the group have the same rule numbers as the one it replaces? */
+static bool
+npf_rule_group_unchanged(npf_rule_group_t *rg)
+{
+	struct cds_list_head *head = &rg->rg_prev->rg_rules;
+	struct cds_list_head *pos = head;
+	npf_rule_t *rl, *rl_old;
+
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
+		pos = pos->next;
+		if (pos == head)
+			return false;
+
+		rl_old = cds_list_entry(pos, npf_rule_t, r_entry);
+		if (rl_old->r_state->rs_rule_no != rl->r_state->rs_rule_no)
+			return false;
+	}
+
+	return pos->next == head;
+}
+
+struct npf_match_map {
+	npf_rule_group_t *rg;
+	struct cds_list_head *pos;
+};
+
+/* Map a rule in the group replaced to the same rule in the new group */
+static void *
+npf_match_map_rule(void *match_ctx, void *arg)
+{
+	npf_rule_t *rl_old = match_ctx;
+	struct npf_match_map *map = arg;
+
+	return npf_find_rule(map->rg, rl_old->r_state->rs_rule_no, &map->pos);
+}
+
+/*
+ * Make the match contexts of a group, all of whose rules are unchanged,
+ * from the built contexts of the group it replaces.
+ */
+static int
+npf_match_reuse(npf_rule_group_t *rg)
+{
 	enum npf_ruleset_type rs_type = rg->rg_ruleset->rs_type;
+	npf_rule_group_t *rg_prev = rg->rg_prev;
+	struct npf_match_map map = { .rg = rg };
+	int err;
 
-	DP_DEBUG(NPF, DEBUG, DATAPLANE, "Creating ruleset of size %d\n",
-		 max_rules);
+	if (!rg_prev->match_ctx_v4 || !rg_prev->match_ctx_v6 ||
+	    !npf_rule_group_unchanged(rg))
+		return -ENOENT;
 
-	err = npf_match_init(rs_type, AF_INET, rg->rg_name,
-			     max_rules, &rg->match_ctx_v4);
+	map.pos = &rg->rg_rules;
+	err = npf_match_dup(rs_type, AF_INET, rg_prev->match_ctx_v4,
+			    &rg->match_ctx_v4, npf_match_map_rule, &map);
 	if (err)
 		return err;
 
-	err = npf_match_init(rs_type, AF_INET6, rg->rg_name,
-			     max_rules, &rg->match_ctx_v6);
+	map.pos = &rg->rg_rules;
+	err = npf_match_dup(rs_type, AF_INET6, rg_prev->match_ctx_v6,
+			    &rg->match_ctx_v6, npf_match_map_rule, &map);
 	if (err) {
 		npf_match_destroy(rs_type, AF_INET, &rg->match_ctx_v4);
 		return err;
@@ -1726,19 +1994,39 @@ npf_match_setup(npf_rule_group_t *rg, uint32_t max_rules)
 	return 0;
 }
 
-void
+int
 npf_match_optimize(npf_rule_group_t *rg)
 {
-	int err;
+	int err = 0;
 	enum npf_ruleset_type rs_type = rg->rg_ruleset->rs_type;
 
-	err = npf_match_build(rs_type, AF_INET, &rg->match_ctx_v4);
-	if (err)
+	/*
+	 * A group with the same rules as the one it replaces reuses its
+	 * contexts, so they are not built again.
+	 */
+	if (rg->rg_unchanged) {
+		if (npf_match_reuse(rg) == 0) {
+			rg->rg_unchanged = false;
+			goto done;
+		}
+
+		err = npf_match_add_deferred(rg);
+		if (err)
+			goto done;
+	}
+
+	if (npf_match_build(rs_type, AF_INET, &rg->match_ctx_v4))
 		RTE_LOG(ERR, DATAPLANE, "Could not rebuild IPv4 grouper\n");
 
-	err = npf_match_build(rs_type, AF_INET6, &rg->match_ctx_v6);
-	if (err)
+	if (npf_match_build(rs_type, AF_INET6, &rg->match_ctx_v6))
 		RTE_LOG(ERR, DATAPLANE, "Could not rebuild IPv6 grouper\n");
+
+done:
+	/* The group is complete, so no more rules to reuse */
+	rg->rg_prev = NULL;
+	rg->rg_prev_pos = NULL;
+
+	return err;
 }
 
 static ALWAYS_INLINE
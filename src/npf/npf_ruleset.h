@@ -118,6 +118,7 @@ void npf_ruleset_gc_init(void);
 npf_ruleset_t *npf_ruleset_create(enum npf_ruleset_type ruleset_type,
 				  enum npf_attach_type attach_type,
 				  const char *attach_point);
+void npf_ruleset_set_prev(npf_ruleset_t *ruleset, npf_ruleset_t *prev);
 void npf_ruleset_update_masquerade(const struct ifnet *ifp,
 				   const npf_ruleset_t *rs);
 void npf_rule_set_natpolicy(npf_rule_t *rl, npf_natpolicy_t *np);
@@ -136,6 +137,7 @@ void npf_rule_update_map_stats(npf_rule_t *rl, int n, uint32_t flags,
 			       uint8_t ip_prot);
 void npf_rule_get_overall_used(npf_rule_t *rl, uint64_t *used,
 		uint64_t *overall);
+const struct npf_rule_stats *npf_rule_get_stats(const npf_rule_t *rl);
 rule_no_t npf_rule_get_num(npf_rule_t *rl);
 void npf_rule_set_pass(npf_rule_t *rl, bool value);
 int npf_rule_get_attach_point(const npf_rule_t *rl,
@@ -162,7 +164,7 @@ bool npf_rproc_action(npf_cache_t *npc, struct rte_mbuf **nbuf,
 bool npf_rproc_match(npf_cache_t *npc, struct rte_mbuf *m, const npf_rule_t *rl,
 		     const struct ifnet *ifp, int dir, npf_session_t *se);
 int npf_match_setup(npf_rule_group_t *rg, uint32_t max_rules);
-void npf_match_optimize(npf_rule_group_t *rg);
+int npf_match_optimize(npf_rule_group_t *rg);
 bool npf_rule_proc(const void *d, const void *r);
 npf_rule_t *npf_ruleset_inspect(npf_cache_t *npc, struct rte_mbuf *nbuf,
 				const npf_ruleset_t *ruleset,
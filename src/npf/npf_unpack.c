@@ -46,15 +46,42 @@ static int npf_pack_get_session_from_init_sentry(struct sentry_packet *sp,
 	return 0;
 }
 
+/* Apply states and stats to the session matching the forward sentry */
+static int npf_pack_session_apply_update(struct sentry_packet *sp_forw,
+					 uint16_t se_feature_count,
+					 struct npf_pack_npf_state *state,
+					 struct npf_pack_session_stats *stats)
+{
+	struct npf_session *se;
+	struct session *s;
+	int rc;
+
+	rc = npf_pack_get_session_from_init_sentry(sp_forw, &s, &se);
+	if (rc)
+		return rc;
+
+	if (s && !se_feature_count) {
+		session_expire(s, NULL);
+		return 0;
+	}
+
+	if (s && se) {
+		rc = npf_session_npf_pack_state_update(se, state);
+		if (rc)
+			return rc;
+		rc = session_npf_pack_stats_restore(s, stats);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
 static
 int npf_pack_session_unpack_update(struct npf_pack_session_update *csu)
 {
-	struct npf_pack_npf_state *state;
-	struct npf_pack_session_stats *stats;
 	struct npf_pack_sentry *sen;
-	struct npf_session *se;
 	struct ifnet *ifp;
-	struct session *s;
 	int rc;
 
 	if (!csu)
@@ -68,31 +95,38 @@ int npf_pack_session_unpack_update(struct npf_pack_session_update *csu)
 	if (rc)
 		return -EINVAL;
 
-	rc = npf_pack_get_session_from_init_sentry(&csu->sen.sp_forw,
-						   &s, &se);
-	if (rc)
-		goto error;
+	return npf_pack_session_apply_update(&sen->sp_forw,
+					     csu->se_feature_count,
+					     &csu->state, &csu->stats);
+}
 
-	if (s && !csu->se_feature_count) {
-		session_expire(s, NULL);
-		return 0;
-	}
+static
+int npf_pack_session_unpack_delta(struct npf_pack_session_delta *psd,
+				  uint32_t len)
+{
+	struct sentry_packet sp = { 0 };
+	struct ifnet *ifp;
+	int i;
 
-	if (s && se) {
-		state = &csu->state;
-		rc = npf_session_npf_pack_state_update(se, state);
-		if (rc)
-			goto error;
-		stats = &csu->stats;
-		rc = session_npf_pack_stats_restore(s, stats);
-		if (rc)
-			goto error;
-	}
+	if (len < sizeof(*psd) ||
+	    psd->sp_len > SENTRY_LEN_IPV6 ||
+	    len < sizeof(*psd) + psd->sp_len * sizeof(uint32_t))
+		return -EINVAL;
 
-	return 0;
+	ifp = dp_ifnet_byifname(psd->ifname);
+	if (!ifp)
+		return -EINVAL;
 
- error:
-	return rc;
+	sp.sp_vrfid = ifp->if_vrfid;
+	sp.sp_ifindex = ifp->if_index;
+	sp.sp_sentry_flags = psd->sp_sentry_flags;
+	sp.sp_protocol = psd->sp_protocol;
+	sp.sp_len = psd->sp_len;
+	for (i = 0; i < psd->sp_len; i++)
+		sp.sp_addrids[i] = psd->sp_addrids[i];
+
+	return npf_pack_session_apply_update(&sp, psd->se_feature_count,
+					     &psd->state, &psd->stats);
 }
 
 static
@@ -422,6 +456,98 @@ int dp_session_restore(void *buf, uint32_t size, enum session_pack_type *spt)
 	return npf_pack_unpack_session(buf, size, spt);
 }
 
+bool npf_pack_validate_bulk_msg(struct npf_pack_message *msg, uint32_t size)
+{
+	struct npf_pack_message_hdr *hdr;
+
+	if (!msg)
+		return false;
+
+	if (size > NPF_PACK_BULK_MAX_SIZE || size < NPF_PACK_BULK_MIN_SIZE)
+		return false;
+
+	hdr = &msg->hdr;
+	if (hdr->len != size)
+		return false;
+	if (hdr->version != SESSION_PACK_BULK_VERSION) {
+		RTE_LOG(ERR, DATAPLANE,
+			"npf_pack bulk unpack: Invalid version %u\n",
+			hdr->version);
+		return false;
+	}
+	if (hdr->msg_type != SESSION_PACK_FULL &&
+	    hdr->msg_type != SESSION_PACK_UPDATE) {
+		RTE_LOG(ERR, DATAPLANE,
+			"npf_pack bulk unpack: Invalid message type %u\n",
+			hdr->msg_type);
+		return false;
+	}
+	return true;
+}
+
+static int npf_pack_unpack_bulk_full(struct npf_pack_session_new *csn,
+				     uint32_t len)
+{
+	struct npf_pack_session_new *csn_peer;
+
+	if (len < sizeof(csn->hdr) || len < csn->hdr.len)
+		return -EINVAL;
+
+	/* A NAT64 or NAT46 session is followed by its peer */
+	if (len > csn->hdr.len) {
+		csn_peer = (struct npf_pack_session_new *)
+			((char *)csn + csn->hdr.len);
+		if (len - csn->hdr.len < sizeof(csn_peer->hdr) ||
+		    len - csn->hdr.len < csn_peer->hdr.len)
+			return -EINVAL;
+	}
+
+	return npf_pack_session_unpack_new(csn);
+}
+
+int dp_session_restore_bulk(void *buf, uint32_t size,
+			    enum session_pack_type *spt)
+{
+	struct npf_pack_message *msg = buf;
+	struct npf_pack_bulk_hdr *bh;
+	struct npf_pack_bulk_rec *rec;
+	uint32_t off, i;
+	int restored = 0;
+	int rc;
+
+	*spt = SESSION_PACK_NONE;
+	if (!npf_pack_validate_bulk_msg(msg, size))
+		return -EINVAL;
+
+	*spt = msg->hdr.msg_type;
+	bh = (struct npf_pack_bulk_hdr *)&msg->data;
+	off = NPF_PACK_BULK_MIN_SIZE;
+
+	for (i = 0; i < bh->count; i++) {
+		if (size - off < sizeof(*rec))
+			return -EINVAL;
+		rec = (struct npf_pack_bulk_rec *)((char *)buf + off);
+		if (rec->len < sizeof(*rec) || rec->len > size - off)
+			return -EINVAL;
+		off += rec->len;
+
+		if (*spt == SESSION_PACK_FULL)
+			rc = npf_pack_unpack_bulk_full(
+				(struct npf_pack_session_new *)(rec + 1),
+				rec->len - sizeof(*rec));
+		else
+			rc = npf_pack_session_unpack_delta(
+				(struct npf_pack_session_delta *)(rec + 1),
+				rec->len - sizeof(*rec));
+
+		/* One session failing does not stop the others */
+		if (!rc)
+			restored++;
+	}
+
+	return restored;
+}
+
 /* For npf_pack UT */
 uint8_t npf_pack_get_msg_type(struct npf_pack_message *msg)
 {
@@ -11,9 +11,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <rte_atomic.h>
 
 #include "compiler.h"
+#include "dp_percpu.h"
 #include "npf/npf.h"
 #include "npf/rproc/npf_rproc.h"
 
@@ -22,17 +22,13 @@ struct rte_mbuf;
 struct npf_cache;
 
 /*
- * While multicore safe, this is using atomic operations, and so is
- * not operating at the max possible rate, however it may be good
- * enough for now.
- *
- * This should possibly be replaced with similar logic to that used by
- * the internal rule counters, those counters then being deleted.
- *
- * However that is a memory vs speed tradeoff.
+ * The hit count is kept per-lcore, in the same way as the internal rule
+ * counters, so that a rule matched on many lcores at once does not bounce
+ * the counter between them.  This costs a cache line per lcore per rule.
  */
-struct rule_ctr {
-	rte_atomic64_t	rc_hits;
+enum {
+	RULE_CTR_HITS,
+	RULE_CTR_MAX
 };
 
 /* Allocate a counter block */
@@ -40,15 +36,12 @@ static int
 npf_counter_ctor(npf_rule_t *rl __unused, const char *params __unused,
 		 void **handle)
 {
-	/* Memory to store the counter. */
-	struct rule_ctr *rule_ctr =
-		zmalloc_aligned(sizeof(struct rule_ctr));
+	struct dp_percpu_counter *rule_ctr;
 
+	rule_ctr = dp_percpu_counter_alloc(RULE_CTR_MAX);
 	if (!rule_ctr)
 		return -ENOMEM;
 
-	rte_atomic64_init(&rule_ctr->rc_hits);
-
 	*handle = rule_ctr;
 
 	return 0;
@@ -58,7 +51,7 @@ npf_counter_ctor(npf_rule_t *rl __unused, const char *params __unused,
 static void
 npf_counter_dtor(void *handle)
 {
-	free(handle);
+	dp_percpu_counter_free(handle);
 }
 
 /* Count it */
@@ -68,9 +61,9 @@ npf_counter_action(struct npf_cache *npc __unused,
 		   void *handle, npf_session_t *se __unused,
 		   npf_rproc_result_t *result __unused)
 {
-	struct rule_ctr *rule_ctr = handle;
+	struct dp_percpu_counter *rule_ctr = handle;
 
-	rte_atomic64_inc(&rule_ctr->rc_hits);
+	dp_percpu_counter_inc(rule_ctr, RULE_CTR_HITS);
 
 	return true; // continue rproc processing
 }
@@ -85,9 +78,9 @@ npf_counter_json(json_writer_t *json,
 	if (!handle)
 		return;
 
-	struct rule_ctr *rule_ctr = handle;
+	struct dp_percpu_counter *rule_ctr = handle;
 
-	uint64_t hits = rte_atomic64_read(&rule_ctr->rc_hits);
+	uint64_t hits = dp_percpu_counter_read(rule_ctr, RULE_CTR_HITS);
 
 	jsonw_uint_field(json, "hits", hits);
 }
@@ -99,9 +92,9 @@ npf_counter_clear(void *handle)
 	if (!handle)
 		return;
 
-	struct rule_ctr *rule_ctr = handle;
+	struct dp_percpu_counter *rule_ctr = handle;
 
-	rte_atomic64_clear(&rule_ctr->rc_hits);
+	dp_percpu_counter_clear(rule_ctr);
 }
 
 /* Counter RPROC ops. */
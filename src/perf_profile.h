@@ -0,0 +1,64 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef PERF_PROFILE_H
+#define PERF_PROFILE_H
+
+/*
+ * TSC based cycle accounting for forwarding lcores and pipeline nodes.
+ *
+ * Only built in when configured with --enable-perf_profile. Callers
+ * guard their accounting with PERF_PROFILE_ENABLED so that, when it
+ * is not built in, the code is still compiled but folds away to
+ * nothing.
+ */
+
+#include <rte_cycles.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compiler.h"
+
+#ifdef DATAPLANE_PERF_PROFILE
+#define PERF_PROFILE_ENABLED true
+#else
+#define PERF_PROFILE_ENABLED false
+#endif
+
+static ALWAYS_INLINE uint64_t perf_cycles(void)
+{
+	if (!PERF_PROFILE_ENABLED)
+		return 0;
+
+	return rte_rdtsc();
+}
+
+/* RX burst sizes are accounted in power of 2 buckets: 1, 2-3 ... 32 */
+#define PERF_RX_BURST_BUCKETS	6
+
+static ALWAYS_INLINE unsigned int perf_burst_bucket(unsigned int nb)
+{
+	unsigned int bucket = 31 - __builtin_clz(nb);
+
+	return bucket < PERF_RX_BURST_BUCKETS ?
+		bucket : PERF_RX_BURST_BUCKETS - 1;
+}
+
+struct perf_count {
+	uint64_t count;
+	uint64_t cycles;
+};
+
+static ALWAYS_INLINE void
+perf_count_add(struct perf_count *pc, uint64_t count, uint64_t start)
+{
+	if (!PERF_PROFILE_ENABLED)
+		return;
+
+	pc->count += count;
+	pc->cycles += perf_cycles() - start;
+}
+
+#endif /* PERF_PROFILE_H */
@@ -14,6 +14,7 @@
 
 #include "commands.h"
 #include "feature_commands.h"
+#include "main.h"
 #include "pl_commands.h"
 #include "pl_common.h"
 #include "pl_internal.h"
@@ -166,6 +167,44 @@ PL_REGISTER_OPCMD(pipeline_show_nodes) = {
 	.handler = cmd_pipeline_show_nodes,
 };
 
+static int
+cmd_pipeline_perf_show(struct pl_command *cmd)
+{
+	json_writer_t *json = jsonw_new(cmd->fp);
+	if (!json)
+		return 0;
+
+	jsonw_name(json, "perf");
+	jsonw_start_object(json);
+	jsonw_bool_field(json, "enabled", PERF_PROFILE_ENABLED);
+	if (PERF_PROFILE_ENABLED) {
+		jsonw_uint_field(json, "tsc-hz", rte_get_tsc_hz());
+		show_lcore_perf(json);
+		pl_dump_node_perf(json);
+	}
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
+static int
+cmd_pipeline_perf_clear(struct pl_command *cmd __unused)
+{
+	clear_lcore_perf();
+	pl_clear_node_perf();
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pipeline_perf_show) = {
+	.cmd = "perf show",
+	.handler = cmd_pipeline_perf_show,
+};
+
+PL_REGISTER_OPCMD(pipeline_perf_clear) = {
+	.cmd = "perf clear",
+	.handler = cmd_pipeline_perf_clear,
+};
+
 /* pipeline statistics config commands
  */
 static int cmd_pipeline_stats_cfg(struct pb_msg *msg)
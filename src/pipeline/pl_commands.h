@@ -25,6 +25,12 @@ pl_recurse_cmds(zhash_t *h, const struct pl_node_command *c, char *s);
 void
 pl_dump_nodes(json_writer_t *json);
 
+void
+pl_dump_node_perf(json_writer_t *json);
+
+void
+pl_clear_node_perf(void);
+
 void list_all_pipeline_cmd_versions(FILE *f);
 void list_all_pipeline_msg_versions(FILE *f);
 
@@ -13,10 +13,12 @@
 
 #include "compiler.h"
 #include "json_writer.h"
+#include "perf_profile.h"
 #include "util.h"
 
 extern int g_stats_enabled __hot_data;
 extern uint64_t *g_pl_node_stats;
+extern struct perf_count *g_pl_node_perf;
 
 static ALWAYS_INLINE int
 pl_node_stats_id(int node_id, unsigned int lcore_id)
@@ -32,9 +34,24 @@ pl_inc_node_stat(int node_id)
 		     pl_node_stats_id(node_id, dp_lcore_id())));
 }
 
+/*
+ * Account the cycles spent in a node handler since start. The cycles
+ * are inclusive of any features and nodes invoked from the handler.
+ */
+static ALWAYS_INLINE void
+pl_node_perf_add(int node_id, uint64_t start)
+{
+	if (!PERF_PROFILE_ENABLED)
+		return;
+
+	perf_count_add(g_pl_node_perf +
+		       pl_node_stats_id(node_id, dp_lcore_id()), 1, start);
+}
+
 void pl_graph_validate(void);
 
 uint64_t pl_get_node_stats(int id);
+void pl_get_node_perf(int id, struct perf_count *perf);
 
 void pl_show_plugin_state(json_writer_t *json, const char *plugin_name);
 #endif /* PL_INTERNAL_H */
@@ -36,6 +36,7 @@ static uint32_t dyn_feat_inst_count;
 int g_stats_enabled __hot_data;
 /* packet counter per node */
 uint64_t *g_pl_node_stats __hot_data;
+struct perf_count *g_pl_node_perf __hot_data;
 
 ALWAYS_INLINE void
 pl_release_storage(struct pl_packet *p)
@@ -305,11 +306,14 @@ pl_graph_walk(struct pl_node_registration *node_reg,
 	      struct pl_packet *pkt,
 	      void *storage_ctx)
 {
+	uint64_t start;
 	int resp;
 
 	while (true) {
 		pl_inc_node_stat(node_reg->node_decl_id);
+		start = perf_cycles();
 		resp = node_reg->handler(pkt, storage_ctx);
+		pl_node_perf_add(node_reg->node_decl_id, start);
 
 		switch (node_reg->type) {
 		case PL_OUTPUT:
@@ -423,6 +427,22 @@ pl_get_node_stats(int id)
 	return ct;
 }
 
+void
+pl_get_node_perf(int id, struct perf_count *perf)
+{
+	unsigned int i;
+
+	perf->count = 0;
+	perf->cycles = 0;
+	if (!g_pl_node_perf)
+		return;
+
+	for (i = 0; i <= get_lcore_max(); ++i) {
+		perf->count += g_pl_node_perf[pl_node_stats_id(id, i)].count;
+		perf->cycles += g_pl_node_perf[pl_node_stats_id(id, i)].cycles;
+	}
+}
+
 static int
 pl_node_enable_global_case_feature(struct pl_feature_registration *pl_feat)
 {
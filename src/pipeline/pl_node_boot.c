@@ -429,6 +429,14 @@ pl_graph_validate(void)
 					  next_dyn_node_id);
 	if (!g_pl_node_stats)
 		rte_panic("out of memory allocating pipeline stats\n");
+
+	if (PERF_PROFILE_ENABLED) {
+		g_pl_node_perf = zmalloc_aligned(sizeof(struct perf_count) *
+						 RTE_MAX_LCORE *
+						 next_dyn_node_id);
+		if (!g_pl_node_perf)
+			rte_panic("out of memory allocating pipeline profile\n");
+	}
 }
 
 void
@@ -501,6 +509,38 @@ pl_dump_nodes(json_writer_t *json)
 	jsonw_end_object(json);
 }
 
+void
+pl_dump_node_perf(json_writer_t *json)
+{
+	struct pl_node_registration *node;
+	struct perf_count perf;
+
+	jsonw_name(json, "node");
+	jsonw_start_object(json);
+	TAILQ_FOREACH(node, &pl_node_reg_list, links) {
+		pl_get_node_perf(node->node_decl_id, &perf);
+		if (!perf.count)
+			continue;
+
+		jsonw_name(json, node->name);
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "calls", perf.count);
+		jsonw_uint_field(json, "cycles", perf.cycles);
+		jsonw_uint_field(json, "cycles-per-call",
+				 perf.cycles / perf.count);
+		jsonw_end_object(json);
+	}
+	jsonw_end_object(json);
+}
+
+void
+pl_clear_node_perf(void)
+{
+	if (g_pl_node_perf)
+		memset(g_pl_node_perf, 0, sizeof(struct perf_count) *
+		       RTE_MAX_LCORE * next_dyn_node_id);
+}
+
 int dp_pipeline_register_node(const char *name,
 			      int num_next_nodes,
 			      const char **next_node_names,
@@ -17,12 +17,15 @@
 #include "urcu.h"
 #include "util.h"
 
-/* pre-defined power profiles */
+/*
+ * pre-defined power profiles.  Only power-save waits for RX interrupts, as
+ * waking from one adds latency to the first packet of a burst.
+ */
 static struct power_profile pm_profiles[] __hot_data = {
-	/* name          thresh min     max */
-	{ "balanced",	 100,	10,	250  },	/* default */
-	{ "low-latency", 1000,	20,	20   },
-	{ "power-save",	 10,	10,	1000 },
+	/* name          thresh min     max   intr   timeout freq */
+	{ "balanced",	 100,	10,	250,  0,     0,		false }, /* default */
+	{ "low-latency", 1000,	20,	20,   0,     0,		false },
+	{ "power-save",	 10,	10,	1000, 500,   100,	true  },
 };
 
 static struct power_profile *cur_pm __hot_data = pm_profiles;
@@ -37,6 +40,9 @@ static void show_power_mode(FILE *f)
 	jsonw_uint_field(wr, "idle_thresh", cur_pm->idle_thresh);
 	jsonw_uint_field(wr, "min_sleep", cur_pm->min_sleep);
 	jsonw_uint_field(wr, "max_sleep", cur_pm->max_sleep);
+	jsonw_uint_field(wr, "intr_thresh", cur_pm->intr_thresh);
+	jsonw_uint_field(wr, "intr_timeout", cur_pm->intr_timeout);
+	jsonw_bool_field(wr, "freq_scale", cur_pm->freq_scale);
 	jsonw_end_object(wr);
 	jsonw_destroy(&wr);
 }
@@ -80,8 +86,12 @@ int cmd_power_cfg(FILE *f, int argc, char **argv)
 		return -1;
 	}
 
+	/*
+	 * custom <idle_thresh> <min_sleep> <max_sleep>
+	 *        [<intr_thresh> <intr_timeout> [freq-scale]]
+	 */
 	if (strcmp(argv[0], "custom") == 0) {
-		if (argc != 4) {
+		if (argc != 4 && argc != 6 && argc != 7) {
 			fprintf(f, "custom wrong number of args\n");
 			return -1;
 		}
@@ -96,6 +106,19 @@ int cmd_power_cfg(FILE *f, int argc, char **argv)
 		pm->idle_thresh = strtoul(argv[1], NULL, 0);
 		pm->min_sleep = strtoul(argv[2], NULL, 0);
 		pm->max_sleep = strtoul(argv[3], NULL, 0);
+		if (argc >= 6) {
+			pm->intr_thresh = strtoul(argv[4], NULL, 0);
+			pm->intr_timeout = strtoul(argv[5], NULL, 0);
+		}
+		if (argc == 7) {
+			if (strcmp(argv[6], "freq-scale") != 0) {
+				fprintf(f, "custom unknown option %s\n",
+					argv[6]);
+				free(pm);
+				return -1;
+			}
+			pm->freq_scale = true;
+		}
 
 		change_power_mode(pm);
 		return 0;
@@ -20,6 +20,9 @@ struct power_profile {
 	unsigned int idle_thresh;   /* number of misses before sleeping */
 	unsigned int min_sleep;	  /* min us of sleep */
 	unsigned int max_sleep;	  /* max us of sleep */
+	unsigned int intr_thresh; /* empty polls before waiting for rx intr */
+	unsigned int intr_timeout; /* max ms to wait for rx intr */
+	bool freq_scale;	  /* hint cpu frequency when waiting for intr */
 } __rte_cache_aligned;
 
 /* Power management and poll loop parameters */
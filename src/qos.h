@@ -523,6 +523,11 @@ void qos_sched_update_if_stats(const struct ifnet *ifp);
 bool qos_sched_subport_get_stats(struct sched_info *qinfo, uint16_t vlan_id,
 				 struct rte_sched_subport_stats64 *stats);
 struct ifnet *qos_get_vlan_ifp(const char *att_pnt, uint16_t *vlan_id);
+typedef int (qos_subport_stats_walk_cb)(
+	struct ifnet *ifp, unsigned int subport, uint32_t vlan_id,
+	const struct rte_sched_subport_stats64 *stats,
+	const struct rte_sched_subport_stats64 *clear_stats, void *arg);
+int qos_sched_subport_stats_walk(qos_subport_stats_walk_cb *fn, void *arg);
 void qos_save_mark_req(const char *att_pnt, enum qos_mark_type type,
 		       uint16_t refs, void **handle);
 void qos_save_mark_v_pol(npf_rule_t *rl, void *po);
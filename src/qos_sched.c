@@ -4142,6 +4142,40 @@ bool qos_sched_subport_get_stats(struct sched_info *qinfo, uint16_t vlan_id,
 	return true;
 }
 
+/*
+ * Walk the subports of every port with QoS, reading the latest non-zeroing
+ * subport counters and passing them to the callback with the counters at
+ * the last clear.  The walk stops if the callback returns non-zero.
+ */
+int qos_sched_subport_stats_walk(qos_subport_stats_walk_cb *fn, void *arg)
+{
+	struct sched_info *qinfo;
+	struct subport_info *sinfo;
+	unsigned int subport;
+	int rc = 0;
+
+	SLIST_FOREACH(qinfo, &qos_qinfos.qinfo_head, list) {
+		if (!QOS_CONFIGURED(qinfo))
+			continue;
+
+		for (subport = 0; subport < qinfo->n_subports; subport++) {
+			sinfo = qinfo->subport + subport;
+
+			if (QOS_SUBPORT_RD_STATS(qinfo)(qinfo, subport,
+						&sinfo->queue_stats) < 0)
+				continue;
+
+			rte_spinlock_lock(&qinfo->stats_lock);
+			rc = fn(qinfo->ifp, subport, sinfo->vlan_id,
+				&sinfo->queue_stats, &sinfo->clear_stats, arg);
+			rte_spinlock_unlock(&qinfo->stats_lock);
+			if (rc)
+				return rc;
+		}
+	}
+	return 0;
+}
+
 void qos_save_mark_req(const char *att_pnt, enum qos_mark_type type,
 		       uint16_t no_qinqs, void **handle)
 {
@@ -33,17 +33,24 @@
 #define BROKER_KEEPALIVE_TIMER_SEC 10
 static struct rte_timer broker_keepalive_timer[CONT_SRC_COUNT];
 
+/*
+ * Max number of route messages processed per event.  The RIB can send
+ * routes much faster than they are installed, so draining a batch per poll
+ * lets updates to the same route be coalesced.
+ */
+#define ROUTE_BROKER_BATCH IP_ROUTE_PB_BATCH_MAX
+
 /*
  * Receive netlink message from rib:
  *
  * dpmsg must be already allocated, and caller is responsible for destroying it.
  * Return 0 on success, -1 on error.
  */
-static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg)
+static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg, int flags)
 {
 	zmq_msg_init(route_msg);
 
-	if (zmq_msg_recv(route_msg, zsock_resolve(sock), 0) <= 0)
+	if (zmq_msg_recv(route_msg, zsock_resolve(sock), flags) <= 0)
 		goto error;
 
 	int more = zmq_msg_get(route_msg, ZMQ_MORE);
@@ -61,53 +68,78 @@ error:
 	return -1;
 }
 
+/*
+ * Receive up to ROUTE_BROKER_BATCH messages.  Only the first receive may
+ * block, the rest take whatever is already queued.
+ *
+ * Returns the number of messages received, or -1 on error.
+ */
+static int route_broker_recv_batch(zsock_t *sock, zmq_msg_t *msgs)
+{
+	int n;
+
+	errno = 0;
+	for (n = 0; n < ROUTE_BROKER_BATCH; n++) {
+		if (dp_rt_msg_recv(sock, &msgs[n], n ? ZMQ_DONTWAIT : 0))
+			break;
+	}
+
+	if (n == 0 && errno != 0)
+		return -1;
+
+	return n;
+}
+
 static int route_netlink_recv(void *arg)
 {
-	zmq_msg_t route_msg;
+	static zmq_msg_t route_msgs[ROUTE_BROKER_BATCH];
 	zsock_t *sock = arg;
+	int i, n, rc;
 
-	errno = 0;
-	int rc = dp_rt_msg_recv(sock, &route_msg);
-	if (rc != 0) {
-		if (errno == 0)
-			return 0;
+	n = route_broker_recv_batch(sock, route_msgs);
+	if (n < 0)
 		return -1;
-	}
 
-	rc = mnl_cb_run(zmq_msg_data(&route_msg),
-			zmq_msg_size(&route_msg),
-			0, 0, rtnl_process, (void *)CONT_SRC_MAIN);
+	for (i = 0; i < n; i++) {
+		rc = mnl_cb_run(zmq_msg_data(&route_msgs[i]),
+				zmq_msg_size(&route_msgs[i]),
+				0, 0, rtnl_process, (void *)CONT_SRC_MAIN);
 
-	if (rc != MNL_CB_OK)
-		DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
-			 "route message not handled\n");
+		if (rc != MNL_CB_OK)
+			DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
+				 "route message not handled\n");
 
-	zmq_msg_close(&route_msg);
+		zmq_msg_close(&route_msgs[i]);
+	}
 
 	return 0;
 }
 
 static int route_pb_recv(void *arg)
 {
-	zmq_msg_t route_msg;
+	static zmq_msg_t route_msgs[ROUTE_BROKER_BATCH];
+	void *data[ROUTE_BROKER_BATCH];
+	size_t len[ROUTE_BROKER_BATCH];
 	zsock_t *sock = arg;
+	unsigned int failed;
+	int i, n;
 
-	errno = 0;
-	int rc = dp_rt_msg_recv(sock, &route_msg);
-	if (rc != 0) {
-		if (errno == 0)
-			return 0;
+	n = route_broker_recv_batch(sock, route_msgs);
+	if (n < 0)
 		return -1;
+
+	for (i = 0; i < n; i++) {
+		data[i] = zmq_msg_data(&route_msgs[i]);
+		len[i] = zmq_msg_size(&route_msgs[i]);
 	}
 
-	rc = ip_route_pb_handler(zmq_msg_data(&route_msg),
-				 zmq_msg_size(&route_msg),
-				 CONT_SRC_MAIN);
-	if (rc)
+	failed = ip_route_pb_batch_handler(data, len, n, CONT_SRC_MAIN);
+	if (failed)
 		DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
-			 "route message not handled\n");
+			 "%u route messages not handled\n", failed);
 
-	zmq_msg_close(&route_msg);
+	for (i = 0; i < n; i++)
+		zmq_msg_close(&route_msgs[i]);
 
 	return 0;
 }
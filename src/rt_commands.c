@@ -29,6 +29,7 @@
 #include "ip_addr.h"
 #include "ip_mcast.h"
 #include "json_writer.h"
+#include "ll_hold.h"
 #include "netinet6/nd6.h"
 #include "netinet6/nd6_nbr.h"
 #include "route.h"
@@ -723,6 +724,9 @@ static int cmd_nbr_res(FILE *f, sa_family_t af, int argc, char **argv)
 	else if (!strcmp(argv[0], "get"))
 		return nbr_res_get_cfg(f, af);
 
+	else if (!strcmp(argv[0], "hold"))
+		return cmd_ll_hold_show(f);
+
 	else {
 		fprintf(f, "unknown command action\n");
 		return -1;
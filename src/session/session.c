@@ -631,6 +631,71 @@ int session_table_walk(session_walk_t cb, void *data)
 	return rc;
 }
 
+static int session_id_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct session *s = caa_container_of(node, struct session,
+						   se_node);
+
+	return s->se_id == *(const uint64_t *)key;
+}
+
+/*
+ * The session table is a split-ordered list, hashed by session ID, so it is
+ * kept in the order of the bit-reversed ID whatever the size of the table.
+ */
+static uint64_t session_walk_order(uint64_t id)
+{
+	id = ((id >> 1) & 0x5555555555555555UL) |
+		((id & 0x5555555555555555UL) << 1);
+	id = ((id >> 2) & 0x3333333333333333UL) |
+		((id & 0x3333333333333333UL) << 2);
+	id = ((id >> 4) & 0x0f0f0f0f0f0f0f0fUL) |
+		((id & 0x0f0f0f0f0f0f0f0fUL) << 4);
+	return __builtin_bswap64(id);
+}
+
+/*
+ * Walk the session table starting after the session with the given ID, and
+ * issue the callback.  If that session still exists the walk continues from
+ * its node.  Otherwise it continues from the first session that comes after
+ * where it was in the table order, so sessions that expire, and resizes of
+ * the table, do not stop a walk from being resumed.
+ */
+int session_table_walk_after(uint64_t id, session_walk_t cb, void *data)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct session *s;
+	uint64_t order;
+	int rc = 0;
+
+	if (!cb)
+		return -ENOENT;
+
+	cds_lfht_lookup(session_ht, id, session_id_match, &id, &iter);
+	if (cds_lfht_iter_get_node(&iter)) {
+		cds_lfht_next(session_ht, &iter);
+	} else {
+		order = session_walk_order(id);
+		for (cds_lfht_first(session_ht, &iter);
+		     (node = cds_lfht_iter_get_node(&iter)) != NULL;
+		     cds_lfht_next(session_ht, &iter)) {
+			s = caa_container_of(node, struct session, se_node);
+			if (session_walk_order(s->se_id) > order)
+				break;
+		}
+	}
+
+	while ((node = cds_lfht_iter_get_node(&iter)) != NULL) {
+		s = caa_container_of(node, struct session, se_node);
+		rc = cb(s, data);
+		if (rc)
+			break;
+		cds_lfht_next(session_ht, &iter);
+	}
+	return rc;
+}
+
 /* Walk the sentry table and issue the callback.  */
 int sentry_table_walk(sentry_walk_t cb, void *data)
 {
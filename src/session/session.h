@@ -201,6 +201,7 @@ struct session {
 	rte_atomic64_t		se_pkts_out;
 	rte_atomic64_t		se_bytes_out;
 	void			*se_private;
+	uint64_t		se_pack_pkts;	/* pkts at last bulk pack */
 };
 
 static_assert(offsetof(struct session, se_rcu_head) == 64,
@@ -719,6 +720,7 @@ typedef int (*session_walk_t)(struct session *s, void *data);
 
 int sentry_table_walk(sentry_walk_t func, void *data);
 int session_table_walk(session_walk_t func, void *data);
+int session_table_walk_after(uint64_t id, session_walk_t func, void *data);
 
 
 /**
@@ -63,6 +63,10 @@ struct session_dump {
 	bool	sd_features;
 	uint8_t sd_filter;
 	ulong	sd_conn_id;
+	bool	sd_resume;	/* Start after session sd_resume_id */
+	bool	sd_more;	/* Stopped before the end of the table */
+	uint64_t sd_resume_id;
+	uint64_t sd_last_id;	/* Last session added to the reply */
 };
 
 /* Parameters for session expiration by filtering */
@@ -189,13 +193,17 @@ static int cmd_session_json(struct session *s, void *data)
 		return 0;
 
 	/* Filled? */
-	if (sd->sd_count-- <= 0)
+	if (sd->sd_count-- <= 0) {
+		sd->sd_more = true;
 		return -1;  /* Stop walk we are full */
+	}
 
 	/* No sentry?  (racing with expiration) */
 	if (!init_sen)
 		return 0;
 
+	sd->sd_last_id = s->se_id;
+
 	sprintf(buf, "%lu", s->se_id);
 	jsonw_name(json, buf);
 	jsonw_start_object(json);
@@ -332,9 +340,19 @@ static void cmd_session_show_summary(FILE *fp)
 	jsonw_destroy(&json);
 }
 
-static void cmd_session_show(struct session_dump *sd)
+/*
+ * Show sessions.  At most MAX_JSON_SESSIONS are returned per request.  If
+ * the walk stops before the end of the table then "resume_id" is the ID of
+ * the last session returned, and the next page is requested with "after
+ * <resume_id>".  This avoids walking all of the preceding sessions again, as
+ * a "start" offset does.  If the resume session has expired since, the walk
+ * carries on from where it was in the table.
+ */
+static int cmd_session_show(struct session_dump *sd)
 {
-	json_writer_t *json = jsonw_new(sd->sd_fp);
+	json_writer_t *json;
+
+	json = jsonw_new(sd->sd_fp);
 	sd->sd_data = json;
 
 	if (sd->sd_count <= 0 || sd->sd_count >= MAX_JSON_SESSIONS)
@@ -345,11 +363,21 @@ static void cmd_session_show(struct session_dump *sd)
 	jsonw_name(json, "sessions");
 	jsonw_start_object(json);
 
-	session_table_walk(cmd_session_json, sd);
+	if (sd->sd_resume)
+		session_table_walk_after(sd->sd_resume_id,
+					 cmd_session_json, sd);
+	else
+		session_table_walk(cmd_session_json, sd);
 
 	jsonw_end_object(json);
+
+	if (sd->sd_more)
+		jsonw_uint_field(json, "resume_id", sd->sd_last_id);
+
 	jsonw_end_object(json);
 	jsonw_destroy(&json);
+
+	return 0;
 }
 
 static void cmd_sentries_show(FILE *fp, int start, int count)
@@ -827,10 +855,42 @@ static int cmd_parse_limits(FILE *f, int argc, char **argv,
 	return 0;
 }
 
+/*
+ * Parse the limits for a session walk.  Either the optional start and
+ * count, or "after <id>" and an optional count.
+ */
+static int cmd_parse_session_limits(FILE *f, int argc, char **argv,
+				    struct session_dump *sd)
+{
+	if (argc >= 2 && !strcmp(argv[0], "after")) {
+		char *end;
+
+		errno = 0;
+		sd->sd_resume_id = strtoull(argv[1], &end, 10);
+		if (errno || *end != '\0') {
+			cmd_err(f, "invalid session id: %s", argv[1]);
+			return -EINVAL;
+		}
+		sd->sd_resume = true;
+		argc -= 2;
+		argv += 2;
+
+		if (argc > 0) {
+			sd->sd_count = arg_to_int(argv[0]);
+			if (sd->sd_count <= 0) {
+				cmd_err(f, "invalid count limit: %s",
+					argv[0]);
+				return -EINVAL;
+			}
+		}
+		return 0;
+	}
+
+	return cmd_parse_limits(f, argc, argv, &sd->sd_start, &sd->sd_count);
+}
+
 static int cmd_op_walk_sessions(FILE *f, int argc, char **argv)
 {
-	int start = 0;
-	int count = 0;
 	int rc;
 	ulong conn_id = 0;
 	bool have_conn_id = false;
@@ -843,43 +903,36 @@ static int cmd_op_walk_sessions(FILE *f, int argc, char **argv)
 		argv += 2;
 	}
 
-	/* Now parse the "start" and "count" limits, if any */
-	rc = cmd_parse_limits(f, argc, argv, &start, &count);
-	if (rc)
-		return rc;
-
 	struct session_dump sd = {
 		.sd_fp = f,
 		.sd_features = false,	/* No feature json */
 		.sd_filter = have_conn_id ? SD_FILTER_CONN_ID : SD_FILTER_NONE,
 		.sd_conn_id = conn_id,
-		.sd_start = start,
-		.sd_count = count,
 	};
-	cmd_session_show(&sd);
-	return 0;
-}
 
-static int cmd_op_walk_sessions_full(FILE *f, int argc, char **argv)
-{
-	int start = 0;
-	int count = 0;
-	int rc;
-
-	rc = cmd_parse_limits(f, argc, argv, &start, &count);
+	/* Now parse the "start" and "count" limits, if any */
+	rc = cmd_parse_session_limits(f, argc, argv, &sd);
 	if (rc)
 		return rc;
 
+	return cmd_session_show(&sd);
+}
+
+static int cmd_op_walk_sessions_full(FILE *f, int argc, char **argv)
+{
 	struct session_dump sd = {
 		.sd_fp = f,
 		.sd_features = true,	/* Include feature json */
 		.sd_filter = 0,
 		.sd_conn_id = 0,
-		.sd_start = start,
-		.sd_count = count,
 	};
-	cmd_session_show(&sd);
-	return 0;
+	int rc;
+
+	rc = cmd_parse_session_limits(f, argc, argv, &sd);
+	if (rc)
+		return rc;
+
+	return cmd_session_show(&sd);
 }
 
 /*
@@ -887,24 +940,19 @@ static int cmd_op_walk_sessions_full(FILE *f, int argc, char **argv)
  */
 static int cmd_op_walk_sessions_nat64(FILE *f, int argc, char **argv)
 {
-	int start = 0;
-	int count = 0;
-	int rc;
-
-	rc = cmd_parse_limits(f, argc, argv, &start, &count);
-	if (rc)
-		return rc;
-
 	struct session_dump sd = {
 		.sd_fp = f,
 		.sd_features = true,	/* Include feature json */
 		.sd_filter = SD_FILTER_NAT64,
 		.sd_conn_id = 0,
-		.sd_start = start,
-		.sd_count = count,
 	};
-	cmd_session_show(&sd);
-	return 0;
+	int rc;
+
+	rc = cmd_parse_session_limits(f, argc, argv, &sd);
+	if (rc)
+		return rc;
+
+	return cmd_session_show(&sd);
 }
 
 /*
@@ -912,24 +960,19 @@ static int cmd_op_walk_sessions_nat64(FILE *f, int argc, char **argv)
  */
 static int cmd_op_walk_sessions_nat46(FILE *f, int argc, char **argv)
 {
-	int start = 0;
-	int count = 0;
-	int rc;
-
-	rc = cmd_parse_limits(f, argc, argv, &start, &count);
-	if (rc)
-		return rc;
-
 	struct session_dump sd = {
 		.sd_fp = f,
 		.sd_features = true,	/* Include feature json */
 		.sd_filter = SD_FILTER_NAT46,
 		.sd_conn_id = 0,
-		.sd_start = start,
-		.sd_count = count,
 	};
-	cmd_session_show(&sd);
-	return 0;
+	int rc;
+
+	rc = cmd_parse_session_limits(f, argc, argv, &sd);
+	if (rc)
+		return rc;
+
+	return cmd_session_show(&sd);
 }
 
 static int cmd_op_walk_sentries(FILE *f, int argc, char **argv)
@@ -17,6 +17,12 @@
  *
  * If dataplane and controller are on separate machines (or VM's)
  * a GRE tunnel is used to transfer packets.
+ *
+ * With "shadow-backend=vhost" the tap device of each port is instead
+ * created behind a virtio-user port using vhost-net, so packets are
+ * moved to and from the kernel in bursts by the vhost-net thread rather
+ * than with a read or write per packet.  The slow path interface always
+ * uses its tun device, as it carries tun_meta.
  */
 
 #include <czmq.h>
@@ -30,8 +36,12 @@
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
 #include <rte_config.h>
+#include <rte_bus_vdev.h>
 #include <rte_debug.h>
+/* rte_eth_dev_rx_intr_ctl_q_get_fd is experimental */
+#define ALLOW_EXPERIMENTAL_API 1
 #include <rte_ethdev.h>
+#undef ALLOW_EXPERIMENTAL_API
 #include <rte_ether.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
@@ -73,11 +83,17 @@
 /* Number of buffers queued from dataplane to slowpath thread  */
 #define SHADOW_IO_RING_SIZE	256
 #define SHADOW_IO_RING_HWM	32
-#define SHADOW_IO_RING_BURST	8
+#define SHADOW_IO_RING_BURST	32
+
+/* Packets read from a tun/tap device per wakeup */
+#define SHADOW_READ_BURST	32
 
 /* to be fair with the tun/tap reader */
 #define SHADOW_WRITE_POLLS 1
 
+/* Descriptors in each queue of a vhost backend port */
+#define SHADOW_VHOST_QUEUE_SIZE	1024
+
 enum shadow_ev {
 	SHADOW_ADD,
 	SHADOW_REMOVE,
@@ -86,15 +102,34 @@ enum shadow_ev {
 /* One for each physical port and also slow path interface */
 struct shadow_if_info *shadow_if[DATAPLANE_MAX_PORTS + 1];
 
-static int event_fd;		      /* wakeup writer thread */
-static int lfd;
+/*
+ * Ports are shared out between the shadow threads.  Each thread moves
+ * packets to and from the tun/tap devices of its own ports, and the
+ * first thread also handles the slow path interface.
+ */
+struct shadow_thread {
+	unsigned int	id;
+	int		event_fd;	/* wakeup writer */
+	zsock_t		*server_sock;
+	pthread_t	pthread;
+	char		inproc[32];	/* inproc server address */
+};
+
+static struct shadow_thread shadow_threads[SHADOW_MAX_THREADS];
+static unsigned int shadow_nthreads;
 static int shadow_fd;
-static zsock_t *shadow_server_sock;
-static pthread_t shadow_thread;
 static uint64_t shadow_next_ring_id;
 
-/* inproc server address */
-static const char shadow_inproc[] = "inproc://shadow";
+/* Owns the vhost backend ports, so they are not taken for forwarding */
+static struct rte_eth_dev_owner shadow_owner;
+
+static struct shadow_thread *shadow_port_thread(portid_t port)
+{
+	if (port == DATAPLANE_SPATH_PORT)
+		return &shadow_threads[0];
+
+	return &shadow_threads[port % shadow_nthreads];
+}
 
 /*
  * Determine the shadow interface where packet should
@@ -192,7 +227,7 @@ void local_packet_internal(struct ifnet *ifp, struct rte_mbuf *m)
 		/* wake up slowpath thread on the master. */
 		static const uint64_t incr = 1;
 
-		if (unlikely(write(event_fd, &incr, sizeof(incr)) < 0))
+		if (unlikely(write(sii->event_fd, &incr, sizeof(incr)) < 0))
 			RTE_LOG(NOTICE, DATAPLANE,
 				"shadow event write failed: %s\n",
 				strerror(errno));
@@ -260,6 +295,50 @@ static void shadow_io_write(struct shadow_if_info *sii, struct rte_mbuf *m)
 	rte_pktmbuf_free(m);
 }
 
+/*
+ * Move a burst of packets to the vhost backend, which takes them all
+ * with a single kick.  VLAN tags are put back in place, so a packet
+ * whose data is shared is copied first.
+ */
+static void shadow_vhost_write(struct shadow_if_info *sii,
+			       struct rte_mbuf **pkts, unsigned int n)
+{
+	unsigned int i, nb = 0;
+	struct rte_mbuf *m, *c;
+	struct ifnet *ifp;
+	uint16_t sent;
+
+	for (i = 0; i < n; i++) {
+		m = pkts[i];
+		ifp = pktmbuf_restore_ifp(m);
+
+		if (unlikely(m->ol_flags & PKT_RX_VLAN) &&
+		    (!RTE_MBUF_DIRECT(m) || rte_mbuf_refcnt_read(m) != 1)) {
+			c = pktmbuf_copy(m, m->pool);
+			rte_pktmbuf_free(m);
+			m = c;
+			if (!m) {
+				++sii->rs_errors;
+				continue;
+			}
+		}
+
+		if (shadow_vlan_insert(m, ifp) < 0) {
+			++sii->rs_errors;
+			rte_pktmbuf_free(m);
+			continue;
+		}
+		pkts[nb++] = m;
+	}
+
+	sent = rte_eth_tx_burst(sii->vport, 0, pkts, nb);
+	sii->rs_packets += sent;
+	if (unlikely(sent < nb)) {
+		sii->rs_overrun += nb - sent;
+		pktmbuf_free_bulk(&pkts[sent], nb - sent);
+	}
+}
+
 /* Get a burst of packets from ring and forward them to kernel */
 static unsigned int shadow_io_burst(struct shadow_if_info *sii)
 {
@@ -271,6 +350,12 @@ static unsigned int shadow_io_burst(struct shadow_if_info *sii)
 				      SHADOW_IO_RING_BURST,
 				      NULL);
 
+	if (sii->vhost) {
+		if (n)
+			shadow_vhost_write(sii, s_pkts, n);
+		return n;
+	}
+
 	for (i = 0; i < n; i++)
 		shadow_io_write(sii, s_pkts[i]);
 
@@ -278,13 +363,14 @@ static unsigned int shadow_io_burst(struct shadow_if_info *sii)
 }
 
 /* Callback from event_fd
- * Processes all packets for all receive rings.
+ * Processes all packets for the receive rings of this thread's ports.
  * Keeps going until all rings are empty.
  */
 static int shadow_writer(zloop_t *loop __rte_unused,
 			 zmq_pollitem_t *item,
-			 void *arg __rte_unused)
+			 void *arg)
 {
+	struct shadow_thread *st = arg;
 	struct shadow_if_info *sii;
 	unsigned int npkts = 0;
 	unsigned int port;
@@ -310,6 +396,9 @@ static int shadow_writer(zloop_t *loop __rte_unused,
 		/* Check for packets to send over tunnel */
 		for (port = 0; port <= DATAPLANE_MAX_PORTS; port++) {
 
+			if (shadow_port_thread(port) != st)
+				continue;
+
 			/* Check for hotplug removal */
 			if (port < DATAPLANE_MAX_PORTS &&
 			    unlikely(!rte_eth_dev_is_valid_port(port)))
@@ -386,9 +475,11 @@ void shadow_init_spath_ring(int tun_fd)
 		rte_panic("spathintf ring %s create failed\n", ring_name);
 
 	sii->port = IF_PORT_ID_INVALID;
+	sii->vhost = false;
 	/* Enable doorbell by default */
 	sii->wake_me = true;
 	sii->fd = tun_fd;
+	sii->event_fd = shadow_port_thread(DATAPLANE_SPATH_PORT)->event_fd;
 	shadow_if[DATAPLANE_SPATH_PORT] = sii;
 }
 
@@ -476,37 +567,93 @@ static int shadow_output(struct shadow_if_info *sii, struct rte_mbuf *m,
 /* Move packets from TAP device to port
  * In order to handle Jumbo packets, need to pre-stage packet
  * in buffer on stack;
+ *
+ * Up to a burst of packets is read for each wakeup, and the thread only
+ * goes online once for the burst.  Anything left over is picked up on
+ * the next poll.
  */
 int tap_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg)
 {
 	struct shadow_if_info *sii = arg;
 	struct ifnet *ifp = ifport_table[sii->port];
-	struct rte_mbuf *m = NULL;
+	struct rte_mbuf *m;
+	unsigned int i;
+	int ret = 0;
 
-	int ret = tap_receive(loop, item, sii, &m);
+	rcu_thread_online();
 
-	if (ret <= 0)
-		return ret;
+	for (i = 0; i < SHADOW_READ_BURST; i++) {
+		m = NULL;
+		ret = tap_receive(loop, item, sii, &m);
+		if (ret <= 0)
+			break;
+
+		if (shadow_output(sii, m, ifp) < 0) {
+			++sii->ts_errors;
+			rte_pktmbuf_free(m);
+			continue;
+		}
+		++sii->ts_packets;
+	}
+
+	rcu_thread_offline();
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Move a burst of packets from the vhost backend to the port.  The
+ * backend signals the rx interrupt eventfd when it adds packets to the
+ * queue, so when a full burst is taken the eventfd is signalled again
+ * to come back for the rest once other events have been serviced.
+ */
+static int vhost_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
+			void *arg)
+{
+	static const uint64_t incr = 1;
+	struct rte_mbuf *pkts[SHADOW_READ_BURST];
+	struct shadow_if_info *sii = arg;
+	struct ifnet *ifp;
+	uint64_t count;
+	uint16_t i, n;
+
+	if (unlikely(read(item->fd, &count, sizeof(count)) < 0) &&
+	    errno != EINTR && errno != EAGAIN)
+		RTE_LOG(NOTICE, DATAPLANE,
+			"shadow vhost fd read failed: %s\n",
+			strerror(errno));
 
 	rcu_thread_online();
 
-	if (shadow_output(sii, m, ifp) < 0)
-		goto drop;
+	ifp = ifport_table[sii->port];
+	n = rte_eth_rx_burst(sii->vport, 0, pkts, SHADOW_READ_BURST);
+	for (i = 0; i < n; i++) {
+		pktmbuf_mdata_clear_all(pkts[i]);
+		pktmbuf_set_vrf(pkts[i], if_vrfid(ifp));
 
-	++sii->ts_packets;
-	rcu_thread_offline();
-	return 0;
- drop:
-	++sii->ts_errors;
-	rte_pktmbuf_free(m);
+		if (shadow_output(sii, pkts[i], ifp) < 0) {
+			++sii->ts_errors;
+			rte_pktmbuf_free(pkts[i]);
+			continue;
+		}
+		++sii->ts_packets;
+	}
 
 	rcu_thread_offline();
+
+	if (n == SHADOW_READ_BURST &&
+	    write(item->fd, &incr, sizeof(incr)) < 0)
+		RTE_LOG(NOTICE, DATAPLANE,
+			"shadow vhost fd write failed: %s\n",
+			strerror(errno));
+
 	return 0;
 }
 
-/* Read packet with meta data from .spathintf */
-int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
-		 void *arg)
+/*
+ * Read a packet with meta data from .spathintf and send it on.  Called
+ * with the thread online.
+ */
+static int spath_read_one(zmq_pollitem_t *item, struct shadow_if_info *sii)
 {
 	struct tun_pi pi;
 	struct tun_meta meta;
@@ -514,7 +661,6 @@ int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
 	struct ifnet *ifp = NULL, *host_ifp, *s2s_ifp = NULL;
 	struct rte_mbuf *m = NULL;
 	enum cont_src_en cont_src = CONT_SRC_MAIN;
-	struct shadow_if_info *sii = arg;
 	struct next_hop *nh = NULL;
 
 	int ret = spath_receive(item, &pi, &meta, sii, &m);
@@ -522,8 +668,6 @@ int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
 	if (ret <= 0)
 		return ret;
 
-	rcu_thread_online();
-
 	if (!(meta.flags & TUN_META_FLAG_IIF)) {
 		RTE_LOG(ERR, DATAPLANE,	"spath missing iif\n");
 		goto drop;
@@ -613,7 +757,7 @@ int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
 							  RT_TABLE_MAIN,
 							  pi.proto,
 							  &nh)))
-				goto rcu_offline;
+				goto done;
 			else if (nh)
 				ifp = dp_nh_get_ifp(nh);
 			else
@@ -679,7 +823,7 @@ int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
 			}
 		}
 
-		goto rcu_offline;
+		goto done;
 	}
 
  drop:
@@ -690,11 +834,30 @@ int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
 
 	rte_pktmbuf_free(m);
 
-rcu_offline:
+done:
 	if (sii)
 		++sii->ts_packets;
+	return 1;
+}
+
+/* Read a burst of packets with meta data from .spathintf */
+int spath_reader(zloop_t *loop __rte_unused, zmq_pollitem_t *item,
+		 void *arg)
+{
+	struct shadow_if_info *sii = arg;
+	unsigned int i;
+	int ret = 0;
+
+	rcu_thread_online();
+
+	for (i = 0; i < SHADOW_READ_BURST; i++) {
+		ret = spath_read_one(item, sii);
+		if (ret <= 0)
+			break;
+	}
+
 	rcu_thread_offline();
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 static void del_handler_tap_fd(zloop_t *loop, struct shadow_if_info *sii)
@@ -714,7 +877,7 @@ static int
 shadow_send_event(enum shadow_ev type, portid_t port,
 		  const char *ifname, const struct rte_ether_addr *eth)
 {
-	zsock_t *sock = zsock_new_req(shadow_inproc);
+	zsock_t *sock = zsock_new_req(shadow_port_thread(port)->inproc);
 	int rv;
 	int call_rv;
 
@@ -774,7 +937,8 @@ static int add_handler_tap_fd(zloop_t *loop, struct shadow_if_info *sii)
 		.socket = NULL,
 	};
 
-	if (zloop_poller(loop, &tap_poll, tap_reader, sii) < 0) {
+	if (zloop_poller(loop, &tap_poll,
+			 sii->vhost ? vhost_reader : tap_reader, sii) < 0) {
 		RTE_LOG(ERR, DATAPLANE,
 			"zloop_poller failed\n");
 		return -1;
@@ -783,6 +947,80 @@ static int add_handler_tap_fd(zloop_t *loop, struct shadow_if_info *sii)
 	return 0;
 }
 
+static void shadow_vhost_name(portid_t port, char *name, size_t len)
+{
+	snprintf(name, len, "virtio_user_shadow%u", port);
+}
+
+/*
+ * Create the vhost backend of a port: a virtio-user port on vhost-net,
+ * with the kernel creating the tap device behind it.  The shadow thread
+ * polls the port's rx interrupt eventfd in place of the tap fd.
+ */
+static int shadow_vhost_attach(struct shadow_if_info *sii,
+			       const char *ifname)
+{
+	static const struct rte_eth_conf conf = {
+		.intr_conf = {
+			.rxq = 1,
+		},
+	};
+	int socket_id = rte_eth_dev_socket_id(sii->port);
+	char name[RTE_ETH_NAME_MAX_LEN];
+	char args[128];
+	uint16_t vport;
+	int fd;
+
+	shadow_vhost_name(sii->port, name, sizeof(name));
+	snprintf(args, sizeof(args),
+		 "path=/dev/vhost-net,iface=%s,queues=1,queue_size=%u",
+		 ifname, SHADOW_VHOST_QUEUE_SIZE);
+	if (rte_vdev_init(name, args) < 0) {
+		RTE_LOG(ERR, DATAPLANE, "shadow: can not create %s for %s\n",
+			name, ifname);
+		return -ENODEV;
+	}
+
+	if (rte_eth_dev_get_port_by_name(name, &vport) != 0 ||
+	    rte_eth_dev_owner_set(vport, &shadow_owner) < 0 ||
+	    rte_eth_dev_configure(vport, 1, 1, &conf) < 0 ||
+	    rte_eth_rx_queue_setup(vport, 0, SHADOW_VHOST_QUEUE_SIZE,
+				   socket_id, NULL,
+				   mbuf_pool(sii->port)) < 0 ||
+	    rte_eth_tx_queue_setup(vport, 0, SHADOW_VHOST_QUEUE_SIZE,
+				   socket_id, NULL) < 0 ||
+	    rte_eth_dev_start(vport) < 0)
+		goto fail;
+
+	fd = rte_eth_dev_rx_intr_ctl_q_get_fd(vport, 0);
+	if (fd < 0 || rte_eth_dev_rx_intr_enable(vport, 0) < 0 ||
+	    tap_dormant(ifname) < 0)
+		goto fail_stop;
+
+	sii->vhost = true;
+	sii->vport = vport;
+	sii->fd = fd;
+	return 0;
+
+fail_stop:
+	rte_eth_dev_stop(vport);
+fail:
+	RTE_LOG(ERR, DATAPLANE, "shadow: can not set up %s for %s\n",
+		name, ifname);
+	rte_vdev_uninit(name);
+	return -ENODEV;
+}
+
+/* Remove the vhost backend of a port, and with it the tap device */
+static void shadow_vhost_detach(struct shadow_if_info *sii)
+{
+	char name[RTE_ETH_NAME_MAX_LEN];
+
+	rte_eth_dev_stop(sii->vport);
+	shadow_vhost_name(sii->port, name, sizeof(name));
+	rte_vdev_uninit(name);
+}
+
 /*
  * After receiving response from controller,
  * set the interface port parameters (name, index)
@@ -819,11 +1057,18 @@ int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname)
 
 	sii->port = port;
 	sii->wake_me = true;
+	sii->event_fd = shadow_port_thread(port)->event_fd;
 
-	sii->fd = tap_attach(ifname);
-	if (sii->fd < 0) {
-		ret = -errno;
-		goto fail_ring_free;
+	if (config.shadow_vhost) {
+		ret = shadow_vhost_attach(sii, ifname);
+		if (ret < 0)
+			goto fail_ring_free;
+	} else {
+		sii->fd = tap_attach(ifname);
+		if (sii->fd < 0) {
+			ret = -errno;
+			goto fail_ring_free;
+		}
 	}
 	if (add_handler_tap_fd(loop, sii) < 0) {
 		ret = -ENOMEM;
@@ -835,7 +1080,10 @@ int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname)
 	return 0;
 
 fail_close:
-	close(sii->fd);
+	if (sii->vhost)
+		shadow_vhost_detach(sii);
+	else
+		close(sii->fd);
 fail_ring_free:
 	rte_ring_free(sii->rx_slow_ring);
 fail_free:
@@ -848,7 +1096,9 @@ static void shadow_free_rcu(struct rcu_head *head)
 	struct shadow_if_info *sii =
 		caa_container_of(head, struct shadow_if_info, rcu);
 
-	close(sii->fd);
+	/* a vhost backend's eventfd belongs to its port */
+	if (!sii->vhost)
+		close(sii->fd);
 	rte_ring_free(sii->rx_slow_ring);
 	rte_free(sii);
 }
@@ -866,7 +1116,10 @@ static void shadow_remove_event(zloop_t *loop, portid_t port)
 	rcu_assign_pointer(shadow_if[port], NULL);
 
 	del_handler_tap_fd(loop, sii);
-	tap_destroy(port);
+	if (sii->vhost)
+		shadow_vhost_detach(sii);
+	else
+		tap_destroy(port);
 
 	/*
 	 * Drain ring
@@ -937,11 +1190,15 @@ static int shadow_handle_event(zloop_t *loop, zsock_t *sock,
 /* main thread loop for processing TUNTAP and GRE packets */
 static void *shadow_handler(void *args)
 {
+	struct shadow_thread *st = args;
+	char name[16];
 	zloop_t *loop;
 
-	lfd = *(int *) args;
-
-	pthread_setname_np(pthread_self(), "dataplane/slow");
+	if (st->id == 0)
+		snprintf(name, sizeof(name), "dataplane/slow");
+	else
+		snprintf(name, sizeof(name), "dataplane/slow%u", st->id);
+	pthread_setname_np(pthread_self(), name);
 
 	loop = zloop_new();
 	if (!loop)
@@ -954,26 +1211,28 @@ static void *shadow_handler(void *args)
 		RTE_LOG(NOTICE, DATAPLANE,
 			"shadow setschedparam failed: %s\n", strerror(err));
 
-	zloop_reader(loop, shadow_server_sock, shadow_handle_event,
+	zloop_reader(loop, st->server_sock, shadow_handle_event,
 		     NULL);
-	zloop_reader_set_tolerant(loop, shadow_server_sock);
+	zloop_reader_set_tolerant(loop, st->server_sock);
 
 	/* poll event fd to wakeup shadow writer */
 	zmq_pollitem_t event_poll = {
-		.fd = event_fd,
+		.fd = st->event_fd,
 		.events = ZMQ_POLLIN,
 	};
-	zloop_poller(loop, &event_poll, shadow_writer, NULL);
+	zloop_poller(loop, &event_poll, shadow_writer, st);
 
 	/* poll slowpath TUN file(local) */
-	zmq_pollitem_t local_poll = {
-		.fd = lfd,
-		.events = ZMQ_POLLIN,
-	};
+	if (st == shadow_port_thread(DATAPLANE_SPATH_PORT)) {
+		zmq_pollitem_t local_poll = {
+			.fd = shadow_fd,
+			.events = ZMQ_POLLIN,
+		};
 
-	if (zloop_poller(loop, &local_poll, spath_reader,
-			 shadow_if[DATAPLANE_SPATH_PORT]) < 0)
-		rte_panic("spath poller setup failed\n");
+		if (zloop_poller(loop, &local_poll, spath_reader,
+				 shadow_if[DATAPLANE_SPATH_PORT]) < 0)
+			rte_panic("spath poller setup failed\n");
+	}
 
 	dp_rcu_register_thread();
 	rcu_thread_offline();
@@ -991,9 +1250,29 @@ static void *shadow_handler(void *args)
 /* Setup global data for shadow */
 void shadow_init(void)
 {
-	event_fd = eventfd(0, EFD_NONBLOCK);
-	if (event_fd < 0)
-		rte_panic("Cannot open event fd\n");
+	struct shadow_thread *st;
+	unsigned int i;
+
+	shadow_nthreads = config.shadow_threads;
+	if (shadow_nthreads == 0)
+		shadow_nthreads = 1;
+	else if (shadow_nthreads > SHADOW_MAX_THREADS)
+		shadow_nthreads = SHADOW_MAX_THREADS;
+
+	for (i = 0; i < shadow_nthreads; i++) {
+		st = &shadow_threads[i];
+		st->id = i;
+		st->event_fd = eventfd(0, EFD_NONBLOCK);
+		if (st->event_fd < 0)
+			rte_panic("Cannot open event fd\n");
+	}
+
+	if (config.shadow_vhost) {
+		snprintf(shadow_owner.name, RTE_ETH_MAX_OWNER_NAME_LEN,
+			 "dataplane-shadow");
+		if (rte_eth_dev_owner_new(&shadow_owner.id) < 0)
+			rte_panic("Can't get shadow owner id\n");
+	}
 
 	/* Open local device.
 	 * Must be done in this thread
@@ -1001,26 +1280,37 @@ void shadow_init(void)
 	 */
 	shadow_fd = slowpath_init();
 
-	shadow_server_sock = zsock_new_rep(shadow_inproc);
-	if (!shadow_server_sock)
-		rte_panic("cannot bind to shadow server socket\n");
+	for (i = 0; i < shadow_nthreads; i++) {
+		st = &shadow_threads[i];
+		snprintf(st->inproc, sizeof(st->inproc),
+			 "inproc://shadow%u", i);
+		st->server_sock = zsock_new_rep(st->inproc);
+		if (!st->server_sock)
+			rte_panic("cannot bind to shadow server socket\n");
 
-	if (pthread_create(&shadow_thread, NULL,
-			   shadow_handler, &shadow_fd) < 0)
-		rte_panic("shadow thread creation failed\n");
+		if (pthread_create(&st->pthread, NULL, shadow_handler, st) < 0)
+			rte_panic("shadow thread creation failed\n");
+	}
 }
 
 void shadow_destroy(void)
 {
-	int join_rc;
 	struct shadow_if_info *sii;
+	struct shadow_thread *st;
+	unsigned int i;
+	int join_rc;
 
-	pthread_cancel(shadow_thread);
-	join_rc = pthread_join(shadow_thread, NULL);
-	if (join_rc != 0)
-		RTE_LOG(ERR, DATAPLANE,
-			"shadow thread join failed, rc %i\n", join_rc);
-	zsock_destroy(&shadow_server_sock);
+	for (i = 0; i < shadow_nthreads; i++) {
+		st = &shadow_threads[i];
+		pthread_cancel(st->pthread);
+		join_rc = pthread_join(st->pthread, NULL);
+		if (join_rc != 0)
+			RTE_LOG(ERR, DATAPLANE,
+				"shadow thread join failed, rc %i\n",
+				join_rc);
+		zsock_destroy(&st->server_sock);
+		close(st->event_fd);
+	}
 	close(shadow_fd);
 	sii = shadow_if[DATAPLANE_SPATH_PORT];
 	rte_ring_free(sii->rx_slow_ring);
@@ -1067,6 +1357,10 @@ void shadow_show_summary(FILE *f, const char *name)
 		jsonw_uint_field(wr, "tx_packet", sii->ts_packets);
 		jsonw_uint_field(wr, "tx_errors", sii->ts_errors);
 		jsonw_uint_field(wr, "tx_nobufs", sii->ts_nobufs);
+		jsonw_uint_field(wr, "thread", shadow_port_thread(port)->id);
+		jsonw_string_field(wr, "backend",
+				   is_spathintf ? "tun" :
+				   sii->vhost ? "vhost" : "tap");
 
 		jsonw_name(wr, "rx_ring");
 		const struct rte_ring *r = sii->rx_slow_ring;
@@ -33,7 +33,10 @@ struct tun_pi;
 struct shadow_if_info {
 	struct rte_ring *rx_slow_ring;	/* pkts going to tunnel */
 	unsigned int	 port;
-	int		 fd;
+	int		 fd;		/* tap, or vhost rx interrupt */
+	bool		 vhost;		/* vhost-net backend */
+	portid_t	 vport;		/* its virtio-user port */
+	int		 event_fd;	/* wakeup owning shadow thread */
 	bool		 wake_me;
 	bool		 congested;
 
@@ -49,6 +52,9 @@ struct shadow_if_info {
 	struct rcu_head	 rcu;
 };
 
+/* Maximum number of shadow threads */
+#define SHADOW_MAX_THREADS	8
+
 /* Start monitoring port */
 void shadow_start_port(portid_t portid);
 void shadow_stop_port(portid_t portid);
@@ -68,6 +74,7 @@ void shadow_show_summary(FILE *f, const char *name);
 struct ifnet *get_lo_ifp(enum cont_src_en cont_src);
 int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname);
 int tap_attach(const char *ifname);
+int tap_dormant(const char *ifname);
 void tap_teardown(const char *ifname);
 
 void shadow_init_spath_ring(int tun_fd);
@@ -83,6 +90,7 @@ int spath_receive(zmq_pollitem_t *item, struct tun_pi *pi,
 int tap_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg);
 int spath_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg);
 int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp);
+int shadow_vlan_insert(struct rte_mbuf *m, struct ifnet *ifp);
 bool local_packet_filter(const struct ifnet *ifp, struct rte_mbuf *m);
 struct shadow_if_info *get_port2shadowif(portid_t portid);
 struct shadow_if_info *get_fd2shadowif(int fd);
@@ -305,10 +305,6 @@ static int mnl_talk(struct mnl_socket *nl, struct nlmsghdr *nlh)
 /* Setup TUN/TAP device */
 int tap_attach(const char *ifname)
 {
-	char buf[MNL_SOCKET_BUFFER_SIZE];
-	struct mnl_socket *nl;
-	struct nlmsghdr *nlh;
-	struct ifinfomsg *ifi;
 	struct ifreq ifr;
 	int fd;
 
@@ -337,18 +333,40 @@ int tap_attach(const char *ifname)
 		goto fail;
 	}
 
+	if (tap_dormant(ifname) < 0)
+		goto fail;
+
+	return fd;
+
+fail:
+	close(fd);
+	return -1;
+}
+
+/*
+ * Set up a TUN/TAP device so that its link state is controlled from
+ * the daemon, starting with no carrier.
+ */
+int tap_dormant(const char *ifname)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_socket *nl;
+	struct nlmsghdr *nlh;
+	struct ifinfomsg *ifi;
+	int rc = -1;
+
 	/* Default to no carrier, link up happens later */
 	nl = mnl_socket_open(NETLINK_ROUTE);
 	if (!nl) {
 		RTE_LOG(ERR, DATAPLANE,
 			"%s(): mnl_socket_open failed\n", __func__);
-		goto fail;
+		return -1;
 	}
 
 	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
 		RTE_LOG(ERR, DATAPLANE,
 			"%s(): mnl_socket_bind failed\n", __func__);
-		goto fail;
+		goto out;
 	}
 
 	nlh = mnl_nlmsg_put_header(buf);
@@ -370,15 +388,13 @@ int tap_attach(const char *ifname)
 	if (mnl_talk(nl, nlh) < 0) {
 		RTE_LOG(ERR, DATAPLANE, "%s(): can not setup %s: %s\n",
 			__func__, ifname, strerror(errno));
-		goto fail;
+		goto out;
 	}
+	rc = 0;
 
+out:
 	mnl_socket_close(nl);
-	return fd;
-
-fail:
-	close(fd);
-	return -1;
+	return rc;
 }
 
 /* Teardown TUN/TAP device */
@@ -526,6 +542,90 @@ int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp)
 	return writev(fd, iov, n);
 }
 
+/*
+ * Put the VLAN tags that were stripped from a received packet back in
+ * front of it, in place, as tuntap_write() does with its iovec.  Used
+ * where the packet is handed over as an mbuf rather than written.
+ */
+int shadow_vlan_insert(struct rte_mbuf *m, struct ifnet *ifp)
+{
+	struct rte_ether_addr addr[2];
+	bool sw_qinq_inner = false;
+	uint16_t sw_outer_vlan = 0;
+	uint16_t tpid, tci[2], ether_type;
+	struct rte_ether_hdr *eh;
+	struct rte_vlan_hdr *vh;
+	unsigned int ntags = 1, hlen, l2_len;
+
+	if (!(m->ol_flags & PKT_RX_VLAN))
+		return 0;
+
+	if (!ifp) {
+		/*
+		 * Interface has been deleted in between the packet being
+		 * enqueued and it being dequeued and processed here.
+		 */
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (pktmbuf_mdata_invar_exists(m, PKT_MDATA_INVAR_BRIDGE)) {
+		struct pktmbuf_mdata *mdata = pktmbuf_mdata(m);
+
+		sw_outer_vlan = mdata->md_bridge.outer_vlan;
+		if (sw_outer_vlan)
+			sw_qinq_inner = true;
+	}
+
+	if (!ifp->qinq_inner && !sw_qinq_inner) {
+		tpid = if_tpid(ifp);
+		tci[0] = m->vlan_tci;
+	} else if (!sw_qinq_inner) {
+		ntags = 2;
+		tpid = if_tpid(ifp->if_parent);
+		tci[0] = m->vlan_tci;
+		tci[1] = ifp->if_vlan;
+	} else {
+		ntags = 2;
+		tpid = if_tpid(ifp);
+		tci[0] = sw_outer_vlan;
+		tci[1] = m->vlan_tci;
+	}
+
+	eh = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	memcpy(addr, eh, sizeof(addr));
+	ether_type = eh->ether_type;
+
+	/* Replace the original Ethernet header */
+	l2_len = dp_pktmbuf_l2_len(m);
+	hlen = RTE_ETHER_HDR_LEN + ntags * sizeof(struct rte_vlan_hdr);
+	if (hlen > l2_len) {
+		if (!rte_pktmbuf_prepend(m, hlen - l2_len)) {
+			errno = ENOBUFS;
+			return -1;
+		}
+	} else {
+		rte_pktmbuf_adj(m, l2_len - hlen);
+	}
+
+	eh = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	memcpy(eh, addr, sizeof(addr));
+	eh->ether_type = htons(tpid);
+	vh = (struct rte_vlan_hdr *)(eh + 1);
+	vh[0].vlan_tci = htons(tci[0]);
+	if (ntags == 2) {
+		vh[0].eth_proto = htons(RTE_ETHER_TYPE_VLAN);
+		vh[1].vlan_tci = htons(tci[1]);
+		vh[1].eth_proto = ether_type;
+	} else {
+		vh[0].eth_proto = ether_type;
+	}
+
+	m->ol_flags &= ~(PKT_RX_VLAN | PKT_RX_VLAN_STRIPPED);
+	dp_pktmbuf_l2_len(m) = hlen;
+	return 0;
+}
+
 /*
  * Filter and mangle local packets
  * returns false if packet is unwanted.
@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Shared memory statistics export.
+ *
+ * A timer on the master thread walks the interfaces, NPF rulesets, QoS
+ * subports and CGNAT pools, and copies their counters into a POSIX shared
+ * memory segment under a sequence lock.  Collectors then read the counters
+ * straight from the segment, rather than polling the console for JSON.
+ *
+ * The snapshot is built in a private buffer first so that the segment is
+ * only marked as being written for the duration of one memcpy.
+ *
+ * The buffer, the mapping and the timer belong to the master thread.  The
+ * enable and disable commands arrive on the console thread, so they are
+ * passed to the master to run there.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_sched.h>
+#include <rte_timer.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+#include "commands.h"
+#include "dp_stats_shm.h"
+#include "if_var.h"
+#include "json_writer.h"
+#include "lcore_sched.h"
+#include "npf/config/npf_attach_point.h"
+#include "npf/config/npf_config.h"
+#include "npf/config/npf_ruleset_type.h"
+#include "npf/nat/nat_pool.h"
+#include "npf/nat/nat_pool_public.h"
+#include "npf/npf_ruleset.h"
+#include "qos.h"
+#include "stats_shm.h"
+#include "util.h"
+#include "vplane_log.h"
+
+#define STATS_SHM_HDR_LEN \
+	RTE_ALIGN_CEIL(sizeof(struct dp_stats_shm_hdr), RTE_CACHE_LINE_SIZE)
+
+#define STATS_SHM_INTERVAL_MIN	100		/* ms */
+#define STATS_SHM_INTERVAL_MAX	3600000		/* ms */
+
+#define STATS_SHM_BUF_MIN	(64 * 1024)
+
+static const char * const stats_shm_sect_name[DP_STATS_SHM_SECT_COUNT] = {
+	[DP_STATS_SHM_SECT_IF]		= "interface",
+	[DP_STATS_SHM_SECT_RULE]	= "rule",
+	[DP_STATS_SHM_SECT_QOS]		= "qos",
+	[DP_STATS_SHM_SECT_NAT_POOL]	= "nat-pool",
+};
+
+static struct stats_shm {
+	int			fd;
+	struct dp_stats_shm_hdr	*hdr;		/* mapped segment */
+	size_t			map_len;
+	uint8_t			*buf;		/* snapshot being built */
+	size_t			buf_len;
+	size_t			buf_used;
+	bool			buf_err;
+	struct dp_stats_shm_section sections[DP_STATS_SHM_SECT_COUNT];
+	struct dp_stats_shm_section *cur;
+	uint32_t		nr_lcores;
+	uint32_t		interval_ms;
+	uint64_t		generation;
+	uint64_t		errors;
+	uint64_t		last_cycles;	/* to build last snapshot */
+	struct rte_timer	tmr;
+	bool			tmr_active;
+} shm = {
+	.fd = -1,
+};
+
+/*
+ * Reserve space for one record at the end of the snapshot.  The buffer may
+ * move, so the record must be filled in before the next is reserved.
+ */
+static void *stats_shm_reserve(size_t len)
+{
+	void *rec;
+
+	if (shm.buf_err)
+		return NULL;
+
+	if (shm.buf_used + len > shm.buf_len) {
+		size_t new_len = RTE_MAX(shm.buf_len * 2, STATS_SHM_BUF_MIN);
+		uint8_t *new_buf;
+
+		while (shm.buf_used + len > new_len)
+			new_len *= 2;
+
+		new_buf = realloc(shm.buf, new_len);
+		if (!new_buf) {
+			shm.buf_err = true;
+			return NULL;
+		}
+		shm.buf = new_buf;
+		shm.buf_len = new_len;
+	}
+
+	rec = shm.buf + shm.buf_used;
+	memset(rec, 0, len);
+	shm.buf_used += len;
+	shm.cur->count++;
+
+	return rec;
+}
+
+static void stats_shm_section_start(enum dp_stats_shm_section_type type,
+				    size_t rec_len)
+{
+	shm.cur = &shm.sections[type];
+	shm.cur->type = type;
+	shm.cur->rec_len = rec_len;
+	shm.cur->offset = STATS_SHM_HDR_LEN + shm.buf_used;
+	shm.cur->count = 0;
+}
+
+/*
+ * Interfaces
+ */
+static void stats_shm_if(struct ifnet *ifp, void *arg __unused)
+{
+	struct dp_stats_shm_if *rec;
+	struct dp_stats_shm_if_counters *c;
+	const struct if_data *d;
+	unsigned int i;
+
+	rec = stats_shm_reserve(shm.cur->rec_len);
+	if (!rec)
+		return;
+
+	rec->ifindex = ifp->if_index;
+	snprintf(rec->ifname, sizeof(rec->ifname), "%s", ifp->if_name);
+
+	if (!ifp->if_data || ifp->unplugged)
+		return;
+
+	FOREACH_DP_LCORE(i) {
+		c = &rec->lcore[i];
+		d = &ifp->if_data[i];
+
+		c->ipackets = d->ifi_ipackets;
+		c->ierrors = d->ifi_ierrors;
+		c->opackets = d->ifi_opackets;
+		c->oerrors = d->ifi_oerrors;
+		c->ibytes = d->ifi_ibytes;
+		c->obytes = d->ifi_obytes;
+		c->idropped = d->ifi_idropped;
+		c->odropped_txring = d->ifi_odropped_txring;
+		c->odropped_hwq = d->ifi_odropped_hwq;
+		c->odropped_proto = d->ifi_odropped_proto;
+		c->ibridged = d->ifi_ibridged;
+		c->imulticast = d->ifi_imulticast;
+		c->ivlan = d->ifi_ivlan;
+		c->no_address = d->ifi_no_address;
+		c->no_vlan = d->ifi_no_vlan;
+		c->unknown = d->ifi_unknown;
+	}
+}
+
+/*
+ * NPF rules
+ */
+static bool stats_shm_rule(npf_rule_t *rl, void *arg)
+{
+	const char *rs_name = arg;
+	const struct npf_rule_stats *stats;
+	struct dp_stats_shm_rule *rec;
+	enum npf_attach_type attach_type;
+	const char *attach_point;
+	const char *group;
+	unsigned int i;
+
+	rec = stats_shm_reserve(shm.cur->rec_len);
+	if (!rec)
+		return false;
+
+	rec->hash = npf_rule_get_hash(rl);
+	rec->rule_no = npf_rule_get_num(rl);
+	snprintf(rec->ruleset, sizeof(rec->ruleset), "%s", rs_name);
+
+	if (npf_rule_get_attach_point(rl, &attach_type, &attach_point) == 0 &&
+	    attach_point)
+		snprintf(rec->attach_point, sizeof(rec->attach_point), "%s",
+			 attach_point);
+
+	group = npf_rule_get_name(rl);
+	if (group)
+		snprintf(rec->group, sizeof(rec->group), "%s", group);
+
+	stats = npf_rule_get_stats(rl);
+	if (!stats)
+		return true;
+
+	FOREACH_DP_LCORE(i) {
+		rec->lcore[i].packets = stats[i].pkts_ct;
+		rec->lcore[i].bytes = stats[i].bytes_ct;
+	}
+	return true;
+}
+
+static bool stats_shm_rule_group(npf_rule_group_t *rg, void *arg)
+{
+	npf_rules_walk(rg, NULL, stats_shm_rule, arg);
+	return !shm.buf_err;
+}
+
+static bool stats_shm_attpt(struct npf_attpt_item *ap, void *arg __unused)
+{
+	struct npf_config **npf_conf_p = npf_attpt_item_up_data_context(ap);
+	enum npf_ruleset_type type;
+	const npf_ruleset_t *rs;
+
+	if (!npf_conf_p || !*npf_conf_p)
+		return true;
+
+	for (type = 0; type < NPF_RS_TYPE_COUNT; type++) {
+		rs = npf_get_ruleset(*npf_conf_p, type);
+		if (!rs)
+			continue;
+
+		npf_ruleset_group_walk(
+			rs, NULL, stats_shm_rule_group,
+			(void *)npf_get_ruleset_type_name(type));
+	}
+	return !shm.buf_err;
+}
+
+/*
+ * QoS subports
+ */
+static int stats_shm_qos(struct ifnet *ifp, unsigned int subport,
+			 uint32_t vlan_id,
+			 const struct rte_sched_subport_stats64 *stats,
+			 const struct rte_sched_subport_stats64 *clear,
+			 void *arg __unused)
+{
+	struct dp_stats_shm_qos *rec;
+	unsigned int i;
+
+	rec = stats_shm_reserve(shm.cur->rec_len);
+	if (!rec)
+		return -ENOMEM;
+
+	rec->ifindex = ifp ? ifp->if_index : 0;
+	rec->subport = subport;
+	rec->vlan_id = vlan_id;
+	rec->nr_tcs = RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE;
+
+	for (i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; i++) {
+		rec->tc[i].packets = stats->n_pkts_tc[i] - clear->n_pkts_tc[i];
+		rec->tc[i].bytes = stats->n_bytes_tc[i] - clear->n_bytes_tc[i];
+		rec->tc[i].dropped = stats->n_pkts_tc_dropped[i] -
+			clear->n_pkts_tc_dropped[i];
+		rec->tc[i].random_dropped = stats->n_pkts_red_dropped[i] -
+			clear->n_pkts_red_dropped[i];
+	}
+	return 0;
+}
+
+/*
+ * CGNAT pools
+ */
+static int stats_shm_nat_pool(struct nat_pool *np, void *arg __unused)
+{
+	struct dp_stats_shm_nat_pool *rec;
+	struct nat_pool_ranges *nr;
+
+	if (!nat_pool_type_is_cgnat(np))
+		return 0;
+
+	rec = stats_shm_reserve(shm.cur->rec_len);
+	if (!rec)
+		return -ENOMEM;
+
+	snprintf(rec->name, sizeof(rec->name), "%s", np->np_name);
+
+	nr = rcu_dereference(np->np_ranges);
+	if (nr) {
+		rec->naddrs = nr->nr_naddrs;
+		rec->addrs_used = rte_atomic32_read(&nr->nr_used);
+	}
+
+	rec->map_active = rte_atomic32_read(&np->np_map_active);
+	rec->pb_active = rte_atomic32_read(&np->np_pb_active);
+	rec->map_reqs = rte_atomic64_read(&np->np_map_reqs);
+	rec->map_fails = rte_atomic64_read(&np->np_map_fails);
+	rec->pb_allocs = rte_atomic64_read(&np->np_pb_allocs);
+	rec->pb_fails = rte_atomic64_read(&np->np_pb_fails);
+	rec->pb_freed = rte_atomic64_read(&np->np_pb_freed);
+	rec->pb_limit = rte_atomic64_read(&np->np_pb_limit);
+
+	return 0;
+}
+
+/*
+ * Grow the segment to at least 'size' bytes.  Readers notice the change
+ * from hdr->size and remap.
+ */
+static int stats_shm_resize(size_t size)
+{
+	size_t pgsz = sysconf(_SC_PAGESIZE);
+	void *map;
+
+	size = RTE_ALIGN_CEIL(size, pgsz);
+	if (size <= shm.map_len)
+		return 0;
+
+	size = RTE_MAX(size, shm.map_len * 2);
+	if (ftruncate(shm.fd, size) < 0)
+		return -errno;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	if (shm.hdr)
+		munmap(shm.hdr, shm.map_len);
+
+	shm.hdr = map;
+	shm.map_len = size;
+	return 0;
+}
+
+static int stats_shm_publish(void)
+{
+	struct dp_stats_shm_hdr *hdr;
+	uint64_t start = rte_get_timer_cycles();
+	struct timespec ts;
+	int rc;
+
+	shm.buf_used = 0;
+	shm.buf_err = false;
+	shm.nr_lcores = get_lcore_max() + 1;
+
+	stats_shm_section_start(DP_STATS_SHM_SECT_IF,
+				sizeof(struct dp_stats_shm_if) +
+				shm.nr_lcores *
+				sizeof(struct dp_stats_shm_if_counters));
+	dp_ifnet_walk(stats_shm_if, NULL);
+
+	stats_shm_section_start(DP_STATS_SHM_SECT_RULE,
+				sizeof(struct dp_stats_shm_rule) +
+				shm.nr_lcores *
+				sizeof(struct dp_stats_shm_rule_counters));
+	npf_attpt_item_walk_up(stats_shm_attpt, NULL);
+
+	stats_shm_section_start(DP_STATS_SHM_SECT_QOS,
+				sizeof(struct dp_stats_shm_qos) +
+				RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE *
+				sizeof(struct dp_stats_shm_qos_tc));
+	qos_sched_subport_stats_walk(stats_shm_qos, NULL);
+
+	stats_shm_section_start(DP_STATS_SHM_SECT_NAT_POOL,
+				sizeof(struct dp_stats_shm_nat_pool));
+	nat_pool_walk(stats_shm_nat_pool, NULL);
+
+	if (shm.buf_err) {
+		shm.errors++;
+		return -ENOMEM;
+	}
+
+	rc = stats_shm_resize(STATS_SHM_HDR_LEN + shm.buf_used);
+	if (rc < 0) {
+		shm.errors++;
+		return rc;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	hdr = shm.hdr;
+	CMM_STORE_SHARED(hdr->seq, hdr->seq + 1);
+	cmm_smp_wmb();
+
+	memcpy((uint8_t *)hdr + STATS_SHM_HDR_LEN, shm.buf, shm.buf_used);
+	memcpy(hdr->sections, shm.sections, sizeof(hdr->sections));
+	hdr->nr_sections = DP_STATS_SHM_SECT_COUNT;
+	hdr->nr_lcores = shm.nr_lcores;
+	hdr->interval_ms = shm.interval_ms;
+	hdr->size = shm.map_len;
+	hdr->generation = ++shm.generation;
+	hdr->timestamp_ns = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(hdr->seq, hdr->seq + 1);
+
+	shm.last_cycles = rte_get_timer_cycles() - start;
+	return 0;
+}
+
+static void
+stats_shm_tmr_hdlr(struct rte_timer *timer __rte_unused,
+		   void *arg __rte_unused)
+{
+	stats_shm_publish();
+}
+
+static void stats_shm_tmr_stop(void)
+{
+	if (shm.tmr_active) {
+		rte_timer_stop_sync(&shm.tmr);
+		shm.tmr_active = false;
+	}
+}
+
+static int stats_shm_open(void)
+{
+	int rc;
+
+	shm.fd = shm_open(DP_STATS_SHM_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (shm.fd < 0)
+		return -errno;
+
+	rc = stats_shm_resize(STATS_SHM_HDR_LEN);
+	if (rc < 0) {
+		close(shm.fd);
+		shm.fd = -1;
+		shm_unlink(DP_STATS_SHM_NAME);
+		return rc;
+	}
+
+	shm.hdr->magic = DP_STATS_SHM_MAGIC;
+	shm.hdr->version = DP_STATS_SHM_VERSION;
+	shm.hdr->hdr_len = sizeof(struct dp_stats_shm_hdr);
+	shm.hdr->size = shm.map_len;
+	return 0;
+}
+
+static int stats_shm_enable(uint32_t interval_ms)
+{
+	int rc;
+
+	if (shm.fd < 0) {
+		rc = stats_shm_open();
+		if (rc < 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"stats-shm: cannot create %s: %s\n",
+				DP_STATS_SHM_NAME, strerror(-rc));
+			return rc;
+		}
+	}
+
+	shm.interval_ms = interval_ms;
+	stats_shm_publish();
+
+	stats_shm_tmr_stop();
+	rte_timer_init(&shm.tmr);
+	rte_timer_reset_sync(&shm.tmr,
+			     rte_get_timer_hz() * interval_ms / 1000,
+			     PERIODICAL, rte_get_master_lcore(),
+			     stats_shm_tmr_hdlr, NULL);
+	shm.tmr_active = true;
+
+	return 0;
+}
+
+void stats_shm_destroy(void)
+{
+	stats_shm_tmr_stop();
+
+	if (shm.hdr) {
+		munmap(shm.hdr, shm.map_len);
+		shm.hdr = NULL;
+		shm.map_len = 0;
+	}
+
+	if (shm.fd >= 0) {
+		close(shm.fd);
+		shm.fd = -1;
+		shm_unlink(DP_STATS_SHM_NAME);
+	}
+
+	free(shm.buf);
+	shm.buf = NULL;
+	shm.buf_len = 0;
+	shm.interval_ms = 0;
+}
+
+static void stats_shm_show(FILE *f)
+{
+	json_writer_t *wr = jsonw_new(f);
+	unsigned int i;
+
+	if (!wr)
+		return;
+
+	jsonw_name(wr, "stats-shm");
+	jsonw_start_object(wr);
+	jsonw_bool_field(wr, "enabled", shm.fd >= 0);
+	jsonw_string_field(wr, "name", DP_STATS_SHM_NAME);
+	jsonw_uint_field(wr, "interval_ms", shm.interval_ms);
+	jsonw_uint_field(wr, "size", shm.map_len);
+	jsonw_uint_field(wr, "generation", shm.generation);
+	jsonw_uint_field(wr, "errors", shm.errors);
+	jsonw_uint_field(wr, "last_us",
+			 shm.last_cycles * 1000000 / rte_get_timer_hz());
+
+	jsonw_name(wr, "sections");
+	jsonw_start_array(wr);
+	for (i = 0; shm.fd >= 0 && i < DP_STATS_SHM_SECT_COUNT; i++) {
+		jsonw_start_object(wr);
+		jsonw_string_field(wr, "type", stats_shm_sect_name[i]);
+		jsonw_uint_field(wr, "count", shm.sections[i].count);
+		jsonw_uint_field(wr, "rec_len", shm.sections[i].rec_len);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+
+	jsonw_end_object(wr);
+	jsonw_destroy(&wr);
+}
+
+/*
+ * stats-shm enable <interval-ms>
+ * stats-shm disable
+ * stats-shm show
+ */
+int cmd_stats_shm(FILE *f, int argc, char **argv)
+{
+	unsigned int interval;
+	int rc;
+
+	if (argc < 2)
+		goto usage;
+
+	if (strcmp(argv[1], "show") == 0) {
+		stats_shm_show(f);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "disable") == 0) {
+		if (!is_master_thread())
+			return console_cmd_on_master(cmd_stats_shm, argc,
+						     argv);
+		stats_shm_destroy();
+		return 0;
+	}
+
+	if (strcmp(argv[1], "enable") == 0) {
+		if (argc < 3 || get_unsigned(argv[2], &interval) < 0 ||
+		    interval < STATS_SHM_INTERVAL_MIN ||
+		    interval > STATS_SHM_INTERVAL_MAX) {
+			fprintf(f, "stats-shm: interval must be %u-%u ms\n",
+				STATS_SHM_INTERVAL_MIN,
+				STATS_SHM_INTERVAL_MAX);
+			return -1;
+		}
+
+		if (!is_master_thread()) {
+			rc = console_cmd_on_master(cmd_stats_shm, argc, argv);
+			if (rc < 0)
+				fprintf(f, "stats-shm: enable failed\n");
+			return rc;
+		}
+
+		rc = stats_shm_enable(interval);
+		if (rc < 0) {
+			fprintf(f, "stats-shm: enable failed: %s\n",
+				strerror(-rc));
+			return -1;
+		}
+		return 0;
+	}
+
+usage:
+	fprintf(f, "Usage: stats-shm enable <interval-ms> | disable | show\n");
+	return -1;
+}
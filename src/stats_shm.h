@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+/*
+ * Export of statistics through a shared memory segment.  The layout of
+ * the segment is described in dp_stats_shm.h.
+ */
+
+/* Stop the export and remove the segment */
+void stats_shm_destroy(void);
+
+#endif /* STATS_SHM_H */
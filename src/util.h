@@ -178,6 +178,27 @@ size_t snprintfcat(char *buf, size_t size, const char *fmt, ...)
 const char *hypervisor_id(void);
 unsigned int get_lcore_max(void);
 
+/*
+ * Sum an array of per-lcore blocks of 64-bit counters, indexed by
+ * dp_lcore_id(), into a single block.  sz is the size of one block and
+ * should be a compile time constant, so that the inner loop is unrolled and
+ * vectorised.
+ */
+static ALWAYS_INLINE void
+dp_lcore_sum_u64(void *restrict sum, const void *restrict pcpu, size_t sz)
+{
+	unsigned int lcore, i, nr = get_lcore_max() + 1;
+	const size_t n = sz / sizeof(uint64_t);
+	const uint64_t *src = pcpu;
+	uint64_t *dst = sum;
+
+	memset(dst, 0, sz);
+
+	for (lcore = 0; lcore < nr; lcore++, src += n)
+		for (i = 0; i < n; i++)
+			dst[i] += src[i];
+}
+
 void *malloc_huge_aligned(size_t sz);
 void free_huge(void *ptr, size_t sz);
 int defer_rcu_huge(void *ptr, size_t sz);
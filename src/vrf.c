@@ -26,7 +26,6 @@
 #include "ip_mcast.h"
 #include "lpm/lpm.h"
 #include "main.h"
-#include "npf/fragment/ipv4_rsmbl.h"
 #include "npf_shim.h"
 #include "route_v6.h"
 #include "rt_tracker.h"
@@ -153,7 +152,6 @@ vrf_destroy(struct rcu_head *head)
 		route_v6_uninit(self, &self->v_rt6_head);
 		gre_table_uninit(self);
 		vti_table_uninit(self);
-		fragment_tables_uninit(self);
 		mcast_vrf_uninit(self);
 		mcast6_vrf_uninit(self);
 		npf_vrf_destroy(self);
@@ -228,9 +226,6 @@ vrf_alloc(vrfid_t vrf_id)
 	if (vti_table_init(vrf_var) < 0)
 		goto err;
 
-	if (fragment_tables_init(vrf_var) < 0)
-		goto err;
-
 	if (mcast_vrf_init(vrf_var) < 0)
 		goto err;
 
@@ -53,8 +53,6 @@ struct vrf {
 	char SPARE[4];
 	/* --- cacheline 1 boundary (64 bytes) --- */
 	uint32_t  *v_pbrtablemap;
-	struct cds_lfht *v_ipv4_frag_table;
-	struct cds_lfht *v_ipv6_frag_table;
 	struct mcast_vrf v_mvrf4;
 	struct mcast6_vrf v_mvrf6;
 	struct crypto_vrf_ctx *crypto;
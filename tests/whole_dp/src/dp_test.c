@@ -515,6 +515,7 @@ static void generate_conf_file(const char *cfgfile, const char *console_ep,
 		 "uuid=%i\n"
 		 "dataplane-id=%i\n"
 		 "uplink-mac=%s\n"
+		 "shadow-threads=%u\n"
 		 "%s\n"
 		 "[RIB]\n"
 		 "%s%s\n"  /* vr defines local ip */
@@ -532,6 +533,7 @@ static void generate_conf_file(const char *cfgfile, const char *console_ep,
 		 uuid,
 		 dp_id,
 		 uplink_mac,
+		 DP_TEST_SHADOW_THREADS,
 		 extra_cfg_buf,
 		 dp_ip_str ? "ip=" : "",
 		 dp_ip_str ? dp_ip_str : "",
@@ -40,6 +40,12 @@ extern struct rte_mempool *dp_test_pool;
 #define DP_TEST_RX_RING_BASE_NAME "nullrx_"
 #define DP_TEST_TX_RING_BASE_NAME "nulltx_"
 
+/*
+ * Number of shadow threads.  Ports are shared out between them, so that
+ * the slow path is tested on more than one thread.
+ */
+#define DP_TEST_SHADOW_THREADS 2
+
 int dp_test_debug_get(void);
 
 /* The entry point into the dataplane test process */
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane CPU affinity and RX queue rebalance tests
+ */
+
+#include <errno.h>
+#include <rte_lcore.h>
+
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test/dp_test_cmd_check.h"
+
+DP_DECL_TEST_SUITE(affinity_suite);
+
+DP_DECL_TEST_CASE(affinity_suite, rebalance_cfg, NULL, NULL);
+
+static void
+dp_test_check_rebalance(bool enabled, unsigned int threshold,
+			unsigned int min_rate, unsigned int holddown)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{ \"rebalance\": "
+		"  { \"enabled\": %s, "
+		"    \"threshold\": %u, "
+		"    \"min_rate\": %u, "
+		"    \"holddown\": %u "
+		"  } "
+		"}",
+		enabled ? "true" : "false", threshold, min_rate, holddown);
+	dp_test_check_json_state("affinity rebalance", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * Rebalancing is off by default and the defaults are kept for any
+ * option not given when it is enabled.
+ */
+DP_START_TEST(rebalance_cfg, enable_disable)
+{
+	dp_test_check_rebalance(false, 25, 100000, 10);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"affinity rebalance enable threshold 50");
+	dp_test_check_rebalance(true, 50, 100000, 10);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"affinity rebalance enable min-rate 1000 "
+				"holddown 5");
+	dp_test_check_rebalance(true, 50, 1000, 5);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"affinity rebalance disable");
+	dp_test_check_rebalance(false, 50, 1000, 5);
+
+	/* restore defaults for later tests */
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"affinity rebalance enable threshold 25 "
+				"min-rate 100000 holddown 10");
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"affinity rebalance disable");
+	dp_test_check_rebalance(false, 25, 100000, 10);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(affinity_suite, rebalance_pick, NULL, NULL);
+
+/*
+ * The tests run on a single lcore, so queues cannot actually be moved.
+ * Check the choice of the busiest lcore, and of the queue to move from it
+ * and where to, instead.
+ */
+DP_START_TEST(rebalance_pick, hot)
+{
+	const struct rxq_rebalance_params params = {
+		.threshold = 25,
+		.min_rate = 100000,
+		.holddown = 10,
+	};
+	uint64_t load[RTE_MAX_LCORE] = { 0 };
+	bitmask_t lcores;
+	unsigned int hot;
+
+	bitmask_zero(&lcores);
+	bitmask_set(&lcores, 1);
+	bitmask_set(&lcores, 2);
+	bitmask_set(&lcores, 3);
+
+	/* Lcore 2 well above the mean */
+	load[1] = 100000;
+	load[2] = 1000000;
+	load[3] = 300000;
+	hot = rxq_rebalance_hot(load, &lcores, &params);
+	dp_test_fail_unless(hot == 2, "hot lcore %u, expected 2", hot);
+
+	/* Lcores that are not candidates are ignored */
+	load[0] = 5000000;
+	hot = rxq_rebalance_hot(load, &lcores, &params);
+	dp_test_fail_unless(hot == 2, "hot lcore %u, expected 2", hot);
+
+	/* Within the threshold of the mean */
+	load[1] = 900000;
+	load[2] = 1000000;
+	load[3] = 800000;
+	hot = rxq_rebalance_hot(load, &lcores, &params);
+	dp_test_fail_unless(hot == RTE_MAX_LCORE,
+			    "balanced, but hot lcore %u", hot);
+
+	/* Busiest lcore below the minimum rate */
+	load[1] = 0;
+	load[2] = 90000;
+	load[3] = 0;
+	hot = rxq_rebalance_hot(load, &lcores, &params);
+	dp_test_fail_unless(hot == RTE_MAX_LCORE,
+			    "not busy, but hot lcore %u", hot);
+
+	/* A single lcore has nowhere to move queues to */
+	bitmask_zero(&lcores);
+	bitmask_set(&lcores, 2);
+	load[2] = 1000000;
+	hot = rxq_rebalance_hot(load, &lcores, &params);
+	dp_test_fail_unless(hot == RTE_MAX_LCORE,
+			    "single lcore, but hot lcore %u", hot);
+} DP_END_TEST;
+
+DP_START_TEST(rebalance_pick, dst)
+{
+	uint64_t load[RTE_MAX_LCORE] = { 0 };
+	uint64_t best_score;
+	bitmask_t allowed;
+	unsigned int dst;
+
+	load[1] = 100000;
+	load[2] = 1000000;
+	load[3] = 300000;
+
+	bitmask_zero(&allowed);
+	bitmask_set(&allowed, 1);
+	bitmask_set(&allowed, 2);
+	bitmask_set(&allowed, 3);
+
+	/* To the least busy lcore, leaving lcore 2 with 600000 */
+	best_score = load[2];
+	dst = rxq_rebalance_dst(load, 2, 400000, &allowed, &best_score);
+	dp_test_fail_unless(dst == 1 && best_score == 600000,
+			    "dst %u score %lu, expected 1 and 600000", dst,
+			    best_score);
+
+	/* A queue that evens out the load less is not picked over it */
+	dst = rxq_rebalance_dst(load, 2, 100000, &allowed, &best_score);
+	dp_test_fail_unless(dst == RTE_MAX_LCORE && best_score == 600000,
+			    "dst %u score %lu for a worse queue", dst,
+			    best_score);
+
+	/* But one that evens it out more is */
+	dst = rxq_rebalance_dst(load, 2, 450000, &allowed, &best_score);
+	dp_test_fail_unless(dst == 1 && best_score == 550000,
+			    "dst %u score %lu, expected 1 and 550000", dst,
+			    best_score);
+
+	/* Only to lcores the queue is allowed on */
+	bitmask_clear(&allowed, 1);
+	best_score = load[2];
+	dst = rxq_rebalance_dst(load, 2, 400000, &allowed, &best_score);
+	dp_test_fail_unless(dst == 3 && best_score == 700000,
+			    "dst %u score %lu, expected 3 and 700000", dst,
+			    best_score);
+
+	/* Moving a queue with most of the load just moves the hot spot */
+	bitmask_set(&allowed, 1);
+	best_score = load[2];
+	dst = rxq_rebalance_dst(load, 2, 950000, &allowed, &best_score);
+	dp_test_fail_unless(dst == RTE_MAX_LCORE,
+			    "queue with most of the load moved to %u", dst);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(affinity_suite, rebalance_move, NULL, NULL);
+
+static void
+dp_test_rebalance_fwd(struct dp_test_pkt_desc_t *pkt)
+{
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+
+	test_pak = dp_test_v4_pkt_from_desc(pkt);
+	test_exp = dp_test_exp_from_desc(test_pak, pkt);
+	dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+	dp_test_pak_receive(test_pak, pkt->rx_intf, test_exp);
+}
+
+/*
+ * Packets keep being forwarded after the receive queue they arrive on
+ * has been handed over between lcores. The test has a single lcore, so
+ * the queue is released and taken back by the same one.
+ */
+DP_START_TEST(rebalance_move, forwarding)
+{
+	uint8_t portid = dp_test_intf_name2port("dp1T0");
+	int rc;
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 41001,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	dp_test_rebalance_fwd(&pkt);
+
+	rc = rxq_move(portid, 0, rte_get_master_lcore());
+	dp_test_fail_unless(rc == 0, "move of dp1T0 queue 0 failed: %d", rc);
+
+	dp_test_rebalance_fwd(&pkt);
+
+	/* A queue that no lcore polls cannot be moved */
+	rc = rxq_move(portid, UINT8_MAX, rte_get_master_lcore());
+	dp_test_fail_unless(rc == -ENOENT, "move of unpolled queue: %d", rc);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+} DP_END_TEST;
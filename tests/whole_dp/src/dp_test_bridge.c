@@ -9,7 +9,9 @@
  */
 
 #include "dp_test.h"
+#include "dp_test/dp_test_cmd_check.h"
 #include "dp_test_console.h"
+#include "dp_test_json_utils.h"
 #include "dp_test_lib_internal.h"
 #include "dp_test_lib_exp.h"
 #include "dp_test_lib_intf_internal.h"
@@ -1492,3 +1494,73 @@ DP_START_TEST(bridge_flush, bridge_flush)
 	dp_test_intf_bridge_remove_port("br1", "dp2T1");
 	dp_test_intf_bridge_del("br1");
 } DP_END_TEST;
+
+/*
+ * Test that a source address moving to another port is relearnt.
+ *
+ * mac_a is learnt on dp1T0 and then moves to dp3T2.  Frames to mac_a
+ * should follow it.
+ */
+DP_DECL_TEST_CASE(bridge_suite, bridge_mac_move, NULL, NULL);
+DP_START_TEST(bridge_mac_move, mac_move)
+{
+	struct dp_test_expected *exp;
+	json_object *expected;
+	const char *mac_a, *mac_b;
+	struct rte_mbuf *test_pak;
+	int len = 64;
+
+	mac_a = "00:00:a4:00:00:aa";
+	mac_b = "00:00:a4:00:00:bb";
+
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "dp2T1");
+	dp_test_intf_bridge_add_port("br1", "dp3T2");
+
+	/* mac_a -> mac_b on dp1T0, flooded */
+	test_pak = dp_test_create_l2_pak(mac_b, mac_a,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_oif_name_m(exp, 0, "dp2T1");
+	dp_test_exp_set_oif_name_m(exp, 1, "dp3T2");
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	/* mac_b -> mac_a on dp2T1, mac_a learnt on dp1T0 */
+	test_pak = dp_test_create_l2_pak(mac_a, mac_b,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp1T0");
+	dp_test_pak_receive(test_pak, "dp2T1", exp);
+
+	/* mac_a moves to dp3T2, mac_b learnt on dp2T1 */
+	test_pak = dp_test_create_l2_pak(mac_b, mac_a,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	dp_test_pak_receive(test_pak, "dp3T2", exp);
+
+	expected = dp_test_json_create(
+		"{\"name\" : \"br1\",\"mac_table\" : ["
+		"{\"port\" : \"dp3T2\","
+		"\"dynamic\" : true,"
+		"\"mac\" : \"%s\""
+		"}]}", mac_a);
+	dp_test_check_json_state("bridge br1 macs show port dp3T2", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+
+	/* mac_b -> mac_a now follows mac_a to dp3T2 */
+	test_pak = dp_test_create_l2_pak(mac_a, mac_b,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp3T2");
+	dp_test_pak_receive(test_pak, "dp2T1", exp);
+
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+	dp_test_intf_bridge_remove_port("br1", "dp2T1");
+	dp_test_intf_bridge_remove_port("br1", "dp3T2");
+	/* Flush the bridge entries, this is synchronous */
+	dp_test_console_request_reply("bridge br1 macs clear", false);
+	dp_test_intf_bridge_del("br1");
+} DP_END_TEST;
@@ -8,6 +8,9 @@
  * Site-to-Site crypto tests
  */
 
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
 #include "dp_test.h"
 #include "dp_test_lib_internal.h"
 #include "dp_test_netlink_state_internal.h"
@@ -28,6 +31,7 @@
 #include "crypto/crypto.h"
 #include "crypto/crypto_forward.h"
 #include "crypto/crypto_internal.h"
+#include "crypto/crypto_sadb.h"
 
 #include "protobuf/IPAddress.pb-c.h"
 #include "protobuf/CryptoPolicyConfig.pb-c.h"
@@ -1333,7 +1337,43 @@ static void encrypt_aesgcm_main(vrfid_t vrfid)
 	s2s_common_teardown(vrfid, NULL, NULL, VFP_FALSE, VRF_XFRM_IN_ORDER);
 }
 
-static void encrypt_main(vrfid_t vrfid, enum vrf_and_xfrm_order out_of_order)
+/*
+ * Check that the forwarding threads pick PMDs for a parallel SA that it
+ * is registered on, and that between them they use all of them.
+ */
+static void s2s_check_parallel_spread(vrfid_t vrfid)
+{
+	struct dp_test_addr peer;
+	xfrm_address_t dst;
+	struct sadb_sa *sa;
+	uint32_t used = 0;
+	unsigned int lcore;
+	int pmd_dev_id;
+
+	dp_test_addr_str_to_addr(PEER, &peer);
+	memset(&dst, 0, sizeof(dst));
+	dst.a4 = peer.addr.ipv4;
+	sa = sadb_lookup_sa_outbound(vrfid, &dst, AF_INET,
+				     htonl(SPI_OUTBOUND));
+	dp_test_fail_unless(sa, "no outbound SA");
+	dp_test_fail_unless(sa->pcpu && sa->parallel_pmds,
+			    "outbound SA not in parallel mode");
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		pmd_dev_id = crypto_pmd_lcore_select(lcore);
+		dp_test_fail_unless(pmd_dev_id >= 0 &&
+				    (sa->parallel_pmds & (1u << pmd_dev_id)),
+				    "lcore %u picked PMD %d, SA is on 0x%x",
+				    lcore, pmd_dev_id, sa->parallel_pmds);
+		used |= 1u << pmd_dev_id;
+	}
+	dp_test_fail_unless(used == sa->parallel_pmds,
+			    "lcores used PMDs 0x%x, SA is on 0x%x",
+			    used, sa->parallel_pmds);
+}
+
+static void encrypt_main(vrfid_t vrfid, enum vrf_and_xfrm_order out_of_order,
+			 bool parallel)
 {
 	const char expected_payload[] = {
 		0x64, 0xc8, 0x6e, 0x89, 0x53, 0x45, 0x54, 0xd6,
@@ -1365,6 +1405,9 @@ static void encrypt_main(vrfid_t vrfid, enum vrf_and_xfrm_order out_of_order)
 			 NULL, NULL,
 			 XFRM_MODE_TUNNEL, VFP_FALSE, out_of_order);
 
+	if (parallel)
+		s2s_check_parallel_spread(vrfid);
+
 	/*
 	 * Construct the input ICMP ping packet.
 	 */
@@ -2447,17 +2490,40 @@ DP_START_TEST_FULL_RUN(encryption, encrypt_aesgcm_vrf)
 
 DP_START_TEST_FULL_RUN(encryption, encrypt)
 {
-	encrypt_main(VRF_DEFAULT_ID, VRF_XFRM_IN_ORDER);
+	encrypt_main(VRF_DEFAULT_ID, VRF_XFRM_IN_ORDER, false);
 }  DP_END_TEST;
 
 DP_START_TEST_FULL_RUN(encryption, encrypt_vrf)
 {
-	encrypt_main(TEST_VRF, VRF_XFRM_IN_ORDER);
+	encrypt_main(TEST_VRF, VRF_XFRM_IN_ORDER, false);
 }  DP_END_TEST;
 
 DP_START_TEST_FULL_RUN(encryption, encrypt_vrf_out_of_order)
 {
-	encrypt_main(TEST_VRF, VRF_XFRM_OUT_OF_ORDER);
+	encrypt_main(TEST_VRF, VRF_XFRM_OUT_OF_ORDER, false);
+}  DP_END_TEST;
+
+/*
+ * An SA created in parallel mode is registered on all the PMDs, and
+ * the forwarding threads spread its packets across them. The packet
+ * is the same as without parallel mode, including its sequence number.
+ */
+DP_START_TEST_FULL_RUN(encryption, encrypt_parallel)
+{
+	char *reply;
+	bool err;
+
+	reply = dp_test_console_request_w_err("ipsec engine parallel on",
+					      &err, false);
+	dp_test_fail_unless(!err, "cannot enable parallel mode: %s",
+			    reply ? reply : "");
+	free(reply);
+
+	encrypt_main(VRF_DEFAULT_ID, VRF_XFRM_IN_ORDER, true);
+
+	reply = dp_test_console_request_w_err("ipsec engine parallel off",
+					      &err, false);
+	free(reply);
 }  DP_END_TEST;
 
 DP_START_TEST(encryption, encrypt6)
@@ -3295,3 +3361,290 @@ DP_START_TEST_FULL_RUN(decryption46, decrypt46_tunnel_test_vrf)
 	teardown_policies(&input_policy46, &output_policy46);
 	s2s_teardown_interfaces_v4_v6(vrfid, VFP_FALSE);
 }  DP_END_TEST;
+
+/*
+ * The cryptodev backend, with AES-CBC and HMAC-SHA1 carried out by the
+ * AESNI-MB software PMD. Outbound IVs are random with this backend, so
+ * rather than comparing against a fixed payload the packets are
+ * encrypted and checked here with OpenSSL.
+ */
+#define CRYPTODEV_IV_LEN	16
+#define CRYPTODEV_ICV_LEN	12
+#define CRYPTODEV_ESP_HDR_LEN	8
+
+static const unsigned char cryptodev_cipher_key[32] = {
+	0x3a, 0x0b, 0x2e, 0x91, 0x5c, 0x47, 0xd8, 0x16,
+	0x60, 0xf2, 0x8d, 0x39, 0xa4, 0x7e, 0x05, 0xcb,
+	0x12, 0x9f, 0x64, 0xe0, 0x3d, 0xb8, 0x71, 0x2a,
+	0xc6, 0x58, 0x0e, 0x93, 0x4f, 0xd1, 0x87, 0x2c
+};
+
+static const unsigned char cryptodev_auth_key[20] = {
+	0x8e, 0x21, 0x5a, 0xf7, 0x03, 0xbc, 0x69, 0xd4,
+	0x1f, 0x86, 0x3b, 0xe5, 0x70, 0x2d, 0x94, 0xc1,
+	0x58, 0x0a, 0xb3, 0x67
+};
+
+static void cryptodev_hmac(const uint8_t *data, int len, uint8_t *icv)
+{
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+
+	HMAC(EVP_sha1(), cryptodev_auth_key, sizeof(cryptodev_auth_key),
+	     data, len, md, &md_len);
+	memcpy(icv, md, CRYPTODEV_ICV_LEN);
+}
+
+static void cryptodev_cbc(int enc, const uint8_t *iv, const uint8_t *in,
+			  int len, uint8_t *out)
+{
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	int out_len, final_len;
+
+	dp_test_assert_internal(ctx != NULL);
+	EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, cryptodev_cipher_key,
+			  iv, enc);
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	EVP_CipherUpdate(ctx, out, &out_len, in, len);
+	EVP_CipherFinal_ex(ctx, out + out_len, &final_len);
+	EVP_CIPHER_CTX_free(ctx);
+}
+
+static void cryptodev_setup(void)
+{
+	char *reply;
+	bool err;
+
+	reply = dp_test_console_request_w_err("ipsec engine cryptodev on",
+					      &err, false);
+	dp_test_fail_unless(!err, "cannot enable cryptodev: %s",
+			    reply ? reply : "");
+	free(reply);
+
+	/* Only SAs created from now on use the backend */
+	input_sa.cipher_key = cryptodev_cipher_key;
+	input_sa.cipher_key_len = sizeof(cryptodev_cipher_key) * 8;
+	input_sa.auth_trunc_key = cryptodev_auth_key;
+	input_sa.auth_trunc_key_len = sizeof(cryptodev_auth_key) * 8;
+	output_sa.cipher_key = cryptodev_cipher_key;
+	output_sa.cipher_key_len = sizeof(cryptodev_cipher_key) * 8;
+	output_sa.auth_trunc_key = cryptodev_auth_key;
+	output_sa.auth_trunc_key_len = sizeof(cryptodev_auth_key) * 8;
+
+	s2s_common_setup(VRF_DEFAULT_ID, CRYPTO_CIPHER_AES_CBC,
+			 CRYPTO_AUTH_HMAC_SHA1, NULL, NULL,
+			 XFRM_MODE_TUNNEL, VFP_FALSE, VRF_XFRM_IN_ORDER);
+}
+
+static void cryptodev_teardown(void)
+{
+	char *reply;
+	bool err;
+
+	s2s_common_teardown(VRF_DEFAULT_ID, NULL, NULL, VFP_FALSE,
+			    VRF_XFRM_IN_ORDER);
+
+	input_sa.cipher_key = NULL;
+	input_sa.auth_trunc_key = NULL;
+	output_sa.cipher_key = NULL;
+	output_sa.auth_trunc_key = NULL;
+
+	reply = dp_test_console_request_w_err("ipsec engine cryptodev off",
+					      &err, false);
+	free(reply);
+}
+
+/*
+ * Check the ESP packet sent by decrypting it, against the inner packet
+ * given as the context.
+ */
+static void
+cryptodev_encrypt_validate_cb(struct rte_mbuf *mbuf,
+			      struct ifnet *ifp,
+			      struct dp_test_expected *expected,
+			      enum dp_test_fwd_result_e fwd_result)
+{
+	struct rte_mbuf *sent = dp_test_exp_get_validate_ctx(expected);
+	struct iphdr *inner = iphdr(sent), *ip = iphdr(mbuf), *dec;
+	uint8_t icv[CRYPTODEV_ICV_LEN], plain[256];
+	uint32_t spi, seq;
+	int esp_len, text_len, inner_len;
+	uint8_t *esp;
+	bool ok;
+
+	inner_len = ntohs(inner->tot_len);
+	esp = (uint8_t *)ip + ip->ihl * 4;
+	esp_len = ntohs(ip->tot_len) - ip->ihl * 4;
+	text_len = esp_len - CRYPTODEV_ESP_HDR_LEN - CRYPTODEV_IV_LEN -
+		CRYPTODEV_ICV_LEN;
+	memcpy(&spi, esp, sizeof(spi));
+	memcpy(&seq, esp + sizeof(spi), sizeof(seq));
+
+	ok = ip->protocol == IPPROTO_ESP &&
+		ntohl(spi) == SPI_OUTBOUND && ntohl(seq) == 1 &&
+		text_len > inner_len && text_len % 16 == 0 &&
+		text_len <= (int)sizeof(plain);
+
+	if (ok) {
+		cryptodev_hmac(esp, esp_len - CRYPTODEV_ICV_LEN, icv);
+		ok = memcmp(icv, esp + esp_len - CRYPTODEV_ICV_LEN,
+			    CRYPTODEV_ICV_LEN) == 0;
+	}
+
+	if (ok) {
+		cryptodev_cbc(0, esp + CRYPTODEV_ESP_HDR_LEN,
+			      esp + CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN,
+			      text_len, plain);
+		dec = (struct iphdr *)plain;
+
+		/* Padding length and next header end the text */
+		ok = plain[text_len - 1] == IPPROTO_IPIP &&
+			text_len - 2 - plain[text_len - 2] == inner_len &&
+			ntohs(dec->tot_len) == inner_len &&
+			dec->saddr == inner->saddr &&
+			dec->daddr == inner->daddr &&
+			dec->protocol == inner->protocol &&
+			memcmp(plain + dec->ihl * 4,
+			       (uint8_t *)inner + inner->ihl * 4,
+			       inner_len - inner->ihl * 4) == 0;
+	}
+
+	dp_test_exp_validate_cb_pak_done(expected, ok);
+}
+
+DP_DECL_TEST_CASE(site_to_site_suite, cryptodev, NULL, NULL);
+
+DP_START_TEST(cryptodev, encrypt)
+{
+	struct rte_mbuf *ping_pkt, *inner;
+	struct dp_test_expected *exp;
+
+	cryptodev_setup();
+
+	ping_pkt = build_input_packet(CLIENT_LOCAL, CLIENT_REMOTE);
+	(void)dp_test_pktmbuf_eth_init(ping_pkt,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       NULL, RTE_ETHER_TYPE_IPV4);
+
+	inner = build_input_packet(CLIENT_LOCAL, CLIENT_REMOTE);
+	exp = dp_test_exp_create(ping_pkt);
+	dp_test_exp_set_oif_name(exp, "dp2T2");
+	dp_test_exp_set_validate_ctx(exp, inner, false);
+	dp_test_exp_set_validate_cb(exp, cryptodev_encrypt_validate_cb);
+
+	dp_test_pak_receive(ping_pkt, "dp1T1", exp);
+	dp_test_crypto_check_sad_packets(VRF_DEFAULT_ID, 1, 84);
+
+	rte_pktmbuf_free(inner);
+	cryptodev_teardown();
+} DP_END_TEST;
+
+/*
+ * Build an ESP packet from the peer holding the ping from the remote
+ * client, with the ICV corrupted if requested.
+ */
+static struct rte_mbuf *
+cryptodev_build_esp(struct rte_mbuf *inner, bool bad_icv)
+{
+	static const uint8_t iv[CRYPTODEV_IV_LEN] = {
+		0x10, 0x21, 0x32, 0x43, 0x54, 0x65, 0x76, 0x87,
+		0x98, 0xa9, 0xba, 0xcb, 0xdc, 0xed, 0xfe, 0x0f
+	};
+	uint8_t plain[256], esp[CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN +
+			       sizeof(plain) + CRYPTODEV_ICV_LEN];
+	int inner_len, text_len, payload_len, i;
+	struct rte_mbuf *m;
+	uint32_t val;
+	uint8_t pad;
+
+	inner_len = ntohs(iphdr(inner)->tot_len);
+	text_len = RTE_ALIGN_CEIL(inner_len + 2, 16);
+	dp_test_assert_internal(text_len <= (int)sizeof(plain));
+
+	memcpy(plain, iphdr(inner), inner_len);
+	pad = text_len - inner_len - 2;
+	for (i = 0; i < pad; i++)
+		plain[inner_len + i] = i + 1;
+	plain[text_len - 2] = pad;
+	plain[text_len - 1] = IPPROTO_IPIP;
+
+	val = htonl(SPI_INBOUND);
+	memcpy(esp, &val, sizeof(val));
+	val = htonl(1);
+	memcpy(esp + 4, &val, sizeof(val));
+	memcpy(esp + CRYPTODEV_ESP_HDR_LEN, iv, sizeof(iv));
+	cryptodev_cbc(1, iv, plain, text_len,
+		      esp + CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN);
+	cryptodev_hmac(esp, CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN +
+		       text_len,
+		       esp + CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN +
+		       text_len);
+	if (bad_icv)
+		esp[CRYPTODEV_ESP_HDR_LEN + CRYPTODEV_IV_LEN + text_len] ^= 1;
+
+	/* The payload follows the ESP header */
+	payload_len = CRYPTODEV_IV_LEN + text_len + CRYPTODEV_ICV_LEN;
+	m = dp_test_create_esp_ipv4_pak(PEER, PORT_EAST, 1, &payload_len,
+					(char *)esp + CRYPTODEV_ESP_HDR_LEN,
+					SPI_INBOUND, 1 /* seq no */,
+					0 /* ip ID */, 255 /* ttl */,
+					NULL /* udp/esp */,
+					NULL /* transport_hdr*/);
+	dp_test_assert_internal(m != NULL);
+	dp_test_set_pak_ip_field(iphdr(m), DP_TEST_SET_DF, 1);
+	(void)dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str("dp2T2"),
+				       PEER_MAC_ADDR, RTE_ETHER_TYPE_IPV4);
+	return m;
+}
+
+DP_START_TEST(cryptodev, decrypt)
+{
+	struct rte_mbuf *encrypted_pkt, *expected_pkt;
+	struct dp_test_expected *exp;
+
+	cryptodev_setup();
+
+	expected_pkt = build_input_packet(CLIENT_REMOTE, CLIENT_LOCAL);
+	encrypted_pkt = cryptodev_build_esp(expected_pkt, false);
+
+	dp_test_set_pak_ip_field(iphdr(expected_pkt), DP_TEST_SET_TTL, 0x3f);
+	dp_test_pktmbuf_eth_init(expected_pkt, CLIENT_LOCAL_MAC_ADDR,
+				 dp_test_intf_name2mac_str("dp1T1"),
+				 RTE_ETHER_TYPE_IPV4);
+	exp = dp_test_exp_create(expected_pkt);
+	rte_pktmbuf_free(expected_pkt);
+	dp_test_exp_set_oif_name(exp, "dp1T1");
+
+	dp_test_pak_receive(encrypted_pkt, "dp2T2", exp);
+	dp_test_crypto_check_sad_packets(VRF_DEFAULT_ID, 1, 84);
+
+	cryptodev_teardown();
+} DP_END_TEST;
+
+/*
+ * An op that fails, here by failing to authenticate, drops the packet.
+ */
+DP_START_TEST(cryptodev, decrypt_bad_icv)
+{
+	struct rte_mbuf *encrypted_pkt, *inner;
+	struct if_data start_stats, stats;
+	struct dp_test_expected *exp;
+
+	cryptodev_setup();
+
+	inner = build_input_packet(CLIENT_REMOTE, CLIENT_LOCAL);
+	encrypted_pkt = cryptodev_build_esp(inner, true);
+	rte_pktmbuf_free(inner);
+
+	exp = dp_test_exp_create(encrypted_pkt);
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+
+	dp_test_intf_initial_stats_for_if("dp1T1", &start_stats);
+	dp_test_pak_receive(encrypted_pkt, "dp2T2", exp);
+	dp_test_intf_delta_stats_for_if("dp1T1", &start_stats, &stats);
+	dp_test_assert_internal(stats.ifi_opackets == 0);
+
+	dp_test_crypto_check_sad_packets(VRF_DEFAULT_ID, 0, 0);
+
+	cryptodev_teardown();
+} DP_END_TEST;
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Tests of the IPsec policy selector classifier
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip6.h>
+#include <string.h>
+
+#include "crypto/crypto_spd.h"
+
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+DP_DECL_TEST_SUITE(crypto_spd_suite);
+
+/* Data for each test policy, the rule index being the array index */
+static int spd_data[64];
+
+static void
+spd_test_sel(struct xfrm_selector *sel, uint8_t family,
+	     const char *dst, uint8_t dlen, const char *src, uint8_t slen,
+	     uint8_t proto, uint16_t sport, uint16_t dport)
+{
+	memset(sel, 0, sizeof(*sel));
+	sel->family = family;
+	dp_test_fail_unless(inet_pton(family, dst, &sel->daddr) == 1,
+			    "bad address %s", dst);
+	dp_test_fail_unless(inet_pton(family, src, &sel->saddr) == 1,
+			    "bad address %s", src);
+	sel->prefixlen_d = dlen;
+	sel->prefixlen_s = slen;
+	sel->proto = proto;
+	sel->sport = htons(sport);
+	sel->dport = htons(dport);
+}
+
+static void
+_spd_test_insert(struct crypto_spd *spd, uint8_t family,
+		 const char *dst, uint8_t dlen, const char *src, uint8_t slen,
+		 uint8_t proto, uint16_t sport, uint16_t dport,
+		 uint32_t rule, const char *file, int line)
+{
+	struct xfrm_selector sel;
+	int rc;
+
+	spd_test_sel(&sel, family, dst, dlen, src, slen, proto, sport, dport);
+	rc = crypto_spd_insert(spd, &sel, rule, &spd_data[rule]);
+	if (rc < 0)
+		_dp_test_fail(file, line, "failed to insert rule %u: %d",
+			      rule, rc);
+}
+#define spd_test_insert(_spd, _af, _d, _dl, _s, _sl, _p, _sp, _dp, _r) \
+	_spd_test_insert(_spd, _af, _d, _dl, _s, _sl, _p, _sp, _dp, _r,	\
+			 __FILE__, __LINE__)
+
+static int
+spd_test_remove(struct crypto_spd *spd, uint8_t family,
+		const char *dst, uint8_t dlen, const char *src, uint8_t slen,
+		uint8_t proto, uint16_t sport, uint16_t dport, uint32_t rule)
+{
+	struct xfrm_selector sel;
+
+	spd_test_sel(&sel, family, dst, dlen, src, slen, proto, sport, dport);
+	return crypto_spd_remove(spd, &sel, rule, &spd_data[rule]);
+}
+
+/*
+ * Look up a packet, and check it matches the given rule, or nothing if
+ * the rule is negative.
+ */
+static void
+_spd_test_lookup(struct crypto_spd *spd, uint8_t family,
+		 const char *dst, const char *src,
+		 uint8_t proto, uint16_t sport, uint16_t dport,
+		 int exp_rule, const char *file, int line)
+{
+	struct crypto_spd_key key;
+	int *data;
+
+	memset(&key, 0, sizeof(key));
+	key.family = family;
+	inet_pton(family, dst, &key.daddr);
+	inet_pton(family, src, &key.saddr);
+	key.proto = proto;
+	key.sport = htons(sport);
+	key.dport = htons(dport);
+
+	data = crypto_spd_lookup(spd, &key);
+	if (exp_rule < 0 && data)
+		_dp_test_fail(file, line, "%s -> %s matched rule %td",
+			      src, dst, data - spd_data);
+	if (exp_rule >= 0 && data != &spd_data[exp_rule])
+		_dp_test_fail(file, line, "%s -> %s matched %s%td, not %d",
+			      src, dst, data ? "rule " : "none",
+			      data ? data - spd_data : 0, exp_rule);
+}
+#define spd_test_lookup(_spd, _af, _d, _s, _p, _sp, _dp, _r)		\
+	_spd_test_lookup(_spd, _af, _d, _s, _p, _sp, _dp, _r,		\
+			 __FILE__, __LINE__)
+
+DP_DECL_TEST_CASE(crypto_spd_suite, crypto_spd, NULL, NULL);
+
+/*
+ * Overlapping destination prefixes, including ones that do not end on a
+ * trie stride, with the lowest rule index winning whatever the prefix
+ * length.
+ */
+DP_START_TEST(crypto_spd, prefix_overlap)
+{
+	struct crypto_spd *spd = crypto_spd_create();
+
+	dp_test_fail_unless(spd, "failed to create classifier");
+
+	spd_test_insert(spd, AF_INET, "0.0.0.0", 0, "0.0.0.0", 0, 0, 0, 0, 40);
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0, 0, 0, 0, 30);
+	spd_test_insert(spd, AF_INET, "10.1.0.0", 16, "0.0.0.0", 0,
+			0, 0, 0, 20);
+	spd_test_insert(spd, AF_INET, "10.1.2.0", 23, "0.0.0.0", 0,
+			0, 0, 0, 10);
+	spd_test_insert(spd, AF_INET, "10.1.2.128", 30, "0.0.0.0", 0,
+			0, 0, 0, 15);
+	dp_test_fail_unless(crypto_spd_count(spd) == 5, "count %u",
+			    crypto_spd_count(spd));
+
+	spd_test_lookup(spd, AF_INET, "10.1.3.1", "1.1.1.1", 17, 1, 1, 10);
+	spd_test_lookup(spd, AF_INET, "10.1.2.129", "1.1.1.1", 17, 1, 1, 10);
+	spd_test_lookup(spd, AF_INET, "10.1.4.1", "1.1.1.1", 17, 1, 1, 20);
+	spd_test_lookup(spd, AF_INET, "10.2.0.1", "1.1.1.1", 17, 1, 1, 30);
+	spd_test_lookup(spd, AF_INET, "11.0.0.1", "1.1.1.1", 17, 1, 1, 40);
+
+	/* A lower index on a shorter prefix wins over longer ones */
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0, 0, 0, 0, 5);
+	spd_test_lookup(spd, AF_INET, "10.1.3.1", "1.1.1.1", 17, 1, 1, 5);
+	spd_test_lookup(spd, AF_INET, "11.0.0.1", "1.1.1.1", 17, 1, 1, 40);
+
+	/* The source prefix must match too */
+	spd_test_insert(spd, AF_INET, "20.0.0.0", 8, "1.1.0.0", 16,
+			0, 0, 0, 1);
+	spd_test_lookup(spd, AF_INET, "20.1.1.1", "1.1.9.9", 17, 1, 1, 1);
+	spd_test_lookup(spd, AF_INET, "20.1.1.1", "1.2.9.9", 17, 1, 1, 40);
+
+	/* IPv4 and IPv6 policies are kept apart */
+	spd_test_lookup(spd, AF_INET6, "::", "::", 17, 1, 1, -1);
+	spd_test_insert(spd, AF_INET6, "2001:db8::", 32, "::", 0, 0, 0, 0, 7);
+	spd_test_insert(spd, AF_INET6, "2001:db8:2::", 47, "::", 0,
+			0, 0, 0, 3);
+	spd_test_insert(spd, AF_INET6, "2001:db8:3::10", 127, "::", 0,
+			0, 0, 0, 2);
+	spd_test_lookup(spd, AF_INET6, "2001:db8:3::11", "2001::1",
+			17, 1, 1, 2);
+	spd_test_lookup(spd, AF_INET6, "2001:db8:3::12", "2001::1",
+			17, 1, 1, 3);
+	spd_test_lookup(spd, AF_INET6, "2001:db8:0:1::1", "2001::1",
+			17, 1, 1, 7);
+	spd_test_lookup(spd, AF_INET6, "2001:db9::1", "2001::1",
+			17, 1, 1, -1);
+	spd_test_lookup(spd, AF_INET, "10.1.3.1", "1.1.1.1", 17, 1, 1, 5);
+
+	crypto_spd_destroy(spd);
+} DP_END_TEST;
+
+/*
+ * Protocols and ports select exactly, or anything when zero.
+ */
+DP_START_TEST(crypto_spd, proto_and_ports)
+{
+	struct crypto_spd *spd = crypto_spd_create();
+
+	dp_test_fail_unless(spd, "failed to create classifier");
+
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0,
+			IPPROTO_UDP, 0, 53, 10);
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0,
+			IPPROTO_TCP, 1024, 0, 20);
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0,
+			IPPROTO_UDP, 0, 0, 30);
+	spd_test_insert(spd, AF_INET, "10.1.0.0", 16, "0.0.0.0", 0,
+			0, 0, 0, 40);
+
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_UDP, 5000, 53, 10);
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_UDP, 5000, 54, 30);
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_TCP, 1024, 53, 20);
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_TCP, 1025, 53, 40);
+	spd_test_lookup(spd, AF_INET, "10.2.1.1", "1.1.1.1",
+			IPPROTO_TCP, 1025, 53, -1);
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_ICMP, 8, 0, 40);
+
+	/* A later fragment has no ports, so only matches port wildcards */
+	spd_test_lookup(spd, AF_INET, "10.1.1.1", "1.1.1.1",
+			IPPROTO_UDP, 0, 0, 30);
+
+	crypto_spd_destroy(spd);
+} DP_END_TEST;
+
+/*
+ * Removing policies, including ones sharing a node, and
+ * pruning the trie.
+ */
+DP_START_TEST(crypto_spd, remove)
+{
+	struct crypto_spd *spd = crypto_spd_create();
+	struct xfrm_selector sel;
+
+	dp_test_fail_unless(spd, "failed to create classifier");
+
+	spd_test_insert(spd, AF_INET, "10.1.2.0", 24, "0.0.0.0", 0,
+			0, 0, 0, 10);
+	spd_test_insert(spd, AF_INET, "10.1.2.0", 24, "0.0.0.0", 0,
+			IPPROTO_UDP, 0, 0, 20);
+	spd_test_insert(spd, AF_INET, "10.0.0.0", 8, "0.0.0.0", 0,
+			0, 0, 0, 30);
+
+	/* Wrong rule index, data or prefix */
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.1.2.0", 24,
+					    "0.0.0.0", 0, 0, 0, 0, 11) ==
+			    -ENOENT, "removed a missing rule");
+	spd_test_sel(&sel, AF_INET, "10.1.2.0", 24, "0.0.0.0", 0, 0, 0, 0);
+	dp_test_fail_unless(crypto_spd_remove(spd, &sel, 10,
+					      &spd_data[11]) == -ENOENT,
+			    "removed a rule with other data");
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.1.3.0", 24,
+					    "0.0.0.0", 0, 0, 0, 0, 10) ==
+			    -ENOENT, "removed a rule with another prefix");
+	dp_test_fail_unless(crypto_spd_count(spd) == 3, "count %u",
+			    crypto_spd_count(spd));
+
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_UDP, 1, 1, 10);
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.1.2.0", 24,
+					    "0.0.0.0", 0, 0, 0, 0, 10) == 0,
+			    "failed to remove rule 10");
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_UDP, 1, 1, 20);
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_TCP, 1, 1, 30);
+
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.1.2.0", 24,
+					    "0.0.0.0", 0, IPPROTO_UDP, 0, 0,
+					    20) == 0,
+			    "failed to remove rule 20");
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_UDP, 1, 1, 30);
+
+	/* The pruned path can be added back */
+	spd_test_insert(spd, AF_INET, "10.1.2.0", 24, "0.0.0.0", 0,
+			0, 0, 0, 20);
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_UDP, 1, 1, 20);
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.1.2.0", 24,
+					    "0.0.0.0", 0, 0, 0, 0, 20) == 0,
+			    "failed to remove rule 20");
+
+	dp_test_fail_unless(spd_test_remove(spd, AF_INET, "10.0.0.0", 8,
+					    "0.0.0.0", 0, 0, 0, 0, 30) == 0,
+			    "failed to remove rule 30");
+	spd_test_lookup(spd, AF_INET, "10.1.2.1", "1.1.1.1",
+			IPPROTO_UDP, 1, 1, -1);
+	dp_test_fail_unless(crypto_spd_count(spd) == 0, "count %u",
+			    crypto_spd_count(spd));
+
+	crypto_spd_destroy(spd);
+} DP_END_TEST;
+
+/*
+ * A later IPv6 fragment is classified on the protocol in its fragment
+ * header, without ports.
+ */
+DP_START_TEST(crypto_spd, ipv6_fragment_key)
+{
+	uint16_t frag_sizes[2] = { 56, 52 };
+	struct rte_mbuf *pkt, *frags[2] = { NULL };
+	struct crypto_spd_key key;
+	int len = 100;
+	int rc;
+
+	pkt = dp_test_create_udp_ipv6_pak("2001:1::1", "2001:2::1",
+					  4000, 5000, 1, &len);
+	dp_test_fail_unless(pkt, "failed to create packet");
+
+	rc = dp_test_ipv6_fragment_packet(pkt, frags, ARRAY_SIZE(frags),
+					  frag_sizes, 0);
+	dp_test_fail_unless(rc == ARRAY_SIZE(frags),
+			    "dp_test_ipv6_fragment_packet failed: %d", rc);
+	rte_pktmbuf_free(pkt);
+
+	dp_test_fail_unless(crypto_spd_key_from_pkt(frags[0], false, &key),
+			    "no key from first fragment");
+	dp_test_fail_unless(key.proto == IPPROTO_UDP &&
+			    key.sport == htons(4000) &&
+			    key.dport == htons(5000),
+			    "first fragment proto %u ports %u %u", key.proto,
+			    ntohs(key.sport), ntohs(key.dport));
+
+	dp_test_fail_unless(crypto_spd_key_from_pkt(frags[1], false, &key),
+			    "no key from second fragment");
+	dp_test_fail_unless(key.proto == IPPROTO_UDP &&
+			    key.sport == 0 && key.dport == 0,
+			    "second fragment proto %u ports %u %u", key.proto,
+			    ntohs(key.sport), ntohs(key.dport));
+
+	rte_pktmbuf_free(frags[0]);
+	rte_pktmbuf_free(frags[1]);
+} DP_END_TEST;
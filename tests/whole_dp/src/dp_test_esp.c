@@ -10,6 +10,8 @@
  *
  */
 
+#include <pthread.h>
+
 #include "dp_test.h"
 #include "dp_test_lib_internal.h"
 
@@ -23,6 +25,15 @@ struct esp_header {
 
 DP_DECL_TEST_SUITE(esp_replay_suite);
 
+static void esp_test_sa_init(struct sadb_sa *sa, uint16_t window,
+			     uint64_t seq)
+{
+	memset(sa, 0, sizeof(*sa));
+	rte_rwlock_init(&sa->replay_lock);
+	sa->replay_window = window;
+	sa->seq = seq;
+}
+
 DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_check, NULL, NULL);
 
 /*
@@ -32,76 +43,76 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_check, NULL, NULL);
 DP_START_TEST(sequence_number_check, sequence_number_check)
 {
 	struct sadb_sa sa;
-	struct esp_header hdr;
+	uint64_t seq;
 	unsigned int i;
 
-	sa.replay_window = 0;
-	sa.replay_bitmap = 0;
-	sa.seq = 0;
-	sa.spi = 0;
-	hdr.spi = 0;
-	hdr.seq = 1;
+	esp_test_sa_init(&sa, 0, 0);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+	dp_test_fail_unless((esp_replay_check(1, &sa) == 0),
 			    "check defaults if no replay window is set");
 
-	hdr.seq = 0;
 	sa.replay_window = 32;
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -1),
+	dp_test_fail_unless((esp_replay_check(0, &sa) == -1),
 			    "check should fail if sequence number is zero");
 
 	sa.seq = 10;
-	hdr.seq = htonl(11);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+	dp_test_fail_unless((esp_replay_check(11, &sa) == 0),
 			    "check should pass if sequence number "
 			    "is to the right of the window");
 
 	sa.seq = 43;
-	hdr.seq = htonl(sa.seq - (sa.replay_window + 1));
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -2),
+	dp_test_fail_unless((esp_replay_check(sa.seq - (sa.replay_window + 1),
+					      &sa) == -2),
 			    "check should fail if sequence number "
 			    "is to the left of the window");
-	sa.seq = 43;
-	hdr.seq = htonl(sa.seq - (sa.replay_window));
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -2),
+	dp_test_fail_unless((esp_replay_check(sa.seq - sa.replay_window,
+					      &sa) == -2),
 			    "check should fail if sequence number "
 			    "is to the left of the window");
 
-	sa.replay_bitmap = 0;
-	sa.seq = 128;
-	hdr.seq = htonl(sa.seq - 31);
+	esp_test_sa_init(&sa, 32, 128);
 
-	for (i = 0; i < 32; i++) {
-		dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr,
-						      &sa) == 0),
-				    "check should pass if sequence number (%d) "
-				    "is new and within window", ntohl(hdr.seq));
-		hdr.seq = htonl(ntohl(hdr.seq) + 1);
-	}
+	for (seq = sa.seq - 31; seq <= sa.seq; seq++)
+		dp_test_fail_unless((esp_replay_check(seq, &sa) == 0),
+				    "check should pass if sequence number "
+				    "(%lu) is new and within window", seq);
 
-	sa.replay_bitmap = 5;
-	hdr.seq = htonl(1);
-	sa.seq = 3;
+	esp_test_sa_init(&sa, 32, 0);
+	esp_replay_advance(1, &sa);
+	esp_replay_advance(3, &sa);
 
-	dp_test_fail_unless(esp_replay_check((uint8_t *) &hdr, &sa) == -3,
-			    "check should fail if sequence number (%d) "
-			    "is _not_ new and within window", i);
+	dp_test_fail_unless(esp_replay_check(1, &sa) == -3,
+			    "check should fail if sequence number (1) "
+			    "is _not_ new and within window");
 
-	hdr.seq = htonl(2);
+	dp_test_fail_unless((esp_replay_check(2, &sa) == 0),
+			    "check should pass if sequence number (2) "
+			    "is new and within window");
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
-			    "check should pass if sequence number (%d) "
-			    "is new and within window", i);
+	dp_test_fail_unless((esp_replay_check(3, &sa) == -3),
+			    "check should fail if sequence number (3) "
+			    "Is _not_ new and within window");
 
-	hdr.seq = htonl(3);
+	/* A window wider than a single word */
+	esp_test_sa_init(&sa, 1024, 0);
+	for (i = 1; i <= 2000; i += 2)
+		esp_replay_advance(i, &sa);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -3),
-			    "check should fail if sequence number (%d) "
-			    "Is _not_ new and within window", i);
+	dp_test_fail_unless((esp_replay_check(1000, &sa) == 0),
+			    "check should pass if sequence number (1000) "
+			    "is new and within a wide window");
+
+	dp_test_fail_unless((esp_replay_check(1001, &sa) == -3),
+			    "check should fail if sequence number (1001) "
+			    "is _not_ new and within a wide window");
+
+	dp_test_fail_unless((esp_replay_check(975, &sa) == -2),
+			    "check should fail if sequence number (975) "
+			    "is to the left of a wide window");
 } DP_END_TEST;
 
 DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
@@ -113,46 +124,178 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
 DP_START_TEST(sequence_number_advance, sequence_number_advance)
 {
 	struct sadb_sa sa;
-	struct esp_header hdr;
+	uint64_t seq;
 
-	sa.replay_window = 3;
-	sa.replay_bitmap = 0;
-	sa.seq = 0;
-	hdr.spi = 0;
-	hdr.seq = htonl(1);
+	esp_test_sa_init(&sa, 3, 0);
 
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(1, &sa);
 	dp_test_fail_unless((sa.seq == 1),
 			    "sequence number failed to advance to 1");
-	dp_test_fail_unless((sa.replay_bitmap == 1), "bitmap should be 1");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 1),
+			    "bitmap should be 1");
 
-	hdr.seq = htonl(2);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(2, &sa);
 	dp_test_fail_unless((sa.seq == 2),
 			    "sequence number failed to advance to 2");
-	dp_test_fail_unless((sa.replay_bitmap == 3), "bitmap should be 3");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 3),
+			    "bitmap should be 3");
 
-	hdr.seq = htonl(4);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(4, &sa);
 	dp_test_fail_unless((sa.seq == 4),
 			    "sequence number failed to advance to 4");
-	dp_test_fail_unless((sa.replay_bitmap == 13), "bitmap should be 13");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 13),
+			    "bitmap should be 13");
 
-	hdr.seq = htonl(3);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(3, &sa);
 	dp_test_fail_unless((sa.seq == 4),
 			    "sequence number should still be 4");
-	dp_test_fail_unless((sa.replay_bitmap == 15), "bitmap should be 15");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 15),
+			    "bitmap should be 15");
 
-	hdr.seq = htonl(5);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(5, &sa);
 	dp_test_fail_unless((sa.seq == 5),
 			    "sequence number failed to advance to 5");
-	dp_test_fail_unless((sa.replay_bitmap == 31), "bitmap should be 31");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 31),
+			    "bitmap should be 31");
 
-	hdr.seq = htonl(7);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	esp_replay_advance(7, &sa);
 	dp_test_fail_unless((sa.seq == 7),
 			    "sequence number failed to advance to 7");
-	dp_test_fail_unless((sa.replay_bitmap == 125), "bitmap should be 125");
+	dp_test_fail_unless((esp_replay_recent(&sa) == 125),
+			    "bitmap should be 125");
+
+	dp_test_fail_unless((esp_replay_advance(7, &sa) == -3),
+			    "advance should fail for a replayed packet");
+
+	/*
+	 * Moving the window further than the size of the bitmap
+	 * must forget everything recorded before.
+	 */
+	esp_test_sa_init(&sa, ESP_REPLAY_WINDOW_MAX, 0);
+	for (seq = 1; seq <= 64; seq++)
+		esp_replay_advance(seq, &sa);
+	seq = 64 + 64 * ESP_REPLAY_BITMAP_WORDS * 2;
+	esp_replay_advance(seq, &sa);
+	dp_test_fail_unless((esp_replay_recent(&sa) == 1),
+			    "bitmap should be 1 after a large jump");
+	dp_test_fail_unless((esp_replay_check(seq - 64, &sa) == 0),
+			    "check should pass for a new sequence number "
+			    "after a large jump");
+} DP_END_TEST;
+
+#define ESP_TEST_THREADS	4
+#define ESP_TEST_SEQ_MAX	200000
+
+struct esp_test_thread {
+	struct sadb_sa	*sa;
+	unsigned int	first;
+	unsigned int	replays;
+	pthread_t	thread;
+};
+
+/* Record every ESP_TEST_THREADS'th sequence number, from first */
+static void *esp_test_advance_thread(void *arg)
+{
+	struct esp_test_thread *t = arg;
+	uint64_t seq;
+
+	for (seq = t->first; seq <= ESP_TEST_SEQ_MAX;
+	     seq += ESP_TEST_THREADS)
+		if (esp_replay_advance(seq, t->sa) == -3)
+			t->replays++;
+
+	return NULL;
+}
+
+/*
+ * Several lcores record the sequence numbers of a parallel SA at once,
+ * each a different set.  None has been seen before, so none may be found
+ * to be a replay, however the window moves while they are recorded.
+ * Those left behind by the window are refused as too old.
+ */
+DP_START_TEST(sequence_number_advance, parallel)
+{
+	struct esp_test_thread threads[ESP_TEST_THREADS];
+	struct sadb_sa_pcpu pcpu[1];
+	struct sadb_sa sa;
+	unsigned int i;
+	int rc;
+
+	esp_test_sa_init(&sa, 64, 0);
+	sa.pcpu = pcpu;
+
+	for (i = 0; i < ESP_TEST_THREADS; i++) {
+		threads[i].sa = &sa;
+		threads[i].first = i + 1;
+		threads[i].replays = 0;
+		rc = pthread_create(&threads[i].thread, NULL,
+				    esp_test_advance_thread, &threads[i]);
+		dp_test_fail_unless(rc == 0, "failed to create thread: %d",
+				    rc);
+	}
+
+	for (i = 0; i < ESP_TEST_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+		dp_test_fail_unless(threads[i].replays == 0,
+				    "thread %u: %u new sequence numbers found "
+				    "to be replays", i, threads[i].replays);
+	}
+
+	dp_test_fail_unless(sa.seq == ESP_TEST_SEQ_MAX,
+			    "sequence number %lu, expected %u", sa.seq,
+			    ESP_TEST_SEQ_MAX);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_esn, NULL, NULL);
+
+/*
+ * Are the high order bits of an extended sequence number inferred
+ * as per RFC 4303 Appendix A2?
+ */
+DP_START_TEST(sequence_number_esn, sequence_number_esn)
+{
+	struct sadb_sa sa;
+	struct esp_header hdr;
+
+	hdr.spi = 0;
+
+	/* Window within one subspace */
+	esp_test_sa_init(&sa, 64, 0x100001000ul);
+	sa.flags = XFRM_STATE_ESN;
+
+	hdr.seq = htonl(0x2000);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) ==
+			     0x100002000ul),
+			    "seq ahead of the window should keep high bits");
+
+	hdr.seq = htonl(0xff0);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) ==
+			     0x100000ff0ul),
+			    "seq within the window should keep high bits");
+
+	hdr.seq = htonl(0x10);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) ==
+			     0x200000010ul),
+			    "seq behind the window should move to the "
+			    "next subspace");
+
+	/* Window spans two subspaces */
+	esp_test_sa_init(&sa, 64, 0x10000000aul);
+	sa.flags = XFRM_STATE_ESN;
+
+	hdr.seq = htonl(0xfffffff0);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) ==
+			     0xfffffff0ul),
+			    "seq in the previous subspace should use it");
+
+	hdr.seq = htonl(5);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) ==
+			     0x100000005ul),
+			    "seq in the current subspace should use it");
+
+	/* Without ESN the sequence number is taken as is */
+	sa.flags = 0;
+	hdr.seq = htonl(5);
+	dp_test_fail_unless((esp_replay_seq((uint8_t *) &hdr, &sa) == 5),
+			    "seq without ESN should be the low 32 bits");
 } DP_END_TEST;
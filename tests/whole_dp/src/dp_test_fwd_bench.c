@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * IPv4 forwarding benchmarks.
+ *
+ * Synthetic traffic is sent through the ring PMD of dp1T0 and taken from
+ * the ring PMD of dp2T1, so it is processed by the forwarding lcores and
+ * the full pipeline exactly as traffic from a NIC would be.  Like the route
+ * benchmarks these are only built into the test binary when configured
+ * with --enable-whole_dp_bench.  Run them with:
+ *
+ *   make dataplane_test_run CK_RUN_SUITE=dp_test_fwd_bench.c
+ *
+ * The traffic is an IMIX of 40, 576 and 1500 byte packets in the ratio
+ * 7:4:1, spread over DP_TEST_BENCH_FLOWS flows, DP_TEST_BENCH_PKTS packets
+ * in total.  Each profile prints one line of JSON with the rate, latency
+ * percentiles and, if built with --enable-perf_profile, the forwarding
+ * cycles per packet and per pipeline node.  The JSON is also appended to
+ * the file named by DP_TEST_BENCH_OUTPUT, if set, for trend tracking.
+ */
+
+#include <inttypes.h>
+#include <json-c/json.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+
+#include "pktmbuf.h"
+#include "util.h"
+
+#include "dp_test.h"
+#include "dp_test_console.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_npf_lib.h"
+#include "dp_test_npf_nat_lib.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+#define FWD_BENCH_FLOWS_DEF	1024
+#define FWD_BENCH_PKTS_DEF	2000000
+#define FWD_BENCH_ACL_RULES	32
+#define FWD_BENCH_BURST		32
+
+/*
+ * Number of packets in circulation.  This is less than the size of the
+ * ring PMD rings, so an enqueue never fails and no packet is lost other
+ * than by the dataplane dropping it.
+ */
+#define FWD_BENCH_POOL		448
+
+/* Give up if nothing is forwarded for this many seconds */
+#define FWD_BENCH_STALL_SECS	1
+
+#define FWD_BENCH_HDR_LEN	(sizeof(struct rte_ether_hdr) + \
+				 sizeof(struct iphdr) + sizeof(struct udphdr))
+
+/* IMIX IP packet lengths and their weights */
+static const struct {
+	int ip_len;
+	unsigned int weight;
+} fwd_bench_imix[] = {
+	{ 40, 7 }, { 576, 4 }, { 1500, 1 },
+};
+
+#define FWD_BENCH_SIZES		ARRAY_SIZE(fwd_bench_imix)
+
+/* Written to the start of the UDP payload of each packet sent */
+struct fwd_bench_stamp {
+	uint64_t tsc;
+	uint32_t size;
+};
+
+struct fwd_bench {
+	unsigned int flows;
+	unsigned int pkts;
+	uint8_t port;
+	/* Headers for each size of packet for each flow */
+	uint8_t (*hdrs)[FWD_BENCH_SIZES][FWD_BENCH_HDR_LEN];
+	struct rte_mbuf *free[FWD_BENCH_POOL];
+	unsigned int nfree;
+	unsigned int next_flow;
+	uint64_t *lat;
+};
+
+struct fwd_bench_result {
+	uint64_t sent;
+	uint64_t rcvd;
+	double secs;
+};
+
+static unsigned int fwd_bench_count(const char *env, unsigned int def)
+{
+	const char *val = getenv(env);
+	unsigned long count;
+
+	if (!val)
+		return def;
+
+	count = strtoul(val, NULL, 10);
+	return count ? count : def;
+}
+
+static void fwd_bench_flow_addrs(unsigned int flow, char *saddr,
+				 char *daddr, size_t len)
+{
+	snprintf(saddr, len, "100.64.%u.%u", (flow >> 8) & 0xff, flow & 0xff);
+	snprintf(daddr, len, "10.73.%u.%u", (flow >> 8) & 0xff, flow & 0xff);
+}
+
+static struct rte_mbuf *fwd_bench_pak(unsigned int flow, unsigned int size)
+{
+	char saddr[INET_ADDRSTRLEN], daddr[INET_ADDRSTRLEN];
+	int len = fwd_bench_imix[size].ip_len - sizeof(struct iphdr) -
+		sizeof(struct udphdr);
+	struct rte_mbuf *m;
+	struct udphdr *udp;
+
+	fwd_bench_flow_addrs(flow, saddr, daddr, sizeof(saddr));
+	m = dp_test_create_udp_ipv4_pak(saddr, daddr, 1024 + (flow & 0x7fff),
+					53, 1, &len);
+	dp_test_fail_unless(m, "failed to create packet");
+	(void)dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str("dp1T0"),
+				       NULL, RTE_ETHER_TYPE_IPV4);
+
+	/* No checksum, as the stamp in the payload changes on every send */
+	udp = dp_pktmbuf_mtol4(m, struct udphdr *);
+	udp->check = 0;
+
+	return m;
+}
+
+static struct fwd_bench_stamp *fwd_bench_stamp(struct rte_mbuf *m)
+{
+	return rte_pktmbuf_mtod_offset(m, struct fwd_bench_stamp *,
+				       FWD_BENCH_HDR_LEN);
+}
+
+/*
+ * Build the header templates, and the pool of packets in the IMIX
+ * proportions.
+ */
+static void fwd_bench_init(struct fwd_bench *fb)
+{
+	unsigned int flow, size, i, total = 0;
+	struct rte_mbuf *m;
+
+	memset(fb, 0, sizeof(*fb));
+	fb->flows = fwd_bench_count("DP_TEST_BENCH_FLOWS", FWD_BENCH_FLOWS_DEF);
+	fb->pkts = fwd_bench_count("DP_TEST_BENCH_PKTS", FWD_BENCH_PKTS_DEF);
+	fb->port = dp_test_intf_name2port("dp1T0");
+
+	fb->hdrs = calloc(fb->flows, sizeof(*fb->hdrs));
+	fb->lat = calloc(fb->pkts, sizeof(*fb->lat));
+	dp_test_fail_unless(fb->hdrs && fb->lat, "no memory for %u flows",
+			    fb->flows);
+
+	for (flow = 0; flow < fb->flows; flow++) {
+		for (size = 0; size < FWD_BENCH_SIZES; size++) {
+			m = fwd_bench_pak(flow, size);
+			memcpy(fb->hdrs[flow][size],
+			       rte_pktmbuf_mtod(m, uint8_t *),
+			       FWD_BENCH_HDR_LEN);
+			rte_pktmbuf_free(m);
+		}
+	}
+
+	for (size = 0; size < FWD_BENCH_SIZES; size++)
+		total += fwd_bench_imix[size].weight;
+
+	for (i = 0; i < FWD_BENCH_POOL; i++) {
+		unsigned int pick = i % total;
+
+		for (size = 0; size < FWD_BENCH_SIZES - 1; size++) {
+			if (pick < fwd_bench_imix[size].weight)
+				break;
+			pick -= fwd_bench_imix[size].weight;
+		}
+		m = fwd_bench_pak(0, size);
+		fwd_bench_stamp(m)->size = size;
+		fb->free[fb->nfree++] = m;
+	}
+}
+
+static void fwd_bench_uninit(struct fwd_bench *fb)
+{
+	unsigned int i;
+
+	for (i = 0; i < fb->nfree; i++)
+		rte_pktmbuf_free(fb->free[i]);
+	free(fb->hdrs);
+	free(fb->lat);
+}
+
+/*
+ * Restore a packet that has been forwarded to what was sent, with the
+ * headers of the next flow, and stamp it with the time.
+ */
+static void fwd_bench_prep(struct fwd_bench *fb, struct rte_mbuf *m,
+			   unsigned int size, uint64_t now)
+{
+	struct fwd_bench_stamp *stamp;
+	uint8_t *data;
+
+	rte_pktmbuf_reset(m);
+	m->port = fb->port;
+	m->data_len = m->pkt_len = sizeof(struct rte_ether_hdr) +
+		fwd_bench_imix[size].ip_len;
+
+	data = rte_pktmbuf_mtod(m, uint8_t *);
+	memcpy(data, fb->hdrs[fb->next_flow][size], FWD_BENCH_HDR_LEN);
+	if (++fb->next_flow == fb->flows)
+		fb->next_flow = 0;
+
+	stamp = (struct fwd_bench_stamp *)(data + FWD_BENCH_HDR_LEN);
+	stamp->tsc = now;
+	stamp->size = size;
+}
+
+/*
+ * Send count packets, keeping the pool in circulation, and record the
+ * latency of each packet forwarded.
+ */
+static void fwd_bench_run(struct fwd_bench *fb, unsigned int count,
+			  bool record, struct fwd_bench_result *res)
+{
+	struct rte_mbuf *bufs[FWD_BENCH_POOL];
+	uint64_t start, last, now, hz = rte_get_tsc_hz();
+	unsigned int n, i;
+	int rx;
+
+	memset(res, 0, sizeof(*res));
+
+	start = last = rte_rdtsc();
+	while (res->rcvd < res->sent || res->sent < count) {
+		now = rte_rdtsc();
+
+		n = RTE_MIN(fb->nfree, count - res->sent);
+		n = RTE_MIN(n, FWD_BENCH_BURST);
+		if (n) {
+			for (i = 0; i < n; i++) {
+				bufs[i] = fb->free[--fb->nfree];
+				fwd_bench_prep(fb, bufs[i],
+					       fwd_bench_stamp(bufs[i])->size,
+					       now);
+			}
+			dp_test_pak_add_to_ring("dp1T0", bufs, n, false);
+			res->sent += n;
+		}
+
+		rx = dp_test_pak_get_from_ring("dp2T1", bufs,
+					       FWD_BENCH_POOL - fb->nfree);
+		now = rte_rdtsc();
+		for (i = 0; i < (unsigned int)rx; i++) {
+			if (record && res->rcvd < fb->pkts)
+				fb->lat[res->rcvd] =
+					now - fwd_bench_stamp(bufs[i])->tsc;
+			res->rcvd++;
+			fb->free[fb->nfree++] = bufs[i];
+		}
+
+		/* Packets dropped by the dataplane never come back */
+		if (rx > 0)
+			last = now;
+		else if (now - last > FWD_BENCH_STALL_SECS * hz)
+			break;
+	}
+	res->secs = (double)(last - start) / hz;
+}
+
+static int fwd_bench_lat_cmp(const void *a, const void *b)
+{
+	uint64_t l1 = *(const uint64_t *)a, l2 = *(const uint64_t *)b;
+
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+static double fwd_bench_lat_us(const uint64_t *lat, uint64_t count,
+			       double pct)
+{
+	uint64_t i = count * pct / 100;
+
+	if (!count)
+		return 0;
+	if (i >= count)
+		i = count - 1;
+	return (double)lat[i] * USEC_PER_SEC / rte_get_tsc_hz();
+}
+
+/*
+ * Add the forwarding cycles per packet, and per call of each pipeline
+ * node, from the perf profile counters.
+ */
+static void fwd_bench_perf(json_object *jres, uint64_t rcvd)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jperf, *jobj, *jnodes;
+	uint64_t busy = 0;
+	unsigned int i;
+
+	jresp = dp_test_json_do_show_cmd("pipeline perf show", &mismatches,
+					 false);
+	dp_test_fail_unless(jresp, "no response to \"pipeline perf show\"");
+
+	if (!json_object_object_get_ex(jresp, "perf", &jperf) ||
+	    !json_object_object_get_ex(jperf, "enabled", &jobj) ||
+	    !json_object_get_boolean(jobj)) {
+		json_object_put(jresp);
+		return;
+	}
+
+	if (json_object_object_get_ex(jperf, "lcore", &jobj)) {
+		for (i = 0; i < json_object_array_length(jobj); i++) {
+			json_object *jcore, *jbusy;
+
+			jcore = json_object_array_get_idx(jobj, i);
+			if (json_object_object_get_ex(jcore, "busy_cycles",
+						      &jbusy))
+				busy += json_object_get_int64(jbusy);
+		}
+	}
+	if (rcvd)
+		json_object_object_add(jres, "cycles_per_pkt",
+				       json_object_new_double((double)busy /
+							      rcvd));
+
+	jnodes = json_object_new_object();
+	if (json_object_object_get_ex(jperf, "node", &jobj)) {
+		json_object_object_foreach(jobj, name, jnode) {
+			json_object *jcalls, *jcpc;
+
+			if (!json_object_object_get_ex(jnode, "calls",
+						       &jcalls) ||
+			    !json_object_get_int64(jcalls) ||
+			    !json_object_object_get_ex(jnode,
+						       "cycles-per-call",
+						       &jcpc))
+				continue;
+			json_object_object_add(jnodes, name,
+					       json_object_get(jcpc));
+		}
+	}
+	json_object_object_add(jres, "node_cycles_per_pkt", jnodes);
+
+	json_object_put(jresp);
+}
+
+static void fwd_bench_output(const char *json)
+{
+	const char *path = getenv("DP_TEST_BENCH_OUTPUT");
+	FILE *f;
+
+	printf("fwd bench: %s\n", json);
+
+	if (!path)
+		return;
+
+	f = fopen(path, "a");
+	dp_test_fail_unless(f, "failed to open %s", path);
+	fprintf(f, "%s\n", json);
+	fclose(f);
+}
+
+/*
+ * Run a profile.  A first pass over all the flows creates any state, such
+ * as sessions, that the profile needs before the timed run.
+ */
+static void fwd_bench_profile(const char *profile)
+{
+	struct fwd_bench_result res;
+	struct fwd_bench fb;
+	json_object *jres, *jlat;
+
+	fwd_bench_init(&fb);
+
+	fwd_bench_run(&fb, fb.flows, false, &res);
+	dp_test_fail_unless(res.rcvd == res.sent,
+			    "%s: %" PRIu64 " of %" PRIu64 " warm up packets "
+			    "forwarded", profile, res.rcvd, res.sent);
+
+	dp_test_console_request_reply("pipeline perf clear", false);
+	fwd_bench_run(&fb, fb.pkts, true, &res);
+
+	jres = json_object_new_object();
+	json_object_object_add(jres, "bench", json_object_new_string("fwd"));
+	json_object_object_add(jres, "profile",
+			       json_object_new_string(profile));
+	json_object_object_add(jres, "flows", json_object_new_int(fb.flows));
+	json_object_object_add(jres, "sent", json_object_new_int64(res.sent));
+	json_object_object_add(jres, "forwarded",
+			       json_object_new_int64(res.rcvd));
+	json_object_object_add(jres, "secs", json_object_new_double(res.secs));
+	json_object_object_add(jres, "mpps",
+			       json_object_new_double(res.rcvd / res.secs /
+						      1e6));
+
+	qsort(fb.lat, res.rcvd, sizeof(*fb.lat), fwd_bench_lat_cmp);
+	jlat = json_object_new_object();
+	json_object_object_add(jlat, "p50", json_object_new_double(
+				       fwd_bench_lat_us(fb.lat, res.rcvd, 50)));
+	json_object_object_add(jlat, "p99", json_object_new_double(
+				       fwd_bench_lat_us(fb.lat, res.rcvd, 99)));
+	json_object_object_add(jlat, "p99.9", json_object_new_double(
+				       fwd_bench_lat_us(fb.lat, res.rcvd,
+							99.9)));
+	json_object_object_add(jres, "latency_us", jlat);
+
+	fwd_bench_perf(jres, res.rcvd);
+
+	fwd_bench_output(json_object_to_json_string_ext(jres,
+							JSON_C_TO_STRING_PLAIN));
+	json_object_put(jres);
+
+	fwd_bench_uninit(&fb);
+}
+
+static void fwd_bench_setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:ee:ff");
+	dp_test_netlink_add_route("10.73.0.0/16 nh 2.2.2.1 int:dp2T1");
+}
+
+static void fwd_bench_teardown(void)
+{
+	dp_test_netlink_del_route("10.73.0.0/16 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:ee:ff");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+}
+
+DP_DECL_TEST_SUITE(fwd_bench_suite);
+
+DP_DECL_TEST_CASE(fwd_bench_suite, fwd_bench, NULL, NULL);
+
+/* Plain IPv4 forwarding, as the baseline for the other profiles */
+DP_START_TEST_BENCH(fwd_bench, ipv4)
+{
+	fwd_bench_setup();
+	fwd_bench_profile("ipv4");
+	fwd_bench_teardown();
+} DP_END_TEST;
+
+/*
+ * A stateless output ACL, with every packet checked against all rules
+ * before matching the last.
+ */
+DP_START_TEST_BENCH(fwd_bench, ipv4_acl)
+{
+	struct dp_test_npf_rule_t rules[FWD_BENCH_ACL_RULES + 1];
+	char nums[FWD_BENCH_ACL_RULES][8];
+	char npf[FWD_BENCH_ACL_RULES][32];
+	unsigned int i;
+
+	for (i = 0; i < FWD_BENCH_ACL_RULES; i++) {
+		bool last = i == FWD_BENCH_ACL_RULES - 1;
+
+		snprintf(nums[i], sizeof(nums[i]), "%u", (i + 1) * 10);
+		snprintf(npf[i], sizeof(npf[i]), "proto=17 dst-port=%u",
+			 last ? 53 : 1000 + i);
+		rules[i].rule = nums[i];
+		rules[i].pass = last ? PASS : BLOCK;
+		rules[i].stateful = STATELESS;
+		rules[i].npf = npf[i];
+	}
+	rules[i] = (struct dp_test_npf_rule_t)NULL_RULE;
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-out",
+		.name   = "FWD_BENCH",
+		.enable = 1,
+		.attach_point = "dp2T1",
+		.fwd    = FWD,
+		.dir    = "out",
+		.rules  = rules
+	};
+
+	fwd_bench_setup();
+	dp_test_npf_fw_add(&fw, false);
+
+	fwd_bench_profile("ipv4_acl");
+
+	dp_test_npf_fw_del(&fw, false);
+	fwd_bench_teardown();
+} DP_END_TEST;
+
+/* A stateful output firewall, with a session per flow */
+DP_START_TEST_BENCH(fwd_bench, ipv4_fw_stateful)
+{
+	struct dp_test_npf_rule_t rules[] = {
+		RULE_10_PASS_UDP_SF,
+		NULL_RULE
+	};
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-out",
+		.name   = "FWD_BENCH",
+		.enable = 1,
+		.attach_point = "dp2T1",
+		.fwd    = FWD,
+		.dir    = "out",
+		.rules  = rules
+	};
+
+	fwd_bench_setup();
+	dp_test_npf_fw_add(&fw, false);
+
+	fwd_bench_profile("ipv4_fw_stateful");
+
+	dp_test_npf_fw_del(&fw, false);
+	dp_test_npf_cleanup();
+	fwd_bench_teardown();
+} DP_END_TEST;
+
+/* Source NAT of every flow to a pool of addresses */
+DP_START_TEST_BENCH(fwd_bench, ipv4_snat)
+{
+	struct dp_test_npf_nat_rule_t snat = {
+		.desc		= "fwd bench snat",
+		.rule		= "10",
+		.ifname		= "dp2T1",
+		.proto		= IPPROTO_UDP,
+		.map		= "dynamic",
+		.from_addr	= "100.64.0.0/16",
+		.from_port	= NULL,
+		.to_addr	= NULL,
+		.to_port	= NULL,
+		.trans_addr	= "2.2.2.100-2.2.2.107",
+		.trans_port	= NULL};
+
+	fwd_bench_setup();
+	dp_test_npf_snat_add(&snat, true);
+
+	fwd_bench_profile("ipv4_snat");
+
+	dp_test_npf_snat_del(snat.ifname, snat.rule, true);
+	dp_test_npf_cleanup();
+	fwd_bench_teardown();
+} DP_END_TEST;
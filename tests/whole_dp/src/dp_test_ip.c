@@ -49,6 +49,38 @@ DP_START_TEST(ip_cfg, route_add_del)
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 } DP_END_TEST;
 
+/*
+ * Send several updates for the same routes without waiting for each to be
+ * applied, so that they may be coalesced, and check the final state is the
+ * same as if they were applied one at a time.
+ */
+DP_START_TEST(ip_cfg, route_add_del_batch)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	/* Add, replace, delete and add back with a different nexthop */
+	dp_test_netlink_add_route_nv("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_route_nv("10.73.2.0/24 nh 2.2.2.3 int:dp2T1");
+	dp_test_netlink_del_route_nv("10.73.2.0/24 nh 2.2.2.3 int:dp2T1");
+	dp_test_netlink_add_route_nv("10.73.3.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_route_nv("10.73.2.0/24 nh 1.1.1.2 int:dp1T0");
+	dp_test_wait_for_route("10.73.2.0/24 nh 1.1.1.2 int:dp1T0", true);
+	dp_test_wait_for_route("10.73.3.0/24 nh 2.2.2.1 int:dp2T1", true);
+
+	/* Add and delete in quick succession leaves no route */
+	dp_test_netlink_add_route_nv("10.73.4.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_route_nv("10.73.4.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_route("10.73.3.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_wait_for_route_gone("10.73.4.0/24 nh 2.2.2.1 int:dp2T1",
+				    false, __FILE__, __func__, __LINE__);
+
+	dp_test_netlink_del_route("10.73.2.0/24 nh 1.1.1.2 int:dp1T0");
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+} DP_END_TEST;
+
 /*
  * Verifying adding and deleting a scale of routes such that the LPM
  * grows
@@ -22,6 +22,8 @@
 #include "dp_test_lib_exp.h"
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_console.h"
+#include "dp_test_json_utils.h"
+#include "dp_test/dp_test_cmd_check.h"
 
 struct nh_info {
 	const char *nh_int;
@@ -1425,3 +1427,99 @@ DP_START_TEST_DONT_RUN(ip_arp_nh_scale,
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "2.2.0.2/16");
 
 } DP_END_TEST;
+
+static void
+dp_test_check_arp_hold(unsigned int depth, unsigned int solicit_rate)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{ \"hold\": "
+		"  { \"depth\": %u, "
+		"    \"solicit_rate\": %u "
+		"  } "
+		"}",
+		depth, solicit_rate);
+	dp_test_check_json_state("arp hold", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * The depth of the per-lcore hold queues and the solicitation rate can be
+ * set, and deleting them restores the defaults.
+ */
+DP_DECL_TEST_CASE(ip_arp_suite, ip_arp_hold_cfg, NULL, NULL);
+DP_START_TEST(ip_arp_hold_cfg, ip_arp_hold_cfg)
+{
+	dp_test_check_arp_hold(256, 1000);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"lladdr set hold-queue 64");
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"lladdr set solicit-rate 10");
+	dp_test_check_arp_hold(64, 10);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"lladdr delete hold-queue");
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"lladdr delete solicit-rate");
+	dp_test_check_arp_hold(256, 1000);
+} DP_END_TEST;
+
+/*
+ * A packet to an unresolved neighbour is held while the neighbour is
+ * solicited, and is sent once an ARP reply resolves it.
+ */
+DP_DECL_TEST_CASE(ip_arp_suite, ip_arp_hold_release, NULL, NULL);
+DP_START_TEST(ip_arp_hold_release, ip_arp_hold_release)
+{
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	const char *oif_mac_str;
+	struct dp_test_expected *exp_held;
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	struct rte_mbuf *arp_pak;
+	int len = 22;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", "2.2.2.2/24");
+	oif_mac_str = dp_test_intf_name2mac_str("dp1T1");
+
+	test_pak = dp_test_create_ipv4_pak("10.73.0.0", "2.2.2.1", 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+
+	/* What the held packet should look like once it is sent */
+	exp_held = dp_test_exp_create(test_pak);
+	dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp_held),
+				 nh_mac_str, oif_mac_str,
+				 RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp_held));
+	dp_test_exp_set_oif_name(exp_held, "dp1T1");
+
+	/* The packet is held and the neighbour solicited */
+	exp = dp_test_exp_create_with_packet(
+		dp_test_create_arp_pak(ARPOP_REQUEST,
+				       oif_mac_str, BCAST_MAC,
+				       oif_mac_str, DONTCARE_MAC,
+				       "2.2.2.2", "2.2.2.1", 0));
+	dp_test_exp_set_oif_name(exp, "dp1T1");
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	/* The reply resolves the neighbour and releases the packet */
+	arp_pak = dp_test_create_arp_pak(ARPOP_REPLY,
+					 nh_mac_str, oif_mac_str,
+					 nh_mac_str, oif_mac_str,
+					 "2.2.2.1", "2.2.2.2", 0);
+	dp_test_pak_receive(arp_pak, "dp1T1", exp_held);
+
+	dp_test_verify_neigh("dp1T1", "2.2.2.1", nh_mac_str, false);
+
+	/* Clean Up */
+	dp_test_neigh_clear_entry("dp1T1", "2.2.2.1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", "2.2.2.2/24");
+} DP_END_TEST;
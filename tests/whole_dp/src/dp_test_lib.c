@@ -33,6 +33,7 @@
 #include "in_cksum.h"
 #include "vplane_debug.h"
 #include "crypto/crypto_main.h"
+#include "if/bridge/bridge.h"
 #include "power.h"
 #include "mpls/mpls.h"
 
@@ -1262,6 +1263,24 @@ dp_test_wait_until_tx_processed(void)
 	synchronize_rcu();
 }
 
+/*
+ * Wait for the master thread to apply any source addresses that the
+ * forwarding thread has queued for bridge learning, so that the next
+ * packet sees them.
+ */
+static void
+dp_test_wait_until_learn_processed(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < USEC_PER_SEC; i++) {
+		if (!bridge_learn_pending())
+			return;
+		usleep(1);
+	}
+	dp_test_fail("bridge learn queues not emptied");
+}
+
 /*
  * Wait for all interfaces to process any packets that have been sent.
  *
@@ -1290,6 +1309,7 @@ void dp_test_intf_wait_until_processed(struct rte_ring *ring)
 			 */
 			synchronize_rcu();
 			dp_test_wait_until_tx_processed();
+			dp_test_wait_until_learn_processed();
 			return;
 		}
 		usleep(1);
@@ -27,6 +27,7 @@
 #include "npf/npf_ptree.h"
 #include "npf/npf_cidr_util.h"
 #include "npf/npf_addrgrp.h"
+#include "npf/npf_addrgrp_lpm.h"
 #include "npf/config/npf_config.h"
 
 #include "dp_test.h"
@@ -1747,3 +1748,158 @@ DP_START_TEST(npf_addrgrp11, test1)
 	dp_test_addrgrp_destroy("ADDRGRP11");
 
 } DP_END_TEST;
+
+
+/*
+ * npf_addrgrp12 - Verify the IPv4 multibit trie gives the same answer as the
+ * ptree for a mix of prefix lengths.
+ */
+DP_DECL_TEST_CASE(npf_addrgrp, npf_addrgrp12, NULL, NULL);
+DP_START_TEST(npf_addrgrp12, test1)
+{
+	static const struct {
+		const char *pfx;
+		uint8_t     mask;
+	} data[] = {
+		{ "10.0.0.0",      8 },
+		{ "10.1.2.3",      32 },	/* covered by 10.0.0.0/8 */
+		{ "172.16.0.0",    16 },
+		{ "172.17.128.0",  17 },
+		{ "192.168.1.0",   24 },
+		{ "192.168.2.128", 25 },
+		{ "192.168.2.7",   32 },
+		{ "192.168.3.64",  26 },
+		{ "198.51.100.0",  22 },
+		{ "198.51.100.9",  32 },	/* covered by 198.51.100.0/22 */
+	};
+	uint32_t base[ARRAY_SIZE(data)];
+	struct ptree_table *pt;
+	struct ag_lpm *al;
+	uint32_t addr;
+	bool exp;
+	uint i;
+	int rc;
+
+	pt = ptree_table_create(4);
+	dp_test_fail_unless(pt, "Failed to create ptree");
+
+	al = ag_lpm_create();
+	dp_test_fail_unless(al, "Failed to create trie");
+
+	for (i = 0; i < ARRAY_SIZE(data); i++) {
+		rc = inet_pton(AF_INET, data[i].pfx, &addr);
+		dp_test_fail_unless(rc == 1, "Failed to parse %s",
+				    data[i].pfx);
+		base[i] = ntohl(addr);
+
+		rc = ptree_insert(pt, (uint8_t *)&addr, data[i].mask);
+		dp_test_fail_unless(rc == 0, "Failed to add %s/%u to ptree",
+				    data[i].pfx, data[i].mask);
+
+		rc = ag_lpm_add(al, base[i], data[i].mask);
+		dp_test_fail_unless(rc == 0, "Failed to add %s/%u to trie",
+				    data[i].pfx, data[i].mask);
+	}
+	ag_lpm_trim(al);
+
+	/* Addresses either side of each prefix boundary */
+	for (i = 0; i < 20000; i++) {
+		addr = base[i % ARRAY_SIZE(data)] + (random() % 8192) - 4096;
+		addr = htonl(addr);
+
+		exp = ptree_shortest_match(pt, (uint8_t *)&addr) != NULL;
+		dp_test_fail_unless(ag_lpm_lookup(al, ntohl(addr)) == exp,
+				    "Trie lookup of 0x%08x returned %u",
+				    ntohl(addr), !exp);
+	}
+
+	ag_lpm_destroy(al);
+
+	rc = ptree_table_destroy(pt);
+	dp_test_fail_unless(!rc, "Failed to destroy ptree");
+
+} DP_END_TEST;
+
+/*
+ * Get the size of an address-groups IPv4 trie from the show command.
+ * Returns false if the address-group has no trie.
+ */
+static bool
+dp_test_addrgrp_trie_size(const char *group, int *size)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jipv4;
+	char cmd[100];
+	bool found = false;
+
+	struct dp_test_json_find_key key[] = {
+		{ "address-group", NULL },
+		{ "ipv4", NULL },
+	};
+
+	spush(cmd, sizeof(cmd),
+	      "npf-op fw show address-group af=ipv4 list=none tree=none "
+	      "name=%s", group);
+
+	jresp = dp_test_json_do_show_cmd(cmd, &mismatches, false);
+	dp_test_fail_unless(jresp, "no response to \"%s\"", cmd);
+
+	jipv4 = dp_test_json_find(jresp, key, ARRAY_SIZE(key));
+	dp_test_fail_unless(jipv4, "no ipv4 object for %s", group);
+
+	found = dp_test_json_int_field_from_obj(jipv4, "trie-size", size);
+
+	json_object_put(jipv4);
+	json_object_put(jresp);
+	return found;
+}
+
+/*
+ * npf_addrgrp13 - Verify the show command gives the size of the trie once an
+ * address-group is large enough to have one, and that the trie is discarded
+ * when the address-group changes.
+ */
+DP_DECL_TEST_CASE(npf_addrgrp, npf_addrgrp13, NULL, NULL);
+DP_START_TEST(npf_addrgrp13, test1)
+{
+	char pfx[24];
+	int size;
+	uint i;
+
+	dp_test_addrgrp_create("ADDRGRP13");
+
+	/* One less than is needed for a trie */
+	for (i = 1; i < 1024; i++) {
+		spush(pfx, sizeof(pfx), "10.%u.%u.1/32", i >> 8, i & 0xff);
+		dp_test_addrgrp_prefix_add("ADDRGRP13", pfx, true);
+	}
+	dp_test_npf_commit();
+
+	dp_test_fail_unless(!dp_test_addrgrp_trie_size("ADDRGRP13", &size),
+			    "Trie built for 1023 prefixes");
+
+	dp_test_addrgrp_prefix_add("ADDRGRP13", "10.4.0.1/32", true);
+	dp_test_fail_unless(!dp_test_addrgrp_trie_size("ADDRGRP13", &size),
+			    "Trie built before commit");
+
+	dp_test_npf_commit();
+	dp_test_fail_unless(dp_test_addrgrp_trie_size("ADDRGRP13", &size),
+			    "No trie for 1024 prefixes");
+	dp_test_fail_unless(size > 0, "Trie size %d", size);
+
+	/* A change discards the trie straight away */
+	dp_test_addrgrp_prefix_remove("ADDRGRP13", "10.4.0.1/32", true, false);
+	dp_test_fail_unless(!dp_test_addrgrp_trie_size("ADDRGRP13", &size),
+			    "Trie kept after prefix removed");
+
+	dp_test_npf_commit();
+	dp_test_fail_unless(!dp_test_addrgrp_trie_size("ADDRGRP13", &size),
+			    "Trie rebuilt for 1023 prefixes");
+
+	for (i = 1; i < 1024; i++) {
+		spush(pfx, sizeof(pfx), "10.%u.%u.1/32", i >> 8, i & 0xff);
+		dp_test_addrgrp_prefix_remove("ADDRGRP13", pfx, true, false);
+	}
+	dp_test_addrgrp_destroy("ADDRGRP13");
+
+} DP_END_TEST;
@@ -38,6 +38,9 @@
 #include "dp_test_npf_alg_sip_lib.h"
 #include "dp_test_npf_alg_sip_call.h"
 
+#include "npf/npf_vrf.h"
+#include "npf/alg/sip/sip.h"
+
 
 static void dpt_alg_sip_setup(void);
 static void dpt_alg_sip_teardown(void);
@@ -407,6 +410,216 @@ DP_START_TEST(sip4_1, test)
 
 } DP_END_TEST;
 
+/*
+ * Scan and translate REGISTERs and their responses without osip, for SNAT
+ * and DNAT, and check the result against the osip path.
+ */
+struct sip4_2_msg {
+	const char	*desc;
+	const char	*pre;
+	const char	*post;
+	struct sip_nat	sn;
+};
+
+static const struct sip4_2_msg sip4_2_msgs[] = {
+	{
+		.desc = "SNAT REGISTER",
+		.pre =
+		"REGISTER sip:18.33.0.200 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 16.33.0.200:5060;branch=z9hG4bK776asdhds\r\n"
+		"From: \"Alice\" <sip:alice@16.33.0.200>;tag=1928301774\r\n"
+		"To: <sip:alice@16.33.0.200>\r\n"
+		"Call-ID: a84b4c76e66710@16.33.0.200\r\n"
+		"CSeq: 314159 REGISTER\r\n"
+		"Contact: <sip:alice@16.33.0.200:5060>\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.post =
+		"REGISTER sip:18.33.0.200 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 77.1.1.1:5060;branch=z9hG4bK776asdhds\r\n"
+		"From: \"Alice\" <sip:alice@77.1.1.1>;tag=1928301774\r\n"
+		"To: <sip:alice@16.33.0.200>\r\n"
+		"Call-ID: a84b4c76e66710@77.1.1.1\r\n"
+		"CSeq: 314159 REGISTER\r\n"
+		"Contact: <sip:alice@77.1.1.1:5060>\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.sn = {
+			.sn_taddr = "77.1.1.1",
+			.sn_oaddr = "16.33.0.200",
+			.sn_tport = "5060",
+			.sn_type = sip_nat_snat,
+			.sn_forw = true,
+		},
+	},
+	{
+		.desc = "SNAT REGISTER response",
+		.pre =
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 77.1.1.1:5060;branch=z9hG4bK776asdhds\r\n"
+		"From: \"Alice\" <sip:alice@77.1.1.1>;tag=1928301774\r\n"
+		"To: <sip:alice@16.33.0.200>;tag=a6c85cf\r\n"
+		"Call-ID: a84b4c76e66710@77.1.1.1\r\n"
+		"CSeq: 314159 REGISTER\r\n"
+		"Contact: <sip:alice@77.1.1.1:5060>;expires=3600\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.post =
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 16.33.0.200:5060;branch=z9hG4bK776asdhds\r\n"
+		"From: \"Alice\" <sip:alice@16.33.0.200>;tag=1928301774\r\n"
+		"To: <sip:alice@16.33.0.200>;tag=a6c85cf\r\n"
+		"Call-ID: a84b4c76e66710@16.33.0.200\r\n"
+		"CSeq: 314159 REGISTER\r\n"
+		"Contact: <sip:alice@77.1.1.1:5060>;expires=3600\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.sn = {
+			.sn_taddr = "16.33.0.200",
+			.sn_oaddr = "77.1.1.1",
+			.sn_tport = "5060",
+			.sn_type = sip_nat_snat,
+			.sn_forw = false,
+		},
+	},
+	{
+		.desc = "DNAT REGISTER",
+		.pre =
+		"REGISTER sip:77.1.1.1 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 18.33.0.200:5060;branch=z9hG4bK74bf9\r\n"
+		"From: <sip:bob@77.1.1.1>;tag=9fxced76sl\r\n"
+		"To: <sip:bob@77.1.1.1>\r\n"
+		"Call-ID: 3848276298220188511@18.33.0.200\r\n"
+		"CSeq: 1 REGISTER\r\n"
+		"Contact: <sip:bob@18.33.0.200:5060>\r\n"
+		"Max-Forwards: 70\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.post =
+		"REGISTER sip:16.33.0.200 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 18.33.0.200:5060;branch=z9hG4bK74bf9\r\n"
+		"From: <sip:bob@77.1.1.1>;tag=9fxced76sl\r\n"
+		"To: <sip:bob@16.33.0.200>\r\n"
+		"Call-ID: 3848276298220188511@18.33.0.200\r\n"
+		"CSeq: 1 REGISTER\r\n"
+		"Contact: <sip:bob@18.33.0.200:5060>\r\n"
+		"Max-Forwards: 70\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.sn = {
+			.sn_taddr = "16.33.0.200",
+			.sn_oaddr = "77.1.1.1",
+			.sn_tport = "5060",
+			.sn_type = sip_nat_dnat,
+			.sn_forw = true,
+		},
+	},
+	{
+		.desc = "DNAT REGISTER response",
+		.pre =
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 18.33.0.200:5060;branch=z9hG4bK74bf9\r\n"
+		"From: <sip:bob@77.1.1.1>;tag=9fxced76sl\r\n"
+		"To: <sip:bob@16.33.0.200>;tag=37GkEhwl6\r\n"
+		"Call-ID: 3848276298220188511@18.33.0.200\r\n"
+		"CSeq: 1 REGISTER\r\n"
+		"Contact: <sip:bob@16.33.0.200:5060>;expires=3600\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.post =
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 18.33.0.200:5060;branch=z9hG4bK74bf9\r\n"
+		"From: <sip:bob@77.1.1.1>;tag=9fxced76sl\r\n"
+		"To: <sip:bob@77.1.1.1>;tag=37GkEhwl6\r\n"
+		"Call-ID: 3848276298220188511@18.33.0.200\r\n"
+		"CSeq: 1 REGISTER\r\n"
+		"Contact: <sip:bob@77.1.1.1:5060>;expires=3600\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		.sn = {
+			.sn_taddr = "77.1.1.1",
+			.sn_oaddr = "16.33.0.200",
+			.sn_tport = "5060",
+			.sn_type = sip_nat_dnat,
+			.sn_forw = false,
+		},
+	},
+};
+
+/*
+ * Translate a message on the fast path, and check the result.  osip does
+ * not keep the layout of a message, so the fast path result is compared
+ * with the osip path result once it has been through osip too.
+ */
+static void
+sip4_2_check(const struct npf_alg *sip, const struct sip4_2_msg *m)
+{
+	struct sip_nat inspect = { .sn_type = sip_nat_inspect };
+	char out[SIP_MESSAGE_MAX_LENGTH + 1];
+	char *fast_str, *osip_str;
+	size_t fast_sz, osip_sz;
+	struct sip_scan sc;
+	int len, rc;
+
+	dp_test_fail_unless(sip_scan(m->pre, strlen(m->pre), &sc) == 0,
+			    "%s: failed to scan", m->desc);
+	dp_test_fail_unless(sip_scan_is_passive(&sc), "%s: not passive",
+			    m->desc);
+
+	len = sip_scan_translate(&sc, &m->sn, out, sizeof(out) - 1);
+	dp_test_fail_unless(len == (int)strlen(m->post) &&
+			    !memcmp(out, m->post, len),
+			    "%s: translation:\n%.*s", m->desc,
+			    len > 0 ? len : 0, out);
+	out[len] = '\0';
+
+	rc = sip_alg_translate_buf(sip, m->pre, strlen(m->pre), &m->sn,
+				   &osip_str, &osip_sz);
+	dp_test_fail_unless(rc == 0, "%s: osip translation: %d", m->desc,
+			    rc);
+
+	rc = sip_alg_translate_buf(sip, out, len, &inspect,
+				   &fast_str, &fast_sz);
+	dp_test_fail_unless(rc == 0, "%s: osip parse of translation: %d",
+			    m->desc, rc);
+
+	dp_test_fail_unless(fast_sz == osip_sz &&
+			    !memcmp(fast_str, osip_str, osip_sz),
+			    "%s: fast path:\n%.*s\nosip path:\n%.*s", m->desc,
+			    (int)fast_sz, fast_str, (int)osip_sz, osip_str);
+
+	osip_free(fast_str);
+	osip_free(osip_str);
+}
+
+DP_DECL_TEST_CASE(npf_sip4, sip4_2, NULL, NULL);
+DP_START_TEST(sip4_2, test)
+{
+	const struct sip4_2_msg *reg = &sip4_2_msgs[0];
+	struct npf_alg_instance *ai;
+	struct sip_scan sc;
+	const char *invite;
+	uint i;
+
+	ai = vrf_get_npf_alg_rcu(VRF_DEFAULT_ID);
+	dp_test_fail_unless(ai && ai->ai_sip, "No SIP ALG instance");
+
+	for (i = 0; i < ARRAY_SIZE(sip4_2_msgs); i++)
+		sip4_2_check(ai->ai_sip, &sip4_2_msgs[i]);
+
+	/* Truncated message */
+	dp_test_fail_unless(sip_scan(reg->pre, strlen(reg->pre) - 4,
+				     &sc) != 0,
+			    "Scanned truncated REGISTER");
+
+	/* INVITEs are always left to osip */
+	invite = sip_call[0].msg;
+	dp_test_fail_unless(sip_scan(invite, strlen(invite), &sc) != 0 ||
+			    !sip_scan_is_passive(&sc),
+			    "INVITE is passive");
+
+} DP_END_TEST;
+
 
 static void dpt_alg_sip_setup(void)
 {
@@ -8,6 +8,7 @@
 #include <time.h>
 #include <values.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <linux/if_ether.h>
 #include <netinet/ip_icmp.h>
@@ -6273,6 +6274,301 @@ DP_START_TEST(cgnat_log_methods, test)
 } DP_END_TEST;
 
 
+/*
+ * Find the first data record for an IPFIX template in an exported file.
+ * Returns a pointer to the record, or NULL.
+ */
+static const uint8_t *
+cgnat_ipfix_find_rec(const uint8_t *buf, size_t len, uint16_t set_id)
+{
+	size_t off = 0;
+
+	while (off + 16 <= len) {
+		size_t msg_len = (buf[off + 2] << 8) | buf[off + 3];
+		size_t set = off + 16;
+
+		if (buf[off] != 0 || buf[off + 1] != 10 || msg_len < 16 ||
+		    off + msg_len > len)
+			return NULL;
+
+		while (set + 4 <= off + msg_len) {
+			uint16_t id = (buf[set] << 8) | buf[set + 1];
+			size_t set_len = (buf[set + 2] << 8) | buf[set + 3];
+
+			if (set_len < 4)
+				return NULL;
+			if (id == set_id && set_len > 4)
+				return &buf[set + 4];
+			set += set_len;
+		}
+		off += msg_len;
+	}
+	return NULL;
+}
+
+/*
+ * cgnat_log_ipfix -- Tests port block allocation is exported as an IPFIX
+ * NAT event to a file.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_log_ipfix, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_log_ipfix, test)
+{
+	const char *path = "/tmp/dp_test_cgnat_ipfix";
+	const uint8_t *rec = NULL;
+	uint8_t buf[4096];
+	size_t len = 0;
+	FILE *f;
+	int i;
+
+	unlink(path);
+	dpt_cgn_cmd_fmt(false, true, "cgn-cfg events ipfix file %s", path);
+	dpt_cgn_cmd_fmt(false, true,
+			"cgn-cfg events ipfix port-block-allocation enable");
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20 "
+			"log-pba=yes");
+
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/12", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* The exporter sends once it is idle */
+	for (i = 0; i < 100 && !rec; i++) {
+		usleep(10000);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		len = fread(buf, 1, sizeof(buf), f);
+		fclose(f);
+		rec = cgnat_ipfix_find_rec(buf, len, 257);
+	}
+	dp_test_fail_unless(rec, "no port block record in %zu bytes", len);
+
+	/* observationTimeMilliseconds, natEvent, addresses, port range */
+	dp_test_fail_unless(rec[8] == 16, "natEvent %u", rec[8]);
+	dp_test_fail_unless(!memcmp(&rec[9], "\x64\x40\x00\x01", 4),
+			    "wrong subscriber address");
+	dp_test_fail_unless(!memcmp(&rec[13], "\x01\x01\x01\x0b", 4),
+			    "wrong public address");
+	dp_test_fail_unless(rec[17] == 0x04 && rec[18] == 0x00,
+			    "wrong port range start");
+
+	dpt_cgn_cmd_fmt(false, true,
+			"cgn-cfg events ipfix port-block-allocation disable");
+	dpt_cgn_cmd_fmt(false, true, "cgn-cfg events ipfix delete");
+	unlink(path);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
+/*
+ * cgnat_det1 -- Tests deterministic translation.  Each subscriber is
+ * given the port-block computed from its position in the match
+ * address-group.  There are 126 blocks of 512 ports per public address.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_det1, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_det1, test)
+{
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20");
+
+	cgnat_policy_add2("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			  "dp2T1", "trans-type=napt-det");
+
+	/* Subscriber 0 */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Subscriber 1 */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.2", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 1536, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Subscriber 127 is given the second block of the next address */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.128", 49152, "1.1.1.1", 80,
+		  "1.1.1.12", 1536, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* A second flow from subscriber 0 stays in its block */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 49153, "1.1.1.1", 80,
+		  "1.1.1.11", 1025, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
+/*
+ * cgnat_det2 -- Tests deterministic translation with more match ranges
+ * than used to be supported.  Each /30 prefix holds two subscribers, so
+ * the first subscriber of the twentieth prefix is subscriber 38.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_det2, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_det2, test)
+{
+	char real_ifname[IFNAMSIZ];
+	uint i;
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20");
+
+	dpt_addr_grp_create("POLICY1_AG", "100.64.0.0/30");
+	for (i = 1; i < 20; i++)
+		dp_test_npf_cmd_fmt(false,
+				    "npf-ut fw table add POLICY1_AG "
+				    "100.64.%u.0/30", i);
+
+	dp_test_intf_real("dp2T1", real_ifname);
+	dp_test_npf_cmd_fmt(false,
+			    "cgn-ut policy add POLICY1 priority=10 "
+			    "match-ag=POLICY1_AG pool=POOL1 "
+			    "trans-type=napt-det");
+	dp_test_npf_cmd_fmt(false,
+			    "cgn-ut policy attach name=POLICY1 intf=%s",
+			    real_ifname);
+
+	/* Subscriber 0 */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Subscriber 38, in the twentieth range */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.19.1", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 20480, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Subscriber 39 */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.19.2", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 20992, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Subscriber 19, in a range from the middle of the array */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.9.2", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 10752, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
+/*
+ * cgnat_det3 -- Tests a deterministic mapping that needs more port-blocks
+ * than the pool has is rejected, and leaves the policy as it was.  The
+ * pool has two public addresses of two blocks each, and the match
+ * address-group a whole /24.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_det3, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_det3, test)
+{
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.12 "
+			"port-range=1024-1151 "
+			"block-size=64");
+
+	cgnat_policy_add2("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			  "dp2T1", NULL);
+
+	/* Too many subscribers for the pool */
+	dpt_cgn_cmd_fmt(false, false,
+			"cgn-ut policy add POLICY1 priority=10 "
+			"match-ag=POLICY1_AG pool=POOL1 "
+			"trans-type=napt-det");
+
+	/*
+	 * Still dynamic, so the third subscriber is given the first block
+	 * of the first address rather than the first block of the second.
+	 */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.3", 49152, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
+/*
+ * cgnat_lu1 -- Tests unused public addresses are allocated before any
+ * address is shared, and then the least used addresses in turn.  Each
+ * public address has two port-blocks.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_lu1, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_lu1, test)
+{
+	const char *subs[] = {
+		"100.64.0.1", "100.64.0.2", "100.64.0.3",
+		"100.64.0.4", "100.64.0.5", "100.64.0.6",
+	};
+	const char *pub[] = {
+		"1.1.1.11", "1.1.1.12", "1.1.1.13",
+		"1.1.1.11", "1.1.1.12", "1.1.1.13",
+	};
+	uint i;
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.13 "
+			"port-range=1024-1151 "
+			"block-size=64");
+
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	for (i = 0; i < ARRAY_SIZE(subs); i++)
+		cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+			  subs[i], 49152, "1.1.1.1", 80,
+			  pub[i], i < 3 ? 1024 : 1088, "1.1.1.1", 80,
+			  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+			  DP_TEST_FWD_FORWARDED);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
 /*
  * npf_cgnat_50 - Tests policy address-group prefix matching
  *
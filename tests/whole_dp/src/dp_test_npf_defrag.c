@@ -17,6 +17,9 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "npf/fragment/ipv4_frag_tbl.h"
+#include "npf/fragment/ipv4_rsmbl.h"
+#include "npf/fragment/ipv6_rsmbl_tbl.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -395,6 +398,94 @@ DP_START_TEST(defrag5, test)
 
 } DP_END_TEST;
 
+/*
+ * The per-lcore reassembly tables.  The tests run on the master thread,
+ * so create and use the table of lcore 0 directly, as the lcore would.
+ * Sets are found again by their key, are expired by the lcore, and are
+ * freed when the lcore stops polling.
+ */
+DP_DECL_TEST_CASE(npf_defrag, defrag_lcore_tbl, NULL, NULL);
+DP_START_TEST(defrag_lcore_tbl, test)
+{
+	struct ipv4_frag_key key4 = {
+		.src_dst = 0x0202020201010101UL,
+		.id = 1,
+		.vrfid = VRF_DEFAULT_ID,
+	};
+	struct ipv6_frag_key key6 = {
+		.src_dst = { 0x20010db8, 0, 0, 1, 0x20010db8, 0, 0, 2 },
+		.id = 1,
+		.vrfid = VRF_DEFAULT_ID,
+	};
+	struct ipv4_frag_pkt *fp4, *fp4b;
+	struct ipv6_frag_pkt *fp6, *fp6b;
+	struct ipv4_frag_tbl *tbl4;
+	struct ipv6_frag_tbl *tbl6;
+
+	fragment_tables_lcore_init(0);
+
+	tbl4 = ipv4_frag_tbl_lcore_get(0);
+	dp_test_fail_unless(tbl4, "no IPv4 table for lcore 0");
+
+	fp4 = ipv4_frag_find(tbl4, &key4);
+	dp_test_fail_unless(ipv4_frag_find(tbl4, &key4) == fp4,
+			    "IPv4 set not found again");
+
+	/* Same datagram id in another VRF */
+	key4.vrfid = VRF_DEFAULT_ID + 1;
+	fp4b = ipv4_frag_find(tbl4, &key4);
+	dp_test_fail_unless(fp4b != fp4, "IPv4 set shared between VRFs");
+	dp_test_fail_unless(ipv4_frag_tbl_used(tbl4) == 2,
+			    "IPv4 sets used %u", ipv4_frag_tbl_used(tbl4));
+
+	/* Nothing has expired yet, and the master leaves lcore tables be */
+	ipv4_frag_tbl_service(0);
+	fp4->pkt_expire = 0;
+	ipv4_frag_tbl_gc();
+	dp_test_fail_unless(ipv4_frag_tbl_used(tbl4) == 2,
+			    "IPv4 sets used %u after gc",
+			    ipv4_frag_tbl_used(tbl4));
+
+	/* The oldest set expires first */
+	ipv4_frag_tbl_service(0);
+	dp_test_fail_unless(ipv4_frag_tbl_used(tbl4) == 1,
+			    "IPv4 sets used %u after expiry",
+			    ipv4_frag_tbl_used(tbl4));
+
+	/* Sets left when the lcore stops polling are freed */
+	fragment_tables_release(0);
+	dp_test_fail_unless(ipv4_frag_tbl_used(tbl4) == 0,
+			    "IPv4 sets used %u at end",
+			    ipv4_frag_tbl_used(tbl4));
+
+	tbl6 = ipv6_frag_tbl_lcore_get(0);
+	dp_test_fail_unless(tbl6, "no IPv6 table for lcore 0");
+
+	fp6 = ipv6_frag_find_or_create(tbl6, &key6);
+	dp_test_fail_unless(ipv6_frag_find_or_create(tbl6, &key6) == fp6,
+			    "IPv6 set not found again");
+
+	key6.id = 2;
+	fp6b = ipv6_frag_find_or_create(tbl6, &key6);
+	dp_test_fail_unless(fp6b != fp6, "IPv6 sets share an entry");
+
+	fp6->pkt_expire = 0;
+	ipv6_frag_tbl_gc();
+	dp_test_fail_unless(ipv6_frag_tbl_used(tbl6) == 2,
+			    "IPv6 sets used %u after gc",
+			    ipv6_frag_tbl_used(tbl6));
+
+	ipv6_frag_tbl_service(0);
+	dp_test_fail_unless(ipv6_frag_tbl_used(tbl6) == 1,
+			    "IPv6 sets used %u after expiry",
+			    ipv6_frag_tbl_used(tbl6));
+
+	fragment_tables_release(0);
+	dp_test_fail_unless(ipv6_frag_tbl_used(tbl6) == 0,
+			    "IPv6 sets used %u at end",
+			    ipv6_frag_tbl_used(tbl6));
+} DP_END_TEST;
+
 static void defrag_setup(void)
 {
 	dp_test_nl_add_ip_addr_and_connected("dp1T0", "100.64.0.254/16");
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane DPI classification budget and statistics tests
+ */
+
+#include <rte_mempool.h>
+#include <unistd.h>
+
+#include "dp_test.h"
+#include "dp_test_str.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_console.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_npf_lib.h"
+#include "dp_test_npf_fw_lib.h"
+#include "dp_test_npf_sess_lib.h"
+
+/* Name of the nDPI flow state pool, in src/npf/dpi/ndpi.c */
+#define DPI_NDPI_STATE_POOL	"ndpi_flow_state"
+
+/* Packets sent in each flow, more than any budget used below */
+#define DPI_TEST_PKTS		6
+
+/* Payload of each packet */
+#define DPI_TEST_PAYLOAD	20
+
+DP_DECL_TEST_SUITE(npf_dpi);
+
+DP_DECL_TEST_CASE(npf_dpi, dpi_budget, NULL, NULL);
+
+static void
+dpi_test_cmd(const char *cmd)
+{
+	char *reply;
+	bool err;
+
+	reply = dp_test_console_request_w_err(cmd, &err, false);
+	dp_test_fail_unless(!err, "\"%s\" failed: %s", cmd,
+			    reply ? reply : "");
+	free(reply);
+}
+
+/*
+ * Get the counters of an application from "app-op show dpi stats".
+ * Returns false if the application has no counters.
+ */
+static bool
+dpi_test_app_stats(const char *app, int *flows, int *pkts)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *japp;
+	bool found = false;
+
+	struct dp_test_json_find_key key[] = {
+		{ "dpi", NULL },
+		{ "applications", NULL },
+		{ "app-name", app },
+	};
+
+	jresp = dp_test_json_do_show_cmd("app-op show dpi stats",
+					 &mismatches, false);
+	dp_test_fail_unless(jresp, "no response to \"app-op show dpi stats\"");
+
+	japp = dp_test_json_find(jresp, key, ARRAY_SIZE(key));
+	if (japp) {
+		found = dp_test_json_int_field_from_obj(japp, "flows",
+							flows) &&
+			dp_test_json_int_field_from_obj(japp, "packets",
+							pkts);
+		json_object_put(japp);
+	}
+
+	json_object_put(jresp);
+	return found;
+}
+
+static void
+dpi_test_check_budget(unsigned int pkts, unsigned int bytes)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{ \"dpi\": "
+		"  { \"budget\": "
+		"    { \"packets\": %u, "
+		"      \"bytes\": %u "
+		"    } "
+		"  } "
+		"}",
+		pkts, bytes);
+	dp_test_check_json_state("app-op show dpi stats", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * Wait for the nDPI flow states in use to drop to the given number.  They
+ * are returned to the pool after an RCU grace period.
+ */
+static void
+dpi_test_wait_states(struct rte_mempool *pool, unsigned int in_use)
+{
+	unsigned int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (rte_mempool_in_use_count(pool) == in_use)
+			return;
+		usleep(1000);
+	}
+	dp_test_fail("nDPI flow states in use: %u, expected %u",
+		     rte_mempool_in_use_count(pool), in_use);
+}
+
+/*
+ * An app-firewall inspects the flow with the user engine, which finds the
+ * application from the app rules on the first packet, and with nDPI, which
+ * does not recognise the payload.  The flow is inspected until it spends
+ * its budget, then nDPI gives up on it and releases its state, and the
+ * flow's packets are added to the counters of the application the user
+ * engine found.
+ */
+static void
+dpi_budget_main(unsigned int budget_pkts, unsigned int budget_bytes,
+		unsigned int inspected)
+{
+	struct dp_test_expected *test_exp;
+	struct rte_mempool *pool;
+	struct rte_mbuf *test_pak;
+	unsigned int base, i;
+	int flows, pkts;
+	char cmd[64];
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = DPI_TEST_PAYLOAD,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 41001,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	struct dp_test_npf_rule_t rules[] = {
+		{"10", PASS, STATEFUL,
+		 "proto=17 rproc=app-firewall(DPI_AFW)"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "FW1_IN", .enable = 1,
+		.attach_point = "dp1T0", .fwd = FWD, .dir = "in",
+		.rules = rules
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	dp_test_npf_cmd_fmt(false, "npf-ut add app:DPI_APP 10 action=accept "
+			    "proto=17 rproc=app(myapp,mytype,myproto)");
+	dp_test_npf_cmd_fmt(false, "npf-ut add app-firewall:DPI_AFW 10 "
+			    "action=accept engine=user name=myapp");
+	dp_test_npf_commit();
+	dp_test_npf_fw_add(&fw, false);
+
+	dpi_test_cmd("app-op clear dpi stats");
+	snprintf(cmd, sizeof(cmd), "app-op dpi budget %u %u",
+		 budget_pkts, budget_bytes);
+	dpi_test_cmd(cmd);
+	dpi_test_check_budget(budget_pkts, budget_bytes);
+
+	pool = rte_mempool_lookup(DPI_NDPI_STATE_POOL);
+	dp_test_fail_unless(pool, "no nDPI flow state pool");
+	base = rte_mempool_in_use_count(pool);
+
+	for (i = 1; i <= DPI_TEST_PKTS; i++) {
+		test_pak = dp_test_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.rx_intf, test_exp);
+
+		if (i < inspected) {
+			/* Still being inspected, so nDPI holds its state */
+			dp_test_fail_unless(rte_mempool_in_use_count(pool) ==
+					    base + 1,
+					    "packet %u: no nDPI flow state", i);
+			dp_test_fail_unless(
+				!dpi_test_app_stats("myapp", &flows, &pkts),
+				"packet %u: flow counted before inspection "
+				"ended", i);
+			continue;
+		}
+
+		/* Given up, released, and no longer inspected */
+		dpi_test_wait_states(pool, base);
+		dp_test_fail_unless(
+			dpi_test_app_stats("myapp", &flows, &pkts),
+			"packet %u: no counters for myapp", i);
+		dp_test_fail_unless(flows == 1 && pkts == (int)inspected,
+				    "packet %u: myapp flows %d packets %d, "
+				    "expected 1 and %u", i, flows, pkts,
+				    inspected);
+	}
+	dp_test_npf_session_count_verify(1);
+
+	dpi_test_cmd("app-op clear dpi stats");
+	dp_test_fail_unless(!dpi_test_app_stats("myapp", &flows, &pkts),
+			    "myapp counters not cleared");
+
+	dpi_test_cmd("app-op dpi budget 0 0");
+	dpi_test_check_budget(0, 0);
+
+	dp_test_npf_cleanup();
+	dp_test_npf_fw_del(&fw, false);
+	dp_test_npf_cmd_fmt(false, "npf-ut delete app-firewall:DPI_AFW 10");
+	dp_test_npf_cmd_fmt(false, "npf-ut delete app:DPI_APP 10");
+	dp_test_npf_commit();
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+}
+
+/* A packet budget ends inspection after that many packets. */
+DP_START_TEST(dpi_budget, packets)
+{
+	dpi_budget_main(3, 0, 3);
+} DP_END_TEST;
+
+/* A byte budget ends inspection once that much payload has been seen. */
+DP_START_TEST(dpi_budget, bytes)
+{
+	dpi_budget_main(0, 2 * DPI_TEST_PAYLOAD + 1, 3);
+} DP_END_TEST;
@@ -2167,6 +2167,256 @@ repeat_test:
 
 } DP_END_TEST;
 
+/*
+ * Send a UDP packet from 1.1.1.2 to 2.2.2.1 on the given port.
+ */
+static void
+fw_rule_reuse_pkt(uint16_t dport, enum dp_test_fwd_result_e fwd_status)
+{
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+
+	struct dp_test_pkt_desc_t v4_pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = dport,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	test_pak = dp_test_v4_pkt_from_desc(&v4_pkt);
+	test_exp = dp_test_exp_from_desc(test_pak, &v4_pkt);
+	spush(test_exp->description, sizeof(test_exp->description),
+	      "dport %u", dport);
+	dp_test_exp_set_fwd_status(test_exp, fwd_status);
+
+	dp_test_pak_receive(test_pak, v4_pkt.rx_intf, test_exp);
+}
+
+/*
+ * Rule reuse across commits
+ *
+ * When a ruleset is rebuilt, a rule with an unchanged config line is built
+ * from the rule it replaces and keeps its counters.  A changed rule starts
+ * counting again, and a rule whose port-group or address-group has changed
+ * matches on the new contents of the group.
+ */
+DP_START_TEST(fw_ipv4, rule_reuse)
+{
+	struct dp_test_npf_rule_t rules[] = {
+		{"10", PASS, STATELESS, "proto=17 dst-port-group=PG_REUSE"},
+		{"20", PASS, STATELESS, "proto=17 dst-port=2000"},
+		{"30", PASS, STATELESS,
+		 "proto=17 dst-port=3000 dst-addr-group=AG_REUSE"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "FW1_IN",
+		.enable = 1,
+		.attach_point = "dp1T0",
+		.fwd = FWD,
+		.dir = "in",
+		.rules = rules
+	};
+
+	/* Setup interfaces and neighbours */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2",
+				  "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1",
+				  "aa:bb:cc:dd:2:b1");
+
+	dp_test_npf_fw_addr_group_add("AG_REUSE");
+	dp_test_npf_fw_addr_group_addr_add("AG_REUSE", "2.2.2.1");
+	dp_test_npf_fw_port_group_add("PG_REUSE", "1000");
+
+	dp_test_npf_fw_add(&fw, npf_fw_debug);
+
+	fw_rule_reuse_pkt(1000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(2000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(3000, DP_TEST_FWD_FORWARDED);
+	dp_test_npf_verify_rule_pkt_count("initial", &fw, "10", 1);
+	dp_test_npf_verify_rule_pkt_count("initial", &fw, "20", 1);
+	dp_test_npf_verify_rule_pkt_count("initial", &fw, "30", 1);
+
+	/*
+	 * Adding a rule rebuilds the ruleset.  The other rules are
+	 * unchanged, so keep their counters.
+	 */
+	dp_test_npf_cmd_fmt(npf_fw_debug, "npf-ut add fw:FW1_IN 40 "
+			    "action=accept proto=17 dst-port=4000");
+	dp_test_npf_commit();
+
+	dp_test_npf_verify_rule_pkt_count("rule added", &fw, "10", 1);
+	dp_test_npf_verify_rule_pkt_count("rule added", &fw, "20", 1);
+	dp_test_npf_verify_rule_pkt_count("rule added", &fw, "30", 1);
+
+	fw_rule_reuse_pkt(1000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(4000, DP_TEST_FWD_FORWARDED);
+	dp_test_npf_verify_rule_pkt_count("rule added", &fw, "10", 2);
+	dp_test_npf_verify_rule_pkt_count("rule added", &fw, "40", 1);
+
+	/*
+	 * A changed rule is built again, matches on its new config, and
+	 * starts counting from zero.
+	 */
+	dp_test_npf_cmd_fmt(npf_fw_debug, "npf-ut add fw:FW1_IN 20 "
+			    "action=accept proto=17 dst-port=2001");
+	dp_test_npf_commit();
+
+	dp_test_npf_verify_rule_pkt_count("rule changed", &fw, "20", 0);
+	dp_test_npf_verify_rule_pkt_count("rule changed", &fw, "10", 2);
+
+	fw_rule_reuse_pkt(2000, DP_TEST_FWD_DROPPED);
+	fw_rule_reuse_pkt(2001, DP_TEST_FWD_FORWARDED);
+	dp_test_npf_verify_rule_pkt_count("rule changed", &fw, "20", 1);
+
+	/*
+	 * A port-group is inlined into the ncode of the rules using it, so
+	 * changing it regenerates the ncode of rule 10.  Its config line is
+	 * unchanged, so it keeps its counters.
+	 */
+	dp_test_npf_fw_port_group_add("PG_REUSE", "1001");
+	dp_test_npf_commit();
+
+	fw_rule_reuse_pkt(1000, DP_TEST_FWD_DROPPED);
+	fw_rule_reuse_pkt(1001, DP_TEST_FWD_FORWARDED);
+	dp_test_npf_verify_rule_pkt_count("port-group changed", &fw, "10", 3);
+
+	/*
+	 * The ncode of a rule using an address-group is always regenerated,
+	 * and matches on the current contents of the group after the
+	 * ruleset is rebuilt.
+	 */
+	dp_test_npf_fw_addr_group_addr_del("AG_REUSE", "2.2.2.1");
+	dp_test_npf_cmd_fmt(npf_fw_debug, "npf-ut delete fw:FW1_IN 40");
+	dp_test_npf_commit();
+
+	fw_rule_reuse_pkt(3000, DP_TEST_FWD_DROPPED);
+	dp_test_npf_verify_rule_pkt_count("address-group changed", &fw,
+					  "30", 1);
+
+	dp_test_npf_fw_addr_group_addr_add("AG_REUSE", "2.2.2.1");
+	fw_rule_reuse_pkt(3000, DP_TEST_FWD_FORWARDED);
+	dp_test_npf_verify_rule_pkt_count("address-group changed", &fw,
+					  "30", 2);
+
+	/* Cleanup */
+	dp_test_npf_fw_del(&fw, npf_fw_debug);
+
+	dp_test_npf_fw_port_group_del("PG_REUSE");
+	dp_test_npf_fw_addr_group_addr_del("AG_REUSE", "2.2.2.1");
+	dp_test_npf_fw_addr_group_del("AG_REUSE");
+	dp_test_npf_commit();
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2",
+				  "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1",
+				  "aa:bb:cc:dd:2:b1");
+
+} DP_END_TEST;
+
+/*
+ * Group reuse across commits
+ *
+ * Changing one of two groups on an interface rebuilds the ruleset.  The
+ * unchanged group reuses the match contexts of the group it replaces,
+ * which must return its new rules.
+ */
+DP_START_TEST(fw_ipv4, group_reuse)
+{
+	struct dp_test_npf_rule_t rules1[] = {
+		{"10", PASS, STATELESS, "proto=17 dst-port=1000"},
+		{"20", PASS, STATELESS, "proto=17 dst-port=2000"},
+		NULL_RULE };
+
+	struct dp_test_npf_rule_t rules2[] = {
+		{"10", PASS, STATELESS, "proto=17 dst-port=3000"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw1 = {
+		.rstype = "fw-in",
+		.name = "FW1_IN",
+		.enable = 1,
+		.attach_point = "dp1T0",
+		.fwd = FWD,
+		.dir = "in",
+		.rules = rules1
+	};
+
+	struct dp_test_npf_ruleset_t fw2 = {
+		.rstype = "fw-in",
+		.name = "FW2_IN",
+		.enable = 1,
+		.attach_point = "dp1T0",
+		.fwd = FWD,
+		.dir = "in",
+		.rules = rules2
+	};
+
+	/* Setup interfaces and neighbours */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2",
+				  "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1",
+				  "aa:bb:cc:dd:2:b1");
+
+	dp_test_npf_fw_add(&fw1, npf_fw_debug);
+	dp_test_npf_fw_add(&fw2, npf_fw_debug);
+
+	fw_rule_reuse_pkt(1000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(2000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(4000, DP_TEST_FWD_DROPPED);
+
+	/* Change FW2_IN only */
+	dp_test_npf_cmd_fmt(npf_fw_debug, "npf-ut add fw:FW2_IN 20 "
+			    "action=accept proto=17 dst-port=4000");
+	dp_test_npf_commit();
+
+	fw_rule_reuse_pkt(1000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(2000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(4000, DP_TEST_FWD_FORWARDED);
+	fw_rule_reuse_pkt(5000, DP_TEST_FWD_DROPPED);
+
+	dp_test_npf_verify_rule_pkt_count("group reused", &fw1, "10", 2);
+	dp_test_npf_verify_rule_pkt_count("group reused", &fw1, "20", 2);
+	dp_test_npf_verify_rule_pkt_count("group changed", &fw2, "20", 1);
+
+	/* Cleanup */
+	dp_test_npf_fw_del(&fw2, npf_fw_debug);
+	dp_test_npf_fw_del(&fw1, npf_fw_debug);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2",
+				  "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1",
+				  "aa:bb:cc:dd:2:b1");
+
+} DP_END_TEST;
+
 DP_START_TEST(fw_ipv4, macvlan)
 {
 	struct dp_test_npf_rule_t rules[] = {
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Test dataplane per-lcore counters
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "dp_percpu.h"
+#include "util.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test/dp_test_macros.h"
+
+DP_DECL_TEST_SUITE(percpu);
+
+DP_DECL_TEST_CASE(percpu, percpu_counter, NULL, NULL);
+
+#define PERCPU_TEST_NVALS	3
+
+static void
+percpu_test_check(const struct dp_percpu_counter *pc,
+		  const uint64_t exp[PERCPU_TEST_NVALS])
+{
+	unsigned int idx;
+	uint64_t val;
+
+	for (idx = 0; idx < PERCPU_TEST_NVALS; idx++) {
+		val = dp_percpu_counter_read(pc, idx);
+		dp_test_fail_unless(val == exp[idx],
+				    "counter %u is %lu, expected %lu",
+				    idx, val, exp[idx]);
+	}
+}
+
+/*
+ * Update each lcore's copy in turn, by taking on its lcore id, and check
+ * that reads sum all of the copies.
+ */
+DP_START_TEST(percpu_counter, alloc_add_read_clear)
+{
+	unsigned int lcore, saved = dp_lcore_id();
+	uint64_t exp[PERCPU_TEST_NVALS] = { 0 };
+	struct dp_percpu_counter *pc;
+
+	dp_test_fail_unless(!dp_percpu_counter_alloc(0),
+			    "allocated with no counters");
+
+	pc = dp_percpu_counter_alloc(PERCPU_TEST_NVALS);
+	dp_test_fail_unless(pc, "failed to allocate counters");
+	dp_test_fail_unless(pc->pc_nr_copies == get_lcore_max() + 1,
+			    "%u copies, expected %u", pc->pc_nr_copies,
+			    get_lcore_max() + 1);
+	percpu_test_check(pc, exp);
+
+	FOREACH_DP_LCORE(lcore) {
+		RTE_PER_LCORE(_dp_lcore_id) = lcore;
+
+		dp_percpu_counter_inc(pc, 0);
+		dp_percpu_counter_add(pc, 1, 100 + lcore);
+		exp[0] += 1;
+		exp[1] += 100 + lcore;
+	}
+	RTE_PER_LCORE(_dp_lcore_id) = saved;
+	percpu_test_check(pc, exp);
+
+	/* Out of range reads as zero */
+	dp_test_fail_unless(dp_percpu_counter_read(pc, PERCPU_TEST_NVALS) == 0,
+			    "out of range counter is not zero");
+
+	/* Clearing leaves the copies alone, and counts on from zero */
+	dp_percpu_counter_clear(pc);
+	memset(exp, 0, sizeof(exp));
+	percpu_test_check(pc, exp);
+
+	dp_percpu_counter_add(pc, 2, 7);
+	dp_percpu_counter_inc(pc, 0);
+	exp[2] = 7;
+	exp[0] = 1;
+	percpu_test_check(pc, exp);
+
+	dp_percpu_counter_free(pc);
+} DP_END_TEST;
+
+static void *
+percpu_test_thread(void *arg)
+{
+	struct dp_percpu_counter *pc = arg;
+
+	dp_percpu_counter_add(pc, 0, 5);
+	return NULL;
+}
+
+/*
+ * A thread that is not an EAL lcore updates the copy of lcore 0.
+ */
+DP_START_TEST(percpu_counter, non_eal)
+{
+	uint64_t exp[PERCPU_TEST_NVALS] = { 5 };
+	struct dp_percpu_counter *pc;
+	pthread_t thread;
+	int rc;
+
+	pc = dp_percpu_counter_alloc(PERCPU_TEST_NVALS);
+	dp_test_fail_unless(pc, "failed to allocate counters");
+
+	rc = pthread_create(&thread, NULL, percpu_test_thread, pc);
+	dp_test_fail_unless(rc == 0, "failed to create thread: %d", rc);
+	pthread_join(thread, NULL);
+
+	percpu_test_check(pc, exp);
+	dp_test_fail_unless(pc->pc_vals[0] == 5,
+			    "lcore 0 copy is %lu, expected 5", pc->pc_vals[0]);
+
+	dp_percpu_counter_free(pc);
+} DP_END_TEST;
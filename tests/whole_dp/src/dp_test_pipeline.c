@@ -7,6 +7,8 @@
  *
  * Whole dataplane test pipeline tests
  */
+#include <inttypes.h>
+
 #include "dp_test.h"
 #include "dp_test_str.h"
 #include "dp_test_lib_internal.h"
@@ -17,6 +19,7 @@
 #include "dp_test_json_utils.h"
 #include "dp_test_netlink_state_internal.h"
 #include "dp_test_console.h"
+#include "perf_profile.h"
 
 #include "src/pipeline/nodes/sample/SampleFeatConfig.pb-c.h"
 #include "src/pipeline/nodes/sample/SampleFeatOp.pb-c.h"
@@ -245,3 +248,134 @@ DP_START_TEST(dyn_feat, dyn_feat_ipv4)
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(pipeline, perf, NULL, NULL);
+
+/*
+ * The profile is always reported, but only has data when the
+ * dataplane is built with profiling, as the tests are unless they
+ * are built as benchmarks.
+ */
+DP_START_TEST(perf, perf_show_clear)
+{
+	json_object *expected;
+
+	dp_test_console_request_reply("pipeline perf clear", false);
+
+	expected = dp_test_json_create("{ \"perf\": "
+				       "  { \"enabled\": %s } "
+				       "}",
+				       PERF_PROFILE_ENABLED ?
+				       "true" : "false");
+	dp_test_check_json_state("pipeline perf show", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+} DP_END_TEST;
+
+/* Packets forwarded while profiling */
+#define PERF_TEST_PKTS	4
+
+/*
+ * Get the calls and cycles of a node in the profile. Returns false if the
+ * node has not been called since the profile was cleared.
+ */
+static bool
+dp_test_pl_perf_node(const char *node, uint64_t *calls, uint64_t *cycles)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jnode, *jval;
+
+	struct dp_test_json_find_key key[] = {
+		{ "perf", NULL },
+		{ "node", NULL },
+		{ node, NULL },
+	};
+
+	jresp = dp_test_json_do_show_cmd("pipeline perf show", &mismatches,
+					 false);
+	dp_test_fail_unless(jresp, "no response to \"pipeline perf show\"");
+
+	jnode = dp_test_json_find(jresp, key, ARRAY_SIZE(key));
+	json_object_put(jresp);
+	if (!jnode)
+		return false;
+
+	*calls = *cycles = 0;
+	if (json_object_object_get_ex(jnode, "calls", &jval))
+		*calls = json_object_get_int64(jval);
+	if (json_object_object_get_ex(jnode, "cycles", &jval))
+		*cycles = json_object_get_int64(jval);
+	json_object_put(jnode);
+
+	return true;
+}
+
+/*
+ * Forwarded packets are counted against the nodes they pass through, and
+ * clearing the profile resets the counts.
+ */
+DP_START_TEST(perf, perf_node_counts)
+{
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+	uint64_t calls, cycles;
+	unsigned int i;
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 41001,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	/* Only built in to benchmarks when configured */
+	if (!PERF_PROFILE_ENABLED)
+		return;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	dp_test_console_request_reply("pipeline perf clear", false);
+	dp_test_fail_unless(!dp_test_pl_perf_node("vyatta:ipv4-validate",
+						  &calls, &cycles),
+			    "ipv4-validate profiled before forwarding");
+
+	for (i = 0; i < PERF_TEST_PKTS; i++) {
+		test_pak = dp_test_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.rx_intf, test_exp);
+	}
+
+	dp_test_fail_unless(dp_test_pl_perf_node("vyatta:ipv4-validate",
+						 &calls, &cycles),
+			    "ipv4-validate not profiled");
+	dp_test_fail_unless(calls >= PERF_TEST_PKTS,
+			    "ipv4-validate called %" PRIu64 " times, "
+			    "expected at least %u", calls, PERF_TEST_PKTS);
+	dp_test_fail_unless(cycles > 0, "ipv4-validate took no cycles");
+
+	dp_test_console_request_reply("pipeline perf clear", false);
+	dp_test_fail_unless(!dp_test_pl_perf_node("vyatta:ipv4-validate",
+						  &calls, &cycles),
+			    "ipv4-validate profiled after clear");
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+} DP_END_TEST;
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane power profile tests
+ */
+
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test/dp_test_cmd_check.h"
+
+DP_DECL_TEST_SUITE(power_suite);
+
+DP_DECL_TEST_CASE(power_suite, power_mode, NULL, NULL);
+
+static void
+dp_test_check_power_mode(const char *name, unsigned int intr_thresh,
+			 unsigned int intr_timeout, bool freq_scale)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{ \"mode\": "
+		"  { \"name\": \"%s\", "
+		"    \"intr_thresh\": %u, "
+		"    \"intr_timeout\": %u, "
+		"    \"freq_scale\": %s "
+		"  } "
+		"}",
+		name, intr_thresh, intr_timeout,
+		freq_scale ? "true" : "false");
+	dp_test_check_json_state("mode", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * Each profile has its own RX interrupt thresholds, and a custom
+ * profile can set them or leave interrupts off.  Only power-save waits
+ * for interrupts by default.
+ */
+DP_START_TEST(power_mode, intr_thresholds)
+{
+	dp_test_check_power_mode("balanced", 0, 0, false);
+
+	dp_test_send_config_src(dp_test_cont_src_get(), "mode power-save");
+	dp_test_check_power_mode("power-save", 500, 100, true);
+
+	dp_test_send_config_src(dp_test_cont_src_get(), "mode low-latency");
+	dp_test_check_power_mode("low-latency", 0, 0, false);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"mode custom 100 10 250");
+	dp_test_check_power_mode("custom", 0, 0, false);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"mode custom 100 10 250 2000 50 freq-scale");
+	dp_test_check_power_mode("custom", 2000, 50, true);
+
+	dp_test_send_config_src(dp_test_cont_src_get(), "mode balanced");
+	dp_test_check_power_mode("balanced", 0, 0, false);
+} DP_END_TEST;
+
+/*
+ * An idle lcore that owns a transmit queue waits for an interrupt once the
+ * queue is flushed, as the lcores feeding its ring wake it.  It keeps
+ * polling while a packet is still pending, or if interrupts are off.
+ */
+DP_START_TEST(power_mode, intr_txq)
+{
+	uint8_t portid = dp_test_intf_name2port("dp1T0");
+
+	dp_test_fail_unless(!lcore_txq_can_intr(portid, false),
+			    "tx lcore waits for interrupts in balanced mode");
+
+	dp_test_send_config_src(dp_test_cont_src_get(), "mode power-save");
+	dp_test_check_power_mode("power-save", 500, 100, true);
+
+	dp_test_fail_unless(lcore_txq_can_intr(portid, false),
+			    "flushed tx lcore does not wait for interrupts");
+	dp_test_fail_unless(!lcore_txq_can_intr(portid, true),
+			    "tx lcore waits with a packet pending");
+
+	dp_test_send_config_src(dp_test_cont_src_get(), "mode balanced");
+	dp_test_check_power_mode("balanced", 0, 0, false);
+} DP_END_TEST;
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Route and FIB programming benchmarks.
+ *
+ * These measure how fast routes sent by the route broker are installed,
+ * rather than checking behaviour, so are only built into the test binary
+ * when configured with --enable-whole_dp_bench.  Run them with:
+ *
+ *   make dataplane_test_run CK_RUN_SUITE=dp_test_route_bench.c
+ *
+ * The number of prefixes used may be set with DP_TEST_BENCH_ROUTES and
+ * DP_TEST_BENCH_ROUTES6.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ip_forward.h"
+#include "lpm/lpm.h"
+#include "nh_common.h"
+#include "pktmbuf_internal.h"
+#include "urcu.h"
+#include "vrf_internal.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+#define ROUTE_BENCH_ROUTES_DEF		100000
+#define ROUTE_BENCH_ROUTES6_DEF		20000
+#define ROUTE_BENCH_ECMP_ROUTES		10000
+#define ROUTE_BENCH_ECMP_ROUNDS		4
+#define ROUTE_BENCH_FLAP_ROUTES		10000
+#define ROUTE_BENCH_FLAPS		20
+
+/*
+ * Routes are sent without waiting for each to be installed.  The last one
+ * sent in each phase is the sentinel, and as routes are installed in the
+ * order they are sent, the phase is complete once the sentinel is in the
+ * expected state.
+ */
+#define ROUTE_BENCH_SENTINEL		"10.255.255.0/24"
+#define ROUTE_BENCH_SENTINEL6		"2001:db8:ffff::/48"
+
+/* IPv4 prefix lengths, roughly in the proportions of a BGP full table */
+static const struct {
+	uint8_t plen;
+	uint8_t percent;
+} route_bench_plens[] = {
+	{ 8, 1 }, { 12, 1 }, { 16, 2 }, { 17, 1 }, { 18, 2 }, { 19, 3 },
+	{ 20, 5 }, { 21, 5 }, { 22, 10 }, { 23, 9 }, { 24, 58 }, { 28, 1 },
+	{ 30, 1 }, { 32, 1 },
+};
+
+struct route_bench_pfx {
+	uint32_t addr;		/* host order */
+	uint8_t plen;
+};
+
+struct route_bench_lookup {
+	pthread_t tid;
+	const struct route_bench_pfx *pfx;
+	unsigned int count;
+	struct rte_mbuf *m;
+	bool stop;
+	uint64_t lookups;
+};
+
+static unsigned int route_bench_count(const char *env, unsigned int def)
+{
+	const char *val = getenv(env);
+	unsigned long count;
+
+	if (!val)
+		return def;
+
+	count = strtoul(val, NULL, 10);
+	return count ? count : def;
+}
+
+static double route_bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long route_bench_maxrss_kb(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+static uint32_t route_bench_rand(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 1;
+}
+
+static int route_bench_pfx_cmp(const void *a, const void *b)
+{
+	const struct route_bench_pfx *p1 = a, *p2 = b;
+
+	if (p1->addr != p2->addr)
+		return p1->addr < p2->addr ? -1 : 1;
+	return p1->plen - p2->plen;
+}
+
+/*
+ * Generate a set of unique prefixes, avoiding the addresses used by the
+ * test interfaces, the sentinel, loopback and multicast.
+ */
+static struct route_bench_pfx *
+route_bench_gen(unsigned int count, unsigned int *gen_count)
+{
+	struct route_bench_pfx *pfx;
+	uint32_t seed = 0x5eed;
+	unsigned int i, j, n;
+
+	pfx = calloc(count, sizeof(*pfx));
+	dp_test_fail_unless(pfx, "no memory for %u prefixes", count);
+
+	for (i = 0; i < count; i++) {
+		unsigned int pick = route_bench_rand(&seed) % 100;
+		uint32_t addr;
+		uint8_t first;
+
+		for (j = 0; j < ARRAY_SIZE(route_bench_plens) - 1; j++) {
+			if (pick < route_bench_plens[j].percent)
+				break;
+			pick -= route_bench_plens[j].percent;
+		}
+
+		do {
+			addr = route_bench_rand(&seed) ^
+				(route_bench_rand(&seed) << 16);
+			first = addr >> 24;
+		} while (first < 11 || first == 127 || first >= 224);
+
+		pfx[i].plen = route_bench_plens[j].plen;
+		pfx[i].addr = addr & lpm_depth_to_mask(pfx[i].plen);
+	}
+
+	qsort(pfx, count, sizeof(*pfx), route_bench_pfx_cmp);
+	for (i = 1, n = 1; i < count; i++)
+		if (route_bench_pfx_cmp(&pfx[i], &pfx[n - 1]))
+			pfx[n++] = pfx[i];
+
+	*gen_count = n;
+	return pfx;
+}
+
+static void route_bench_send(const struct route_bench_pfx *pfx, bool add,
+			     const char *paths)
+{
+	char addr[INET_ADDRSTRLEN];
+	uint32_t naddr = htonl(pfx->addr);
+
+	inet_ntop(AF_INET, &naddr, addr, sizeof(addr));
+	if (add)
+		dp_test_nl_add_route_fmt(false, "%s/%u %s", addr, pfx->plen,
+					 paths);
+	else
+		dp_test_nl_del_route_fmt(false, "%s/%u %s", addr, pfx->plen,
+					 paths);
+}
+
+/*
+ * Wait until a lookup of the sentinel gives the expected gateway, or no
+ * route if gw is 0.
+ */
+static void route_bench_wait(struct rte_mbuf *m, const char *gw_str)
+{
+	const struct next_hop *nh;
+	in_addr_t dst, gw = 0;
+	bool done;
+
+	inet_pton(AF_INET, "10.255.255.1", &dst);
+	if (gw_str)
+		inet_pton(AF_INET, gw_str, &gw);
+
+	dp_rcu_register_thread();
+	do {
+		rcu_thread_online();
+		nh = dp_rt_lookup(dst, RT_TABLE_MAIN, m);
+		if (gw)
+			done = nh && nh->gateway.address.ip_v4.s_addr == gw;
+		else
+			done = !nh;
+		rcu_thread_offline();
+		if (!done)
+			usleep(100);
+	} while (!done);
+	dp_rcu_unregister_thread();
+}
+
+static void route_bench_sentinel(struct rte_mbuf *m, const char *gw)
+{
+	dp_test_nl_add_route_fmt(false, ROUTE_BENCH_SENTINEL " nh %s int:dp2T1",
+				 gw);
+	route_bench_wait(m, gw);
+	dp_test_nl_del_route_fmt(false, ROUTE_BENCH_SENTINEL " nh %s int:dp2T1",
+				 gw);
+	route_bench_wait(m, NULL);
+}
+
+static void *route_bench_lookup_thread(void *arg)
+{
+	struct route_bench_lookup *lb = arg;
+	uint64_t lookups = 0;
+	unsigned int i;
+
+	dp_rcu_register_thread();
+	rcu_thread_online();
+
+	while (!CMM_LOAD_SHARED(lb->stop)) {
+		for (i = 0; i < lb->count; i++)
+			dp_rt_lookup(htonl(lb->pfx[i].addr), RT_TABLE_MAIN,
+				     lb->m);
+		lookups += lb->count;
+		rcu_quiescent_state();
+	}
+
+	rcu_thread_offline();
+	dp_rcu_unregister_thread();
+
+	lb->lookups = lookups;
+	return NULL;
+}
+
+static void route_bench_lookup_start(struct route_bench_lookup *lb,
+				     const struct route_bench_pfx *pfx,
+				     unsigned int count, struct rte_mbuf *m)
+{
+	lb->pfx = pfx;
+	lb->count = count;
+	lb->m = m;
+	lb->stop = false;
+	lb->lookups = 0;
+
+	dp_test_fail_unless(!pthread_create(&lb->tid, NULL,
+					    route_bench_lookup_thread, lb),
+			    "failed to start lookup thread");
+}
+
+static uint64_t route_bench_lookup_stop(struct route_bench_lookup *lb)
+{
+	CMM_STORE_SHARED(lb->stop, true);
+	pthread_join(lb->tid, NULL);
+	return lb->lookups;
+}
+
+static void route_bench_report(const char *what, unsigned int count,
+			       double secs, uint64_t lookups)
+{
+	printf("route bench: %-24s %8u in %7.3fs, %10.0f/s", what, count,
+	       secs, count / secs);
+	if (lookups)
+		printf(", lookups %.0f/s", lookups / secs);
+	printf("\n");
+}
+
+/* Print the LPM and next-hop table usage from the summary command */
+static void route_bench_summary(const char *cmd, const char *obj,
+				const char *tbl8_obj)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jstats, *jobj;
+	int total = 0, tbl8 = 0, nh = 0;
+
+	jresp = dp_test_json_do_show_cmd(cmd, &mismatches, false);
+	dp_test_fail_unless(jresp, "no response to \"%s\"", cmd);
+
+	if (json_object_object_get_ex(jresp, obj, &jstats)) {
+		dp_test_json_int_field_from_obj(jstats, "total", &total);
+		jobj = jstats;
+		if (!tbl8_obj ||
+		    json_object_object_get_ex(jstats, tbl8_obj, &jobj))
+			dp_test_json_int_field_from_obj(jobj, "used", &tbl8);
+		if (json_object_object_get_ex(jstats, "nexthop", &jobj))
+			dp_test_json_int_field_from_obj(jobj, "used", &nh);
+	}
+	json_object_put(jresp);
+
+	printf("route bench: %s: routes %d tbl8 groups %d nexthops %d "
+	       "max rss %ld KB\n", cmd, total, tbl8, nh,
+	       route_bench_maxrss_kb());
+}
+
+static struct rte_mbuf *route_bench_pak(void)
+{
+	int len = 20;
+	struct rte_mbuf *m;
+
+	m = dp_test_create_ipv4_pak("1.1.1.2", "10.255.255.1", 1, &len);
+	dp_test_fail_unless(m, "failed to create packet");
+	pktmbuf_set_vrf(m, VRF_DEFAULT_ID);
+	return m;
+}
+
+static void route_bench_setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp3T2", "3.3.3.3/24");
+}
+
+static void route_bench_teardown(void)
+{
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp3T2", "3.3.3.3/24");
+}
+
+DP_DECL_TEST_SUITE(route_bench_suite);
+
+DP_DECL_TEST_CASE(route_bench_suite, route_bench, NULL, NULL);
+
+/*
+ * Install and remove an IPv4 full table, with lookups running on another
+ * thread throughout.
+ */
+DP_START_TEST_BENCH(route_bench, ipv4_full_table)
+{
+	struct route_bench_lookup lb;
+	struct route_bench_pfx *pfx;
+	struct rte_mbuf *m;
+	unsigned int i, count;
+	uint64_t lookups;
+	long rss_start;
+	double start;
+
+	route_bench_setup();
+	m = route_bench_pak();
+	pfx = route_bench_gen(route_bench_count("DP_TEST_BENCH_ROUTES",
+						ROUTE_BENCH_ROUTES_DEF),
+			      &count);
+	rss_start = route_bench_maxrss_kb();
+
+	route_bench_lookup_start(&lb, pfx, count, m);
+
+	start = route_bench_now();
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], true, "nh 2.2.2.1 int:dp2T1");
+	route_bench_sentinel(m, "2.2.2.1");
+	lookups = route_bench_lookup_stop(&lb);
+	route_bench_report("ipv4 add", count, route_bench_now() - start,
+			   lookups);
+
+	route_bench_summary("route summary", "route_stats", NULL);
+	printf("route bench: max rss grew by %ld KB\n",
+	       route_bench_maxrss_kb() - rss_start);
+
+	route_bench_lookup_start(&lb, pfx, count, m);
+
+	start = route_bench_now();
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], false, "nh 2.2.2.1 int:dp2T1");
+	route_bench_sentinel(m, "2.2.2.1");
+	lookups = route_bench_lookup_stop(&lb);
+	route_bench_report("ipv4 delete", count, route_bench_now() - start,
+			   lookups);
+
+	free(pfx);
+	rte_pktmbuf_free(m);
+	route_bench_teardown();
+} DP_END_TEST;
+
+/*
+ * Move a set of ECMP routes back and forth between two sets of paths.
+ */
+DP_START_TEST_BENCH(route_bench, ipv4_ecmp_churn)
+{
+	static const char * const paths[] = {
+		"nh 1.1.1.2 int:dp1T0 nh 2.2.2.1 int:dp2T1",
+		"nh 2.2.2.1 int:dp2T1 nh 3.3.3.1 int:dp3T2",
+	};
+	struct route_bench_lookup lb;
+	struct route_bench_pfx *pfx;
+	struct rte_mbuf *m;
+	unsigned int i, r, count;
+	uint64_t lookups;
+	double start;
+
+	route_bench_setup();
+	m = route_bench_pak();
+	pfx = route_bench_gen(ROUTE_BENCH_ECMP_ROUTES, &count);
+
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], true, paths[0]);
+	route_bench_sentinel(m, "2.2.2.1");
+
+	route_bench_lookup_start(&lb, pfx, count, m);
+
+	start = route_bench_now();
+	for (r = 1; r <= ROUTE_BENCH_ECMP_ROUNDS; r++) {
+		for (i = 0; i < count; i++)
+			route_bench_send(&pfx[i], true, paths[r % 2]);
+		route_bench_sentinel(m, "2.2.2.1");
+	}
+	lookups = route_bench_lookup_stop(&lb);
+	route_bench_report("ipv4 ecmp replace", count * ROUTE_BENCH_ECMP_ROUNDS,
+			   route_bench_now() - start, lookups);
+
+	route_bench_summary("route summary", "route_stats", NULL);
+
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], false, paths[0]);
+	route_bench_sentinel(m, "2.2.2.1");
+
+	free(pfx);
+	rte_pktmbuf_free(m);
+	route_bench_teardown();
+} DP_END_TEST;
+
+/*
+ * Flap the neighbour that a set of routes resolve through.  Each neighbour
+ * change updates the next-hops of every route using it.
+ */
+DP_START_TEST_BENCH(route_bench, ipv4_neigh_flap)
+{
+	struct route_bench_pfx *pfx;
+	struct rte_mbuf *m;
+	unsigned int i, count;
+	double start;
+
+	route_bench_setup();
+	m = route_bench_pak();
+	pfx = route_bench_gen(ROUTE_BENCH_FLAP_ROUTES, &count);
+
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], true, "nh 2.2.2.1 int:dp2T1");
+	route_bench_sentinel(m, "2.2.2.1");
+
+	start = route_bench_now();
+	for (i = 0; i < ROUTE_BENCH_FLAPS; i++) {
+		dp_test_netlink_add_neigh("dp2T1", "2.2.2.1",
+					  "aa:bb:cc:dd:ee:ff");
+		dp_test_netlink_del_neigh("dp2T1", "2.2.2.1",
+					  "aa:bb:cc:dd:ee:ff");
+	}
+	route_bench_report("ipv4 neighbour flap", ROUTE_BENCH_FLAPS * 2,
+			   route_bench_now() - start, 0);
+
+	for (i = 0; i < count; i++)
+		route_bench_send(&pfx[i], false, "nh 2.2.2.1 int:dp2T1");
+	route_bench_sentinel(m, "2.2.2.1");
+
+	free(pfx);
+	rte_pktmbuf_free(m);
+	route_bench_teardown();
+} DP_END_TEST;
+
+/*
+ * Wait until a lookup of the IPv6 sentinel gives a route, or no route.
+ */
+static void route_bench_wait6(struct rte_mbuf *m, bool present)
+{
+	struct in6_addr dst;
+	bool done;
+
+	inet_pton(AF_INET6, "2001:db8:ffff::1", &dst);
+
+	dp_rcu_register_thread();
+	do {
+		rcu_thread_online();
+		done = !!dp_rt6_lookup(&dst, RT_TABLE_MAIN, m) == present;
+		rcu_thread_offline();
+		if (!done)
+			usleep(100);
+	} while (!done);
+	dp_rcu_unregister_thread();
+}
+
+static void route_bench_send6(unsigned int i, bool add)
+{
+	/* Mostly /48s, with some /64s */
+	unsigned int plen = (i % 10 == 0) ? 64 : 48;
+
+	if (add)
+		dp_test_nl_add_route_fmt(
+			false, "2001:%x:%x::/%u nh 2:2:2::1 int:dp2T1",
+			0x1000 + i / 0x10000, i % 0x10000, plen);
+	else
+		dp_test_nl_del_route_fmt(
+			false, "2001:%x:%x::/%u nh 2:2:2::1 int:dp2T1",
+			0x1000 + i / 0x10000, i % 0x10000, plen);
+}
+
+DP_START_TEST_BENCH(route_bench, ipv6_full_table)
+{
+	unsigned int i, count;
+	struct rte_mbuf *m;
+	double start;
+	int len = 20;
+
+	count = route_bench_count("DP_TEST_BENCH_ROUTES6",
+				  ROUTE_BENCH_ROUTES6_DEF);
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2:2:2::2/64");
+	m = dp_test_create_ipv6_pak("2:2:2::1", "2001:db8:ffff::1", 1, &len);
+	dp_test_fail_unless(m, "failed to create packet");
+	pktmbuf_set_vrf(m, VRF_DEFAULT_ID);
+
+	start = route_bench_now();
+	for (i = 0; i < count; i++)
+		route_bench_send6(i, true);
+	dp_test_nl_add_route_fmt(false, ROUTE_BENCH_SENTINEL6
+				 " nh 2:2:2::1 int:dp2T1");
+	route_bench_wait6(m, true);
+	route_bench_report("ipv6 add", count, route_bench_now() - start, 0);
+
+	route_bench_summary("route6 summary", "route6_stats", "tbl8s");
+
+	start = route_bench_now();
+	for (i = 0; i < count; i++)
+		route_bench_send6(i, false);
+	dp_test_nl_del_route_fmt(false, ROUTE_BENCH_SENTINEL6
+				 " nh 2:2:2::1 int:dp2T1");
+	route_bench_wait6(m, false);
+	route_bench_report("ipv6 delete", count, route_bench_now() - start, 0);
+
+	rte_pktmbuf_free(m);
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2:2:2::2/64");
+} DP_END_TEST;
@@ -28,6 +28,8 @@
 #include "npf/npf_if.h"
 #include "npf/npf_cache.h"
 #include "npf/npf_session.h"
+#include "npf/npf_pack.h"
+#include "npf/npf_state.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -35,8 +37,10 @@
 #include "dp_test_lib_internal.h"
 #include "dp_test_lib_intf_internal.h"
 #include "dp_test_lib_exp.h"
+#include "dp_test_lib_pkt.h"
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_session_internal_lib.h"
+#include "dp_test_npf_fw_lib.h"
 #include "dp_test_npf_sess_lib.h"
 
 #define TEST_VRF 69
@@ -1156,3 +1160,280 @@ DP_START_TEST(session_link_walk, test18)
 
 	dp_test_netlink_del_vrf(69, 0);
 } DP_END_TEST;
+
+/*
+ * Bulk packing.  Sessions without an NPF feature cannot be restored, so
+ * are not packed, leaving a valid but empty message.
+ */
+DP_DECL_TEST_CASE(session_suite, session_pack_bulk, NULL, NULL);
+DP_START_TEST(session_pack_bulk, test17)
+{
+	char buf[NPF_PACK_BULK_SESSION_MAX_SIZE * 2];
+	struct npf_pack_message *msg = (struct npf_pack_message *)buf;
+	struct npf_pack_bulk_hdr *bh;
+	enum session_pack_type spt;
+	const struct ifnet *ifp;
+	char realname[IFNAMSIZ];
+	struct rte_mbuf *f;
+	struct session *s;
+	uint64_t cursor;
+	bool created;
+	int len = 22;
+	int rc;
+
+	dp_test_netlink_add_vrf(69, 1);
+
+	dp_test_nl_add_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_intf_real(IF_NAME, realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	f = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1001, 1003, 1, &len);
+	dp_test_session_establish(f, ifp, 10, &s, &created);
+
+	/* Buffer too small for even the header */
+	cursor = 0;
+	rc = dp_session_pack_bulk(buf, 4, SESSION_PACK_FULL, &cursor);
+	dp_test_fail_unless(rc == -EINVAL, "bulk pack small rc: %d\n", rc);
+
+	cursor = 0;
+	rc = dp_session_pack_bulk(buf, sizeof(buf), SESSION_PACK_FULL,
+				  &cursor);
+	dp_test_fail_unless(rc == (int)NPF_PACK_BULK_MIN_SIZE,
+			    "bulk pack full rc: %d\n", rc);
+	dp_test_fail_unless(cursor == 0, "bulk pack cursor: %lu\n", cursor);
+	bh = (struct npf_pack_bulk_hdr *)&msg->data;
+	dp_test_fail_unless(bh->count == 0, "bulk pack count: %u\n",
+			    bh->count);
+	dp_test_fail_unless(npf_pack_validate_bulk_msg(msg, rc),
+			    "bulk pack message invalid\n");
+
+	rc = dp_session_restore_bulk(buf, rc, &spt);
+	dp_test_fail_unless(rc == 0, "bulk restore rc: %d\n", rc);
+	dp_test_fail_unless(spt == SESSION_PACK_FULL,
+			    "bulk restore type: %d\n", spt);
+
+	rc = dp_session_pack_bulk(buf, sizeof(buf), SESSION_PACK_UPDATE,
+				  &cursor);
+	dp_test_fail_unless(rc == (int)NPF_PACK_BULK_MIN_SIZE,
+			    "bulk pack update rc: %d\n", rc);
+
+	/* Single session messages are not bulk messages */
+	msg->hdr.version = SESSION_PACK_VERSION;
+	rc = dp_session_restore_bulk(buf, NPF_PACK_BULK_MIN_SIZE, &spt);
+	dp_test_fail_unless(rc == -EINVAL, "bulk restore version rc: %d\n",
+			    rc);
+
+	/* A record count beyond the end of the message */
+	msg->hdr.version = SESSION_PACK_BULK_VERSION;
+	bh->count = 1;
+	rc = dp_session_restore_bulk(buf, NPF_PACK_BULK_MIN_SIZE, &spt);
+	dp_test_fail_unless(rc == -EINVAL, "bulk restore count rc: %d\n",
+			    rc);
+
+	dp_test_session_reset();
+
+	rte_pktmbuf_free(f);
+	dp_test_nl_del_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+
+	dp_test_netlink_del_vrf(69, 0);
+} DP_END_TEST;
+
+#define PACK_BULK_SESSIONS	8
+#define PACK_BULK_FULL_SIZE	(NPF_PACK_BULK_MIN_SIZE + \
+				 3 * NPF_PACK_BULK_SESSION_MAX_SIZE)
+#define PACK_BULK_UPDATE_SIZE	(NPF_PACK_BULK_MIN_SIZE + \
+				 NPF_PACK_DELTA_SESSION_MAX_SIZE)
+
+/*
+ * Pack a whole walk of the session table, a buffer at a time.  Returns the
+ * number of buffers used, and the total record count.
+ */
+static uint32_t
+dp_test_session_pack_bulk_walk(char bufs[][PACK_BULK_FULL_SIZE],
+			       uint32_t nbufs, uint32_t size,
+			       enum session_pack_type spt, uint32_t *count)
+{
+	struct npf_pack_bulk_hdr *bh;
+	struct npf_pack_message *msg;
+	uint64_t cursor = 0;
+	uint32_t i = 0;
+	int rc;
+
+	*count = 0;
+	do {
+		dp_test_fail_unless(i < nbufs, "bulk pack walk too long\n");
+		rc = dp_session_pack_bulk(bufs[i], size, spt, &cursor);
+		dp_test_fail_unless(rc > 0, "bulk pack rc: %d\n", rc);
+
+		msg = (struct npf_pack_message *)bufs[i];
+		bh = (struct npf_pack_bulk_hdr *)&msg->data;
+		*count += bh->count;
+		i++;
+	} while (cursor);
+
+	return i;
+}
+
+/* Restore the buffers from a walk, and return the number restored */
+static uint32_t
+dp_test_session_restore_bulk_walk(char bufs[][PACK_BULK_FULL_SIZE],
+				  uint32_t nbufs, enum session_pack_type exp_spt)
+{
+	struct npf_pack_message *msg;
+	enum session_pack_type spt;
+	uint32_t count = 0;
+	uint32_t i;
+	int rc;
+
+	for (i = 0; i < nbufs; i++) {
+		msg = (struct npf_pack_message *)bufs[i];
+		rc = dp_session_restore_bulk(bufs[i], msg->hdr.len, &spt);
+		dp_test_fail_unless(rc >= 0, "bulk restore rc: %d\n", rc);
+		dp_test_fail_unless(spt == exp_spt,
+				    "bulk restore type: %d\n", spt);
+		count += rc;
+	}
+	return count;
+}
+
+/*
+ * Bulk pack real firewall sessions into several buffers, and restore them
+ * after the session table has been cleared.  Then pack and restore the
+ * updates for the sessions that have seen packets since.
+ */
+DP_START_TEST(session_pack_bulk, test19)
+{
+	static char fbufs[PACK_BULK_SESSIONS][PACK_BULK_FULL_SIZE];
+	static char ubufs[PACK_BULK_SESSIONS][PACK_BULK_FULL_SIZE];
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+	uint32_t nfbufs, nubufs;
+	uint32_t count;
+	uint state;
+	uint i;
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 80,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	struct dp_test_npf_rule_t rules[] = {
+		{"10", PASS, STATEFUL, "proto=17"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "FW1_IN", .enable = 1,
+		.attach_point = "dp1T0", .fwd = FWD, .dir = "in",
+		.rules = rules
+	};
+
+	dp_test_npf_fw_add(&fw, false);
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	/* One session per source port */
+	for (i = 0; i < PACK_BULK_SESSIONS; i++) {
+		pkt.l4.udp.sport = 41000 + i;
+		test_pak = dp_test_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.rx_intf, test_exp);
+	}
+	dp_test_npf_session_count_verify(PACK_BULK_SESSIONS);
+
+	/* Room for three sessions in each buffer */
+	nfbufs = dp_test_session_pack_bulk_walk(fbufs, PACK_BULK_SESSIONS,
+						PACK_BULK_FULL_SIZE,
+						SESSION_PACK_FULL, &count);
+	dp_test_fail_unless(count == PACK_BULK_SESSIONS,
+			    "bulk pack full count: %u\n", count);
+	dp_test_fail_unless(nfbufs > 1, "bulk pack full buffers: %u\n",
+			    nfbufs);
+
+	/* Nothing has changed since the full pack */
+	dp_test_session_pack_bulk_walk(ubufs, PACK_BULK_SESSIONS,
+				       PACK_BULK_UPDATE_SIZE,
+				       SESSION_PACK_UPDATE, &count);
+	dp_test_fail_unless(count == 0, "bulk pack update count: %u\n",
+			    count);
+
+	/* Replies establish the first two sessions */
+	for (i = 0; i < 2; i++) {
+		pkt.l4.udp.sport = 41000 + i;
+		test_pak = dp_test_reverse_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_reverse_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.tx_intf, test_exp);
+	}
+
+	/* Room for one session in each buffer */
+	nubufs = dp_test_session_pack_bulk_walk(ubufs, PACK_BULK_SESSIONS,
+						PACK_BULK_UPDATE_SIZE,
+						SESSION_PACK_UPDATE, &count);
+	dp_test_fail_unless(count == 2, "bulk pack update count: %u\n",
+			    count);
+	dp_test_fail_unless(nubufs == 2, "bulk pack update buffers: %u\n",
+			    nubufs);
+
+	dp_test_session_reset();
+	dp_test_npf_session_count_verify(0);
+
+	count = dp_test_session_restore_bulk_walk(fbufs, nfbufs,
+						  SESSION_PACK_FULL);
+	dp_test_fail_unless(count == PACK_BULK_SESSIONS,
+			    "bulk restore full count: %u\n", count);
+	dp_test_npf_session_count_verify(PACK_BULK_SESSIONS);
+
+	for (i = 0; i < PACK_BULK_SESSIONS; i++) {
+		dp_test_fail_unless(dp_test_npf_session_state(
+					    "1.1.1.2", 41000 + i, "2.2.2.1", 80,
+					    IPPROTO_UDP, "dp1T0", &state),
+				    "session %u not restored\n", i);
+		dp_test_fail_unless(state == NPF_ANY_SESSION_NEW,
+				    "session %u restored state: %u\n", i,
+				    state);
+	}
+
+	count = dp_test_session_restore_bulk_walk(ubufs, nubufs,
+						  SESSION_PACK_UPDATE);
+	dp_test_fail_unless(count == 2, "bulk restore update count: %u\n",
+			    count);
+
+	for (i = 0; i < PACK_BULK_SESSIONS; i++) {
+		dp_test_npf_session_state("1.1.1.2", 41000 + i, "2.2.2.1", 80,
+					  IPPROTO_UDP, "dp1T0", &state);
+		dp_test_fail_unless(state == (i < 2 ?
+					      NPF_ANY_SESSION_ESTABLISHED :
+					      NPF_ANY_SESSION_NEW),
+				    "session %u updated state: %u\n", i,
+				    state);
+	}
+
+	dp_test_session_reset();
+	dp_test_npf_fw_del(&fw, false);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+} DP_END_TEST;
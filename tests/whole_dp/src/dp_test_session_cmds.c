@@ -158,6 +158,28 @@ static const struct dp_test_command_t session_cmd[] = {
 		true,
 		true,
 	},
+	/*
+	 * session-op show sessions after <id> [<count>]
+	 */
+	{
+		"session-op show sessions after foo",
+		"invalid session id: foo",
+		false,
+		false,
+	},
+	{
+		/* A resume session that has gone is not an error */
+		"session-op show sessions after 1 10",
+		EXP_SESSIONS,
+		true,
+		true,
+	},
+	{
+		"session-op show sessions full after 1",
+		EXP_SESSIONS,
+		true,
+		true,
+	},
 	/*
 	 * cmd_npf_clear
 	 *
@@ -260,3 +282,156 @@ DP_START_TEST(sess, test1)
 
 	dp_test_fail_unless(rc == 0, "failed bringing attach point down");
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(session_cmds, sess_paging, NULL, NULL);
+
+#define PAGING_SESSIONS		10
+#define PAGING_COUNT		4
+
+/*
+ * Fetch a page of sessions, and mark the source port of each one as seen.
+ * Returns the resume_id of the page, or 0 if it is the last page.
+ */
+static uint64_t
+dp_test_session_show_page(const char *cmd, uint *seen, uint *nr_page)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jcfg, *jsess, *jresume;
+	uint64_t resume_id = 0;
+	int port;
+
+	jresp = dp_test_json_do_show_cmd(cmd, &mismatches, false);
+	dp_test_fail_unless(jresp, "no response to \"%s\"", cmd);
+
+	dp_test_fail_unless(json_object_object_get_ex(jresp, "config",
+						      &jcfg) &&
+			    json_object_object_get_ex(jcfg, "sessions",
+						      &jsess),
+			    "\"%s\": no sessions object", cmd);
+
+	*nr_page = 0;
+	json_object_object_foreach(jsess, id, jse) {
+		dp_test_fail_unless(
+			dp_test_json_int_field_from_obj(jse, "src_port",
+							&port),
+			"\"%s\": session %s has no src_port", cmd, id);
+		port -= 41000;
+		dp_test_fail_unless(port >= 0 && port < PAGING_SESSIONS,
+				    "\"%s\": session %s unexpected", cmd, id);
+		dp_test_fail_unless(!seen[port],
+				    "\"%s\": session %s repeated", cmd, id);
+		seen[port]++;
+		(*nr_page)++;
+	}
+
+	if (json_object_object_get_ex(jcfg, "resume_id", &jresume))
+		resume_id = json_object_get_int64(jresume);
+
+	json_object_put(jresp);
+	return resume_id;
+}
+
+/*
+ * Page through more sessions than fit on one page with "after <resume_id>",
+ * and check that each session is returned exactly once.
+ */
+DP_START_TEST(sess_paging, after)
+{
+	uint seen[PAGING_SESSIONS] = { 0 };
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+	uint64_t resume_id;
+	uint nr_page, total, pages;
+	char cmd[64];
+	uint i;
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 80,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	struct dp_test_npf_rule_t rules[] = {
+		{"10", PASS, STATEFUL, "proto=17"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "FW1_IN", .enable = 1,
+		.attach_point = "dp1T0", .fwd = FWD, .dir = "in",
+		.rules = rules
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	dp_test_npf_fw_add(&fw, false);
+
+	/* One session per source port */
+	for (i = 0; i < PAGING_SESSIONS; i++) {
+		pkt.l4.udp.sport = 41000 + i;
+		test_pak = dp_test_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.rx_intf, test_exp);
+	}
+	dp_test_npf_session_count_verify(PAGING_SESSIONS);
+
+	snprintf(cmd, sizeof(cmd), "session-op show sessions 0 %u",
+		 PAGING_COUNT);
+	resume_id = dp_test_session_show_page(cmd, seen, &nr_page);
+	dp_test_fail_unless(nr_page == PAGING_COUNT && resume_id,
+			    "first page: %u sessions, resume_id %lu",
+			    nr_page, resume_id);
+	total = nr_page;
+	pages = 1;
+
+	while (resume_id) {
+		snprintf(cmd, sizeof(cmd),
+			 "session-op show sessions after %lu %u",
+			 resume_id, PAGING_COUNT);
+		resume_id = dp_test_session_show_page(cmd, seen, &nr_page);
+		dp_test_fail_unless(nr_page <= PAGING_COUNT,
+				    "page %u: %u sessions", pages + 1,
+				    nr_page);
+		dp_test_fail_unless(resume_id == 0 || nr_page == PAGING_COUNT,
+				    "page %u: %u sessions before the end",
+				    pages + 1, nr_page);
+		total += nr_page;
+		pages++;
+		dp_test_fail_unless(pages <= PAGING_SESSIONS,
+				    "paging does not end");
+	}
+
+	/* No gaps */
+	dp_test_fail_unless(total == PAGING_SESSIONS,
+			    "%u sessions returned, expected %u", total,
+			    PAGING_SESSIONS);
+	for (i = 0; i < PAGING_SESSIONS; i++)
+		dp_test_fail_unless(seen[i] == 1, "session %u not returned",
+				    i);
+
+	dp_test_npf_cleanup();
+	dp_test_npf_fw_del(&fw, false);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+} DP_END_TEST;
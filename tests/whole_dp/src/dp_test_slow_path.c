@@ -17,6 +17,8 @@
 #include "if/gre.h"
 
 #include "dp_test.h"
+#include "dp_test_console.h"
+#include "dp_test_json_utils.h"
 #include "dp_test_lib_internal.h"
 #include "dp_test_lib_intf_internal.h"
 #include "dp_test_lib_exp.h"
@@ -191,3 +193,87 @@ DP_START_TEST(slow_dp_pkt, test_spath_gre)
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "1.1.2.1/24");
 
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(slow_suite, slow_dp_threads, NULL, NULL);
+
+/*
+ * Get the shadow thread of an interface from the "slowpath" command.
+ */
+static int
+dp_test_shadow_thread(const char *ifname)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jintf;
+	char cmd[DP_TEST_TMP_BUF_SMALL];
+	int thread = -1;
+
+	struct dp_test_json_find_key key[] = {
+		{ "interfaces", NULL },
+		{ "name", ifname },
+	};
+
+	snprintf(cmd, sizeof(cmd), "slowpath %s", ifname);
+	jresp = dp_test_json_do_show_cmd(cmd, &mismatches, false);
+	dp_test_fail_unless(jresp, "no response to \"%s\"", cmd);
+
+	jintf = dp_test_json_find(jresp, key, ARRAY_SIZE(key));
+	dp_test_fail_unless(jintf, "no slowpath entry for %s", ifname);
+	dp_test_fail_unless(dp_test_json_int_field_from_obj(jintf, "thread",
+							    &thread),
+			    "no thread for %s", ifname);
+
+	json_object_put(jintf);
+	json_object_put(jresp);
+	return thread;
+}
+
+/*
+ * Ports are shared out between the shadow threads by port number, and the
+ * slow path interface belongs to the first thread.  Packets from the kernel
+ * are forwarded on a port that belongs to the second thread.
+ */
+DP_START_TEST(slow_dp_threads, port_owner)
+{
+	static const char * const intfs[] = {
+		"dp1T0", "dp1T1", "dp1T2", "dp1T3",
+	};
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	char real_ifname[IFNAMSIZ];
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	const char *intf = NULL;
+	int len = 22;
+	unsigned int i;
+	portid_t port;
+	int thread;
+
+	dp_test_fail_unless(dp_test_shadow_thread(".spathintf") == 0,
+			    ".spathintf is not on shadow thread 0");
+
+	for (i = 0; i < ARRAY_SIZE(intfs); i++) {
+		dp_test_intf_real(intfs[i], real_ifname);
+		port = dp_test_intf_name2port(real_ifname);
+
+		thread = dp_test_shadow_thread(real_ifname);
+		dp_test_fail_unless(thread ==
+				    (int)(port % DP_TEST_SHADOW_THREADS),
+				    "%s port %u on shadow thread %d",
+				    intfs[i], port, thread);
+		if (thread == 1 && !intf)
+			intf = intfs[i];
+	}
+	dp_test_fail_unless(intf, "no interface on shadow thread 1");
+
+	test_pak = dp_test_create_ipv4_pak("10.73.0.10", "1.1.1.2", 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak, nh_mac_str,
+				 dp_test_intf_name2mac_str(intf),
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, intf);
+	dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp), nh_mac_str,
+				 dp_test_intf_name2mac_str(intf),
+				 RTE_ETHER_TYPE_IPV4);
+
+	dp_test_send_slowpath_pkt(test_pak, exp);
+} DP_END_TEST;
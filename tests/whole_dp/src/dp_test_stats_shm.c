@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane shared memory statistics export tests
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dp_stats_shm.h"
+
+#include "dp_test.h"
+#include "dp_test_console.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_npf_fw_lib.h"
+#include "dp_test/dp_test_cmd_check.h"
+#include "dp_test/dp_test_lib_intf.h"
+
+/* Long enough that the timer does not publish during a test */
+#define STATS_SHM_TEST_INTERVAL	3600000
+
+/* Packets forwarded between snapshots */
+#define STATS_SHM_TEST_PKTS	5
+
+DP_DECL_TEST_SUITE(stats_shm_suite);
+
+DP_DECL_TEST_CASE(stats_shm_suite, stats_shm_cmd, NULL, NULL);
+
+static void
+dp_test_stats_shm_cmd(const char *cmd)
+{
+	char *reply;
+	bool err;
+
+	reply = dp_test_console_request_w_err(cmd, &err, false);
+	dp_test_fail_unless(!err, "\"%s\" failed: %s", cmd,
+			    reply ? reply : "");
+	free(reply);
+}
+
+static void
+dp_test_check_stats_shm(bool enabled, unsigned int interval_ms)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{ \"stats-shm\": "
+		"  { \"enabled\": %s, "
+		"    \"interval_ms\": %u "
+		"  } "
+		"}",
+		enabled ? "true" : "false", interval_ms);
+	dp_test_check_json_state("stats-shm show", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * Publish a snapshot, by enabling the export again, and map the segment.
+ * The master has finished writing it by the time the command returns.
+ */
+static const struct dp_stats_shm_hdr *
+dp_test_stats_shm_snapshot(size_t *len)
+{
+	const struct dp_stats_shm_hdr *hdr;
+	char cmd[64];
+	struct stat st;
+	int fd;
+
+	snprintf(cmd, sizeof(cmd), "stats-shm enable %u",
+		 STATS_SHM_TEST_INTERVAL);
+	dp_test_stats_shm_cmd(cmd);
+
+	fd = shm_open(DP_STATS_SHM_NAME, O_RDONLY, 0);
+	dp_test_fail_unless(fd >= 0, "cannot open %s", DP_STATS_SHM_NAME);
+	dp_test_fail_unless(fstat(fd, &st) == 0, "cannot stat %s",
+			    DP_STATS_SHM_NAME);
+
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	dp_test_fail_unless(hdr != MAP_FAILED, "cannot map %s",
+			    DP_STATS_SHM_NAME);
+
+	dp_test_fail_unless(hdr->magic == DP_STATS_SHM_MAGIC,
+			    "bad magic 0x%x", hdr->magic);
+	dp_test_fail_unless(hdr->version == DP_STATS_SHM_VERSION,
+			    "bad version %u", hdr->version);
+	dp_test_fail_unless((hdr->seq & 1) == 0 && hdr->generation > 0,
+			    "no snapshot published");
+	dp_test_fail_unless(hdr->size <= (uint64_t)st.st_size,
+			    "size %" PRIu64 " beyond segment", hdr->size);
+
+	*len = st.st_size;
+	return hdr;
+}
+
+static const void *
+dp_test_stats_shm_rec(const struct dp_stats_shm_hdr *hdr,
+		      enum dp_stats_shm_section_type type, unsigned int i)
+{
+	const struct dp_stats_shm_section *sect = &hdr->sections[type];
+
+	return (const char *)hdr + sect->offset + i * sect->rec_len;
+}
+
+/* Sum an interface's per-lcore received and sent packets */
+static void
+dp_test_stats_shm_if_pkts(const struct dp_stats_shm_hdr *hdr,
+			  const char *ifname, uint64_t *ipkts, uint64_t *opkts)
+{
+	const struct dp_stats_shm_section *sect;
+	const struct dp_stats_shm_if *rec;
+	char real_ifname[IFNAMSIZ];
+	unsigned int i, lcore;
+
+	dp_test_intf_real(ifname, real_ifname);
+	sect = &hdr->sections[DP_STATS_SHM_SECT_IF];
+	for (i = 0; i < sect->count; i++) {
+		rec = dp_test_stats_shm_rec(hdr, DP_STATS_SHM_SECT_IF, i);
+		if (strcmp(rec->ifname, real_ifname) != 0)
+			continue;
+
+		*ipkts = *opkts = 0;
+		for (lcore = 0; lcore < hdr->nr_lcores; lcore++) {
+			*ipkts += rec->lcore[lcore].ipackets;
+			*opkts += rec->lcore[lcore].opackets;
+		}
+		return;
+	}
+	dp_test_fail("no record for %s", real_ifname);
+}
+
+/* Sum a rule's per-lcore packets */
+static uint64_t
+dp_test_stats_shm_rule_pkts(const struct dp_stats_shm_hdr *hdr,
+			    const char *ruleset, const char *group,
+			    uint32_t rule_no)
+{
+	const struct dp_stats_shm_section *sect;
+	const struct dp_stats_shm_rule *rec;
+	unsigned int i, lcore;
+	uint64_t pkts = 0;
+
+	sect = &hdr->sections[DP_STATS_SHM_SECT_RULE];
+	for (i = 0; i < sect->count; i++) {
+		rec = dp_test_stats_shm_rec(hdr, DP_STATS_SHM_SECT_RULE, i);
+		if (rec->rule_no != rule_no ||
+		    strcmp(rec->ruleset, ruleset) != 0 ||
+		    strcmp(rec->group, group) != 0)
+			continue;
+
+		for (lcore = 0; lcore < hdr->nr_lcores; lcore++)
+			pkts += rec->lcore[lcore].packets;
+		return pkts;
+	}
+	dp_test_fail("no record for %s %s rule %u", ruleset, group, rule_no);
+	return 0;
+}
+
+/*
+ * Enabling the export publishes a snapshot straight away, with a record
+ * for each interface, and disabling it removes the segment.
+ */
+DP_START_TEST(stats_shm_cmd, enable_disable)
+{
+	const struct dp_stats_shm_hdr *hdr;
+	uint64_t ipkts, opkts;
+	size_t len;
+	int fd;
+
+	dp_test_check_stats_shm(false, 0);
+
+	hdr = dp_test_stats_shm_snapshot(&len);
+	dp_test_check_stats_shm(true, STATS_SHM_TEST_INTERVAL);
+	dp_test_stats_shm_if_pkts(hdr, "dp1T0", &ipkts, &opkts);
+	munmap((void *)hdr, len);
+
+	dp_test_stats_shm_cmd("stats-shm disable");
+	dp_test_check_stats_shm(false, 0);
+
+	fd = shm_open(DP_STATS_SHM_NAME, O_RDONLY, 0);
+	dp_test_fail_unless(fd < 0, "%s not removed", DP_STATS_SHM_NAME);
+} DP_END_TEST;
+
+/*
+ * Packets forwarded between two snapshots are added to the counters of the
+ * input and output interfaces, and of the firewall rule they matched.
+ */
+DP_START_TEST(stats_shm_cmd, counters)
+{
+	uint64_t in_before, in_after, out_before, out_after, unused;
+	uint64_t rule_before, rule_after;
+	const struct dp_stats_shm_hdr *hdr;
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+	unsigned int i;
+	size_t len;
+
+	struct dp_test_pkt_desc_t pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 41001,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	struct dp_test_npf_rule_t rules[] = {
+		{"10", PASS, STATELESS, "proto=17"},
+		RULE_DEF_BLOCK,
+		NULL_RULE };
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "SHM_IN", .enable = 1,
+		.attach_point = "dp1T0", .fwd = FWD, .dir = "in",
+		.rules = rules
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+	dp_test_npf_fw_add(&fw, false);
+
+	hdr = dp_test_stats_shm_snapshot(&len);
+	dp_test_stats_shm_if_pkts(hdr, "dp1T0", &in_before, &unused);
+	dp_test_stats_shm_if_pkts(hdr, "dp2T1", &unused, &out_before);
+	rule_before = dp_test_stats_shm_rule_pkts(hdr, "fw-in", "SHM_IN", 10);
+	munmap((void *)hdr, len);
+
+	for (i = 0; i < STATS_SHM_TEST_PKTS; i++) {
+		test_pak = dp_test_v4_pkt_from_desc(&pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, &pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_FORWARDED);
+		dp_test_pak_receive(test_pak, pkt.rx_intf, test_exp);
+	}
+
+	hdr = dp_test_stats_shm_snapshot(&len);
+	dp_test_stats_shm_if_pkts(hdr, "dp1T0", &in_after, &unused);
+	dp_test_stats_shm_if_pkts(hdr, "dp2T1", &unused, &out_after);
+	rule_after = dp_test_stats_shm_rule_pkts(hdr, "fw-in", "SHM_IN", 10);
+	munmap((void *)hdr, len);
+
+	dp_test_fail_unless(in_after - in_before == STATS_SHM_TEST_PKTS,
+			    "dp1T0 received %" PRIu64 ", expected %u",
+			    in_after - in_before, STATS_SHM_TEST_PKTS);
+	dp_test_fail_unless(out_after - out_before == STATS_SHM_TEST_PKTS,
+			    "dp2T1 sent %" PRIu64 ", expected %u",
+			    out_after - out_before, STATS_SHM_TEST_PKTS);
+	dp_test_fail_unless(rule_after - rule_before == STATS_SHM_TEST_PKTS,
+			    "rule 10 matched %" PRIu64 ", expected %u",
+			    rule_after - rule_before, STATS_SHM_TEST_PKTS);
+
+	dp_test_stats_shm_cmd("stats-shm disable");
+
+	dp_test_npf_fw_del(&fw, false);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+} DP_END_TEST;